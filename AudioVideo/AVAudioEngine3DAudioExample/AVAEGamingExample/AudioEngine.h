@@ -7,12 +7,17 @@
                     AVAudioEngine           *_engine;
                     AVAudioEnvironmentNode  *_environment;
                     AVAudioPCMBuffer        *_collisionSoundBuffer;
-                    NSMutableArray          *_collisionPlayerArray;
+                    NSArray                 *_collisionPlayers;
+                    AVAudioMixerNode        *_pannedMixer;
+                    SpatialVoicePool        *_voicePool;
                     AVAudioPlayerNode       *_launchSoundPlayer;
                     AVAudioPCMBuffer        *_launchSoundBuffer;
                     bool                    _multichannelOutputEnabled;
     
                  It creates and connects all the nodes, loads the buffers as well as controls the AVAudioEngine object itself.
+                 Collision sounds play on a fixed pool of players that is set up once.
+                 The pool's first players are spatialized by the environment node, the rest are panned on the CPU and mixed in
+                 through _pannedMixer when the spatial players are all busy with louder sounds. See SpatialVoicePool.h.
 */
 
 @import Foundation;
@@ -32,9 +37,6 @@
 @property (weak) id<AudioEngineDelegate> delegate;
 @property (nonatomic, getter=isRunning) BOOL running;
 
-- (void)createPlayerForSCNNode:(SCNNode *)node;
-- (void)destroyPlayerForSCNNode:(SCNNode *)node;
-
 - (void)playCollisionSoundForSCNNode:(SCNNode *)node position:(AVAudio3DPoint)position impulse:(float)impulse;
 - (void)playLaunchSoundAtPosition:(AVAudio3DPoint)position completionHandler:(AVAudioNodeCompletionHandler)completionHandler;
 
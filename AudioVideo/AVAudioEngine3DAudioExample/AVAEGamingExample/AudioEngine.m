@@ -7,21 +7,33 @@
                     AVAudioEngine           *_engine;
                     AVAudioEnvironmentNode  *_environment;
                     AVAudioPCMBuffer        *_collisionSoundBuffer;
-                    NSMutableArray          *_collisionPlayerArray;
+                    NSArray                 *_collisionPlayers;
+                    AVAudioMixerNode        *_pannedMixer;
+                    SpatialVoicePool        *_voicePool;
                     AVAudioPlayerNode       *_launchSoundPlayer;
                     AVAudioPCMBuffer        *_launchSoundBuffer;
                     bool                    _multichannelOutputEnabled;
     
                  It creates and connects all the nodes, loads the buffers as well as controls the AVAudioEngine object itself.
+                 Collision sounds play on a fixed pool of players that is set up once.
+                 The pool's first players are spatialized by the environment node, the rest are panned on the CPU and mixed in
+                 through _pannedMixer when the spatial players are all busy with louder sounds. See SpatialVoicePool.h.
 */
 
 #import "AudioEngine.h"
+#import "SpatialVoicePool.h"
+
+// how many collision sounds can play at once, spatialized and CPU panned
+static const uint32_t kNumSpatialCollisionVoices = 8;
+static const uint32_t kNumPannedCollisionVoices = 8;
 
 @interface AudioEngine () {
     AVAudioEngine                       *_engine;
     AVAudioEnvironmentNode              *_environment;
     AVAudioPCMBuffer                    *_collisionSoundBuffer;
-    NSMutableArray <AVAudioPlayerNode*> *_collisionPlayerArray;
+    NSArray <AVAudioPlayerNode*>        *_collisionPlayers;     // spatial players first, then panned ones
+    AVAudioMixerNode                    *_pannedMixer;
+    SpatialVoicePool                    *_voicePool;            // guarded by @synchronized(self)
     AVAudioPlayerNode                   *_launchSoundPlayer;
     AVAudioPCMBuffer                    *_launchSoundBuffer;
     bool                                _multichannelOutputEnabled;
@@ -72,12 +84,34 @@
         _environment = [[AVAudioEnvironmentNode alloc] init];
         [_engine attachNode:_environment];
         
-        // array that keeps track of all the collision players
-        _collisionPlayerArray = [[NSMutableArray alloc] init];
-        
         // load the collision sound into a buffer
         _collisionSoundBuffer = [self loadSoundIntoBuffer:@"bounce"];
         
+        // set up the pool of collision players once, so that a collision never has to create a node or change the graph
+        NSMutableArray <AVAudioPlayerNode*> *collisionPlayers = [[NSMutableArray alloc] init];
+        for (uint32_t i = 0; i < kNumSpatialCollisionVoices + kNumPannedCollisionVoices; i++) {
+            AVAudioPlayerNode *player = [[AVAudioPlayerNode alloc] init];
+            [_engine attachNode:player];
+            [collisionPlayers addObject:player];
+            
+            // turn up the reverb blend for the spatial players
+            if (i < kNumSpatialCollisionVoices) player.reverbBlend = 0.3;
+        }
+        _collisionPlayers = collisionPlayers;
+        
+        // the panned players are mixed down to stereo, which the environment node passes through without spatializing
+        _pannedMixer = [[AVAudioMixerNode alloc] init];
+        [_engine attachNode:_pannedMixer];
+        
+        // decide which collisions get which players with the same distance attenuation the environment node uses
+        AVAudioEnvironmentDistanceAttenuationParameters *distanceParameters = _environment.distanceAttenuationParameters;
+        SpatialVoicePoolParameters voicePoolParameters;
+        SpatialVoicePoolGetDefaultParameters(&voicePoolParameters);
+        voicePoolParameters.referenceDistance = distanceParameters.referenceDistance;
+        voicePoolParameters.maximumDistance = distanceParameters.maximumDistance;
+        voicePoolParameters.rolloffFactor = distanceParameters.rolloffFactor;
+        _voicePool = SpatialVoicePoolCreate(kNumSpatialCollisionVoices, kNumPannedCollisionVoices, &voicePoolParameters);
+        
         // load the launch sound into a buffer
         _launchSoundBuffer = [self loadSoundIntoBuffer:@"launchSound"];
         
@@ -124,6 +158,11 @@
     return self;
 }
 
+- (void)dealloc
+{
+    SpatialVoicePoolDispose(_voicePool);
+}
+
 - (void)makeEngineConnections
 {
     [_engine connect:_launchSoundPlayer to:_environment format:_launchSoundBuffer.format];
@@ -132,11 +171,18 @@
     // if we're connecting with a multichannel format, we need to pick a multichannel rendering algorithm
     AVAudio3DMixingRenderingAlgorithm renderingAlgo = _multichannelOutputEnabled ? AVAudio3DMixingRenderingAlgorithmSoundField : AVAudio3DMixingRenderingAlgorithmEqualPowerPanning;
     
-    // if we already have a pool of collision players, connect all of them to the environment
-    for (int i = 0; i < _collisionPlayerArray.count; i++) {
-        [_engine connect:_collisionPlayerArray[i] to:_environment format:_collisionSoundBuffer.format];
-        _collisionPlayerArray[i].renderingAlgorithm = renderingAlgo;
+    // connect the spatial collision players to the environment, and the panned ones to it through the panned mixer
+    for (uint32_t i = 0; i < _collisionPlayers.count; i++) {
+        if (i < kNumSpatialCollisionVoices) {
+            [_engine connect:_collisionPlayers[i] to:_environment format:_collisionSoundBuffer.format];
+            _collisionPlayers[i].renderingAlgorithm = renderingAlgo;
+        }
+        else {
+            [_engine connect:_collisionPlayers[i] to:_pannedMixer format:_collisionSoundBuffer.format];
+        }
     }
+    AVAudioFormat *pannedMixerFormat = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:_collisionSoundBuffer.format.sampleRate channels:2];
+    [_engine connect:_pannedMixer to:_environment format:pannedMixerFormat];
 }
 
 - (void)startEngine
@@ -201,39 +247,41 @@
     return environmentOutputConnectionFormat;
 }
 
-- (void)createPlayerForSCNNode:(SCNNode *)node
-{
-    // create a new player and connect it to the environment node
-    AVAudioPlayerNode *newPlayer = [[AVAudioPlayerNode alloc] init];
-    [_engine attachNode:newPlayer];
-    [_engine connect:newPlayer to:_environment format:_collisionSoundBuffer.format];
-    [_collisionPlayerArray insertObject:newPlayer atIndex:[node.name integerValue]];
-    
-    // pick a rendering algorithm based on the rendering format
-    AVAudio3DMixingRenderingAlgorithm renderingAlgo = _multichannelOutputEnabled ? AVAudio3DMixingRenderingAlgorithmSoundField : AVAudio3DMixingRenderingAlgorithmEqualPowerPanning;
-    newPlayer.renderingAlgorithm = renderingAlgo;
-    
-    // turn up the reverb blend for this player
-    newPlayer.reverbBlend = 0.3;
-}
-
-- (void)destroyPlayerForSCNNode:(SCNNode *)node
-{
-    NSInteger playerIndex = [node.name integerValue];
-    AVAudioPlayerNode *player = _collisionPlayerArray[playerIndex];
-    [player stop];
-    [_engine disconnectNodeOutput:player];
-}
-
 - (void)playCollisionSoundForSCNNode:(SCNNode *)node position:(AVAudio3DPoint)position impulse:(float)impulse
 {
     if (_engine.isRunning) {
-        NSInteger playerIndex = [node.name integerValue];
-        AVAudioPlayerNode *player = _collisionPlayerArray[playerIndex];
+        float volume = [self calculateVolumeForImpulse:impulse];
+        float rate = [self calculatePlaybackRateForImpulse:impulse];
+        double duration = _collisionSoundBuffer.frameLength / _collisionSoundBuffer.format.sampleRate;
+        SpatialVoicePoint voicePosition = { position.x, position.y, position.z };
+        
+        // pick a player, unless the collision is too quiet to hear or every player is busy with a louder one
+        int32_t voice;
+        BOOL isSpatial;
+        float pan = 0, distanceGain = 1;
+        @synchronized(self) {
+            voice = SpatialVoicePoolAllocateVoice(_voicePool, [node.name integerValue], voicePosition, volume, duration, rate, CACurrentMediaTime());
+            if (voice == kSpatialVoicePool_NoVoice) return;
+            
+            isSpatial = SpatialVoicePoolIsSpatialVoice(_voicePool, voice);
+            if (!isSpatial) {
+                SpatialVoicePoolPan(_voicePool, voicePosition, &pan, NULL, NULL);
+                distanceGain = SpatialVoicePoolDistanceGain(_voicePool, voicePosition);
+            }
+        }
+        
+        AVAudioPlayerNode *player = _collisionPlayers[voice];
         [player scheduleBuffer:_collisionSoundBuffer atTime:nil options:AVAudioPlayerNodeBufferInterrupts completionHandler:nil];
-        player.position = position;
-        player.volume = [self calculateVolumeForImpulse:impulse];
-        player.rate = [self calculatePlaybackRateForImpulse:impulse];
+        if (isSpatial) {
+            player.position = position;
+            player.volume = volume;
+            player.rate = rate;
+        }
+        else {
+            // the mixer doesn't do distance or rate, so the panned players only follow the position
+            player.pan = pan;
+            player.volume = volume * distanceGain;
+        }
         [player play];
     }
 }
@@ -280,6 +328,7 @@
 - (void)updateListenerPosition:(AVAudio3DPoint)position
 {
     _environment.listenerPosition = position;
+    [self updateVoicePoolListener];
 }
 
 - (AVAudio3DPoint)listenerPosition
@@ -290,6 +339,15 @@
 - (void)updateListenerOrientation:(AVAudio3DAngularOrientation)orientation
 {
     _environment.listenerAngularOrientation = orientation;
+    [self updateVoicePoolListener];
+}
+
+- (void)updateVoicePoolListener
+{
+    AVAudio3DPoint position = _environment.listenerPosition;
+    @synchronized(self) {
+        SpatialVoicePoolSetListener(_voicePool, (SpatialVoicePoint){ position.x, position.y, position.z }, _environment.listenerAngularOrientation.yaw);
+    }
 }
 
 - (AVAudio3DAngularOrientation)listenerAngularOrientation
@@ -351,8 +409,11 @@
         _isSessionInterrupted = YES;
         
         //stop the playback of the nodes
-        for (int i = 0; i < _collisionPlayerArray.count; i++)
-             [[_collisionPlayerArray objectAtIndex:i] stop];
+        for (int i = 0; i < _collisionPlayers.count; i++)
+             [[_collisionPlayers objectAtIndex:i] stop];
+        @synchronized(self) {
+            SpatialVoicePoolReleaseAllVoices(_voicePool);
+        }
         
         if ([self.delegate respondsToSelector:@selector(engineWasInterrupted)]) {
             [self.delegate engineWasInterrupted];
@@ -441,9 +502,10 @@
     
     [_engine attachNode:_environment];
     [_engine attachNode:_launchSoundPlayer];
+    [_engine attachNode:_pannedMixer];
     
-    for (int i = 0; i < _collisionPlayerArray.count; i++)
-        [_engine attachNode:[_collisionPlayerArray objectAtIndex:i]];
+    for (int i = 0; i < _collisionPlayers.count; i++)
+        [_engine attachNode:[_collisionPlayers objectAtIndex:i]];
     
 }
 
@@ -112,9 +112,6 @@ static float randFloat(float min, float max){
     ball.physicsBody = [SCNPhysicsBody dynamicBody];
     ball.physicsBody.restitution = 1.2; //bounce!
     
-    // create an AVAudioEngine player which will be tied to this ball
-    [_audioEngine createPlayerForSCNNode:ball];
-    
     [self.gameView.scene.rootNode addChildNode:ball];
     
     // bias the direction towards one of the side walls
@@ -130,7 +127,6 @@ static float randFloat(float min, float max){
 
 - (void)removeBall:(SCNNode *)ball
 {
-    [_audioEngine destroyPlayerForSCNNode:ball];
     [ball removeFromParentNode];
 }
 
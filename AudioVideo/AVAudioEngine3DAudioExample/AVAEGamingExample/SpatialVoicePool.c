@@ -0,0 +1,230 @@
+/*
+    Copyright (C) 2016 Apple Inc. All Rights Reserved.
+    See LICENSE.txt for this sample’s licensing information
+
+    Abstract:
+    SpatialVoicePool decides which of a fixed set of player voices each collision sound plays on.
+*/
+
+#include "SpatialVoicePool.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct SpatialVoice {
+    uint64_t    emitterID;
+    float       audibility;     // the gain the sound reaches the listener with
+    double      startTime;
+    double      endTime;        // the voice is free from here on
+} SpatialVoice;
+
+struct SpatialVoicePool {
+    SpatialVoicePoolParameters  parameters;
+    uint32_t                    spatialVoiceCount;
+    uint32_t                    voiceCount;
+    SpatialVoice               *voices;
+
+    SpatialVoicePoint           listenerPosition;
+    float                       listenerRight[2];   // x and z of the listener's right hand direction
+
+    SpatialVoicePoolStatistics  statistics;
+};
+
+static float Distance(SpatialVoicePoint a, SpatialVoicePoint b)
+{
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// How much a voice is worth keeping at time now. A sound that has played out is worth nothing, and one that
+// has nearly finished is worth less than one that has just started.
+static float VoicePriority(const SpatialVoice *voice, double now)
+{
+    if (now >= voice->endTime) return 0.0f;
+
+    double remaining = (voice->endTime - now) / (voice->endTime - voice->startTime);
+    return voice->audibility * (float)remaining;
+}
+
+// The voice in [first, last) that is free or else least worth keeping.
+static uint32_t LowestPriorityVoice(const SpatialVoicePool *pool, uint32_t first, uint32_t last, double now, float *outPriority)
+{
+    uint32_t lowest = first;
+    float lowestPriority = INFINITY;
+
+    for (uint32_t i = first; i < last; ++i) {
+        float priority = VoicePriority(&pool->voices[i], now);
+        if (priority < lowestPriority) {
+            lowest = i;
+            lowestPriority = priority;
+            if (priority == 0.0f) break;
+        }
+    }
+
+    *outPriority = lowestPriority;
+    return lowest;
+}
+
+void SpatialVoicePoolGetDefaultParameters(SpatialVoicePoolParameters *outParameters)
+{
+    outParameters->referenceDistance = 1.0f;
+    outParameters->maximumDistance = 100000.0f;
+    outParameters->rolloffFactor = 1.0f;
+    outParameters->cullingGain = 0.001f;
+}
+
+SpatialVoicePool *SpatialVoicePoolCreate(uint32_t spatialVoiceCount, uint32_t pannedVoiceCount, const SpatialVoicePoolParameters *parameters)
+{
+    if (spatialVoiceCount + pannedVoiceCount == 0) return NULL;
+
+    SpatialVoicePool *pool = (SpatialVoicePool *)calloc(1, sizeof(SpatialVoicePool));
+    if (pool == NULL) return NULL;
+
+    pool->voiceCount = spatialVoiceCount + pannedVoiceCount;
+    pool->voices = (SpatialVoice *)calloc(pool->voiceCount, sizeof(SpatialVoice));
+    if (pool->voices == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    if (parameters) pool->parameters = *parameters;
+    else SpatialVoicePoolGetDefaultParameters(&pool->parameters);
+
+    pool->spatialVoiceCount = spatialVoiceCount;
+    SpatialVoicePoolReleaseAllVoices(pool);
+    SpatialVoicePoolSetListener(pool, (SpatialVoicePoint){ 0.0f, 0.0f, 0.0f }, 0.0f);
+
+    return pool;
+}
+
+void SpatialVoicePoolDispose(SpatialVoicePool *pool)
+{
+    if (pool == NULL) return;
+
+    free(pool->voices);
+    free(pool);
+}
+
+void SpatialVoicePoolSetListener(SpatialVoicePool *pool, SpatialVoicePoint listenerPosition, float listenerYaw)
+{
+    // The listener faces -z at a yaw of 0, with +x to its right, and turns to the right as the yaw goes up.
+    float yaw = listenerYaw * (float)(M_PI / 180.0);
+
+    pool->listenerPosition = listenerPosition;
+    pool->listenerRight[0] = cosf(yaw);
+    pool->listenerRight[1] = sinf(yaw);
+}
+
+int32_t SpatialVoicePoolAllocateVoice(SpatialVoicePool *pool, uint64_t emitterID, SpatialVoicePoint position, float gain,
+                                      double duration, float rate, double now)
+{
+    pool->statistics.requests++;
+
+    float audibility = gain * SpatialVoicePoolDistanceGain(pool, position);
+    if (audibility < pool->parameters.cullingGain || duration <= 0.0 || rate <= 0.0f) {
+        pool->statistics.culled++;
+        return kSpatialVoicePool_NoVoice;
+    }
+
+    // An emitter that is still sounding restarts on its own voice.
+    uint32_t voice = pool->voiceCount;
+    for (uint32_t i = 0; i < pool->voiceCount; ++i) {
+        if (pool->voices[i].emitterID == emitterID && now < pool->voices[i].endTime) {
+            voice = i;
+            break;
+        }
+    }
+
+    if (voice == pool->voiceCount) {
+        // Take a spatial voice if one is free or quieter, then a panned one.
+        float priority;
+        voice = LowestPriorityVoice(pool, 0, pool->spatialVoiceCount, now, &priority);
+
+        if (priority >= audibility) {
+            voice = LowestPriorityVoice(pool, pool->spatialVoiceCount, pool->voiceCount, now, &priority);
+
+            if (priority >= audibility) {
+                pool->statistics.rejected++;
+                return kSpatialVoicePool_NoVoice;
+            }
+            pool->statistics.fallbacks++;
+        }
+
+        if (priority > 0.0f) pool->statistics.stolen++;
+    }
+
+    SpatialVoice *v = &pool->voices[voice];
+    v->emitterID = emitterID;
+    v->audibility = audibility;
+    v->startTime = now;
+    v->endTime = now + (voice < pool->spatialVoiceCount ? duration / rate : duration);
+
+    return (int32_t)voice;
+}
+
+void SpatialVoicePoolReleaseVoice(SpatialVoicePool *pool, int32_t voice)
+{
+    if (voice < 0 || (uint32_t)voice >= pool->voiceCount) return;
+
+    pool->voices[voice].endTime = -INFINITY;
+}
+
+void SpatialVoicePoolReleaseAllVoices(SpatialVoicePool *pool)
+{
+    for (uint32_t i = 0; i < pool->voiceCount; ++i) {
+        pool->voices[i].endTime = -INFINITY;
+    }
+}
+
+bool SpatialVoicePoolIsSpatialVoice(const SpatialVoicePool *pool, int32_t voice)
+{
+    return voice >= 0 && (uint32_t)voice < pool->spatialVoiceCount;
+}
+
+uint32_t SpatialVoicePoolGetActiveVoiceCount(const SpatialVoicePool *pool, double now)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < pool->voiceCount; ++i) {
+        if (now < pool->voices[i].endTime) ++count;
+    }
+    return count;
+}
+
+void SpatialVoicePoolGetStatistics(const SpatialVoicePool *pool, SpatialVoicePoolStatistics *outStatistics)
+{
+    *outStatistics = pool->statistics;
+}
+
+float SpatialVoicePoolDistanceGain(const SpatialVoicePool *pool, SpatialVoicePoint position)
+{
+    const SpatialVoicePoolParameters *p = &pool->parameters;
+
+    float distance = Distance(position, pool->listenerPosition);
+    if (distance > p->maximumDistance) distance = p->maximumDistance;
+    if (distance <= p->referenceDistance) return 1.0f;
+
+    return p->referenceDistance / (p->referenceDistance + p->rolloffFactor * (distance - p->referenceDistance));
+}
+
+void SpatialVoicePoolPan(const SpatialVoicePool *pool, SpatialVoicePoint position, float *outPan, float *outLeftGain, float *outRightGain)
+{
+    // Pan by how far to the listener's right the sound is, in the horizontal plane. Straight above, below or on
+    // top of the listener is the center.
+    float dx = position.x - pool->listenerPosition.x;
+    float dz = position.z - pool->listenerPosition.z;
+    float horizontalDistance = sqrtf(dx * dx + dz * dz);
+
+    float pan = 0.0f;
+    if (horizontalDistance > 1.0e-6f) {
+        pan = (dx * pool->listenerRight[0] + dz * pool->listenerRight[1]) / horizontalDistance;
+        if (pan < -1.0f) pan = -1.0f;
+        if (pan > 1.0f) pan = 1.0f;
+    }
+
+    float gain = SpatialVoicePoolDistanceGain(pool, position);
+    float angle = (pan + 1.0f) * (float)(M_PI / 4.0);
+
+    if (outPan) *outPan = pan;
+    if (outLeftGain) *outLeftGain = gain * fmaxf(cosf(angle), 0.0f);
+    if (outRightGain) *outRightGain = gain * fmaxf(sinf(angle), 0.0f);
+}
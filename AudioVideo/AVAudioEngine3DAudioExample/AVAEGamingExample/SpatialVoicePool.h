@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2016 Apple Inc. All Rights Reserved.
+    See LICENSE.txt for this sample’s licensing information
+
+    Abstract:
+    SpatialVoicePool decides which of a fixed set of player voices each collision sound plays on.
+                 Voices 0 to spatialVoiceCount-1 are spatialized by the environment node, the rest are panned on the CPU.
+                 A sound goes to a free spatial voice, or steals the least audible one if it is louder, and otherwise falls back
+                 to a panned voice the same way. Sounds too quiet to hear at the listener are culled before they take a voice.
+                 Priorities are the gain a sound reaches the listener with, fading out over its duration.
+                 The pool is plain C with no audio dependencies, so it can be driven headless.
+*/
+
+#ifndef SpatialVoicePool_h
+#define SpatialVoicePool_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    kSpatialVoicePool_NoVoice = -1
+};
+
+typedef struct SpatialVoicePoint {
+    float x, y, z;
+} SpatialVoicePoint;
+
+typedef struct SpatialVoicePoolParameters {
+    // distance attenuation, as AVAudioEnvironmentDistanceAttenuationModelInverse
+    float referenceDistance;
+    float maximumDistance;
+    float rolloffFactor;
+
+    // sounds reaching the listener with less gain than this are culled
+    float cullingGain;
+} SpatialVoicePoolParameters;
+
+typedef struct SpatialVoicePoolStatistics {
+    uint64_t requests;
+    uint64_t culled;        // too quiet to hear
+    uint64_t stolen;        // took a voice from a quieter sound
+    uint64_t fallbacks;     // played on a panned voice because the spatial voices were all louder
+    uint64_t rejected;      // every voice was louder
+} SpatialVoicePoolStatistics;
+
+typedef struct SpatialVoicePool SpatialVoicePool;
+
+// the defaults match AVAudioEnvironmentNode's, culling below -60 dB
+void SpatialVoicePoolGetDefaultParameters(SpatialVoicePoolParameters *outParameters);
+
+SpatialVoicePool *SpatialVoicePoolCreate(uint32_t spatialVoiceCount, uint32_t pannedVoiceCount, const SpatialVoicePoolParameters *parameters);
+void SpatialVoicePoolDispose(SpatialVoicePool *pool);
+
+// listenerYaw is in degrees, as in AVAudio3DAngularOrientation
+void SpatialVoicePoolSetListener(SpatialVoicePool *pool, SpatialVoicePoint listenerPosition, float listenerYaw);
+
+// Returns the voice a sound from emitterID should play on, or kSpatialVoicePool_NoVoice if it shouldn't play.
+// An emitter whose last sound is still playing gets the same voice back, so its new sound cuts off the old one.
+// gain is the sound's own volume and duration how long it lasts at its normal rate, in seconds. The spatial voices
+// play it at rate, so it lasts duration / rate on them; the panned voices don't vary the rate. now is any steady
+// clock in seconds.
+int32_t SpatialVoicePoolAllocateVoice(SpatialVoicePool *pool, uint64_t emitterID, SpatialVoicePoint position, float gain,
+                                      double duration, float rate, double now);
+
+// frees a voice early, for instance when its player is stopped
+void SpatialVoicePoolReleaseVoice(SpatialVoicePool *pool, int32_t voice);
+void SpatialVoicePoolReleaseAllVoices(SpatialVoicePool *pool);
+
+bool SpatialVoicePoolIsSpatialVoice(const SpatialVoicePool *pool, int32_t voice);
+uint32_t SpatialVoicePoolGetActiveVoiceCount(const SpatialVoicePool *pool, double now);
+void SpatialVoicePoolGetStatistics(const SpatialVoicePool *pool, SpatialVoicePoolStatistics *outStatistics);
+
+// the gain the distance model gives a sound at position
+float SpatialVoicePoolDistanceGain(const SpatialVoicePool *pool, SpatialVoicePoint position);
+
+// The CPU panner for voices the environment node doesn't spatialize. outPan runs from -1 (left) to 1 (right) and
+// outLeftGain and outRightGain are its equal power gains, with distance attenuation. Any out pointer may be NULL.
+void SpatialVoicePoolPan(const SpatialVoicePool *pool, SpatialVoicePoint position, float *outPan, float *outLeftGain, float *outRightGain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SpatialVoicePool_h */
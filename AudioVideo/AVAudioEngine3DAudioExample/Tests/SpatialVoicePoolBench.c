@@ -0,0 +1,164 @@
+// Checks how SpatialVoicePool hands out, steals, culls and pans voices, then times it allocating voices for
+// thousands of emitters scattered around the listener, as the gaming example would with a busy scene, at 1000,
+// 4000 and 16000 emitters. The optional argument times just that number of emitters instead.
+#include "SpatialVoicePool.h"
+#include "TestSupport.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+enum {
+    kSpatialVoices = 16,
+    kPannedVoices = 16,
+    kFramesPerSecond = 60
+};
+
+static float RandomBetween(float low, float high)
+{
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+static void testPan(void)
+{
+    SpatialVoicePool *pool = SpatialVoicePoolCreate(kSpatialVoices, kPannedVoices, NULL);
+    float pan, left, right;
+
+    SpatialVoicePoolPan(pool, (SpatialVoicePoint){ 5, 0, 0 }, &pan, &left, &right);
+    TEST_CHECK(pan == 1.0f && right > 0.0f && left < 1.0e-6f, "a sound to the right pans %g, %g/%g", pan, left, right);
+    TEST_CHECK(fabsf(right - 0.2f) < 1.0e-5f, "a sound 5 m away has a gain of %g", right);
+
+    SpatialVoicePoolPan(pool, (SpatialVoicePoint){ -5, 0, 0 }, &pan, &left, &right);
+    TEST_CHECK(pan == -1.0f && left > 0.0f && right < 1.0e-6f, "a sound to the left pans %g, %g/%g", pan, left, right);
+
+    SpatialVoicePoolPan(pool, (SpatialVoicePoint){ 0, 0, -1 }, &pan, &left, &right);
+    TEST_CHECK(pan == 0.0f && fabsf(left - right) < 1.0e-6f, "a sound in front pans %g, %g/%g", pan, left, right);
+
+    // turned to the right, +z is on the listener's right
+    SpatialVoicePoolSetListener(pool, (SpatialVoicePoint){ 0, 0, 0 }, 90);
+    SpatialVoicePoolPan(pool, (SpatialVoicePoint){ 0, 0, 5 }, &pan, NULL, NULL);
+    TEST_CHECK(fabsf(pan - 1.0f) < 1.0e-5f, "+z pans %g with a yaw of 90", pan);
+
+    SpatialVoicePoolDispose(pool);
+}
+
+static void testAllocation(void)
+{
+    SpatialVoicePool *pool = SpatialVoicePoolCreate(kSpatialVoices, kPannedVoices, NULL);
+    const SpatialVoicePoint near = { 1, 0, 0 };
+
+    // loud sounds fill the spatial voices first
+    for (uint64_t emitter = 1; emitter <= kSpatialVoices; ++emitter) {
+        int32_t voice = SpatialVoicePoolAllocateVoice(pool, emitter, near, 1, 1, 1, 0);
+        TEST_CHECK(SpatialVoicePoolIsSpatialVoice(pool, voice), "emitter %llu got voice %d", (unsigned long long)emitter, voice);
+    }
+
+    int32_t voice = SpatialVoicePoolAllocateVoice(pool, 100, (SpatialVoicePoint){ 10, 0, 0 }, 1, 1, 1, 0);
+    TEST_CHECK(voice >= kSpatialVoices, "a quieter sound got voice %d rather than a panned one", voice);
+
+    voice = SpatialVoicePoolAllocateVoice(pool, 1, near, 1, 1, 1, 0);
+    TEST_CHECK(voice == 0, "a sounding emitter got voice %d rather than its own", voice);
+
+    voice = SpatialVoicePoolAllocateVoice(pool, 101, (SpatialVoicePoint){ 1.0e6f, 0, 0 }, 1, 1, 1, 0);
+    TEST_CHECK(voice == kSpatialVoicePool_NoVoice, "an inaudible sound got voice %d", voice);
+
+    // half way through, the loud sounds are worth less than a new one as loud
+    voice = SpatialVoicePoolAllocateVoice(pool, 102, (SpatialVoicePoint){ 0.5f, 0, 0 }, 1, 1, 1, 0.5);
+    TEST_CHECK(SpatialVoicePoolIsSpatialVoice(pool, voice), "a new loud sound got voice %d rather than stealing one", voice);
+
+    SpatialVoicePoolStatistics statistics;
+    SpatialVoicePoolGetStatistics(pool, &statistics);
+    TEST_CHECK(statistics.culled == 1 && statistics.stolen == 1 && statistics.fallbacks == 1,
+               "%llu culled, %llu stolen, %llu fallbacks", (unsigned long long)statistics.culled,
+               (unsigned long long)statistics.stolen, (unsigned long long)statistics.fallbacks);
+
+    SpatialVoicePoolDispose(pool);
+}
+
+static void testRate(void)
+{
+    // a spatial voice plays a sound twice as fast at a rate of 2, a panned voice doesn't vary the rate
+    SpatialVoicePool *pool = SpatialVoicePoolCreate(1, 1, NULL);
+    int32_t spatial = SpatialVoicePoolAllocateVoice(pool, 1, (SpatialVoicePoint){ 1, 0, 0 }, 1, 1, 2, 0);
+    int32_t panned = SpatialVoicePoolAllocateVoice(pool, 2, (SpatialVoicePoint){ 2, 0, 0 }, 1, 1, 2, 0);
+    TEST_CHECK(SpatialVoicePoolIsSpatialVoice(pool, spatial) && panned == 1, "got voices %d and %d", spatial, panned);
+
+    TEST_CHECK(SpatialVoicePoolGetActiveVoiceCount(pool, 0.4) == 2, "both voices should still be playing");
+    TEST_CHECK(SpatialVoicePoolGetActiveVoiceCount(pool, 0.6) == 1, "only the panned voice should still be playing");
+    TEST_CHECK(SpatialVoicePoolGetActiveVoiceCount(pool, 1.0) == 0, "neither voice should still be playing");
+
+    SpatialVoicePoolDispose(pool);
+}
+
+// emitters scattered over a 200 m square around the listener, each hit about twice a second, for a minute of frames
+static void bench(uint32_t emitterCount)
+{
+    SpatialVoicePool *pool = SpatialVoicePoolCreate(kSpatialVoices, kPannedVoices, NULL);
+    SpatialVoicePoint *positions = (SpatialVoicePoint *)malloc(emitterCount * sizeof(SpatialVoicePoint));
+
+    srand(1);
+    for (uint32_t i = 0; i < emitterCount; ++i) {
+        positions[i] = (SpatialVoicePoint){ RandomBetween(-100, 100), RandomBetween(-5, 5), RandomBetween(-100, 100) };
+    }
+
+    uint32_t hitsPerFrame = emitterCount * 2 / kFramesPerSecond;
+    if (hitsPerFrame == 0) hitsPerFrame = 1;
+
+    uint64_t requests = 0;
+    uint32_t mostActive = 0;
+    double seconds = 0;
+    for (uint32_t frame = 0; frame < 60 * kFramesPerSecond; ++frame) {
+        double now = frame / (double)kFramesPerSecond;
+        for (uint32_t i = 0; i < emitterCount; ++i) {
+            positions[i].x += RandomBetween(-0.05f, 0.05f);
+            positions[i].z += RandomBetween(-0.05f, 0.05f);
+        }
+
+        double start = TestNow();
+        for (uint32_t hit = 0; hit < hitsPerFrame; ++hit) {
+            uint32_t emitter = rand() % emitterCount;
+            SpatialVoicePoolAllocateVoice(pool, emitter + 1, positions[emitter], RandomBetween(0.1f, 1), 0.35, RandomBetween(0.5f, 2), now);
+        }
+        uint32_t active = SpatialVoicePoolGetActiveVoiceCount(pool, now);
+        seconds += TestNow() - start;
+
+        requests += hitsPerFrame;
+        if (active > mostActive) mostActive = active;
+    }
+
+    SpatialVoicePoolStatistics statistics;
+    SpatialVoicePoolGetStatistics(pool, &statistics);
+    TEST_CHECK(statistics.requests == requests, "%llu requests counted of %llu", (unsigned long long)statistics.requests,
+               (unsigned long long)requests);
+    TEST_CHECK(mostActive <= kSpatialVoices + kPannedVoices, "%u voices active at once", mostActive);
+    // this many hits can't all be heard, so some have to be culled or steal a voice
+    if (hitsPerFrame > kSpatialVoices + kPannedVoices) {
+        TEST_CHECK(statistics.culled + statistics.stolen > 0, "%u emitters: nothing culled or stolen", emitterCount);
+    }
+
+    printf("%u emitters: %llu requests in %.2f ms, %.0f voices allocated per ms\n", emitterCount,
+           (unsigned long long)requests, seconds * 1.0e3, requests / (seconds * 1.0e3));
+    printf("  culled %llu, stolen %llu, fallbacks %llu, rejected %llu, at most %u voices active\n",
+           (unsigned long long)statistics.culled, (unsigned long long)statistics.stolen,
+           (unsigned long long)statistics.fallbacks, (unsigned long long)statistics.rejected, mostActive);
+
+    free(positions);
+    SpatialVoicePoolDispose(pool);
+}
+
+int main(int argc, const char *argv[])
+{
+    testPan();
+    testAllocation();
+    testRate();
+    if (argc > 1) {
+        bench((uint32_t)atoi(argv[1]));
+    } else {
+        const uint32_t emitterCounts[] = { 1000, 4000, 16000 };
+        for (size_t i = 0; i < sizeof(emitterCounts) / sizeof(emitterCounts[0]); ++i) {
+            bench(emitterCounts[i]);
+        }
+    }
+
+    if (gTestFailures == 0) printf("SpatialVoicePoolBench: all passed\n");
+    return gTestFailures != 0;
+}
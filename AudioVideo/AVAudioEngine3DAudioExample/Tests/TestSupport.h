@@ -0,0 +1,29 @@
+// Small helpers shared by the gaming example's tests and benchmarks. Each test is its own executable
+// that prints what failed and returns non-zero, so ctest needs nothing more.
+#ifndef TestSupport_h
+#define TestSupport_h
+
+#include <stdio.h>
+#include <time.h>
+
+#define TEST_CHECK(condition, ...)                              \
+    do {                                                        \
+        if (!(condition)) {                                     \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);     \
+            fprintf(stderr, __VA_ARGS__);                       \
+            fprintf(stderr, "\n");                              \
+            ++gTestFailures;                                    \
+        }                                                       \
+    } while (0)
+
+static int gTestFailures = 0;
+
+// a steady clock in seconds, for timing
+static inline double TestNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+#endif /* TestSupport_h */
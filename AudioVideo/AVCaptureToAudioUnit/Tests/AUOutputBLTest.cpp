@@ -0,0 +1,145 @@
+//	Checks that an AUOutputBL whose memory was reserved up front, taking its
+//	buffer list from a pool as the capture callback does, never goes to the
+//	heap for it again: not when it is allocated and prepared for the frames
+//	it was reserved for, not after SetFormat changes it to a format with more
+//	buffers or bigger frames, and not when it is asked for more than it was
+//	reserved for, which throws instead.
+#include "AUOutputBL.h"
+#include "CAAudioBufferListPool.h"
+#include "TestSupport.h"
+#include <AudioUnit/AUComponent.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+//	replaced so the test can count every allocation; gcc pairs the malloc and free below across the inlined
+//	operators and warns about a mismatch that isn't one
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+	#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<long>	sHeapAllocations(0);
+
+void*	operator new(size_t inSize)
+{
+	sHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* theMemory = malloc(inSize);
+	if(theMemory == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return theMemory;
+}
+void*	operator new[](size_t inSize) { return operator new(inSize); }
+void	operator delete(void* inMemory) noexcept { free(inMemory); }
+void	operator delete[](void* inMemory) noexcept { free(inMemory); }
+void	operator delete(void* inMemory, size_t) noexcept { free(inMemory); }
+void	operator delete[](void* inMemory, size_t) noexcept { free(inMemory); }
+
+static const UInt32 kReservedFrames = 4096;
+static const UInt32 kPoolMaxNumberBuffers = 8;
+
+//	allocates and prepares inNumberFrames frames the way the capture callback does, writes every byte of them and
+//	returns the number of heap allocations that took
+static long	AllocateAndFill(AUOutputBL& inBufferList, UInt32 inNumberFrames)
+{
+	long theAllocations = sHeapAllocations.load();
+	inBufferList.Allocate(inNumberFrames);
+	inBufferList.Prepare(inNumberFrames);
+	for(UInt32 theBuffer = 0; theBuffer < inBufferList.ABL()->mNumberBuffers; ++theBuffer)
+	{
+		memset(inBufferList.ABL()->mBuffers[theBuffer].mData, 0x55, inBufferList.ABL()->mBuffers[theBuffer].mDataByteSize);
+	}
+	return sHeapAllocations.load() - theAllocations;
+}
+
+//	every buffer holds inNumberFrames frames of inFormat, and none of them overlap
+static void	CheckBuffers(AUOutputBL& inBufferList, const CAStreamBasicDescription& inFormat, UInt32 inNumberFrames, const char* inWhen)
+{
+	AudioBufferList& theList = *inBufferList.ABL();
+	TEST_CHECK(theList.mNumberBuffers == inFormat.NumberChannelStreams(), "%s: %u buffers", inWhen, (unsigned)theList.mNumberBuffers);
+	for(UInt32 theBuffer = 0; theBuffer < theList.mNumberBuffers; ++theBuffer)
+	{
+		TEST_CHECK(theList.mBuffers[theBuffer].mDataByteSize == inFormat.FramesToBytes(inNumberFrames), "%s: buffer %u holds %u bytes", inWhen, (unsigned)theBuffer, (unsigned)theList.mBuffers[theBuffer].mDataByteSize);
+		if(theBuffer > 0)
+		{
+			const Byte* thePrevious = static_cast<const Byte*>(theList.mBuffers[theBuffer - 1].mData);
+			TEST_CHECK(static_cast<const Byte*>(theList.mBuffers[theBuffer].mData) >= thePrevious + theList.mBuffers[theBuffer - 1].mDataByteSize, "%s: buffer %u overlaps the one before it", inWhen, (unsigned)theBuffer);
+		}
+	}
+}
+
+//	the capture callback's sequence: reserve for the biggest sample buffer, take sample buffers of different sizes,
+//	then have the input format change to more channels and carry on
+static void	TestSetFormatKeepsReservation(CAAudioBufferListPool& inPool)
+{
+	CAStreamBasicDescription theMono = TestPCMFormat(1, 32, 4, true, true, false, false);
+	AUOutputBL theBufferList(theMono, inPool, 512);
+	TEST_CHECK(theBufferList.Reserve(kReservedFrames), "couldn't reserve %u frames", (unsigned)kReservedFrames);
+	TEST_CHECK(theBufferList.AllocatedFrames() == kReservedFrames, "reserved for %u frames", (unsigned)theBufferList.AllocatedFrames());
+
+	TEST_CHECK(AllocateAndFill(theBufferList, 512) == 0, "allocating 512 reserved frames went to the heap");
+	TEST_CHECK(AllocateAndFill(theBufferList, kReservedFrames) == 0, "allocating all the reserved frames went to the heap");
+	CheckBuffers(theBufferList, theMono, kReservedFrames, "mono");
+
+	//	more buffers, then bigger frames, each shrinking what the old reservation holds below what was asked for
+	const CAStreamBasicDescription theFormats[] =
+	{
+		TestPCMFormat(2, 32, 4, true, true, false, false),
+		TestPCMFormat(6, 32, 4, true, true, false, false),
+		TestPCMFormat(8, 32, 4, true, true, false, true),
+		TestPCMFormat(1, 32, 4, true, true, false, false),
+	};
+	for(const CAStreamBasicDescription& theFormat : theFormats)
+	{
+		theBufferList.SetFormat(theFormat);
+		char theWhen[64];
+		snprintf(theWhen, sizeof(theWhen), "after SetFormat to %u %s channels", (unsigned)theFormat.NumberChannels(), theFormat.IsInterleaved() ? "interleaved" : "planar");
+		TEST_CHECK(theBufferList.IsReserved(), "%s: no longer reserved", theWhen);
+		TEST_CHECK(theBufferList.AllocatedFrames() >= kReservedFrames, "%s: only holds %u frames", theWhen, (unsigned)theBufferList.AllocatedFrames());
+
+		long theAllocations = AllocateAndFill(theBufferList, 100);
+		theAllocations += AllocateAndFill(theBufferList, kReservedFrames);
+		TEST_CHECK(theAllocations == 0, "%s: allocating the reserved frames went to the heap %ld times", theWhen, theAllocations);
+		CheckBuffers(theBufferList, theFormat, kReservedFrames, theWhen);
+	}
+}
+
+//	asking a reserved buffer list for more than it was reserved for fails, and leaves it as it was
+static void	TestAllocatePastReservation(CAAudioBufferListPool& inPool)
+{
+	CAStreamBasicDescription theStereo = TestPCMFormat(2, 32, 4, true, true, false, false);
+	AUOutputBL theBufferList(theStereo, inPool, 512);
+	TEST_CHECK(theBufferList.Reserve(kReservedFrames), "couldn't reserve %u frames", (unsigned)kReservedFrames);
+	AllocateAndFill(theBufferList, kReservedFrames);
+
+	long theAllocations = sHeapAllocations.load();
+	bool didThrow = false;
+	try
+	{
+		theBufferList.Allocate(2 * kReservedFrames);
+	}
+	catch(OSStatus inError)
+	{
+		didThrow = (inError == kAudioUnitErr_TooManyFramesToProcess);
+	}
+	TEST_CHECK(didThrow, "allocating past the reservation didn't throw kAudioUnitErr_TooManyFramesToProcess");
+	TEST_CHECK(sHeapAllocations.load() == theAllocations, "allocating past the reservation went to the heap");
+	TEST_CHECK(theBufferList.IsReserved() && (theBufferList.AllocatedFrames() == kReservedFrames), "allocating past the reservation changed it");
+	TEST_CHECK(AllocateAndFill(theBufferList, kReservedFrames) == 0, "the reservation can't be used after a failed Allocate");
+
+	//	letting go of the memory ends the reservation, and after that the heap is used as before
+	theBufferList.Allocate(0);
+	TEST_CHECK(!theBufferList.IsReserved(), "still reserved after Allocate(0)");
+	TEST_CHECK(AllocateAndFill(theBufferList, 2 * kReservedFrames) > 0, "an unreserved buffer list didn't go to the heap");
+	CheckBuffers(theBufferList, theStereo, 2 * kReservedFrames, "after Allocate(0)");
+}
+
+int	main()
+{
+	CAAudioBufferListPool thePool;
+	thePool.Allocate(2, kPoolMaxNumberBuffers, 256 * sizeof(Float32));
+	TestSetFormatKeepsReservation(thePool);
+	TestAllocatePastReservation(thePool);
+	return (gTestFailures == 0) ? 0 : 1;
+}
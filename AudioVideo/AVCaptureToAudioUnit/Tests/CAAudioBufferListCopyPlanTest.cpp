@@ -0,0 +1,220 @@
+//	Checks CAAudioBufferListCopyPlan, and CAAudioBufferList::Copy with and
+//	without one, against a reference that copies one sample at a time:
+//	planar to interleaved and back, whole buffers, mixed layouts, channel maps
+//	with silent channels, lists shorter than each other, and plans kept across
+//	calls while the layouts change under them.
+#include "TestSupport.h"
+#include "CAAudioBufferListCopyPlan.h"
+
+static const Float32 kUntouched = 12345.f;
+static const SInt32 kLeftAlone = -2;
+
+//	a Float32 AudioBufferList with the given number of channels in each buffer
+class	TestLayout
+{
+public:
+						TestLayout(std::vector<UInt32> inBufferChannels, UInt32 inNumberFrames)
+						:	mBufferList(CAAudioBufferList::Create(static_cast<UInt32>(inBufferChannels.size()))),
+							mData(inBufferChannels.size())
+						{
+							for(UInt32 theBuffer = 0; theBuffer < mBufferList->mNumberBuffers; ++theBuffer)
+							{
+								mData[theBuffer].assign(inBufferChannels[theBuffer] * inNumberFrames, kUntouched);
+								mBufferList->mBuffers[theBuffer].mNumberChannels = inBufferChannels[theBuffer];
+								mBufferList->mBuffers[theBuffer].mDataByteSize = static_cast<UInt32>(mData[theBuffer].size() * sizeof(Float32));
+								mBufferList->mBuffers[theBuffer].mData = mData[theBuffer].data();
+							}
+						}
+						~TestLayout() { CAAudioBufferList::Destroy(mBufferList); }
+						TestLayout(const TestLayout&) = delete;
+	TestLayout&			operator=(const TestLayout&) = delete;
+
+	AudioBufferList&	Get() { return *mBufferList; }
+	UInt32				NumberChannels() const { return CAAudioBufferList::GetTotalNumberChannels(*mBufferList); }
+	UInt32				NumberFrames(UInt32 inChannel) const
+						{
+							UInt32 theBuffer, theBufferChannel;
+							CAAudioBufferList::GetBufferForChannel(*mBufferList, inChannel, theBuffer, theBufferChannel);
+							return static_cast<UInt32>(mData[theBuffer].size()) / mBufferList->mBuffers[theBuffer].mNumberChannels;
+						}
+	Float32&			Sample(UInt32 inChannel, UInt32 inFrame)
+						{
+							UInt32 theBuffer, theBufferChannel;
+							CAAudioBufferList::GetBufferForChannel(*mBufferList, inChannel, theBuffer, theBufferChannel);
+							return mData[theBuffer][inFrame * mBufferList->mBuffers[theBuffer].mNumberChannels + theBufferChannel];
+						}
+
+	//	every sample says which channel and frame it is
+	void				Fill(UInt32 inSeed)
+						{
+							for(UInt32 theChannel = 0; theChannel < NumberChannels(); ++theChannel)
+							{
+								for(UInt32 theFrame = 0; theFrame < NumberFrames(theChannel); ++theFrame)
+								{
+									Sample(theChannel, theFrame) = static_cast<Float32>(inSeed * 100000 + theChannel * 1000 + theFrame);
+								}
+							}
+						}
+
+private:
+	AudioBufferList*					mBufferList;
+	std::vector<std::vector<Float32>>	mData;
+};
+
+//	inChannelMap[destination channel] is the source channel, -1 for silence or kLeftAlone; the destination decides
+//	how many frames are copied, but no more are read than the source has
+static void	ReferenceCopy(TestLayout& inSource, TestLayout& ioDestination, const std::vector<SInt32>& inChannelMap)
+{
+	for(UInt32 theChannel = 0; theChannel < inChannelMap.size(); ++theChannel)
+	{
+		SInt32 theSourceChannel = inChannelMap[theChannel];
+		if(theSourceChannel == kLeftAlone)
+		{
+			continue;
+		}
+		bool isSilent = (theSourceChannel < 0) || (static_cast<UInt32>(theSourceChannel) >= inSource.NumberChannels());
+		UInt32 theNumberFrames = ioDestination.NumberFrames(theChannel);
+		if(!isSilent && (inSource.NumberFrames(static_cast<UInt32>(theSourceChannel)) < theNumberFrames))
+		{
+			theNumberFrames = inSource.NumberFrames(static_cast<UInt32>(theSourceChannel));
+		}
+		for(UInt32 theFrame = 0; theFrame < theNumberFrames; ++theFrame)
+		{
+			ioDestination.Sample(theChannel, theFrame) = isSilent ? 0.f : inSource.Sample(static_cast<UInt32>(theSourceChannel), theFrame);
+		}
+	}
+}
+
+static std::vector<SInt32>	ChannelForChannel(TestLayout& inSource, UInt32 inStartingSourceChannel, TestLayout& inDestination, UInt32 inStartingDestinationChannel)
+{
+	std::vector<SInt32> theMap;
+	for(UInt32 theChannel = 0; theChannel < inDestination.NumberChannels(); ++theChannel)
+	{
+		UInt32 theSourceChannel = theChannel - inStartingDestinationChannel + inStartingSourceChannel;
+		bool isCopied = (theChannel >= inStartingDestinationChannel) && (theSourceChannel < inSource.NumberChannels());
+		theMap.push_back(isCopied ? static_cast<SInt32>(theSourceChannel) : kLeftAlone);
+	}
+	return theMap;
+}
+
+//	compares every sample of the two, including the ones the copy must leave alone
+static void	CheckSame(TestLayout& inActual, TestLayout& inExpected, const char* inWhat)
+{
+	UInt32 theNumberWrong = 0;
+	for(UInt32 theChannel = 0; theChannel < inExpected.NumberChannels(); ++theChannel)
+	{
+		for(UInt32 theFrame = 0; theFrame < inExpected.NumberFrames(theChannel); ++theFrame)
+		{
+			theNumberWrong += (inActual.Sample(theChannel, theFrame) != inExpected.Sample(theChannel, theFrame)) ? 1 : 0;
+		}
+	}
+	TEST_CHECK(theNumberWrong == 0, "%s: %u samples differ from the per sample copy", inWhat, (unsigned)theNumberWrong);
+}
+
+//	copies inSourceBuffers' channels from inStartingSourceChannel onto inDestinationBuffers' from
+//	inStartingDestinationChannel every way there is, checking each against the reference
+static void	TestChannelForChannel(const char* inWhat, std::vector<UInt32> inSourceBuffers, UInt32 inSourceFrames, UInt32 inStartingSourceChannel, std::vector<UInt32> inDestinationBuffers, UInt32 inDestinationFrames, UInt32 inStartingDestinationChannel, UInt32 inExpectedSteps)
+{
+	TestLayout theSource(inSourceBuffers, inSourceFrames);
+	theSource.Fill(1);
+	TestLayout theExpected(inDestinationBuffers, inDestinationFrames);
+	ReferenceCopy(theSource, theExpected, ChannelForChannel(theSource, inStartingSourceChannel, theExpected, inStartingDestinationChannel));
+
+	CAAudioBufferListCopyPlan thePlan;
+	TEST_CHECK(thePlan.Plan(theSource.Get(), inStartingSourceChannel, theExpected.Get(), inStartingDestinationChannel), "%s: didn't plan", inWhat);
+	TEST_CHECK(thePlan.GetNumberSteps() == inExpectedSteps, "%s: %u steps, expected %u", inWhat, (unsigned)thePlan.GetNumberSteps(), (unsigned)inExpectedSteps);
+	TestLayout thePlanned(inDestinationBuffers, inDestinationFrames);
+	TEST_CHECK(thePlan.Execute(theSource.Get(), thePlanned.Get()), "%s: didn't execute", inWhat);
+	CheckSame(thePlanned, theExpected, inWhat);
+
+	TestLayout theCopied(inDestinationBuffers, inDestinationFrames);
+	CAAudioBufferList::Copy(theSource.Get(), inStartingSourceChannel, theCopied.Get(), inStartingDestinationChannel);
+	CheckSame(theCopied, theExpected, inWhat);
+
+	TestLayout theCopiedWithPlan(inDestinationBuffers, inDestinationFrames);
+	CAAudioBufferListCopyPlan theCallersPlan;
+	CAAudioBufferList::Copy(theSource.Get(), inStartingSourceChannel, theCopiedWithPlan.Get(), inStartingDestinationChannel, theCallersPlan);
+	CheckSame(theCopiedWithPlan, theExpected, inWhat);
+}
+
+static void	TestChannelMap(const char* inWhat, std::vector<UInt32> inSourceBuffers, std::vector<UInt32> inDestinationBuffers, std::vector<SInt32> inChannelMap, UInt32 inExpectedSteps)
+{
+	TestLayout theSource(inSourceBuffers, 67);
+	theSource.Fill(2);
+	TestLayout theExpected(inDestinationBuffers, 67);
+	std::vector<SInt32> theMap = inChannelMap;
+	theMap.resize(theExpected.NumberChannels() < theMap.size() ? theExpected.NumberChannels() : theMap.size());
+	ReferenceCopy(theSource, theExpected, theMap);
+
+	CAAudioBufferListCopyPlan thePlan;
+	TEST_CHECK(thePlan.Plan(theSource.Get(), theExpected.Get(), inChannelMap.data(), static_cast<UInt32>(inChannelMap.size())), "%s: didn't plan", inWhat);
+	TEST_CHECK(thePlan.GetNumberSteps() == inExpectedSteps, "%s: %u steps, expected %u", inWhat, (unsigned)thePlan.GetNumberSteps(), (unsigned)inExpectedSteps);
+	TEST_CHECK(!thePlan.IsPlannedFor(theSource.Get(), 0, theExpected.Get(), 0), "%s: a channel map plan passes for a channel for channel one", inWhat);
+	TestLayout thePlanned(inDestinationBuffers, 67);
+	TEST_CHECK(thePlan.Execute(theSource.Get(), thePlanned.Get()), "%s: didn't execute", inWhat);
+	CheckSame(thePlanned, theExpected, inWhat);
+}
+
+//	a plan kept across calls is reused while the layouts stay the same, rebuilt when they change, and never
+//	executed against lists it wasn't built for
+static void	TestKeptPlan()
+{
+	TestLayout theInterleaved({ 2 }, 256);
+	TestLayout thePlanar({ 1, 1 }, 256);
+	TestLayout theMixed({ 1, 3 }, 256);
+	theInterleaved.Fill(3);
+	theMixed.Fill(4);
+
+	CAAudioBufferListCopyPlan thePlan;
+	TEST_CHECK(!thePlan.IsPlannedFor(theInterleaved.Get(), 0, thePlanar.Get(), 0), "an empty plan passes for a copy");
+	CAAudioBufferList::Copy(theInterleaved.Get(), 0, thePlanar.Get(), 0, thePlan);
+	TEST_CHECK(thePlan.IsPlannedFor(theInterleaved.Get(), 0, thePlanar.Get(), 0), "the plan wasn't kept");
+	TEST_CHECK(!thePlan.IsPlannedFor(theInterleaved.Get(), 1, thePlanar.Get(), 0), "the plan passes for another starting channel");
+	TEST_CHECK(!thePlan.IsPlannedFor(theMixed.Get(), 0, thePlanar.Get(), 0), "the plan passes for another layout");
+	TEST_CHECK(!thePlan.Execute(theMixed.Get(), thePlanar.Get()), "the plan executed against a layout it wasn't built for");
+
+	//	the same buffer count with the channels split differently needs a new plan too
+	TestLayout theOtherMixed({ 3, 1 }, 256);
+	theOtherMixed.Fill(5);
+	CAAudioBufferList::Copy(theMixed.Get(), 1, theInterleaved.Get(), 0, thePlan);
+	TEST_CHECK(!thePlan.IsPlannedFor(theOtherMixed.Get(), 1, theInterleaved.Get(), 0), "the plan passes for another split of the channels");
+	CAAudioBufferList::Copy(theOtherMixed.Get(), 1, theInterleaved.Get(), 0, thePlan);
+	TestLayout theExpected({ 2 }, 256);
+	ReferenceCopy(theOtherMixed, theExpected, { 1, 2 });
+	CheckSame(theInterleaved, theExpected, "replanned for another split of the channels");
+
+	//	and executing the kept plan again, with new data, copies the new data
+	for(UInt32 theCycle = 0; theCycle < 3; ++theCycle)
+	{
+		theInterleaved.Fill(10 + theCycle);
+		CAAudioBufferList::Copy(theInterleaved.Get(), 0, thePlanar.Get(), 0, thePlan);
+		TestLayout theExpectedPlanar({ 1, 1 }, 256);
+		ReferenceCopy(theInterleaved, theExpectedPlanar, { 0, 1 });
+		CheckSame(thePlanar, theExpectedPlanar, "a kept plan");
+	}
+}
+
+int	main()
+{
+	TestChannelForChannel("interleaved stereo to planar", { 2 }, 256, 0, { 1, 1 }, 256, 0, 1);
+	TestChannelForChannel("planar quad to interleaved", { 1, 1, 1, 1 }, 255, 0, { 4 }, 255, 0, 1);
+	TestChannelForChannel("interleaved to interleaved", { 2 }, 255, 0, { 2 }, 255, 0, 1);
+	TestChannelForChannel("planar to planar", { 1, 1, 1 }, 100, 0, { 1, 1, 1 }, 100, 0, 3);
+	TestChannelForChannel("interleaved 6 to planar from channel 2", { 6 }, 64, 2, { 1, 1, 1, 1 }, 64, 0, 1);
+	TestChannelForChannel("planar into the middle of interleaved", { 1, 1 }, 64, 0, { 4 }, 64, 1, 1);
+	TestChannelForChannel("mixed layouts", { 2, 1, 3 }, 50, 1, { 1, 4, 1 }, 50, 0, 5);
+	TestChannelForChannel("more source channels than destination", { 8 }, 33, 0, { 1, 1, 1 }, 33, 0, 1);
+	TestChannelForChannel("a shorter source", { 2 }, 40, 0, { 1, 1 }, 64, 0, 1);
+	TestChannelForChannel("a shorter destination", { 1, 1 }, 64, 0, { 2 }, 40, 0, 1);
+	TestChannelForChannel("starting past the source's channels", { 2 }, 16, 2, { 2 }, 16, 0, 0);
+
+	TestChannelMap("swapped stereo", { 2 }, { 2 }, { 1, 0 }, 2);
+	TestChannelMap("silence in interleaved", { 1, 1 }, { 4 }, { 1, -1, 0, -1 }, 4);
+	TestChannelMap("silence in planar", { 4 }, { 1, 1, 1 }, { -1, 2, 3 }, 2);
+	TestChannelMap("an out of range source is silent", { 2 }, { 1, 1, 1 }, { 0, 1, 7 }, 2);
+	TestChannelMap("a map longer than the destination", { 2 }, { 2 }, { 0, 1, 0, 1 }, 1);
+	TestChannelMap("a map shorter than the destination", { 1, 1, 1 }, { 3 }, { 2, 2 }, 2);
+
+	TestKeptPlan();
+	return (gTestFailures == 0) ? 0 : 1;
+}
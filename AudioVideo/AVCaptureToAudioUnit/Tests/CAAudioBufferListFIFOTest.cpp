@@ -0,0 +1,254 @@
+//	Runs a producer and a consumer thread through CAAudioBufferListFIFO at about
+//	ten times real time, storing and fetching blocks of sizes that don't divide
+//	each other, and checks that every frame that went in comes out once and in
+//	order, that the frames missing are exactly the ones the overrun counter says
+//	were dropped, and that the underrun counter matches the short fetches the
+//	consumer saw. Also checks that Store and Fetch respect the sizes of the
+//	buffers they are given. Pass a number of seconds of audio to run longer.
+#include "CAAudioBufferListFIFO.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <stdlib.h>
+#include <thread>
+
+static const double kSampleRate = 44100.0;
+static const double kSpeedUp = 10.0;
+
+//	every sample says which frame and channel it is
+static SInt32	SampleValue(UInt64 inFrame, UInt32 inChannel)
+{
+	return static_cast<SInt32>((inFrame << 3) | inChannel);
+}
+
+struct	StressCase
+{
+	const char*	mName;
+	bool		mIsInterleaved;
+	UInt32		mCapacityFrames;
+	UInt32		mStoreFrames;		//	the producer stores blocks of mStoreFrames up to 2 * mStoreFrames - 1 frames
+	UInt32		mFetchFrames;
+	bool		mUseBeginRead;		//	read the way the file writer does, straight out of the ring
+	UInt32		mStallEvery;		//	if not 0, the consumer stops for mStallMilliseconds every mStallEvery reads
+	UInt32		mStallMilliseconds;
+};
+
+static void	RunStressCase(const StressCase& inCase, double inSeconds)
+{
+	const UInt32 kNumberChannels = 2;
+	CAStreamBasicDescription theFormat = TestPCMFormat(kNumberChannels, 32, 4, false, true, false, inCase.mIsInterleaved);
+	CAAudioBufferListFIFO theFIFO;
+	theFIFO.Allocate(theFormat, inCase.mCapacityFrames);
+
+	const UInt64 theTotalFrames = static_cast<UInt64>(inSeconds * kSampleRate);
+	const double theSecondsPerFrame = 1.0 / (kSampleRate * kSpeedUp);
+	std::atomic<bool> isProducing(true);
+
+	//	what each side saw for itself, to check the FIFO's counters against
+	UInt64 theProducedFrames = 0, theProducerRejects = 0, theProducerRejectedFrames = 0;
+	UInt64 theConsumerShortFetches = 0, theConsumedFrames = 0, theMissingFrames = 0, theLastFrame = 0;
+	UInt64 theOutOfOrderFrames = 0, theWrongSamples = 0;
+
+	std::thread theProducer([&]()
+	{
+		TestBufferList theBlock(theFormat, 2 * inCase.mStoreFrames);
+		auto theStart = std::chrono::steady_clock::now();
+		UInt32 theSeed = 1;
+		for(UInt64& theFrame = theProducedFrames; theFrame < theTotalFrames; )
+		{
+			theSeed = theSeed * 1664525u + 1013904223u;
+			UInt32 theNumberFrames = inCase.mStoreFrames + (theSeed >> 8) % inCase.mStoreFrames;
+			for(UInt32 theBuffer = 0; theBuffer < theBlock.Get().mNumberBuffers; ++theBuffer)
+			{
+				SInt32* theSamples = theBlock.Data<SInt32>(theBuffer);
+				UInt32 theBufferChannels = theFormat.NumberInterleavedChannels();
+				for(UInt32 theBlockFrame = 0; theBlockFrame < theNumberFrames; ++theBlockFrame)
+				{
+					for(UInt32 theChannel = 0; theChannel < theBufferChannels; ++theChannel)
+					{
+						theSamples[theBlockFrame * theBufferChannels + theChannel] = SampleValue(theFrame + theBlockFrame, theBuffer + theChannel);
+					}
+				}
+			}
+
+			//	the frames are lost, as a capture callback's would be, if they don't fit
+			if(!theFIFO.Store(theBlock.Get(), theNumberFrames))
+			{
+				++theProducerRejects;
+				theProducerRejectedFrames += theNumberFrames;
+			}
+			theFrame += theNumberFrames;
+
+			//	keep to the sped up sample rate on average, catching up if the thread fell behind
+			std::this_thread::sleep_until(theStart + std::chrono::duration<double>(theFrame * theSecondsPerFrame));
+		}
+		isProducing.store(false, std::memory_order_release);
+	});
+
+	std::thread theConsumer([&]()
+	{
+		TestBufferList theBlock(theFormat, inCase.mFetchFrames);
+		AudioBufferList* theView = CAAudioBufferList::Create(theFormat.NumberChannelStreams());
+		auto theStart = std::chrono::steady_clock::now();
+		UInt64 theExpectedFrame = 0;
+		UInt64 theReads = 0;
+		for(bool isLastPass = false; ; )
+		{
+			//	read until the producer is done and everything it stored has been read
+			if(!isProducing.load(std::memory_order_acquire))
+			{
+				if(isLastPass && (theFIFO.GetReadableFrames() == 0))
+				{
+					break;
+				}
+				isLastPass = true;
+			}
+
+			UInt32 theNumberFrames;
+			AudioBufferList* theFrames;
+			if(inCase.mUseBeginRead)
+			{
+				theNumberFrames = theFIFO.BeginRead(*theView, inCase.mFetchFrames);
+				theFrames = theView;
+			}
+			else
+			{
+				for(UInt32 theBuffer = 0; theBuffer < theBlock.Get().mNumberBuffers; ++theBuffer)
+				{
+					theBlock.Get().mBuffers[theBuffer].mDataByteSize = theFormat.FramesToBytes(inCase.mFetchFrames);
+				}
+				theNumberFrames = theFIFO.Fetch(theBlock.Get(), inCase.mFetchFrames);
+				theFrames = &theBlock.Get();
+				theConsumerShortFetches += (theNumberFrames < inCase.mFetchFrames) ? 1 : 0;
+			}
+
+			if(theNumberFrames > 0)
+			{
+				//	frames that were dropped leave gaps, anywhere in a block, but what is there is in order
+				for(UInt32 theBuffer = 0; theBuffer < theFrames->mNumberBuffers; ++theBuffer)
+				{
+					TEST_CHECK(theFrames->mBuffers[theBuffer].mDataByteSize == theFormat.FramesToBytes(theNumberFrames), "%s: buffer %u says it holds %u bytes for %u frames", inCase.mName, (unsigned)theBuffer, (unsigned)theFrames->mBuffers[theBuffer].mDataByteSize, (unsigned)theNumberFrames);
+				}
+				for(UInt32 theFrame = 0; theFrame < theNumberFrames; ++theFrame)
+				{
+					UInt64 theFrameNumber = static_cast<UInt64>(static_cast<const SInt32*>(theFrames->mBuffers[0].mData)[theFrame * theFrames->mBuffers[0].mNumberChannels]) >> 3;
+					if(theFrameNumber < theExpectedFrame)
+					{
+						++theOutOfOrderFrames;
+					}
+					else
+					{
+						theMissingFrames += theFrameNumber - theExpectedFrame;
+					}
+					for(UInt32 theBuffer = 0; theBuffer < theFrames->mNumberBuffers; ++theBuffer)
+					{
+						const SInt32* theSamples = static_cast<const SInt32*>(theFrames->mBuffers[theBuffer].mData);
+						UInt32 theBufferChannels = theFrames->mBuffers[theBuffer].mNumberChannels;
+						for(UInt32 theChannel = 0; theChannel < theBufferChannels; ++theChannel)
+						{
+							theWrongSamples += (theSamples[theFrame * theBufferChannels + theChannel] != SampleValue(theFrameNumber, theBuffer + theChannel)) ? 1 : 0;
+						}
+					}
+					theExpectedFrame = theFrameNumber + 1;
+				}
+				theConsumedFrames += theNumberFrames;
+				if(inCase.mUseBeginRead)
+				{
+					theFIFO.EndRead(theNumberFrames);
+				}
+			}
+
+			++theReads;
+			if((inCase.mStallEvery != 0) && (theReads % inCase.mStallEvery == 0))
+			{
+				//	as if the disk stalled; the schedule below then catches up without sleeping
+				std::this_thread::sleep_for(std::chrono::milliseconds(inCase.mStallMilliseconds));
+			}
+			else
+			{
+				std::this_thread::sleep_until(theStart + std::chrono::duration<double>(theReads * inCase.mFetchFrames * theSecondsPerFrame * 0.9));
+			}
+		}
+		theLastFrame = theExpectedFrame;
+		CAAudioBufferList::Destroy(theView);
+	});
+
+	theProducer.join();
+	theConsumer.join();
+
+	TEST_CHECK(theWrongSamples == 0, "%s: %llu samples came out wrong", inCase.mName, (unsigned long long)theWrongSamples);
+	TEST_CHECK(theOutOfOrderFrames == 0, "%s: %llu frames came out of order", inCase.mName, (unsigned long long)theOutOfOrderFrames);
+	TEST_CHECK(theFIFO.GetOverrunCount() == theProducerRejects, "%s: %llu overruns counted, the producer saw %llu", inCase.mName, (unsigned long long)theFIFO.GetOverrunCount(), (unsigned long long)theProducerRejects);
+	TEST_CHECK(theFIFO.GetDroppedFrameCount() == theProducerRejectedFrames, "%s: %llu frames counted as dropped, the producer lost %llu", inCase.mName, (unsigned long long)theFIFO.GetDroppedFrameCount(), (unsigned long long)theProducerRejectedFrames);
+	TEST_CHECK(theConsumedFrames + theProducerRejectedFrames == theProducedFrames, "%s: %llu frames read and %llu dropped of %llu", inCase.mName, (unsigned long long)theConsumedFrames, (unsigned long long)theProducerRejectedFrames, (unsigned long long)theProducedFrames);
+	TEST_CHECK(theMissingFrames + (theProducedFrames - theLastFrame) == theProducerRejectedFrames, "%s: %llu frames are missing from what was read, %llu were dropped", inCase.mName, (unsigned long long)(theMissingFrames + theProducedFrames - theLastFrame), (unsigned long long)theProducerRejectedFrames);
+	TEST_CHECK(theFIFO.GetUnderrunCount() == theConsumerShortFetches, "%s: %llu underruns counted, the consumer saw %llu short fetches", inCase.mName, (unsigned long long)theFIFO.GetUnderrunCount(), (unsigned long long)theConsumerShortFetches);
+
+	//	make sure each case exercised what it was meant to
+	if(inCase.mStallEvery != 0)
+	{
+		TEST_CHECK(theProducerRejects > 0, "%s: the consumer's stalls never filled the FIFO", inCase.mName);
+	}
+	else
+	{
+		TEST_CHECK(theProducerRejects == 0, "%s: %llu stores overran a FIFO the consumer kept up with", inCase.mName, (unsigned long long)theProducerRejects);
+	}
+	if(!inCase.mUseBeginRead)
+	{
+		TEST_CHECK(theConsumerShortFetches > 0, "%s: the consumer never caught up with the producer", inCase.mName);
+	}
+	printf("%-40s %8llu frames, %5llu overruns dropping %7llu frames, %5llu underruns\n", inCase.mName, (unsigned long long)theProducedFrames, (unsigned long long)theFIFO.GetOverrunCount(), (unsigned long long)theFIFO.GetDroppedFrameCount(), (unsigned long long)theFIFO.GetUnderrunCount());
+}
+
+//	Store and Fetch go by the sizes of the buffers they are given, not just the frame counts they are asked for
+static void	TestBufferSizes()
+{
+	CAStreamBasicDescription theFormat = TestPCMFormat(2, 32, 4, true, true, false, false);
+	CAAudioBufferListFIFO theFIFO;
+	theFIFO.Allocate(theFormat, 1024);
+
+	TestBufferList theBlock(theFormat, 256);
+	theBlock.Get().mBuffers[1].mDataByteSize = theFormat.FramesToBytes(100);
+	TEST_CHECK(!theFIFO.Store(theBlock.Get(), 256), "stored 256 frames from a buffer that holds 100");
+	TEST_CHECK((theFIFO.GetOverrunCount() == 1) && (theFIFO.GetDroppedFrameCount() == 256), "a buffer too short to store wasn't counted as an overrun");
+	TEST_CHECK(theFIFO.GetReadableFrames() == 0, "a rejected store left %u frames behind", (unsigned)theFIFO.GetReadableFrames());
+	TEST_CHECK(theFIFO.Store(theBlock.Get(), 100), "didn't store the 100 frames the buffers hold");
+
+	//	a buffer with no data is stored as silence, whatever size it says it has
+	theBlock.Get().mBuffers[1].mData = NULL;
+	theBlock.Get().mBuffers[1].mDataByteSize = 0;
+	TEST_CHECK(theFIFO.Store(theBlock.Get(), 256), "didn't store a block with a buffer of silence");
+	theBlock.Get().mBuffers[1].mData = theBlock.Data<Float32>(1);
+
+	//	a fetch stops at the room the smallest buffer has, and only counts an underrun for that much
+	theFIFO.ResetCounters();
+	theBlock.Get().mBuffers[0].mDataByteSize = theFormat.FramesToBytes(200);
+	theBlock.Get().mBuffers[1].mDataByteSize = theFormat.FramesToBytes(256);
+	TEST_CHECK(theFIFO.Fetch(theBlock.Get(), 256) == 200, "fetched more than a 200 frame buffer holds");
+	TEST_CHECK(theBlock.Get().mBuffers[1].mDataByteSize == theFormat.FramesToBytes(200), "the fetch didn't set the buffer sizes");
+	TEST_CHECK(theFIFO.GetUnderrunCount() == 0, "a fetch limited by its buffers counted as an underrun");
+	theBlock.Get().mBuffers[0].mDataByteSize = theBlock.Get().mBuffers[1].mDataByteSize = theFormat.FramesToBytes(256);
+	TEST_CHECK(theFIFO.Fetch(theBlock.Get(), 256) == 156, "didn't fetch the 156 frames left");
+	TEST_CHECK(theFIFO.GetUnderrunCount() == 1, "running out of frames didn't count as an underrun");
+}
+
+int	main(int argc, const char* argv[])
+{
+	double theSeconds = (argc > 1) ? atof(argv[1]) : 6.0;
+
+	//	at ten times real time, 6 seconds of audio take about 0.6 seconds each
+	const StressCase theCases[] =
+	{
+		{ "interleaved, fetching 512 from 441", true, 16384, 441, 512, false, 0, 0 },
+		{ "planar, fetching 160 from 1000", false, 16384, 1000, 160, false, 0, 0 },
+		{ "planar, reading in place 4096 from 333", false, 16384, 333, 4096, true, 0, 0 },
+		{ "interleaved, a stalling consumer", true, 4096, 441, 1024, false, 20, 30 },
+		{ "planar, a stalling consumer in place", false, 4096, 250, 2048, true, 10, 30 },
+	};
+	for(const StressCase& theCase : theCases)
+	{
+		RunStressCase(theCase, theSeconds);
+	}
+
+	TestBufferSizes();
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+//	Checks that taking buffer lists from CAAudioBufferListPool and preparing an
+//	AUOutputBL on top of them, the way the capture callback does, never touches
+//	the heap, and that the pool stays consistent with several threads hammering
+//	it at once.
+#include "AUOutputBL.h"
+#include "CAAudioBufferListPool.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+
+//	replaced so the test can count every allocation; gcc pairs the malloc and free below across the inlined
+//	operators and warns about a mismatch that isn't one
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+	#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<long>	sHeapAllocations(0);
+static std::atomic<bool>	sCountHeapAllocations(false);
+
+void*	operator new(size_t inSize)
+{
+	if(sCountHeapAllocations.load(std::memory_order_relaxed))
+	{
+		sHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	void* theMemory = malloc(inSize);
+	if(theMemory == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return theMemory;
+}
+void*	operator new[](size_t inSize) { return operator new(inSize); }
+void	operator delete(void* inMemory) noexcept { free(inMemory); }
+void	operator delete[](void* inMemory) noexcept { free(inMemory); }
+void	operator delete(void* inMemory, size_t) noexcept { free(inMemory); }
+void	operator delete[](void* inMemory, size_t) noexcept { free(inMemory); }
+
+static const UInt32 kNumberLists = 4;
+static const UInt32 kMaxNumberBuffers = 8;
+static const UInt32 kScratchFrames = 4096;
+
+static UInt32	CountFreeLists(CAAudioBufferListPool& inPool)
+{
+	AudioBufferList* theLists[kNumberLists + 1];
+	UInt32 theNumberLists = 0;
+	while((theNumberLists <= kNumberLists) && ((theLists[theNumberLists] = inPool.Acquire(1)) != NULL))
+	{
+		++theNumberLists;
+	}
+	for(UInt32 theList = 0; theList < theNumberLists; ++theList)
+	{
+		inPool.Release(theLists[theList]);
+	}
+	return theNumberLists;
+}
+
+static void	TestNoHeapAllocations()
+{
+	CAAudioBufferListPool thePool;
+	thePool.Allocate(kNumberLists, kMaxNumberBuffers, kScratchFrames * sizeof(Float32));
+
+	CAStreamBasicDescription theMono(44100.0, 1, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	CAStreamBasicDescription theStereo(48000.0, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	AUOutputBL* theOutput = new AUOutputBL(theMono, thePool, 1024);
+	TEST_CHECK(CountFreeLists(thePool) == kNumberLists - 1, "the AUOutputBL should hold one list");
+
+	//	one sample buffer's worth of list traffic per pass, with a format change every so often
+	sCountHeapAllocations.store(true);
+	for(UInt32 thePass = 0; thePass < 100000; ++thePass)
+	{
+		AudioBufferList* theInput = thePool.Acquire(2);
+		TEST_CHECK(theInput != NULL, "pass %u: the pool ran dry", (unsigned)thePass);
+		if((thePass % 1000) == 0)
+		{
+			theOutput->SetFormat(((thePass / 1000) & 1) ? theStereo : theMono);
+		}
+		theOutput->Allocate(1024);
+		theOutput->Prepare(1024);
+		static_cast<Float32*>(theOutput->ABL()->mBuffers[0].mData)[1023] = 1.f;
+		thePool.Release(theInput);
+	}
+	sCountHeapAllocations.store(false);
+	TEST_CHECK(sHeapAllocations.load() == 0, "%ld heap allocations while capturing, expected none", sHeapAllocations.load());
+
+	delete theOutput;
+	TEST_CHECK(CountFreeLists(thePool) == kNumberLists, "deleting the AUOutputBL should give its list back");
+}
+
+static void	TestConcurrentAcquireAndRelease()
+{
+	CAAudioBufferListPool thePool;
+	thePool.Allocate(kNumberLists, kMaxNumberBuffers, 64);
+
+	std::atomic<bool> theCorrupted(false);
+	std::vector<std::thread> theThreads;
+	for(UInt32 theThread = 0; theThread < 4; ++theThread)
+	{
+		theThreads.push_back(std::thread([&thePool, &theCorrupted, theThread]()
+		{
+			for(UInt32 theIteration = 0; theIteration < 200000; ++theIteration)
+			{
+				AudioBufferList* theList = thePool.Acquire(1);
+				if(theList != NULL)
+				{
+					//	if two threads ever got the same list at once one would see the other's marks
+					UInt32* theScratch = static_cast<UInt32*>(theList->mBuffers[0].mData);
+					theScratch[0] = theThread;
+					theScratch[1] = theIteration;
+					if((theScratch[0] != theThread) || (theScratch[1] != theIteration))
+					{
+						theCorrupted.store(true);
+					}
+					thePool.Release(theList);
+				}
+			}
+		}));
+	}
+	for(std::thread& theThread : theThreads)
+	{
+		theThread.join();
+	}
+	TEST_CHECK(!theCorrupted.load(), "two threads held the same list");
+	TEST_CHECK(CountFreeLists(thePool) == kNumberLists, "lists went missing");
+}
+
+int	main()
+{
+	TestNoHeapAllocations();
+	TestConcurrentAcquireAndRelease();
+	if(gTestFailures == 0)
+	{
+		printf("CAAudioBufferListPoolTest: all passed\n");
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
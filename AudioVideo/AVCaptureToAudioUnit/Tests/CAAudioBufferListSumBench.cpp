@@ -0,0 +1,109 @@
+//	Checks CAAudioBufferList::Sum against a plain double precision loop and
+//	times it against the per sample loop it replaced, over a sweep of source
+//	counts and block sizes. The sweep goes past kMaxSourcesPerMixPass so the
+//	fan-in takes more than one pass. Pass a number of source samples to sum per
+//	case to run longer than the default smoke run ctest does.
+#include "TestSupport.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const UInt32 kNumberChannels = 2;
+static const UInt32 kSourceCounts[] = { 1, 2, 4, 8, 16, 32, CAAudioBufferList::kMaxSourcesPerMixPass, CAAudioBufferList::kMaxSourcesPerMixPass + 1, 2 * CAAudioBufferList::kMaxSourcesPerMixPass + 22 };
+static const UInt32 kFrameCounts[] = { 64, 255, 1024, 4096 };	//	255 is odd on purpose, to exercise the scalar tails
+
+//	what Sum used to do
+static void	SumPerSample(const AudioBufferList& inSource, AudioBufferList& ioSum)
+{
+	for(UInt32 theBuffer = 0; theBuffer < ioSum.mNumberBuffers; ++theBuffer)
+	{
+		const Float32* theSource = static_cast<const Float32*>(inSource.mBuffers[theBuffer].mData);
+		Float32* theSum = static_cast<Float32*>(ioSum.mBuffers[theBuffer].mData);
+		UInt32 theNumberSamples = ioSum.mBuffers[theBuffer].mDataByteSize / sizeof(Float32);
+		for(UInt32 theSample = 0; theSample < theNumberSamples; ++theSample)
+		{
+			theSum[theSample] += theSource[theSample];
+		}
+	}
+}
+
+//	sums inNumberSources sources of inNumberFrames frames every way, checks them against the scalar reference and
+//	prints how fast each way went
+static void	RunCase(UInt32 inNumberSources, UInt32 inNumberFrames, double inSamplesPerCase)
+{
+	CAStreamBasicDescription theFormat = TestPCMFormat(kNumberChannels, 32, 4, true, true, false, false);
+	std::vector<TestBufferList*> theSources;
+	std::vector<const AudioBufferList*> theSourceLists;
+	std::vector<Float32> theGains;
+	for(UInt32 theSource = 0; theSource < inNumberSources; ++theSource)
+	{
+		theSources.push_back(new TestBufferList(theFormat, inNumberFrames));
+		for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+		{
+			for(UInt32 theFrame = 0; theFrame < inNumberFrames; ++theFrame)
+			{
+				theSources.back()->Data<Float32>(theChannel)[theFrame] = rand() / static_cast<Float32>(RAND_MAX) - 0.5f;
+			}
+		}
+		theSourceLists.push_back(&theSources.back()->Get());
+		theGains.push_back(0.5f + 0.01f * (theSource % 50));
+	}
+
+	//	correctness: fan-in with gains, fan-in at unity gain, then the single source forms on top
+	TestBufferList theSum(theFormat, inNumberFrames);
+	CAAudioBufferList::Sum(theSourceLists.data(), theGains.data(), inNumberSources, theSum.Get());
+	CAAudioBufferList::Sum(theSourceLists.data(), NULL, inNumberSources, theSum.Get());
+	CAAudioBufferList::Sum(*theSourceLists[0], theSum.Get());
+	CAAudioBufferList::Sum(*theSourceLists[inNumberSources - 1], 2.f, theSum.Get());
+	UInt32 theNumberWrong = 0;
+	double theWorstError = 0.0;
+	for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+	{
+		for(UInt32 theFrame = 0; theFrame < inNumberFrames; ++theFrame)
+		{
+			double theExpected = theSources[0]->Data<Float32>(theChannel)[theFrame] + 2.0 * theSources[inNumberSources - 1]->Data<Float32>(theChannel)[theFrame];
+			for(UInt32 theSource = 0; theSource < inNumberSources; ++theSource)
+			{
+				theExpected += (1.0 + theGains[theSource]) * theSources[theSource]->Data<Float32>(theChannel)[theFrame];
+			}
+			double theError = fabs(theSum.Data<Float32>(theChannel)[theFrame] - theExpected);
+			theWorstError = (theError > theWorstError) ? theError : theWorstError;
+			//	float rounding grows with the number of terms
+			if(theError > 1.0e-5 * (inNumberSources + 2))
+			{
+				++theNumberWrong;
+			}
+		}
+	}
+	TEST_CHECK(theNumberWrong == 0, "%u sources x %u frames: %u samples are off, by up to %g", (unsigned)inNumberSources, (unsigned)inNumberFrames, (unsigned)theNumberWrong, theWorstError);
+
+	//	speed, in source buffer lists summed per microsecond
+	double theSourceSamples = static_cast<double>(inNumberSources) * inNumberFrames * kNumberChannels;
+	UInt32 theIterations = (theSourceSamples < inSamplesPerCase) ? static_cast<UInt32>(inSamplesPerCase / theSourceSamples) : 1;
+	double thePerSample = TestTime(theIterations, [&]() { for(UInt32 theSource = 0; theSource < inNumberSources; ++theSource) SumPerSample(*theSourceLists[theSource], theSum.Get()); });
+	double theOneAtATime = TestTime(theIterations, [&]() { for(UInt32 theSource = 0; theSource < inNumberSources; ++theSource) CAAudioBufferList::Sum(*theSourceLists[theSource], theSum.Get()); });
+	double theFanIn = TestTime(theIterations, [&]() { CAAudioBufferList::Sum(theSourceLists.data(), theGains.data(), inNumberSources, theSum.Get()); });
+	double theLists = static_cast<double>(theIterations) * inNumberSources;
+	printf("%7u %7u %12.2f %12.2f %12.2f\n", (unsigned)inNumberSources, (unsigned)inNumberFrames, theLists / thePerSample * 1.0e-6, theLists / theOneAtATime * 1.0e-6, theLists / theFanIn * 1.0e-6);
+
+	for(TestBufferList* theSource : theSources)
+	{
+		delete theSource;
+	}
+}
+
+int	main(int argc, const char* argv[])
+{
+	double theSamplesPerCase = (argc > 1) ? atof(argv[1]) : 4.0e6;
+
+	srand(1);
+	printf("lists of %u channels summed per us\n", (unsigned)kNumberChannels);
+	printf("%7s %7s %12s %12s %12s\n", "sources", "frames", "per sample", "one by one", "fan-in");
+	for(UInt32 theNumberSources : kSourceCounts)
+	{
+		for(UInt32 theNumberFrames : kFrameCounts)
+		{
+			RunCase(theNumberSources, theNumberFrames, theSamplesPerCase);
+		}
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,353 @@
+//	Checks that CAAudioRenderDriver renders everything pushed into it exactly
+//	once and in order, in whole quanta and, after a Flush, a short last one,
+//	with sample times that carry on without gaps; and that Reset throws away
+//	what is buffered and starts the sample time again. These are what the
+//	capture controllers rely on to start and end a recording cleanly. Then
+//	does the same where quanta wrap around the ring and have to be copied out
+//	of it, and with kRenderQuantum_Immediate, which renders each push as is.
+#include "CAAudioRenderDriver.h"
+#include "TestSupport.h"
+#include <vector>
+
+static const UInt32 kQuantum = CAAudioRenderDriver::kRenderQuantum_LowLatency;
+static const UInt32 kMaxInputFrames = 512;
+
+//	stands in for the audio unit: pulls its input from the driver and adds 1 to it
+struct	TestUnit
+{
+	CAAudioRenderDriver*	mDriver;
+	std::vector<Float64>	mSampleTimes;
+	std::vector<UInt32>		mFrameCounts;
+	std::vector<const void*>	mInputs;
+
+	static OSStatus	Render(void* inRefCon, AudioUnitRenderActionFlags* ioActionFlags, const AudioTimeStamp* inTimeStamp, UInt32, UInt32 inNumberFrames, AudioBufferList* ioData)
+	{
+		TestUnit* theUnit = static_cast<TestUnit*>(inRefCon);
+		theUnit->mSampleTimes.push_back(inTimeStamp->mSampleTime);
+		theUnit->mFrameCounts.push_back(inNumberFrames);
+		
+		AudioBufferList* theInput = CAAudioBufferList::Create(ioData->mNumberBuffers);
+		OSStatus theError = CAAudioRenderDriver::InputCallback(theUnit->mDriver, ioActionFlags, inTimeStamp, 0, inNumberFrames, theInput);
+		if(theError == noErr)
+		{
+			theUnit->mInputs.push_back(theInput->mBuffers[0].mData);
+			for(UInt32 theBuffer = 0; theBuffer < ioData->mNumberBuffers; ++theBuffer)
+			{
+				const Float32* theSource = static_cast<const Float32*>(theInput->mBuffers[theBuffer].mData);
+				Float32* theDestination = static_cast<Float32*>(ioData->mBuffers[theBuffer].mData);
+				for(UInt32 theSample = 0; theSample < inNumberFrames * theInput->mBuffers[theBuffer].mNumberChannels; ++theSample)
+				{
+					theDestination[theSample] = theSource[theSample] + 1.0f;
+				}
+			}
+		}
+		CAAudioBufferList::Destroy(theInput);
+		return theError;
+	}
+};
+
+//	pushes inNumberFrames frames counting up from inFirstValue, inPushFrames at a time, rendering after each push
+//	the way the capture callback does, and appends what was rendered to ioRendered
+static void	PushAndRender(CAAudioRenderDriver& inDriver, const CAStreamBasicDescription& inFormat, UInt32 inFirstValue, UInt32 inNumberFrames, UInt32 inPushFrames, std::vector<Float32>& ioRendered)
+{
+	TestBufferList theBuffer(inFormat, inPushFrames);
+	for(UInt32 theFrame = 0; theFrame < inNumberFrames; theFrame += inPushFrames)
+	{
+		UInt32 theNumberFrames = std::min(inPushFrames, inNumberFrames - theFrame);
+		for(UInt32 theIndex = 0; theIndex < theNumberFrames; ++theIndex)
+		{
+			theBuffer.Data<Float32>(0)[theIndex] = static_cast<Float32>(inFirstValue + theFrame + theIndex);
+		}
+		theBuffer.Get().mBuffers[0].mDataByteSize = inFormat.FramesToBytes(theNumberFrames);
+		TEST_CHECK(inDriver.Push(theBuffer.Get(), theNumberFrames), "could not push %u frames", (unsigned)theNumberFrames);
+		
+		UInt32 theRenderedFrames = 0;
+		while((inDriver.Render(theRenderedFrames) == noErr) && (theRenderedFrames != 0))
+		{
+			const Float32* theOutput = static_cast<const Float32*>(inDriver.GetOutputBufferList()->mBuffers[0].mData);
+			ioRendered.insert(ioRendered.end(), theOutput, theOutput + theRenderedFrames);
+		}
+	}
+}
+
+static void	RenderFlushed(CAAudioRenderDriver& inDriver, std::vector<Float32>& ioRendered)
+{
+	inDriver.Flush();
+	UInt32 theRenderedFrames = 0;
+	while((inDriver.Render(theRenderedFrames) == noErr) && (theRenderedFrames != 0))
+	{
+		const Float32* theOutput = static_cast<const Float32*>(inDriver.GetOutputBufferList()->mBuffers[0].mData);
+		ioRendered.insert(ioRendered.end(), theOutput, theOutput + theRenderedFrames);
+	}
+}
+
+static bool	IsCount(const std::vector<Float32>& inRendered, UInt32 inFirstValue)
+{
+	for(size_t theFrame = 0; theFrame < inRendered.size(); ++theFrame)
+	{
+		if(inRendered[theFrame] != static_cast<Float32>(inFirstValue + theFrame + 1))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void	TestFlush()
+{
+	CAStreamBasicDescription theFormat = TestPCMFormat(1, 32, 4, true, true, false, true);
+	CAAudioRenderDriver theDriver;
+	TestUnit theUnit = { &theDriver, {}, {}, {} };
+	theDriver.Initialize(theFormat, kQuantum, kMaxInputFrames);
+	theDriver.SetRenderProc(TestUnit::Render, &theUnit);
+	
+	//	the end of a recording: 2500 frames are 2 whole quanta and 452 left waiting until the flush
+	std::vector<Float32> theRendered;
+	PushAndRender(theDriver, theFormat, 0, 2500, 500, theRendered);
+	TEST_CHECK(theRendered.size() == 2 * kQuantum, "rendered %zu frames before the flush", theRendered.size());
+	TEST_CHECK(theDriver.GetBufferedFrames() == 2500 - 2 * kQuantum, "%u frames buffered", (unsigned)theDriver.GetBufferedFrames());
+	RenderFlushed(theDriver, theRendered);
+	TEST_CHECK(theRendered.size() == 2500, "rendered %zu frames after the flush", theRendered.size());
+	TEST_CHECK(IsCount(theRendered, 0), "the rendered frames aren't the pushed ones in order");
+	TEST_CHECK(theDriver.GetBufferedFrames() == 0, "%u frames still buffered after the flush", (unsigned)theDriver.GetBufferedFrames());
+	TEST_CHECK((theUnit.mFrameCounts.size() == 3) && (theUnit.mFrameCounts[2] == 2500 - 2 * kQuantum), "the flush rendered the wrong short quantum");
+	TEST_CHECK((theUnit.mSampleTimes.size() == 3) && (theUnit.mSampleTimes[1] == kQuantum) && (theUnit.mSampleTimes[2] == 2 * kQuantum), "the sample times have gaps");
+	
+	//	a flush only lasts until what was buffered when it was asked for is rendered
+	theRendered.clear();
+	PushAndRender(theDriver, theFormat, 2500, 300, 300, theRendered);
+	TEST_CHECK(theRendered.empty(), "rendered %zu frames without a whole quantum or a flush", theRendered.size());
+	
+	//	a flush with nothing buffered renders nothing
+	CAAudioRenderDriver theEmptyDriver;
+	TestUnit theEmptyUnit = { &theEmptyDriver, {}, {}, {} };
+	theEmptyDriver.Initialize(theFormat, kQuantum, kMaxInputFrames);
+	theEmptyDriver.SetRenderProc(TestUnit::Render, &theEmptyUnit);
+	RenderFlushed(theEmptyDriver, theRendered);
+	TEST_CHECK(theEmptyUnit.mFrameCounts.empty(), "an empty flush rendered");
+}
+
+static void	TestReset()
+{
+	CAStreamBasicDescription theFormat = TestPCMFormat(1, 32, 4, true, true, false, true);
+	CAAudioRenderDriver theDriver;
+	TestUnit theUnit = { &theDriver, {}, {}, {} };
+	theDriver.Initialize(theFormat, kQuantum, kMaxInputFrames);
+	theDriver.SetRenderProc(TestUnit::Render, &theUnit);
+	
+	//	what was captured before a recording started doesn't end up in it, and the recording starts at sample time 0
+	std::vector<Float32> theRendered;
+	PushAndRender(theDriver, theFormat, 0, 1500, 500, theRendered);
+	TEST_CHECK(theDriver.GetBufferedFrames() == 1500 - kQuantum, "%u frames buffered", (unsigned)theDriver.GetBufferedFrames());
+	theDriver.Reset();
+	TEST_CHECK(theDriver.GetBufferedFrames() == 0, "%u frames buffered after the reset", (unsigned)theDriver.GetBufferedFrames());
+	
+	theRendered.clear();
+	theUnit.mSampleTimes.clear();
+	PushAndRender(theDriver, theFormat, 10000, 1100, 500, theRendered);
+	RenderFlushed(theDriver, theRendered);
+	TEST_CHECK(theRendered.size() == 1100, "rendered %zu frames after the reset", theRendered.size());
+	TEST_CHECK(IsCount(theRendered, 10000), "frames from before the reset were rendered after it");
+	TEST_CHECK(!theUnit.mSampleTimes.empty() && (theUnit.mSampleTimes[0] == 0.0), "the first render after the reset isn't at sample time 0");
+	
+	//	a flush asked for before a reset doesn't carry over
+	PushAndRender(theDriver, theFormat, 0, 200, 200, theRendered);
+	theDriver.Flush();
+	theDriver.Reset(5000.0);
+	theRendered.clear();
+	theUnit.mSampleTimes.clear();
+	PushAndRender(theDriver, theFormat, 0, 300, 300, theRendered);
+	TEST_CHECK(theRendered.empty(), "a flush survived the reset");
+	RenderFlushed(theDriver, theRendered);
+	TEST_CHECK((theUnit.mSampleTimes.size() == 1) && (theUnit.mSampleTimes[0] == 5000.0), "the reset didn't start the sample time at 5000");
+}
+
+//	the value of every sample of frame inFrame in channel inChannel that the multichannel cases push
+static Float32	SampleValue(UInt32 inFrame, UInt32 inChannel)
+{
+	return static_cast<Float32>(inFrame * 4 + inChannel);
+}
+
+//	pushes inNumberFrames frames of inFormat starting at frame inFirstFrame, inPushFrames at a time, rendering after
+//	each push; checks that every rendered frame is the next one pushed plus 1 in every channel, and returns how many
+//	frames were rendered
+static UInt32	PushAndRenderChannels(CAAudioRenderDriver& inDriver, const CAStreamBasicDescription& inFormat, UInt32 inFirstFrame, UInt32 inNumberFrames, UInt32 inPushFrames, bool inFlush, const char* inName)
+{
+	TestBufferList theBuffer(inFormat, inPushFrames);
+	UInt32 theNextFrame = inFirstFrame;
+	UInt32 theNumberWrong = 0;
+	auto theRenderAll = [&]()
+	{
+		UInt32 theRenderedFrames = 0;
+		while((inDriver.Render(theRenderedFrames) == noErr) && (theRenderedFrames != 0))
+		{
+			const AudioBufferList& theOutput = *inDriver.GetOutputBufferList();
+			for(UInt32 theBufferIndex = 0; theBufferIndex < theOutput.mNumberBuffers; ++theBufferIndex)
+			{
+				const Float32* theSamples = static_cast<const Float32*>(theOutput.mBuffers[theBufferIndex].mData);
+				UInt32 theNumberChannels = theOutput.mBuffers[theBufferIndex].mNumberChannels;
+				for(UInt32 theFrame = 0; theFrame < theRenderedFrames; ++theFrame)
+				{
+					for(UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+					{
+						if(theSamples[theFrame * theNumberChannels + theChannel] != SampleValue(theNextFrame + theFrame, theBufferIndex + theChannel) + 1.0f)
+						{
+							++theNumberWrong;
+						}
+					}
+				}
+			}
+			theNextFrame += theRenderedFrames;
+		}
+	};
+	
+	for(UInt32 theFrame = 0; theFrame < inNumberFrames; theFrame += inPushFrames)
+	{
+		UInt32 theNumberFrames = std::min(inPushFrames, inNumberFrames - theFrame);
+		for(UInt32 theBufferIndex = 0; theBufferIndex < inFormat.NumberChannelStreams(); ++theBufferIndex)
+		{
+			Float32* theSamples = theBuffer.Data<Float32>(theBufferIndex);
+			UInt32 theNumberChannels = inFormat.NumberInterleavedChannels();
+			for(UInt32 theIndex = 0; theIndex < theNumberFrames; ++theIndex)
+			{
+				for(UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+				{
+					theSamples[theIndex * theNumberChannels + theChannel] = SampleValue(inFirstFrame + theFrame + theIndex, theBufferIndex + theChannel);
+				}
+			}
+			theBuffer.Get().mBuffers[theBufferIndex].mDataByteSize = inFormat.FramesToBytes(theNumberFrames);
+		}
+		TEST_CHECK(inDriver.Push(theBuffer.Get(), theNumberFrames), "%s: could not push %u frames", inName, (unsigned)theNumberFrames);
+		theRenderAll();
+	}
+	if(inFlush)
+	{
+		inDriver.Flush();
+		theRenderAll();
+	}
+	TEST_CHECK(theNumberWrong == 0, "%s: %u rendered samples aren't the pushed ones in order", inName, (unsigned)theNumberWrong);
+	return theNextFrame - inFirstFrame;
+}
+
+//	quanta that aren't a power of two, or that follow a flush, start part way through the ring and sooner or later
+//	run off its end, so Render has to copy them out; pushes of sizes that don't divide the quantum make sure quanta
+//	start everywhere
+static void	TestWrap()
+{
+	const CAStreamBasicDescription theFormats[] =
+	{
+		TestPCMFormat(1, 32, 4, true, true, false, true),
+		TestPCMFormat(2, 32, 4, true, true, false, false),
+		TestPCMFormat(2, 32, 4, true, true, false, true)
+	};
+	const UInt32 kNumberFrames = 20000;
+	for(const CAStreamBasicDescription& theFormat : theFormats)
+	{
+		for(UInt32 thePushFrames : { 441U, 500U, kMaxInputFrames })
+		{
+			//	a 1000 frame quantum in a 2048 frame ring
+			char theName[128];
+			snprintf(theName, sizeof(theName), "%u ch %s, 1000 frame quanta, pushes of %u", (unsigned)theFormat.NumberChannels(), theFormat.IsInterleaved() ? "interleaved" : "deinterleaved", (unsigned)thePushFrames);
+			CAAudioRenderDriver theDriver;
+			TestUnit theUnit = { &theDriver, {}, {}, {} };
+			theDriver.Initialize(theFormat, 1000, kMaxInputFrames);
+			theDriver.SetRenderProc(TestUnit::Render, &theUnit);
+			UInt32 theRenderedFrames = PushAndRenderChannels(theDriver, theFormat, 0, kNumberFrames, thePushFrames, true, theName);
+			TEST_CHECK(theRenderedFrames == kNumberFrames, "%s: rendered %u frames", theName, (unsigned)theRenderedFrames);
+			bool theQuantaAreRight = true, theTimesAreRight = true;
+			for(size_t theRender = 0; theRender < theUnit.mFrameCounts.size(); ++theRender)
+			{
+				theQuantaAreRight = theQuantaAreRight && (theUnit.mFrameCounts[theRender] == 1000);
+				theTimesAreRight = theTimesAreRight && (theUnit.mSampleTimes[theRender] == 1000.0 * theRender);
+			}
+			TEST_CHECK(theQuantaAreRight && (theUnit.mFrameCounts.size() == kNumberFrames / 1000), "%s: rendered in the wrong quanta", theName);
+			TEST_CHECK(theTimesAreRight, "%s: the sample times have gaps", theName);
+			
+			//	the power of two quantum the capture path uses, knocked out of step with the ring by a flush part way
+			snprintf(theName, sizeof(theName), "%u ch %s, %u frame quanta after a flush, pushes of %u", (unsigned)theFormat.NumberChannels(), theFormat.IsInterleaved() ? "interleaved" : "deinterleaved", (unsigned)kQuantum, (unsigned)thePushFrames);
+			CAAudioRenderDriver theFlushedDriver;
+			TestUnit theFlushedUnit = { &theFlushedDriver, {}, {}, {} };
+			theFlushedDriver.Initialize(theFormat, kQuantum, kMaxInputFrames);
+			theFlushedDriver.SetRenderProc(TestUnit::Render, &theFlushedUnit);
+			theRenderedFrames = PushAndRenderChannels(theFlushedDriver, theFormat, 0, 1500, thePushFrames, true, theName);
+			theRenderedFrames += PushAndRenderChannels(theFlushedDriver, theFormat, 1500, kNumberFrames, thePushFrames, true, theName);
+			TEST_CHECK(theRenderedFrames == 1500 + kNumberFrames, "%s: rendered %u frames", theName, (unsigned)theRenderedFrames);
+			Float64 theSampleTime = 0.0;
+			theTimesAreRight = true;
+			for(size_t theRender = 0; theRender < theFlushedUnit.mFrameCounts.size(); ++theRender)
+			{
+				theTimesAreRight = theTimesAreRight && (theFlushedUnit.mSampleTimes[theRender] == theSampleTime);
+				theSampleTime += theFlushedUnit.mFrameCounts[theRender];
+			}
+			TEST_CHECK(theTimesAreRight, "%s: the sample times have gaps", theName);
+		}
+	}
+}
+
+//	each push is rendered by the next Render, all of it and straight out of the pushed buffers
+static void	TestImmediate()
+{
+	const CAStreamBasicDescription theFormats[] =
+	{
+		TestPCMFormat(1, 32, 4, true, true, false, true),
+		TestPCMFormat(2, 32, 4, true, true, false, false)
+	};
+	for(const CAStreamBasicDescription& theFormat : theFormats)
+	{
+		CAAudioRenderDriver theDriver;
+		TestUnit theUnit = { &theDriver, {}, {}, {} };
+		theDriver.Initialize(theFormat, CAAudioRenderDriver::kRenderQuantum_Immediate, kMaxInputFrames);
+		theDriver.SetRenderProc(TestUnit::Render, &theUnit);
+		TEST_CHECK((theDriver.GetMaximumFramesPerRender() == kMaxInputFrames) && (theDriver.GetMaximumLatencyFrames() == 0), "immediate: renders up to %u frames with %u frames of latency", (unsigned)theDriver.GetMaximumFramesPerRender(), (unsigned)theDriver.GetMaximumLatencyFrames());
+		
+		//	whatever the push size, with no flush needed
+		UInt32 theRenderedFrames = 0;
+		for(UInt32 thePushFrames : { 441U, kMaxInputFrames, 1U, 300U })
+		{
+			theRenderedFrames += PushAndRenderChannels(theDriver, theFormat, theRenderedFrames, 3 * thePushFrames, thePushFrames, false, "immediate");
+		}
+		TEST_CHECK(theRenderedFrames == 3 * (441 + kMaxInputFrames + 1 + 300), "immediate: rendered %u frames", (unsigned)theRenderedFrames);
+		TEST_CHECK(theDriver.GetBufferedFrames() == 0, "immediate: %u frames left buffered", (unsigned)theDriver.GetBufferedFrames());
+		bool theTimesAreRight = true;
+		Float64 theSampleTime = 0.0;
+		for(size_t theRender = 0; theRender < theUnit.mFrameCounts.size(); ++theRender)
+		{
+			theTimesAreRight = theTimesAreRight && (theUnit.mSampleTimes[theRender] == theSampleTime);
+			theSampleTime += theUnit.mFrameCounts[theRender];
+		}
+		TEST_CHECK((theUnit.mFrameCounts.size() == 12) && theTimesAreRight, "immediate: %zu renders, or the sample times have gaps", theUnit.mFrameCounts.size());
+		
+		//	the unit is handed the pushed buffers themselves, and a second push has to wait for a Render
+		TestBufferList theFirst(theFormat, 100), theSecond(theFormat, 100);
+		theUnit.mInputs.clear();
+		TEST_CHECK(theDriver.Push(theFirst.Get(), 100) && (theDriver.GetBufferedFrames() == 100), "immediate: couldn't push");
+		TEST_CHECK(!theDriver.Push(theSecond.Get(), 100), "immediate: pushed twice without a Render");
+		UInt32 theNumberFrames = 0;
+		TEST_CHECK((theDriver.Render(theNumberFrames) == noErr) && (theNumberFrames == 100), "immediate: rendered %u frames", (unsigned)theNumberFrames);
+		TEST_CHECK((theUnit.mInputs.size() == 1) && (theUnit.mInputs[0] == theFirst.Get().mBuffers[0].mData), "immediate: the unit wasn't handed the pushed buffer");
+		TEST_CHECK((theDriver.Render(theNumberFrames) == noErr) && (theNumberFrames == 0), "immediate: rendered the same push twice");
+		TEST_CHECK(!theDriver.Push(theSecond.Get(), kMaxInputFrames + 1), "immediate: pushed more than the maximum");
+		
+		//	Reset drops a push that hasn't been rendered, and a Flush has nothing to do
+		TEST_CHECK(theDriver.Push(theSecond.Get(), 100), "immediate: couldn't push after a Render");
+		theDriver.Reset(7000.0);
+		theDriver.Flush();
+		TEST_CHECK((theDriver.Render(theNumberFrames) == noErr) && (theNumberFrames == 0) && (theDriver.GetBufferedFrames() == 0), "immediate: a push survived the reset");
+		theUnit.mSampleTimes.clear();
+		TEST_CHECK(theDriver.Push(theSecond.Get(), 100) && (theDriver.Render(theNumberFrames) == noErr) && (theNumberFrames == 100), "immediate: couldn't push and render after the reset");
+		TEST_CHECK((theUnit.mSampleTimes.size() == 1) && (theUnit.mSampleTimes[0] == 7000.0), "immediate: the reset didn't start the sample time at 7000");
+	}
+}
+
+int	main()
+{
+	TestFlush();
+	TestReset();
+	TestWrap();
+	TestImmediate();
+	if(gTestFailures == 0)
+	{
+		printf("CAAudioRenderDriverTest: all passed\n");
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+//	Times CAPCMConverter on the conversions the capture path actually makes, in
+//	capture-sized slices. Pass an iteration count to run longer than the default
+//	smoke run ctest does.
+#include "CAPCMConverter.h"
+#include "TestSupport.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const UInt32 kNumberFrames = 1024;
+
+static void	Bench(const char* inName, const CAStreamBasicDescription& inSourceFormat, const CAStreamBasicDescription& inDestinationFormat, UInt32 inIterations)
+{
+	CAPCMConverter theConverter;
+	TEST_CHECK(theConverter.Initialize(inSourceFormat, inDestinationFormat) == noErr, "%s: Initialize failed", inName);
+
+	//	fill the source by converting a sine from Float32
+	CAStreamBasicDescription theSineFormat = TestPCMFormat(inSourceFormat.mChannelsPerFrame, 32, 4, true, true, false, false);
+	TestBufferList theSine(theSineFormat, kNumberFrames), theSource(inSourceFormat, kNumberFrames), theDestination(inDestinationFormat, kNumberFrames);
+	for(UInt32 theChannel = 0; theChannel < inSourceFormat.mChannelsPerFrame; ++theChannel)
+	{
+		for(UInt32 theFrame = 0; theFrame < kNumberFrames; ++theFrame)
+		{
+			theSine.Data<Float32>(theChannel)[theFrame] = 0.9f * sinf(0.03f * theFrame);
+		}
+	}
+	CAPCMConverter theFiller;
+	theFiller.Initialize(theSineFormat, inSourceFormat);
+	theFiller.Convert(theSine.Get(), theSource.Get(), kNumberFrames);
+
+	double theSeconds = TestTime(inIterations, [&]() { theConverter.Convert(theSource.Get(), theDestination.Get(), kNumberFrames); });
+	double theSamples = static_cast<double>(inIterations) * kNumberFrames * inSourceFormat.mChannelsPerFrame;
+	printf("%-40s %8.1f Msamples/s\n", inName, theSamples / theSeconds * 1.0e-6);
+}
+
+int	main(int argc, const char* argv[])
+{
+	UInt32 theIterations = (argc > 1) ? static_cast<UInt32>(atoi(argv[1])) : 2000;
+
+	CAStreamBasicDescription theInt16Interleaved = TestPCMFormat(2, 16, 2, false, true, false, true);
+	CAStreamBasicDescription theFloat32Deinterleaved = TestPCMFormat(2, 32, 4, true, false, false, false);
+	CAStreamBasicDescription theInt24BigEndian = TestPCMFormat(2, 24, 3, false, true, true, true);
+	CAStreamBasicDescription theFixed824 = TestPCMFormat(2, 32, 4, false, true, false, false, false, 24);
+
+	Bench("Int16 interleaved -> Float32", theInt16Interleaved, theFloat32Deinterleaved, theIterations);
+	Bench("Float32 -> Int16 interleaved", theFloat32Deinterleaved, theInt16Interleaved, theIterations);
+	Bench("Int24 big endian -> Float32", theInt24BigEndian, theFloat32Deinterleaved, theIterations);
+	Bench("8.24 fixed -> Float32", theFixed824, theFloat32Deinterleaved, theIterations);
+	Bench("Float32 -> Int24 big endian", theFloat32Deinterleaved, theInt24BigEndian, theIterations);
+
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+//	Round trips a Float64 signal through every pair of formats CAPCMConverter
+//	handles and checks it comes back within the quantization of the narrower
+//	one, then checks the vector Float32 -> Int16 kernel saturates exactly like
+//	its scalar tail.
+#include "CAPCMConverter.h"
+#include "CAVectorOps.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+static const UInt32 kNumberFrames = 1001;
+static const UInt32 kNumberChannels = 3;
+
+//	the largest error a value picks up going through inFormat
+static double	Quantization(const CAPCMConverter::SampleFormat& inFormat)
+{
+	switch(inFormat.mKind)
+	{
+		case CAPCMConverter::kSampleKind_Integer:
+			return ldexp(1.0, -static_cast<int>(inFormat.mFractionBits));
+		case CAPCMConverter::kSampleKind_Float32:
+			return 1.0e-7;
+		default:
+			return 1.0e-15;
+	}
+}
+
+//	the largest value inFormat can hold
+static double	FullScale(const CAPCMConverter::SampleFormat& inFormat)
+{
+	if(inFormat.mKind != CAPCMConverter::kSampleKind_Integer)
+	{
+		return std::numeric_limits<double>::max();
+	}
+	return (ldexp(1.0, static_cast<int>(inFormat.mValidBits) - 1) - 1.0) / inFormat.mEncodeScale;
+}
+
+static void	TestRoundTrips()
+{
+	std::vector<CAStreamBasicDescription> theFormats;
+	for(int theInterleaved = 0; theInterleaved < 2; ++theInterleaved)
+	{
+		for(int theBigEndian = 0; theBigEndian < 2; ++theBigEndian)
+		{
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 8, 1, false, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 8, 1, false, false, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 16, 2, false, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 24, 3, false, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 24, 4, false, true, theBigEndian, theInterleaved, true));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 24, 4, false, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 32, 4, false, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 32, 4, false, true, theBigEndian, theInterleaved, false, 24));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 32, 4, true, true, theBigEndian, theInterleaved));
+			theFormats.push_back(TestPCMFormat(kNumberChannels, 64, 8, true, true, theBigEndian, theInterleaved));
+		}
+	}
+
+	//	the first two frames are out of range so every format has to clip
+	CAStreamBasicDescription theReferenceFormat = TestPCMFormat(kNumberChannels, 64, 8, true, true, false, false);
+	TestBufferList theSource(theReferenceFormat, kNumberFrames);
+	for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+	{
+		Float64* theSamples = theSource.Data<Float64>(theChannel);
+		theSamples[0] = 1.5;
+		theSamples[1] = -1.5;
+		for(UInt32 theFrame = 2; theFrame < kNumberFrames; ++theFrame)
+		{
+			theSamples[theFrame] = 0.99 * sin(0.01 * theFrame * (theChannel + 1));
+		}
+	}
+
+	for(const CAStreamBasicDescription& theFormatA : theFormats)
+	{
+		for(const CAStreamBasicDescription& theFormatB : theFormats)
+		{
+			CAPCMConverter theToA, theAToB, theFromB;
+			TEST_CHECK(theToA.Initialize(theReferenceFormat, theFormatA) == noErr, "Initialize failed");
+			TEST_CHECK(theAToB.Initialize(theFormatA, theFormatB) == noErr, "Initialize failed");
+			TEST_CHECK(theFromB.Initialize(theFormatB, theReferenceFormat) == noErr, "Initialize failed");
+
+			TestBufferList theA(theFormatA, kNumberFrames), theB(theFormatB, kNumberFrames), theResult(theReferenceFormat, kNumberFrames);
+			TEST_CHECK(theToA.Convert(theSource.Get(), theA.Get(), kNumberFrames) == noErr, "Convert failed");
+			TEST_CHECK(theAToB.Convert(theA.Get(), theB.Get(), kNumberFrames) == noErr, "Convert failed");
+			TEST_CHECK(theFromB.Convert(theB.Get(), theResult.Get(), kNumberFrames) == noErr, "Convert failed");
+
+			CAPCMConverter::SampleFormat theSampleFormatA, theSampleFormatB;
+			CAPCMConverter::GetSampleFormat(theFormatA, theSampleFormatA);
+			CAPCMConverter::GetSampleFormat(theFormatB, theSampleFormatB);
+			bool theHasFloat32 = (theSampleFormatA.mKind == CAPCMConverter::kSampleKind_Float32) || (theSampleFormatB.mKind == CAPCMConverter::kSampleKind_Float32);
+			double theTolerance = 1.01 * (Quantization(theSampleFormatA) + Quantization(theSampleFormatB)) + 2.0e-9 + (theHasFloat32 ? 1.0e-7 : 0.0);
+			double theFullScale = std::min(FullScale(theSampleFormatA), FullScale(theSampleFormatB));
+
+			for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+			{
+				for(UInt32 theFrame = 0; theFrame < kNumberFrames; ++theFrame)
+				{
+					double theInput = theSource.Data<Float64>(theChannel)[theFrame];
+					double theExpected = std::max(-theFullScale - 1.0e-9, std::min(theFullScale, theInput));
+					//	a pure fraction format holds -1 exactly, and a float on the far side keeps it
+					if((theInput < -1.0) && (theSampleFormatA.mKind == CAPCMConverter::kSampleKind_Integer) && (theSampleFormatA.mFractionBits == theSampleFormatA.mValidBits - 1) && (theSampleFormatB.mKind != CAPCMConverter::kSampleKind_Integer))
+					{
+						theExpected = std::max(theExpected, -1.0);
+					}
+					double theOutput = theResult.Data<Float64>(theChannel)[theFrame];
+					if(fabs(theOutput - theExpected) > theTolerance)
+					{
+						TEST_CHECK(false, "%u bit/%u byte/0x%X -> %u bit/%u byte/0x%X channel %u frame %u: %g came back as %g, expected %g", (unsigned)theFormatA.mBitsPerChannel, (unsigned)theFormatA.mBytesPerFrame, (unsigned)theFormatA.mFormatFlags, (unsigned)theFormatB.mBitsPerChannel, (unsigned)theFormatB.mBytesPerFrame, (unsigned)theFormatB.mFormatFlags, (unsigned)theChannel, (unsigned)theFrame, theInput, theOutput, theExpected);
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+static void	TestFloat32ToInt16Saturation()
+{
+	const Float32 kEdgeCases[] = { std::numeric_limits<Float32>::quiet_NaN(), -std::numeric_limits<Float32>::quiet_NaN(), std::numeric_limits<Float32>::infinity(), -std::numeric_limits<Float32>::infinity(), 65536.f, -65536.f, 1.0f, -1.0f, 1.5f, -1.5f, 0.99999f, -0.99999f, 3.0e9f, -3.0e9f, 0.f, 0.5f / 32768.f };
+	const SInt16 kExpected[] = { 0, 0, 32767, -32768, 32767, -32768, 32767, -32768, 32767, -32768, 32767, -32768, 32767, -32768, 0, 0 };
+	const UInt32 kNumberEdgeCases = sizeof(kEdgeCases) / sizeof(kEdgeCases[0]);
+
+	//	all at once goes down the vector path, one at a time down the scalar tail
+	SInt16 theVectorResult[kNumberEdgeCases];
+	SInt16 theScalarResult[kNumberEdgeCases];
+	CAVectorOps::Float32ToInt16(kEdgeCases, theVectorResult, kNumberEdgeCases);
+	for(UInt32 theIndex = 0; theIndex < kNumberEdgeCases; ++theIndex)
+	{
+		CAVectorOps::Float32ToInt16(kEdgeCases + theIndex, theScalarResult + theIndex, 1);
+	}
+	for(UInt32 theIndex = 0; theIndex < kNumberEdgeCases; ++theIndex)
+	{
+		TEST_CHECK(theVectorResult[theIndex] == kExpected[theIndex], "vector path turned %g into %d, expected %d", kEdgeCases[theIndex], theVectorResult[theIndex], kExpected[theIndex]);
+		TEST_CHECK(theScalarResult[theIndex] == kExpected[theIndex], "scalar tail turned %g into %d, expected %d", kEdgeCases[theIndex], theScalarResult[theIndex], kExpected[theIndex]);
+	}
+}
+
+int	main()
+{
+	TestRoundTrips();
+	TestFloat32ToInt16Saturation();
+	if(gTestFailures == 0)
+	{
+		printf("CAPCMConverterTest: all passed\n");
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
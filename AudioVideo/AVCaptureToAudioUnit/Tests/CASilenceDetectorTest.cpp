@@ -0,0 +1,86 @@
+//	Checks CASilenceDetector's per channel peak and RMS against a plain loop over
+//	mixed interleaved and mono buffers, and its hysteresis, including that a
+//	negative hysteresis is treated as none.
+#include "CASilenceDetector.h"
+#include "TestSupport.h"
+#include <math.h>
+
+static void	TestLevels()
+{
+	std::vector<Float32> theStereo(2 * 1001), theMono(999);
+	for(UInt32 theFrame = 0; theFrame < 1001; ++theFrame)
+	{
+		theStereo[2 * theFrame] = 0.5f * sinf(0.1f * theFrame);
+		theStereo[2 * theFrame + 1] = 0.001f * (static_cast<int>(theFrame % 7) - 3);
+	}
+	theMono[500] = -0.9f;
+
+	AudioBufferList* theBufferList = CAAudioBufferList::Create(2);
+	theBufferList->mBuffers[0].mNumberChannels = 2;
+	theBufferList->mBuffers[0].mDataByteSize = static_cast<UInt32>(theStereo.size() * sizeof(Float32));
+	theBufferList->mBuffers[0].mData = theStereo.data();
+	theBufferList->mBuffers[1].mNumberChannels = 1;
+	theBufferList->mBuffers[1].mDataByteSize = static_cast<UInt32>(theMono.size() * sizeof(Float32));
+	theBufferList->mBuffers[1].mData = theMono.data();
+
+	CASilenceDetector theDetector(-40.f, 6.f);
+	TEST_CHECK(!theDetector.Analyze(*theBufferList), "a -6 dB sine is not silent");
+	TEST_CHECK(theDetector.DidChangeState(), "the detector starts out silent");
+	TEST_CHECK(theDetector.GetNumberChannels() == 3, "%u channels, expected 3", (unsigned)theDetector.GetNumberChannels());
+
+	const Float32* theChannels[3] = { theStereo.data(), theStereo.data() + 1, theMono.data() };
+	const UInt32 theStrides[3] = { 2, 2, 1 };
+	const UInt32 theFrames[3] = { 1001, 1001, 999 };
+	for(UInt32 theChannel = 0; theChannel < 3; ++theChannel)
+	{
+		double thePeak = 0.0, theSumOfSquares = 0.0;
+		for(UInt32 theFrame = 0; theFrame < theFrames[theChannel]; ++theFrame)
+		{
+			double theValue = theChannels[theChannel][theFrame * theStrides[theChannel]];
+			thePeak = fmax(thePeak, fabs(theValue));
+			theSumOfSquares += theValue * theValue;
+		}
+		double theRMS = sqrt(theSumOfSquares / theFrames[theChannel]);
+		TEST_CHECK(fabs(theDetector.GetPeak(theChannel) - thePeak) < 1.0e-6, "channel %u peak %g, expected %g", (unsigned)theChannel, theDetector.GetPeak(theChannel), thePeak);
+		TEST_CHECK(fabs(theDetector.GetRMS(theChannel) - theRMS) < 1.0e-5 * (1.0 + theRMS), "channel %u RMS %g, expected %g", (unsigned)theChannel, theDetector.GetRMS(theChannel), theRMS);
+	}
+
+	//	-44 dB is below the threshold but inside the hysteresis, -50 dB is past it
+	for(Float32& theValue : theStereo) { theValue *= 0.012f; }
+	for(Float32& theValue : theMono) { theValue = 0.f; }
+	TEST_CHECK(!theDetector.Analyze(*theBufferList), "-44 dB is within the hysteresis and should stay active");
+	for(Float32& theValue : theStereo) { theValue *= 0.5f; }
+	TEST_CHECK(theDetector.Analyze(*theBufferList) && theDetector.DidChangeState(), "-50 dB is past the hysteresis and should be silent");
+
+	CAAudioBufferList::Destroy(theBufferList);
+}
+
+static void	TestNegativeHysteresis()
+{
+	CASilenceDetector theDetector(-40.f, -12.f);
+	TEST_CHECK(theDetector.GetHysteresis() == 0.f, "the constructor kept a hysteresis of %g", theDetector.GetHysteresis());
+
+	//	with no hysteresis the signal goes silent as soon as it drops below the threshold, and never sooner
+	Float32 theSamples[64];
+	AudioBufferList theBufferList = { 1, { { 1, sizeof(theSamples), theSamples } } };
+	for(Float32& theValue : theSamples) { theValue = CASilenceDetector::DBToAmplitude(-39.f); }
+	TEST_CHECK(!theDetector.Analyze(theBufferList), "-39 dB is above the threshold");
+	for(Float32& theValue : theSamples) { theValue = CASilenceDetector::DBToAmplitude(-39.9f); }
+	TEST_CHECK(!theDetector.Analyze(theBufferList), "-39.9 dB is still above the threshold");
+	for(Float32& theValue : theSamples) { theValue = CASilenceDetector::DBToAmplitude(-40.1f); }
+	TEST_CHECK(theDetector.Analyze(theBufferList), "-40.1 dB is below the threshold");
+
+	theDetector.SetHysteresis(-3.f);
+	TEST_CHECK(theDetector.GetHysteresis() == 0.f, "SetHysteresis kept a hysteresis of %g", theDetector.GetHysteresis());
+}
+
+int	main()
+{
+	TestLevels();
+	TestNegativeHysteresis();
+	if(gTestFailures == 0)
+	{
+		printf("CASilenceDetectorTest: all passed\n");
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+//	Checks that CAStaticStreamFormat describes the same formats at compile time
+//	as the ASBDs it stands for, that the dispatcher finds exactly those formats,
+//	and that CAPCMConverter, which uses the per pair kernels for them, converts
+//	every pair of them exactly as its general purpose path does.
+#include "CAPCMConverter.h"
+#include "CAStaticStreamFormat.h"
+#include "TestSupport.h"
+#include <math.h>
+
+static const UInt32 kNumberFrames = 1001;
+
+typedef CAStaticStreamFormat<SInt16, 2, true>	Int16Interleaved;
+typedef CAStaticStreamFormat<Float32, 2, false>	Float32Deinterleaved;
+typedef CAStaticStreamFormat<SInt32, 1, false>	Fixed824Mono;
+
+static_assert(Int16Interleaved::FramesToBytes(512) == 2048, "interleaved Int16 stereo is 4 bytes a frame");
+static_assert(Float32Deinterleaved::FramesToBytes(512) == 2048, "deinterleaved Float32 is 4 bytes a frame in each buffer");
+static_assert(Float32Deinterleaved::kNumberChannelStreams == 2, "deinterleaved stereo has two buffers");
+static_assert(Int16Interleaved::Matches(Int16Interleaved::ASBD(44100.0)), "a format matches its own ASBD");
+static_assert(!Int16Interleaved::Matches(Float32Deinterleaved::ASBD(44100.0)), "a format doesn't match another's ASBD");
+static_assert(Fixed824Mono::Matches(Fixed824Mono::ASBD(8000.0)), "a format matches its own ASBD");
+
+//	the formats the dispatcher covers
+static std::vector<CAStreamBasicDescription>	StaticFormats()
+{
+	std::vector<CAStreamBasicDescription> theFormats;
+	for(UInt32 theNumberChannels = 1; theNumberChannels <= CAStaticStreamFormatDispatcher::kMaxNumberChannels; ++theNumberChannels)
+	{
+		for(int theInterleaved = 0; theInterleaved < 2; ++theInterleaved)
+		{
+			theFormats.push_back(TestPCMFormat(theNumberChannels, 32, 4, true, false, false, theInterleaved));
+			theFormats.push_back(TestPCMFormat(theNumberChannels, 16, 2, false, true, false, theInterleaved));
+			theFormats.push_back(TestPCMFormat(theNumberChannels, 32, 4, false, true, false, theInterleaved, false, 24));
+		}
+	}
+	return theFormats;
+}
+
+template <class Format> struct FramesPerBuffer { static void Run(UInt32& outNumberFrames) { outNumberFrames = Format::BytesToFrames(4096); } };
+template <class Format> struct Silence : CAStaticFormatKernels<Format>::SilenceKernel {};
+template <class Format> struct Prepare : CAStaticFormatKernels<Format>::PrepareKernel {};
+typedef void	(*FramesPerBufferFunction)(UInt32& outNumberFrames);
+
+static void	TestDispatch()
+{
+	for(const CAStreamBasicDescription& theFormat : StaticFormats())
+	{
+		char theName[256];
+		theFormat.AsString(theName, sizeof(theName));
+
+		UInt32 theNumberFrames = 0;
+		TEST_CHECK(CAStaticStreamFormatDispatcher::Dispatch<FramesPerBuffer>(theFormat, theNumberFrames) && (theNumberFrames == theFormat.BytesToFrames(4096)), "%s: dispatched to a format that holds %u frames", theName, (unsigned)theNumberFrames);
+		FramesPerBufferFunction theFunction = CAStaticStreamFormatDispatcher::Resolve<FramesPerBuffer, FramesPerBufferFunction>(theFormat);
+		theNumberFrames = 0;
+		TEST_CHECK((theFunction != NULL) && ((*theFunction)(theNumberFrames), theNumberFrames == theFormat.BytesToFrames(4096)), "%s: didn't resolve", theName);
+
+		//	Prepare lays the buffers out the way CAStreamBasicDescription says, and Silence zeroes them
+		std::vector<Byte> theMemory(2 * 4096, 0xFF);
+		AudioBufferList* theList = CAAudioBufferList::Create(theFormat.NumberChannelStreams());
+		TEST_CHECK(CAStaticStreamFormatDispatcher::Dispatch<Prepare>(theFormat, *theList, theMemory.data(), 4096U, 100U), "%s: Prepare didn't dispatch", theName);
+		TEST_CHECK(CAStaticStreamFormatDispatcher::Dispatch<Silence>(theFormat, *theList, 100U), "%s: Silence didn't dispatch", theName);
+		for(UInt32 theBuffer = 0; theBuffer < theFormat.NumberChannelStreams(); ++theBuffer)
+		{
+			TEST_CHECK((theList->mBuffers[theBuffer].mData == theMemory.data() + theBuffer * 4096) && (theList->mBuffers[theBuffer].mDataByteSize == theFormat.FramesToBytes(100))
+						&& (theList->mBuffers[theBuffer].mNumberChannels == theFormat.NumberInterleavedChannels()), "%s: buffer %u isn't laid out right", theName, (unsigned)theBuffer);
+			const Byte* theBytes = theMemory.data() + theBuffer * 4096;
+			TEST_CHECK((theBytes[0] == 0) && (theBytes[theFormat.FramesToBytes(100) - 1] == 0) && (theBytes[theFormat.FramesToBytes(100)] == 0xFF), "%s: buffer %u isn't silenced right", theName, (unsigned)theBuffer);
+		}
+		CAAudioBufferList::Destroy(theList);
+	}
+
+	//	and nothing else
+	const CAStreamBasicDescription theOthers[] =
+	{
+		TestPCMFormat(3, 32, 4, true, false, false, false),
+		TestPCMFormat(2, 64, 8, true, false, false, false),
+		TestPCMFormat(2, 16, 2, false, true, true, true),
+		TestPCMFormat(2, 16, 2, false, false, false, true),
+		TestPCMFormat(2, 24, 3, false, true, false, true),
+		TestPCMFormat(2, 32, 4, false, true, false, false),
+		TestPCMFormat(2, 32, 4, true, true, false, false),
+	};
+	for(const CAStreamBasicDescription& theFormat : theOthers)
+	{
+		char theName[256];
+		theFormat.AsString(theName, sizeof(theName));
+		UInt32 theNumberFrames = 0;
+		TEST_CHECK(!CAStaticStreamFormatDispatcher::Dispatch<FramesPerBuffer>(theFormat, theNumberFrames) && (theNumberFrames == 0), "%s: dispatched", theName);
+		FramesPerBufferFunction theFunction = CAStaticStreamFormatDispatcher::Resolve<FramesPerBuffer, FramesPerBufferFunction>(theFormat);
+		TEST_CHECK(theFunction == NULL, "%s: resolved", theName);
+	}
+}
+
+//	converts every pair of formats with the same number of channels both directly, which takes the static kernel,
+//	and through deinterleaved Float64, which takes the general purpose path both ways, and checks that the bytes agree
+static void	TestConversions()
+{
+	std::vector<CAStreamBasicDescription> theFormats = StaticFormats();
+	for(const CAStreamBasicDescription& theSourceFormat : theFormats)
+	{
+		//	a signal that clips, hits full scale exactly and has values halfway between Int16 steps
+		UInt32 theNumberChannels = theSourceFormat.NumberChannels();
+		CAStreamBasicDescription theFloat64 = TestPCMFormat(theNumberChannels, 64, 8, true, false, false, false);
+		TestBufferList theSignal(theFloat64, kNumberFrames);
+		for(UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+		{
+			Float64* theSamples = theSignal.Data<Float64>(theChannel);
+			for(UInt32 theFrame = 0; theFrame < kNumberFrames; ++theFrame)
+			{
+				theSamples[theFrame] = 1.2 * sin(0.01 * theFrame + theChannel);
+			}
+			theSamples[0] = 1.0;
+			theSamples[1] = -1.0;
+			theSamples[2] = 1001.5 / 32768.0;
+			theSamples[3] = -2.5 / 32768.0;
+		}
+		TestBufferList theSource(theSourceFormat, kNumberFrames);
+		CAPCMConverter theFiller;
+		theFiller.Initialize(theFloat64, theSourceFormat);
+		theFiller.Convert(theSignal.Get(), theSource.Get(), kNumberFrames);
+
+		CAPCMConverter theToFloat64;
+		theToFloat64.Initialize(theSourceFormat, theFloat64);
+		theToFloat64.Convert(theSource.Get(), theSignal.Get(), kNumberFrames);
+
+		for(const CAStreamBasicDescription& theDestinationFormat : theFormats)
+		{
+			if(theDestinationFormat.NumberChannels() != theNumberChannels)
+			{
+				continue;
+			}
+			char theSourceName[256], theDestinationName[256], theName[520];
+			theSourceFormat.AsString(theSourceName, sizeof(theSourceName));
+			theDestinationFormat.AsString(theDestinationName, sizeof(theDestinationName));
+			snprintf(theName, sizeof(theName), "%s -> %s", theSourceName, theDestinationName);
+
+			TestBufferList theExpected(theDestinationFormat, kNumberFrames), theActual(theDestinationFormat, kNumberFrames);
+			CAPCMConverter theFromFloat64, theConverter;
+			theFromFloat64.Initialize(theFloat64, theDestinationFormat);
+			theFromFloat64.Convert(theSignal.Get(), theExpected.Get(), kNumberFrames);
+			TEST_CHECK(theConverter.Initialize(theSourceFormat, theDestinationFormat) == noErr, "%s: Initialize failed", theName);
+			TEST_CHECK(theConverter.Convert(theSource.Get(), theActual.Get(), kNumberFrames) == noErr, "%s: Convert failed", theName);
+
+			for(UInt32 theBuffer = 0; theBuffer < theDestinationFormat.NumberChannelStreams(); ++theBuffer)
+			{
+				TEST_CHECK(theActual.Get().mBuffers[theBuffer].mDataByteSize == theDestinationFormat.FramesToBytes(kNumberFrames), "%s: buffer %u holds %u bytes", theName, (unsigned)theBuffer, (unsigned)theActual.Get().mBuffers[theBuffer].mDataByteSize);
+				TEST_CHECK(memcmp(theActual.Data<Byte>(theBuffer), theExpected.Data<Byte>(theBuffer), theDestinationFormat.FramesToBytes(kNumberFrames)) == 0, "%s: buffer %u differs from the general path", theName, (unsigned)theBuffer);
+			}
+		}
+	}
+}
+
+//	NaN has no integer, so both integer formats turn it into silence
+static void	TestNaN()
+{
+	CAStreamBasicDescription theFloat32 = TestPCMFormat(2, 32, 4, true, false, false, true);
+	const CAStreamBasicDescription theIntegers[] = { TestPCMFormat(2, 16, 2, false, true, false, false), TestPCMFormat(2, 32, 4, false, true, false, false, false, 24) };
+	for(const CAStreamBasicDescription& theInteger : theIntegers)
+	{
+		TestBufferList theSource(theFloat32, 4), theDestination(theInteger, 4);
+		Float32* theSamples = theSource.Data<Float32>(0);
+		for(UInt32 theSample = 0; theSample < 8; ++theSample)
+		{
+			theSamples[theSample] = (theSample & 1) ? NAN : 0.5f;
+		}
+		memset(theDestination.Data<Byte>(0), 0xFF, theInteger.FramesToBytes(4));
+		memset(theDestination.Data<Byte>(1), 0xFF, theInteger.FramesToBytes(4));
+		CAPCMConverter theConverter;
+		theConverter.Initialize(theFloat32, theInteger);
+		theConverter.Convert(theSource.Get(), theDestination.Get(), 4);
+		for(UInt32 theFrame = 0; theFrame < 4; ++theFrame)
+		{
+			bool isRight = (theInteger.mBitsPerChannel == 16) ? ((theDestination.Data<SInt16>(0)[theFrame] == 16384) && (theDestination.Data<SInt16>(1)[theFrame] == 0))
+															   : ((theDestination.Data<SInt32>(0)[theFrame] == (1 << 23)) && (theDestination.Data<SInt32>(1)[theFrame] == 0));
+			TEST_CHECK(isRight, "%u bit: frame %u is wrong", (unsigned)theInteger.mBitsPerChannel, (unsigned)theFrame);
+		}
+	}
+}
+
+int	main()
+{
+	TestDispatch();
+	TestConversions();
+	TestNaN();
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+//	Checks CAStreamFormatText::Parse on a corpus of format strings, that
+//	CAStreamBasicDescription::FromText still prints the diagnostics it always
+//	has, that AsString and GetSimpleName write what the stdio versions did, and
+//	that CAStreamFormatRegistry hands back the same entry for the same format.
+//	Then times parsing and formatting the corpus, directly and through the
+//	registry; pass an iteration count to run longer than ctest does.
+#include "CAStreamFormatRegistry.h"
+#include "CAStreamFormatText.h"
+#include "TestSupport.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+static const char* const kCorpus[] =
+{
+	"F32@44100,2", "LEI16@48000,2", "BEI24@96000,1", "-F32@44100,2D", "I8.24@44100,2D", "UI8@8000,1", "F64",
+	"aac", "aac@44100,2", "alac@48000,2", "ima4@22050#64,1", "I20@44100:L4,2", "I20:H4,2", "I16@44100/C,2",
+	"I16#4", "ulaw@8000", "\\x41\\x42CD", "I16,2I", "mp4a@48000", "LEF32@192000,8D", "I12@11025,3"
+};
+
+//	what FromText printed to stderr for inText
+static std::string	FromTextDiagnostics(const char* inText, bool& outResult)
+{
+	fflush(stderr);
+	FILE* theCapture = tmpfile();
+	int theSavedStderr = dup(fileno(stderr));
+	dup2(fileno(theCapture), fileno(stderr));
+	
+	AudioStreamBasicDescription theDesc;
+	outResult = CAStreamBasicDescription::FromText(inText, theDesc);
+	
+	fflush(stderr);
+	dup2(theSavedStderr, fileno(stderr));
+	close(theSavedStderr);
+	std::string theAnswer;
+	rewind(theCapture);
+	int theCharacter;
+	while((theCharacter = fgetc(theCapture)) != EOF)
+	{
+		theAnswer += static_cast<char>(theCharacter);
+	}
+	fclose(theCapture);
+	return theAnswer;
+}
+
+static void	TestParse()
+{
+	AudioStreamBasicDescription theDesc;
+	TEST_CHECK(CAStreamFormatText::Parse("F32@44100,2D", 12, theDesc), "F32@44100,2D should parse");
+	TEST_CHECK((theDesc.mFormatID == kAudioFormatLinearPCM) && (theDesc.mSampleRate == 44100.0) && (theDesc.mChannelsPerFrame == 2) && (theDesc.mBitsPerChannel == 32) && (theDesc.mBytesPerFrame == 4) && (theDesc.mFormatFlags == (kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved)), "F32@44100,2D parsed wrong");
+	TEST_CHECK(CAStreamFormatText::Parse("BEI24@96000,2", 13, theDesc), "BEI24@96000,2 should parse");
+	TEST_CHECK((theDesc.mBytesPerFrame == 6) && (theDesc.mFormatFlags == (kAudioFormatFlagIsBigEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked)), "BEI24@96000,2 parsed wrong");
+	TEST_CHECK(CAStreamFormatText::Parse("aac@44100,2", 11, theDesc) && (theDesc.mFormatID == kAudioFormatMPEG4AAC), "aac should parse");
+	//	the text doesn't need a null, only a length
+	TEST_CHECK(CAStreamFormatText::Parse("I16@44100,2XYZ", 11, theDesc) && (theDesc.mChannelsPerFrame == 2), "a length should end the text");
+	
+	struct { const char* mText; UInt32 mKind; size_t mOffset; } const kFailures[] =
+	{
+		{ "F32@44100,2X",	CAStreamFormatText::ParseError::kExtraCharacters,		11 },
+		{ "aac@44100,2D",	CAStreamFormatText::ParseError::kNonInterleavedNonPCM,	12 },
+		{ "I16.",			CAStreamFormatText::ParseError::kMissingFractionBits,	4 },
+		{ "I16:Q4",			CAStreamFormatText::ParseError::kSyntax,				4 },
+		{ "ac",				CAStreamFormatText::ParseError::kBadFormatID,			2 }
+	};
+	for(const auto& theFailure : kFailures)
+	{
+		CAStreamFormatText::ParseError theError;
+		TEST_CHECK(!CAStreamFormatText::Parse(theFailure.mText, strlen(theFailure.mText), theDesc, &theError), "'%s' should not parse", theFailure.mText);
+		TEST_CHECK((theError.mKind == theFailure.mKind) && (theError.mOffset == theFailure.mOffset), "'%s' failed with %u at %zu, expected %u at %zu", theFailure.mText, (unsigned)theError.mKind, theError.mOffset, (unsigned)theFailure.mKind, theFailure.mOffset);
+	}
+}
+
+static void	TestFromTextDiagnostics()
+{
+	struct { const char* mText; const char* mDiagnostics; } const kCases[] =
+	{
+		{ "F32@44100,2X",	"extra characters at end of format string: X\nInvalid format string: F32@44100,2X\nSyntax of format strings is: \n" },
+		{ "aac@44100,2D",	"non-interleaved flag invalid for non-PCM formats\nInvalid format string: aac@44100,2D\nSyntax of format strings is: \n" },
+		{ "I16.",			"Expected fractional bits following '.'\nInvalid format string: I16.\nSyntax of format strings is: \n" },
+		{ "I16:Q4",			"Invalid format string: I16:Q4\nSyntax of format strings is: \n" },
+		{ "ac",				"" },
+		{ "I16@44100,2",	"" }
+	};
+	for(const auto& theCase : kCases)
+	{
+		bool theResult = false;
+		std::string theDiagnostics = FromTextDiagnostics(theCase.mText, theResult);
+		TEST_CHECK(theResult == (theCase.mText[0] == 'I' && theCase.mText[3] == '@'), "FromText('%s') returned %d", theCase.mText, theResult);
+		TEST_CHECK(theDiagnostics == theCase.mDiagnostics, "FromText('%s') printed \"%s\", expected \"%s\"", theCase.mText, theDiagnostics.c_str(), theCase.mDiagnostics);
+	}
+}
+
+//	what the stdio AsString and GetSimpleName wrote for each of kCorpus
+static const struct { const char* mString; const char* mSimpleName; const char* mAbbreviatedSimpleName; } kExpected[] =
+{
+	{ " 2 ch,  44100 Hz, 'lpcm' (0x00000009) 32-bit little-endian float", "Mixable 2 Channel 32 Bit Floating Point", "Mixable 2 Ch Float32" },
+	{ " 2 ch,  48000 Hz, 'lpcm' (0x0000000C) 16-bit little-endian signed integer", "Mixable 2 Channel 16 Bit Signed Integer", "Mixable 2 Ch SInt16" },
+	{ " 1 ch,  96000 Hz, 'lpcm' (0x0000000E) 24-bit big-endian signed integer", "Mixable 1 Channel 24 Bit Big Endian Signed Integer", "Mixable 1 Ch Big Endian SInt24" },
+	{ " 2 ch,  44100 Hz, 'lpcm' (0x00000029) 32-bit little-endian float, deinterleaved", "Mixable 2 Channel 32 Bit Floating Point", "Mixable 2 Ch Float32" },
+	{ " 2 ch,  44100 Hz, 'lpcm' (0x00000C2C) 8.24-bit little-endian signed integer, deinterleaved", "Mixable 2 Channel 32 Bit Signed Integer", "Mixable 2 Ch SInt32" },
+	{ " 1 ch,   8000 Hz, 'lpcm' (0x00000008) 8-bit unsigned integer", "Mixable 1 Channel 8 Bit Unsigned Integer", "Mixable 1 Ch UInt8" },
+	{ " 1 ch,      0 Hz, 'lpcm' (0x00000009) 64-bit little-endian float", "Mixable 1 Channel 64 Bit Floating Point", "Mixable 1 Ch Float64" },
+	{ " 0 ch,      0 Hz, 'aac ' (0x00000000) 0 bits/channel, 0 bytes/packet, 0 frames/packet, 0 bytes/frame", "aac ", "aac " },
+	{ " 2 ch,  44100 Hz, 'aac ' (0x00000000) 0 bits/channel, 0 bytes/packet, 0 frames/packet, 0 bytes/frame", "aac ", "aac " },
+	{ " 2 ch,  48000 Hz, 'alac' (0x00000000) from UNKNOWN source bit depth, 0 frames/packet", "alac", "alac" },
+	{ " 1 ch,  22050 Hz, 'ima4' (0x00000000) 0 bits/channel, 0 bytes/packet, 64 frames/packet, 0 bytes/frame", "ima4", "ima4" },
+	{ " 2 ch,  44100 Hz, 'lpcm' (0x00000004) 20-bit little-endian signed integer, unpacked in 4 bytes low-aligned", "Mixable 2 Channel 20 Bit Signed Integer Aligned Low in 32 Bits", "Mixable 2 Ch Low SInt20/SInt32" },
+	{ " 2 ch,      0 Hz, 'lpcm' (0x00000014) 20-bit little-endian signed integer, unpacked in 4 bytes high-aligned", "Mixable 2 Channel 20 Bit Signed Integer Aligned High in 32 Bits", "Mixable 2 Ch High SInt20/SInt32" },
+	{ " 2 ch,  44100 Hz, 'lpcm' (0x0000000C) 16-bit little-endian signed integer", "Mixable 2 Channel 16 Bit Signed Integer", "Mixable 2 Ch SInt16" },
+	{ " 1 ch,      0 Hz, 'lpcm' (0x0000000C) 16-bit little-endian signed integer", "Mixable 1 Channel 16 Bit Signed Integer", "Mixable 1 Ch SInt16" },
+	{ " 0 ch,   8000 Hz, 'ulaw' (0x00000000) 0 bits/channel, 0 bytes/packet, 0 frames/packet, 0 bytes/frame", "ulaw", "ulaw" },
+	{ " 0 ch,      0 Hz, 'ABCD' (0x00000000) 0 bits/channel, 0 bytes/packet, 0 frames/packet, 0 bytes/frame", "ABCD", "ABCD" },
+	{ " 2 ch,      0 Hz, 'lpcm' (0x0000000C) 16-bit little-endian signed integer", "Mixable 2 Channel 16 Bit Signed Integer", "Mixable 2 Ch SInt16" },
+	{ " 0 ch,  48000 Hz, 'mp4a' (0x00000000) 0 bits/channel, 0 bytes/packet, 0 frames/packet, 0 bytes/frame", "mp4a", "mp4a" },
+	{ " 8 ch, 192000 Hz, 'lpcm' (0x00000029) 32-bit little-endian float, deinterleaved", "Mixable 8 Channel 32 Bit Floating Point", "Mixable 8 Ch Float32" },
+	{ " 3 ch,  11025 Hz, 'lpcm' (0x00000014) 12-bit little-endian signed integer, unpacked in 2 bytes high-aligned", "Mixable 3 Channel 12 Bit Signed Integer Aligned High in 16 Bits", "Mixable 3 Ch High SInt12/SInt16" }
+};
+static_assert(sizeof(kExpected) / sizeof(kExpected[0]) == sizeof(kCorpus) / sizeof(kCorpus[0]), "every format string needs its expected text");
+
+static void	TestText()
+{
+	//	twice, so that the second time around everything comes out of the registry
+	for(int thePass = 0; thePass < 2; ++thePass)
+	{
+		for(size_t theIndex = 0; theIndex < sizeof(kCorpus) / sizeof(kCorpus[0]); ++theIndex)
+		{
+			const char* theText = kCorpus[theIndex];
+			AudioStreamBasicDescription theDesc;
+			TEST_CHECK(CAStreamBasicDescription::FromText(theText, theDesc), "'%s' should parse", theText);
+			
+			char theFormatted[256], theAsString[256], theName[128], theAbbreviatedName[64], theNameWithRate[128];
+			CAStreamFormatText::Format(theDesc, theFormatted, sizeof(theFormatted));
+			CAStreamBasicDescription(theDesc).AsString(theAsString, sizeof(theAsString));
+			CAStreamBasicDescription::GetSimpleName(theDesc, theName, sizeof(theName), false);
+			CAStreamBasicDescription::GetSimpleName(theDesc, theAbbreviatedName, sizeof(theAbbreviatedName), true);
+			CAStreamBasicDescription::GetSimpleName(theDesc, theNameWithRate, sizeof(theNameWithRate), false, true);
+			TEST_CHECK(strcmp(theFormatted, kExpected[theIndex].mString) == 0, "'%s': Format wrote '%s'", theText, theFormatted);
+			TEST_CHECK(strcmp(theAsString, kExpected[theIndex].mString) == 0, "'%s': AsString wrote '%s'", theText, theAsString);
+			TEST_CHECK(strcmp(theName, kExpected[theIndex].mSimpleName) == 0, "'%s': GetSimpleName wrote '%s'", theText, theName);
+			TEST_CHECK(strcmp(theAbbreviatedName, kExpected[theIndex].mAbbreviatedSimpleName) == 0, "'%s': GetSimpleName abbreviated wrote '%s'", theText, theAbbreviatedName);
+			char theExpectedWithRate[128];
+			snprintf(theExpectedWithRate, sizeof(theExpectedWithRate), "%.0f %s", theDesc.mSampleRate, kExpected[theIndex].mSimpleName);
+			TEST_CHECK(strcmp(theNameWithRate, theExpectedWithRate) == 0, "'%s': GetSimpleName with the sample rate wrote '%s'", theText, theNameWithRate);
+			
+			//	a short buffer gets as much as fits, as snprintf would leave it
+			char theTruncated[16];
+			UInt32 theLength = CAStreamFormatText::Format(theDesc, theTruncated, sizeof(theTruncated));
+			TEST_CHECK((theLength == sizeof(theTruncated) - 1) && (strncmp(theTruncated, kExpected[theIndex].mString, theLength) == 0), "'%s': Format truncated to '%s'", theText, theTruncated);
+			CAStreamBasicDescription(theDesc).AsString(theTruncated, sizeof(theTruncated));
+			TEST_CHECK((strlen(theTruncated) == sizeof(theTruncated) - 1) && (strncmp(theTruncated, kExpected[theIndex].mString, sizeof(theTruncated) - 1) == 0), "'%s': AsString truncated to '%s'", theText, theTruncated);
+		}
+	}
+}
+
+static void	TestRegistry()
+{
+	CAStreamFormatRegistry& theRegistry = CAStreamFormatRegistry::Shared();
+	UInt32 theNumberFormats = theRegistry.GetNumberFormats();
+	UInt32 theNumberTexts = theRegistry.GetNumberTexts();
+	
+	//	everything in the corpus has been seen by now, so nothing new is added
+	for(const char* theText : kCorpus)
+	{
+		AudioStreamBasicDescription theDesc;
+		CAStreamBasicDescription::FromText(theText, theDesc);
+		const CAStreamFormatRegistry::Entry* theEntry = theRegistry.Intern(theDesc);
+		TEST_CHECK((theEntry != NULL) && (theEntry == theRegistry.Intern(theDesc)) && (memcmp(&theEntry->mDescription, &theDesc, sizeof(theDesc)) == 0), "'%s': interned differently twice", theText);
+	}
+	TEST_CHECK(theRegistry.GetNumberFormats() == theNumberFormats, "the registry grew from %u to %u formats it had already seen", (unsigned)theNumberFormats, (unsigned)theRegistry.GetNumberFormats());
+	TEST_CHECK(theRegistry.GetNumberTexts() == theNumberTexts, "the registry grew from %u to %u texts it had already seen", (unsigned)theNumberTexts, (unsigned)theRegistry.GetNumberTexts());
+	
+	//	a new format or text is added once; one that doesn't parse never is
+	AudioStreamBasicDescription theDesc = CAStreamBasicDescription(12345.0, kAudioFormatLinearPCM, 6, 1, 6, 3, 16, kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked);
+	char theBuffer[256];
+	CAStreamBasicDescription(theDesc).AsString(theBuffer, sizeof(theBuffer));
+	CAStreamBasicDescription(theDesc).AsString(theBuffer, sizeof(theBuffer));
+	TEST_CHECK(strcmp(theBuffer, " 3 ch,  12345 Hz, 'lpcm' (0x0000000C) 16-bit little-endian signed integer") == 0, "a new format was written as '%s'", theBuffer);
+	TEST_CHECK(theRegistry.GetNumberFormats() == theNumberFormats + 1, "a new format added %u entries", (unsigned)(theRegistry.GetNumberFormats() - theNumberFormats));
+	CAStreamBasicDescription::FromText("BEF32@12345,3", theDesc);
+	CAStreamBasicDescription::FromText("BEF32@12345,3", theDesc);
+	bool theResult = true;
+	FromTextDiagnostics("I16.", theResult);
+	TEST_CHECK(FromTextDiagnostics("I16.", theResult).size() > 0, "a text that doesn't parse only complained once");
+	TEST_CHECK(theRegistry.GetNumberTexts() == theNumberTexts + 1, "a new text and a bad one added %u entries", (unsigned)(theRegistry.GetNumberTexts() - theNumberTexts));
+}
+
+static void	Bench(UInt32 inIterations)
+{
+	const UInt32 kNumberTexts = sizeof(kCorpus) / sizeof(kCorpus[0]);
+	size_t theLengths[kNumberTexts];
+	AudioStreamBasicDescription theDescs[kNumberTexts];
+	for(UInt32 theText = 0; theText < kNumberTexts; ++theText)
+	{
+		theLengths[theText] = strlen(kCorpus[theText]);
+		CAStreamFormatText::Parse(kCorpus[theText], theLengths[theText], theDescs[theText]);
+	}
+	
+	volatile UInt32 theSink = 0;
+	double theParseSeconds = TestTime(inIterations, [&]()
+	{
+		for(UInt32 theText = 0; theText < kNumberTexts; ++theText)
+		{
+			AudioStreamBasicDescription theDesc;
+			theSink = theSink + CAStreamFormatText::Parse(kCorpus[theText], theLengths[theText], theDesc);
+		}
+	});
+	double theFormatSeconds = TestTime(inIterations, [&]()
+	{
+		for(UInt32 theText = 0; theText < kNumberTexts; ++theText)
+		{
+			char theBuffer[256];
+			theSink = theSink + CAStreamFormatText::Format(theDescs[theText], theBuffer, sizeof(theBuffer));
+		}
+	});
+	double theFromTextSeconds = TestTime(inIterations, [&]()
+	{
+		for(UInt32 theText = 0; theText < kNumberTexts; ++theText)
+		{
+			AudioStreamBasicDescription theDesc;
+			theSink = theSink + CAStreamBasicDescription::FromText(kCorpus[theText], theDesc);
+		}
+	});
+	double theAsStringSeconds = TestTime(inIterations, [&]()
+	{
+		for(UInt32 theText = 0; theText < kNumberTexts; ++theText)
+		{
+			char theBuffer[256];
+			theSink = theSink + CAStreamBasicDescription(theDescs[theText]).AsString(theBuffer, sizeof(theBuffer))[0];
+		}
+	});
+	double theCount = static_cast<double>(inIterations) * kNumberTexts;
+	printf("Parse     %7.1f ns per format string\n", theParseSeconds / theCount * 1.0e9);
+	printf("FromText  %7.1f ns per format string, through the registry\n", theFromTextSeconds / theCount * 1.0e9);
+	printf("Format    %7.1f ns per format\n", theFormatSeconds / theCount * 1.0e9);
+	printf("AsString  %7.1f ns per format, through the registry\n", theAsStringSeconds / theCount * 1.0e9);
+}
+
+int	main(int argc, const char* argv[])
+{
+	TestParse();
+	TestFromTextDiagnostics();
+	TestText();
+	TestRegistry();
+	Bench((argc > 1) ? static_cast<UInt32>(atoi(argv[1])) : 2000);
+	if(gTestFailures == 0)
+	{
+		printf("CAStreamFormatTextTest: all passed\n");
+	}
+	return (gTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+//	Stand-in for AUComponent.h, only the error codes PublicUtility uses.
+#pragma once
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+enum
+{
+	kAudioUnitErr_CannotDoInCurrentContext	= -10863,
+	kAudioUnitErr_Uninitialized				= -10867,
+	kAudioUnitErr_TooManyFramesToProcess	= -10874
+};
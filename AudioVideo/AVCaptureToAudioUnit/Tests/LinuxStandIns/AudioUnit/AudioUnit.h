@@ -0,0 +1,19 @@
+//	Stand-in for AudioUnit.h, only what CAAudioRenderDriver uses. Nothing in
+//	the tests renders a real audio unit, so AudioUnitRender just fails.
+#pragma once
+
+#include <AudioUnit/AUComponent.h>
+
+//	AudioUnit.h brings in AudioToolbox's AudioFormat.h, which is where this comes from
+enum
+{
+	kAudioFormatUnknownFormatError	= '!fmt'
+};
+
+typedef struct ComponentInstanceRecord*	AudioUnit;
+typedef UInt32							AudioUnitRenderActionFlags;
+
+inline OSStatus	AudioUnitRender(AudioUnit, AudioUnitRenderActionFlags*, const AudioTimeStamp*, UInt32, UInt32, AudioBufferList*)
+{
+	return kAudioUnitErr_Uninitialized;
+}
@@ -0,0 +1,152 @@
+//	Just enough of CoreAudioTypes.h to build the portable PublicUtility classes
+//	on a machine without the Apple SDKs. Values match the real header.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COREAUDIOTYPES_VERSION 20150414
+#define TARGET_OS_WIN32 0
+#define TARGET_OS_MAC 0
+#define TARGET_RT_BIG_ENDIAN 0
+#define TARGET_RT_LITTLE_ENDIAN 1
+#define MAC_OS_X_VERSION_10_3 1030
+#define MAC_OS_X_VERSION_MAX_ALLOWED 101500
+
+typedef uint8_t UInt8;
+typedef int8_t SInt8;
+typedef uint16_t UInt16;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef float Float32;
+typedef double Float64;
+typedef UInt8 Byte;
+typedef int32_t OSStatus;
+typedef UInt32 OSType;
+typedef SInt16 OSErr;
+typedef unsigned char Boolean;
+
+enum { noErr = 0 };
+
+typedef UInt32 AudioFormatID;
+typedef UInt32 AudioFormatFlags;
+
+typedef struct AudioStreamBasicDescription
+{
+	Float64				mSampleRate;
+	AudioFormatID		mFormatID;
+	AudioFormatFlags	mFormatFlags;
+	UInt32				mBytesPerPacket;
+	UInt32				mFramesPerPacket;
+	UInt32				mBytesPerFrame;
+	UInt32				mChannelsPerFrame;
+	UInt32				mBitsPerChannel;
+	UInt32				mReserved;
+} AudioStreamBasicDescription;
+
+typedef struct AudioBuffer
+{
+	UInt32	mNumberChannels;
+	UInt32	mDataByteSize;
+	void*	mData;
+} AudioBuffer;
+
+typedef struct AudioBufferList
+{
+	UInt32		mNumberBuffers;
+	AudioBuffer	mBuffers[1];
+} AudioBufferList;
+
+typedef struct AudioStreamPacketDescription
+{
+	SInt64	mStartOffset;
+	UInt32	mVariableFramesInPacket;
+	UInt32	mDataByteSize;
+} AudioStreamPacketDescription;
+
+typedef struct SMPTETime
+{
+	SInt16	mSubframes;
+	SInt16	mSubframeDivisor;
+	UInt32	mCounter;
+	UInt32	mType;
+	UInt32	mFlags;
+	SInt16	mHours;
+	SInt16	mMinutes;
+	SInt16	mSeconds;
+	SInt16	mFrames;
+} SMPTETime;
+
+typedef struct AudioTimeStamp
+{
+	Float64		mSampleTime;
+	UInt64		mHostTime;
+	Float64		mRateScalar;
+	UInt64		mWordClockTime;
+	SMPTETime	mSMPTETime;
+	UInt32		mFlags;
+	UInt32		mReserved;
+} AudioTimeStamp;
+
+enum
+{
+	kAudioTimeStampSampleTimeValid	= (1U << 0),
+	kAudioTimeStampHostTimeValid	= (1U << 1)
+};
+
+enum
+{
+	kAudioFormatLinearPCM						= 0x6C70636D,	//	'lpcm'
+	kAudioFormatAppleLossless					= 0x616C6163,	//	'alac'
+	kAudioFormatMPEG4AAC						= 0x61616320	//	'aac '
+};
+
+enum
+{
+	kAudioFormatFlagIsFloat						= (1U << 0),
+	kAudioFormatFlagIsBigEndian					= (1U << 1),
+	kAudioFormatFlagIsSignedInteger				= (1U << 2),
+	kAudioFormatFlagIsPacked					= (1U << 3),
+	kAudioFormatFlagIsAlignedHigh				= (1U << 4),
+	kAudioFormatFlagIsNonInterleaved			= (1U << 5),
+	kAudioFormatFlagIsNonMixable				= (1U << 6),
+	kAudioFormatFlagsAreAllClear				= 0x80000000,
+
+	kLinearPCMFormatFlagIsFloat					= kAudioFormatFlagIsFloat,
+	kLinearPCMFormatFlagIsBigEndian				= kAudioFormatFlagIsBigEndian,
+	kLinearPCMFormatFlagIsSignedInteger			= kAudioFormatFlagIsSignedInteger,
+	kLinearPCMFormatFlagIsPacked				= kAudioFormatFlagIsPacked,
+	kLinearPCMFormatFlagIsAlignedHigh			= kAudioFormatFlagIsAlignedHigh,
+	kLinearPCMFormatFlagIsNonInterleaved		= kAudioFormatFlagIsNonInterleaved,
+	kLinearPCMFormatFlagIsNonMixable			= kAudioFormatFlagIsNonMixable,
+	kLinearPCMFormatFlagsSampleFractionShift	= 7,
+	kLinearPCMFormatFlagsSampleFractionMask		= (0x3F << kLinearPCMFormatFlagsSampleFractionShift),
+	kLinearPCMFormatFlagsAreAllClear			= kAudioFormatFlagsAreAllClear,
+
+	kAppleLosslessFormatFlag_16BitSourceData	= 1,
+
+	kAudioFormatFlagsNativeEndian				= 0,
+	kAudioFormatFlagsCanonical					= kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked,
+	kAudioFormatFlagsNativeFloatPacked			= kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked,
+	kAudioFormatFlagsAudioUnitCanonical			= kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved
+};
+
+typedef Float32 AudioSampleType;
+typedef Float32 AudioUnitSampleType;
+typedef UInt32 AudioChannelLabel;
+
+enum
+{
+	kAudio_UnimplementedError	= -4,
+	kAudio_FileNotFoundError	= -43,
+	kAudio_ParamError			= -50,
+	kAudio_MemFullError			= -108
+};
+
+#if defined(__cplusplus)
+	#define SizeOf32(X) ((UInt32)sizeof(X))
+#endif
@@ -0,0 +1,9 @@
+//	Stand-in for CFByteOrder.h on a little endian host.
+#pragma once
+
+#include <stdint.h>
+
+static inline uint16_t CFSwapInt16(uint16_t inValue) { return __builtin_bswap16(inValue); }
+static inline uint32_t CFSwapInt32(uint32_t inValue) { return __builtin_bswap32(inValue); }
+static inline uint32_t CFSwapInt32HostToBig(uint32_t inValue) { return __builtin_bswap32(inValue); }
+static inline uint32_t CFSwapInt32BigToHost(uint32_t inValue) { return __builtin_bswap32(inValue); }
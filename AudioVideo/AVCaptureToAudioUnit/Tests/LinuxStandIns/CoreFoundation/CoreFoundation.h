@@ -0,0 +1,37 @@
+//	Stand-in for the parts of CoreFoundation.h PublicUtility touches. The
+//	property list types are opaque; the tests never save or restore formats.
+#pragma once
+
+#include <CoreAudio/CoreAudioTypes.h>
+#include <CoreFoundation/CFByteOrder.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef const void* CFTypeRef;
+typedef const void* CFStringRef;
+typedef const void* CFDictionaryRef;
+typedef const void* CFPropertyListRef;
+typedef const void* CFAllocatorRef;
+
+//	these live in AudioFormat.h on the real SDK
+enum
+{
+	kAudioFormatAC3			= 0x61632D33,	//	'ac-3'
+	kAudioFormat60958AC3	= 0x63616333	//	'cac3'
+};
+
+//	glibc only grew strlcpy in 2.38
+#if defined(__GLIBC__) && ((__GLIBC__ == 2) && (__GLIBC_MINOR__ < 38))
+static inline size_t strlcpy(char* outDestination, const char* inSource, size_t inSize)
+{
+	size_t theLength = strlen(inSource);
+	if(inSize > 0)
+	{
+		size_t theCopyLength = (theLength < inSize - 1) ? theLength : inSize - 1;
+		memcpy(outDestination, inSource, theCopyLength);
+		outDestination[theCopyLength] = 0;
+	}
+	return theLength;
+}
+#endif
@@ -0,0 +1,88 @@
+//	Small helpers shared by the PublicUtility tests and benchmarks. Each test is
+//	its own executable that prints what failed and returns non-zero, so ctest
+//	needs nothing more.
+#pragma once
+
+#include "CAAudioBufferList.h"
+#include "CAStreamBasicDescription.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define TEST_CHECK(inCondition, ...)								\
+	do																\
+	{																\
+		if(!(inCondition))											\
+		{															\
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);		\
+			fprintf(stderr, __VA_ARGS__);							\
+			fprintf(stderr, "\n");									\
+			++gTestFailures;										\
+		}															\
+	}																\
+	while(0)
+
+static int gTestFailures = 0;
+
+//	a linear PCM format built field by field, the way the tests want to enumerate them
+inline CAStreamBasicDescription	TestPCMFormat(UInt32 inChannels, UInt32 inValidBits, UInt32 inWordBytes, bool inIsFloat, bool inIsSigned, bool inIsBigEndian, bool inIsInterleaved, bool inIsAlignedHigh = false, UInt32 inFractionBits = 0)
+{
+	UInt32 theFlags = (inValidBits == inWordBytes * 8) ? static_cast<UInt32>(kAudioFormatFlagIsPacked) : 0;
+	if(inIsFloat) { theFlags |= kAudioFormatFlagIsFloat; }
+	if(inIsSigned) { theFlags |= kAudioFormatFlagIsSignedInteger; }
+	if(inIsBigEndian) { theFlags |= kAudioFormatFlagIsBigEndian; }
+	if(!inIsInterleaved) { theFlags |= kAudioFormatFlagIsNonInterleaved; }
+	if(inIsAlignedHigh) { theFlags |= kAudioFormatFlagIsAlignedHigh; }
+
+	CAStreamBasicDescription theFormat;
+	theFormat.mSampleRate = 44100.0;
+	theFormat.mFormatID = kAudioFormatLinearPCM;
+	theFormat.mFormatFlags = theFlags | (inFractionBits << kLinearPCMFormatFlagsSampleFractionShift);
+	theFormat.mFramesPerPacket = 1;
+	theFormat.mChannelsPerFrame = inChannels;
+	theFormat.mBitsPerChannel = inValidBits;
+	theFormat.mBytesPerFrame = theFormat.mBytesPerPacket = inIsInterleaved ? (inWordBytes * inChannels) : inWordBytes;
+	return theFormat;
+}
+
+//	an AudioBufferList that owns its memory
+class	TestBufferList
+{
+public:
+						TestBufferList(const CAStreamBasicDescription& inFormat, UInt32 inNumberFrames)
+						:	mBufferList(CAAudioBufferList::Create(inFormat.NumberChannelStreams())),
+							mData(inFormat.NumberChannelStreams())
+						{
+							for(UInt32 theBuffer = 0; theBuffer < mBufferList->mNumberBuffers; ++theBuffer)
+							{
+								mData[theBuffer].resize(inFormat.FramesToBytes(inNumberFrames));
+								mBufferList->mBuffers[theBuffer].mNumberChannels = inFormat.NumberInterleavedChannels();
+								mBufferList->mBuffers[theBuffer].mDataByteSize = static_cast<UInt32>(mData[theBuffer].size());
+								mBufferList->mBuffers[theBuffer].mData = mData[theBuffer].data();
+							}
+						}
+						~TestBufferList() { CAAudioBufferList::Destroy(mBufferList); }
+						TestBufferList(const TestBufferList&) = delete;
+	TestBufferList&		operator=(const TestBufferList&) = delete;
+
+	AudioBufferList&	Get() { return *mBufferList; }
+	template <typename T>
+	T*					Data(UInt32 inBuffer) { return reinterpret_cast<T*>(mData[inBuffer].data()); }
+
+private:
+	AudioBufferList*				mBufferList;
+	std::vector<std::vector<Byte>>	mData;
+};
+
+//	seconds taken by inIterations calls of inBlock
+template <typename F>
+double	TestTime(UInt32 inIterations, F inBlock)
+{
+	auto theStart = std::chrono::steady_clock::now();
+	for(UInt32 theIteration = 0; theIteration < inIterations; ++theIteration)
+	{
+		inBlock();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - theStart).count();
+}
@@ -52,12 +52,18 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 #import <AudioUnit/AudioUnit.h>
 #import <AudioToolbox/AudioToolbox.h>
 #import <AVFoundation/AVFoundation.h>
+#include <pthread.h>
 
 // CoreAudio Public Utility
 #include "CAStreamBasicDescription.h"
 #include "CAComponentDescription.h"
 #include "CAAudioBufferList.h"
 #include "AUOutputBL.h"
+#include "CAPCMConverter.h"
+#include "CAAudioBufferListFIFO.h"
+#include "CAAudioBufferListPool.h"
+#include "CAAudioRenderDriver.h"
+#include "CASilenceDetector.h"
 
 @interface CaptureSessionController : NSObject <AVCaptureAudioDataOutputSampleBufferDelegate> {
 @private
@@ -66,17 +72,26 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
     AVCaptureAudioDataOutput    *captureAudioDataOutput;
 	
     AUGraph                     auGraph;
-    AudioUnit					converterAudioUnit;
 	AudioUnit					delayAudioUnit;
     AudioChannelLayout          *currentRecordingChannelLayout;
     ExtAudioFileRef             extAudioFile;
 	
     AudioStreamBasicDescription currentInputASBD;
     AudioStreamBasicDescription graphOutputASBD;
+    CAAudioBufferListPool       *bufferListPool;
 	AudioBufferList				*currentInputAudioBufferList;
-    AUOutputBL                  *outputBufferList;
+    CAPCMConverter              *inputConverter;
+    AUOutputBL                  *convertedInputBufferList;
+    CAAudioRenderDriver         *renderDriver;
+    CASilenceDetector           *inputSilenceDetector;
+    
+    dispatch_queue_t            audioDataOutputQueue;
+    CAAudioBufferListFIFO       *recordingFIFO;
+    BOOL                        storeToRecordingFIFO;
+    pthread_t                   fileWriterThread;
+    dispatch_semaphore_t        fileWriterSemaphore;
+    volatile BOOL               fileWriterShouldExit;
     
-	double						currentSampleTime;
 	BOOL						didSetUpAudioUnits;
 }
 
@@ -51,12 +51,30 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 
 #import "CaptureSessionController.h"
 
-static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *inRefCon,
-													AudioUnitRenderActionFlags *ioActionFlags,
-													const AudioTimeStamp       *inTimeStamp,
-													UInt32						inBusNumber,
-													UInt32						inNumberFrames,
-													AudioBufferList            *ioData);
+static void *AudioFileWriterThreadEntry(void *inRefCon);
+
+// The processed audio is handed from the capture queue to a file writer thread through a FIFO holding this many seconds,
+// and the writer is woken up once at least kFileWriterBatchFrames frames are waiting so that it writes in large chunks
+static const Float64 kRecordingFIFOSeconds = 2.0;
+static const UInt32  kFileWriterBatchFrames = 8192;
+
+// All the AudioBufferLists used while capturing come from a pool set up front so that nothing is allocated per buffer,
+// each list can hold this many buffers and comes with enough scratch memory for this many frames of Float32 audio
+static const UInt32  kBufferListPoolSize = 4;
+static const UInt32  kBufferListPoolMaxBuffers = 8;
+static const UInt32  kBufferListPoolScratchFrames = 4096;
+
+// The buffer lists the audio is converted and rendered into reserve address space for this many frames up front, so that
+// a route change delivering bigger sample buffers never causes a reallocation (or an exception) in the capture callback
+static const UInt32  kMaxFramesPerSampleBuffer = 16384;
+
+// The delay is rendered in quanta of this many frames rather than once per sample buffer, nobody listens to the
+// processed audio as it is captured, only the recording does, so we take the fewer larger renders over the latency
+static const UInt32  kRenderQuantumFrames = CAAudioRenderDriver::kRenderQuantum_Throughput;
+
+// The input counts as active once its peak reaches this level, and as silent again once it drops the hysteresis below it
+static const Float32 kInputSilenceThresholdDB = -54.f;
+static const Float32 kInputSilenceHysteresisDB = 6.f;
 
 @implementation CaptureSessionController
 
@@ -128,28 +146,39 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 		return NO;
     }
     
-    // Create a serial dispatch queue and set it on the AVCaptureAudioDataOutput object
-    dispatch_queue_t audioDataOutputQueue = dispatch_queue_create("AudioDataOutputQueue", DISPATCH_QUEUE_SERIAL);
+    // Create the AudioBufferList pool used by the audio data output delegate method
+    bufferListPool = new CAAudioBufferListPool;
+    bufferListPool->Allocate(kBufferListPoolSize, kBufferListPoolMaxBuffers, kBufferListPoolScratchFrames * sizeof(Float32));
+    
+    // Create the render driver which collects the converted audio into render quanta and renders the delay with it,
+    // it is set up for the format once the first sample buffer arrives
+    renderDriver = new CAAudioRenderDriver;
+    
+    // Create the detector that tells us when the input goes quiet or comes back, it measures each converted sample buffer
+    inputSilenceDetector = new CASilenceDetector(kInputSilenceThresholdDB, kInputSilenceHysteresisDB);
+    
+    // Create a serial dispatch queue and set it on the AVCaptureAudioDataOutput object, we keep it so that starting and
+    // stopping a recording can synchronize with the delegate method
+    audioDataOutputQueue = dispatch_queue_create("AudioDataOutputQueue", DISPATCH_QUEUE_SERIAL);
     if (!audioDataOutputQueue){
         NSLog(@"dispatch_queue_create Failed!");
 		return NO;
     }
     
     [captureAudioDataOutput setSampleBufferDelegate:self queue:audioDataOutputQueue];
-    dispatch_release(audioDataOutputQueue);
 	
     // AVFoundation does not currently provide a way to set the output format of the AVCaptureAudioDataOutput object,
     // therefore unlike OS X where you could simply use the delay AU and have AVCaptureAudioDataOutput return samples
-    // in a format that the delay AU can ingest by using the audioSettings method, for iOS you need to use the Converter AU
-    // along with the delay AU in a Graph. Note that we don't start or stop the graph and we don't use an output unit
-    // all we are doing is chaining two AUs together then pulling on the delay when we call render, this delivers data in
-    // the current AVCaptureAudioDataOutput format to the converter which then converts the format for the delay which
+    // in a format that the delay AU can ingest by using the audioSettings method, for iOS the samples need to be converted
+    // before the delay AU sees them. The conversion is only a change of sample format (the sample rate and channel count
+    // already match), so rather than putting a Converter AU in front of the delay we convert each sample buffer with
+    // CAPCMConverter just before rendering. Note that we don't start or stop the graph and we don't use an output unit
+    // all we are doing is pulling on the delay when we call render, this delivers the converted data to the delay which
     // performs the processing we want delivering the data into our output buffer list for recording if we choose
     
-	// Create an AUGraph of the converter audio unit and the delay effect audio unit, the resulting effect is added to the audio when it is written to the file
+	// Create an AUGraph with the delay effect audio unit, the resulting effect is added to the audio when it is written to the file
 
     AUNode delayNode;
-    AUNode converterNode;
     
     // create a new AUGraph
 	OSStatus err = NewAUGraph(&auGraph);
@@ -158,39 +187,25 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
     // delay effect
     CAComponentDescription delay_EffectAudioUnitDescription(kAudioUnitType_Effect, kAudioUnitSubType_Delay, kAudioUnitManufacturer_Apple);
     
-    // converter
-    CAComponentDescription converter_desc(kAudioUnitType_FormatConverter, kAudioUnitSubType_AUConverter, kAudioUnitManufacturer_Apple);
-    
     // add nodes to graph
     err = AUGraphAddNode(auGraph, &delay_EffectAudioUnitDescription, &delayNode);
     if (err) { printf("AUGraphNewNode 2 result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
     
-    err = AUGraphAddNode(auGraph, &converter_desc, &converterNode);
-	if (err) { printf("AUGraphNewNode 3 result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
-    
-    // connect a node's output to a node's input
-    // au converter -> delay
-    
-    err = AUGraphConnectNodeInput(auGraph, converterNode, 0, delayNode, 0);
-	if (err) { printf("AUGraphConnectNodeInput result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
-	
     // open the graph -- AudioUnits are open but not initialized (no resource allocation occurs here)
 	err = AUGraphOpen(auGraph);
 	if (err) { printf("AUGraphOpen result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 	
     // grab audio unit instances from the nodes
-    err = AUGraphNodeInfo(auGraph, converterNode, NULL, &converterAudioUnit);
-    if (err) { printf("AUGraphNodeInfo result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
-
 	err = AUGraphNodeInfo(auGraph, delayNode, NULL, &delayAudioUnit);
     if (err) { printf("AUGraphNodeInfo result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 
-    // Set a callback on the converter audio unit that will supply the audio buffers received from the capture audio data output
+    // Set a callback on the delay audio unit that will supply the converted audio buffers received from the capture audio data output,
+    // the render driver hands the delay whatever it is rendering at the time
     AURenderCallbackStruct renderCallbackStruct;
-    renderCallbackStruct.inputProc = PushCurrentInputBufferIntoAudioUnit;
-    renderCallbackStruct.inputProcRefCon = self;
+    renderCallbackStruct.inputProc = CAAudioRenderDriver::InputCallback;
+    renderCallbackStruct.inputProcRefCon = renderDriver;
     
-    err = AUGraphSetNodeInputCallback(auGraph, converterNode, 0, &renderCallbackStruct);
+    err = AUGraphSetNodeInputCallback(auGraph, delayNode, 0, &renderCallbackStruct);
     if (err) { printf("AUGraphSetNodeInputCallback result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 	
     // add an observer for the interupted property, we simply log the result
@@ -246,6 +261,9 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 // teardown
 - (void)dealloc
 {
+    // the file writer thread doesn't retain us, so it has to be gone before anything it uses
+    if (self.isRecording) [self stopRecording];
+    
     [[NSNotificationCenter defaultCenter] removeObserver:self
                                                     name:UIApplicationWillResignActiveNotification
                                                   object:nil];
@@ -269,20 +287,28 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 	[captureAudioDeviceInput release];
     [captureAudioDataOutput setSampleBufferDelegate:nil queue:NULL];
 	[captureAudioDataOutput release];
+    if (audioDataOutputQueue) dispatch_release(audioDataOutputQueue);
 	
 	if (_outputFile) { CFRelease(_outputFile); _outputFile = NULL; }
 	
 	if (extAudioFile)
         ExtAudioFileDispose(extAudioFile);
     
+    if (fileWriterSemaphore) dispatch_release(fileWriterSemaphore);
+    
 	if (auGraph) {
 		if (didSetUpAudioUnits)
 			AUGraphUninitialize(auGraph);
 		DisposeAUGraph(auGraph);
 	}
     
-    if (currentInputAudioBufferList) free(currentInputAudioBufferList);
-    if (outputBufferList) delete outputBufferList;
+    if (currentInputAudioBufferList) bufferListPool->Release(currentInputAudioBufferList);
+    if (renderDriver) delete renderDriver;
+    if (inputSilenceDetector) delete inputSilenceDetector;
+    if (convertedInputBufferList) delete convertedInputBufferList;
+    if (bufferListPool) delete bufferListPool;
+    if (inputConverter) delete inputConverter;
+    if (recordingFIFO) delete recordingFIFO;
 	
 	[super dealloc];
 }
@@ -306,7 +332,8 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
     CAStreamBasicDescription sampleBufferASBD(*CMAudioFormatDescriptionGetStreamBasicDescription(formatDescription));
     if (kAudioFormatLinearPCM != sampleBufferASBD.mFormatID) { NSLog(@"Bad format or bogus ASBD!"); return; }
     
-    if ((sampleBufferASBD.mChannelsPerFrame != currentInputASBD.mChannelsPerFrame) || (sampleBufferASBD.mSampleRate != currentInputASBD.mSampleRate)) {
+    if ((sampleBufferASBD.mChannelsPerFrame != currentInputASBD.mChannelsPerFrame) || (sampleBufferASBD.mSampleRate != currentInputASBD.mSampleRate) ||
+        (sampleBufferASBD.mFormatFlags != currentInputASBD.mFormatFlags) || (sampleBufferASBD.mBitsPerChannel != currentInputASBD.mBitsPerChannel)) {
         NSLog(@"AVCaptureAudioDataOutput Audio Format:");
         sampleBufferASBD.Print();
         /* 
@@ -323,32 +350,43 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
             // The audio units were previously set up, so they must be uninitialized now
             err = AUGraphUninitialize(auGraph);
             NSLog(@"AUGraphUninitialize failed (%ld)", (long)err);
-			
-        if (outputBufferList) delete outputBufferList;
-            outputBufferList = NULL;
         } else {
             didSetUpAudioUnits = YES;
         }
         
-        // set the input stream format, this is the format of the audio for the converter input bus
-        err = AudioUnitSetProperty(converterAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &currentInputASBD, sizeof(currentInputASBD));
-		
-		if (noErr == err) {
-            CAStreamBasicDescription outputFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatFloat32, false);
-            NSLog(@"AUGraph Output Audio Format:");
-            outputFormat.Print();
-            
-            graphOutputASBD = outputFormat;
-            
-            // in an au graph, each nodes output stream format (including sample rate) needs to be set explicitly
-            // this stream format is propagated to its destination's input stream format
-    
-            // set the output stream format of the converter
-            err = AudioUnitSetProperty(converterAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
-            if (noErr == err)
-                // set the output stream format of the delay
-                err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
+        CAStreamBasicDescription outputFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatFloat32, false);
+        NSLog(@"AUGraph Output Audio Format:");
+        outputFormat.Print();
+        
+        graphOutputASBD = outputFormat;
+        
+        // reuse the buffer list we already have, changing it over to the new format
+        if (convertedInputBufferList) convertedInputBufferList->SetFormat(graphOutputASBD);
+        
+        // set up the render driver for the new format, it renders the delay in kRenderQuantumFrames at a time
+        renderDriver->Initialize(outputFormat, kRenderQuantumFrames, kMaxFramesPerSampleBuffer);
+        renderDriver->SetRenderTarget(delayAudioUnit);
+        UInt32 maximumFramesPerSlice = renderDriver->GetMaximumFramesPerRender();
+        
+        // a recording can't change format part way through and the recording FIFO holds the old one, so stop storing
+        // into it right away and have the recording stopped
+        if (storeToRecordingFIFO) {
+            storeToRecordingFIFO = NO;
+            NSLog(@"Input format changed while recording, stopping the recording");
+            dispatch_async(dispatch_get_main_queue(), ^{ [self stopRecording]; });
         }
+        
+        // the converter turns the sample buffer format into the Float32 format the delay wants on its input
+        if (NULL == inputConverter) inputConverter = new CAPCMConverter;
+        err = inputConverter->Initialize(sampleBufferASBD, outputFormat);
+        
+        // set the input and output stream formats of the delay, and let it render a whole quantum at a time
+        if (noErr == err)
+            err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &graphOutputASBD, sizeof(graphOutputASBD));
+        if (noErr == err)
+            err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
+        if (noErr == err)
+            err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maximumFramesPerSlice, sizeof(maximumFramesPerSlice));
 		
         // Initialize the graph
 		if (noErr == err)
@@ -365,32 +403,29 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
     }
 
     CMItemCount numberOfFrames = CMSampleBufferGetNumSamples(sampleBuffer); // corresponds to the number of CoreAudio audio frames
-		
-    // In order to render continuously, the effect audio unit needs a new time stamp for each buffer
-    // Use the number of frames for each unit of time continuously incrementing
-    currentSampleTime += (double)numberOfFrames;
-    
-    AudioTimeStamp timeStamp;
-    memset(&timeStamp, 0, sizeof(AudioTimeStamp));
-    timeStamp.mSampleTime = currentSampleTime;
-    timeStamp.mFlags |= kAudioTimeStampSampleTimeValid;		
     
-    AudioUnitRenderActionFlags flags = 0;
-    
-    // Create an output AudioBufferList as the destination for the AU rendered audio
-    if (NULL == outputBufferList) {
-        outputBufferList = new AUOutputBL(graphOutputASBD, numberOfFrames);
+    // Create an AudioBufferList to receive the sample buffer's audio converted to the graph format
+    if (NULL == convertedInputBufferList) {
+        convertedInputBufferList = new AUOutputBL(graphOutputASBD, *bufferListPool, numberOfFrames);
+        convertedInputBufferList->Reserve(kMaxFramesPerSampleBuffer);
+    }
+
+    // a reserved buffer list won't fall back to the heap for a sample buffer bigger than it was reserved for, drop it
+    if (convertedInputBufferList->IsReserved() && (numberOfFrames > convertedInputBufferList->AllocatedFrames())) {
+        NSLog(@"Dropping a sample buffer of %ld frames, more than the %u reserved for!", (long)numberOfFrames, (unsigned int)convertedInputBufferList->AllocatedFrames());
+        return;
     }
-    outputBufferList->Prepare(numberOfFrames);
+    convertedInputBufferList->Allocate(numberOfFrames);
+    convertedInputBufferList->Prepare(numberOfFrames);
     
     /*
      Get an audio buffer list from the sample buffer and assign it to the currentInputAudioBufferList instance variable.
-     The the audio unit render callback called PushCurrentInputBufferIntoAudioUnit can access this value by calling the
-     currentInputAudioBufferList method.
+     Once it has been converted it is pushed into the render driver, which renders the delay with it.
     */
     
     // CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer requires a properly allocated AudioBufferList struct
-    currentInputAudioBufferList = CAAudioBufferList::Create(currentInputASBD.mChannelsPerFrame);
+    currentInputAudioBufferList = bufferListPool->Acquire(currentInputASBD.mChannelsPerFrame);
+    if (NULL == currentInputAudioBufferList) { NSLog(@"Could not get an AudioBufferList for %u channels!", (unsigned int)currentInputASBD.mChannelsPerFrame); return; }
     
     size_t bufferListSizeNeededOut;
     CMBlockBufferRef blockBufferOut = nil;
@@ -405,41 +440,112 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
                                                                   &blockBufferOut);
     
     if (noErr == err) {
-        // Tell the effect audio unit to render -- This will synchronously call PushCurrentInputBufferIntoAudioUnit, which will
-        // feed currentInputAudioBufferList into the effect audio unit
-        err = AudioUnitRender(delayAudioUnit, &flags, &timeStamp, 0, numberOfFrames, outputBufferList->ABL());
+        err = inputConverter->Convert(*currentInputAudioBufferList, *convertedInputBufferList->ABL(), numberOfFrames);
         if (err) {
-            // kAudioUnitErr_TooManyFramesToProcess may happen on a route change if CMSampleBufferGetNumSamples
-            // returns more than 1024 (the default) number of samples. This is ok and on the next cycle this error should not repeat
-            NSLog(@"AudioUnitRender failed! (%ld)", err);
+            NSLog(@"CAPCMConverter Convert failed! (%ld)", (long)err);
         }
         
         CFRelease(blockBufferOut);
-        CAAudioBufferList::Destroy(currentInputAudioBufferList);
-        currentInputAudioBufferList = NULL;
     } else {
         NSLog(@"CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer failed! (%ld)", (long)err);
     }
+    
+    bufferListPool->Release(currentInputAudioBufferList);
+    currentInputAudioBufferList = NULL;
+    
+    if (noErr != err) return;
+    
+    // measure the converted input and log when it goes silent or comes back
+    inputSilenceDetector->Analyze(*convertedInputBufferList->ABL());
+    if (inputSilenceDetector->DidChangeState()) {
+        NSLog(@"Input is %@ (peak %.1f dBFS)", inputSilenceDetector->IsSilent() ? @"silent" : @"active", CASilenceDetector::AmplitudeToDB(inputSilenceDetector->GetMaximumPeak()));
+    }
+    
+    if (!renderDriver->Push(*convertedInputBufferList->ABL(), numberOfFrames)) {
+        NSLog(@"Could not push %ld frames into the render driver!", (long)numberOfFrames);
+        return;
+    }
+    
+    [self renderPushedAudio];
+}
 
-    if (noErr == err) {
-        @synchronized(self) {
-            if (extAudioFile) {
-                err = ExtAudioFileWriteAsync(extAudioFile, numberOfFrames, outputBufferList->ABL());
+/*
+ Renders the delay for every whole quantum the render driver now has, or after a Flush for what is left as well -- Each
+ render synchronously calls back into the render driver, which feeds the converted audio into the delay, and is stamped
+ with the sample time of the quantum's first frame. Only ever called on the capture queue.
+*/
+- (void)renderPushedAudio
+{
+    OSStatus err = noErr;
+    UInt32 renderedFrames = 0;
+    while ((noErr == (err = renderDriver->Render(renderedFrames))) && renderedFrames) {
+        if (storeToRecordingFIFO) {
+            // Hand the processed audio to the file writer thread, this never blocks -- if the writer has fallen so far
+            // behind that the FIFO is full the buffer is dropped and counted as an overrun, which the writer reports
+            recordingFIFO->Store(*renderDriver->GetOutputBufferList(), renderedFrames);
+            
+            if (recordingFIFO->GetReadableFrames() >= kFileWriterBatchFrames) {
+                dispatch_semaphore_signal(fileWriterSemaphore);
             }
-        }// @synchronized
-        if (err) {
-            NSLog(@"ExtAudioFileWriteAsync failed! (%ld)", (long)err);
         }
     }
+    
+    if (err) {
+        NSLog(@"AudioUnitRender failed! (%ld)", (long)err);
+    }
 }
 
+#pragma mark ======== Audio file writer methods =========
+
 /*
- Used by PushCurrentInputBufferIntoAudioUnit() to access the current audio buffer list
- that has been output by the AVCaptureAudioDataOutput.
+ Runs on the file writer thread for as long as we are recording. It sleeps until the capture queue tells it there is
+ a batch of audio waiting in the recording FIFO (or a short timeout passes) and then writes everything it finds to the file.
+ The lock only guards the file, the capture queue never takes it so a slow write can't hold up the capture.
 */
-- (AudioBufferList *)currentInputAudioBufferList
+- (void)runFileWriter
 {
-	return currentInputAudioBufferList;
+    UInt64 reportedOverruns = 0;
+    
+    while (!fileWriterShouldExit) {
+        dispatch_semaphore_wait(fileWriterSemaphore, dispatch_time(DISPATCH_TIME_NOW, 250 * NSEC_PER_MSEC));
+        
+        @synchronized(self) {
+            [self writeRecordingFIFOToFile:NO];
+            
+            if (recordingFIFO && (recordingFIFO->GetOverrunCount() != reportedOverruns)) {
+                reportedOverruns = recordingFIFO->GetOverrunCount();
+                NSLog(@"Recording FIFO overrun, %llu frames dropped so far", (unsigned long long)recordingFIFO->GetDroppedFrameCount());
+            }
+        } // @synchronized
+    }
+}
+
+/*
+ Writes the audio waiting in the recording FIFO to the file straight out of the FIFO's memory. Unless asked to write
+ everything, a partial batch is left for next time. Must be called while holding the lock, and only by the recording
+ FIFO's one consumer: the file writer thread, or stopRecording once that has exited.
+*/
+- (void)writeRecordingFIFOToFile:(BOOL)writeAll
+{
+    if (!recordingFIFO || !extAudioFile) return;
+    
+    AudioBufferList *fileBufferList = bufferListPool->Acquire(recordingFIFO->GetFormat().NumberChannelStreams());
+    if (!fileBufferList) return;
+    
+    while (writeAll || (recordingFIFO->GetReadableFrames() >= kFileWriterBatchFrames)) {
+        UInt32 numberOfFrames = recordingFIFO->BeginRead(*fileBufferList, recordingFIFO->GetCapacityFrames());
+        if (0 == numberOfFrames) break;
+        
+        OSStatus err = ExtAudioFileWrite(extAudioFile, numberOfFrames, fileBufferList);
+        recordingFIFO->EndRead(numberOfFrames);
+        if (err) {
+            NSLog(@"ExtAudioFileWrite failed! (%ld)", (long)err);
+            recordingFIFO->Discard();
+            break;
+        }
+    }
+    
+    bufferListPool->Release(fileBufferList);
 }
 
 #pragma mark ======== AVCapture Session & Recording =========
@@ -523,6 +629,37 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
         } // @synchronized
         
         if (noErr == err) {
+            // Between recordings nothing stores into or reads from the recording FIFO, so it can be sized for the current
+            // format and emptied here, that way nothing left over from a previous recording ends up in this one
+            CAStreamBasicDescription recordingClientFormat(graphOutputASBD);
+            if (NULL == recordingFIFO) recordingFIFO = new CAAudioBufferListFIFO;
+            if ((0 == recordingFIFO->GetCapacityFrames()) || !(recordingFIFO->GetFormat() == recordingClientFormat)) {
+                recordingFIFO->Allocate(recordingClientFormat, (UInt32)(recordingClientFormat.mSampleRate * kRecordingFIFOSeconds));
+            } else {
+                recordingFIFO->Discard();
+                recordingFIFO->ResetCounters();
+            }
+            
+            // start the thread that drains the recording FIFO into the file
+            if (!fileWriterSemaphore) fileWriterSemaphore = dispatch_semaphore_create(0);
+            fileWriterShouldExit = NO;
+            err = pthread_create(&fileWriterThread, NULL, AudioFileWriterThreadEntry, self);
+            if (err) {
+                @synchronized(self) {
+                    ExtAudioFileDispose(extAudioFile);
+                    extAudioFile = NULL;
+                } // @synchronized
+            }
+        }
+        
+        if (noErr == err) {
+            // and only then have the capture queue start storing into it, starting over with a render driver that holds
+            // nothing pushed before the recording began and stamps the first frame of the recording with sample time 0
+            dispatch_sync(audioDataOutputQueue, ^{
+                renderDriver->Reset();
+                storeToRecordingFIFO = YES;
+            });
+            
             self.recording = YES;
             NSLog(@"Recording Started");
         } else {
@@ -535,7 +672,27 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 {
     if (self.isRecording) {
         OSStatus err = kAudioFileNotOpenError;
+        
+        // Stop the capture queue storing into the recording FIFO, once this returns it is done with the FIFO -- The render
+        // driver still holds up to a quantum less a frame waiting for a full quantum, so render that as a short last one
+        // and store it first, otherwise the end of the recording is lost
+        dispatch_sync(audioDataOutputQueue, ^{
+            if (storeToRecordingFIFO) {
+                renderDriver->Flush();
+                [self renderPushedAudio];
+            }
+            storeToRecordingFIFO = NO;
+        });
+        self.recording = NO;
+        
+        // stop the file writer thread, then write whatever it left in the recording FIFO ourselves
+        fileWriterShouldExit = YES;
+        dispatch_semaphore_signal(fileWriterSemaphore);
+        pthread_join(fileWriterThread, NULL);
+        
         @synchronized(self) {
+            [self writeRecordingFIFOToFile:YES];
+            
             if (extAudioFile) {
                 // Close the file by disposing the ExtAudioFile
                 err = ExtAudioFileDispose(extAudioFile);
@@ -545,7 +702,6 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 
         AudioUnitReset(delayAudioUnit, kAudioUnitScope_Global, 0);
         
-        self.recording = NO;
         NSLog(@"Recording Stopped (%ld)", (long)err);
     }
 }
@@ -635,31 +791,17 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 
 @end
 
-#pragma mark ======== AudioUnit render callback =========
+#pragma mark ======== Audio file writer thread =========
 
 /*
- Synchronously called by the effect audio unit whenever AudioUnitRender() is called.
- Used to feed the audio samples output by the ATCaptureAudioDataOutput to the AudioUnit.
+ Entry point of the thread started by startRecording, which writes the processed audio to the file.
  */
-static OSStatus PushCurrentInputBufferIntoAudioUnit(void *							inRefCon,
-													AudioUnitRenderActionFlags *	ioActionFlags,
-													const AudioTimeStamp *			inTimeStamp,
-													UInt32							inBusNumber,
-													UInt32							inNumberFrames,
-													AudioBufferList *				ioData)
+static void *AudioFileWriterThreadEntry(void *inRefCon)
 {
-	CaptureSessionController *self = (CaptureSessionController *)inRefCon;
-	AudioBufferList *currentInputAudioBufferList = [self currentInputAudioBufferList];
-	UInt32 bufferIndex, bufferCount = currentInputAudioBufferList->mNumberBuffers;
-	
-	if (bufferCount != ioData->mNumberBuffers) return kAudioFormatUnknownFormatError;
-	
-	// Fill the provided AudioBufferList with the data from the AudioBufferList output by the audio data output
-	for (bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++) {
-		ioData->mBuffers[bufferIndex].mDataByteSize = currentInputAudioBufferList->mBuffers[bufferIndex].mDataByteSize;
-		ioData->mBuffers[bufferIndex].mData = currentInputAudioBufferList->mBuffers[bufferIndex].mData;
-		ioData->mBuffers[bufferIndex].mNumberChannels = currentInputAudioBufferList->mBuffers[bufferIndex].mNumberChannels;
+	@autoreleasepool {
+		CaptureSessionController *self = (CaptureSessionController *)inRefCon;
+		[self runFileWriter];
 	}
 	
-	return noErr;
-}
\ No newline at end of file
+	return NULL;
+}
@@ -50,6 +50,13 @@
 #else
 	#include <AUComponent.h>
 #endif
+#if !TARGET_OS_WIN32
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#if TARGET_OS_MAC
+		#include <mach/vm_statistics.h>
+	#endif
+#endif
 /*
 struct AudioBufferList
 {
@@ -70,19 +77,90 @@ AUOutputBL::AUOutputBL (const CAStreamBasicDescription &inDesc, UInt32 inDefault
 		  mBufferList (NULL),
 		  mNumberBuffers (0), // keep this here, so can ensure integrity of ABL
 		  mBufferSize (0),
-		  mFrames(inDefaultNumFrames)
+		  mFrames(inDefaultNumFrames),
+		  mMemorySize (0),
+		  mBufferListCapacity (0),
+		  mPool (NULL),
+		  mOwnsBufferMemory (false),
+		  mIsReserved (false),
+		  mCommittedBytes (0),
+		  mReservedFrames (0),
+		  mReservedHugePages (false)
 {
 	mNumberBuffers = mFormat.IsInterleaved() ? 1 : mFormat.NumberChannels();
 	mBufferList = reinterpret_cast<AudioBufferList*>(new Byte[offsetof(AudioBufferList, mBuffers) + (mNumberBuffers * sizeof(AudioBuffer))]);
+	mBufferListCapacity = mNumberBuffers;
+}
+
+AUOutputBL::AUOutputBL (const CAStreamBasicDescription &inDesc, CAAudioBufferListPool &inPool, UInt32 inDefaultNumFrames) 
+		: mFormat (inDesc),
+		  mBufferMemory(NULL),
+		  mBufferList (NULL),
+		  mNumberBuffers (0),
+		  mBufferSize (0),
+		  mFrames(inDefaultNumFrames),
+		  mMemorySize (0),
+		  mBufferListCapacity (0),
+		  mPool (&inPool),
+		  mOwnsBufferMemory (false),
+		  mIsReserved (false),
+		  mCommittedBytes (0),
+		  mReservedFrames (0),
+		  mReservedHugePages (false)
+{
+	mNumberBuffers = mFormat.IsInterleaved() ? 1 : mFormat.NumberChannels();
+	mBufferList = inPool.Acquire(mNumberBuffers);
+	if (mBufferList == NULL)
+		throw OSStatus(kAudio_MemFullError);
+	mBufferListCapacity = inPool.GetMaxNumberBuffers();
+	
+		// until someone asks for more, use the scratch memory that comes with the list
+	if (inPool.GetScratchBytesPerBuffer() > 0) {
+		mBufferMemory = inPool.GetScratch(mBufferList);
+		mMemorySize = inPool.GetScratchBytesPerBuffer() * mBufferListCapacity;
+		mBufferSize = inPool.GetScratchBytesPerBuffer();
+		mFrames = mFormat.BytesToFrames(mBufferSize);
+	}
 }
 
 AUOutputBL::~AUOutputBL()
 {
-	if (mBufferMemory)
-		delete[] mBufferMemory;
+	ReleaseMemory();
 
-	if (mBufferList)
-		delete [] (Byte *)mBufferList;
+	if (mBufferList) {
+		if (mPool)
+			mPool->Release(mBufferList);
+		else
+			delete [] (Byte *)mBufferList;
+	}
+}
+
+void	AUOutputBL::SetFormat (const CAStreamBasicDescription &inDesc)
+{
+	UInt32 numberBuffers = inDesc.IsInterleaved() ? 1 : inDesc.NumberChannels();
+	if (numberBuffers == 0 || numberBuffers > mBufferListCapacity)
+		throw OSStatus(kAudio_ParamError);
+	
+	mFormat = inDesc;
+	mNumberBuffers = numberBuffers;
+	
+		// reserve enough for the frames Reserve was asked for in the new format, if what we have won't hold them,
+		// so Allocate never has to go to the heap; if that fails, carve what we have like any other memory
+	if (mIsReserved && (mFormat.BytesToFrames ((mMemorySize / mNumberBuffers) & ~0xFU) < mReservedFrames))
+		Reserve (mReservedFrames, mReservedHugePages);
+	
+	if (mBufferMemory) {
+			// carve the memory we have into the new number of buffers, keeping them 16 byte aligned
+		UInt32 bufferSize = (mMemorySize / mNumberBuffers) & ~0xFU;
+		UInt32 frames = mFormat.BytesToFrames(bufferSize);
+		if (frames > 0) {
+			mBufferSize = bufferSize;
+			mFrames = frames;
+			mCommittedBytes = 0;
+		} else {
+			Allocate (0);
+		}
+	}
 }
 
 void 	AUOutputBL::Prepare (UInt32 inNumFrames, bool inWantNullBufferIfAllocated) 
@@ -124,8 +202,13 @@ void	AUOutputBL::Allocate (UInt32 inNumFrames)
 	{
 		UInt32 nBytes = mFormat.FramesToBytes (inNumFrames);
 		
-		if (nBytes <= AllocatedBytes()) 
+		if (nBytes <= mBufferSize) {
+			if (mIsReserved)
+				CommitMemory (nBytes);
 			return;
+		}
+		if (mIsReserved)
+			throw OSStatus(kAudioUnitErr_TooManyFramesToProcess);
 		
 			// align successive buffers for Altivec and to take alternating
 			// cache line hits by spacing them by odd multiples of 16
@@ -138,23 +221,104 @@ void	AUOutputBL::Allocate (UInt32 inNumFrames)
 		Byte *newMemory = new Byte[memorySize];
 		memset(newMemory, 0, memorySize);	// make buffer "hot"
 		
-		Byte *oldMemory = mBufferMemory;
+		ReleaseMemory();
 		mBufferMemory = newMemory;
-		delete[] oldMemory;
+		mOwnsBufferMemory = true;
+		mMemorySize = memorySize;
 		
 		mFrames = inNumFrames;
 	} 
 	else 
 	{
-		if (mBufferMemory) {
-			delete [] mBufferMemory;
-			mBufferMemory = NULL;
-		}
+		ReleaseMemory();
 		mBufferSize = 0;
 		mFrames = 0;
 	}
 }
 
+bool	AUOutputBL::Reserve (UInt32 inMaxNumberFrames, bool inUseHugePages)
+{
+#if TARGET_OS_WIN32
+	return false;
+#else
+	UInt32 nBytes = mFormat.FramesToBytes (inMaxNumberFrames);
+	if (nBytes == 0)
+		return false;
+	
+		// same spacing of successive buffers as Allocate
+	if (mNumberBuffers > 1)
+		nBytes = (nBytes + (0x10 - (nBytes & 0xF))) | 0x10;
+	
+	size_t pageSize = (size_t)getpagesize();
+	size_t memorySize = ((size_t)nBytes * mNumberBuffers + pageSize - 1) & ~(pageSize - 1);
+	void *memory = MAP_FAILED;
+	
+		// anonymous memory is only given pages when it is first touched, so mapping it reserves the range
+	if (inUseHugePages) {
+		const size_t kHugePageSize = 2 * 1024 * 1024;
+		size_t hugeMemorySize = (memorySize + kHugePageSize - 1) & ~(kHugePageSize - 1);
+	#if defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+		memory = mmap (NULL, hugeMemorySize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+	#elif defined(MAP_HUGETLB)
+		memory = mmap (NULL, hugeMemorySize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+	#endif
+		if (memory != MAP_FAILED)
+			memorySize = hugeMemorySize;
+	}
+	if (memory == MAP_FAILED)
+		memory = mmap (NULL, memorySize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if (memory == MAP_FAILED)
+		return false;
+	
+	ReleaseMemory();
+	mBufferMemory = static_cast<Byte*>(memory);
+	mMemorySize = (UInt32)memorySize;
+	mIsReserved = true;
+	mReservedFrames = inMaxNumberFrames;
+	mReservedHugePages = inUseHugePages;
+	mBufferSize = nBytes;
+	mFrames = inMaxNumberFrames;
+	return true;
+#endif
+}
+
+void	AUOutputBL::ReleaseMemory ()
+{
+	if (mBufferMemory) {
+#if !TARGET_OS_WIN32
+		if (mIsReserved)
+			munmap (mBufferMemory, mMemorySize);
+		else
+#endif
+		if (mOwnsBufferMemory)
+			delete [] mBufferMemory;
+		mBufferMemory = NULL;
+	}
+	mOwnsBufferMemory = false;
+	mIsReserved = false;
+	mMemorySize = 0;
+	mCommittedBytes = 0;
+	mReservedFrames = 0;
+}
+
+void	AUOutputBL::CommitMemory (UInt32 inNumberBytes)
+{
+#if !TARGET_OS_WIN32
+	if (inNumberBytes <= mCommittedBytes)
+		return;
+	
+		// writing to a page is what gets it committed, and these pages hold no audio anyone is still using
+	size_t pageSize = (size_t)getpagesize();
+	for (UInt32 i = 0; i < mNumberBuffers; ++i) {
+		volatile Byte *p = mBufferMemory + (i * mBufferSize);
+		for (size_t offset = mCommittedBytes & ~(pageSize - 1); offset < inNumberBytes; offset += pageSize)
+			p[offset] = 0;
+		p[inNumberBytes - 1] = 0;
+	}
+	mCommittedBytes = inNumberBytes;
+#endif
+}
+
 #if DEBUG
 void			AUOutputBL::Print()
 {
@@ -0,0 +1,391 @@
+/*
+     File: CAAudioBufferListCopyPlan.cpp 
+ Abstract:  CAAudioBufferListCopyPlan.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAAudioBufferListCopyPlan.h"
+#include "CAAudioBufferList.h"
+#include "CADebugMacros.h"
+#include "CAVectorOps.h"
+#include <string.h>
+
+//=============================================================================
+//	CAAudioBufferListCopyPlan
+//=============================================================================
+
+bool	CAAudioBufferListCopyPlan::Plan(const AudioBufferList& inSourceLayout, UInt32 inStartingSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inStartingDestinationChannel)
+{
+	Reset();
+	mSourceNumberBuffers = inSourceLayout.mNumberBuffers;
+	mDestinationNumberBuffers = inDestinationLayout.mNumberBuffers;
+	
+	UInt32 theNumberInputChannels = CAAudioBufferList::GetTotalNumberChannels(inSourceLayout);
+	UInt32 theNumberOutputChannels = CAAudioBufferList::GetTotalNumberChannels(inDestinationLayout);
+	
+	bool theAnswer = true;
+	UInt32 theInputChannel = inStartingSourceChannel;
+	UInt32 theOutputChannel = inStartingDestinationChannel;
+	while(theAnswer && (theInputChannel < theNumberInputChannels) && (theOutputChannel < theNumberOutputChannels))
+	{
+		theAnswer = AddChannel(inSourceLayout, static_cast<SInt32>(theInputChannel), inDestinationLayout, theOutputChannel);
+		++theInputChannel;
+		++theOutputChannel;
+	}
+	
+	if(theAnswer)
+	{
+		Coalesce();
+		
+		//	remember the layouts, when they are small enough to, so IsPlannedFor can tell whether they changed
+		mIsChannelForChannel = (mSourceNumberBuffers <= kMaxSteps) && (mDestinationNumberBuffers <= kMaxSteps);
+		mStartingSourceChannel = inStartingSourceChannel;
+		mStartingDestinationChannel = inStartingDestinationChannel;
+		for(UInt32 theBuffer = 0; mIsChannelForChannel && (theBuffer < mSourceNumberBuffers); ++theBuffer)
+		{
+			mSourceBufferChannels[theBuffer] = static_cast<UInt16>(inSourceLayout.mBuffers[theBuffer].mNumberChannels);
+			mIsChannelForChannel = (mSourceBufferChannels[theBuffer] == inSourceLayout.mBuffers[theBuffer].mNumberChannels);
+		}
+		for(UInt32 theBuffer = 0; mIsChannelForChannel && (theBuffer < mDestinationNumberBuffers); ++theBuffer)
+		{
+			mDestinationBufferChannels[theBuffer] = static_cast<UInt16>(inDestinationLayout.mBuffers[theBuffer].mNumberChannels);
+			mIsChannelForChannel = (mDestinationBufferChannels[theBuffer] == inDestinationLayout.mBuffers[theBuffer].mNumberChannels);
+		}
+	}
+	else
+	{
+		Reset();
+	}
+	return theAnswer;
+}
+
+bool	CAAudioBufferListCopyPlan::IsPlannedFor(const AudioBufferList& inSourceLayout, UInt32 inStartingSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inStartingDestinationChannel) const
+{
+	return mIsChannelForChannel && (inStartingSourceChannel == mStartingSourceChannel) && (inStartingDestinationChannel == mStartingDestinationChannel) &&
+			(inSourceLayout.mNumberBuffers == mSourceNumberBuffers) && (inDestinationLayout.mNumberBuffers == mDestinationNumberBuffers) &&
+			SameLayout(inSourceLayout, mSourceBufferChannels) && SameLayout(inDestinationLayout, mDestinationBufferChannels);
+}
+
+bool	CAAudioBufferListCopyPlan::SameLayout(const AudioBufferList& inLayout, const UInt16 inBufferChannels[])
+{
+	for(UInt32 theBuffer = 0; theBuffer < inLayout.mNumberBuffers; ++theBuffer)
+	{
+		if(inLayout.mBuffers[theBuffer].mNumberChannels != inBufferChannels[theBuffer])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool	CAAudioBufferListCopyPlan::Plan(const AudioBufferList& inSourceLayout, const AudioBufferList& inDestinationLayout, const SInt32 inChannelMap[], UInt32 inChannelMapSize)
+{
+	Reset();
+	mSourceNumberBuffers = inSourceLayout.mNumberBuffers;
+	mDestinationNumberBuffers = inDestinationLayout.mNumberBuffers;
+	
+	UInt32 theNumberOutputChannels = CAAudioBufferList::GetTotalNumberChannels(inDestinationLayout);
+	if(inChannelMapSize < theNumberOutputChannels)
+	{
+		theNumberOutputChannels = inChannelMapSize;
+	}
+	
+	bool theAnswer = true;
+	for(UInt32 theOutputChannel = 0; theAnswer && (theOutputChannel < theNumberOutputChannels); ++theOutputChannel)
+	{
+		theAnswer = AddChannel(inSourceLayout, inChannelMap[theOutputChannel], inDestinationLayout, theOutputChannel);
+	}
+	
+	if(theAnswer)
+	{
+		Coalesce();
+	}
+	else
+	{
+		Reset();
+	}
+	return theAnswer;
+}
+
+bool	CAAudioBufferListCopyPlan::AddChannel(const AudioBufferList& inSourceLayout, SInt32 inSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inDestinationChannel)
+{
+	if(mNumberSteps >= kMaxSteps)
+	{
+		return false;
+	}
+	
+	Step& theStep = mSteps[mNumberSteps];
+	theStep.mNumberChannels = 1;
+	if(!CAAudioBufferList::GetBufferForChannel(inDestinationLayout, inDestinationChannel, theStep.mDestinationBuffer, theStep.mDestinationChannel))
+	{
+		return false;
+	}
+	theStep.mDestinationBufferChannels = inDestinationLayout.mBuffers[theStep.mDestinationBuffer].mNumberChannels;
+	
+	if((inSourceChannel >= 0) && CAAudioBufferList::GetBufferForChannel(inSourceLayout, static_cast<UInt32>(inSourceChannel), theStep.mSourceBuffer, theStep.mSourceChannel))
+	{
+		theStep.mKind = kStep_Strided;
+		theStep.mSourceBufferChannels = inSourceLayout.mBuffers[theStep.mSourceBuffer].mNumberChannels;
+	}
+	else
+	{
+		//	unmapped or out of range source channels are silent
+		theStep.mKind = kStep_Silence;
+		theStep.mSourceBuffer = 0;
+		theStep.mSourceChannel = 0;
+		theStep.mSourceBufferChannels = 0;
+	}
+	
+	++mNumberSteps;
+	return true;
+}
+
+void	CAAudioBufferListCopyPlan::Coalesce()
+{
+	//	merge runs of single channel steps into the widest operation that covers them
+	UInt32 theNumberMergedSteps = 0;
+	UInt32 theIndex = 0;
+	while(theIndex < mNumberSteps)
+	{
+		Step theStep = mSteps[theIndex];
+		UInt32 theRunLength = 1;
+		
+		if(theStep.mKind == kStep_Strided)
+		{
+			//	whole buffer to whole buffer with the channels in order
+			if((theStep.mSourceChannel == 0) && (theStep.mDestinationChannel == 0) && (theStep.mSourceBufferChannels == theStep.mDestinationBufferChannels))
+			{
+				while((theRunLength < theStep.mSourceBufferChannels) && (theIndex + theRunLength < mNumberSteps))
+				{
+					const Step& theNext = mSteps[theIndex + theRunLength];
+					if((theNext.mKind != kStep_Strided) || (theNext.mSourceBuffer != theStep.mSourceBuffer) || (theNext.mDestinationBuffer != theStep.mDestinationBuffer) || (theNext.mSourceChannel != theRunLength) || (theNext.mDestinationChannel != theRunLength))
+					{
+						break;
+					}
+					++theRunLength;
+				}
+				if(theRunLength == theStep.mSourceBufferChannels)
+				{
+					theStep.mKind = kStep_Bulk;
+				}
+				else
+				{
+					theRunLength = 1;
+				}
+			}
+			
+			//	one interleaved source buffer fanned out to mono destination buffers
+			if((theStep.mKind == kStep_Strided) && (theStep.mSourceBufferChannels > 1) && (theStep.mDestinationBufferChannels == 1))
+			{
+				while(theIndex + theRunLength < mNumberSteps)
+				{
+					const Step& theNext = mSteps[theIndex + theRunLength];
+					if((theNext.mKind != kStep_Strided) || (theNext.mSourceBuffer != theStep.mSourceBuffer) || (theNext.mSourceChannel != theStep.mSourceChannel + theRunLength) || (theNext.mDestinationBufferChannels != 1) || (theNext.mDestinationBuffer != theStep.mDestinationBuffer + theRunLength))
+					{
+						break;
+					}
+					++theRunLength;
+				}
+				if(theRunLength > 1)
+				{
+					theStep.mKind = kStep_Deinterleave;
+				}
+			}
+			
+			//	mono source buffers gathered into one interleaved destination buffer
+			if((theStep.mKind == kStep_Strided) && (theStep.mSourceBufferChannels == 1) && (theStep.mDestinationBufferChannels > 1))
+			{
+				while(theIndex + theRunLength < mNumberSteps)
+				{
+					const Step& theNext = mSteps[theIndex + theRunLength];
+					if((theNext.mKind != kStep_Strided) || (theNext.mDestinationBuffer != theStep.mDestinationBuffer) || (theNext.mDestinationChannel != theStep.mDestinationChannel + theRunLength) || (theNext.mSourceBufferChannels != 1) || (theNext.mSourceBuffer != theStep.mSourceBuffer + theRunLength))
+					{
+						break;
+					}
+					++theRunLength;
+				}
+				if(theRunLength > 1)
+				{
+					theStep.mKind = kStep_Interleave;
+				}
+			}
+		}
+		
+		theStep.mNumberChannels = theRunLength;
+		mSteps[theNumberMergedSteps++] = theStep;
+		theIndex += theRunLength;
+	}
+	mNumberSteps = theNumberMergedSteps;
+}
+
+bool	CAAudioBufferListCopyPlan::ValidateLayouts(const AudioBufferList& inSource, const AudioBufferList& inDestination) const
+{
+	if((inSource.mNumberBuffers != mSourceNumberBuffers) || (inDestination.mNumberBuffers != mDestinationNumberBuffers))
+	{
+		return false;
+	}
+	for(UInt32 theStepIndex = 0; theStepIndex < mNumberSteps; ++theStepIndex)
+	{
+		const Step& theStep = mSteps[theStepIndex];
+		UInt32 theNumberDestinationBuffers = (theStep.mKind == kStep_Deinterleave) ? theStep.mNumberChannels : 1;
+		for(UInt32 theBuffer = 0; theBuffer < theNumberDestinationBuffers; ++theBuffer)
+		{
+			if(inDestination.mBuffers[theStep.mDestinationBuffer + theBuffer].mNumberChannels != theStep.mDestinationBufferChannels)
+			{
+				return false;
+			}
+		}
+		UInt32 theNumberSourceBuffers = (theStep.mKind == kStep_Interleave) ? theStep.mNumberChannels : ((theStep.mKind == kStep_Silence) ? 0 : 1);
+		for(UInt32 theBuffer = 0; theBuffer < theNumberSourceBuffers; ++theBuffer)
+		{
+			if(inSource.mBuffers[theStep.mSourceBuffer + theBuffer].mNumberChannels != theStep.mSourceBufferChannels)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool	CAAudioBufferListCopyPlan::Execute(const AudioBufferList& inSource, AudioBufferList& outDestination) const
+{
+	//	assumes that both the source and destination sample formats are Float32
+	if(!ValidateLayouts(inSource, outDestination))
+	{
+		return false;
+	}
+	
+	const Float32* theSources[kMaxSteps];
+	Float32* theDestinations[kMaxSteps];
+	for(UInt32 theStepIndex = 0; theStepIndex < mNumberSteps; ++theStepIndex)
+	{
+		const Step& theStep = mSteps[theStepIndex];
+		const AudioBuffer& theSourceBuffer = inSource.mBuffers[theStep.mSourceBuffer];
+		AudioBuffer& theDestinationBuffer = outDestination.mBuffers[theStep.mDestinationBuffer];
+		
+		//	like CopyChannel, the destination decides how many frames get copied, but never read past the source
+		UInt32 theNumberFrames = theDestinationBuffer.mDataByteSize / (theStep.mDestinationBufferChannels * SizeOf32(Float32));
+		if(theStep.mKind != kStep_Silence)
+		{
+			UInt32 theNumberSourceFrames = theSourceBuffer.mDataByteSize / (theStep.mSourceBufferChannels * SizeOf32(Float32));
+			if(theNumberSourceFrames < theNumberFrames)
+			{
+				theNumberFrames = theNumberSourceFrames;
+			}
+		}
+		
+		switch(theStep.mKind)
+		{
+			case kStep_Bulk:
+				if((theSourceBuffer.mData != NULL) && (theDestinationBuffer.mData != NULL))
+				{
+					memcpy(theDestinationBuffer.mData, theSourceBuffer.mData, theNumberFrames * theStep.mNumberChannels * SizeOf32(Float32));
+				}
+				break;
+			
+			case kStep_Interleave:
+				for(UInt32 theChannel = 0; theChannel < theStep.mNumberChannels; ++theChannel)
+				{
+					const AudioBuffer& theMonoBuffer = inSource.mBuffers[theStep.mSourceBuffer + theChannel];
+					theSources[theChannel] = static_cast<const Float32*>(theMonoBuffer.mData);
+					UInt32 theNumberSourceFrames = theMonoBuffer.mDataByteSize / SizeOf32(Float32);
+					if((theSources[theChannel] == NULL) || (theNumberSourceFrames < theNumberFrames))
+					{
+						theNumberFrames = (theSources[theChannel] == NULL) ? 0 : theNumberSourceFrames;
+					}
+				}
+				if(theDestinationBuffer.mData != NULL)
+				{
+					CAVectorOps::Interleave(theSources, theStep.mNumberChannels, static_cast<Float32*>(theDestinationBuffer.mData) + theStep.mDestinationChannel, theStep.mDestinationBufferChannels, theNumberFrames);
+				}
+				break;
+			
+			case kStep_Deinterleave:
+				for(UInt32 theChannel = 0; theChannel < theStep.mNumberChannels; ++theChannel)
+				{
+					AudioBuffer& theMonoBuffer = outDestination.mBuffers[theStep.mDestinationBuffer + theChannel];
+					theDestinations[theChannel] = static_cast<Float32*>(theMonoBuffer.mData);
+					UInt32 theNumberDestinationFrames = theMonoBuffer.mDataByteSize / SizeOf32(Float32);
+					if((theDestinations[theChannel] == NULL) || (theNumberDestinationFrames < theNumberFrames))
+					{
+						theNumberFrames = (theDestinations[theChannel] == NULL) ? 0 : theNumberDestinationFrames;
+					}
+				}
+				if(theSourceBuffer.mData != NULL)
+				{
+					CAVectorOps::Deinterleave(static_cast<const Float32*>(theSourceBuffer.mData) + theStep.mSourceChannel, theStep.mSourceBufferChannels, theStep.mNumberChannels, theDestinations, theNumberFrames);
+				}
+				break;
+			
+			case kStep_Strided:
+				if((theSourceBuffer.mData != NULL) && (theDestinationBuffer.mData != NULL))
+				{
+					CAVectorOps::CopyStrided(static_cast<const Float32*>(theSourceBuffer.mData) + theStep.mSourceChannel, theStep.mSourceBufferChannels, static_cast<Float32*>(theDestinationBuffer.mData) + theStep.mDestinationChannel, theStep.mDestinationBufferChannels, theNumberFrames);
+				}
+				break;
+			
+			case kStep_Silence:
+				if(theDestinationBuffer.mData != NULL)
+				{
+					if(theStep.mDestinationBufferChannels == 1)
+					{
+						memset(theDestinationBuffer.mData, 0, theNumberFrames * SizeOf32(Float32));
+					}
+					else
+					{
+						Float32* theDestination = static_cast<Float32*>(theDestinationBuffer.mData) + theStep.mDestinationChannel;
+						for(UInt32 theFrame = 0; theFrame < theNumberFrames; ++theFrame, theDestination += theStep.mDestinationBufferChannels)
+						{
+							*theDestination = 0.f;
+						}
+					}
+				}
+				break;
+		}
+	}
+	return true;
+}
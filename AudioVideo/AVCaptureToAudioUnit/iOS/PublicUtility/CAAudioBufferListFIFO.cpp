@@ -0,0 +1,271 @@
+/*
+     File: CAAudioBufferListFIFO.cpp 
+ Abstract:  CAAudioBufferListFIFO.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAAudioBufferListFIFO.h"
+#include <string.h>
+
+//=============================================================================
+//	CAAudioBufferListFIFO
+//=============================================================================
+
+CAAudioBufferListFIFO::CAAudioBufferListFIFO()
+	: mMemory(NULL),
+	  mNumberStreams(0),
+	  mBytesPerFrame(0),
+	  mStreamStride(0),
+	  mCapacityFrames(0),
+	  mCapacityMask(0),
+	  mWriteFrame(0),
+	  mReadFrame(0),
+	  mOverrunCount(0),
+	  mDroppedFrameCount(0),
+	  mUnderrunCount(0)
+{
+}
+
+CAAudioBufferListFIFO::~CAAudioBufferListFIFO()
+{
+	Deallocate();
+}
+
+void	CAAudioBufferListFIFO::Allocate(const CAStreamBasicDescription& inFormat, UInt32 inCapacityFrames)
+{
+	Deallocate();
+	
+	UInt32 theCapacityFrames = 1;
+	while(theCapacityFrames < inCapacityFrames)
+	{
+		theCapacityFrames <<= 1;
+	}
+	
+	mFormat = inFormat;
+	mNumberStreams = inFormat.NumberChannelStreams();
+	mBytesPerFrame = inFormat.FramesToBytes(1);
+	mCapacityFrames = theCapacityFrames;
+	mCapacityMask = theCapacityFrames - 1;
+	
+	//	keep each stream's ring on its own cache lines
+	mStreamStride = (inFormat.FramesToBytes(theCapacityFrames) + 63) & ~63U;
+	mMemory = new Byte[mStreamStride * mNumberStreams];
+	memset(mMemory, 0, mStreamStride * mNumberStreams);	// make the pages "hot"
+	
+	mWriteFrame.store(0, std::memory_order_relaxed);
+	mReadFrame.store(0, std::memory_order_relaxed);
+	ResetCounters();
+}
+
+void	CAAudioBufferListFIFO::Deallocate()
+{
+	delete[] mMemory;
+	mMemory = NULL;
+	mNumberStreams = 0;
+	mCapacityFrames = 0;
+	mCapacityMask = 0;
+	mWriteFrame.store(0, std::memory_order_relaxed);
+	mReadFrame.store(0, std::memory_order_relaxed);
+}
+
+UInt32	CAAudioBufferListFIFO::GetWritableFrames() const
+{
+	UInt64 theWriteFrame = mWriteFrame.load(std::memory_order_relaxed);
+	UInt64 theReadFrame = mReadFrame.load(std::memory_order_acquire);
+	return mCapacityFrames - static_cast<UInt32>(theWriteFrame - theReadFrame);
+}
+
+UInt32	CAAudioBufferListFIFO::GetReadableFrames() const
+{
+	UInt64 theWriteFrame = mWriteFrame.load(std::memory_order_acquire);
+	UInt64 theReadFrame = mReadFrame.load(std::memory_order_relaxed);
+	return static_cast<UInt32>(theWriteFrame - theReadFrame);
+}
+
+bool	CAAudioBufferListFIFO::Store(const AudioBufferList& inBufferList, UInt32 inNumberFrames)
+{
+	if((mMemory == NULL) || (inBufferList.mNumberBuffers != mNumberStreams) || (inNumberFrames > GetBufferListFrames(inBufferList)) || (inNumberFrames > GetWritableFrames()))
+	{
+		mOverrunCount.fetch_add(1, std::memory_order_relaxed);
+		mDroppedFrameCount.fetch_add(inNumberFrames, std::memory_order_relaxed);
+		return false;
+	}
+	
+	UInt64 theWriteFrame = mWriteFrame.load(std::memory_order_relaxed);
+	UInt32 theOffsetFrame = static_cast<UInt32>(theWriteFrame) & mCapacityMask;
+	UInt32 theFirstFrames = mCapacityFrames - theOffsetFrame;
+	if(theFirstFrames > inNumberFrames)
+	{
+		theFirstFrames = inNumberFrames;
+	}
+	
+	for(UInt32 theStream = 0; theStream < mNumberStreams; ++theStream)
+	{
+		Byte* theRing = mMemory + (theStream * mStreamStride);
+		const Byte* theSource = static_cast<const Byte*>(inBufferList.mBuffers[theStream].mData);
+		if(theSource != NULL)
+		{
+			memcpy(theRing + (theOffsetFrame * mBytesPerFrame), theSource, theFirstFrames * mBytesPerFrame);
+			memcpy(theRing, theSource + (theFirstFrames * mBytesPerFrame), (inNumberFrames - theFirstFrames) * mBytesPerFrame);
+		}
+		else
+		{
+			memset(theRing + (theOffsetFrame * mBytesPerFrame), 0, theFirstFrames * mBytesPerFrame);
+			memset(theRing, 0, (inNumberFrames - theFirstFrames) * mBytesPerFrame);
+		}
+	}
+	
+	//	publish the frames only once they have been written
+	mWriteFrame.store(theWriteFrame + inNumberFrames, std::memory_order_release);
+	return true;
+}
+
+UInt32	CAAudioBufferListFIFO::BeginRead(AudioBufferList& outBufferList, UInt32 inMaxFrames) const
+{
+	if((mMemory == NULL) || (outBufferList.mNumberBuffers < mNumberStreams))
+	{
+		return 0;
+	}
+	
+	UInt32 theNumberFrames = GetReadableFrames();
+	UInt32 theOffsetFrame = static_cast<UInt32>(mReadFrame.load(std::memory_order_relaxed)) & mCapacityMask;
+	if(theNumberFrames > (mCapacityFrames - theOffsetFrame))
+	{
+		theNumberFrames = mCapacityFrames - theOffsetFrame;
+	}
+	if(theNumberFrames > inMaxFrames)
+	{
+		theNumberFrames = inMaxFrames;
+	}
+	
+	outBufferList.mNumberBuffers = mNumberStreams;
+	for(UInt32 theStream = 0; theStream < mNumberStreams; ++theStream)
+	{
+		outBufferList.mBuffers[theStream].mNumberChannels = mFormat.NumberInterleavedChannels();
+		outBufferList.mBuffers[theStream].mDataByteSize = theNumberFrames * mBytesPerFrame;
+		outBufferList.mBuffers[theStream].mData = mMemory + (theStream * mStreamStride) + (theOffsetFrame * mBytesPerFrame);
+	}
+	return theNumberFrames;
+}
+
+void	CAAudioBufferListFIFO::EndRead(UInt32 inNumberFrames)
+{
+	//	hand the space back to the producer only once we are done with it
+	mReadFrame.store(mReadFrame.load(std::memory_order_relaxed) + inNumberFrames, std::memory_order_release);
+}
+
+UInt32	CAAudioBufferListFIFO::Fetch(AudioBufferList& ioBufferList, UInt32 inMaxFrames)
+{
+	if((mMemory == NULL) || (ioBufferList.mNumberBuffers != mNumberStreams))
+	{
+		return 0;
+	}
+	
+	UInt32 theRoomFrames = GetBufferListFrames(ioBufferList);
+	if(inMaxFrames > theRoomFrames)
+	{
+		inMaxFrames = theRoomFrames;
+	}
+	
+	UInt32 theNumberFrames = GetReadableFrames();
+	if(theNumberFrames < inMaxFrames)
+	{
+		mUnderrunCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		theNumberFrames = inMaxFrames;
+	}
+	
+	UInt32 theOffsetFrame = static_cast<UInt32>(mReadFrame.load(std::memory_order_relaxed)) & mCapacityMask;
+	UInt32 theFirstFrames = mCapacityFrames - theOffsetFrame;
+	if(theFirstFrames > theNumberFrames)
+	{
+		theFirstFrames = theNumberFrames;
+	}
+	
+	for(UInt32 theStream = 0; theStream < mNumberStreams; ++theStream)
+	{
+		const Byte* theRing = mMemory + (theStream * mStreamStride);
+		Byte* theDestination = static_cast<Byte*>(ioBufferList.mBuffers[theStream].mData);
+		if(theDestination != NULL)
+		{
+			memcpy(theDestination, theRing + (theOffsetFrame * mBytesPerFrame), theFirstFrames * mBytesPerFrame);
+			memcpy(theDestination + (theFirstFrames * mBytesPerFrame), theRing, (theNumberFrames - theFirstFrames) * mBytesPerFrame);
+		}
+		ioBufferList.mBuffers[theStream].mDataByteSize = theNumberFrames * mBytesPerFrame;
+	}
+	
+	EndRead(theNumberFrames);
+	return theNumberFrames;
+}
+
+UInt32	CAAudioBufferListFIFO::GetBufferListFrames(const AudioBufferList& inBufferList) const
+{
+	//	the frames the smallest buffer holds; buffers with no data are skipped, as Store and Fetch do
+	UInt32 theNumberFrames = 0xFFFFFFFF;
+	for(UInt32 theStream = 0; theStream < inBufferList.mNumberBuffers; ++theStream)
+	{
+		if((inBufferList.mBuffers[theStream].mData != NULL) && (inBufferList.mBuffers[theStream].mDataByteSize / mBytesPerFrame < theNumberFrames))
+		{
+			theNumberFrames = inBufferList.mBuffers[theStream].mDataByteSize / mBytesPerFrame;
+		}
+	}
+	return theNumberFrames;
+}
+
+void	CAAudioBufferListFIFO::Discard()
+{
+	mReadFrame.store(mWriteFrame.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+void	CAAudioBufferListFIFO::ResetCounters()
+{
+	mOverrunCount.store(0, std::memory_order_relaxed);
+	mDroppedFrameCount.store(0, std::memory_order_relaxed);
+	mUnderrunCount.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,144 @@
+/*
+     File: CAAudioBufferListFIFO.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAAudioBufferListFIFO_h__)
+#define __CAAudioBufferListFIFO_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAStreamBasicDescription.h"
+#include <atomic>
+
+//=============================================================================
+//	CAAudioBufferListFIFO
+//
+//	A wait-free single producer, single consumer FIFO of PCM frames in a fixed
+//	format, for handing rendered audio from a real-time thread to a thread that
+//	does something slow with it (like writing a file).
+//
+//	The storage is sized once by Allocate, using the format's FramesToBytes, and
+//	is laid out like the format: one ring per channel stream. Store copies a
+//	buffer list in; the consumer either copies out with Fetch or, to avoid the
+//	copy, asks BeginRead for buffers that point straight into the ring and
+//	then releases them with EndRead.
+//
+//	Exactly one thread may call the producer methods and exactly one thread the
+//	consumer methods. Allocate and Deallocate must not overlap with either.
+//=============================================================================
+
+class	CAAudioBufferListFIFO
+{
+
+//	Construction/Destruction
+public:
+						CAAudioBufferListFIFO();
+						~CAAudioBufferListFIFO();
+
+	//	the capacity is rounded up to a power of two frames
+	void				Allocate(const CAStreamBasicDescription& inFormat, UInt32 inCapacityFrames);
+	void				Deallocate();
+
+	const CAStreamBasicDescription&	GetFormat() const { return mFormat; }
+	UInt32				GetCapacityFrames() const { return mCapacityFrames; }
+
+//	Producer
+public:
+	//	stores all inNumberFrames frames or none of them; a buffer that does not fit counts as an overrun, and so
+	//	does one that is not laid out like the format or whose buffers hold fewer than inNumberFrames frames
+	bool				Store(const AudioBufferList& inBufferList, UInt32 inNumberFrames);
+	UInt32				GetWritableFrames() const;
+
+//	Consumer
+public:
+	//	copies up to inMaxFrames frames into ioBufferList, which must be laid out like the format,
+	//	and no more than its buffer sizes say it has room for, then sets its buffer sizes to match.
+	//	Returns the number of frames copied. Asking for more frames than there are counts as an underrun.
+	UInt32				Fetch(AudioBufferList& ioBufferList, UInt32 inMaxFrames);
+
+	//	points the buffers of outBufferList (which must have a buffer per channel stream) at up to
+	//	inMaxFrames readable frames without copying. Reads stop at the end of the ring, so a second
+	//	BeginRead after EndRead may return more. The frames stay valid until EndRead.
+	UInt32				BeginRead(AudioBufferList& outBufferList, UInt32 inMaxFrames) const;
+	void				EndRead(UInt32 inNumberFrames);
+
+	//	throws away everything that has been stored so far
+	void				Discard();
+	UInt32				GetReadableFrames() const;
+
+//	Statistics
+public:
+	UInt64				GetOverrunCount() const { return mOverrunCount.load(std::memory_order_relaxed); }
+	UInt64				GetDroppedFrameCount() const { return mDroppedFrameCount.load(std::memory_order_relaxed); }
+	UInt64				GetUnderrunCount() const { return mUnderrunCount.load(std::memory_order_relaxed); }
+	void				ResetCounters();
+
+//	Implementation
+private:
+	UInt32				GetBufferListFrames(const AudioBufferList& inBufferList) const;
+
+	CAStreamBasicDescription	mFormat;
+	Byte*						mMemory;
+	UInt32						mNumberStreams;
+	UInt32						mBytesPerFrame;
+	UInt32						mStreamStride;		//	bytes between the start of each channel stream's ring
+	UInt32						mCapacityFrames;
+	UInt32						mCapacityMask;
+
+	//	frame counters that only ever go up; the producer owns mWriteFrame and the consumer mReadFrame
+	std::atomic<UInt64>			mWriteFrame;
+	std::atomic<UInt64>			mReadFrame;
+
+	std::atomic<UInt64>			mOverrunCount;
+	std::atomic<UInt64>			mDroppedFrameCount;
+	std::atomic<UInt64>			mUnderrunCount;
+
+	CAAudioBufferListFIFO(const CAAudioBufferListFIFO&);
+	CAAudioBufferListFIFO& operator=(const CAAudioBufferListFIFO&);
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+     File: CAAudioBufferListPool.cpp 
+ Abstract:  CAAudioBufferListPool.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAAudioBufferListPool.h"
+#include "CAAudioBufferList.h"
+#include <string.h>
+
+//=============================================================================
+//	CAAudioBufferListPool
+//=============================================================================
+
+static const UInt32	kNoSlot = 0xFFFFFFFF;
+
+CAAudioBufferListPool::CAAudioBufferListPool()
+	: mMemory(NULL),
+	  mNextFree(NULL),
+	  mNumberLists(0),
+	  mMaxNumberBuffers(0),
+	  mScratchBytesPerBuffer(0),
+	  mHeaderBytes(0),
+	  mSlotBytes(0),
+	  mFreeHead(kNoSlot)
+{
+}
+
+CAAudioBufferListPool::~CAAudioBufferListPool()
+{
+	Deallocate();
+}
+
+void	CAAudioBufferListPool::Allocate(UInt32 inNumberLists, UInt32 inMaxNumberBuffers, UInt32 inScratchBytesPerBuffer)
+{
+	Deallocate();
+	
+	if((inNumberLists == 0) || (inMaxNumberBuffers == 0))
+	{
+		return;
+	}
+	
+	//	keep every list and its scratch memory 16 byte aligned, and each slot on its own cache lines
+	mNumberLists = inNumberLists;
+	mMaxNumberBuffers = inMaxNumberBuffers;
+	mScratchBytesPerBuffer = (inScratchBytesPerBuffer + 15) & ~15U;
+	mHeaderBytes = (CAAudioBufferList::CalculateByteSize(inMaxNumberBuffers) + 15) & ~15U;
+	mSlotBytes = (mHeaderBytes + (mScratchBytesPerBuffer * inMaxNumberBuffers) + 63) & ~63U;
+	
+	mMemory = new Byte[mSlotBytes * inNumberLists];
+	memset(mMemory, 0, mSlotBytes * inNumberLists);	// make the pages "hot"
+	
+	mNextFree = new std::atomic<UInt32>[inNumberLists];
+	for(UInt32 theSlot = 0; theSlot < inNumberLists; ++theSlot)
+	{
+		mNextFree[theSlot].store((theSlot + 1 < inNumberLists) ? theSlot + 1 : kNoSlot, std::memory_order_relaxed);
+	}
+	mFreeHead.store(0, std::memory_order_release);
+}
+
+void	CAAudioBufferListPool::Deallocate()
+{
+	delete[] mMemory;
+	mMemory = NULL;
+	delete[] mNextFree;
+	mNextFree = NULL;
+	mNumberLists = 0;
+	mMaxNumberBuffers = 0;
+	mScratchBytesPerBuffer = 0;
+	mHeaderBytes = 0;
+	mSlotBytes = 0;
+	mFreeHead.store(kNoSlot, std::memory_order_relaxed);
+}
+
+AudioBufferList*	CAAudioBufferListPool::Acquire(UInt32 inNumberBuffers)
+{
+	if((mMemory == NULL) || (inNumberBuffers > mMaxNumberBuffers))
+	{
+		return NULL;
+	}
+	
+	//	pop a slot off the free list
+	UInt64 theHead = mFreeHead.load(std::memory_order_acquire);
+	UInt32 theSlot;
+	do
+	{
+		theSlot = static_cast<UInt32>(theHead);
+		if(theSlot == kNoSlot)
+		{
+			return NULL;
+		}
+		UInt64 theNewHead = ((theHead & 0xFFFFFFFF00000000ULL) + 0x100000000ULL) | mNextFree[theSlot].load(std::memory_order_relaxed);
+		if(mFreeHead.compare_exchange_weak(theHead, theNewHead, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			break;
+		}
+	}
+	while(true);
+	
+	Byte* theSlotMemory = mMemory + (theSlot * mSlotBytes);
+	AudioBufferList* theAnswer = reinterpret_cast<AudioBufferList*>(theSlotMemory);
+	Byte* theScratch = theSlotMemory + mHeaderBytes;
+	
+	theAnswer->mNumberBuffers = inNumberBuffers;
+	for(UInt32 theBuffer = 0; theBuffer < inNumberBuffers; ++theBuffer)
+	{
+		theAnswer->mBuffers[theBuffer].mNumberChannels = 1;
+		theAnswer->mBuffers[theBuffer].mDataByteSize = mScratchBytesPerBuffer;
+		theAnswer->mBuffers[theBuffer].mData = (mScratchBytesPerBuffer > 0) ? theScratch + (theBuffer * mScratchBytesPerBuffer) : NULL;
+	}
+	return theAnswer;
+}
+
+void	CAAudioBufferListPool::Release(AudioBufferList* inBufferList)
+{
+	if(!Owns(inBufferList))
+	{
+		return;
+	}
+	
+	//	push the slot back on the free list
+	UInt32 theSlot = GetSlotIndex(inBufferList);
+	UInt64 theHead = mFreeHead.load(std::memory_order_relaxed);
+	do
+	{
+		mNextFree[theSlot].store(static_cast<UInt32>(theHead), std::memory_order_relaxed);
+	}
+	while(!mFreeHead.compare_exchange_weak(theHead, (theHead & 0xFFFFFFFF00000000ULL) | theSlot, std::memory_order_release, std::memory_order_relaxed));
+}
+
+Byte*	CAAudioBufferListPool::GetScratch(const AudioBufferList* inBufferList) const
+{
+	return Owns(inBufferList) ? mMemory + (GetSlotIndex(inBufferList) * mSlotBytes) + mHeaderBytes : NULL;
+}
+
+bool	CAAudioBufferListPool::Owns(const AudioBufferList* inBufferList) const
+{
+	const Byte* thePointer = reinterpret_cast<const Byte*>(inBufferList);
+	return (mMemory != NULL) && (thePointer >= mMemory) && (thePointer < mMemory + (mNumberLists * mSlotBytes)) && (((thePointer - mMemory) % mSlotBytes) == 0);
+}
+
+UInt32	CAAudioBufferListPool::GetSlotIndex(const AudioBufferList* inBufferList) const
+{
+	return static_cast<UInt32>((reinterpret_cast<const Byte*>(inBufferList) - mMemory) / mSlotBytes);
+}
@@ -0,0 +1,127 @@
+/*
+     File: CAAudioBufferListPool.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAAudioBufferListPool_h__)
+#define __CAAudioBufferListPool_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+#include <atomic>
+
+//=============================================================================
+//	CAAudioBufferListPool
+//
+//	A fixed set of AudioBufferLists, all allocated up front by Allocate, that can
+//	be taken and given back without touching the heap. Every list has room for
+//	the same maximum number of buffers and comes with its own scratch memory, a
+//	block of GetScratchBytesPerBuffer() bytes for each of those buffers laid out
+//	one after the other.
+//
+//	Acquire and Release are lock-free and may be called from any thread,
+//	including real-time ones. Allocate and Deallocate are not, and must not be
+//	called while any list is out.
+//=============================================================================
+
+class	CAAudioBufferListPool
+{
+
+//	Construction/Destruction
+public:
+						CAAudioBufferListPool();
+						~CAAudioBufferListPool();
+
+	void				Allocate(UInt32 inNumberLists, UInt32 inMaxNumberBuffers, UInt32 inScratchBytesPerBuffer);
+	void				Deallocate();
+
+	bool				IsAllocated() const { return mMemory != NULL; }
+	UInt32				GetNumberLists() const { return mNumberLists; }
+	UInt32				GetMaxNumberBuffers() const { return mMaxNumberBuffers; }
+	UInt32				GetScratchBytesPerBuffer() const { return mScratchBytesPerBuffer; }
+
+//	Operations
+public:
+	//	returns NULL if the pool is empty or inNumberBuffers is more than it can hold. The list comes back
+	//	with each buffer pointing at its scratch memory, with mDataByteSize set to GetScratchBytesPerBuffer()
+	//	and mNumberChannels set to 1.
+	AudioBufferList*	Acquire(UInt32 inNumberBuffers);
+	void				Release(AudioBufferList* inBufferList);
+
+	//	the scratch memory bound to a list handed out by Acquire, which does not move when the list's
+	//	buffers are pointed somewhere else
+	Byte*				GetScratch(const AudioBufferList* inBufferList) const;
+	bool				Owns(const AudioBufferList* inBufferList) const;
+
+//	Implementation
+private:
+	UInt32				GetSlotIndex(const AudioBufferList* inBufferList) const;
+
+	Byte*						mMemory;
+	//	the free list, linked by slot index. A pop can read a slot's link just as another thread that popped the
+	//	same slot first pushes it back; the compare-and-swap throws that value away, but the read has to be atomic.
+	std::atomic<UInt32>*		mNextFree;
+	UInt32						mNumberLists;
+	UInt32						mMaxNumberBuffers;
+	UInt32						mScratchBytesPerBuffer;
+	UInt32						mHeaderBytes;		//	bytes at the start of each slot that hold the list itself
+	UInt32						mSlotBytes;
+
+	//	the slot index of the top of the free list in the low 32 bits and a count of pops in the high 32,
+	//	so that a slot released and reacquired between a load and a compare-and-swap can't be mistaken
+	std::atomic<UInt64>			mFreeHead;
+
+	CAAudioBufferListPool(const CAAudioBufferListPool&);
+	CAAudioBufferListPool& operator=(const CAAudioBufferListPool&);
+};
+
+#endif
@@ -0,0 +1,314 @@
+/*
+     File: CAAudioRenderDriver.cpp 
+ Abstract:  CAAudioRenderDriver.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAAudioRenderDriver.h"
+#include "CAAudioBufferList.h"
+#include "AUOutputBL.h"
+#include <string.h>
+
+//=============================================================================
+//	CAAudioRenderDriver
+//=============================================================================
+
+CAAudioRenderDriver::CAAudioRenderDriver()
+	: mFormat(),
+	  mRenderQuantum(kRenderQuantum_Immediate),
+	  mMaxInputFrames(0),
+	  mRenderProc(NULL),
+	  mRenderRefCon(NULL),
+	  mOutputBusNumber(0),
+	  mFIFO(),
+	  mFIFOView(NULL),
+	  mQuantumBuffer(NULL),
+	  mOutputBuffer(NULL),
+	  mIsFlushing(false),
+	  mPendingInput(NULL),
+	  mPendingFrames(0),
+	  mCurrentInput(NULL),
+	  mCurrentFrames(0),
+	  mNextSampleTime(0.0)
+{
+	memset(&mRenderTimeStamp, 0, sizeof(AudioTimeStamp));
+}
+
+CAAudioRenderDriver::~CAAudioRenderDriver()
+{
+	Deallocate();
+}
+
+void	CAAudioRenderDriver::Initialize(const CAStreamBasicDescription& inFormat, UInt32 inRenderQuantum, UInt32 inMaxInputFrames)
+{
+	Deallocate();
+	
+	mFormat = inFormat;
+	mRenderQuantum = inRenderQuantum;
+	mMaxInputFrames = inMaxInputFrames;
+	
+	if(mRenderQuantum != kRenderQuantum_Immediate)
+	{
+		//	Render takes out whole quanta after every push, so there are never more than a quantum less
+		//	a frame left over when a push comes in. When the quantum is a power of two it divides the
+		//	(power of two) capacity, and since reads are always a quantum at a time they never wrap.
+		mFIFO.Allocate(mFormat, mRenderQuantum + mMaxInputFrames);
+		mFIFOView = CAAudioBufferList::Create(mFormat.NumberChannelStreams());
+		mQuantumBuffer = new AUOutputBL(mFormat, mRenderQuantum);
+		mQuantumBuffer->Allocate(mRenderQuantum);
+	}
+	
+	mOutputBuffer = new AUOutputBL(mFormat, GetMaximumFramesPerRender());
+	mOutputBuffer->Allocate(GetMaximumFramesPerRender());
+}
+
+void	CAAudioRenderDriver::Deallocate()
+{
+	mFIFO.Deallocate();
+	if(mFIFOView != NULL)
+	{
+		CAAudioBufferList::Destroy(mFIFOView);
+		mFIFOView = NULL;
+	}
+	delete mQuantumBuffer;
+	mQuantumBuffer = NULL;
+	delete mOutputBuffer;
+	mOutputBuffer = NULL;
+	
+	mIsFlushing = false;
+	mPendingInput = NULL;
+	mPendingFrames = 0;
+}
+
+void	CAAudioRenderDriver::SetRenderTarget(AudioUnit inAudioUnit, UInt32 inOutputBusNumber)
+{
+	SetRenderProc(AudioUnitRenderProc, inAudioUnit, inOutputBusNumber);
+}
+
+void	CAAudioRenderDriver::SetRenderProc(RenderProc inRenderProc, void* inRefCon, UInt32 inOutputBusNumber)
+{
+	mRenderProc = inRenderProc;
+	mRenderRefCon = inRefCon;
+	mOutputBusNumber = inOutputBusNumber;
+}
+
+bool	CAAudioRenderDriver::Push(const AudioBufferList& inBufferList, UInt32 inNumberFrames)
+{
+	if((mOutputBuffer == NULL) || (inNumberFrames > mMaxInputFrames))
+	{
+		return false;
+	}
+	
+	if(mRenderQuantum == kRenderQuantum_Immediate)
+	{
+		if(mPendingInput != NULL)
+		{
+			return false;
+		}
+		mPendingInput = &inBufferList;
+		mPendingFrames = inNumberFrames;
+		return true;
+	}
+	
+	//	new frames after a flush are part of the next full quantum again
+	mIsFlushing = false;
+	return mFIFO.Store(inBufferList, inNumberFrames);
+}
+
+OSStatus	CAAudioRenderDriver::Render(UInt32& outNumberFrames)
+{
+	outNumberFrames = 0;
+	if(mOutputBuffer == NULL)
+	{
+		return noErr;
+	}
+	
+	if(mRenderQuantum == kRenderQuantum_Immediate)
+	{
+		if(mPendingInput == NULL)
+		{
+			return noErr;
+		}
+		const AudioBufferList* theInput = mPendingInput;
+		UInt32 theNumberFrames = mPendingFrames;
+		mPendingInput = NULL;
+		mPendingFrames = 0;
+		
+		OSStatus theError = RenderFrames(theInput, theNumberFrames);
+		if(theError == noErr)
+		{
+			outNumberFrames = theNumberFrames;
+		}
+		return theError;
+	}
+	
+	UInt32 theNumberFrames = mFIFO.GetReadableFrames();
+	if(theNumberFrames >= mRenderQuantum)
+	{
+		theNumberFrames = mRenderQuantum;
+	}
+	else if(!mIsFlushing || (theNumberFrames == 0))
+	{
+		mIsFlushing = false;
+		return noErr;
+	}
+	
+	//	render straight out of the ring if we can, otherwise from a copy
+	OSStatus theError;
+	if(mFIFO.BeginRead(*mFIFOView, theNumberFrames) == theNumberFrames)
+	{
+		theError = RenderFrames(mFIFOView, theNumberFrames);
+		mFIFO.EndRead(theNumberFrames);
+	}
+	else
+	{
+		mQuantumBuffer->Prepare(theNumberFrames);
+		mFIFO.Fetch(*mQuantumBuffer->ABL(), theNumberFrames);
+		theError = RenderFrames(mQuantumBuffer->ABL(), theNumberFrames);
+	}
+	
+	if(theError == noErr)
+	{
+		outNumberFrames = theNumberFrames;
+	}
+	return theError;
+}
+
+OSStatus	CAAudioRenderDriver::RenderFrames(const AudioBufferList* inInput, UInt32 inNumberFrames)
+{
+	if(mRenderProc == NULL)
+	{
+		return kAudioUnitErr_Uninitialized;
+	}
+	
+	memset(&mRenderTimeStamp, 0, sizeof(AudioTimeStamp));
+	mRenderTimeStamp.mSampleTime = mNextSampleTime;
+	mRenderTimeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+	
+	//	the frames are used up whether or not the render works, so time moves on regardless
+	mNextSampleTime += inNumberFrames;
+	
+	mOutputBuffer->Prepare(inNumberFrames);
+	
+	mCurrentInput = inInput;
+	mCurrentFrames = inNumberFrames;
+	AudioUnitRenderActionFlags theFlags = 0;
+	OSStatus theError = (*mRenderProc)(mRenderRefCon, &theFlags, &mRenderTimeStamp, mOutputBusNumber, inNumberFrames, mOutputBuffer->ABL());
+	mCurrentInput = NULL;
+	mCurrentFrames = 0;
+	
+	return theError;
+}
+
+AudioBufferList*	CAAudioRenderDriver::GetOutputBufferList()
+{
+	return (mOutputBuffer != NULL) ? mOutputBuffer->ABL() : NULL;
+}
+
+void	CAAudioRenderDriver::Flush()
+{
+	mIsFlushing = true;
+}
+
+void	CAAudioRenderDriver::Reset(Float64 inSampleTime)
+{
+	mFIFO.Discard();
+	mIsFlushing = false;
+	mPendingInput = NULL;
+	mPendingFrames = 0;
+	mNextSampleTime = inSampleTime;
+}
+
+UInt32	CAAudioRenderDriver::GetBufferedFrames() const
+{
+	return (mRenderQuantum != kRenderQuantum_Immediate) ? mFIFO.GetReadableFrames() : mPendingFrames;
+}
+
+OSStatus	CAAudioRenderDriver::InputCallback(void*						inRefCon,
+											   AudioUnitRenderActionFlags*	/*ioActionFlags*/,
+											   const AudioTimeStamp*		/*inTimeStamp*/,
+											   UInt32						/*inBusNumber*/,
+											   UInt32						inNumberFrames,
+											   AudioBufferList*				ioData)
+{
+	CAAudioRenderDriver* theDriver = static_cast<CAAudioRenderDriver*>(inRefCon);
+	const AudioBufferList* theInput = theDriver->mCurrentInput;
+	
+	//	only called back from inside Render
+	if(theInput == NULL)
+	{
+		return kAudioUnitErr_CannotDoInCurrentContext;
+	}
+	if(inNumberFrames > theDriver->mCurrentFrames)
+	{
+		return kAudioUnitErr_TooManyFramesToProcess;
+	}
+	if(theInput->mNumberBuffers != ioData->mNumberBuffers)
+	{
+		return kAudioFormatUnknownFormatError;
+	}
+	
+	//	hand over the input without copying it
+	UInt32 theNumberBytes = theDriver->mFormat.FramesToBytes(inNumberFrames);
+	for(UInt32 theBuffer = 0; theBuffer < ioData->mNumberBuffers; ++theBuffer)
+	{
+		ioData->mBuffers[theBuffer].mNumberChannels = theInput->mBuffers[theBuffer].mNumberChannels;
+		ioData->mBuffers[theBuffer].mDataByteSize = theNumberBytes;
+		ioData->mBuffers[theBuffer].mData = theInput->mBuffers[theBuffer].mData;
+	}
+	return noErr;
+}
+
+OSStatus	CAAudioRenderDriver::AudioUnitRenderProc(void*							inRefCon,
+													 AudioUnitRenderActionFlags*	ioActionFlags,
+													 const AudioTimeStamp*			inTimeStamp,
+													 UInt32							inOutputBusNumber,
+													 UInt32							inNumberFrames,
+													 AudioBufferList*				ioData)
+{
+	return AudioUnitRender(static_cast<AudioUnit>(inRefCon), ioActionFlags, inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+}
@@ -0,0 +1,199 @@
+/*
+     File: CAAudioRenderDriver.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAAudioRenderDriver_h__)
+#define __CAAudioRenderDriver_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <AudioUnit/AudioUnit.h>
+#else
+	#include <AudioUnit.h>
+#endif
+
+//	PublicUtility Includes
+#include "CAStreamBasicDescription.h"
+#include "CAAudioBufferListFIFO.h"
+
+class	AUOutputBL;
+
+//=============================================================================
+//	CAAudioRenderDriver
+//
+//	Drives an audio unit (or anything with the same render signature) that is
+//	pulled by hand rather than by an output device, such as an effect fed from
+//	a capture callback. Audio is pushed in whatever buffer sizes it arrives in
+//	and rendered in fixed sized quanta, so that the unit runs fewer, larger
+//	renders. Each render gets a time stamp whose sample time is that of its
+//	first frame, continuing across renders without gaps.
+//
+//	The render quantum trades latency for throughput: pushed frames wait until
+//	a whole quantum has arrived, so up to one quantum less a frame is held
+//	back. kRenderQuantum_Immediate renders each push as it is, without copying.
+//
+//	The unit's input is fed by InputCallback, which must be installed as its
+//	render callback (or node input callback) with the driver as the refCon, and
+//	its kAudioUnitProperty_MaximumFramesPerSlice must be at least
+//	GetMaximumFramesPerRender().
+//
+//	Everything but Initialize is real-time safe, and all of it must be called
+//	from one thread at a time.
+//=============================================================================
+
+class	CAAudioRenderDriver
+{
+
+//	Types
+public:
+	typedef OSStatus	(*RenderProc)(void*							inRefCon,
+									  AudioUnitRenderActionFlags*	ioActionFlags,
+									  const AudioTimeStamp*			inTimeStamp,
+									  UInt32						inOutputBusNumber,
+									  UInt32						inNumberFrames,
+									  AudioBufferList*				ioData);
+
+//	Constants
+public:
+	enum
+	{
+		kRenderQuantum_Immediate	= 0,
+		kRenderQuantum_LowLatency	= 1024,
+		kRenderQuantum_Throughput	= 4096
+	};
+
+//	Construction/Destruction
+public:
+						CAAudioRenderDriver();
+						~CAAudioRenderDriver();
+
+	//	sets up the buffering for pushes of up to inMaxInputFrames frames in inFormat, which is both
+	//	the input and output format of the unit. Anything still buffered is thrown away, but the
+	//	sample time carries on from where it was.
+	void				Initialize(const CAStreamBasicDescription& inFormat, UInt32 inRenderQuantum, UInt32 inMaxInputFrames);
+
+	const CAStreamBasicDescription&	GetFormat() const { return mFormat; }
+	UInt32				GetRenderQuantum() const { return mRenderQuantum; }
+	UInt32				GetMaximumFramesPerRender() const { return (mRenderQuantum != kRenderQuantum_Immediate) ? mRenderQuantum : mMaxInputFrames; }
+	UInt32				GetMaximumLatencyFrames() const { return (mRenderQuantum != kRenderQuantum_Immediate) ? (mRenderQuantum - 1) : 0; }
+
+//	Render Target
+public:
+	void				SetRenderTarget(AudioUnit inAudioUnit, UInt32 inOutputBusNumber = 0);
+	void				SetRenderProc(RenderProc inRenderProc, void* inRefCon, UInt32 inOutputBusNumber = 0);
+
+	static OSStatus		InputCallback(void*							inRefCon,
+									  AudioUnitRenderActionFlags*	ioActionFlags,
+									  const AudioTimeStamp*			inTimeStamp,
+									  UInt32						inBusNumber,
+									  UInt32						inNumberFrames,
+									  AudioBufferList*				ioData);
+
+//	Operations
+public:
+	//	takes all of the frames or, if there isn't room for them because Render hasn't been called
+	//	since the last push, none of them. With kRenderQuantum_Immediate the buffers are not copied
+	//	and must stay valid until they have been rendered.
+	bool				Push(const AudioBufferList& inBufferList, UInt32 inNumberFrames);
+
+	//	renders the next quantum if enough has been pushed, returning the number of frames rendered
+	//	in outNumberFrames (zero when there is nothing to render yet). Call until that is zero; the
+	//	output stays valid until the next call.
+	OSStatus			Render(UInt32& outNumberFrames);
+	AudioBufferList*	GetOutputBufferList();
+	const AudioTimeStamp&	GetRenderTimeStamp() const { return mRenderTimeStamp; }
+
+	//	lets Render render the frames still waiting for a full quantum as a short final one
+	void				Flush();
+
+	//	throws away anything buffered and starts the sample time again at inSampleTime
+	void				Reset(Float64 inSampleTime = 0.0);
+
+	UInt32				GetBufferedFrames() const;
+
+//	Implementation
+private:
+	OSStatus			RenderFrames(const AudioBufferList* inInput, UInt32 inNumberFrames);
+	void				Deallocate();
+
+	static OSStatus		AudioUnitRenderProc(void*							inRefCon,
+											AudioUnitRenderActionFlags*	ioActionFlags,
+											const AudioTimeStamp*			inTimeStamp,
+											UInt32						inOutputBusNumber,
+											UInt32						inNumberFrames,
+											AudioBufferList*				ioData);
+
+	CAStreamBasicDescription	mFormat;
+	UInt32						mRenderQuantum;
+	UInt32						mMaxInputFrames;
+
+	RenderProc					mRenderProc;
+	void*						mRenderRefCon;
+	UInt32						mOutputBusNumber;
+
+	CAAudioBufferListFIFO		mFIFO;				//	frames waiting for a full quantum
+	AudioBufferList*			mFIFOView;			//	points into mFIFO when a quantum doesn't wrap around the ring
+	AUOutputBL*					mQuantumBuffer;		//	holds a copy of a quantum when it does
+	AUOutputBL*					mOutputBuffer;
+	bool						mIsFlushing;
+
+	const AudioBufferList*		mPendingInput;		//	kRenderQuantum_Immediate only
+	UInt32						mPendingFrames;
+
+	const AudioBufferList*		mCurrentInput;		//	what InputCallback hands out, only set while rendering
+	UInt32						mCurrentFrames;
+
+	Float64						mNextSampleTime;
+	AudioTimeStamp				mRenderTimeStamp;
+
+	CAAudioRenderDriver(const CAAudioRenderDriver&);
+	CAAudioRenderDriver& operator=(const CAAudioRenderDriver&);
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+     File: CAPCMConverter.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAPCMConverter_h__)
+#define __CAPCMConverter_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAStreamBasicDescription.h"
+
+//=============================================================================
+//	CAPCMConverter
+//
+//	Converts linear PCM between any two formats that differ only in sample
+//	type, endianness and interleaving: signed or unsigned 8, 16, 24 and 32 bit
+//	integers (packed or aligned in a wider word, with or without fraction bits
+//	such as 8.24), and 32 and 64 bit floats. It does no sample rate conversion
+//	and no channel mixing, so both formats must agree on those.
+//
+//	Unlike an AudioConverter or AUConverter this holds no buffers and takes no
+//	locks: Initialize once when the formats are known, then Convert may be
+//	called from the render thread. The common conversions between native
+//	Int16, native 32 bit integers and Float32 use CAVectorOps kernels; pairs of
+//	the common formats with 1 or 2 channels that those can't take as one run
+//	use a CAStaticConvertKernel picked in Initialize; the rest go through a
+//	small stack block of Float32 (or Float64 for the wide formats).
+//=============================================================================
+
+class	CAPCMConverter
+{
+
+//	Construction/Destruction
+public:
+						CAPCMConverter() : mIsInitialized(false) {}
+
+	//	returns kAudio_UnimplementedError if either format is not one this class handles,
+	//	and kAudio_ParamError if the formats disagree on sample rate or channel count
+	OSStatus			Initialize(const CAStreamBasicDescription& inSourceFormat, const CAStreamBasicDescription& inDestinationFormat);
+	bool				IsInitialized() const { return mIsInitialized; }
+
+	static bool			CanConvert(const CAStreamBasicDescription& inSourceFormat, const CAStreamBasicDescription& inDestinationFormat);
+
+	const CAStreamBasicDescription&	GetSourceFormat() const { return mSourceFormat; }
+	const CAStreamBasicDescription&	GetDestinationFormat() const { return mDestinationFormat; }
+
+//	Operations
+public:
+	//	converts inNumberFrames frames and sets the size of every destination buffer to match
+	//	returns kAudio_ParamError if either list does not match its format or is too small
+	OSStatus			Convert(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames) const;
+
+//	Implementation
+public:
+	enum	SampleKind
+			{
+				kSampleKind_Integer,
+				kSampleKind_Float32,
+				kSampleKind_Float64
+			};
+
+	struct	SampleFormat
+	{
+		UInt32	mKind;
+		UInt32	mWordBytes;			//	bytes each sample occupies
+		UInt32	mValidBits;			//	significant bits within that word
+		UInt32	mWordShift;			//	left shift that puts the significant bits at the top of an SInt32
+		UInt32	mFractionBits;		//	integer value of full scale is 2^mFractionBits
+		bool	mIsSigned;
+		bool	mIsBigEndian;
+		bool	mIsSwapped;			//	not native endian
+		Float64	mDecodeScale;		//	multiplies a top aligned SInt32 to get the value
+		Float64	mEncodeScale;		//	multiplies a value to get the integer
+	};
+
+	static bool			GetSampleFormat(const CAStreamBasicDescription& inFormat, SampleFormat& outSampleFormat);
+
+private:
+	enum	FastPath
+			{
+				kFastPath_None,
+				kFastPath_Copy,
+				kFastPath_Int16ToFloat32,
+				kFastPath_Float32ToInt16,
+				kFastPath_Int32ToFloat32
+			};
+
+	typedef void		(*StaticKernel)(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames);
+
+	void				ConvertSamples(const Byte* inSource, UInt32 inSourceStride, Byte* outDestination, UInt32 inDestinationStride, UInt32 inNumberSamples) const;
+
+	CAStreamBasicDescription	mSourceFormat;
+	CAStreamBasicDescription	mDestinationFormat;
+	SampleFormat				mSourceSampleFormat;
+	SampleFormat				mDestinationSampleFormat;
+	UInt32						mFastPath;
+	StaticKernel				mStaticKernel;
+	bool						mUseFloat64;
+	bool						mIsInitialized;
+
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*
+     File: CASilenceDetector.cpp 
+ Abstract:  CASilenceDetector.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CASilenceDetector.h"
+#include "CADebugMacros.h"
+#include "CAVectorOps.h"
+#include <math.h>
+
+//=============================================================================
+//	CASilenceDetector
+//=============================================================================
+
+const Float32	CASilenceDetector::kMinimumDB = -144.f;
+
+CASilenceDetector::CASilenceDetector(Float32 inThresholdDB, Float32 inHysteresisDB)
+	: mThresholdDB(inThresholdDB),
+	  mHysteresisDB(0.f),
+	  mOpenLevel(0.f),
+	  mCloseLevel(0.f),
+	  mIsSilent(true),
+	  mDidChangeState(false),
+	  mNumberChannels(0)
+{
+	//	also sets the levels, with the hysteresis clamped the same way as when it's changed later
+	SetHysteresis(inHysteresisDB);
+	Reset();
+}
+
+void	CASilenceDetector::SetThreshold(Float32 inThresholdDB)
+{
+	mThresholdDB = inThresholdDB;
+	mOpenLevel = DBToAmplitude(mThresholdDB);
+	mCloseLevel = DBToAmplitude(mThresholdDB - mHysteresisDB);
+}
+
+void	CASilenceDetector::SetHysteresis(Float32 inHysteresisDB)
+{
+	mHysteresisDB = (inHysteresisDB > 0.f) ? inHysteresisDB : 0.f;
+	SetThreshold(mThresholdDB);
+}
+
+void	CASilenceDetector::Reset()
+{
+	mIsSilent = true;
+	mDidChangeState = false;
+	mNumberChannels = 0;
+	for(UInt32 theChannel = 0; theChannel < kMaxChannels; ++theChannel)
+	{
+		mPeaks[theChannel] = 0.f;
+		mRMS[theChannel] = 0.f;
+	}
+}
+
+bool	CASilenceDetector::Analyze(const AudioBufferList& inBufferList)
+{
+	Float32 theSumsOfSquares[kMaxChannels];
+	UInt32 theNumberFrames[kMaxChannels];
+	
+	//	measure each buffer in one pass, however many channels it interleaves
+	UInt32 theNumberChannels = 0;
+	for(UInt32 theBufferIndex = 0; theBufferIndex < inBufferList.mNumberBuffers; ++theBufferIndex)
+	{
+		const AudioBuffer& theBuffer = inBufferList.mBuffers[theBufferIndex];
+		UInt32 theBufferChannels = theBuffer.mNumberChannels;
+		if(theNumberChannels + theBufferChannels > kMaxChannels)
+		{
+			break;
+		}
+		
+		UInt32 theFrames = ((theBuffer.mData != NULL) && (theBufferChannels > 0)) ? theBuffer.mDataByteSize / (theBufferChannels * SizeOf32(Float32)) : 0;
+		for(UInt32 theChannel = 0; theChannel < theBufferChannels; ++theChannel)
+		{
+			mPeaks[theNumberChannels + theChannel] = 0.f;
+			theSumsOfSquares[theNumberChannels + theChannel] = 0.f;
+			theNumberFrames[theNumberChannels + theChannel] = theFrames;
+		}
+		if(theFrames > 0)
+		{
+			CAVectorOps::MeasurePeakAndPower(static_cast<const Float32*>(theBuffer.mData), theBufferChannels, theFrames, mPeaks + theNumberChannels, theSumsOfSquares + theNumberChannels);
+		}
+		theNumberChannels += theBufferChannels;
+	}
+	mNumberChannels = theNumberChannels;
+	
+	for(UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+	{
+		mRMS[theChannel] = (theNumberFrames[theChannel] > 0) ? sqrtf(theSumsOfSquares[theChannel] / theNumberFrames[theChannel]) : 0.f;
+	}
+	
+	//	apply the hysteresis to the loudest channel
+	Float32 thePeak = GetMaximumPeak();
+	bool wasSilent = mIsSilent;
+	if(mIsSilent)
+	{
+		mIsSilent = !(thePeak >= mOpenLevel);
+	}
+	else
+	{
+		mIsSilent = thePeak < mCloseLevel;
+	}
+	mDidChangeState = mIsSilent != wasSilent;
+	
+	return mIsSilent;
+}
+
+Float32	CASilenceDetector::GetMaximumPeak() const
+{
+	Float32 theAnswer = 0.f;
+	for(UInt32 theChannel = 0; theChannel < mNumberChannels; ++theChannel)
+	{
+		if(mPeaks[theChannel] > theAnswer)
+		{
+			theAnswer = mPeaks[theChannel];
+		}
+	}
+	return theAnswer;
+}
+
+Float32	CASilenceDetector::AmplitudeToDB(Float32 inAmplitude)
+{
+	return (inAmplitude > 0.f) ? fmaxf(20.f * log10f(inAmplitude), kMinimumDB) : kMinimumDB;
+}
+
+Float32	CASilenceDetector::DBToAmplitude(Float32 inDB)
+{
+	return powf(10.f, inDB / 20.f);
+}
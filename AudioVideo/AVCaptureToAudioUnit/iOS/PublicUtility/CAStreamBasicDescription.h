@@ -392,6 +392,14 @@ public:
 #if CoreAudio_Debug
 	static void			PrintToLog(const AudioStreamBasicDescription& inDesc);
 #endif
+
+//	Implementation
+private:
+	friend class CAStreamFormatRegistry;
+
+	//	what GetSimpleName and FromText do the first time CAStreamFormatRegistry sees a format or text
+	static void			FormatSimpleName(const AudioStreamBasicDescription& inDescription, char* outName, UInt32 inMaxNameLength, bool inAbbreviate);
+	static bool			ParseText(const char *inTextDesc, AudioStreamBasicDescription &outDesc);
 };
 
 bool		operator<(const AudioStreamBasicDescription& x, const AudioStreamBasicDescription& y);
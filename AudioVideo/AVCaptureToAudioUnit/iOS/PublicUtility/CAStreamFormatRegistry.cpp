@@ -0,0 +1,242 @@
+/*
+     File: CAStreamFormatRegistry.cpp 
+ Abstract:  CAStreamFormatRegistry.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAStreamFormatRegistry.h"
+#include "CAStreamBasicDescription.h"
+#include "CAStreamFormatText.h"
+#include <string.h>
+
+namespace
+{
+	//	what snprintf would leave in outBuffer if inString were formatted into it
+	void	CopyTruncated(const char* inString, UInt32 inLength, char* outBuffer, size_t inBufferSize)
+	{
+		if(inBufferSize > 0)
+		{
+			size_t theLength = (inLength < inBufferSize) ? inLength : (inBufferSize - 1);
+			memcpy(outBuffer, inString, theLength);
+			outBuffer[theLength] = 0;
+		}
+	}
+}
+
+//=============================================================================
+//	CAStreamFormatRegistry
+//=============================================================================
+
+CAStreamFormatRegistry&	CAStreamFormatRegistry::Shared()
+{
+	//	never destroyed, so that formats can still be described from other static destructors
+	static CAStreamFormatRegistry* sRegistry = new CAStreamFormatRegistry;
+	return *sRegistry;
+}
+
+CAStreamFormatRegistry::CAStreamFormatRegistry()
+	: mNumberFormats(0),
+	  mNumberTexts(0)
+{
+	for(UInt32 theSlot = 0; theSlot < kNumberFormatSlots; ++theSlot)
+	{
+		mFormats[theSlot].store(NULL, std::memory_order_relaxed);
+	}
+	for(UInt32 theSlot = 0; theSlot < kNumberTextSlots; ++theSlot)
+	{
+		mTexts[theSlot].store(NULL, std::memory_order_relaxed);
+	}
+}
+
+CAStreamFormatRegistry::~CAStreamFormatRegistry()
+{
+	for(UInt32 theSlot = 0; theSlot < kNumberFormatSlots; ++theSlot)
+	{
+		delete mFormats[theSlot].load(std::memory_order_relaxed);
+	}
+	for(UInt32 theSlot = 0; theSlot < kNumberTextSlots; ++theSlot)
+	{
+		delete mTexts[theSlot].load(std::memory_order_relaxed);
+	}
+}
+
+const CAStreamFormatRegistry::Entry*	CAStreamFormatRegistry::Intern(const AudioStreamBasicDescription& inDesc)
+{
+	UInt32 theHash = Hash(&inDesc, sizeof(AudioStreamBasicDescription));
+	
+	//	look for it without the lock; slots are only ever filled in, so a miss here just means we take the lock
+	UInt32 theSlot = theHash & (kNumberFormatSlots - 1);
+	Entry* theEntry;
+	while((theEntry = mFormats[theSlot].load(std::memory_order_acquire)) != NULL)
+	{
+		if(memcmp(&theEntry->mDescription, &inDesc, sizeof(AudioStreamBasicDescription)) == 0)
+		{
+			return theEntry;
+		}
+		theSlot = (theSlot + 1) & (kNumberFormatSlots - 1);
+	}
+	
+	std::lock_guard<std::mutex> theLock(mInsertMutex);
+	
+	//	someone else may have added it, or something else in its way, while we waited
+	while((theEntry = mFormats[theSlot].load(std::memory_order_acquire)) != NULL)
+	{
+		if(memcmp(&theEntry->mDescription, &inDesc, sizeof(AudioStreamBasicDescription)) == 0)
+		{
+			return theEntry;
+		}
+		theSlot = (theSlot + 1) & (kNumberFormatSlots - 1);
+	}
+	if(mNumberFormats.load(std::memory_order_relaxed) >= kMaxNumberFormats)
+	{
+		return NULL;
+	}
+	
+	theEntry = new Entry;
+	theEntry->mDescription = inDesc;
+	theEntry->mStringLength = CAStreamFormatText::Format(inDesc, theEntry->mString, sizeof(theEntry->mString));
+	CAStreamBasicDescription::FormatSimpleName(inDesc, theEntry->mSimpleName, sizeof(theEntry->mSimpleName), false);
+	theEntry->mSimpleNameLength = static_cast<UInt32>(strlen(theEntry->mSimpleName));
+	CAStreamBasicDescription::FormatSimpleName(inDesc, theEntry->mAbbreviatedSimpleName, sizeof(theEntry->mAbbreviatedSimpleName), true);
+	theEntry->mAbbreviatedSimpleNameLength = static_cast<UInt32>(strlen(theEntry->mAbbreviatedSimpleName));
+	
+	mFormats[theSlot].store(theEntry, std::memory_order_release);
+	mNumberFormats.fetch_add(1, std::memory_order_relaxed);
+	return theEntry;
+}
+
+char*	CAStreamFormatRegistry::AsString(const AudioStreamBasicDescription& inDesc, char* outBuffer, size_t inBufferSize)
+{
+	//	a text that filled the entry may have been cut short, so that one is formatted every time
+	const Entry* theEntry = Intern(inDesc);
+	if((theEntry != NULL) && (theEntry->mStringLength < (sizeof(theEntry->mString) - 1)))
+	{
+		CopyTruncated(theEntry->mString, theEntry->mStringLength, outBuffer, inBufferSize);
+	}
+	else
+	{
+		CAStreamFormatText::Format(inDesc, outBuffer, (inBufferSize > 0xFFFFFFFF) ? 0xFFFFFFFF : static_cast<UInt32>(inBufferSize));
+	}
+	return outBuffer;
+}
+
+char*	CAStreamFormatRegistry::GetSimpleName(const AudioStreamBasicDescription& inDesc, bool inAbbreviate, char* outBuffer, UInt32 inBufferSize)
+{
+	const Entry* theEntry = Intern(inDesc);
+	if(theEntry != NULL)
+	{
+		const char* theName = inAbbreviate ? theEntry->mAbbreviatedSimpleName : theEntry->mSimpleName;
+		UInt32 theLength = inAbbreviate ? theEntry->mAbbreviatedSimpleNameLength : theEntry->mSimpleNameLength;
+		UInt32 theCapacity = inAbbreviate ? sizeof(theEntry->mAbbreviatedSimpleName) : sizeof(theEntry->mSimpleName);
+		if(theLength < (theCapacity - 1))
+		{
+			CopyTruncated(theName, theLength, outBuffer, inBufferSize);
+			return outBuffer;
+		}
+	}
+	CAStreamBasicDescription::FormatSimpleName(inDesc, outBuffer, inBufferSize, inAbbreviate);
+	return outBuffer;
+}
+
+bool	CAStreamFormatRegistry::FromText(const char* inText, AudioStreamBasicDescription& outDesc)
+{
+	size_t theLength = strlen(inText);
+	if(theLength > kMaxTextLength)
+	{
+		return CAStreamBasicDescription::ParseText(inText, outDesc);
+	}
+	
+	UInt32 theHash = Hash(inText, theLength);
+	UInt32 theSlot = theHash & (kNumberTextSlots - 1);
+	TextEntry* theEntry;
+	while((theEntry = mTexts[theSlot].load(std::memory_order_acquire)) != NULL)
+	{
+		if(strcmp(theEntry->mText, inText) == 0)
+		{
+			outDesc = theEntry->mDescription;
+			return true;
+		}
+		theSlot = (theSlot + 1) & (kNumberTextSlots - 1);
+	}
+	
+	//	parse outside the lock; it's the same answer whoever gets to store it
+	if(!CAStreamBasicDescription::ParseText(inText, outDesc))
+	{
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> theLock(mInsertMutex);
+	while((theEntry = mTexts[theSlot].load(std::memory_order_acquire)) != NULL)
+	{
+		if(strcmp(theEntry->mText, inText) == 0)
+		{
+			return true;
+		}
+		theSlot = (theSlot + 1) & (kNumberTextSlots - 1);
+	}
+	if(mNumberTexts.load(std::memory_order_relaxed) < kMaxNumberTexts)
+	{
+		theEntry = new TextEntry;
+		memcpy(theEntry->mText, inText, theLength + 1);
+		theEntry->mDescription = outDesc;
+		mTexts[theSlot].store(theEntry, std::memory_order_release);
+		mNumberTexts.fetch_add(1, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+UInt32	CAStreamFormatRegistry::Hash(const void* inBytes, size_t inLength)
+{
+	//	FNV-1a
+	const Byte* theBytes = static_cast<const Byte*>(inBytes);
+	UInt32 theHash = 2166136261U;
+	for(size_t theIndex = 0; theIndex < inLength; ++theIndex)
+	{
+		theHash = (theHash ^ theBytes[theIndex]) * 16777619U;
+	}
+	return theHash;
+}
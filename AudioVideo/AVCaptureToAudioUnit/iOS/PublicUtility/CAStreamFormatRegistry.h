@@ -0,0 +1,152 @@
+/*
+     File: CAStreamFormatRegistry.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAStreamFormatRegistry_h__)
+#define __CAStreamFormatRegistry_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+
+//=============================================================================
+//	CAStreamFormatRegistry
+//
+//	Interns AudioStreamBasicDescriptions, keyed by their bytes, along with their
+//	text forms. CAStreamBasicDescription's AsString, GetSimpleName and FromText
+//	all go through the shared registry, so code that describes the same few
+//	formats over and over only formats or parses each of them once.
+//
+//	Lookups are a hash and a compare, and never lock or allocate once a format
+//	or text has been seen. The first sighting takes a lock and allocates. The
+//	registry holds a fixed number of each and never forgets one; once it is full
+//	new ones are handled without being cached. Texts that don't parse are never
+//	cached, so FromText prints its diagnostics for them every time.
+//=============================================================================
+
+class	CAStreamFormatRegistry
+{
+
+//	Types
+public:
+	struct	Entry
+	{
+		AudioStreamBasicDescription	mDescription;
+		char						mString[256];				//	as CAStreamFormatText::Format writes it
+		char						mSimpleName[128];			//	as CAStreamBasicDescription::GetSimpleName writes it, without the sample rate
+		char						mAbbreviatedSimpleName[64];
+		UInt32						mStringLength;
+		UInt32						mSimpleNameLength;
+		UInt32						mAbbreviatedSimpleNameLength;
+	};
+
+//	Construction/Destruction
+public:
+	static CAStreamFormatRegistry&	Shared();
+
+						CAStreamFormatRegistry();
+						~CAStreamFormatRegistry();
+
+//	Operations
+public:
+	//	returns NULL only if the format isn't registered yet and the registry is full
+	const Entry*		Intern(const AudioStreamBasicDescription& inDesc);
+
+	//	these write what CAStreamBasicDescription's own do into outBuffer, truncated the same way, and return outBuffer
+	char*				AsString(const AudioStreamBasicDescription& inDesc, char* outBuffer, size_t inBufferSize);
+	char*				GetSimpleName(const AudioStreamBasicDescription& inDesc, bool inAbbreviate, char* outBuffer, UInt32 inBufferSize);
+
+	//	CAStreamBasicDescription::FromText, remembering the answer for each text that parses
+	bool				FromText(const char* inText, AudioStreamBasicDescription& outDesc);
+
+	UInt32				GetNumberFormats() const { return mNumberFormats.load(std::memory_order_relaxed); }
+	UInt32				GetNumberTexts() const { return mNumberTexts.load(std::memory_order_relaxed); }
+
+//  Constants
+public:
+	enum
+	{
+		kMaxNumberFormats	= 1024,
+		kMaxNumberTexts		= 1024,
+		kMaxTextLength		= 63		//	longer texts are parsed every time
+	};
+
+//	Implementation
+private:
+	struct	TextEntry
+	{
+		char						mText[kMaxTextLength + 1];
+		AudioStreamBasicDescription	mDescription;
+	};
+
+	enum
+	{
+		kNumberFormatSlots	= 2 * kMaxNumberFormats,	//	powers of two, kept at most half full
+		kNumberTextSlots	= 2 * kMaxNumberTexts
+	};
+
+	static UInt32		Hash(const void* inBytes, size_t inLength);
+
+	std::atomic<Entry*>			mFormats[kNumberFormatSlots];
+	std::atomic<TextEntry*>		mTexts[kNumberTextSlots];
+	std::atomic<UInt32>			mNumberFormats;
+	std::atomic<UInt32>			mNumberTexts;
+	std::mutex					mInsertMutex;
+
+	CAStreamFormatRegistry(const CAStreamFormatRegistry&);
+	CAStreamFormatRegistry& operator=(const CAStreamFormatRegistry&);
+};
+
+#endif
@@ -0,0 +1,536 @@
+/*
+     File: CAStreamFormatText.cpp 
+ Abstract:  CAStreamFormatText.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAStreamFormatText.h"
+#include "CAStreamBasicDescription.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreFoundation/CFByteOrder.h>
+#else
+	#include <CFByteOrder.h>
+#endif
+
+//=============================================================================
+//	CATextWriter
+//
+//	Appends to a fixed buffer, silently dropping whatever doesn't fit, the way
+//	a chain of snprintf calls would.
+//=============================================================================
+
+class	CATextWriter
+{
+
+public:
+			CATextWriter(char* outBuffer, UInt32 inBufferSize) : mBuffer(outBuffer), mCapacity((inBufferSize > 0) ? inBufferSize - 1 : 0), mLength(0) { Terminate(); }
+
+	UInt32	GetLength() const { return mLength; }
+
+	void	Append(char inCharacter)
+	{
+		if(mLength < mCapacity)
+		{
+			mBuffer[mLength++] = inCharacter;
+		}
+	}
+
+	void	Append(const char* inString)
+	{
+		while(*inString != '\0')
+		{
+			Append(*inString++);
+		}
+	}
+
+	//	%*d (inPadWidth > 0) and %0*d (inPadWidth > 0, inPadCharacter '0')
+	void	AppendInteger(SInt64 inValue, UInt32 inPadWidth = 0, char inPadCharacter = ' ')
+	{
+		char theDigits[24];
+		UInt32 theNumberDigits = 0;
+		UInt64 theMagnitude = (inValue < 0) ? (0 - static_cast<UInt64>(inValue)) : static_cast<UInt64>(inValue);
+		do
+		{
+			theDigits[theNumberDigits++] = static_cast<char>('0' + (theMagnitude % 10));
+			theMagnitude /= 10;
+		}
+		while(theMagnitude != 0);
+		AppendDigits(theDigits, theNumberDigits, inValue < 0, inPadWidth, inPadCharacter);
+	}
+
+	//	%0*X
+	void	AppendHex(UInt32 inValue, UInt32 inNumberDigits)
+	{
+		static const char kHexDigits[] = "0123456789ABCDEF";
+		for(UInt32 theDigit = inNumberDigits; theDigit > 0; --theDigit)
+		{
+			Append(kHexDigits[(inValue >> (4 * (theDigit - 1))) & 0xF]);
+		}
+	}
+
+	//	%*.0f
+	void	AppendRounded(Float64 inValue, UInt32 inPadWidth)
+	{
+		if(!(fabs(inValue) < 1e15))
+		{
+			//	infinities, NaNs and numbers too big to round through an integer are rare enough to leave to stdio
+			char theText[352];
+			snprintf(theText, sizeof(theText), "%*.0f", static_cast<int>(inPadWidth), inValue);
+			Append(theText);
+			return;
+		}
+		
+		//	rint rounds halfway cases to even, as printf does
+		Float64 theRounded = rint(inValue);
+		char theDigits[24];
+		UInt32 theNumberDigits = 0;
+		UInt64 theMagnitude = static_cast<UInt64>(fabs(theRounded));
+		do
+		{
+			theDigits[theNumberDigits++] = static_cast<char>('0' + (theMagnitude % 10));
+			theMagnitude /= 10;
+		}
+		while(theMagnitude != 0);
+		AppendDigits(theDigits, theNumberDigits, signbit(theRounded) != 0, inPadWidth, ' ');
+	}
+
+	void	Terminate()
+	{
+		if(mCapacity > 0 || mBuffer != NULL)
+		{
+			mBuffer[mLength] = '\0';
+		}
+	}
+
+private:
+	void	AppendDigits(const char* inReversedDigits, UInt32 inNumberDigits, bool inIsNegative, UInt32 inPadWidth, char inPadCharacter)
+	{
+		UInt32 theWidth = inNumberDigits + (inIsNegative ? 1 : 0);
+		if(inIsNegative && (inPadCharacter == '0'))
+		{
+			Append('-');
+		}
+		for(; theWidth < inPadWidth; ++theWidth)
+		{
+			Append(inPadCharacter);
+		}
+		if(inIsNegative && (inPadCharacter != '0'))
+		{
+			Append('-');
+		}
+		while(inNumberDigits > 0)
+		{
+			Append(inReversedDigits[--inNumberDigits]);
+		}
+	}
+
+	char*	mBuffer;
+	UInt32	mCapacity;
+	UInt32	mLength;
+
+};
+
+//=============================================================================
+//	CAStreamFormatText
+//=============================================================================
+
+static void	AppendOSType(CATextWriter& ioWriter, OSType inType)
+{
+	unsigned char theCharacters[4];
+	UInt32 theBigEndianType = CFSwapInt32HostToBig(inType);
+	memcpy(theCharacters, &theBigEndianType, 4);
+	
+	bool hasNonPrint = false;
+	for(int theIndex = 0; theIndex < 4; ++theIndex)
+	{
+		if((theCharacters[theIndex] < 0x20) || (theCharacters[theIndex] > 0x7E) || (theCharacters[theIndex] == '\\'))
+		{
+			hasNonPrint = true;
+		}
+	}
+	
+	if(hasNonPrint)
+	{
+		ioWriter.Append("0x");
+		ioWriter.AppendHex(CFSwapInt32BigToHost(theBigEndianType), 8);
+	}
+	else
+	{
+		ioWriter.Append('\'');
+		for(int theIndex = 0; theIndex < 4; ++theIndex)
+		{
+			ioWriter.Append(static_cast<char>(theCharacters[theIndex]));
+		}
+		ioWriter.Append('\'');
+	}
+}
+
+UInt32	CAStreamFormatText::FormatOSType(OSType inType, char* outBuffer, UInt32 inBufferSize)
+{
+	CATextWriter theWriter(outBuffer, inBufferSize);
+	AppendOSType(theWriter, inType);
+	theWriter.Terminate();
+	return theWriter.GetLength();
+}
+
+UInt32	CAStreamFormatText::Format(const AudioStreamBasicDescription& inDesc, char* outBuffer, UInt32 inBufferSize)
+{
+	const CAStreamBasicDescription& theDesc = static_cast<const CAStreamBasicDescription&>(inDesc);
+	CATextWriter theWriter(outBuffer, inBufferSize);
+	
+	theWriter.AppendInteger(static_cast<int>(theDesc.NumberChannels()), 2);
+	theWriter.Append(" ch, ");
+	theWriter.AppendRounded(theDesc.mSampleRate, 6);
+	theWriter.Append(" Hz, ");
+	AppendOSType(theWriter, theDesc.mFormatID);
+	theWriter.Append(" (0x");
+	theWriter.AppendHex(theDesc.mFormatFlags, 8);
+	theWriter.Append(") ");
+	
+	if(theDesc.mFormatID == kAudioFormatLinearPCM)
+	{
+		bool isInt = !(theDesc.mFormatFlags & kLinearPCMFormatFlagIsFloat);
+		UInt32 theWordSize = theDesc.SampleWordSize();
+		int theFractionBits = (theDesc.mFormatFlags & kLinearPCMFormatFlagsSampleFractionMask) >> kLinearPCMFormatFlagsSampleFractionShift;
+		
+		if(theFractionBits > 0)
+		{
+			theWriter.AppendInteger(static_cast<int>(theDesc.mBitsPerChannel) - theFractionBits);
+			theWriter.Append('.');
+			theWriter.AppendInteger(theFractionBits);
+		}
+		else
+		{
+			theWriter.AppendInteger(static_cast<int>(theDesc.mBitsPerChannel));
+		}
+		theWriter.Append("-bit");
+		if(theWordSize > 1)
+		{
+			theWriter.Append((theDesc.mFormatFlags & kLinearPCMFormatFlagIsBigEndian) ? " big-endian" : " little-endian");
+		}
+		if(isInt)
+		{
+			theWriter.Append((theDesc.mFormatFlags & kLinearPCMFormatFlagIsSignedInteger) ? " signed" : " unsigned");
+		}
+		theWriter.Append(isInt ? " integer" : " float");
+		
+		bool hasPacking = (theWordSize > 0) && theDesc.PackednessIsSignificant();
+		bool hasAlignment = (theWordSize > 0) && theDesc.AlignmentIsSignificant();
+		if(hasPacking || hasAlignment)
+		{
+			theWriter.Append(", ");
+		}
+		if(hasPacking)
+		{
+			theWriter.Append((theDesc.mFormatFlags & kLinearPCMFormatFlagIsPacked) ? "packed in " : "unpacked in ");
+			theWriter.AppendInteger(static_cast<int>(theWordSize));
+			theWriter.Append(" bytes");
+		}
+		if(hasAlignment)
+		{
+			theWriter.Append((theDesc.mFormatFlags & kLinearPCMFormatFlagIsAlignedHigh) ? " high-aligned" : " low-aligned");
+		}
+		if(theDesc.mFormatFlags & kAudioFormatFlagIsNonInterleaved)
+		{
+			theWriter.Append(", deinterleaved");
+		}
+	}
+	else if(theDesc.mFormatID == 'alac')	//	kAudioFormatAppleLossless
+	{
+		int theSourceBits = 0;
+		switch(theDesc.mFormatFlags)
+		{
+			case 1:	//	kAppleLosslessFormatFlag_16BitSourceData
+				theSourceBits = 16;
+				break;
+			case 2:	//	kAppleLosslessFormatFlag_20BitSourceData
+				theSourceBits = 20;
+				break;
+			case 3:	//	kAppleLosslessFormatFlag_24BitSourceData
+				theSourceBits = 24;
+				break;
+			case 4:	//	kAppleLosslessFormatFlag_32BitSourceData
+				theSourceBits = 32;
+				break;
+		}
+		if(theSourceBits)
+		{
+			theWriter.Append("from ");
+			theWriter.AppendInteger(theSourceBits);
+			theWriter.Append("-bit source, ");
+		}
+		else
+		{
+			theWriter.Append("from UNKNOWN source bit depth, ");
+		}
+		theWriter.AppendInteger(static_cast<int>(theDesc.mFramesPerPacket));
+		theWriter.Append(" frames/packet");
+	}
+	else
+	{
+		theWriter.AppendInteger(static_cast<int>(theDesc.mBitsPerChannel));
+		theWriter.Append(" bits/channel, ");
+		theWriter.AppendInteger(static_cast<int>(theDesc.mBytesPerPacket));
+		theWriter.Append(" bytes/packet, ");
+		theWriter.AppendInteger(static_cast<int>(theDesc.mFramesPerPacket));
+		theWriter.Append(" frames/packet, ");
+		theWriter.AppendInteger(static_cast<int>(theDesc.mBytesPerFrame));
+		theWriter.Append(" bytes/frame");
+	}
+	
+	theWriter.Terminate();
+	return theWriter.GetLength();
+}
+
+//	the parser reads through one of these so that running off the end of the text looks like a terminating null
+class	CATextReader
+{
+
+public:
+			CATextReader(const char* inText, size_t inLength) : mText(inText), mPosition(inText), mEnd(inText + inLength) {}
+
+	char	Peek(size_t inOffset = 0) const { return (mPosition + inOffset < mEnd) ? mPosition[inOffset] : '\0'; }
+	char	Next() { char theAnswer = Peek(); if(mPosition < mEnd) ++mPosition; return theAnswer; }
+	void	Skip(size_t inCount = 1) { mPosition = (mPosition + inCount < mEnd) ? mPosition + inCount : mEnd; }
+	void	Back() { if(mPosition > mText) --mPosition; }
+	void	Rewind() { mPosition = mText; }
+	bool	AtEnd() const { return mPosition >= mEnd; }
+	size_t	GetOffset() const { return static_cast<size_t>(mPosition - mText); }
+	static bool	IsDigit(char inCharacter) { return (inCharacter >= '0') && (inCharacter <= '9'); }
+	
+	UInt32	ReadDecimal()
+	{
+		UInt32 theAnswer = 0;
+		while(IsDigit(Peek()))
+		{
+			theAnswer = 10 * theAnswer + (Next() - '0');
+		}
+		return theAnswer;
+	}
+
+private:
+	const char*	mText;
+	const char*	mPosition;
+	const char*	mEnd;
+
+};
+
+static int	HexDigitValue(char inCharacter)
+{
+	if((inCharacter >= '0') && (inCharacter <= '9'))	return inCharacter - '0';
+	if((inCharacter >= 'A') && (inCharacter <= 'F'))	return inCharacter - 'A' + 10;
+	if((inCharacter >= 'a') && (inCharacter <= 'f'))	return inCharacter - 'a' + 10;
+	return -1;
+}
+
+static bool	ParseFailed(const CATextReader& inReader, UInt32 inKind, CAStreamFormatText::ParseError* outError)
+{
+	if(outError != NULL)
+	{
+		outError->mKind = inKind;
+		outError->mOffset = inReader.GetOffset();
+	}
+	return false;
+}
+
+bool	CAStreamFormatText::Parse(const char* inText, size_t inLength, AudioStreamBasicDescription& fmt, ParseError* outError)
+{
+	//	this follows CAStreamBasicDescription::FromText's original implementation step for step
+	CATextReader p(inText, inLength);
+	
+	memset(&fmt, 0, sizeof(fmt));
+	
+	bool isPCM = true;	// until proven otherwise
+	UInt32 pcmFlags = kAudioFormatFlagIsPacked | kAudioFormatFlagIsSignedInteger;
+	
+	if (p.Peek() == '-')	// previously we required a leading dash on PCM formats
+		p.Skip();
+	
+	if (p.Peek() == 'B' && p.Peek(1) == 'E') {
+		pcmFlags |= kLinearPCMFormatFlagIsBigEndian;
+		p.Skip(2);
+	} else if (p.Peek() == 'L' && p.Peek(1) == 'E') {
+		p.Skip(2);
+	} else {
+		// default is native-endian
+#if TARGET_RT_BIG_ENDIAN
+		pcmFlags |= kLinearPCMFormatFlagIsBigEndian;
+#endif
+	}
+	if (p.Peek() == 'F') {
+		pcmFlags = (pcmFlags & ~kAudioFormatFlagIsSignedInteger) | kAudioFormatFlagIsFloat;
+		p.Skip();
+	} else {
+		if (p.Peek() == 'U') {
+			pcmFlags &= ~kAudioFormatFlagIsSignedInteger;
+			p.Skip();
+		}
+		if (p.Peek() == 'I')
+			p.Skip();
+		else {
+			// it's not PCM; presumably some other format (NOT VALIDATED; use AudioFormat for that)
+			isPCM = false;
+			p.Rewind();	// go back to the beginning
+			char buf[4] = { ' ',' ',' ',' ' };
+			for (int i = 0; i < 4; ++i) {
+				if (p.Peek() != '\\') {
+					if (p.AtEnd() || p.Peek() == '\0') {
+						// special-case for 'aac'
+						if (i != 3) return ParseFailed(p, ParseError::kBadFormatID, outError);
+						buf[i] = ' ';	// keep pointing at the end
+						break;
+					}
+					buf[i] = p.Next();
+				} else {
+					// "\xNN" is a hex byte
+					p.Skip();
+					if (p.Next() != 'x') return ParseFailed(p, ParseError::kBadFormatID, outError);
+					int theHigh = HexDigitValue(p.Peek()), theLow = HexDigitValue(p.Peek(1));
+					if (theHigh < 0) return ParseFailed(p, ParseError::kBadFormatID, outError);
+					buf[i] = static_cast<char>((theLow < 0) ? theHigh : (theHigh << 4) | theLow);
+					p.Skip(2);
+				}
+			}
+			
+			if (strchr("-@/#", buf[3])) {
+				// further special-casing for 'aac'
+				buf[3] = ' ';
+				p.Back();
+			}
+			
+			UInt32 theFormatID;
+			memcpy(&theFormatID, buf, 4);
+			fmt.mFormatID = CFSwapInt32BigToHost(theFormatID);
+		}
+	}
+	
+	if (isPCM) {
+		fmt.mFormatID = kAudioFormatLinearPCM;
+		fmt.mFormatFlags = pcmFlags;
+		fmt.mFramesPerPacket = 1;
+		fmt.mChannelsPerFrame = 1;
+		UInt32 bitdepth = p.ReadDecimal(), fracbits = 0;
+		if (p.Peek() == '.') {
+			p.Skip();
+			if (!CATextReader::IsDigit(p.Peek()))
+				return ParseFailed(p, ParseError::kMissingFractionBits, outError);
+			fracbits = p.ReadDecimal();
+			bitdepth += fracbits;
+			fmt.mFormatFlags |= (fracbits << kLinearPCMFormatFlagsSampleFractionShift);
+		}
+		fmt.mBitsPerChannel = bitdepth;
+		fmt.mBytesPerPacket = fmt.mBytesPerFrame = (bitdepth + 7) / 8;
+		if (bitdepth & 7) {
+			// assume unpacked. (packed odd bit depths are describable but not supported in AudioConverter.)
+			fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsPacked;
+			// alignment matters; default to high-aligned. use ':L_' for low.
+			fmt.mFormatFlags |= kLinearPCMFormatFlagIsAlignedHigh;
+		}
+	}
+	if (p.Peek() == '@') {
+		p.Skip();
+		while (CATextReader::IsDigit(p.Peek()))
+			fmt.mSampleRate = 10 * fmt.mSampleRate + (p.Next() - '0');
+	}
+	if (p.Peek() == '/') {
+		p.Skip();
+		UInt32 flags = 0;
+		int theDigit;
+		while ((theDigit = HexDigitValue(p.Peek())) >= 0) {
+			flags = (flags << 4) | theDigit;
+			p.Skip();
+		}
+		fmt.mFormatFlags = flags;
+	}
+	if (p.Peek() == '#') {
+		p.Skip();
+		// as FromText always has, this accumulates onto the default of 1 for PCM
+		while (CATextReader::IsDigit(p.Peek()))
+			fmt.mFramesPerPacket = 10 * fmt.mFramesPerPacket + (p.Next() - '0');
+	}
+	if (p.Peek() == ':') {
+		p.Skip();
+		fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsPacked;
+		if (p.Peek() == 'L')
+			fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsAlignedHigh;
+		else if (p.Peek() == 'H')
+			fmt.mFormatFlags |= kLinearPCMFormatFlagIsAlignedHigh;
+		else
+			return ParseFailed(p, ParseError::kSyntax, outError);
+		p.Skip();
+		fmt.mBytesPerFrame = fmt.mBytesPerPacket = p.ReadDecimal();
+	}
+	if (p.Peek() == ',') {
+		p.Skip();
+		UInt32 ch = p.ReadDecimal();
+		fmt.mChannelsPerFrame = ch;
+		if (p.Peek() == 'D') {
+			p.Skip();
+			if (fmt.mFormatID != kAudioFormatLinearPCM)
+				return ParseFailed(p, ParseError::kNonInterleavedNonPCM, outError);
+			fmt.mFormatFlags |= kAudioFormatFlagIsNonInterleaved;
+		} else {
+			if (p.Peek() == 'I') p.Skip();	// default
+			if (fmt.mFormatID == kAudioFormatLinearPCM)
+				fmt.mBytesPerPacket = fmt.mBytesPerFrame *= ch;
+		}
+	}
+	
+	// anything left over is an error
+	if (!p.AtEnd() && (p.Peek() != '\0'))
+		return ParseFailed(p, ParseError::kExtraCharacters, outError);
+	
+	if (outError != NULL) {
+		outError->mKind = ParseError::kNone;
+		outError->mOffset = p.GetOffset();
+	}
+	return true;
+}
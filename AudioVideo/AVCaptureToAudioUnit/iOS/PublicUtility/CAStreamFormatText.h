@@ -0,0 +1,108 @@
+/*
+     File: CAStreamFormatText.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAStreamFormatText_h__)
+#define __CAStreamFormatText_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+#include <stddef.h>
+
+//=============================================================================
+//	CAStreamFormatText
+//
+//	The text forms of an AudioStreamBasicDescription without stdio: Parse reads
+//	the syntax CAStreamBasicDescription::FromText does (see
+//	sTextParsingUsageString) and Format writes exactly what
+//	CAStreamBasicDescription::AsString does. Neither allocates, locks or
+//	prints anything, and Parse doesn't need its text to be null terminated.
+//=============================================================================
+
+struct	CAStreamFormatText
+{
+
+//	Types
+public:
+	//	why Parse gave up, so that FromText can print the same diagnostics it always has
+	struct	ParseError
+	{
+		enum
+		{
+			kNone,
+			kBadFormatID,				//	a 4 character code or \x escape that FromText never complained about
+			kSyntax,
+			kMissingFractionBits,
+			kNonInterleavedNonPCM,
+			kExtraCharacters
+		};
+		
+		UInt32	mKind;
+		size_t	mOffset;				//	where in the text Parse was when it gave up
+	};
+
+//	Operations
+public:
+	//	returns false, leaving outDesc undefined and filling out outError if it isn't NULL, if the text isn't a valid format
+	static bool		Parse(const char* inText, size_t inLength, AudioStreamBasicDescription& outDesc, ParseError* outError = NULL);
+
+	//	writes at most inBufferSize bytes, including the terminating null, and returns the number of
+	//	characters written, not counting the null
+	static UInt32	Format(const AudioStreamBasicDescription& inDesc, char* outBuffer, UInt32 inBufferSize);
+
+	//	what CAStringForOSType writes: 'abcd', or 0x followed by 8 hex digits if any character isn't printable
+	static UInt32	FormatOSType(OSType inType, char* outBuffer, UInt32 inBufferSize);
+
+};
+
+#endif
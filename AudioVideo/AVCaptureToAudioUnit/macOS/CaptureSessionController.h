@@ -58,7 +58,9 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 #import "CAStreamBasicDescription.h"
 #import "CAComponentDescription.h"
 #import "CAAudioBufferList.h"
-#import "AUOutputBL.h"
+#import "CAAudioBufferListPool.h"
+#import "CAAudioRenderDriver.h"
+#import "CASilenceDetector.h"
 
 @interface CaptureSessionController : NSObject <NSWindowDelegate, AVCaptureAudioDataOutputSampleBufferDelegate> {
 	IBOutlet NSWindow			*window;
@@ -73,10 +75,11 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
     ExtAudioFileRef             extAudioFile;
 	
     AudioStreamBasicDescription currentInputASBD;
+    CAAudioBufferListPool       *bufferListPool;
 	AudioBufferList				*currentInputAudioBufferList;
-    AUOutputBL                  *outputBufferList;
+    CAAudioRenderDriver         *renderDriver;
+    CASilenceDetector           *inputSilenceDetector;
 	
-	double						currentSampleTime;
 	BOOL						didSetUpAudioUnits;
 	
 	NSString					*outputFile;
@@ -51,12 +51,23 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 
 #import "CaptureSessionController.h"
 
-static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *inRefCon,
-													AudioUnitRenderActionFlags *ioActionFlags,
-													const AudioTimeStamp       *inTimeStamp,
-													UInt32						inBusNumber,
-													UInt32						inNumberFrames,
-													AudioBufferList            *ioData);
+// The AudioBufferLists used while capturing come from a pool set up front so that nothing is allocated per buffer,
+// each list can hold this many buffers and comes with enough scratch memory for this many frames of Float32 audio
+static const UInt32 kBufferListPoolSize = 2;
+static const UInt32 kBufferListPoolMaxBuffers = 8;
+static const UInt32 kBufferListPoolScratchFrames = 4096;
+
+// The render driver is set up for sample buffers of up to this many frames, so that a device change delivering
+// bigger sample buffers never causes a reallocation (or an exception) in the capture callback
+static const UInt32 kMaxFramesPerSampleBuffer = 16384;
+
+// The effect is rendered in quanta of this many frames rather than once per sample buffer, the processed audio
+// only goes to the recording so we take the fewer larger renders over the latency
+static const UInt32 kRenderQuantumFrames = CAAudioRenderDriver::kRenderQuantum_Throughput;
+
+// The input counts as active once its peak reaches this level, and as silent again once it drops the hysteresis below it
+static const Float32 kInputSilenceThresholdDB = -54.f;
+static const Float32 kInputSilenceHysteresisDB = 6.f;
 
 static void DisplayAlert(NSString *inMessageText)
 {
@@ -204,6 +215,17 @@ static void DisplayAlert(NSString *inMessageText)
     
     NSLog(@"AVCaptureAudioDataOutput Audio Settings: %@", captureAudioDataOutput.audioSettings);
     
+    // Create the AudioBufferList pool used by the audio data output delegate method
+    bufferListPool = new CAAudioBufferListPool;
+    bufferListPool->Allocate(kBufferListPoolSize, kBufferListPoolMaxBuffers, kBufferListPoolScratchFrames * sizeof(Float32));
+    
+    // Create the render driver which collects the captured audio into render quanta and renders the effect with it,
+    // it is set up for the format once the first sample buffer arrives
+    renderDriver = new CAAudioRenderDriver;
+    
+    // Create the detector that tells us when the input goes quiet or comes back, it measures each sample buffer
+    inputSilenceDetector = new CASilenceDetector(kInputSilenceThresholdDB, kInputSilenceHysteresisDB);
+    
     // Create a serial dispatch queue and set it on the AVCaptureAudioDataOutput object
     dispatch_queue_t audioDataOutputQueue = dispatch_queue_create("AudioDataOutputQueue", DISPATCH_QUEUE_SERIAL);
     if (!audioDataOutputQueue){
@@ -222,10 +244,11 @@ static void DisplayAlert(NSString *inMessageText)
 	OSStatus err = AudioComponentInstanceNew(effectAudioUnitComponent, &effectAudioUnit);
 
 	if (noErr == err) {
-		// Set a callback on the effect unit that will supply the audio buffers received from the capture audio data output
+		// Set a callback on the effect unit that will supply the audio buffers received from the capture audio data output,
+		// the render driver hands the effect whatever it is rendering at the time
 		AURenderCallbackStruct renderCallbackStruct;
-		renderCallbackStruct.inputProc = PushCurrentInputBufferIntoAudioUnit;
-		renderCallbackStruct.inputProcRefCon = self;
+		renderCallbackStruct.inputProc = CAAudioRenderDriver::InputCallback;
+		renderCallbackStruct.inputProcRefCon = renderDriver;
 		err = AudioUnitSetProperty(effectAudioUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &renderCallbackStruct, sizeof(renderCallbackStruct));	    
 	}
 	
@@ -282,8 +305,10 @@ static void DisplayAlert(NSString *inMessageText)
 		AudioComponentInstanceDispose(effectAudioUnit);
 	}
     
-    if (currentInputAudioBufferList) free(currentInputAudioBufferList);
-    if (outputBufferList) delete outputBufferList;
+    if (currentInputAudioBufferList) bufferListPool->Release(currentInputAudioBufferList);
+    if (renderDriver) delete renderDriver;
+    if (inputSilenceDetector) delete inputSilenceDetector;
+    if (bufferListPool) delete bufferListPool;
 	
 	[super dealloc];
 }
@@ -324,28 +349,40 @@ static void DisplayAlert(NSString *inMessageText)
         currentInputASBD = *sampleBufferASBD;
         
         if (didSetUpAudioUnits) {
+			// If recording was in progress, the recording needs to be stopped because the audio format changed, but first
+			// the frames the render driver is still holding in the old format are rendered and written to finish it off
+			if (extAudioFile) {
+                renderDriver->Flush();
+                [self renderPushedAudio];
+            }
+			
             // The audio units were previously set up, so they must be uninitialized now
             AudioUnitUninitialize(effectAudioUnit);
 			
-			// If recording was in progress, the recording needs to be stopped because the audio format changed
 			if (extAudioFile) {
                 [self setRecording:NO];
 				err = ExtAudioFileDispose(extAudioFile);
 				extAudioFile = NULL;
                 NSLog(@"Recording Stopped - Audio Format Changed (%ld)", (long)err);
 			}
-            if (outputBufferList) delete outputBufferList;
-            outputBufferList = NULL;
         } else {
             didSetUpAudioUnits = YES;
         }
+        
+        // Set up the render driver for the new format, it renders the effect in kRenderQuantumFrames at a time
+        renderDriver->Initialize(currentInputASBD, kRenderQuantumFrames, kMaxFramesPerSampleBuffer);
+        renderDriver->SetRenderTarget(effectAudioUnit);
+        UInt32 maximumFramesPerSlice = renderDriver->GetMaximumFramesPerRender();
 		
-		// Set the input and output formats of the audio unit to match that of the sample buffer
+		// Set the input and output formats of the audio unit to match that of the sample buffer, and let it render a whole quantum at a time
 		err = AudioUnitSetProperty(effectAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &currentInputASBD, sizeof(currentInputASBD));
 		
 		if (noErr == err)
 			err = AudioUnitSetProperty(effectAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &currentInputASBD, sizeof(currentInputASBD));
 		
+		if (noErr == err)
+			err = AudioUnitSetProperty(effectAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maximumFramesPerSlice, sizeof(maximumFramesPerSlice));
+		
         // Initialize the AU
 		if (noErr == err)
 			err = AudioUnitInitialize(effectAudioUnit);
@@ -386,8 +423,16 @@ static void DisplayAlert(NSString *inMessageText)
 			if (extAudioFile) ExtAudioFileDispose(extAudioFile);
 			extAudioFile = NULL;
             NSLog(@"Failed to setup audio file! (%ld)", (long)err);
-		}
+		} else {
+            // start the recording with nothing captured before it and with its first frame at sample time 0
+            renderDriver->Reset();
+        }
 	} else if (!isRecording && extAudioFile) {
+		// The render driver still holds up to a quantum less a frame waiting for a full quantum, render that as a short
+		// last one and write it, otherwise the end of the recording is lost
+		renderDriver->Flush();
+		[self renderPushedAudio];
+		
 		// Stop recording by disposing of the ExtAudioFile
 		err = ExtAudioFileDispose(extAudioFile);
 		extAudioFile = NULL;
@@ -395,32 +440,15 @@ static void DisplayAlert(NSString *inMessageText)
 	}
     
     CMItemCount numberOfFrames = CMSampleBufferGetNumSamples(sampleBuffer); // corresponds to the number of CoreAudio audio frames
-		
-    // In order to render continuously, the effect audio unit needs a new time stamp for each buffer
-    // Use the number of frames for each unit of time continuously incrementing
-    currentSampleTime += (double)numberOfFrames;
-    
-    AudioTimeStamp timeStamp;
-    memset(&timeStamp, 0, sizeof(AudioTimeStamp));
-    timeStamp.mSampleTime = currentSampleTime;
-    timeStamp.mFlags |= kAudioTimeStampSampleTimeValid;		
-    
-    AudioUnitRenderActionFlags flags = 0;
-    
-    // Create an output AudioBufferList as the destination for the AU rendered audio
-    if (NULL == outputBufferList) {
-        outputBufferList = new AUOutputBL(currentInputASBD, numberOfFrames);
-    }
-    outputBufferList->Prepare(numberOfFrames);
     
     /*
      Get an audio buffer list from the sample buffer and assign it to the currentInputAudioBufferList instance variable.
-     The the audio unit render callback called PushCurrentInputBufferIntoAudioUnit can access this value by calling the
-     currentInputAudioBufferList method.
+     It is pushed into the render driver, which renders the effect with it.
     */
     
     // CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer requires a properly allocated AudioBufferList struct
-    currentInputAudioBufferList = CAAudioBufferList::Create(currentInputASBD.mChannelsPerFrame);
+    currentInputAudioBufferList = bufferListPool->Acquire(currentInputASBD.mChannelsPerFrame);
+    if (NULL == currentInputAudioBufferList) { NSLog(@"Could not get an AudioBufferList for %u channels!", (unsigned int)currentInputASBD.mChannelsPerFrame); return; }
     
     size_t bufferListSizeNeededOut;
     CMBlockBufferRef blockBufferOut = nil;
@@ -435,40 +463,51 @@ static void DisplayAlert(NSString *inMessageText)
                                                                   &blockBufferOut);
     
     if (noErr == err) {
-        // Tell the effect audio unit to render -- This will synchronously call PushCurrentInputBufferIntoAudioUnit, which will
-        // feed currentInputAudioBufferList into the effect audio unit
-        
         // set some parameter values to affect the effect (To Hear What Condition My Condition Was In) 
         AudioUnitSetParameter(effectAudioUnit, kDelayParam_Feedback, kAudioUnitScope_Global, 0, [feedbackValue floatValue], 0);
         AudioUnitSetParameter(effectAudioUnit, kDelayParam_DelayTime, kAudioUnitScope_Global, 0, [delayTimeValue floatValue], 0);
         
-        err = AudioUnitRender(effectAudioUnit, &flags, &timeStamp, 0, numberOfFrames, outputBufferList->ABL());
-        if (err) {
-            NSLog(@"AudioUnitRender failed! (%ld)", (long)err);
+        // measure the input and log when it goes silent or comes back
+        inputSilenceDetector->Analyze(*currentInputAudioBufferList);
+        if (inputSilenceDetector->DidChangeState()) {
+            NSLog(@"Input is %@ (peak %.1f dBFS)", inputSilenceDetector->IsSilent() ? @"silent" : @"active", CASilenceDetector::AmplitudeToDB(inputSilenceDetector->GetMaximumPeak()));
+        }
+        
+        if (renderDriver->Push(*currentInputAudioBufferList, numberOfFrames)) {
+            [self renderPushedAudio];
+        } else {
+            NSLog(@"Could not push %ld frames into the render driver!", (long)numberOfFrames);
         }
         
         CFRelease(blockBufferOut);
-        CAAudioBufferList::Destroy(currentInputAudioBufferList);
-        currentInputAudioBufferList = NULL;
     } else {
         NSLog(@"CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer failed! (%ld)", (long)err);
     }
-
-	if ((noErr == err) && extAudioFile) {
-		err = ExtAudioFileWriteAsync(extAudioFile, numberOfFrames, outputBufferList->ABL());
-        if (err) {
-            NSLog(@"ExtAudioFileWriteAsync failed! (%ld)", (long)err);
-        }
-	}
+    
+    bufferListPool->Release(currentInputAudioBufferList);
+    currentInputAudioBufferList = NULL;
 }
 
 /*
- Used by PushCurrentInputBufferIntoAudioUnit() to access the current audio buffer list
- that has been output by the AVCaptureAudioDataOutput.
+ Renders the effect for every whole quantum the render driver now has, or after a Flush for what is left as well, and writes
+ it to the file when recording -- Each render synchronously calls back into the render driver, which feeds the captured audio
+ into the effect, and is stamped with the sample time of the quantum's first frame. Only ever called on the capture queue.
 */
-- (AudioBufferList *)currentInputAudioBufferList
+- (void)renderPushedAudio
 {
-	return currentInputAudioBufferList;
+    OSStatus err = noErr;
+    UInt32 renderedFrames = 0;
+    while ((noErr == (err = renderDriver->Render(renderedFrames))) && renderedFrames) {
+        if (extAudioFile) {
+            OSStatus writeErr = ExtAudioFileWriteAsync(extAudioFile, renderedFrames, renderDriver->GetOutputBufferList());
+            if (writeErr) {
+                NSLog(@"ExtAudioFileWriteAsync failed! (%ld)", (long)writeErr);
+            }
+        }
+    }
+    if (err) {
+        NSLog(@"AudioUnitRender failed! (%ld)", (long)err);
+    }
 }
 
 #pragma mark ======== Property and action definitions =========
@@ -491,32 +530,3 @@ static void DisplayAlert(NSString *inMessageText)
 }
 
 @end
-
-#pragma mark ======== AudioUnit render callback =========
-
-/*
- Synchronously called by the effect audio unit whenever AudioUnitRender() is called.
- Used to feed the audio samples output by the ATCaptureAudioDataOutput to the AudioUnit.
- */
-static OSStatus PushCurrentInputBufferIntoAudioUnit(void *							inRefCon,
-													AudioUnitRenderActionFlags *	ioActionFlags,
-													const AudioTimeStamp *			inTimeStamp,
-													UInt32							inBusNumber,
-													UInt32							inNumberFrames,
-													AudioBufferList *				ioData)
-{
-	CaptureSessionController *self = (CaptureSessionController *)inRefCon;
-	AudioBufferList *currentInputAudioBufferList = [self currentInputAudioBufferList];
-	UInt32 bufferIndex, bufferCount = currentInputAudioBufferList->mNumberBuffers;
-	
-	if (bufferCount != ioData->mNumberBuffers) return badFormat;
-	
-	// Fill the provided AudioBufferList with the data from the AudioBufferList output by the audio data output
-	for (bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++) {
-		ioData->mBuffers[bufferIndex].mDataByteSize = currentInputAudioBufferList->mBuffers[bufferIndex].mDataByteSize;
-		ioData->mBuffers[bufferIndex].mData = currentInputAudioBufferList->mBuffers[bufferIndex].mData;
-		ioData->mBuffers[bufferIndex].mNumberChannels = currentInputAudioBufferList->mBuffers[bufferIndex].mNumberChannels;
-	}
-	
-	return noErr;
-}
\ No newline at end of file
@@ -48,6 +48,7 @@
 #define __AUOutputBL_h__
 
 #include "CAStreamBasicDescription.h"
+#include "CAAudioBufferListPool.h"
 #if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
 #else
 #endif
@@ -70,6 +71,11 @@ public:
 											// this is the constructor that you use
 											// it can't be reset once you've constructed it
 										AUOutputBL (const CAStreamBasicDescription &inDesc, UInt32 inDefaultNumFrames = 512);
+										
+											// this one takes its buffer list, and its buffer memory while that is
+											// big enough, from the pool instead of the heap. It will throw if the pool is
+											// empty or its lists can't hold enough buffers. The pool must outlive this object
+										AUOutputBL (const CAStreamBasicDescription &inDesc, CAAudioBufferListPool &inPool, UInt32 inDefaultNumFrames = 512);
 										~AUOutputBL();
 
 	void 								Prepare ()
@@ -89,11 +95,31 @@ public:
 								// if you want to dispose previously allocted memory, pass in 0
 								// then you either have an empty buffer list, or you can re-allocate
 								// Memory is kept around if an Allocation request is less than what is currently allocated
+								// Reserved memory is never swapped for heap memory: asking a reserved buffer list for
+								// more than AllocatedFrames() throws kAudioUnitErr_TooManyFramesToProcess instead
 	void								Allocate (UInt32 inNumberFrames);
 	
 	UInt32								AllocatedFrames() const { return mFrames; }
 	
+								// Reserves address space for inMaxNumberFrames frames up front without committing
+								// any memory to it, so that nothing is ever reallocated or copied as the frame count
+								// grows. AllocatedFrames() becomes inMaxNumberFrames, Prepare won't throw for anything
+								// up to that, and the pages are committed as they are first written (Allocate commits
+								// them ahead of time, without moving anything). If inUseHugePages is true and the
+								// system supports them, huge pages are used, which the system may commit all at once.
+								// Returns false, leaving things as they were, if the address space can't be had.
+	bool								Reserve (UInt32 inMaxNumberFrames, bool inUseHugePages = false);
+	
+	bool								IsReserved() const { return mIsReserved; }
+	
 	const CAStreamBasicDescription&		GetFormat() const { return mFormat; }
+	
+								// Changes the format without creating a new AUOutputBL. Allocated memory is kept
+								// (and AllocatedFrames() changes to match) if it holds at least as many frames of the
+								// new format, otherwise it is freed and you need to call Allocate again. Reserved memory
+								// is reserved again if it needs to be, so it still holds the frames Reserve was asked for.
+								// This will throw if the buffer list can't hold the number of buffers the format needs
+	void								SetFormat (const CAStreamBasicDescription &inDesc);
 
 #if DEBUG
 	void								Print();
@@ -101,6 +127,8 @@ public:
 	
 private:
 	UInt32						AllocatedBytes () const { return (mBufferSize * mNumberBuffers); }
+	void						ReleaseMemory ();
+	void						CommitMemory (UInt32 inNumberBytes);
 
 	CAStreamBasicDescription	mFormat;
 	Byte*						mBufferMemory;
@@ -108,6 +136,14 @@ private:
 	UInt32						mNumberBuffers;
 	UInt32						mBufferSize;
 	UInt32						mFrames;
+	UInt32						mMemorySize;
+	UInt32						mBufferListCapacity;	// the number of AudioBuffers mBufferList has room for
+	CAAudioBufferListPool*		mPool;
+	bool						mOwnsBufferMemory;
+	bool						mIsReserved;			// mBufferMemory is a reserved range of mMemorySize bytes
+	UInt32						mCommittedBytes;		// how much of each buffer has been committed in a reserved range
+	UInt32						mReservedFrames;		// what Reserve was asked for, so SetFormat can keep it
+	bool						mReservedHugePages;
 
 // don't want to copy these.. can if you want, but more code to write!
 	AUOutputBL () {}
@@ -49,8 +49,10 @@
 //=============================================================================
 
 #include "CAAudioBufferList.h"
+#include "CAAudioBufferListCopyPlan.h"
 #include "CADebugMacros.h"
 #include "CALogMacros.h"
+#include "CAVectorOps.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -126,10 +128,26 @@ void	CAAudioBufferList::Clear(AudioBufferList& outBufferList)
 	}
 }
 
+void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel, CAAudioBufferListCopyPlan& ioPlan)
+{
+	//  The plan is kept by the caller and only rebuilt when the lists' layouts or the starting channels change, so
+	//  runs of channels turn into memcpys or (de)interleaves without planning the copy on every render cycle.
+	//  This method also assumes that both the source and destination sample formats are Float32
+	if(ioPlan.IsPlannedFor(inSource, inStartingSourceChannel, outDestination, inStartingDestinationChannel) || ioPlan.Plan(inSource, inStartingSourceChannel, outDestination, inStartingDestinationChannel))
+	{
+		ioPlan.Execute(inSource, outDestination);
+		return;
+	}
+	
+	//  too many channels to plan, so copy them one at a time
+	Copy(inSource, inStartingSourceChannel, outDestination, inStartingDestinationChannel);
+}
+
 void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel)
 {
-	//  This is a brute force copy method that can handle ABL's that have different buffer layouts
-	//  This means that this method is probably not the fastest way to do this for all cases.
+	//  This method can handle ABL's that have different buffer layouts. It copies one channel at a time, so it
+	//  needs no plan; callers that copy between the same layouts every cycle should pass a CAAudioBufferListCopyPlan
+	//  they keep around instead, which coalesces the channels into bulk operations.
 	//  This method also assumes that both the source and destination sample formats are Float32
 
 	UInt32 theInputChannel = inStartingSourceChannel;
@@ -145,7 +163,7 @@ void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingS
 	{
 		GetBufferForChannel(inSource, theInputChannel, theInputBufferIndex, theInputBufferChannel);
 		
-		GetBufferForChannel(inSource, theOutputChannel, theOutputBufferIndex, theOutputBufferChannel);
+		GetBufferForChannel(outDestination, theOutputChannel, theOutputBufferIndex, theOutputBufferChannel);
 		
 		CopyChannel(inSource.mBuffers[theInputBufferIndex], theInputBufferChannel, outDestination.mBuffers[theOutputBufferIndex], theOutputBufferChannel);
 		
@@ -156,41 +174,82 @@ void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingS
 
 void	CAAudioBufferList::CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel)
 {
-	//  set up the stuff for the loop
+	//  set up the stuff for the loop; the destination decides how many frames get copied, but never read past the source
 	UInt32 theNumberFramesToCopy = outDestination.mDataByteSize / (outDestination.mNumberChannels * SizeOf32(Float32));
+	UInt32 theNumberSourceFrames = inSource.mDataByteSize / (inSource.mNumberChannels * SizeOf32(Float32));
+	if(theNumberSourceFrames < theNumberFramesToCopy)
+	{
+		theNumberFramesToCopy = theNumberSourceFrames;
+	}
 	const Float32* theSource = static_cast<const Float32*>(inSource.mData);
 	Float32* theDestination = static_cast<Float32*>(outDestination.mData);
 	
-	//  loop through the data and copy the samples
-	while(theNumberFramesToCopy > 0)
+	//  mono to mono is just a block copy
+	if((inSource.mNumberChannels == 1) && (outDestination.mNumberChannels == 1))
 	{
-		//  copy the data
-		theDestination[inDestinationChannel] = theSource[inSourceChannel];
-		
-		//  adjust the pointers
-		--theNumberFramesToCopy;
-		theSource += inSource.mNumberChannels;
-		theDestination += outDestination.mNumberChannels;
+		memcpy(theDestination, theSource, theNumberFramesToCopy * SizeOf32(Float32));
+		return;
 	}
+	
+	CAVectorOps::CopyStrided(theSource + inSourceChannel, inSource.mNumberChannels, theDestination + inDestinationChannel, outDestination.mNumberChannels, theNumberFramesToCopy);
 }
 
 void	CAAudioBufferList::Sum(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList)
 {
-	//	assumes that the buffers are Float32 samples and the listst have the same layout
-	//	this is a lame algorithm, by the way. it could at least be unrolled a couple of times
+	//	assumes that the buffers are Float32 samples and the lists have the same layout
+	for(UInt32 theBufferIndex = 0; theBufferIndex < ioSummedBufferList.mNumberBuffers; ++theBufferIndex)
+	{
+		const Float32* theSourceBuffer = static_cast<const Float32*>(inSourceBufferList.mBuffers[theBufferIndex].mData);
+		Float32* theSummedBuffer = static_cast<Float32*>(ioSummedBufferList.mBuffers[theBufferIndex].mData);
+		UInt32 theNumberSamplesToMix = ioSummedBufferList.mBuffers[theBufferIndex].mDataByteSize / SizeOf32(Float32);
+		if((theSourceBuffer != NULL) && (theSummedBuffer != NULL) && (theNumberSamplesToMix > 0))
+		{
+			CAVectorOps::Accumulate(theSourceBuffer, theSummedBuffer, theNumberSamplesToMix);
+		}
+	}
+}
+
+void	CAAudioBufferList::Sum(const AudioBufferList& inSourceBufferList, Float32 inGain, AudioBufferList& ioSummedBufferList)
+{
+	//	assumes that the buffers are Float32 samples and the lists have the same layout
 	for(UInt32 theBufferIndex = 0; theBufferIndex < ioSummedBufferList.mNumberBuffers; ++theBufferIndex)
 	{
-		Float32* theSourceBuffer = static_cast<Float32*>(inSourceBufferList.mBuffers[theBufferIndex].mData);
+		const Float32* theSourceBuffer = static_cast<const Float32*>(inSourceBufferList.mBuffers[theBufferIndex].mData);
 		Float32* theSummedBuffer = static_cast<Float32*>(ioSummedBufferList.mBuffers[theBufferIndex].mData);
 		UInt32 theNumberSamplesToMix = ioSummedBufferList.mBuffers[theBufferIndex].mDataByteSize / SizeOf32(Float32);
 		if((theSourceBuffer != NULL) && (theSummedBuffer != NULL) && (theNumberSamplesToMix > 0))
 		{
-			while(theNumberSamplesToMix > 0)
+			CAVectorOps::AccumulateScaled(theSourceBuffer, inGain, theSummedBuffer, theNumberSamplesToMix);
+		}
+	}
+}
+
+void	CAAudioBufferList::Sum(const AudioBufferList* const inSourceBufferLists[], const Float32 inGains[], UInt32 inNumberSources, AudioBufferList& ioSummedBufferList)
+{
+	//	assumes that the buffers are Float32 samples and that every source has the same layout as the summed list
+	//	inGains may be NULL, in which case every source is summed at unity gain
+	//	the sources are fanned in kMaxSourcesPerMixPass at a time, so the summed buffers are only
+	//	read and written once per pass instead of once per source
+	const Float32* theSourceBuffers[kMaxSourcesPerMixPass];
+	for(UInt32 theBufferIndex = 0; theBufferIndex < ioSummedBufferList.mNumberBuffers; ++theBufferIndex)
+	{
+		Float32* theSummedBuffer = static_cast<Float32*>(ioSummedBufferList.mBuffers[theBufferIndex].mData);
+		UInt32 theNumberSamplesToMix = ioSummedBufferList.mBuffers[theBufferIndex].mDataByteSize / SizeOf32(Float32);
+		if((theSummedBuffer != NULL) && (theNumberSamplesToMix > 0))
+		{
+			for(UInt32 theFirstSource = 0; theFirstSource < inNumberSources; theFirstSource += kMaxSourcesPerMixPass)
 			{
-				*theSummedBuffer += *theSourceBuffer;
-				++theSummedBuffer;
-				++theSourceBuffer;
-				--theNumberSamplesToMix;
+				UInt32 theNumberSourcesInPass = inNumberSources - theFirstSource;
+				if(theNumberSourcesInPass > kMaxSourcesPerMixPass)
+				{
+					theNumberSourcesInPass = kMaxSourcesPerMixPass;
+				}
+				for(UInt32 theSourceIndex = 0; theSourceIndex < theNumberSourcesInPass; ++theSourceIndex)
+				{
+					const AudioBufferList* theSource = inSourceBufferLists[theFirstSource + theSourceIndex];
+					theSourceBuffers[theSourceIndex] = ((theSource != NULL) && (theBufferIndex < theSource->mNumberBuffers)) ? static_cast<const Float32*>(theSource->mBuffers[theBufferIndex].mData) : NULL;
+				}
+				CAVectorOps::MixSources(theSourceBuffers, (inGains != NULL) ? inGains + theFirstSource : NULL, theNumberSourcesInPass, theSummedBuffer, theNumberSamplesToMix, true);
 			}
 		}
 	}
@@ -203,12 +262,9 @@ bool	CAAudioBufferList::HasData(AudioBufferList& inBufferList)
 	{
 		if(inBufferList.mBuffers[theBufferIndex].mData != NULL)
 		{
-			UInt32* theBuffer = (UInt32*)inBufferList.mBuffers[theBufferIndex].mData;
+			const UInt32* theBuffer = static_cast<const UInt32*>(inBufferList.mBuffers[theBufferIndex].mData);
 			UInt32 theNumberSamples = inBufferList.mBuffers[theBufferIndex].mDataByteSize / SizeOf32(UInt32);
-			for(UInt32 theSampleIndex = 0; !hasData && (theSampleIndex < theNumberSamples); ++theSampleIndex)
-			{
-				hasData = theBuffer[theSampleIndex] != 0;
-			}
+			hasData = CAVectorOps::HasNonZeroWord(theBuffer, theNumberSamples);
 		}
 	}
 	return hasData;
@@ -63,6 +63,7 @@
 //=============================================================================
 
 typedef AudioBufferList*	AudioBufferListPtr;
+class	CAAudioBufferListCopyPlan;
 
 //=============================================================================
 //	CAAudioBufferList
@@ -83,9 +84,12 @@ public:
 	static bool				GetBufferForChannel(const AudioBufferList& inBufferList, UInt32 inChannel, UInt32& outBufferNumber, UInt32& outBufferChannel);
 	static void				Clear(AudioBufferList& outBufferList);
 	static void				Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel);
+	static void				Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel, CAAudioBufferListCopyPlan& ioPlan);	//	replans only when the layouts change
 	static void				CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel);
 	static void				Sum(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList);
-	static bool				HasData(AudioBufferList& inBufferList);
+	static void				Sum(const AudioBufferList& inSourceBufferList, Float32 inGain, AudioBufferList& ioSummedBufferList);
+	static void				Sum(const AudioBufferList* const inSourceBufferLists[], const Float32 inGains[], UInt32 inNumberSources, AudioBufferList& ioSummedBufferList);
+	static bool				HasData(AudioBufferList& inBufferList);	//	any bit set at all; see CASilenceDetector for whether it is audible
 #if	CoreAudio_Debug
 	static void				PrintToLog(const AudioBufferList& inBufferList);
 #endif
@@ -93,6 +97,7 @@ public:
 //  Constants
 public:
 	static AudioBufferList  sEmptyBufferList;
+	enum { kMaxSourcesPerMixPass = 64 };
 
 };
 
@@ -0,0 +1,147 @@
+/*
+     File: CAAudioBufferListCopyPlan.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAAudioBufferListCopyPlan_h__)
+#define __CAAudioBufferListCopyPlan_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+
+//=============================================================================
+//	CAAudioBufferListCopyPlan
+//
+//	Works out once how the channels of one Float32 AudioBufferList layout map
+//	onto another, and reduces that mapping to as few bulk operations as it can:
+//	whole buffer memcpys, interleaves, deinterleaves, and only then single
+//	channel strided copies. The plan only holds buffer and channel indices, so
+//	it can be built when the formats are known and executed on every render
+//	cycle against any lists that have the same layouts. A plan is about 5KB,
+//	so keep one around rather than building it on the stack every cycle.
+//	Neither Plan nor Execute allocates memory.
+//=============================================================================
+
+class	CAAudioBufferListCopyPlan
+{
+
+//	Constants
+public:
+	enum	{ kMaxSteps = 128 };
+
+//	Construction/Destruction
+public:
+						CAAudioBufferListCopyPlan() : mNumberSteps(0), mIsChannelForChannel(false) {}
+
+//	Planning
+public:
+	//	plans the same copy as CAAudioBufferList::Copy, channel for channel starting at the given channels
+	bool				Plan(const AudioBufferList& inSourceLayout, UInt32 inStartingSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inStartingDestinationChannel);
+
+	//	plans a routed copy where inChannelMap[destination channel] is the source channel to copy from,
+	//	or -1 to fill that destination channel with silence (the same convention as kAudioConverterChannelMap)
+	bool				Plan(const AudioBufferList& inSourceLayout, const AudioBufferList& inDestinationLayout, const SInt32 inChannelMap[], UInt32 inChannelMapSize);
+
+	void				Reset() { mNumberSteps = 0; mIsChannelForChannel = false; }
+	UInt32				GetNumberSteps() const { return mNumberSteps; }
+
+	//	true if the channel for channel Plan built this plan for lists with these layouts and starting channels
+	bool				IsPlannedFor(const AudioBufferList& inSourceLayout, UInt32 inStartingSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inStartingDestinationChannel) const;
+
+//	Execution
+public:
+	//	returns false, having copied nothing, if the lists do not have the layouts the plan was built for
+	bool				Execute(const AudioBufferList& inSource, AudioBufferList& outDestination) const;
+
+//	Implementation
+private:
+	enum	StepKind
+			{
+				kStep_Bulk,				//	mNumberChannels channels, all of both buffers, in order
+				kStep_Interleave,		//	mNumberChannels mono source buffers into consecutive destination channels
+				kStep_Deinterleave,		//	consecutive source channels into mNumberChannels mono destination buffers
+				kStep_Strided,			//	one channel
+				kStep_Silence			//	one destination channel filled with zeros
+			};
+
+	struct	Step
+	{
+		UInt32	mKind;
+		UInt32	mNumberChannels;
+		UInt32	mSourceBuffer;
+		UInt32	mSourceChannel;
+		UInt32	mSourceBufferChannels;
+		UInt32	mDestinationBuffer;
+		UInt32	mDestinationChannel;
+		UInt32	mDestinationBufferChannels;
+	};
+
+	bool				AddChannel(const AudioBufferList& inSourceLayout, SInt32 inSourceChannel, const AudioBufferList& inDestinationLayout, UInt32 inDestinationChannel);
+	void				Coalesce();
+	bool				ValidateLayouts(const AudioBufferList& inSource, const AudioBufferList& inDestination) const;
+	static bool			SameLayout(const AudioBufferList& inLayout, const UInt16 inBufferChannels[]);
+
+	Step				mSteps[kMaxSteps];
+	UInt32				mNumberSteps;
+	UInt32				mSourceNumberBuffers;
+	UInt32				mDestinationNumberBuffers;
+	
+	//	what the channel for channel Plan was given, so a caller's plan is only rebuilt when they change
+	bool				mIsChannelForChannel;
+	UInt32				mStartingSourceChannel;
+	UInt32				mStartingDestinationChannel;
+	UInt16				mSourceBufferChannels[kMaxSteps];
+	UInt16				mDestinationBufferChannels[kMaxSteps];
+
+};
+
+#endif
@@ -0,0 +1,488 @@
+/*
+     File: CAPCMConverter.cpp 
+ Abstract:  CAPCMConverter.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAPCMConverter.h"
+#include "CAStaticStreamFormat.h"
+#include "CAVectorOps.h"
+#include <math.h>
+#include <string.h>
+
+//=============================================================================
+//	Sample access
+//=============================================================================
+
+namespace
+{
+	template <class Format> struct StaticCopy : CAStaticFormatKernels<Format>::CopyKernel {};
+
+	//	the number of samples converted through the intermediate block at a time
+	enum { kBlockSamples = 256 };
+
+	inline UInt32	ReadWord(const Byte* inSource, UInt32 inWordBytes, bool inIsBigEndian)
+	{
+		UInt32 theWord = 0;
+		if(inIsBigEndian)
+		{
+			for(UInt32 theByte = 0; theByte < inWordBytes; ++theByte)
+			{
+				theWord = (theWord << 8) | inSource[theByte];
+			}
+		}
+		else
+		{
+			for(UInt32 theByte = inWordBytes; theByte > 0; --theByte)
+			{
+				theWord = (theWord << 8) | inSource[theByte - 1];
+			}
+		}
+		return theWord;
+	}
+	
+	inline void	WriteWord(UInt32 inWord, Byte* outDestination, UInt32 inWordBytes, bool inIsBigEndian)
+	{
+		if(inIsBigEndian)
+		{
+			for(UInt32 theByte = inWordBytes; theByte > 0; --theByte)
+			{
+				outDestination[theByte - 1] = static_cast<Byte>(inWord);
+				inWord >>= 8;
+			}
+		}
+		else
+		{
+			for(UInt32 theByte = 0; theByte < inWordBytes; ++theByte)
+			{
+				outDestination[theByte] = static_cast<Byte>(inWord);
+				inWord >>= 8;
+			}
+		}
+	}
+	
+	inline void	SwapBytes(Byte* ioBytes, UInt32 inNumberBytes)
+	{
+		for(UInt32 theLow = 0, theHigh = inNumberBytes - 1; theLow < theHigh; ++theLow, --theHigh)
+		{
+			Byte theByte = ioBytes[theLow];
+			ioBytes[theLow] = ioBytes[theHigh];
+			ioBytes[theHigh] = theByte;
+		}
+	}
+	
+	template <typename T>
+	void	DecodeSamples(const CAPCMConverter::SampleFormat& inFormat, const Byte* inSource, UInt32 inSourceStride, T* outSamples, UInt32 inNumberSamples)
+	{
+		switch(inFormat.mKind)
+		{
+			case CAPCMConverter::kSampleKind_Float32:
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, inSource += inSourceStride)
+				{
+					Float32 theValue;
+					memcpy(&theValue, inSource, sizeof(theValue));
+					if(inFormat.mIsSwapped)
+					{
+						SwapBytes(reinterpret_cast<Byte*>(&theValue), sizeof(theValue));
+					}
+					outSamples[theIndex] = static_cast<T>(theValue);
+				}
+				break;
+			
+			case CAPCMConverter::kSampleKind_Float64:
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, inSource += inSourceStride)
+				{
+					Float64 theValue;
+					memcpy(&theValue, inSource, sizeof(theValue));
+					if(inFormat.mIsSwapped)
+					{
+						SwapBytes(reinterpret_cast<Byte*>(&theValue), sizeof(theValue));
+					}
+					outSamples[theIndex] = static_cast<T>(theValue);
+				}
+				break;
+			
+			default:
+			{
+				//	move the significant bits to the top of an SInt32, dropping any padding below them
+				UInt32 theMask = (inFormat.mValidBits < 32) ? ~((1U << (32 - inFormat.mValidBits)) - 1) : ~0U;
+				UInt32 theSignFlip = inFormat.mIsSigned ? 0 : 0x80000000U;
+				T theScale = static_cast<T>(inFormat.mDecodeScale);
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, inSource += inSourceStride)
+				{
+					UInt32 theWord = ReadWord(inSource, inFormat.mWordBytes, inFormat.mIsBigEndian);
+					SInt32 theValue = static_cast<SInt32>(((theWord << inFormat.mWordShift) & theMask) ^ theSignFlip);
+					outSamples[theIndex] = static_cast<T>(theValue) * theScale;
+				}
+				break;
+			}
+		}
+	}
+	
+	template <typename T>
+	void	EncodeSamples(const CAPCMConverter::SampleFormat& inFormat, const T* inSamples, Byte* outDestination, UInt32 inDestinationStride, UInt32 inNumberSamples)
+	{
+		switch(inFormat.mKind)
+		{
+			case CAPCMConverter::kSampleKind_Float32:
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, outDestination += inDestinationStride)
+				{
+					Float32 theValue = static_cast<Float32>(inSamples[theIndex]);
+					if(inFormat.mIsSwapped)
+					{
+						SwapBytes(reinterpret_cast<Byte*>(&theValue), sizeof(theValue));
+					}
+					memcpy(outDestination, &theValue, sizeof(theValue));
+				}
+				break;
+			
+			case CAPCMConverter::kSampleKind_Float64:
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, outDestination += inDestinationStride)
+				{
+					Float64 theValue = static_cast<Float64>(inSamples[theIndex]);
+					if(inFormat.mIsSwapped)
+					{
+						SwapBytes(reinterpret_cast<Byte*>(&theValue), sizeof(theValue));
+					}
+					memcpy(outDestination, &theValue, sizeof(theValue));
+				}
+				break;
+			
+			default:
+			{
+				//	round to the format's own precision and saturate, then shift back down into the word
+				Float64 theMaximum = ldexp(1.0, static_cast<int>(inFormat.mValidBits) - 1) - 1.0;
+				Float64 theMinimum = -theMaximum - 1.0;
+				UInt32 theTopShift = 32 - inFormat.mValidBits;
+				UInt32 theSignFlip = inFormat.mIsSigned ? 0 : 0x80000000U;
+				for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, outDestination += inDestinationStride)
+				{
+					Float64 theValue = rint(static_cast<Float64>(inSamples[theIndex]) * inFormat.mEncodeScale);
+					theValue = (theValue > theMaximum) ? theMaximum : ((theValue < theMinimum) ? theMinimum : theValue);
+					UInt32 theTop = (static_cast<UInt32>(static_cast<SInt32>(theValue)) << theTopShift) ^ theSignFlip;
+					UInt32 theWord = inFormat.mIsSigned ? static_cast<UInt32>(static_cast<SInt32>(theTop) >> inFormat.mWordShift) : (theTop >> inFormat.mWordShift);
+					WriteWord(theWord, outDestination, inFormat.mWordBytes, inFormat.mIsBigEndian);
+				}
+				break;
+			}
+		}
+	}
+}
+
+//=============================================================================
+//	CAPCMConverter
+//=============================================================================
+
+bool	CAPCMConverter::GetSampleFormat(const CAStreamBasicDescription& inFormat, SampleFormat& outSampleFormat)
+{
+	if(!inFormat.IsPCM() || (inFormat.mFramesPerPacket != 1) || (inFormat.mChannelsPerFrame == 0) || (inFormat.mBytesPerFrame == 0) || (inFormat.mBytesPerFrame != inFormat.mBytesPerPacket))
+	{
+		return false;
+	}
+	
+	UInt32 theWordBytes = inFormat.SampleWordSize();
+	if((theWordBytes * inFormat.NumberInterleavedChannels()) != inFormat.mBytesPerFrame)
+	{
+		return false;
+	}
+	
+	memset(&outSampleFormat, 0, sizeof(outSampleFormat));
+	outSampleFormat.mWordBytes = theWordBytes;
+	outSampleFormat.mValidBits = inFormat.mBitsPerChannel;
+	outSampleFormat.mIsBigEndian = (inFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0;
+	outSampleFormat.mIsSwapped = !inFormat.IsNativeEndian() && (theWordBytes > 1);
+	
+	if(inFormat.IsFloat())
+	{
+		if((inFormat.mBitsPerChannel == 32) && (theWordBytes == 4))
+		{
+			outSampleFormat.mKind = kSampleKind_Float32;
+		}
+		else if((inFormat.mBitsPerChannel == 64) && (theWordBytes == 8))
+		{
+			outSampleFormat.mKind = kSampleKind_Float64;
+		}
+		else
+		{
+			return false;
+		}
+		outSampleFormat.mIsSigned = true;
+		return true;
+	}
+	
+	if((theWordBytes < 1) || (theWordBytes > 4) || (inFormat.mBitsPerChannel < 2) || (inFormat.mBitsPerChannel > (8 * theWordBytes)))
+	{
+		return false;
+	}
+	
+	outSampleFormat.mKind = kSampleKind_Integer;
+	outSampleFormat.mIsSigned = inFormat.IsSignedInteger();
+	if(inFormat.mFormatFlags & kAudioFormatFlagIsAlignedHigh)
+	{
+		outSampleFormat.mWordShift = 32 - (8 * theWordBytes);
+	}
+	else
+	{
+		outSampleFormat.mWordShift = 32 - inFormat.mBitsPerChannel;
+	}
+	
+	UInt32 theFractionBits = (inFormat.mFormatFlags & kLinearPCMFormatFlagsSampleFractionMask) >> kLinearPCMFormatFlagsSampleFractionShift;
+	outSampleFormat.mFractionBits = (theFractionBits != 0) ? theFractionBits : (inFormat.mBitsPerChannel - 1);
+	outSampleFormat.mDecodeScale = ldexp(1.0, -static_cast<int>(outSampleFormat.mFractionBits + 32 - inFormat.mBitsPerChannel));
+	outSampleFormat.mEncodeScale = ldexp(1.0, static_cast<int>(outSampleFormat.mFractionBits));
+	return true;
+}
+
+bool	CAPCMConverter::CanConvert(const CAStreamBasicDescription& inSourceFormat, const CAStreamBasicDescription& inDestinationFormat)
+{
+	SampleFormat theSourceSampleFormat;
+	SampleFormat theDestinationSampleFormat;
+	return GetSampleFormat(inSourceFormat, theSourceSampleFormat) && GetSampleFormat(inDestinationFormat, theDestinationSampleFormat)
+			&& (inSourceFormat.NumberChannels() == inDestinationFormat.NumberChannels())
+			&& ((inSourceFormat.mSampleRate == inDestinationFormat.mSampleRate) || (inSourceFormat.mSampleRate == 0) || (inDestinationFormat.mSampleRate == 0));
+}
+
+OSStatus	CAPCMConverter::Initialize(const CAStreamBasicDescription& inSourceFormat, const CAStreamBasicDescription& inDestinationFormat)
+{
+	mIsInitialized = false;
+	
+	if(!GetSampleFormat(inSourceFormat, mSourceSampleFormat) || !GetSampleFormat(inDestinationFormat, mDestinationSampleFormat))
+	{
+		return kAudio_UnimplementedError;
+	}
+	if(!CanConvert(inSourceFormat, inDestinationFormat))
+	{
+		return kAudio_ParamError;
+	}
+	
+	mSourceFormat = inSourceFormat;
+	mDestinationFormat = inDestinationFormat;
+	
+	const SampleFormat& theSource = mSourceSampleFormat;
+	const SampleFormat& theDestination = mDestinationSampleFormat;
+	bool theSourceIsNativeInt16 = (theSource.mKind == kSampleKind_Integer) && theSource.mIsSigned && !theSource.mIsSwapped && (theSource.mWordBytes == 2) && (theSource.mValidBits == 16) && (theSource.mFractionBits == 15);
+	bool theDestinationIsNativeInt16 = (theDestination.mKind == kSampleKind_Integer) && theDestination.mIsSigned && !theDestination.mIsSwapped && (theDestination.mWordBytes == 2) && (theDestination.mValidBits == 16) && (theDestination.mFractionBits == 15);
+	bool theSourceIsNativeInt32 = (theSource.mKind == kSampleKind_Integer) && theSource.mIsSigned && !theSource.mIsSwapped && (theSource.mWordBytes == 4) && (theSource.mValidBits == 32);
+	bool theSourceIsNativeFloat32 = (theSource.mKind == kSampleKind_Float32) && !theSource.mIsSwapped;
+	bool theDestinationIsNativeFloat32 = (theDestination.mKind == kSampleKind_Float32) && !theDestination.mIsSwapped;
+	
+	if(memcmp(&theSource, &theDestination, sizeof(SampleFormat)) == 0)
+	{
+		mFastPath = kFastPath_Copy;
+	}
+	else if(theSourceIsNativeInt16 && theDestinationIsNativeFloat32)
+	{
+		mFastPath = kFastPath_Int16ToFloat32;
+	}
+	else if(theSourceIsNativeFloat32 && theDestinationIsNativeInt16)
+	{
+		mFastPath = kFastPath_Float32ToInt16;
+	}
+	else if(theSourceIsNativeInt32 && theDestinationIsNativeFloat32)
+	{
+		mFastPath = kFastPath_Int32ToFloat32;
+	}
+	else
+	{
+		mFastPath = kFastPath_None;
+	}
+	
+	//	Float32 only carries 24 bits, so anything wider goes through Float64
+	mUseFloat64 = (theSource.mKind == kSampleKind_Float64) || (theDestination.mKind == kSampleKind_Float64)
+					|| ((theSource.mKind == kSampleKind_Integer) && (theSource.mValidBits > 24))
+					|| ((theDestination.mKind == kSampleKind_Integer) && (theDestination.mValidBits > 24));
+	
+	//	a copy or conversion between common formats in the same layout is one contiguous run per buffer, which memcpy
+	//	and the CAVectorOps kernels already do well; everything else between them gets a kernel built for the pair
+	bool theLayoutsMatch = (mSourceFormat.IsInterleaved() == mDestinationFormat.IsInterleaved()) || (mSourceFormat.NumberChannels() == 1);
+	if((mFastPath == kFastPath_Copy) && theLayoutsMatch)
+	{
+		mStaticKernel = CAStaticStreamFormatDispatcher::Resolve<StaticCopy, StaticKernel>(mSourceFormat);
+	}
+	else if((mFastPath == kFastPath_None) || !theLayoutsMatch)
+	{
+		mStaticKernel = CAStaticStreamFormatDispatcher::ResolvePair<CAStaticConvertKernel, StaticKernel>(mSourceFormat, mDestinationFormat);
+	}
+	else
+	{
+		mStaticKernel = NULL;
+	}
+	
+	mIsInitialized = true;
+	return noErr;
+}
+
+OSStatus	CAPCMConverter::Convert(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames) const
+{
+	if(!mIsInitialized || (inSource.mNumberBuffers != mSourceFormat.NumberChannelStreams()) || (ioDestination.mNumberBuffers != mDestinationFormat.NumberChannelStreams()))
+	{
+		return kAudio_ParamError;
+	}
+	
+	UInt32 theSourceBytes = mSourceFormat.FramesToBytes(inNumberFrames);
+	for(UInt32 theBufferIndex = 0; theBufferIndex < inSource.mNumberBuffers; ++theBufferIndex)
+	{
+		if((inSource.mBuffers[theBufferIndex].mData == NULL) || (inSource.mBuffers[theBufferIndex].mDataByteSize < theSourceBytes))
+		{
+			return kAudio_ParamError;
+		}
+	}
+	UInt32 theDestinationBytes = mDestinationFormat.FramesToBytes(inNumberFrames);
+	for(UInt32 theBufferIndex = 0; theBufferIndex < ioDestination.mNumberBuffers; ++theBufferIndex)
+	{
+		if((ioDestination.mBuffers[theBufferIndex].mData == NULL) || (ioDestination.mBuffers[theBufferIndex].mDataByteSize < theDestinationBytes))
+		{
+			return kAudio_ParamError;
+		}
+		ioDestination.mBuffers[theBufferIndex].mDataByteSize = theDestinationBytes;
+	}
+	
+	if(mStaticKernel != NULL)
+	{
+		(*mStaticKernel)(inSource, ioDestination, inNumberFrames);
+		return noErr;
+	}
+	
+	UInt32 theSourceWord = mSourceSampleFormat.mWordBytes;
+	UInt32 theDestinationWord = mDestinationSampleFormat.mWordBytes;
+	if(mSourceFormat.IsInterleaved() && mDestinationFormat.IsInterleaved())
+	{
+		//	the same channel order on both sides, so the whole buffer is one run of samples
+		ConvertSamples(static_cast<const Byte*>(inSource.mBuffers[0].mData), theSourceWord, static_cast<Byte*>(ioDestination.mBuffers[0].mData), theDestinationWord, inNumberFrames * mSourceFormat.NumberChannels());
+	}
+	else
+	{
+		for(UInt32 theChannel = 0; theChannel < mSourceFormat.NumberChannels(); ++theChannel)
+		{
+			const Byte* theSource;
+			UInt32 theSourceStride;
+			if(mSourceFormat.IsInterleaved())
+			{
+				theSource = static_cast<const Byte*>(inSource.mBuffers[0].mData) + (theChannel * theSourceWord);
+				theSourceStride = mSourceFormat.mBytesPerFrame;
+			}
+			else
+			{
+				theSource = static_cast<const Byte*>(inSource.mBuffers[theChannel].mData);
+				theSourceStride = theSourceWord;
+			}
+			
+			Byte* theDestination;
+			UInt32 theDestinationStride;
+			if(mDestinationFormat.IsInterleaved())
+			{
+				theDestination = static_cast<Byte*>(ioDestination.mBuffers[0].mData) + (theChannel * theDestinationWord);
+				theDestinationStride = mDestinationFormat.mBytesPerFrame;
+			}
+			else
+			{
+				theDestination = static_cast<Byte*>(ioDestination.mBuffers[theChannel].mData);
+				theDestinationStride = theDestinationWord;
+			}
+			
+			ConvertSamples(theSource, theSourceStride, theDestination, theDestinationStride, inNumberFrames);
+		}
+	}
+	return noErr;
+}
+
+void	CAPCMConverter::ConvertSamples(const Byte* inSource, UInt32 inSourceStride, Byte* outDestination, UInt32 inDestinationStride, UInt32 inNumberSamples) const
+{
+	bool theRunsAreContiguous = (inSourceStride == mSourceSampleFormat.mWordBytes) && (inDestinationStride == mDestinationSampleFormat.mWordBytes);
+	if(mFastPath == kFastPath_Copy)
+	{
+		if(theRunsAreContiguous)
+		{
+			memcpy(outDestination, inSource, inNumberSamples * mSourceSampleFormat.mWordBytes);
+		}
+		else
+		{
+			for(UInt32 theIndex = 0; theIndex < inNumberSamples; ++theIndex, inSource += inSourceStride, outDestination += inDestinationStride)
+			{
+				memcpy(outDestination, inSource, mSourceSampleFormat.mWordBytes);
+			}
+		}
+		return;
+	}
+	
+	if(theRunsAreContiguous && (mFastPath != kFastPath_None))
+	{
+		switch(mFastPath)
+		{
+			case kFastPath_Int16ToFloat32:
+				CAVectorOps::Int16ToFloat32(reinterpret_cast<const SInt16*>(inSource), reinterpret_cast<Float32*>(outDestination), inNumberSamples);
+				return;
+			case kFastPath_Float32ToInt16:
+				CAVectorOps::Float32ToInt16(reinterpret_cast<const Float32*>(inSource), reinterpret_cast<SInt16*>(outDestination), inNumberSamples);
+				return;
+			case kFastPath_Int32ToFloat32:
+				CAVectorOps::Int32ToFloat32(reinterpret_cast<const SInt32*>(inSource), static_cast<Float32>(mSourceSampleFormat.mDecodeScale), reinterpret_cast<Float32*>(outDestination), inNumberSamples);
+				return;
+		}
+	}
+	
+	//	everything else decodes a block at a time into an intermediate buffer on the stack and encodes from there
+	while(inNumberSamples > 0)
+	{
+		UInt32 theNumberSamples = (inNumberSamples < static_cast<UInt32>(kBlockSamples)) ? inNumberSamples : static_cast<UInt32>(kBlockSamples);
+		if(mUseFloat64)
+		{
+			Float64 theBlock[kBlockSamples];
+			DecodeSamples(mSourceSampleFormat, inSource, inSourceStride, theBlock, theNumberSamples);
+			EncodeSamples(mDestinationSampleFormat, theBlock, outDestination, inDestinationStride, theNumberSamples);
+		}
+		else
+		{
+			Float32 theBlock[kBlockSamples];
+			DecodeSamples(mSourceSampleFormat, inSource, inSourceStride, theBlock, theNumberSamples);
+			EncodeSamples(mDestinationSampleFormat, theBlock, outDestination, inDestinationStride, theNumberSamples);
+		}
+		inSource += theNumberSamples * inSourceStride;
+		outDestination += theNumberSamples * inDestinationStride;
+		inNumberSamples -= theNumberSamples;
+	}
+}
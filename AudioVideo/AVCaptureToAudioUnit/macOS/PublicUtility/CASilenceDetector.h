@@ -0,0 +1,129 @@
+/*
+     File: CASilenceDetector.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CASilenceDetector_h__)
+#define __CASilenceDetector_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+
+//=============================================================================
+//	CASilenceDetector
+//
+//	Decides whether native Float32 audio is silent, and measures the peak and
+//	RMS level of each channel while it's at it, in one pass over the samples.
+//
+//	The signal is considered present once the peak of any channel reaches the
+//	threshold, and silent again once every channel has dropped the hysteresis
+//	below it, so a signal hovering around the threshold doesn't chatter.
+//	Analyze doesn't allocate or lock and can be called from a render callback.
+//=============================================================================
+
+class	CASilenceDetector
+{
+
+//	Construction/Destruction
+public:
+	//	a negative hysteresis is taken as 0
+						CASilenceDetector(Float32 inThresholdDB = -60.f, Float32 inHysteresisDB = 6.f);
+
+//	Settings
+public:
+	Float32				GetThreshold() const { return mThresholdDB; }
+	void				SetThreshold(Float32 inThresholdDB);
+	Float32				GetHysteresis() const { return mHysteresisDB; }
+	void				SetHysteresis(Float32 inHysteresisDB);
+
+//	Operations
+public:
+	//	measures every channel of every buffer of inBufferList, using the whole of each buffer, and
+	//	returns IsSilent(). Channels past kMaxChannels are ignored.
+	bool				Analyze(const AudioBufferList& inBufferList);
+
+	//	forgets the levels and goes back to silent
+	void				Reset();
+
+//	Results of the last Analyze
+public:
+	bool				IsSilent() const { return mIsSilent; }
+	bool				DidChangeState() const { return mDidChangeState; }
+	UInt32				GetNumberChannels() const { return mNumberChannels; }
+	Float32				GetPeak(UInt32 inChannel) const { return (inChannel < mNumberChannels) ? mPeaks[inChannel] : 0.f; }
+	Float32				GetRMS(UInt32 inChannel) const { return (inChannel < mNumberChannels) ? mRMS[inChannel] : 0.f; }
+	Float32				GetPeakDB(UInt32 inChannel) const { return AmplitudeToDB(GetPeak(inChannel)); }
+	Float32				GetRMSDB(UInt32 inChannel) const { return AmplitudeToDB(GetRMS(inChannel)); }
+	Float32				GetMaximumPeak() const;
+
+	static Float32		AmplitudeToDB(Float32 inAmplitude);
+	static Float32		DBToAmplitude(Float32 inDB);
+
+//  Constants
+public:
+	enum { kMaxChannels = 64 };
+	static const Float32	kMinimumDB;		//	what AmplitudeToDB returns for silence
+
+//	Implementation
+private:
+	Float32				mThresholdDB;
+	Float32				mHysteresisDB;
+	Float32				mOpenLevel;			//	linear peak at which the signal is present
+	Float32				mCloseLevel;		//	linear peak below which it is silent again
+	bool				mIsSilent;
+	bool				mDidChangeState;
+	UInt32				mNumberChannels;
+	Float32				mPeaks[kMaxChannels];
+	Float32				mRMS[kMaxChannels];
+};
+
+#endif
@@ -0,0 +1,401 @@
+/*
+     File: CAStaticStreamFormat.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAStaticStreamFormat_h__)
+#define __CAStaticStreamFormat_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "CAStreamBasicDescription.h"
+#include <math.h>
+#include <string.h>
+
+//=============================================================================
+//	CAStaticSampleTraits
+//
+//	What an AudioStreamBasicDescription says about each of the sample types
+//	CAStreamBasicDescription calls common PCM formats, and how a sample of each
+//	maps to a value where full scale is 1. SInt32 stands for the 8.24 fixed
+//	point AudioUnitSampleType, as it does for kPCMFormatFixed824. FromValue
+//	rounds to nearest, saturates, and turns NaN into 0, as CAPCMConverter does.
+//=============================================================================
+
+template <typename SampleT>	struct	CAStaticSampleTraits;
+
+template <>	struct	CAStaticSampleTraits<Float32>
+{
+	static const CAStreamBasicDescription::CommonPCMFormat	kCommonPCMFormat = CAStreamBasicDescription::kPCMFormatFloat32;
+	static const UInt32	kFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+
+	static Float64	ToValue(Float32 inSample) { return inSample; }
+	static Float32	FromValue(Float64 inValue) { return static_cast<Float32>(inValue); }
+};
+
+template <>	struct	CAStaticSampleTraits<SInt16>
+{
+	static const CAStreamBasicDescription::CommonPCMFormat	kCommonPCMFormat = CAStreamBasicDescription::kPCMFormatInt16;
+	static const UInt32	kFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+
+	static Float64	ToValue(SInt16 inSample) { return inSample * (1.0 / 32768.0); }
+	static SInt16	FromValue(Float64 inValue)
+	{
+		Float64 theValue = rint(inValue * 32768.0);
+		return (theValue != theValue) ? 0 : ((theValue >= 32767.0) ? 32767 : ((theValue <= -32768.0) ? -32768 : static_cast<SInt16>(theValue)));
+	}
+};
+
+template <>	struct	CAStaticSampleTraits<SInt32>
+{
+	static const CAStreamBasicDescription::CommonPCMFormat	kCommonPCMFormat = CAStreamBasicDescription::kPCMFormatFixed824;
+	static const UInt32	kFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked | (24 << kLinearPCMFormatFlagsSampleFractionShift);
+
+	static Float64	ToValue(SInt32 inSample) { return inSample * (1.0 / 16777216.0); }
+	static SInt32	FromValue(Float64 inValue)
+	{
+		Float64 theValue = rint(inValue * 16777216.0);
+		return (theValue != theValue) ? 0 : ((theValue >= 2147483647.0) ? 2147483647 : ((theValue <= -2147483648.0) ? (-2147483647 - 1) : static_cast<SInt32>(theValue)));
+	}
+};
+
+//	one sample from one common type to another; a sample that doesn't change type is copied as it is
+template <typename SourceT, typename DestinationT>
+struct	CAStaticSampleConverter
+{
+	static DestinationT	Convert(SourceT inSample) { return CAStaticSampleTraits<DestinationT>::FromValue(CAStaticSampleTraits<SourceT>::ToValue(inSample)); }
+};
+
+template <typename SampleT>
+struct	CAStaticSampleConverter<SampleT, SampleT>
+{
+	static SampleT	Convert(SampleT inSample) { return inSample; }
+};
+
+//=============================================================================
+//	CAStaticStreamFormat
+//
+//	A packed, native endian linear PCM format fixed at compile time. Everything
+//	CAStreamBasicDescription works out at run time (IsInterleaved,
+//	NumberChannelStreams, FramesToBytes, ...) is a constant here, so a kernel
+//	templated on one of these has no format tests left in its inner loop.
+//=============================================================================
+
+template <typename SampleT, UInt32 Channels, bool Interleaved>
+struct	CAStaticStreamFormat
+{
+
+//	Constants
+public:
+	typedef SampleT		SampleType;
+	static const UInt32	kNumberChannels = Channels;
+	static const bool	kIsInterleaved = Interleaved;
+	static const UInt32	kNumberChannelStreams = Interleaved ? 1 : Channels;
+	static const UInt32	kNumberInterleavedChannels = Interleaved ? Channels : 1;
+	static const UInt32	kSampleWordSize = sizeof(SampleT);
+	static const UInt32	kBytesPerFrame = sizeof(SampleT) * kNumberInterleavedChannels;
+	static const UInt32	kFormatFlags = CAStaticSampleTraits<SampleT>::kFormatFlags | (Interleaved ? 0 : static_cast<UInt32>(kAudioFormatFlagIsNonInterleaved));
+
+//	Conversion
+public:
+	static constexpr UInt32	FramesToBytes(UInt32 inNumberFrames) { return inNumberFrames * kBytesPerFrame; }
+	static constexpr UInt32	BytesToFrames(UInt32 inNumberBytes) { return inNumberBytes / kBytesPerFrame; }
+
+	static constexpr AudioStreamBasicDescription	ASBD(Float64 inSampleRate)
+	{
+		return AudioStreamBasicDescription { inSampleRate, kAudioFormatLinearPCM, kFormatFlags, kBytesPerFrame, 1, kBytesPerFrame, Channels, 8 * kSampleWordSize, 0 };
+	}
+
+	//	true if inDesc is this format at any sample rate
+	static constexpr bool	Matches(const AudioStreamBasicDescription& inDesc)
+	{
+		return (inDesc.mFormatID == kAudioFormatLinearPCM) && (inDesc.mFormatFlags == kFormatFlags) && (inDesc.mBytesPerPacket == kBytesPerFrame) &&
+			   (inDesc.mFramesPerPacket == 1) && (inDesc.mBytesPerFrame == kBytesPerFrame) && (inDesc.mChannelsPerFrame == Channels) &&
+			   (inDesc.mBitsPerChannel == 8 * kSampleWordSize);
+	}
+
+};
+
+//=============================================================================
+//	CAStaticFormatKernels
+//
+//	AudioBufferList operations for one CAStaticStreamFormat. Pick the format at
+//	compile time when you know it, or hand one of these to
+//	CAStaticStreamFormatDispatcher to have it picked from an ASBD.
+//=============================================================================
+
+template <class Format>
+struct	CAStaticFormatKernels
+{
+
+public:
+	//	what AUOutputBL::Prepare does: points each buffer at inMemory, spaced inBufferStride bytes apart
+	static void	Prepare(AudioBufferList& ioBufferList, Byte* inMemory, UInt32 inBufferStride, UInt32 inNumberFrames)
+	{
+		ioBufferList.mNumberBuffers = Format::kNumberChannelStreams;
+		for(UInt32 theBuffer = 0; theBuffer < Format::kNumberChannelStreams; ++theBuffer)
+		{
+			ioBufferList.mBuffers[theBuffer].mNumberChannels = Format::kNumberInterleavedChannels;
+			ioBufferList.mBuffers[theBuffer].mDataByteSize = Format::FramesToBytes(inNumberFrames);
+			ioBufferList.mBuffers[theBuffer].mData = (inMemory != NULL) ? inMemory + (theBuffer * inBufferStride) : NULL;
+		}
+	}
+
+	//	zeroes the first inNumberFrames frames of every buffer
+	static void	Silence(AudioBufferList& ioBufferList, UInt32 inNumberFrames)
+	{
+		for(UInt32 theBuffer = 0; theBuffer < Format::kNumberChannelStreams; ++theBuffer)
+		{
+			memset(ioBufferList.mBuffers[theBuffer].mData, 0, Format::FramesToBytes(inNumberFrames));
+		}
+	}
+
+	//	copies the first inNumberFrames frames of every buffer
+	static void	Copy(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames)
+	{
+		for(UInt32 theBuffer = 0; theBuffer < Format::kNumberChannelStreams; ++theBuffer)
+		{
+			memcpy(ioDestination.mBuffers[theBuffer].mData, inSource.mBuffers[theBuffer].mData, Format::FramesToBytes(inNumberFrames));
+			ioDestination.mBuffers[theBuffer].mDataByteSize = Format::FramesToBytes(inNumberFrames);
+		}
+	}
+
+	//	the Run functions the dispatcher calls
+	struct	PrepareKernel	{ static void Run(AudioBufferList& ioBufferList, Byte* inMemory, UInt32 inBufferStride, UInt32 inNumberFrames) { Prepare(ioBufferList, inMemory, inBufferStride, inNumberFrames); } };
+	struct	SilenceKernel	{ static void Run(AudioBufferList& ioBufferList, UInt32 inNumberFrames) { Silence(ioBufferList, inNumberFrames); } };
+	struct	CopyKernel		{ static void Run(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames) { Copy(inSource, ioDestination, inNumberFrames); } };
+
+};
+
+//=============================================================================
+//	CAStaticConvertKernel
+//
+//	Converts between two CAStaticStreamFormats with the same number of channels,
+//	changing the sample type and the interleaving in one pass. CAPCMConverter
+//	uses it for the conversions its CAVectorOps kernels can't take as one
+//	contiguous run, such as the capture path's interleaved Int16 to
+//	deinterleaved Float32, and for copies between the common formats.
+//=============================================================================
+
+template <class SourceFormat, class DestinationFormat>
+struct	CAStaticConvertKernel
+{
+	typedef typename SourceFormat::SampleType		SourceSample;
+	typedef typename DestinationFormat::SampleType	DestinationSample;
+	static const UInt32	kNumberChannels = (SourceFormat::kNumberChannels < DestinationFormat::kNumberChannels) ? SourceFormat::kNumberChannels : DestinationFormat::kNumberChannels;
+
+	//	converts the first inNumberFrames frames, which both lists must hold
+	static void	Run(const AudioBufferList& inSource, AudioBufferList& ioDestination, UInt32 inNumberFrames)
+	{
+		const SourceSample* theSources[kNumberChannels];
+		DestinationSample* theDestinations[kNumberChannels];
+		for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+		{
+			theSources[theChannel] = SourceFormat::kIsInterleaved ? static_cast<const SourceSample*>(inSource.mBuffers[0].mData) + theChannel
+																	: static_cast<const SourceSample*>(inSource.mBuffers[theChannel].mData);
+			theDestinations[theChannel] = DestinationFormat::kIsInterleaved ? static_cast<DestinationSample*>(ioDestination.mBuffers[0].mData) + theChannel
+																			: static_cast<DestinationSample*>(ioDestination.mBuffers[theChannel].mData);
+		}
+		
+		//	walk the destination in order: a frame at a time when it's interleaved, a channel at a time when it isn't
+		if(DestinationFormat::kIsInterleaved)
+		{
+			for(UInt32 theFrame = 0; theFrame < inNumberFrames; ++theFrame)
+			{
+				for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+				{
+					theDestinations[theChannel][theFrame * DestinationFormat::kNumberInterleavedChannels] = CAStaticSampleConverter<SourceSample, DestinationSample>::Convert(theSources[theChannel][theFrame * SourceFormat::kNumberInterleavedChannels]);
+				}
+			}
+		}
+		else
+		{
+			for(UInt32 theChannel = 0; theChannel < kNumberChannels; ++theChannel)
+			{
+				const SourceSample* theSource = theSources[theChannel];
+				DestinationSample* theDestination = theDestinations[theChannel];
+				for(UInt32 theFrame = 0; theFrame < inNumberFrames; ++theFrame)
+				{
+					theDestination[theFrame] = CAStaticSampleConverter<SourceSample, DestinationSample>::Convert(theSource[theFrame * SourceFormat::kNumberInterleavedChannels]);
+				}
+			}
+		}
+	}
+};
+
+//=============================================================================
+//	CAStaticStreamFormatDispatcher
+//
+//	Finds the CAStaticStreamFormat that matches a run time ASBD: any common PCM
+//	sample type, interleaved or not, with 1 or 2 channels. For every other
+//	format nothing is called and nothing is found, so that the caller can fall
+//	back on its general purpose code.
+//
+//	Dispatch calls Kernel<Format>::Run(inArguments...) right away. Resolve and
+//	ResolvePair look the format up once, typically when a format is set, and
+//	return the instantiation's Run function to call from the render thread
+//	without looking again. Kernel is a template taking the format, for example
+//		template <class F> struct Silence : CAStaticFormatKernels<F>::SilenceKernel {};
+//		CAStaticStreamFormatDispatcher::Dispatch<Silence>(theASBD, theBufferList, theNumberFrames);
+//=============================================================================
+
+struct	CAStaticStreamFormatDispatcher
+{
+
+public:
+	enum { kMaxNumberChannels = 2 };
+
+	//	returns false if inDesc isn't one of the formats
+	template <template <class> class Kernel, typename... Arguments>
+	static bool	Dispatch(const AudioStreamBasicDescription& inDesc, Arguments&&... inArguments)
+	{
+		return VisitFormat< RunVisitor<Kernel> >(inDesc, inArguments...);
+	}
+
+	//	&Kernel<Format>::Run, or NULL if inDesc isn't one of the formats
+	template <template <class> class Kernel, typename Function>
+	static Function	Resolve(const AudioStreamBasicDescription& inDesc)
+	{
+		Function theFunction = NULL;
+		VisitFormat< ResolveVisitor<Kernel> >(inDesc, theFunction);
+		return theFunction;
+	}
+
+	//	&Kernel<SourceFormat, DestinationFormat>::Run, or NULL if either isn't one of the formats or they
+	//	have different numbers of channels
+	template <template <class, class> class Kernel, typename Function>
+	static Function	ResolvePair(const AudioStreamBasicDescription& inSourceDesc, const AudioStreamBasicDescription& inDestinationDesc)
+	{
+		Function theFunction = NULL;
+		if(inSourceDesc.mChannelsPerFrame == inDestinationDesc.mChannelsPerFrame)
+		{
+			VisitFormat< ResolvePairVisitor<Kernel> >(inSourceDesc, inDestinationDesc, theFunction);
+		}
+		return theFunction;
+	}
+
+private:
+	template <template <class> class Kernel>
+	struct	RunVisitor
+	{
+		template <class Format, typename... Arguments>
+		static void	Visit(Arguments&&... inArguments) { Kernel<Format>::Run(inArguments...); }
+	};
+
+	template <template <class> class Kernel>
+	struct	ResolveVisitor
+	{
+		template <class Format, typename Function>
+		static void	Visit(Function& outFunction) { outFunction = &Kernel<Format>::Run; }
+	};
+
+	template <template <class, class> class Kernel>
+	struct	ResolvePairVisitor
+	{
+		template <class SourceFormat>
+		struct	WithSource
+		{
+			template <class DestinationFormat, typename Function>
+			static void	Visit(Function& outFunction) { outFunction = &Kernel<SourceFormat, DestinationFormat>::Run; }
+		};
+
+		template <class SourceFormat, typename Function>
+		static void	Visit(const AudioStreamBasicDescription& inDestinationDesc, Function& outFunction)
+		{
+			CAStaticStreamFormatDispatcher::VisitFormat< WithSource<SourceFormat> >(inDestinationDesc, outFunction);
+		}
+	};
+
+	//	calls Visitor::Visit<Format>(inArguments...) with the format that matches inDesc
+	template <class Visitor, typename... Arguments>
+	static bool	VisitFormat(const AudioStreamBasicDescription& inDesc, Arguments&&... inArguments)
+	{
+		CAStreamBasicDescription::CommonPCMFormat theFormat;
+		bool isInterleaved = true;
+		if(!CAStreamBasicDescription(inDesc).IdentifyCommonPCMFormat(theFormat, &isInterleaved))
+		{
+			return false;
+		}
+		
+		switch(theFormat)
+		{
+			case CAStreamBasicDescription::kPCMFormatFloat32:
+				return VisitLayout<Visitor, Float32>(isInterleaved, inDesc.mChannelsPerFrame, inArguments...);
+			case CAStreamBasicDescription::kPCMFormatInt16:
+				return VisitLayout<Visitor, SInt16>(isInterleaved, inDesc.mChannelsPerFrame, inArguments...);
+			case CAStreamBasicDescription::kPCMFormatFixed824:
+				return VisitLayout<Visitor, SInt32>(isInterleaved, inDesc.mChannelsPerFrame, inArguments...);
+			default:
+				return false;
+		};
+	}
+
+	template <class Visitor, typename SampleT, typename... Arguments>
+	static bool	VisitLayout(bool inIsInterleaved, UInt32 inNumberChannels, Arguments&&... inArguments)
+	{
+		return inIsInterleaved ? VisitChannels<Visitor, SampleT, true>(inNumberChannels, inArguments...)
+							   : VisitChannels<Visitor, SampleT, false>(inNumberChannels, inArguments...);
+	}
+
+	template <class Visitor, typename SampleT, bool Interleaved, typename... Arguments>
+	static bool	VisitChannels(UInt32 inNumberChannels, Arguments&&... inArguments)
+	{
+		switch(inNumberChannels)
+		{
+			case 1:
+				Visitor::template Visit< CAStaticStreamFormat<SampleT, 1, Interleaved> >(inArguments...);
+				return true;
+			case 2:
+				Visitor::template Visit< CAStaticStreamFormat<SampleT, 2, Interleaved> >(inArguments...);
+				return true;
+			default:
+				return false;
+		};
+	}
+
+};
+
+#endif
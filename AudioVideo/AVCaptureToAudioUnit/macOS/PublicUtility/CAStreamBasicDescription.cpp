@@ -45,6 +45,8 @@
   
 */
 #include "CAStreamBasicDescription.h"
+#include "CAStreamFormatRegistry.h"
+#include "CAStreamFormatText.h"
 #include "CAMath.h"
 
 #if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
@@ -57,35 +59,8 @@
 
 char *CAStringForOSType (OSType t, char *writeLocation)
 {
-	char *p = writeLocation;
-    unsigned char str[4] = {0}, *q = str;
-	*(UInt32 *)str = CFSwapInt32HostToBig(t);
-
-	bool hasNonPrint = false;
-	for (int i = 0; i < 4; ++i) {
-		if (!(isprint(*q) && *q != '\\')) {
-			hasNonPrint = true;
-			break;
-		}
-        q++;
-	}
-    q = str;
-	
-	if (hasNonPrint)
-		p += sprintf (p, "0x");
-	else
-		*p++ = '\'';
-		
-	for (int i = 0; i < 4; ++i) {
-		if (hasNonPrint) {
-			p += sprintf(p, "%02X", *q++);
-		} else {
-			*p++ = *q++;
-		}
-	}
-	if (!hasNonPrint)
-		*p++ = '\'';
-	*p = '\0';
+	// callers have always passed at least 11 bytes, enough for the longest form (0xXXXXXXXX)
+	CAStreamFormatText::FormatOSType(t, writeLocation, 11);
 	return writeLocation;
 }
 
@@ -121,75 +96,7 @@ CAStreamBasicDescription::CAStreamBasicDescription(double inSampleRate,		UInt32
 
 char *CAStreamBasicDescription::AsString(char *buf, size_t _bufsize) const
 {
-	int bufsize = (int)_bufsize;	// must be signed to protect against overflow
-	char *theBuffer = buf;
-	int nc;
-	char formatID[24];
-	CAStringForOSType (mFormatID, formatID);
-	nc = snprintf(buf, bufsize, "%2d ch, %6.0f Hz, %s (0x%08X) ", (int)NumberChannels(), mSampleRate, formatID, (int)mFormatFlags);
-	buf += nc; if ((bufsize -= nc) <= 0) goto exit;
-	if (mFormatID == kAudioFormatLinearPCM) {
-		bool isInt = !(mFormatFlags & kLinearPCMFormatFlagIsFloat);
-		int wordSize = SampleWordSize();
-		const char *endian = (wordSize > 1) ? 
-			((mFormatFlags & kLinearPCMFormatFlagIsBigEndian) ? " big-endian" : " little-endian" ) : "";
-		const char *sign = isInt ? 
-			((mFormatFlags & kLinearPCMFormatFlagIsSignedInteger) ? " signed" : " unsigned") : "";
-		const char *floatInt = isInt ? "integer" : "float";
-		char packed[32];
-		if (wordSize > 0 && PackednessIsSignificant()) {
-			if (mFormatFlags & kLinearPCMFormatFlagIsPacked)
-				snprintf(packed, sizeof(packed), "packed in %d bytes", wordSize);
-			else
-				snprintf(packed, sizeof(packed), "unpacked in %d bytes", wordSize);
-		} else
-			packed[0] = '\0';
-		const char *align = (wordSize > 0 && AlignmentIsSignificant()) ?
-			((mFormatFlags & kLinearPCMFormatFlagIsAlignedHigh) ? " high-aligned" : " low-aligned") : "";
-		const char *deinter = (mFormatFlags & kAudioFormatFlagIsNonInterleaved) ? ", deinterleaved" : "";
-		const char *commaSpace = (packed[0]!='\0') || (align[0]!='\0') ? ", " : "";
-		char bitdepth[20];
-
-		int fracbits = (mFormatFlags & kLinearPCMFormatFlagsSampleFractionMask) >> kLinearPCMFormatFlagsSampleFractionShift;
-		if (fracbits > 0)
-			snprintf(bitdepth, sizeof(bitdepth), "%d.%d", (int)mBitsPerChannel - fracbits, fracbits);
-		else
-			snprintf(bitdepth, sizeof(bitdepth), "%d", (int)mBitsPerChannel);
-		
-		/* nc =*/ snprintf(buf, bufsize, "%s-bit%s%s %s%s%s%s%s",
-			bitdepth, endian, sign, floatInt, 
-			commaSpace, packed, align, deinter);
-		// buf += nc; if ((bufsize -= nc) <= 0) goto exit;
-	} else if (mFormatID == 'alac') {	//	kAudioFormatAppleLossless
-		int sourceBits = 0;
-		switch (mFormatFlags)
-		{
-			case 1:	//	kAppleLosslessFormatFlag_16BitSourceData
-				sourceBits = 16;
-				break;
-    		case 2:	//	kAppleLosslessFormatFlag_20BitSourceData
-    			sourceBits = 20;
-    			break;
-    		case 3:	//	kAppleLosslessFormatFlag_24BitSourceData
-    			sourceBits = 24;
-    			break;
-    		case 4:	//	kAppleLosslessFormatFlag_32BitSourceData
-    			sourceBits = 32;
-    			break;
-		}
-		if (sourceBits)
-			nc = snprintf(buf, bufsize, "from %d-bit source, ", sourceBits);
-		else
-			nc = snprintf(buf, bufsize, "from UNKNOWN source bit depth, ");
-		buf += nc; if ((bufsize -= nc) <= 0) goto exit;
-		/* nc =*/ snprintf(buf, bufsize, "%d frames/packet", (int)mFramesPerPacket);
-		//	buf += nc; if ((bufsize -= nc) <= 0) goto exit;
-	}
-	else
-		/* nc =*/ snprintf(buf, bufsize, "%d bits/channel, %d bytes/packet, %d frames/packet, %d bytes/frame",
-			(int)mBitsPerChannel, (int)mBytesPerPacket, (int)mFramesPerPacket, (int)mBytesPerFrame);
-exit:
-	return theBuffer;
+	return CAStreamFormatRegistry::Shared().AsString(*this, buf, _bufsize);
 }
 
 void	CAStreamBasicDescription::NormalizeLinearPCMFormat(AudioStreamBasicDescription& ioDescription)
@@ -289,6 +196,11 @@ void	CAStreamBasicDescription::GetSimpleName(const AudioStreamBasicDescription&
 		inMaxNameLength -= theCharactersWritten;
 	}
 	
+	CAStreamFormatRegistry::Shared().GetSimpleName(inDescription, inAbbreviate, outName, inMaxNameLength);
+}
+
+void	CAStreamBasicDescription::FormatSimpleName(const AudioStreamBasicDescription& inDescription, char* outName, UInt32 inMaxNameLength, bool inAbbreviate)
+{
 	switch(inDescription.mFormatID)
 	{
 		case kAudioFormatLinearPCM:
@@ -627,164 +539,28 @@ bool SanityCheck(const AudioStreamBasicDescription& x)
 
 bool CAStreamBasicDescription::FromText(const char *inTextDesc, AudioStreamBasicDescription &fmt)
 {
-	const char *p = inTextDesc;
-	
-	memset(&fmt, 0, sizeof(fmt));
-
-	bool isPCM = true;	// until proven otherwise
-	UInt32 pcmFlags = kAudioFormatFlagIsPacked | kAudioFormatFlagIsSignedInteger;
-
-	if (p[0] == '-')	// previously we required a leading dash on PCM formats
-		++p;
+	return CAStreamFormatRegistry::Shared().FromText(inTextDesc, fmt);
+}
 
-	if (p[0] == 'B' && p[1] == 'E') {
-		pcmFlags |= kLinearPCMFormatFlagIsBigEndian;
-		p += 2;
-	} else if (p[0] == 'L' && p[1] == 'E') {
-		p += 2;
-	} else {
-		// default is native-endian
-#if TARGET_RT_BIG_ENDIAN
-		pcmFlags |= kLinearPCMFormatFlagIsBigEndian;
-#endif
-	}
-	if (p[0] == 'F') {
-		pcmFlags = (pcmFlags & ~kAudioFormatFlagIsSignedInteger) | kAudioFormatFlagIsFloat;
-		++p;
-	} else {
-		if (p[0] == 'U') {
-			pcmFlags &= ~kAudioFormatFlagIsSignedInteger;
-			++p;
-		}
-		if (p[0] == 'I')
-			++p;
-		else {
-			// it's not PCM; presumably some other format (NOT VALIDATED; use AudioFormat for that)
-			isPCM = false;
-			p = inTextDesc;	// go back to the beginning
-			char buf[4] = { ' ',' ',' ',' ' };
-			for (int i = 0; i < 4; ++i) {
-				if (*p != '\\') {
-					if ((buf[i] = *p++) == '\0') {
-						// special-case for 'aac'
-						if (i != 3) return false;
-						--p;	// keep pointing at the terminating null
-						buf[i] = ' ';
-						break;
-					}
-				} else {
-					// "\xNN" is a hex byte
-					if (*++p != 'x') return false;
-					int x;
-					if (sscanf(++p, "%02X", &x) != 1) return false;
-					buf[i] = x;
-					p += 2;
-				}
-			}
-			
-			if (strchr("-@/#", buf[3])) {
-				// further special-casing for 'aac'
-				buf[3] = ' ';
-				--p;
-			}
-			
-			fmt.mFormatID = CFSwapInt32BigToHost(*(UInt32 *)buf);
-		}
-	}
+bool CAStreamBasicDescription::ParseText(const char *inTextDesc, AudioStreamBasicDescription &fmt)
+{
+	CAStreamFormatText::ParseError theError;
+	if (CAStreamFormatText::Parse(inTextDesc, strlen(inTextDesc), fmt, &theError))
+		return true;
 	
-	if (isPCM) {
-		fmt.mFormatID = kAudioFormatLinearPCM;
-		fmt.mFormatFlags = pcmFlags;
-		fmt.mFramesPerPacket = 1;
-		fmt.mChannelsPerFrame = 1;
-		int bitdepth = 0, fracbits = 0;
-		while (isdigit(*p))
-			bitdepth = 10 * bitdepth + *p++ - '0';
-		if (*p == '.') {
-			++p;
-			if (!isdigit(*p)) {
-				fprintf(stderr, "Expected fractional bits following '.'\n");
-				goto Bail;
-			}
-			while (isdigit(*p))
-				fracbits = 10 * fracbits + *p++ - '0';
-			bitdepth += fracbits;
-			fmt.mFormatFlags |= (fracbits << kLinearPCMFormatFlagsSampleFractionShift);
-		}
-		fmt.mBitsPerChannel = bitdepth;
-		fmt.mBytesPerPacket = fmt.mBytesPerFrame = (bitdepth + 7) / 8;
-		if (bitdepth & 7) {
-			// assume unpacked. (packed odd bit depths are describable but not supported in AudioConverter.)
-			fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsPacked;
-			// alignment matters; default to high-aligned. use ':L_' for low.
-			fmt.mFormatFlags |= kLinearPCMFormatFlagIsAlignedHigh;
-		}
-	}
-	if (*p == '@') {
-		++p;
-		while (isdigit(*p))
-			fmt.mSampleRate = 10 * fmt.mSampleRate + (*p++ - '0');
-	}
-	if (*p == '/') {
-		UInt32 flags = 0;
-		while (true) {
-			char c = *++p;
-			if (c >= '0' && c <= '9')
-				flags = (flags << 4) | (c - '0');
-			else if (c >= 'A' && c <= 'F')
-				flags = (flags << 4) | (c - 'A' + 10);
-			else if (c >= 'a' && c <= 'f')
-				flags = (flags << 4) | (c - 'a' + 10);
-			else break;
-		}
-		fmt.mFormatFlags = flags;
-	}
-	if (*p == '#') {
-		++p;
-		while (isdigit(*p))
-			fmt.mFramesPerPacket = 10 * fmt.mFramesPerPacket + (*p++ - '0');
-	}
-	if (*p == ':') {
-		++p;
-		fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsPacked;
-		if (*p == 'L')
-			fmt.mFormatFlags &= ~kLinearPCMFormatFlagIsAlignedHigh;
-		else if (*p == 'H')
-			fmt.mFormatFlags |= kLinearPCMFormatFlagIsAlignedHigh;
-		else
-			goto Bail;
-		++p;
-		int bytesPerFrame = 0;
-		while (isdigit(*p))
-			bytesPerFrame = 10 * bytesPerFrame + (*p++ - '0');
-		fmt.mBytesPerFrame = fmt.mBytesPerPacket = bytesPerFrame;
-	}
-	if (*p == ',') {
-		++p;
-		int ch = 0;
-		while (isdigit(*p))
-			ch = 10 * ch + (*p++ - '0');
-		fmt.mChannelsPerFrame = ch;
-		if (*p == 'D') {
-			++p;
-			if (fmt.mFormatID != kAudioFormatLinearPCM) {
-				fprintf(stderr, "non-interleaved flag invalid for non-PCM formats\n");
-				goto Bail;
-			}
-			fmt.mFormatFlags |= kAudioFormatFlagIsNonInterleaved;
-		} else {
-			if (*p == 'I') ++p;	// default
-			if (fmt.mFormatID == kAudioFormatLinearPCM)
-				fmt.mBytesPerPacket = fmt.mBytesPerFrame *= ch;
-		}
-	}
-	if (*p != '\0') {
-		fprintf(stderr, "extra characters at end of format string: %s\n", p);
-		goto Bail;
+	switch (theError.mKind) {
+		case CAStreamFormatText::ParseError::kBadFormatID:
+			return false;
+		case CAStreamFormatText::ParseError::kMissingFractionBits:
+			fprintf(stderr, "Expected fractional bits following '.'\n");
+			break;
+		case CAStreamFormatText::ParseError::kNonInterleavedNonPCM:
+			fprintf(stderr, "non-interleaved flag invalid for non-PCM formats\n");
+			break;
+		case CAStreamFormatText::ParseError::kExtraCharacters:
+			fprintf(stderr, "extra characters at end of format string: %s\n", inTextDesc + theError.mOffset);
+			break;
 	}
-	return true;
-
-Bail:
 	fprintf(stderr, "Invalid format string: %s\n", inTextDesc);
 	fprintf(stderr, "Syntax of format strings is: \n");
 	return false;
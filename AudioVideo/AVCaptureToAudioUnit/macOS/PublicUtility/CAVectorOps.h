@@ -0,0 +1,550 @@
+/*
+     File: CAVectorOps.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#if !defined(__CAVectorOps_h__)
+#define __CAVectorOps_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+//	System Includes
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+#include <math.h>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+#elif defined(__SSE__)
+	#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+#endif
+
+//=============================================================================
+//	CAVector
+//
+//	A thin wrapper around the widest Float32 vector type the compiler has been
+//	told it may use. Every kernel in CAVectorOps is written once against these
+//	inlines and has a scalar tail, so a build without any vector unit (or with
+//	CA_VECTOR_DISABLE defined) still produces the same results.
+//	Loads and stores are unaligned; AudioBufferLists handed to us by other
+//	code make no promises about alignment.
+//=============================================================================
+
+#if !defined(CA_VECTOR_DISABLE)
+	#if defined(__AVX__)
+		#define CA_VECTOR_AVX		1
+	#elif defined(__SSE__) || defined(_M_X64)
+		#define CA_VECTOR_SSE		1
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#define CA_VECTOR_NEON		1
+	#endif
+#endif
+
+#if CA_VECTOR_AVX
+	typedef __m256	CAVector;
+	enum { kCAVectorWidth = 8 };
+	inline CAVector	CAVectorZero()										{ return _mm256_setzero_ps(); }
+	inline CAVector	CAVectorSplat(Float32 inValue)						{ return _mm256_set1_ps(inValue); }
+	inline CAVector	CAVectorLoad(const Float32* inSource)				{ return _mm256_loadu_ps(inSource); }
+	inline void		CAVectorStore(Float32* outDestination, CAVector inValue)	{ _mm256_storeu_ps(outDestination, inValue); }
+	inline CAVector	CAVectorAdd(CAVector inA, CAVector inB)				{ return _mm256_add_ps(inA, inB); }
+	inline CAVector	CAVectorMul(CAVector inA, CAVector inB)				{ return _mm256_mul_ps(inA, inB); }
+	inline CAVector	CAVectorMax(CAVector inA, CAVector inB)				{ return _mm256_max_ps(inA, inB); }
+	inline CAVector	CAVectorMin(CAVector inA, CAVector inB)				{ return _mm256_min_ps(inA, inB); }
+	inline CAVector	CAVectorAbs(CAVector inA)							{ return _mm256_andnot_ps(_mm256_set1_ps(-0.f), inA); }
+	inline Float32	CAVectorSumAcross(CAVector inA)						{ Float32 t[8]; _mm256_storeu_ps(t, inA); return ((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7])); }
+	inline Float32	CAVectorMaxAcross(CAVector inA)						{ Float32 t[8]; _mm256_storeu_ps(t, inA); Float32 m = t[0]; for (int i = 1; i < 8; ++i) if (t[i] > m) m = t[i]; return m; }
+#elif CA_VECTOR_SSE
+	typedef __m128	CAVector;
+	enum { kCAVectorWidth = 4 };
+	inline CAVector	CAVectorZero()										{ return _mm_setzero_ps(); }
+	inline CAVector	CAVectorSplat(Float32 inValue)						{ return _mm_set1_ps(inValue); }
+	inline CAVector	CAVectorLoad(const Float32* inSource)				{ return _mm_loadu_ps(inSource); }
+	inline void		CAVectorStore(Float32* outDestination, CAVector inValue)	{ _mm_storeu_ps(outDestination, inValue); }
+	inline CAVector	CAVectorAdd(CAVector inA, CAVector inB)				{ return _mm_add_ps(inA, inB); }
+	inline CAVector	CAVectorMul(CAVector inA, CAVector inB)				{ return _mm_mul_ps(inA, inB); }
+	inline CAVector	CAVectorMax(CAVector inA, CAVector inB)				{ return _mm_max_ps(inA, inB); }
+	inline CAVector	CAVectorMin(CAVector inA, CAVector inB)				{ return _mm_min_ps(inA, inB); }
+	inline CAVector	CAVectorAbs(CAVector inA)							{ return _mm_andnot_ps(_mm_set1_ps(-0.f), inA); }
+	inline Float32	CAVectorSumAcross(CAVector inA)						{ Float32 t[4]; _mm_storeu_ps(t, inA); return (t[0] + t[1]) + (t[2] + t[3]); }
+	inline Float32	CAVectorMaxAcross(CAVector inA)						{ Float32 t[4]; _mm_storeu_ps(t, inA); Float32 m = t[0]; for (int i = 1; i < 4; ++i) if (t[i] > m) m = t[i]; return m; }
+#elif CA_VECTOR_NEON
+	typedef float32x4_t	CAVector;
+	enum { kCAVectorWidth = 4 };
+	inline CAVector	CAVectorZero()										{ return vdupq_n_f32(0.f); }
+	inline CAVector	CAVectorSplat(Float32 inValue)						{ return vdupq_n_f32(inValue); }
+	inline CAVector	CAVectorLoad(const Float32* inSource)				{ return vld1q_f32(inSource); }
+	inline void		CAVectorStore(Float32* outDestination, CAVector inValue)	{ vst1q_f32(outDestination, inValue); }
+	inline CAVector	CAVectorAdd(CAVector inA, CAVector inB)				{ return vaddq_f32(inA, inB); }
+	inline CAVector	CAVectorMul(CAVector inA, CAVector inB)				{ return vmulq_f32(inA, inB); }
+	inline CAVector	CAVectorMax(CAVector inA, CAVector inB)				{ return vmaxq_f32(inA, inB); }
+	inline CAVector	CAVectorMin(CAVector inA, CAVector inB)				{ return vminq_f32(inA, inB); }
+	inline CAVector	CAVectorAbs(CAVector inA)							{ return vabsq_f32(inA); }
+	inline Float32	CAVectorSumAcross(CAVector inA)						{ float32x2_t s = vadd_f32(vget_low_f32(inA), vget_high_f32(inA)); return vget_lane_f32(vpadd_f32(s, s), 0); }
+	inline Float32	CAVectorMaxAcross(CAVector inA)						{ float32x2_t m = vmax_f32(vget_low_f32(inA), vget_high_f32(inA)); return vget_lane_f32(vpmax_f32(m, m), 0); }
+#endif
+
+#if CA_VECTOR_AVX || CA_VECTOR_SSE || CA_VECTOR_NEON
+	#define CA_VECTOR_AVAILABLE		1
+#else
+	#define CA_VECTOR_AVAILABLE		0
+#endif
+
+//=============================================================================
+//	CAVectorOps
+//
+//	Float32 kernels shared by CAAudioBufferList and friends. None of these
+//	allocate or lock, so they are all safe to call from a render callback.
+//=============================================================================
+
+struct	CAVectorOps
+{
+
+//	Mixing
+public:
+	//	ioDestination[i] += inSource[i]
+	static void				Accumulate(const Float32* inSource, Float32* ioDestination, UInt32 inNumberSamples);
+
+	//	ioDestination[i] += inSource[i] * inGain
+	static void				AccumulateScaled(const Float32* inSource, Float32 inGain, Float32* ioDestination, UInt32 inNumberSamples);
+
+	//	ioDestination[i] (+)= sum over s of inSources[s][i] * inGains[s]
+	//	Each vector of the destination is loaded and stored once no matter how many sources there are.
+	//	inGains may be NULL for unity gain. NULL entries in inSources are skipped.
+	//	If inAccumulate is false the destination is overwritten rather than summed into.
+	static void				MixSources(const Float32* const inSources[], const Float32 inGains[], UInt32 inNumberSources, Float32* ioDestination, UInt32 inNumberSamples, bool inAccumulate);
+
+//	Layout conversion
+public:
+	//	copies one channel of an interleaved buffer to one channel of another, each with its own stride in samples
+	static void				CopyStrided(const Float32* inSource, UInt32 inSourceStride, Float32* outDestination, UInt32 inDestinationStride, UInt32 inNumberFrames);
+
+	//	outDestination[frame * inDestinationStride + channel] = inSources[channel][frame], for inNumberChannels channels
+	static void				Interleave(const Float32* const inSources[], UInt32 inNumberChannels, Float32* outDestination, UInt32 inDestinationStride, UInt32 inNumberFrames);
+
+	//	outDestinations[channel][frame] = inSource[frame * inSourceStride + channel], for inNumberChannels channels
+	static void				Deinterleave(const Float32* inSource, UInt32 inSourceStride, UInt32 inNumberChannels, Float32* const outDestinations[], UInt32 inNumberFrames);
+
+//	Sample format conversion (native endian, contiguous)
+public:
+	//	outDestination[i] = inSource[i] / 32768
+	static void				Int16ToFloat32(const SInt16* inSource, Float32* outDestination, UInt32 inNumberSamples);
+
+	//	outDestination[i] = inSource[i] * 32768, rounded to nearest and saturated
+	static void				Float32ToInt16(const Float32* inSource, SInt16* outDestination, UInt32 inNumberSamples);
+
+	//	outDestination[i] = inSource[i] * inScale, for 32 bit integer and fixed point formats
+	static void				Int32ToFloat32(const SInt32* inSource, Float32 inScale, Float32* outDestination, UInt32 inNumberSamples);
+
+//	Analysis
+public:
+	//	for each of the inNumberChannels interleaved channels of inSource, raises ioPeaks[channel] to the largest
+	//	absolute sample value and adds the sum of the squared samples to ioSumsOfSquares[channel], in one pass
+	static void				MeasurePeakAndPower(const Float32* inSource, UInt32 inNumberChannels, UInt32 inNumberFrames, Float32 ioPeaks[], Float32 ioSumsOfSquares[]);
+
+	//	true if any of the inNumberWords 32 bit words is not all zero bits
+	static bool				HasNonZeroWord(const UInt32* inSource, UInt32 inNumberWords);
+
+};
+
+//=============================================================================
+//	CAVectorOps inline implementations
+//=============================================================================
+
+inline void	CAVectorOps::Accumulate(const Float32* inSource, Float32* ioDestination, UInt32 inNumberSamples)
+{
+	UInt32 theIndex = 0;
+#if CA_VECTOR_AVAILABLE
+	for(; theIndex + 2 * kCAVectorWidth <= inNumberSamples; theIndex += 2 * kCAVectorWidth)
+	{
+		CAVector theA = CAVectorAdd(CAVectorLoad(ioDestination + theIndex), CAVectorLoad(inSource + theIndex));
+		CAVector theB = CAVectorAdd(CAVectorLoad(ioDestination + theIndex + kCAVectorWidth), CAVectorLoad(inSource + theIndex + kCAVectorWidth));
+		CAVectorStore(ioDestination + theIndex, theA);
+		CAVectorStore(ioDestination + theIndex + kCAVectorWidth, theB);
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		ioDestination[theIndex] += inSource[theIndex];
+	}
+}
+
+inline void	CAVectorOps::AccumulateScaled(const Float32* inSource, Float32 inGain, Float32* ioDestination, UInt32 inNumberSamples)
+{
+	UInt32 theIndex = 0;
+#if CA_VECTOR_AVAILABLE
+	CAVector theGain = CAVectorSplat(inGain);
+	for(; theIndex + 2 * kCAVectorWidth <= inNumberSamples; theIndex += 2 * kCAVectorWidth)
+	{
+		CAVector theA = CAVectorAdd(CAVectorLoad(ioDestination + theIndex), CAVectorMul(CAVectorLoad(inSource + theIndex), theGain));
+		CAVector theB = CAVectorAdd(CAVectorLoad(ioDestination + theIndex + kCAVectorWidth), CAVectorMul(CAVectorLoad(inSource + theIndex + kCAVectorWidth), theGain));
+		CAVectorStore(ioDestination + theIndex, theA);
+		CAVectorStore(ioDestination + theIndex + kCAVectorWidth, theB);
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		ioDestination[theIndex] += inSource[theIndex] * inGain;
+	}
+}
+
+inline void	CAVectorOps::MixSources(const Float32* const inSources[], const Float32 inGains[], UInt32 inNumberSources, Float32* ioDestination, UInt32 inNumberSamples, bool inAccumulate)
+{
+	UInt32 theIndex = 0;
+#if CA_VECTOR_AVAILABLE
+	//	four independent sums per pass, so the adds from one source to the next don't wait on each other
+	for(; theIndex + 4 * kCAVectorWidth <= inNumberSamples; theIndex += 4 * kCAVectorWidth)
+	{
+		CAVector theA = inAccumulate ? CAVectorLoad(ioDestination + theIndex) : CAVectorZero();
+		CAVector theB = inAccumulate ? CAVectorLoad(ioDestination + theIndex + kCAVectorWidth) : CAVectorZero();
+		CAVector theC = inAccumulate ? CAVectorLoad(ioDestination + theIndex + 2 * kCAVectorWidth) : CAVectorZero();
+		CAVector theD = inAccumulate ? CAVectorLoad(ioDestination + theIndex + 3 * kCAVectorWidth) : CAVectorZero();
+		for(UInt32 theSourceIndex = 0; theSourceIndex < inNumberSources; ++theSourceIndex)
+		{
+			const Float32* theSource = inSources[theSourceIndex];
+			if(theSource != NULL)
+			{
+				theSource += theIndex;
+				CAVector theGain = CAVectorSplat((inGains != NULL) ? inGains[theSourceIndex] : 1.f);
+				theA = CAVectorAdd(theA, CAVectorMul(CAVectorLoad(theSource), theGain));
+				theB = CAVectorAdd(theB, CAVectorMul(CAVectorLoad(theSource + kCAVectorWidth), theGain));
+				theC = CAVectorAdd(theC, CAVectorMul(CAVectorLoad(theSource + 2 * kCAVectorWidth), theGain));
+				theD = CAVectorAdd(theD, CAVectorMul(CAVectorLoad(theSource + 3 * kCAVectorWidth), theGain));
+			}
+		}
+		CAVectorStore(ioDestination + theIndex, theA);
+		CAVectorStore(ioDestination + theIndex + kCAVectorWidth, theB);
+		CAVectorStore(ioDestination + theIndex + 2 * kCAVectorWidth, theC);
+		CAVectorStore(ioDestination + theIndex + 3 * kCAVectorWidth, theD);
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		Float32 theSum = inAccumulate ? ioDestination[theIndex] : 0.f;
+		for(UInt32 theSourceIndex = 0; theSourceIndex < inNumberSources; ++theSourceIndex)
+		{
+			if(inSources[theSourceIndex] != NULL)
+			{
+				theSum += inSources[theSourceIndex][theIndex] * ((inGains != NULL) ? inGains[theSourceIndex] : 1.f);
+			}
+		}
+		ioDestination[theIndex] = theSum;
+	}
+}
+
+inline void	CAVectorOps::CopyStrided(const Float32* inSource, UInt32 inSourceStride, Float32* outDestination, UInt32 inDestinationStride, UInt32 inNumberFrames)
+{
+	UInt32 theFrame = 0;
+	for(; theFrame + 4 <= inNumberFrames; theFrame += 4)
+	{
+		Float32 the0 = inSource[0];
+		Float32 the1 = inSource[inSourceStride];
+		Float32 the2 = inSource[2 * inSourceStride];
+		Float32 the3 = inSource[3 * inSourceStride];
+		outDestination[0] = the0;
+		outDestination[inDestinationStride] = the1;
+		outDestination[2 * inDestinationStride] = the2;
+		outDestination[3 * inDestinationStride] = the3;
+		inSource += 4 * inSourceStride;
+		outDestination += 4 * inDestinationStride;
+	}
+	for(; theFrame < inNumberFrames; ++theFrame)
+	{
+		*outDestination = *inSource;
+		inSource += inSourceStride;
+		outDestination += inDestinationStride;
+	}
+}
+
+inline void	CAVectorOps::Interleave(const Float32* const inSources[], UInt32 inNumberChannels, Float32* outDestination, UInt32 inDestinationStride, UInt32 inNumberFrames)
+{
+	UInt32 theChannel = 0;
+	if((inNumberChannels == 2) && (inDestinationStride == 2))
+	{
+		//	the stereo pair is by far the most common case, so it gets a real shuffle
+		const Float32* theLeft = inSources[0];
+		const Float32* theRight = inSources[1];
+		UInt32 theFrame = 0;
+#if !defined(CA_VECTOR_DISABLE) && (defined(__SSE__) || defined(_M_X64))
+		for(; theFrame + 4 <= inNumberFrames; theFrame += 4)
+		{
+			__m128 theL = _mm_loadu_ps(theLeft + theFrame);
+			__m128 theR = _mm_loadu_ps(theRight + theFrame);
+			_mm_storeu_ps(outDestination + 2 * theFrame, _mm_unpacklo_ps(theL, theR));
+			_mm_storeu_ps(outDestination + 2 * theFrame + 4, _mm_unpackhi_ps(theL, theR));
+		}
+#elif !defined(CA_VECTOR_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+		for(; theFrame + 4 <= inNumberFrames; theFrame += 4)
+		{
+			float32x4x2_t thePair = { { vld1q_f32(theLeft + theFrame), vld1q_f32(theRight + theFrame) } };
+			vst2q_f32(outDestination + 2 * theFrame, thePair);
+		}
+#endif
+		for(; theFrame < inNumberFrames; ++theFrame)
+		{
+			outDestination[2 * theFrame] = theLeft[theFrame];
+			outDestination[2 * theFrame + 1] = theRight[theFrame];
+		}
+		theChannel = 2;
+	}
+	for(; theChannel < inNumberChannels; ++theChannel)
+	{
+		CopyStrided(inSources[theChannel], 1, outDestination + theChannel, inDestinationStride, inNumberFrames);
+	}
+}
+
+inline void	CAVectorOps::Deinterleave(const Float32* inSource, UInt32 inSourceStride, UInt32 inNumberChannels, Float32* const outDestinations[], UInt32 inNumberFrames)
+{
+	UInt32 theChannel = 0;
+	if((inNumberChannels == 2) && (inSourceStride == 2))
+	{
+		Float32* theLeft = outDestinations[0];
+		Float32* theRight = outDestinations[1];
+		UInt32 theFrame = 0;
+#if !defined(CA_VECTOR_DISABLE) && (defined(__SSE__) || defined(_M_X64))
+		for(; theFrame + 4 <= inNumberFrames; theFrame += 4)
+		{
+			__m128 theLo = _mm_loadu_ps(inSource + 2 * theFrame);
+			__m128 theHi = _mm_loadu_ps(inSource + 2 * theFrame + 4);
+			_mm_storeu_ps(theLeft + theFrame, _mm_shuffle_ps(theLo, theHi, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(theRight + theFrame, _mm_shuffle_ps(theLo, theHi, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+#elif !defined(CA_VECTOR_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+		for(; theFrame + 4 <= inNumberFrames; theFrame += 4)
+		{
+			float32x4x2_t thePair = vld2q_f32(inSource + 2 * theFrame);
+			vst1q_f32(theLeft + theFrame, thePair.val[0]);
+			vst1q_f32(theRight + theFrame, thePair.val[1]);
+		}
+#endif
+		for(; theFrame < inNumberFrames; ++theFrame)
+		{
+			theLeft[theFrame] = inSource[2 * theFrame];
+			theRight[theFrame] = inSource[2 * theFrame + 1];
+		}
+		theChannel = 2;
+	}
+	for(; theChannel < inNumberChannels; ++theChannel)
+	{
+		CopyStrided(inSource + theChannel, inSourceStride, outDestinations[theChannel], 1, inNumberFrames);
+	}
+}
+
+inline void	CAVectorOps::Int16ToFloat32(const SInt16* inSource, Float32* outDestination, UInt32 inNumberSamples)
+{
+	const Float32 kScale = 1.f / 32768.f;
+	UInt32 theIndex = 0;
+#if !defined(CA_VECTOR_DISABLE) && (defined(__SSE2__) || defined(_M_X64))
+	__m128 theScale = _mm_set1_ps(kScale);
+	for(; theIndex + 8 <= inNumberSamples; theIndex += 8)
+	{
+		__m128i theWords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inSource + theIndex));
+		//	sign extend by unpacking into the high half and shifting back down
+		__m128i theLo = _mm_srai_epi32(_mm_unpacklo_epi16(theWords, theWords), 16);
+		__m128i theHi = _mm_srai_epi32(_mm_unpackhi_epi16(theWords, theWords), 16);
+		_mm_storeu_ps(outDestination + theIndex, _mm_mul_ps(_mm_cvtepi32_ps(theLo), theScale));
+		_mm_storeu_ps(outDestination + theIndex + 4, _mm_mul_ps(_mm_cvtepi32_ps(theHi), theScale));
+	}
+#elif !defined(CA_VECTOR_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	float32x4_t theScale = vdupq_n_f32(kScale);
+	for(; theIndex + 8 <= inNumberSamples; theIndex += 8)
+	{
+		int16x8_t theWords = vld1q_s16(inSource + theIndex);
+		vst1q_f32(outDestination + theIndex, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(theWords))), theScale));
+		vst1q_f32(outDestination + theIndex + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(theWords))), theScale));
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		outDestination[theIndex] = inSource[theIndex] * kScale;
+	}
+}
+
+inline void	CAVectorOps::Float32ToInt16(const Float32* inSource, SInt16* outDestination, UInt32 inNumberSamples)
+{
+	UInt32 theIndex = 0;
+#if !defined(CA_VECTOR_DISABLE) && (defined(__SSE2__) || defined(_M_X64))
+	__m128 theScale = _mm_set1_ps(32768.f);
+	__m128 theMin = _mm_set1_ps(-32768.f);
+	__m128 theMax = _mm_set1_ps(32767.f);
+	for(; theIndex + 8 <= inNumberSamples; theIndex += 8)
+	{
+		//	cvtps turns NaN and anything out of SInt32 range into 0x80000000, so clamp
+		//	first and zero the NaN lanes (cmpord) to agree with the scalar tail
+		__m128 theLoValues = _mm_mul_ps(_mm_loadu_ps(inSource + theIndex), theScale);
+		__m128 theHiValues = _mm_mul_ps(_mm_loadu_ps(inSource + theIndex + 4), theScale);
+		theLoValues = _mm_and_ps(_mm_cmpord_ps(theLoValues, theLoValues), _mm_min_ps(_mm_max_ps(theLoValues, theMin), theMax));
+		theHiValues = _mm_and_ps(_mm_cmpord_ps(theHiValues, theHiValues), _mm_min_ps(_mm_max_ps(theHiValues, theMin), theMax));
+		__m128i theLo = _mm_cvtps_epi32(theLoValues);
+		__m128i theHi = _mm_cvtps_epi32(theHiValues);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outDestination + theIndex), _mm_packs_epi32(theLo, theHi));
+	}
+#elif !defined(CA_VECTOR_DISABLE) && defined(__aarch64__)
+	float32x4_t theScale = vdupq_n_f32(32768.f);
+	for(; theIndex + 8 <= inNumberSamples; theIndex += 8)
+	{
+		//	fcvtns already saturates and turns NaN into 0, vqmovn saturates the rest
+		int32x4_t theLo = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(inSource + theIndex), theScale));
+		int32x4_t theHi = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(inSource + theIndex + 4), theScale));
+		vst1q_s16(outDestination + theIndex, vcombine_s16(vqmovn_s32(theLo), vqmovn_s32(theHi)));
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		Float32 theValue = rintf(inSource[theIndex] * 32768.f);
+		outDestination[theIndex] = (theValue != theValue) ? 0 : ((theValue >= 32767.f) ? 32767 : ((theValue <= -32768.f) ? -32768 : static_cast<SInt16>(theValue)));
+	}
+}
+
+inline void	CAVectorOps::Int32ToFloat32(const SInt32* inSource, Float32 inScale, Float32* outDestination, UInt32 inNumberSamples)
+{
+	UInt32 theIndex = 0;
+#if !defined(CA_VECTOR_DISABLE) && (defined(__SSE2__) || defined(_M_X64))
+	__m128 theScale = _mm_set1_ps(inScale);
+	for(; theIndex + 4 <= inNumberSamples; theIndex += 4)
+	{
+		__m128i theWords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inSource + theIndex));
+		_mm_storeu_ps(outDestination + theIndex, _mm_mul_ps(_mm_cvtepi32_ps(theWords), theScale));
+	}
+#elif !defined(CA_VECTOR_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	float32x4_t theScale = vdupq_n_f32(inScale);
+	for(; theIndex + 4 <= inNumberSamples; theIndex += 4)
+	{
+		vst1q_f32(outDestination + theIndex, vmulq_f32(vcvtq_f32_s32(vld1q_s32(inSource + theIndex)), theScale));
+	}
+#endif
+	for(; theIndex < inNumberSamples; ++theIndex)
+	{
+		outDestination[theIndex] = static_cast<Float32>(inSource[theIndex]) * inScale;
+	}
+}
+
+inline void	CAVectorOps::MeasurePeakAndPower(const Float32* inSource, UInt32 inNumberChannels, UInt32 inNumberFrames, Float32 ioPeaks[], Float32 ioSumsOfSquares[])
+{
+	UInt32 theNumberSamples = inNumberFrames * inNumberChannels;
+	UInt32 theIndex = 0;
+#if CA_VECTOR_AVAILABLE
+	//	when the channels divide the vector width evenly, lane i of every vector always holds channel i % inNumberChannels
+	if((inNumberChannels > 0) && ((kCAVectorWidth % inNumberChannels) == 0))
+	{
+		CAVector thePeakA = CAVectorZero(), thePeakB = CAVectorZero();
+		CAVector theSumA = CAVectorZero(), theSumB = CAVectorZero();
+		for(; theIndex + 2 * kCAVectorWidth <= theNumberSamples; theIndex += 2 * kCAVectorWidth)
+		{
+			CAVector theA = CAVectorLoad(inSource + theIndex);
+			CAVector theB = CAVectorLoad(inSource + theIndex + kCAVectorWidth);
+			thePeakA = CAVectorMax(thePeakA, CAVectorAbs(theA));
+			thePeakB = CAVectorMax(thePeakB, CAVectorAbs(theB));
+			theSumA = CAVectorAdd(theSumA, CAVectorMul(theA, theA));
+			theSumB = CAVectorAdd(theSumB, CAVectorMul(theB, theB));
+		}
+		
+		Float32 thePeaks[kCAVectorWidth], theSums[kCAVectorWidth];
+		CAVectorStore(thePeaks, CAVectorMax(thePeakA, thePeakB));
+		CAVectorStore(theSums, CAVectorAdd(theSumA, theSumB));
+		for(UInt32 theLane = 0; theLane < kCAVectorWidth; ++theLane)
+		{
+			UInt32 theChannel = theLane % inNumberChannels;
+			if(thePeaks[theLane] > ioPeaks[theChannel])
+			{
+				ioPeaks[theChannel] = thePeaks[theLane];
+			}
+			ioSumsOfSquares[theChannel] += theSums[theLane];
+		}
+	}
+#endif
+	//	what is left always starts on a frame boundary
+	for(UInt32 theChannel = 0; theChannel < inNumberChannels; ++theChannel)
+	{
+		Float32 thePeak = ioPeaks[theChannel];
+		Float32 theSum = 0.f;
+		for(UInt32 theSample = theIndex + theChannel; theSample < theNumberSamples; theSample += inNumberChannels)
+		{
+			Float32 theValue = inSource[theSample];
+			Float32 theMagnitude = fabsf(theValue);
+			if(theMagnitude > thePeak)
+			{
+				thePeak = theMagnitude;
+			}
+			theSum += theValue * theValue;
+		}
+		ioPeaks[theChannel] = thePeak;
+		ioSumsOfSquares[theChannel] += theSum;
+	}
+}
+
+inline bool	CAVectorOps::HasNonZeroWord(const UInt32* inSource, UInt32 inNumberWords)
+{
+	//	OR whole blocks together, which the compiler can vectorize, and only test the result once per block
+	UInt32 theIndex = 0;
+	for(; theIndex + 64 <= inNumberWords; theIndex += 64)
+	{
+		UInt32 theBits = 0;
+		for(UInt32 theWord = 0; theWord < 64; ++theWord)
+		{
+			theBits |= inSource[theIndex + theWord];
+		}
+		if(theBits != 0)
+		{
+			return true;
+		}
+	}
+	UInt32 theBits = 0;
+	for(; theIndex < inNumberWords; ++theIndex)
+	{
+		theBits |= inSource[theIndex];
+	}
+	return theBits != 0;
+}
+
+#endif
@@ -0,0 +1,364 @@
+/*
+     File: CABiquadFilterBank.cpp
+ Abstract: Smoothed cascaded biquad filters for audio callbacks.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#include "CABiquadFilterBank.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+
+enum {
+	kLanes = 4		// channels filtered side by side
+};
+
+// a channel from each of up to four channels, or four sets of coefficients alike
+typedef float Vector4 __attribute__((vector_size(16)));
+
+static const float kMinBandwidth = .01f;
+static const float kMaxBandwidth = 8.f;
+static const float kMinFrequency = 10.f;
+static const float kDenormalThreshold = 1e-15f;
+
+struct Stage {
+	// what was last set, from any thread
+	std::atomic<UInt32>		mTargetType;
+	std::atomic<float>		mTargetFrequency;
+	std::atomic<float>		mTargetBandwidth;
+	std::atomic<float>		mTargetGain;
+	
+	// what the audio thread is filtering with, gliding towards the targets
+	UInt32					mType;
+	float					mLogFrequency;
+	float					mBandwidth;
+	float					mGain;
+	Vector4					mB0, mB1, mB2, mA1, mA2;
+};
+
+struct CABiquadFilterBank {
+	UInt32					mChannelCount;
+	UInt32					mStageCount;
+	UInt32					mGroupCount;		// of kLanes channels
+	Float64					mSampleRate;
+	float					mMaxFrequency;
+	float					mGlideCoefficient;	// per smoothing block
+	
+	Stage*					mStages;
+	Vector4*				mState;				// two per stage per group
+	Float32**				mChannelData;		// where each channel is in the buffer list being processed
+	UInt32*					mChannelStrides;
+	Vector4					mBlock[kCABiquad_SmoothingBlockFrames];
+	std::atomic<bool>		mResetRequested;
+};
+
+static inline Vector4 Splat(float inValue)
+{
+	Vector4 result = { inValue, inValue, inValue, inValue };
+	return result;
+}
+
+static void ComputeCoefficients(const CABiquadFilterBank* inBank, Stage& ioStage)
+{
+	// the Audio EQ Cookbook, with alpha from the bandwidth in octaves
+	double frequency = exp2(ioStage.mLogFrequency);
+	double w0 = 2. * M_PI * frequency / inBank->mSampleRate;
+	double cosw0 = cos(w0), sinw0 = sin(w0);
+	double alpha = sinw0 * sinh(M_LN2 / 2. * ioStage.mBandwidth * w0 / sinw0);
+	double A = pow(10., ioStage.mGain / 40.);
+	double sqrtA2alpha = 2. * sqrt(A) * alpha;
+	double b0 = 1., b1 = 0., b2 = 0., a0 = 1., a1 = 0., a2 = 0.;
+	
+	switch (ioStage.mType) {
+		case kCABiquadFilterType_LowPass:
+			b0 = (1. - cosw0) / 2.; b1 = 1. - cosw0; b2 = b0;
+			a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+			break;
+		case kCABiquadFilterType_HighPass:
+			b0 = (1. + cosw0) / 2.; b1 = -(1. + cosw0); b2 = b0;
+			a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+			break;
+		case kCABiquadFilterType_BandPass:
+			b0 = alpha; b1 = 0.; b2 = -alpha;
+			a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+			break;
+		case kCABiquadFilterType_LowShelf:
+			b0 = A * ((A + 1.) - (A - 1.) * cosw0 + sqrtA2alpha);
+			b1 = 2. * A * ((A - 1.) - (A + 1.) * cosw0);
+			b2 = A * ((A + 1.) - (A - 1.) * cosw0 - sqrtA2alpha);
+			a0 = (A + 1.) + (A - 1.) * cosw0 + sqrtA2alpha;
+			a1 = -2. * ((A - 1.) + (A + 1.) * cosw0);
+			a2 = (A + 1.) + (A - 1.) * cosw0 - sqrtA2alpha;
+			break;
+		case kCABiquadFilterType_HighShelf:
+			b0 = A * ((A + 1.) + (A - 1.) * cosw0 + sqrtA2alpha);
+			b1 = -2. * A * ((A - 1.) + (A + 1.) * cosw0);
+			b2 = A * ((A + 1.) + (A - 1.) * cosw0 - sqrtA2alpha);
+			a0 = (A + 1.) - (A - 1.) * cosw0 + sqrtA2alpha;
+			a1 = 2. * ((A - 1.) - (A + 1.) * cosw0);
+			a2 = (A + 1.) - (A - 1.) * cosw0 - sqrtA2alpha;
+			break;
+		case kCABiquadFilterType_Peaking:
+			b0 = 1. + alpha * A; b1 = -2. * cosw0; b2 = 1. - alpha * A;
+			a0 = 1. + alpha / A; a1 = -2. * cosw0; a2 = 1. - alpha / A;
+			break;
+		default:
+			break;
+	}
+	
+	ioStage.mB0 = Splat((float)(b0 / a0));
+	ioStage.mB1 = Splat((float)(b1 / a0));
+	ioStage.mB2 = Splat((float)(b2 / a0));
+	ioStage.mA1 = Splat((float)(a1 / a0));
+	ioStage.mA2 = Splat((float)(a2 / a0));
+}
+
+static inline float Glide(float inCurrent, float inTarget, float inCoefficient, bool& ioChanged)
+{
+	if (inCurrent == inTarget) return inCurrent;
+	ioChanged = true;
+	float next = inCurrent + (inTarget - inCurrent) * inCoefficient;
+	return fabsf(inTarget - next) < 1e-4f ? inTarget : next;
+}
+
+static bool UpdateStages(CABiquadFilterBank* inBank, bool inJump)
+{
+	// returns whether any stage filters at all
+	bool isActive = false;
+	for (UInt32 s = 0; s < inBank->mStageCount; ++s) {
+		Stage& stage = inBank->mStages[s];
+		UInt32 type = stage.mTargetType.load(std::memory_order_relaxed);
+		float logFrequency = log2f(stage.mTargetFrequency.load(std::memory_order_relaxed));
+		float bandwidth = stage.mTargetBandwidth.load(std::memory_order_relaxed);
+		float gain = stage.mTargetGain.load(std::memory_order_relaxed);
+		
+		bool changed = false;
+		if (type != stage.mType || inJump) {
+			// nothing to glide from, and the old memory means nothing to the new filter
+			stage.mType = type;
+			stage.mLogFrequency = logFrequency;
+			stage.mBandwidth = bandwidth;
+			stage.mGain = gain;
+			memset(inBank->mState + 2 * s * inBank->mGroupCount, 0, 2 * inBank->mGroupCount * sizeof(Vector4));
+			changed = true;
+		} else {
+			float k = inBank->mGlideCoefficient;
+			stage.mLogFrequency = Glide(stage.mLogFrequency, logFrequency, k, changed);
+			stage.mBandwidth = Glide(stage.mBandwidth, bandwidth, k, changed);
+			stage.mGain = Glide(stage.mGain, gain, k, changed);
+		}
+		
+		if (stage.mType == kCABiquadFilterType_Bypass) continue;
+		isActive = true;
+		if (changed) ComputeCoefficients(inBank, stage);
+	}
+	return isActive;
+}
+
+static inline void FilterBlock(const Stage& inStage, Vector4* ioBlock, UInt32 inNumFrames, Vector4& ioZ1, Vector4& ioZ2)
+{
+	// transposed direct form II
+	const Vector4 b0 = inStage.mB0, b1 = inStage.mB1, b2 = inStage.mB2, a1 = inStage.mA1, a2 = inStage.mA2;
+	Vector4 z1 = ioZ1, z2 = ioZ2;
+	for (UInt32 i = 0; i < inNumFrames; ++i) {
+		Vector4 x = ioBlock[i];
+		Vector4 y = b0 * x + z1;
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		ioBlock[i] = y;
+	}
+	ioZ1 = z1;
+	ioZ2 = z2;
+}
+
+static inline void FlushDenormals(Vector4& ioZ)
+{
+	for (int lane = 0; lane < kLanes; ++lane)
+		if (fabsf(ioZ[lane]) < kDenormalThreshold) ioZ[lane] = 0.f;
+}
+
+CABiquadFilterBank* CABiquadFilterBankCreate(UInt32 inChannelCount, Float64 inSampleRate, UInt32 inStageCount)
+{
+	if (inChannelCount == 0 || !(inSampleRate > 0.) || inStageCount == 0) return NULL;
+	
+	CABiquadFilterBank* bank = new (std::nothrow) CABiquadFilterBank;
+	if (!bank) return NULL;
+	bank->mChannelCount = inChannelCount;
+	bank->mStageCount = inStageCount;
+	bank->mGroupCount = (inChannelCount + kLanes - 1) / kLanes;
+	bank->mSampleRate = inSampleRate;
+	bank->mMaxFrequency = (float)(inSampleRate * .49);
+	bank->mGlideCoefficient = (float)(1. - exp(-kCABiquad_SmoothingBlockFrames / (kCABiquad_SmoothingTime * inSampleRate)));
+	bank->mStages = new (std::nothrow) Stage[inStageCount];
+	bank->mState = (Vector4*)calloc(2 * inStageCount * bank->mGroupCount, sizeof(Vector4));
+	bank->mChannelData = (Float32**)calloc(inChannelCount, sizeof(Float32*));
+	bank->mChannelStrides = (UInt32*)calloc(inChannelCount, sizeof(UInt32));
+	if (!bank->mStages || !bank->mState || !bank->mChannelData || !bank->mChannelStrides) {
+		CABiquadFilterBankDispose(bank);
+		return NULL;
+	}
+	
+	CABiquadParameters bypass = { kCABiquadFilterType_Bypass, 1000.f, 1.f, 0.f };
+	for (UInt32 s = 0; s < inStageCount; ++s) {
+		bank->mStages[s].mType = kCABiquadFilterType_Bypass;
+		CABiquadFilterBankSetStage(bank, s, &bypass);
+	}
+	bank->mResetRequested.store(true, std::memory_order_release);
+	return bank;
+}
+
+void CABiquadFilterBankDispose(CABiquadFilterBank* inBank)
+{
+	if (!inBank) return;
+	delete [] inBank->mStages;
+	free(inBank->mState);
+	free(inBank->mChannelData);
+	free(inBank->mChannelStrides);
+	delete inBank;
+}
+
+UInt32 CABiquadFilterBankGetStageCount(const CABiquadFilterBank* inBank)
+{
+	return inBank->mStageCount;
+}
+
+void CABiquadFilterBankSetStage(CABiquadFilterBank* inBank, UInt32 inStage, const CABiquadParameters* inParameters)
+{
+	if (inStage >= inBank->mStageCount || !inParameters) return;
+	Stage& stage = inBank->mStages[inStage];
+	
+	float frequency = inParameters->frequency;
+	if (!(frequency >= kMinFrequency)) frequency = kMinFrequency;
+	if (frequency > inBank->mMaxFrequency) frequency = inBank->mMaxFrequency;
+	float bandwidth = inParameters->bandwidth;
+	if (!(bandwidth >= kMinBandwidth)) bandwidth = kMinBandwidth;
+	if (bandwidth > kMaxBandwidth) bandwidth = kMaxBandwidth;
+	float gain = isfinite(inParameters->gain) ? inParameters->gain : 0.f;
+	UInt32 type = inParameters->type <= kCABiquadFilterType_Peaking ? inParameters->type : (UInt32)kCABiquadFilterType_Bypass;
+	
+	stage.mTargetFrequency.store(frequency, std::memory_order_relaxed);
+	stage.mTargetBandwidth.store(bandwidth, std::memory_order_relaxed);
+	stage.mTargetGain.store(gain, std::memory_order_relaxed);
+	stage.mTargetType.store(type, std::memory_order_relaxed);
+}
+
+void CABiquadFilterBankGetStage(const CABiquadFilterBank* inBank, UInt32 inStage, CABiquadParameters* outParameters)
+{
+	if (inStage >= inBank->mStageCount || !outParameters) return;
+	const Stage& stage = inBank->mStages[inStage];
+	outParameters->type = stage.mTargetType.load(std::memory_order_relaxed);
+	outParameters->frequency = stage.mTargetFrequency.load(std::memory_order_relaxed);
+	outParameters->bandwidth = stage.mTargetBandwidth.load(std::memory_order_relaxed);
+	outParameters->gain = stage.mTargetGain.load(std::memory_order_relaxed);
+}
+
+void CABiquadFilterBankProcess(CABiquadFilterBank* inBank, AudioBufferList* ioBufferList, UInt32 inNumberFrames)
+{
+	bool jump = inBank->mResetRequested.exchange(false, std::memory_order_acquire);
+	
+	// find each channel, as for CAMeteringEngineProcess
+	UInt32 channel = 0;
+	memset(inBank->mChannelData, 0, inBank->mChannelCount * sizeof(Float32*));
+	for (UInt32 i = 0; i < ioBufferList->mNumberBuffers && channel < inBank->mChannelCount; ++i) {
+		AudioBuffer& buffer = ioBufferList->mBuffers[i];
+		UInt32 stride = buffer.mNumberChannels ? buffer.mNumberChannels : 1;
+		bool isUsable = buffer.mData && buffer.mDataByteSize >= inNumberFrames * stride * sizeof(Float32);
+		for (UInt32 j = 0; j < stride && channel < inBank->mChannelCount; ++j, ++channel) {
+			inBank->mChannelData[channel] = isUsable ? (Float32*)buffer.mData + j : NULL;
+			inBank->mChannelStrides[channel] = stride;
+		}
+	}
+	
+	for (UInt32 startFrame = 0; startFrame < inNumberFrames; startFrame += kCABiquad_SmoothingBlockFrames) {
+		UInt32 numFrames = inNumberFrames - startFrame;
+		if (numFrames > kCABiquad_SmoothingBlockFrames) numFrames = kCABiquad_SmoothingBlockFrames;
+		
+		bool isActive = UpdateStages(inBank, jump);
+		jump = false;
+		if (!isActive) continue;
+		
+		for (UInt32 group = 0; group < inBank->mGroupCount; ++group) {
+			UInt32 firstChannel = group * kLanes;
+			UInt32 numLanes = inBank->mChannelCount - firstChannel < (UInt32)kLanes ? inBank->mChannelCount - firstChannel : (UInt32)kLanes;
+			
+			// gather
+			Vector4* block = inBank->mBlock;
+			memset(block, 0, numFrames * sizeof(Vector4));
+			for (UInt32 lane = 0; lane < numLanes; ++lane) {
+				const Float32* data = inBank->mChannelData[firstChannel + lane];
+				if (!data) continue;
+				UInt32 stride = inBank->mChannelStrides[firstChannel + lane];
+				data += startFrame * stride;
+				for (UInt32 i = 0; i < numFrames; ++i) block[i][lane] = data[i * stride];
+			}
+			
+			for (UInt32 s = 0; s < inBank->mStageCount; ++s) {
+				const Stage& stage = inBank->mStages[s];
+				if (stage.mType == kCABiquadFilterType_Bypass) continue;
+				Vector4* state = inBank->mState + 2 * (s * inBank->mGroupCount + group);
+				FilterBlock(stage, block, numFrames, state[0], state[1]);
+			}
+			
+			// scatter
+			for (UInt32 lane = 0; lane < numLanes; ++lane) {
+				Float32* data = inBank->mChannelData[firstChannel + lane];
+				if (!data) continue;
+				UInt32 stride = inBank->mChannelStrides[firstChannel + lane];
+				data += startFrame * stride;
+				for (UInt32 i = 0; i < numFrames; ++i) data[i * stride] = block[i][lane];
+			}
+		}
+	}
+	
+	// so that a filter ringing down into silence doesn't slow to a crawl where denormals aren't flushed to zero
+	for (UInt32 i = 0; i < 2 * inBank->mStageCount * inBank->mGroupCount; ++i)
+		FlushDenormals(inBank->mState[i]);
+}
+
+void CABiquadFilterBankReset(CABiquadFilterBank* inBank)
+{
+	inBank->mResetRequested.store(true, std::memory_order_release);
+}
@@ -0,0 +1,116 @@
+/*
+     File: CABiquadFilterBank.h
+ Abstract: Smoothed cascaded biquad filters for audio callbacks.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#ifndef __CABiquadFilterBank_h__
+#define __CABiquadFilterBank_h__
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+/*
+ CABiquadFilterBank filters 32 bit float audio in place inside an audio callback, through a cascade
+ of second order sections of the kinds in Robert Bristow-Johnson's Audio EQ Cookbook.
+ 
+ Each stage has a type, a frequency, a bandwidth and, for the shelves and peaking stage, a gain. They
+ can be set from any thread and are glided to over kCABiquad_SmoothingTime, the frequency on a log
+ scale, with the coefficients worked out again every kCABiquad_SmoothingBlockFrames frames, so that
+ sweeping them from the UI doesn't click. A change of type takes effect at once.
+ 
+ Up to four channels are filtered side by side in one vector, so stereo costs about what mono does.
+ It uses the compiler's vector extensions rather than Accelerate, so it builds with clang or gcc
+ anywhere CoreAudioTypes.h can be found, and can be timed off the device.
+*/
+
+#define kCABiquad_SmoothingTime			0.02	/* seconds */
+#define kCABiquad_SmoothingBlockFrames	32
+
+enum {
+	kCABiquadFilterType_Bypass		= 0,
+	kCABiquadFilterType_LowPass		= 1,
+	kCABiquadFilterType_HighPass	= 2,
+	kCABiquadFilterType_BandPass	= 3,	/* 0 dB at the center frequency */
+	kCABiquadFilterType_LowShelf	= 4,
+	kCABiquadFilterType_HighShelf	= 5,
+	kCABiquadFilterType_Peaking		= 6
+};
+typedef UInt32 CABiquadFilterType;
+
+typedef struct CABiquadParameters {
+	CABiquadFilterType	type;
+	Float32				frequency;	/* Hz, the center, corner or shelf midpoint frequency */
+	Float32				bandwidth;	/* octaves between the -3 dB points (1.9 gives a Q of .707) */
+	Float32				gain;		/* dB, for the shelves and peaking stage only */
+} CABiquadParameters;
+
+typedef struct CABiquadFilterBank CABiquadFilterBank;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+/* returns NULL if any argument is zero or memory runs out. every stage starts out bypassed. */
+CABiquadFilterBank*	CABiquadFilterBankCreate(UInt32 inChannelCount, Float64 inSampleRate, UInt32 inStageCount);
+void				CABiquadFilterBankDispose(CABiquadFilterBank* inBank);
+
+UInt32				CABiquadFilterBankGetStageCount(const CABiquadFilterBank* inBank);
+
+/* may be called from any thread. the frequency is kept below Nyquist and the bandwidth between .01 and 8 octaves. */
+void				CABiquadFilterBankSetStage(CABiquadFilterBank* inBank, UInt32 inStage, const CABiquadParameters* inParameters);
+void				CABiquadFilterBankGetStage(const CABiquadFilterBank* inBank, UInt32 inStage, CABiquadParameters* outParameters);
+
+/* audio thread only: filters inNumberFrames frames in place, interleaved or not. channels beyond the bank's are left alone */
+void				CABiquadFilterBankProcess(CABiquadFilterBank* inBank, AudioBufferList* ioBufferList, UInt32 inNumberFrames);
+
+/* clears the filters' memory and jumps to the parameters last set, as after a seek. may be called from any thread,
+   and takes effect when the next buffer is processed */
+void				CABiquadFilterBankReset(CABiquadFilterBank* inBank);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // __CABiquadFilterBank_h__
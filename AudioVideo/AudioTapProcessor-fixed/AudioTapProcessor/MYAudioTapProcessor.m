@@ -46,6 +46,8 @@
  */
 
 #import "MYAudioTapProcessor.h"
+#import "CAMeteringEngine.h"
+#import "CABiquadFilterBank.h"
 
 #import <AVFoundation/AVFoundation.h>
 
@@ -54,10 +56,10 @@ typedef struct AVAudioTapProcessorContext {
 	Boolean supportedTapProcessingFormat;
 	Boolean isNonInterleaved;
 	Float64 sampleRate;
-	AudioUnit audioUnit;
-	Float64 sampleCount;
-	float leftChannelVolume;
-	float rightChannelVolume;
+	CABiquadFilterBank *filterBank;
+	Boolean wasFilterEnabled;
+	CAMeteringEngine *meteringEngine;
+	void *meteringSource; // dispatch_source_t, tells the main queue there are new levels to show
 	void *self;
 } AVAudioTapProcessorContext;
 
@@ -68,8 +70,8 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 static void tap_UnprepareCallback(MTAudioProcessingTapRef tap);
 static void tap_ProcessCallback(MTAudioProcessingTapRef tap, CMItemCount numberFrames, MTAudioProcessingTapFlags flags, AudioBufferList *bufferListInOut, CMItemCount *numberFramesOut, MTAudioProcessingTapFlags *flagsOut);
 
-// Audio Unit callbacks.
-static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData);
+// Bandpass filter parameters.
+static void setBandpassFilterParameters(CABiquadFilterBank *filterBank, Float64 sampleRate, float centerFrequency, float bandwidth);
 
 @interface MYAudioTapProcessor ()
 {
@@ -141,22 +143,7 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 	{
 		_centerFrequency = centerFrequency;
 		
-		AVAudioMix *audioMix = self.audioMix;
-		if (audioMix)
-		{
-			// Get pointer to Audio Unit stored in MTAudioProcessingTap context.
-			MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
-			AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
-			AudioUnit audioUnit = context->audioUnit;
-			if (audioUnit)
-			{
-				// Update center frequency of bandpass filter Audio Unit.
-				Float32 newCenterFrequency = (20.0f + ((context->sampleRate * 0.5f) - 20.0f) * self.centerFrequency); // Global, Hz, 20->(SampleRate/2), 5000
-				OSStatus status = AudioUnitSetParameter(audioUnit, kBandpassParam_CenterFrequency, kAudioUnitScope_Global, 0, newCenterFrequency, 0);
-				if (noErr != status)
-					NSLog(@"AudioUnitSetParameter(kBandpassParam_CenterFrequency): %d", (int)status);
-			}
-		}
+		[self updateBandpassFilter];
 	}
 }
 
@@ -166,21 +153,22 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 	{
 		_bandwidth = bandwidth;
 		
-		AVAudioMix *audioMix = self.audioMix;
-		if (audioMix)
+		[self updateBandpassFilter];
+	}
+}
+
+- (void)updateBandpassFilter
+{
+	AVAudioMix *audioMix = self.audioMix;
+	if (audioMix)
+	{
+		// Get pointer to filter bank stored in MTAudioProcessingTap context.
+		MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
+		AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
+		if (context->filterBank)
 		{
-			// Get pointer to Audio Unit stored in MTAudioProcessingTap context.
-			MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
-			AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
-			AudioUnit audioUnit = context->audioUnit;
-			if (audioUnit)
-			{
-				// Update bandwidth of bandpass filter Audio Unit.
-				Float32 newBandwidth = (100.0f + 11900.0f * self.bandwidth);
-				OSStatus status = AudioUnitSetParameter(audioUnit, kBandpassParam_Bandwidth, kAudioUnitScope_Global, 0, newBandwidth, 0); // Global, Cents, 100->12000, 600
-				if (noErr != status)
-					NSLog(@"AudioUnitSetParameter(kBandpassParam_Bandwidth): %d", (int)status);
-			}
+			// The filter glides to the new parameters, so dragging the sliders doesn't click.
+			setBandpassFilterParameters(context->filterBank, context->sampleRate, self.centerFrequency, self.bandwidth);
 		}
 	}
 }
@@ -189,14 +177,9 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 
 - (void)updateLeftChannelVolume:(float)leftChannelVolume rightChannelVolume:(float)rightChannelVolume
 {
-	@autoreleasepool
-	{
-		dispatch_async(dispatch_get_main_queue(), ^{
-			// Forward left and right channel volume to delegate.
-			if (self.delegate && [self.delegate respondsToSelector:@selector(audioTabProcessor:hasNewLeftChannelValue:rightChannelValue:)])
-				[self.delegate audioTabProcessor:self hasNewLeftChannelValue:leftChannelVolume rightChannelValue:rightChannelVolume];
-		});
-	}
+	// Forward left and right channel volume to delegate.
+	if (self.delegate && [self.delegate respondsToSelector:@selector(audioTabProcessor:hasNewLeftChannelValue:rightChannelValue:)])
+		[self.delegate audioTabProcessor:self hasNewLeftChannelValue:leftChannelVolume rightChannelValue:rightChannelVolume];
 }
 
 @end
@@ -211,10 +194,10 @@ static void tap_InitCallback(MTAudioProcessingTapRef tap, void *clientInfo, void
 	context->supportedTapProcessingFormat = false;
 	context->isNonInterleaved = false;
 	context->sampleRate = NAN;
-	context->audioUnit = NULL;
-	context->sampleCount = 0.0f;
-	context->leftChannelVolume = 0.0f;
-	context->rightChannelVolume = 0.0f;
+	context->filterBank = NULL;
+	context->wasFilterEnabled = false;
+	context->meteringEngine = NULL;
+	context->meteringSource = NULL;
 	context->self = clientInfo;
 	
 	*tapStorageOut = context;
@@ -237,7 +220,7 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 	// Store sample rate for -setCenterFrequency:.
 	context->sampleRate = processingFormat->mSampleRate;
 	
-	/* Verify processing format (this is not needed for Audio Unit, but for RMS calculation). */
+	/* Verify processing format (the filter bank and metering engine take 32 bit float only). */
 	
 	context->supportedTapProcessingFormat = true;
 	
@@ -258,63 +241,42 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 		context->isNonInterleaved = true;
 	}
 	
-	/* Create bandpass filter Audio Unit */
+	/* Create metering engine */
 	
-	AudioUnit audioUnit;
+	if (context->supportedTapProcessingFormat)
+	{
+		CAMeteringEngine *meteringEngine = CAMeteringEngineCreate(processingFormat->mChannelsPerFrame, processingFormat->mSampleRate);
+		if (meteringEngine)
+		{
+			// The process callback only signals this source, the main queue picks up the levels whenever it gets to it.
+			dispatch_source_t meteringSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, dispatch_get_main_queue());
+			__weak MYAudioTapProcessor *weakSelf = (__bridge MYAudioTapProcessor *)context->self;
+			dispatch_source_set_event_handler(meteringSource, ^{
+				CAMeterChannelLevels levels[2];
+				UInt32 channelCount = CAMeteringEngineGetChannelCount(meteringEngine);
+				if (CAMeteringEngineGetLevels(meteringEngine, levels, 2, NULL))
+					[weakSelf updateLeftChannelVolume:levels[0].rms rightChannelVolume:levels[(channelCount > 1) ? 1 : 0].rms];
+			});
+			// Runs once the last event handler has, so the engine is no longer being read.
+			dispatch_source_set_cancel_handler(meteringSource, ^{
+				CAMeteringEngineDispose(meteringEngine);
+			});
+			dispatch_resume(meteringSource);
+			
+			context->meteringEngine = meteringEngine;
+			context->meteringSource = (__bridge_retained void *)meteringSource;
+		}
+	}
 	
-	AudioComponentDescription audioComponentDescription;
-	audioComponentDescription.componentType = kAudioUnitType_Effect;
-	audioComponentDescription.componentSubType = kAudioUnitSubType_BandPassFilter;
-	audioComponentDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
-	audioComponentDescription.componentFlags = 0;
-	audioComponentDescription.componentFlagsMask = 0;
+	/* Create bandpass filter */
 	
-	AudioComponent audioComponent = AudioComponentFindNext(NULL, &audioComponentDescription);
-	if (audioComponent)
+	if (context->supportedTapProcessingFormat)
 	{
-		if (noErr == AudioComponentInstanceNew(audioComponent, &audioUnit))
+		context->filterBank = CABiquadFilterBankCreate(processingFormat->mChannelsPerFrame, processingFormat->mSampleRate, 1);
+		if (context->filterBank)
 		{
-			OSStatus status = noErr;
-			
-			// Set audio unit input/output stream format to processing format.
-			if (noErr == status)
-			{
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, processingFormat, sizeof(AudioStreamBasicDescription));
-			}
-			if (noErr == status)
-			{
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, processingFormat, sizeof(AudioStreamBasicDescription));
-			}
-			
-			// Set audio unit render callback.
-			if (noErr == status)
-			{
-				AURenderCallbackStruct renderCallbackStruct;
-				renderCallbackStruct.inputProc = AU_RenderCallback;
-				renderCallbackStruct.inputProcRefCon = (void *)tap;
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &renderCallbackStruct, sizeof(AURenderCallbackStruct));
-			}
-			
-			// Set audio unit maximum frames per slice to max frames.
-			if (noErr == status)
-			{
-				UInt32 maximumFramesPerSlice = maxFrames;
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maximumFramesPerSlice, (UInt32)sizeof(UInt32));
-			}
-			
-			// Initialize audio unit.
-			if (noErr == status)
-			{
-				status = AudioUnitInitialize(audioUnit);
-			}
-			
-			if (noErr != status)
-			{
-				AudioComponentInstanceDispose(audioUnit);
-				audioUnit = NULL;
-			}
-			
-			context->audioUnit = audioUnit;
+			MYAudioTapProcessor *self = ((__bridge MYAudioTapProcessor *)context->self);
+			setBandpassFilterParameters(context->filterBank, context->sampleRate, self.centerFrequency, self.bandwidth);
 		}
 	}
 }
@@ -323,13 +285,22 @@ static void tap_UnprepareCallback(MTAudioProcessingTapRef tap)
 {
 	AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(tap);
 	
-	/* Release bandpass filter Audio Unit */
+	/* Release metering engine (the source's cancel handler disposes of it) */
 	
-	if (context->audioUnit)
+	if (context->meteringSource)
 	{
-		AudioUnitUninitialize(context->audioUnit);
-		AudioComponentInstanceDispose(context->audioUnit);
-		context->audioUnit = NULL;
+		dispatch_source_t meteringSource = (__bridge_transfer dispatch_source_t)context->meteringSource;
+		dispatch_source_cancel(meteringSource);
+		context->meteringSource = NULL;
+		context->meteringEngine = NULL;
+	}
+	
+	/* Release bandpass filter */
+	
+	if (context->filterBank)
+	{
+		CABiquadFilterBankDispose(context->filterBank);
+		context->filterBank = NULL;
 	}
 }
 
@@ -346,79 +317,43 @@ static void tap_ProcessCallback(MTAudioProcessingTapRef tap, CMItemCount numberF
 		return;
 	}
 	
-	MYAudioTapProcessor *self = ((__bridge MYAudioTapProcessor *)context->self);
-	
-	if (self.isBandpassFilterEnabled)
-	{
-		// Apply bandpass filter Audio Unit.
-		AudioUnit audioUnit = context->audioUnit;
-		if (audioUnit)
-		{
-			AudioTimeStamp audioTimeStamp;
-			audioTimeStamp.mSampleTime = context->sampleCount;
-			audioTimeStamp.mFlags = kAudioTimeStampSampleTimeValid;
-			
-			status = AudioUnitRender(audioUnit, 0, &audioTimeStamp, 0, (UInt32)numberFrames, bufferListInOut);
-			if (noErr != status)
-			{
-				NSLog(@"AudioUnitRender(): %d", (int)status);
-				return;
-			}
-			
-			// Increment sample count for audio unit.
-			context->sampleCount += numberFrames;
-			
-			// Set number of frames out.
-			*numberFramesOut = numberFrames;
-		}
-	}
-	else
+	// Get actual audio buffers from MTAudioProcessingTap.
+	status = MTAudioProcessingTapGetSourceAudio(tap, numberFrames, bufferListInOut, flagsOut, NULL, numberFramesOut);
+	if (noErr != status)
 	{
-		// Get actual audio buffers from MTAudioProcessingTap (AudioUnitRender() will fill bufferListInOut otherwise).
-		status = MTAudioProcessingTapGetSourceAudio(tap, numberFrames, bufferListInOut, flagsOut, NULL, numberFramesOut);
-		if (noErr != status)
-		{
-			NSLog(@"MTAudioProcessingTapGetSourceAudio: %d", (int)status);
-			return;
-		}
+		NSLog(@"MTAudioProcessingTapGetSourceAudio: %d", (int)status);
+		return;
 	}
 	
-	// Calculate root mean square (RMS) for left and right audio channel.
-	for (UInt32 i = 0; i < bufferListInOut->mNumberBuffers; i++)
+	MYAudioTapProcessor *self = ((__bridge MYAudioTapProcessor *)context->self);
+	
+	if (self.isBandpassFilterEnabled && context->filterBank)
 	{
-		AudioBuffer *pBuffer = &bufferListInOut->mBuffers[i];
-		UInt32 cSamples = numberFrames * (context->isNonInterleaved ? 1 : pBuffer->mNumberChannels);
+		// Start from silence rather than from whatever was in the filter when it was last turned off.
+		if (!context->wasFilterEnabled)
+			CABiquadFilterBankReset(context->filterBank);
 		
-		float *pData = (float *)pBuffer->mData;
-		
-		float rms = 0.0f;
-		for (UInt32 j = 0; j < cSamples; j++)
-		{
-			rms += pData[j] * pData[j];
-		}
-		if (cSamples > 0)
-		{
-			rms = sqrtf(rms / cSamples);
-		}
-		
-		if (0 == i)
-		{
-			context->leftChannelVolume = rms;
-		}
-		if (1 == i || (0 == i && 1 == bufferListInOut->mNumberBuffers))
-		{
-			context->rightChannelVolume = rms;
-		}
+		// Apply bandpass filter in place.
+		CABiquadFilterBankProcess(context->filterBank, bufferListInOut, (UInt32)*numberFramesOut);
 	}
+	context->wasFilterEnabled = self.isBandpassFilterEnabled;
 	
-	// Pass calculated left and right channel volume to VU meters.
-	[self updateLeftChannelVolume:context->leftChannelVolume rightChannelVolume:context->rightChannelVolume];
+	// Measure levels, and let the main queue know there are new ones to show.
+	if (context->meteringEngine)
+	{
+		CAMeteringEngineProcess(context->meteringEngine, bufferListInOut, (UInt32)numberFrames);
+		dispatch_source_merge_data((__bridge dispatch_source_t)context->meteringSource, 1);
+	}
 }
 
-#pragma mark - Audio Unit Callbacks
+#pragma mark - Bandpass Filter
 
-OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData)
+static void setBandpassFilterParameters(CABiquadFilterBank *filterBank, Float64 sampleRate, float centerFrequency, float bandwidth)
 {
-	// Just return audio buffers from MTAudioProcessingTap.
-	return MTAudioProcessingTapGetSourceAudio(inRefCon, inNumberFrames, ioData, NULL, NULL, NULL);
+	CABiquadParameters parameters;
+	parameters.type = kCABiquadFilterType_BandPass;
+	parameters.frequency = (20.0f + ((sampleRate * 0.5f) - 20.0f) * centerFrequency); // Hz, 20->(SampleRate/2), 5000
+	parameters.bandwidth = (100.0f + 11900.0f * bandwidth) / 1200.0f; // Cents, 100->12000, 600, as octaves
+	parameters.gain = 0.0f;
+	CABiquadFilterBankSetStage(filterBank, 0, &parameters);
 }
@@ -0,0 +1,180 @@
+//	Times CABiquadFilterBankProcess per frame for a few channel and stage
+//	counts, interleaved and not, in 512 frame buffers as the tap hands them
+//	over. First checks the gains the filters are meant to have, that
+//	interleaved and split buffers come out the same, and that sweeping the
+//	frequency doesn't click. Pass a buffer count to run longer than ctest does.
+#include "CABiquadFilterBank.h"
+#include "TestSupport.h"
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+static const double kSampleRate = 48000.;
+static const UInt32 kSliceFrames = 512;
+
+// a buffer list over audio for inChannels channels, interleaved in one buffer or split one per channel
+class TestBuffers {
+public:
+	TestBuffers(UInt32 inChannels, UInt32 inFrames, bool inIsInterleaved)
+		: mChannels(inChannels), mFrames(inFrames), mIsInterleaved(inIsInterleaved), mSamples(inChannels * inFrames),
+		  mMemory(sizeof(AudioBufferList) + inChannels * sizeof(AudioBuffer)) {}
+	
+	float& Sample(UInt32 inChannel, UInt32 inFrame) { return mIsInterleaved ? mSamples[inFrame * mChannels + inChannel] : mSamples[inChannel * mFrames + inFrame]; }
+	
+	// the buffer list for inNumFrames frames from inFrame on
+	AudioBufferList* Slice(UInt32 inFrame, UInt32 inNumFrames)
+	{
+		AudioBufferList* list = (AudioBufferList*)mMemory.data();
+		list->mNumberBuffers = mIsInterleaved ? 1 : mChannels;
+		for (UInt32 i = 0; i < list->mNumberBuffers; ++i) {
+			UInt32 stride = mIsInterleaved ? mChannels : 1;
+			list->mBuffers[i].mNumberChannels = stride;
+			list->mBuffers[i].mDataByteSize = inNumFrames * stride * sizeof(float);
+			list->mBuffers[i].mData = &Sample(i, inFrame);
+		}
+		return list;
+	}
+	
+	void Process(CABiquadFilterBank* inBank)
+	{
+		for (UInt32 frame = 0; frame < mFrames; frame += kSliceFrames)
+			CABiquadFilterBankProcess(inBank, Slice(frame, kSliceFrames), kSliceFrames);
+	}
+	
+private:
+	UInt32 mChannels, mFrames;
+	bool mIsInterleaved;
+	std::vector<float> mSamples;
+	std::vector<char> mMemory;
+};
+
+// the gain in dB of the bank at inHz, measured on the last channel once the filters have settled
+static double gainAt(CABiquadFilterBank* bank, double inHz, UInt32 channels, bool isInterleaved)
+{
+	const UInt32 kFrames = 96 * kSliceFrames;
+	CABiquadFilterBankReset(bank);
+	TestBuffers buffers(channels, kFrames, isInterleaved);
+	for (UInt32 frame = 0; frame < kFrames; ++frame)
+		for (UInt32 channel = 0; channel < channels; ++channel)
+			buffers.Sample(channel, frame) = (float)sin(2. * M_PI * inHz * frame / kSampleRate);
+	buffers.Process(bank);
+	
+	double peak = 0.;
+	for (UInt32 frame = kFrames / 2; frame < kFrames; ++frame) peak = fmax(peak, fabs(buffers.Sample(channels - 1, frame)));
+	return 20. * log10(peak);
+}
+
+static void testGains()
+{
+	struct { CABiquadParameters parameters; double hz; double expectedDB; } const kCases[] = {
+		{ { kCABiquadFilterType_BandPass, 1000.f, 1.f, 0.f }, 1000., 0. },
+		{ { kCABiquadFilterType_BandPass, 1000.f, 1.f, 0.f }, 707.1, -3. },		// half an octave below, the band edge
+		{ { kCABiquadFilterType_LowPass, 1000.f, 1.9f, 0.f }, 1000., -3. },
+		{ { kCABiquadFilterType_LowPass, 500.f, 1.9f, 0.f }, 2000., -24. },		// two octaves up at 12 dB an octave
+		{ { kCABiquadFilterType_HighPass, 1000.f, 1.9f, 0.f }, 1000., -3. },
+		{ { kCABiquadFilterType_Peaking, 4000.f, 1.f, 6.f }, 4000., 6. },
+		{ { kCABiquadFilterType_LowShelf, 500.f, 1.9f, -6.f }, 50., -6. },
+		{ { kCABiquadFilterType_HighShelf, 1000.f, 1.9f, 6.f }, 8000., 6. },
+		{ { kCABiquadFilterType_Bypass, 1000.f, 1.f, 0.f }, 3000., 0. }
+	};
+	for (UInt32 channels : { 1u, 2u, 5u }) {
+		for (bool isInterleaved : { true, false }) {
+			for (const auto& test : kCases) {
+				CABiquadFilterBank* bank = CABiquadFilterBankCreate(channels, kSampleRate, 1);
+				CABiquadFilterBankSetStage(bank, 0, &test.parameters);
+				double gain = gainAt(bank, test.hz, channels, isInterleaved);
+				TEST_CHECK(fabs(gain - test.expectedDB) < 1., "type %u at %.0f Hz, %u channels %s: %.2f dB, expected %.0f", (unsigned)test.parameters.type, test.hz, (unsigned)channels, isInterleaved ? "interleaved" : "split", gain, test.expectedDB);
+				CABiquadFilterBankDispose(bank);
+			}
+		}
+	}
+}
+
+static void testLayoutsMatch()
+{
+	// the same noise through the same cascade, interleaved and split
+	const UInt32 kChannels = 3, kFrames = 16 * kSliceFrames;
+	TestBuffers interleaved(kChannels, kFrames, true), split(kChannels, kFrames, false);
+	srand(1);
+	for (UInt32 frame = 0; frame < kFrames; ++frame)
+		for (UInt32 channel = 0; channel < kChannels; ++channel)
+			interleaved.Sample(channel, frame) = split.Sample(channel, frame) = (float)rand() / RAND_MAX - .5f;
+	
+	CABiquadParameters low = { kCABiquadFilterType_LowPass, 3000.f, 1.9f, 0.f }, peak = { kCABiquadFilterType_Peaking, 800.f, 2.f, -9.f };
+	CABiquadFilterBank* banks[2];
+	for (CABiquadFilterBank*& bank : banks) {
+		bank = CABiquadFilterBankCreate(kChannels, kSampleRate, 2);
+		CABiquadFilterBankSetStage(bank, 0, &low);
+		CABiquadFilterBankSetStage(bank, 1, &peak);
+	}
+	interleaved.Process(banks[0]);
+	split.Process(banks[1]);
+	
+	float worst = 0.f;
+	for (UInt32 frame = 0; frame < kFrames; ++frame)
+		for (UInt32 channel = 0; channel < kChannels; ++channel)
+			worst = fmaxf(worst, fabsf(interleaved.Sample(channel, frame) - split.Sample(channel, frame)));
+	TEST_CHECK(worst < 1e-6f, "interleaved and split buffers differ by up to %g", worst);
+	for (CABiquadFilterBank* bank : banks) CABiquadFilterBankDispose(bank);
+}
+
+static void testSweepIsSmooth()
+{
+	// a 1 kHz tone through a band pass swept from 200 Hz to 5 kHz and back a slice at a time: the
+	// output may only change as fast as the tone itself could, never jump
+	const UInt32 kFrames = 200 * kSliceFrames;
+	TestBuffers buffers(1, kFrames, true);
+	for (UInt32 frame = 0; frame < kFrames; ++frame) buffers.Sample(0, frame) = (float)sin(2. * M_PI * 1000. * frame / kSampleRate);
+	
+	CABiquadFilterBank* bank = CABiquadFilterBankCreate(1, kSampleRate, 1);
+	float worstStep = 0.f, last = 0.f;
+	for (UInt32 slice = 0; slice < kFrames / kSliceFrames; ++slice) {
+		double t = (double)slice / (kFrames / kSliceFrames);
+		CABiquadParameters parameters = { kCABiquadFilterType_BandPass, (float)(200. * pow(25., t < .5 ? 2. * t : 2. - 2. * t)), 1.f, 0.f };
+		CABiquadFilterBankSetStage(bank, 0, &parameters);
+		CABiquadFilterBankProcess(bank, buffers.Slice(slice * kSliceFrames, kSliceFrames), kSliceFrames);
+		for (UInt32 frame = 0; frame < kSliceFrames; ++frame) {
+			float sample = buffers.Sample(0, slice * kSliceFrames + frame);
+			worstStep = fmaxf(worstStep, fabsf(sample - last));
+			last = sample;
+		}
+	}
+	float toneStep = (float)(2. * M_PI * 1000. / kSampleRate);
+	TEST_CHECK(worstStep < 1.1f * toneStep, "the sweep stepped by %.4f, the tone can by %.4f", worstStep, toneStep);
+	CABiquadFilterBankDispose(bank);
+}
+
+static void bench(UInt32 numBuffers)
+{
+	printf("%-8s %-6s %-12s %10s\n", "channels", "stages", "layout", "ns/frame");
+	for (UInt32 channels : { 1u, 2u, 4u, 6u }) {
+		for (UInt32 stages : { 1u, 4u, 8u }) {
+			for (bool isInterleaved : { true, false }) {
+				CABiquadFilterBank* bank = CABiquadFilterBankCreate(channels, kSampleRate, stages);
+				for (UInt32 stage = 0; stage < stages; ++stage) {
+					CABiquadParameters parameters = { kCABiquadFilterType_Peaking, 100.f * (stage + 1), 1.f, 3.f };
+					CABiquadFilterBankSetStage(bank, stage, &parameters);
+				}
+				TestBuffers buffers(channels, kSliceFrames, isInterleaved);
+				for (UInt32 frame = 0; frame < kSliceFrames; ++frame)
+					for (UInt32 channel = 0; channel < channels; ++channel)
+						buffers.Sample(channel, frame) = (float)rand() / RAND_MAX - .5f;
+				AudioBufferList* list = buffers.Slice(0, kSliceFrames);
+				
+				double seconds = TestTime(numBuffers, [&]() { CABiquadFilterBankProcess(bank, list, kSliceFrames); });
+				printf("%-8u %-6u %-12s %10.1f\n", (unsigned)channels, (unsigned)stages, isInterleaved ? "interleaved" : "split", seconds / ((double)numBuffers * kSliceFrames) * 1e9);
+				CABiquadFilterBankDispose(bank);
+			}
+		}
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	testGains();
+	testLayoutsMatch();
+	testSweepIsSmooth();
+	bench(argc > 1 ? (UInt32)atoi(argv[1]) : 200);
+	if (gTestFailures == 0) printf("CABiquadFilterBankBench: all passed\n");
+	return gTestFailures == 0 ? 0 : 1;
+}
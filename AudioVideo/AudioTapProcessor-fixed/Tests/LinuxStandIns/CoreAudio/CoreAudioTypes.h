@@ -0,0 +1,30 @@
+//	Just enough of CoreAudioTypes.h to build the AudioTapProcessor's portable
+//	classes on a machine without the Apple SDKs. Values match the real header.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t UInt8;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef float Float32;
+typedef double Float64;
+typedef int32_t OSStatus;
+
+enum { noErr = 0 };
+
+typedef struct AudioBuffer
+{
+	UInt32	mNumberChannels;
+	UInt32	mDataByteSize;
+	void*	mData;
+} AudioBuffer;
+
+typedef struct AudioBufferList
+{
+	UInt32		mNumberBuffers;
+	AudioBuffer	mBuffers[1];
+} AudioBufferList;
@@ -0,0 +1,34 @@
+//	Small helpers shared by the AudioTapProcessor tests and benchmarks. Each test is its
+//	own executable that prints what failed and returns non-zero, so ctest needs
+//	nothing more.
+#pragma once
+
+#include <chrono>
+#include <stdio.h>
+
+#define TEST_CHECK(inCondition, ...)								\
+	do																\
+	{																\
+		if(!(inCondition))											\
+		{															\
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);		\
+			fprintf(stderr, __VA_ARGS__);							\
+			fprintf(stderr, "\n");									\
+			++gTestFailures;										\
+		}															\
+	}																\
+	while(0)
+
+static int gTestFailures = 0;
+
+//	seconds taken by inIterations calls of inBlock
+template <typename F>
+double	TestTime(UInt32 inIterations, F inBlock)
+{
+	auto theStart = std::chrono::steady_clock::now();
+	for(UInt32 theIteration = 0; theIteration < inIterations; ++theIteration)
+	{
+		inBlock();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - theStart).count();
+}
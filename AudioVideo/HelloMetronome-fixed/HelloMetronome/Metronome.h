@@ -17,6 +17,7 @@
 - (BOOL)start;
 - (void)stop;
 - (void)setTempo:(Float32)tempo;
+- (void)setTempo:(Float32)tempo rampBeats:(UInt32)rampBeats; // glides to the new tempo over rampBeats beats
 
 @property(weak, nullable) id<MetronomeDelegate> delegate;
 
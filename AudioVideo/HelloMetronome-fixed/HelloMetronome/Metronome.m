@@ -8,9 +8,17 @@
 
 #import "Metronome.h"
 #import "HelloMetronome-Swift.h"
+#import "ClickTrack.h"
 
 static const float kBipDurationSeconds = 0.020f;
-static const float kTempoChangeResponsivenessSeconds = 0.250f;
+
+// The click track is rendered ahead into this many buffers, which the player plays back to back.
+// Together they set how soon a tempo change is heard (about 140 ms at 44.1 kHz).
+enum {
+    kRenderBufferFrames = 2048,
+    kNumRenderBuffers = 3,
+    kMaxBeatsPerRenderBuffer = 16
+};
 
 @interface Metronome () {
     AVAudioEngine     * _engine;
@@ -20,17 +28,13 @@ static const float kTempoChangeResponsivenessSeconds = 0.250f;
     AVAudioPCMBuffer * _soundBuf2;
     AVAudioPCMBuffer * _soundBuffer[2];
     
-    SInt32  _bufferNumber;
+    AVAudioPCMBuffer * _renderBuffer[kNumRenderBuffers];
+    ClickTrack       * _clickTrack; // only used on _syncQueue
+    
     Float64 _bufferSampleRate;
     
     dispatch_queue_t _syncQueue;
     
-    Float32 _tempoBPM;
-    SInt32  _beatNumber;
-    Float64 _nextBeatSampleTime;
-    SInt32  _beatsToScheduleAhead; // controls responsiveness to tempo changes
-    SInt32  _beatsScheduled;
-    
     BOOL    _playing;
     BOOL    _playerStarted;
     
@@ -103,10 +107,21 @@ static const float kTempoChangeResponsivenessSeconds = 0.250f;
 		
 		_bufferSampleRate = format.sampleRate;
 		
+		// Create the click track with the bips, which alternate beat by beat, and the buffers it renders into.
+		_clickTrack = ClickTrackCreate(format.sampleRate, format.channelCount, 120);
+		if (_clickTrack == NULL) return nil;
+		
+		for (UInt32 i = 0; i < 2; ++i) {
+			ClickTrackSetSound(_clickTrack, i, (const float * const *)_soundBuffer[i].floatChannelData, _soundBuffer[i].frameLength);
+		}
+		
+		for (UInt32 i = 0; i < kNumRenderBuffers; ++i) {
+			_renderBuffer[i] = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:kRenderBufferFrames];
+			_renderBuffer[i].frameLength = kRenderBufferFrames;
+		}
+		
 		// Create a dispatch queue for synchronizing callbacks.
 		_syncQueue = dispatch_queue_create("Metronome", DISPATCH_QUEUE_SERIAL);
-		
-		[self setTempo: 120];
 	}
     
 	return self;
@@ -121,56 +136,56 @@ static const float kTempoChangeResponsivenessSeconds = 0.250f;
     _engine = nil;
     _soundBuf1 = nil;
     _soundBuf2 = nil;
+    
+    ClickTrackDispose(_clickTrack);
 }
 
 // The caller is responsible for calling this method on _syncQueue.
-- (void)scheduleBeats {
+- (void)scheduleRenderBuffer:(UInt32)bufferIndex {
 	if (!_playing) return;
 	
-	while (_beatsScheduled < _beatsToScheduleAhead) {
-		// Schedule the beat.
-        
-		float secondsPerBeat = 60.0f / _tempoBPM;
-		float samplesPerBeat = (float)(secondsPerBeat * _bufferSampleRate);
-		AVAudioFramePosition beatSampleTime = (AVAudioFramePosition)_nextBeatSampleTime;
-		AVAudioTime *playerBeatTime = [AVAudioTime timeWithSampleTime: beatSampleTime atRate: _bufferSampleRate];
-			// This time is relative to the player's start time.
-
-        [_player scheduleBuffer:_soundBuffer[_bufferNumber] atTime:playerBeatTime options:0 completionHandler:^{
-            dispatch_sync(_syncQueue, ^{
-				_beatsScheduled -= 1;
-                _bufferNumber ^= 1;
-				[self scheduleBeats];
-			});
-		}];
-		
-        _beatsScheduled += 1;
-		
-        if (!_playerStarted) {
-			// We defer the starting of the player so that the first beat will play precisely
-			// at player time 0. Having scheduled the first beat, we need the player to be running
-			// in order for nodeTimeForPlayerTime to return a non-nil value.
-			[_player play];
-			_playerStarted = YES;
-		}
+	// Render the next stretch of the click track. The beats are mixed in on the exact sample frames the tempo
+	// puts them on, so however late this runs, the player plays them on time as long as it has the buffer.
+	AVAudioPCMBuffer *buffer = _renderBuffer[bufferIndex];
+	AVAudioFramePosition bufferSampleTime = ClickTrackGetFrame(_clickTrack);
+	ClickTrackOnset beats[kMaxBeatsPerRenderBuffer];
+	UInt32 beatCount = ClickTrackRender(_clickTrack, buffer.floatChannelData, kRenderBufferFrames, beats, kMaxBeatsPerRenderBuffer);
+	
+	AVAudioTime *playerBufferTime = [AVAudioTime timeWithSampleTime: bufferSampleTime atRate: _bufferSampleRate];
+		// This time is relative to the player's start time.
+	
+	[_player scheduleBuffer:buffer atTime:playerBufferTime options:0 completionHandler:^{
+		// The player is done with the buffer, so render the next stretch into it.
+		dispatch_sync(_syncQueue, ^{
+			[self scheduleRenderBuffer: bufferIndex];
+		});
+	}];
+	
+	if (!_playerStarted) {
+		// We defer the starting of the player so that the first beat will play precisely
+		// at player time 0. Having scheduled the first buffer, we need the player to be running
+		// in order for nodeTimeForPlayerTime to return a non-nil value.
+		[_player play];
+		_playerStarted = YES;
+	}
+	
+	// Schedule the delegate callback (metronomeTicking:bar:beat:) for each beat if necessary.
+	if (_delegate && [_delegate respondsToSelector: @selector(metronomeTicking:bar:beat:)]) {
+		AVAudioIONode *output = _engine.outputNode;
+		uint64_t latencyHostTicks = [AVAudioTime hostTimeForSeconds: output.presentationLatency];
 		
-		// Schedule the delegate callback (metronomeTicking:bar:beat:) if necessary.
-		int callbackBeat = _beatNumber++;
-		if (_delegate && [_delegate respondsToSelector: @selector(metronomeTicking:bar:beat:)]) {
+		for (UInt32 i = 0; i < beatCount; ++i) {
+			AVAudioTime *playerBeatTime = [AVAudioTime timeWithSampleTime: beats[i].frame atRate: _bufferSampleRate];
 			AVAudioTime *nodeBeatTime = [_player nodeTimeForPlayerTime: playerBeatTime];
+			if (nodeBeatTime == nil) continue;
 			
-            AVAudioIONode *output = _engine.outputNode;
-			
-			//NSLog(@"%@ %@ %.6f", playerBeatTime, nodeBeatTime, output.presentationLatency);
-			uint64_t latencyHostTicks = [AVAudioTime hostTimeForSeconds: output.presentationLatency];
+			SInt32 callbackBeat = (SInt32)beats[i].beat;
 			dispatch_after(dispatch_time(nodeBeatTime.hostTime + latencyHostTicks, 0), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
 				// hardcoded to 4/4 meter
 				if (_playing)
 					[_delegate metronomeTicking: self bar: (callbackBeat / 4) + 1 beat: (callbackBeat % 4) + 1];
 			});
 		}
-        
-		_nextBeatSampleTime += samplesPerBeat;
 	}
 }
 
@@ -179,11 +194,13 @@ static const float kTempoChangeResponsivenessSeconds = 0.250f;
 	if (![_engine startAndReturnError:nil]) return NO;
 
 	_playing = YES;
-	_nextBeatSampleTime = 0;
-	_beatNumber = 0;
 	
 	dispatch_sync(_syncQueue, ^{
-		[self scheduleBeats];
+		// Start the click track over at player time 0, and fill every render buffer.
+		ClickTrackReset(_clickTrack);
+		for (UInt32 i = 0; i < kNumRenderBuffers; ++i) {
+			[self scheduleRenderBuffer: i];
+		}
 	});
 	
 	return YES;
@@ -214,11 +231,14 @@ static const float kTempoChangeResponsivenessSeconds = 0.250f;
 }
 
 - (void)setTempo: (float)tempo {
-	_tempoBPM = tempo;
+	[self setTempo: tempo rampBeats: 0];
+}
 
-	float secondsPerBeat = 60.0f / _tempoBPM;
-	_beatsToScheduleAhead = (SInt32)(kTempoChangeResponsivenessSeconds / secondsPerBeat);
-	if (_beatsToScheduleAhead < 1) _beatsToScheduleAhead = 1;
+- (void)setTempo: (float)tempo rampBeats: (UInt32)rampBeats {
+	// The change is heard once the buffers already rendered have played.
+	dispatch_sync(_syncQueue, ^{
+		ClickTrackSetTempo(_clickTrack, tempo, rampBeats);
+	});
 }
 
 @end
\ No newline at end of file
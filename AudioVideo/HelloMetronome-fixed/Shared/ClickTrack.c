@@ -0,0 +1,243 @@
+/*
+ Copyright (C) 2017 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+
+ Abstract:
+ Sample accurate click track renderer
+*/
+
+#include "ClickTrack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct ClickTrackSound {
+    float      *samples;        // channelCount runs of frameCount samples
+    uint32_t    frameCount;
+} ClickTrackSound;
+
+typedef struct ClickTrackVoice {
+    int32_t     sound;          // -1 when the voice is free
+    uint32_t    position;       // the next frame of the sound to mix in
+    int64_t     beat;
+} ClickTrackVoice;
+
+struct ClickTrack {
+    double          sampleRate;
+    uint32_t        channelCount;
+
+    ClickTrackSound sounds[kClickTrackMaxSounds];
+    uint32_t        soundCount;     // one past the highest sound set
+    ClickTrackVoice voices[kClickTrackMaxVoices];
+
+    int64_t         frame;          // where the next block starts
+    int64_t         nextBeat;       // the first beat not yet started
+
+    // The tempo from anchorBeat on: the interval into beat anchorBeat + n is fromFramesPerBeat ramping to
+    // toFramesPerBeat for n from 1 to rampBeats, and toFramesPerBeat after that.
+    int64_t         anchorBeat;
+    double          anchorPosition; // the frame, with its fraction, that anchorBeat falls on
+    double          fromFramesPerBeat;
+    double          toFramesPerBeat;
+    uint32_t        rampBeats;
+};
+
+static double FramesPerBeat(const ClickTrack *track, double tempoBPM)
+{
+    double framesPerBeat = 60.0 * track->sampleRate / tempoBPM;
+    return (framesPerBeat < 1.0) ? 1.0 : framesPerBeat;
+}
+
+// The interval into beat anchorBeat + n, for n >= 1.
+static double BeatInterval(const ClickTrack *track, int64_t n)
+{
+    if (n > (int64_t)track->rampBeats) return track->toFramesPerBeat;
+    return track->fromFramesPerBeat + (track->toFramesPerBeat - track->fromFramesPerBeat) * (double)n / (double)track->rampBeats;
+}
+
+// The frame, with its fraction, that beat falls on. Sums the ramp in closed form.
+static double BeatPosition(const ClickTrack *track, int64_t beat)
+{
+    double n = (double)(beat - track->anchorBeat);
+    double from = track->fromFramesPerBeat;
+    double delta = track->toFramesPerBeat - from;
+    double ramp = (double)track->rampBeats;
+
+    if (track->rampBeats == 0) {
+        return track->anchorPosition + n * track->toFramesPerBeat;
+    }
+    if (n <= ramp) {
+        return track->anchorPosition + n * from + delta * n * (n + 1.0) / (2.0 * ramp);
+    }
+    return track->anchorPosition + ramp * from + delta * (ramp + 1.0) * 0.5 + (n - ramp) * track->toFramesPerBeat;
+}
+
+static int64_t BeatFrame(const ClickTrack *track, int64_t beat)
+{
+    return (int64_t)floor(BeatPosition(track, beat) + 0.5);
+}
+
+// Mixes a voice into frames [offset, frameCount) of the block, freeing it once its sound has been played out.
+static void MixVoice(ClickTrack *track, ClickTrackVoice *voice, float * const *channels, uint32_t offset, uint32_t frameCount)
+{
+    const ClickTrackSound *sound = &track->sounds[voice->sound];
+    uint32_t count = sound->frameCount - voice->position;
+    if (count > frameCount - offset) count = frameCount - offset;
+
+    for (uint32_t ch = 0; ch < track->channelCount; ++ch) {
+        const float *src = sound->samples + (size_t)ch * sound->frameCount + voice->position;
+        float *dst = channels[ch] + offset;
+        for (uint32_t i = 0; i < count; ++i) {
+            dst[i] += src[i];
+        }
+    }
+
+    voice->position += count;
+    if (voice->position >= sound->frameCount) voice->sound = -1;
+}
+
+ClickTrack *ClickTrackCreate(double sampleRate, uint32_t channelCount, double tempoBPM)
+{
+    if (sampleRate <= 0.0 || channelCount == 0 || tempoBPM <= 0.0) return NULL;
+
+    ClickTrack *track = (ClickTrack *)calloc(1, sizeof(ClickTrack));
+    if (track == NULL) return NULL;
+
+    track->sampleRate = sampleRate;
+    track->channelCount = channelCount;
+    track->fromFramesPerBeat = track->toFramesPerBeat = FramesPerBeat(track, tempoBPM);
+    ClickTrackReset(track);
+
+    return track;
+}
+
+void ClickTrackDispose(ClickTrack *track)
+{
+    if (track == NULL) return;
+
+    for (uint32_t i = 0; i < kClickTrackMaxSounds; ++i) {
+        free(track->sounds[i].samples);
+    }
+    free(track);
+}
+
+bool ClickTrackSetSound(ClickTrack *track, uint32_t soundIndex, const float * const *channels, uint32_t frameCount)
+{
+    if (soundIndex >= kClickTrackMaxSounds) return false;
+
+    float *samples = NULL;
+    if (frameCount > 0) {
+        samples = (float *)malloc((size_t)track->channelCount * frameCount * sizeof(float));
+        if (samples == NULL) return false;
+
+        for (uint32_t ch = 0; ch < track->channelCount; ++ch) {
+            memcpy(samples + (size_t)ch * frameCount, channels[ch], frameCount * sizeof(float));
+        }
+    }
+
+    // Voices still playing the old sound stop rather than read freed memory.
+    for (uint32_t i = 0; i < kClickTrackMaxVoices; ++i) {
+        if (track->voices[i].sound == (int32_t)soundIndex) track->voices[i].sound = -1;
+    }
+
+    free(track->sounds[soundIndex].samples);
+    track->sounds[soundIndex].samples = samples;
+    track->sounds[soundIndex].frameCount = frameCount;
+
+    track->soundCount = 0;
+    for (uint32_t i = 0; i < kClickTrackMaxSounds; ++i) {
+        if (track->sounds[i].frameCount > 0) track->soundCount = i + 1;
+    }
+
+    return true;
+}
+
+void ClickTrackSetTempo(ClickTrack *track, double tempoBPM, uint32_t rampBeats)
+{
+    if (tempoBPM <= 0.0) return;
+
+    // Start again from the next beat, which keeps the frame the current tempo gave it, and ramp from the
+    // interval that led into it (or from wherever a ramp that hasn't got going yet was starting).
+    int64_t n = track->nextBeat - track->anchorBeat;
+    double from = (n > 0) ? BeatInterval(track, n) : track->fromFramesPerBeat;
+
+    track->anchorPosition = BeatPosition(track, track->nextBeat);
+    track->anchorBeat = track->nextBeat;
+    track->fromFramesPerBeat = from;
+    track->toFramesPerBeat = FramesPerBeat(track, tempoBPM);
+    track->rampBeats = rampBeats;
+}
+
+double ClickTrackGetTempo(const ClickTrack *track)
+{
+    return 60.0 * track->sampleRate / track->toFramesPerBeat;
+}
+
+void ClickTrackReset(ClickTrack *track)
+{
+    track->frame = 0;
+    track->nextBeat = 0;
+    track->anchorBeat = 0;
+    track->anchorPosition = 0.0;
+    track->fromFramesPerBeat = track->toFramesPerBeat;
+    track->rampBeats = 0;
+
+    for (uint32_t i = 0; i < kClickTrackMaxVoices; ++i) {
+        track->voices[i].sound = -1;
+    }
+}
+
+uint32_t ClickTrackRender(ClickTrack *track, float * const *channels, uint32_t frameCount,
+                          ClickTrackOnset *onsets, uint32_t maxOnsets)
+{
+    for (uint32_t ch = 0; ch < track->channelCount; ++ch) {
+        memset(channels[ch], 0, frameCount * sizeof(float));
+    }
+
+    // Carry on with the beats still ringing from earlier blocks.
+    for (uint32_t i = 0; i < kClickTrackMaxVoices; ++i) {
+        if (track->voices[i].sound >= 0) MixVoice(track, &track->voices[i], channels, 0, frameCount);
+    }
+
+    // Start the beats that fall in this block.
+    uint32_t onsetCount = 0;
+    int64_t endFrame = track->frame + frameCount;
+
+    for (int64_t beatFrame = BeatFrame(track, track->nextBeat); beatFrame < endFrame; beatFrame = BeatFrame(track, track->nextBeat)) {
+        int64_t beat = track->nextBeat++;
+
+        uint32_t sound = (track->soundCount > 0) ? (uint32_t)(beat % track->soundCount) : 0;
+
+        if (onsetCount < maxOnsets) {
+            onsets[onsetCount].beat = beat;
+            onsets[onsetCount].frame = beatFrame;
+            onsets[onsetCount].sound = sound;
+            ++onsetCount;
+        }
+
+        if (track->sounds[sound].frameCount > 0) {
+            // Take a free voice, or else cut off the oldest beat.
+            ClickTrackVoice *voice = &track->voices[0];
+            for (uint32_t i = 0; i < kClickTrackMaxVoices; ++i) {
+                if (track->voices[i].sound < 0) { voice = &track->voices[i]; break; }
+                if (track->voices[i].beat < voice->beat) voice = &track->voices[i];
+            }
+
+            voice->sound = (int32_t)sound;
+            voice->position = 0;
+            voice->beat = beat;
+
+            // Beat frames only go up, so a beat never falls before the block.
+            MixVoice(track, voice, channels, (uint32_t)(beatFrame - track->frame), frameCount);
+        }
+    }
+
+    track->frame = endFrame;
+    return onsetCount;
+}
+
+int64_t ClickTrackGetFrame(const ClickTrack *track)
+{
+    return track->frame;
+}
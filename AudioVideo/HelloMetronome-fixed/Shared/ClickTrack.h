@@ -0,0 +1,75 @@
+/*
+ Copyright (C) 2017 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+
+ Abstract:
+ Sample accurate click track renderer
+*/
+
+#ifndef ClickTrack_h
+#define ClickTrack_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ A ClickTrack renders a metronome click straight into blocks of output frames. Every beat starts on
+ the sample frame its tempo puts it on, however the blocks are sized or however late they are asked for,
+ so the timing never depends on when the caller gets around to rendering the next block.
+
+ Beat n uses sound n % soundCount, so two sounds alternate just as the metronome's two bip buffers did.
+ The sounds are non-interleaved float with the track's channel count, and copied when they are set.
+ Beats may ring over one another, up to kClickTrackMaxVoices at once.
+
+ Tempo changes take effect from the next beat that has not been rendered yet, either at once or as a
+ ramp over a number of beats. Beat positions are worked out from the start of the current ramp rather
+ than added up beat by beat, so they don't drift however long the track plays.
+
+ Only ClickTrackCreate and ClickTrackSetSound allocate memory. A ClickTrack is not thread safe; the
+ caller should render it and change its tempo on the same thread or queue.
+*/
+
+enum {
+    kClickTrackMaxSounds = 4,
+    kClickTrackMaxVoices = 4
+};
+
+typedef struct ClickTrack ClickTrack;
+
+// A beat that starts in the block just rendered.
+typedef struct ClickTrackOnset {
+    int64_t     beat;       // counting from 0 at the last reset
+    int64_t     frame;      // the track frame the beat starts on
+    uint32_t    sound;
+} ClickTrackOnset;
+
+ClickTrack *ClickTrackCreate(double sampleRate, uint32_t channelCount, double tempoBPM);
+void ClickTrackDispose(ClickTrack *track);
+
+// channels holds the track's channel count of frameCount frame buffers. Setting a sound with no frames removes it.
+bool ClickTrackSetSound(ClickTrack *track, uint32_t soundIndex, const float * const *channels, uint32_t frameCount);
+
+// rampBeats is how many beats the tempo glides over to reach tempoBPM, 0 to change it at the next beat.
+void ClickTrackSetTempo(ClickTrack *track, double tempoBPM, uint32_t rampBeats);
+double ClickTrackGetTempo(const ClickTrack *track);
+
+// Starts the track over at frame 0, with beat 0 on frame 0 at the current tempo and nothing ringing.
+void ClickTrackReset(ClickTrack *track);
+
+// Renders the next frameCount frames into channels, which it overwrites. Beats that start among them are reported in
+// onsets, up to maxOnsets of them, and the number reported is returned. onsets may be NULL if maxOnsets is 0.
+uint32_t ClickTrackRender(ClickTrack *track, float * const *channels, uint32_t frameCount,
+                          ClickTrackOnset *onsets, uint32_t maxOnsets);
+
+// The track frame the next block will start on.
+int64_t ClickTrackGetFrame(const ClickTrack *track);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ClickTrack_h */
@@ -0,0 +1,119 @@
+// Renders the same tempo changes, ramps included, once in random block sizes and once a frame at a
+// time, and checks that every beat lands on the frame an independent beat-by-beat sum of its
+// intervals puts it on, and that both renders come out identical.
+#include "ClickTrack.h"
+#include "TestSupport.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#define kSampleRate     44100.0
+#define kTotalFrames    (44100 * 40)
+#define kMaxBeats       4096
+#define kClickFrames    16
+
+typedef struct TempoChange {
+    int64_t     afterBeat;      // set as soon as this beat has been rendered
+    double      tempoBPM;
+    uint32_t    rampBeats;
+} TempoChange;
+
+static const TempoChange kChanges[] = {
+    { 7, 90, 0 }, { 15, 200, 6 }, { 18, 57.3, 3 }, { 30, 133.7, 0 }, { 40, 61, 12 }
+};
+#define kChangeCount (sizeof(kChanges) / sizeof(kChanges[0]))
+
+static float sRandomOutput[kTotalFrames], sSingleOutput[kTotalFrames];
+static int64_t sRandomFrames[kMaxBeats], sSingleFrames[kMaxBeats];
+
+// Returns the number of beats rendered.
+static int64_t render(float *output, bool randomBlocks, int64_t *onsetFrames)
+{
+    ClickTrack *track = ClickTrackCreate(kSampleRate, 1, 120);
+    float click[kClickFrames] = { 1.0f };
+    const float *clickChannels[1] = { click };
+    ClickTrackSetSound(track, 0, clickChannels, kClickFrames);
+
+    int64_t frame = 0, beatCount = 0;
+    size_t change = 0;
+    srand(7);
+    while (frame < kTotalFrames) {
+        uint32_t blockFrames = randomBlocks ? 1 + rand() % 1500 : 1;
+        if (frame + blockFrames > kTotalFrames)
+            blockFrames = (uint32_t)(kTotalFrames - frame);
+
+        float *channel = output + frame;
+        ClickTrackOnset onsets[64];
+        uint32_t onsetCount = ClickTrackRender(track, &channel, blockFrames, onsets, 64);
+        for (uint32_t i = 0; i < onsetCount; ++i) {
+            TEST_CHECK(onsets[i].beat == beatCount, "beat %lld reported as %lld", (long long)beatCount, (long long)onsets[i].beat);
+            if (beatCount < kMaxBeats)
+                onsetFrames[beatCount] = onsets[i].frame;
+            ++beatCount;
+        }
+        frame += blockFrames;
+
+        // No block is longer than a beat, so each change goes in right after its beat and takes effect from the next.
+        while (change < kChangeCount && beatCount - 1 >= kChanges[change].afterBeat) {
+            TEST_CHECK(beatCount - 1 == kChanges[change].afterBeat, "tempo change %zu set late", change);
+            ClickTrackSetTempo(track, kChanges[change].tempoBPM, kChanges[change].rampBeats);
+            ++change;
+        }
+    }
+    ClickTrackDispose(track);
+    return beatCount;
+}
+
+int main(void)
+{
+    int64_t randomCount = render(sRandomOutput, true, sRandomFrames);
+    int64_t singleCount = render(sSingleOutput, false, sSingleFrames);
+    TEST_CHECK(randomCount == singleCount, "%lld beats in random blocks, %lld a frame at a time",
+               (long long)randomCount, (long long)singleCount);
+    TEST_CHECK(randomCount > 0 && randomCount <= kMaxBeats, "%lld beats", (long long)randomCount);
+    if (randomCount > kMaxBeats)
+        randomCount = kMaxBeats;
+
+    // The frames a ramp's intervals glide between, the beat it started on and how many beats it lasts.
+    long double position = 0, fromInterval = 60.0L * kSampleRate / 120, toInterval = fromInterval;
+    int64_t rampStart = 0;
+    uint32_t rampBeats = 0;
+    size_t change = 0;
+    for (int64_t beat = 0; beat < randomCount && beat < singleCount; ++beat) {
+        int64_t intoRamp = beat - rampStart;
+        long double interval = (rampBeats && intoRamp <= rampBeats)
+            ? fromInterval + (toInterval - fromInterval) * intoRamp / rampBeats : toInterval;
+        if (beat > 0)
+            position += interval;
+
+        int64_t expected = (int64_t)floorl(position + 0.5L);
+        TEST_CHECK(sRandomFrames[beat] == expected && sSingleFrames[beat] == expected,
+                   "beat %lld on frame %lld in random blocks and %lld a frame at a time, not %lld", (long long)beat,
+                   (long long)sRandomFrames[beat], (long long)sSingleFrames[beat], (long long)expected);
+        TEST_CHECK(expected < kTotalFrames && sRandomOutput[expected] == 1.0f && sSingleOutput[expected] == 1.0f,
+                   "no click on frame %lld for beat %lld", (long long)expected, (long long)beat);
+
+        if (change < kChangeCount && kChanges[change].afterBeat + 1 == beat) {
+            rampStart = beat;
+            fromInterval = beat > 0 ? interval : fromInterval;
+            toInterval = 60.0L * kSampleRate / kChanges[change].tempoBPM;
+            rampBeats = kChanges[change].rampBeats;
+            ++change;
+        }
+    }
+    TEST_CHECK(change == kChangeCount, "only %zu of the tempo changes were reached", change);
+
+    int64_t differences = 0, clicks = 0;
+    for (int64_t frame = 0; frame < kTotalFrames; ++frame) {
+        if (sRandomOutput[frame] != sSingleOutput[frame])
+            ++differences;
+        if (sRandomOutput[frame] == 1.0f)
+            ++clicks;
+    }
+    TEST_CHECK(differences == 0, "%lld frames differ between the two renders", (long long)differences);
+    TEST_CHECK(clicks == randomCount, "%lld clicks for %lld beats", (long long)clicks, (long long)randomCount);
+
+    if (gTestFailures == 0)
+        printf("ClickTrackTest: all passed\n");
+    return gTestFailures != 0;
+}
@@ -0,0 +1,20 @@
+// Small helpers shared by the HelloMetronome tests. Each test is its own executable that prints
+// what failed and returns non-zero, so ctest needs nothing more.
+#ifndef TestSupport_h
+#define TestSupport_h
+
+#include <stdio.h>
+
+#define TEST_CHECK(condition, ...)                              \
+    do {                                                        \
+        if (!(condition)) {                                     \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);     \
+            fprintf(stderr, __VA_ARGS__);                       \
+            fprintf(stderr, "\n");                              \
+            ++gTestFailures;                                    \
+        }                                                       \
+    } while (0)
+
+static int gTestFailures = 0;
+
+#endif /* TestSupport_h */
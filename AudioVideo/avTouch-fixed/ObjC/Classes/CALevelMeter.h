@@ -9,14 +9,17 @@
 #import <AVFoundation/AVFoundation.h>
 
 #include "MeterTable.h"
+#import "CASound.h"
 
 #define kPeakFalloffPerSec	.7
 #define kLevelFalloffPerSec .8
 #define kMinDBvalue -80.0
+#define kMaxMeterChannels 128
 
-// A LevelMeter subclass which is used specifically for AVAudioPlayer objects
+// A LevelMeter subclass which is used specifically for AVAudioPlayer and CASound objects
 @interface CALevelMeter : UIView {
 	AVAudioPlayer				*_player;
+	CASound						*_sound;
 	NSArray						*_channelNumbers;
 	NSArray						*_subLevelMeters;
 	MeterTable					*_meterTable;
@@ -29,8 +32,10 @@
 }
 
 - (void)setPlayer:(AVAudioPlayer*)v;
+- (void)setSound:(CASound*)v;
 
 @property (readonly)	AVAudioPlayer *player; // The AVAudioPlayer object
+@property (readonly)	CASound *sound; // A CASound object to meter instead, whose levels come as linear amplitudes
 @property (retain)		NSArray *channelNumbers; // Array of NSNumber objects: The indices of the channels to display in this meter
 @property				BOOL showsPeaks; // Whether or not we show peak levels
 @property				BOOL vertical; // Whether the view is oriented V or H
@@ -124,26 +124,35 @@
 	BOOL success = NO;
 
 	// if we have no queue, but still have levels, gradually bring them down
-	if (_player == NULL)
+	if ((_player == NULL) && (_sound == NULL))
 	{
-		CGFloat maxLvl = -1.;
 		CFAbsoluteTime thisFire = CFAbsoluteTimeGetCurrent();
 		// calculate how much time passed since the last draw
 		CFAbsoluteTime timePassed = thisFire - _peakFalloffLastFire;
-		for (LevelMeter *thisMeter in _subLevelMeters)
+		
+		// let every meter fall at once, each peak staying at or above its level
+		float levels[kMaxMeterChannels], peaks[kMaxMeterChannels];
+		NSUInteger numMeters = MIN([_subLevelMeters count], (NSUInteger)kMaxMeterChannels);
+		for (NSUInteger i=0; i<numMeters; i++)
+		{
+			LevelMeter *thisMeter = [_subLevelMeters objectAtIndex:i];
+			levels[i] = thisMeter.level;
+			peaks[i] = thisMeter.peakLevel;
+		}
+		MeterTable::Decay(levels, numMeters, timePassed * kLevelFalloffPerSec);
+		if (_showsPeaks) MeterTable::HoldPeaks(levels, peaks, numMeters, timePassed * kPeakFalloffPerSec);
+		
+		CGFloat maxLvl = -1.;
+		for (NSUInteger i=0; i<numMeters; i++)
 		{
-			CGFloat newPeak, newLevel;
-			newLevel = thisMeter.level - timePassed * kLevelFalloffPerSec;
-			if (newLevel < 0.) newLevel = 0.;
-			thisMeter.level = newLevel;
+			LevelMeter *thisMeter = [_subLevelMeters objectAtIndex:i];
+			thisMeter.level = levels[i];
 			if (_showsPeaks)
 			{
-				newPeak = thisMeter.peakLevel - timePassed * kPeakFalloffPerSec;
-				if (newPeak < 0.) newPeak = 0.;
-				thisMeter.peakLevel = newPeak;
-				if (newPeak > maxLvl) maxLvl = newPeak;
+				thisMeter.peakLevel = peaks[i];
+				if (peaks[i] > maxLvl) maxLvl = peaks[i];
 			}
-			else if (newLevel > maxLvl) maxLvl = newLevel;
+			else if (levels[i] > maxLvl) maxLvl = levels[i];
 			
 			[thisMeter setNeedsDisplay];
 		}
@@ -157,19 +166,44 @@
 		_peakFalloffLastFire = thisFire;
 		success = YES;
 	} else {
-		[_player updateMeters];
-		for (int i=0; i<[_channelNumbers count]; i++)
+		// collect the levels for every channel, then map them in one go
+		NSUInteger numChannels = [_channelNumbers count];
+		if (numChannels > kMaxMeterChannels) goto bail;
+		float levels[kMaxMeterChannels], peaks[kMaxMeterChannels];
+		if (_sound)
+		{
+			// a CASound's levels are amplitudes as measured, and the table takes them without a trip through decibels here
+			if (numChannels > _sound.channelCount) goto bail;
+			CASoundLevels *amplitudes = _sound.amplitudeMeters;
+			for (int i=0; i<numChannels; i++)
+			{
+				levels[i] = amplitudes[i].averagePower;
+				peaks[i] = _showsPeaks ? amplitudes[i].peakPower : 0.;
+			}
+			_meterTable->ValuesForAmplitudes(levels, levels, numChannels);
+			_meterTable->ValuesForAmplitudes(peaks, peaks, numChannels);
+		}
+		else
+		{
+			// AVAudioPlayer only reports powers in decibels
+			[_player updateMeters];
+			for (int i=0; i<numChannels; i++)
+			{
+				levels[i] = [_player averagePowerForChannel:i];
+				peaks[i] = _showsPeaks ? [_player peakPowerForChannel:i] : kMinDBvalue - 1.;
+			}
+			_meterTable->ValuesAt(levels, levels, numChannels);
+			_meterTable->ValuesAt(peaks, peaks, numChannels);
+		}
+		
+		for (int i=0; i<numChannels; i++)
 		{
 			NSInteger channelIdx = [(NSNumber *)[_channelNumbers objectAtIndex:i] intValue];
-			LevelMeter *channelView = [_subLevelMeters objectAtIndex:channelIdx];
-			
-			if (channelIdx >= [_channelNumbers count]) goto bail;
-			if (channelIdx > 127) goto bail;
+			if (channelIdx >= numChannels) goto bail;
 			
-			channelView.level = _meterTable->ValueAt([_player averagePowerForChannel:i]);
-			if (_showsPeaks) channelView.peakLevel = _meterTable->ValueAt([_player peakPowerForChannel:i]);
-			else
-				channelView.peakLevel = 0.;
+			LevelMeter *channelView = [_subLevelMeters objectAtIndex:channelIdx];
+			channelView.level = levels[i];
+			channelView.peakLevel = peaks[i];
 			[channelView setNeedsDisplay];
 			success = YES;		
 		}
@@ -233,6 +267,44 @@ bail:
 }
 
 
+- (CASound*)sound { return _sound; }
+- (void)setSound:(CASound*)v
+{
+	if ((_player == NULL) && (_sound == NULL) && (v != NULL))
+	{
+		if (_updateTimer) [_updateTimer invalidate];
+		_updateTimer = [CADisplayLink displayLinkWithTarget:self selector:@selector(_refresh)];
+		[_updateTimer addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+
+	} else if ((_sound != NULL) && (v == NULL)) {
+		_peakFalloffLastFire = CFAbsoluteTimeGetCurrent();
+	}
+	
+	_sound = v;
+	
+	if (_sound)
+	{
+		_sound.enableMetering = YES;
+		// now check the number of channels in the new sound, we will need to reallocate if this has changed
+		NSUInteger numChannels = MIN(_sound.channelCount, (NSUInteger)2);
+		if (numChannels != [_channelNumbers count])
+		{
+			NSArray *chan_array;
+			if (numChannels < 2)
+				chan_array = [[NSArray alloc] initWithObjects:[NSNumber numberWithInt:0], nil];
+			else
+				chan_array = [[NSArray alloc] initWithObjects:[NSNumber numberWithInt:0], [NSNumber numberWithInt:1], nil];
+			[self setChannelNumbers:chan_array];
+			[chan_array release];
+		}
+	} else {
+		for (LevelMeter *thisMeter in _subLevelMeters) {
+			[thisMeter setNeedsDisplay];
+		}
+	}
+}
+
+
 - (NSArray *)channelNumbers { return _channelNumbers; }
 - (void)setChannelNumbers:(NSArray *)v
 {
@@ -257,7 +329,7 @@ bail:
 
 - (void)resumeTimer
 {
-	if (_player)
+	if (_player || _sound)
 	{
 		_updateTimer = [CADisplayLink displayLinkWithTarget:self selector:@selector(_refresh)];
 		[_updateTimer addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
@@ -0,0 +1,362 @@
+/*
+ 
+ File: CAMeteringEngine.cpp
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#include "CAMeteringEngine.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+
+enum {
+	kTruePeakOversampling = 4,
+	kTruePeakTapsPerPhase = 12,
+	kLoudnessBlocksPerSecond = 10,		// loudness is summed in 100 ms blocks
+	kMomentaryBlocks = 4,
+	kShortTermBlocks = 30,
+	kFreshSnapshot = 4					// set in mMiddle when the writer has published since the reader last looked
+};
+
+// K-weighting, the two stage filter of ITU-R BS.1770, worked out for any sample rate
+static const double kShelfFrequency = 1681.974450955533;
+static const double kShelfGainDecibels = 3.999843853973347;
+static const double kShelfQ = 0.7071752369554196;
+static const double kHighPassFrequency = 38.13547087602444;
+static const double kHighPassQ = 0.5003270373238773;
+
+struct Biquad {
+	double	b0, b1, b2, a1, a2;
+	
+	double Process(double inX, double& ioZ1, double& ioZ2) const
+	{
+		double y = b0 * inX + ioZ1;
+		ioZ1 = b1 * inX - a1 * y + ioZ2;
+		ioZ2 = b2 * inX - a2 * y;
+		return y;
+	}
+};
+
+struct ChannelState {
+	double	meanSquare;
+	float	peak;
+	float	truePeak;
+	double	shelfZ1, shelfZ2, highPassZ1, highPassZ2;
+	float	history[2 * kTruePeakTapsPerPhase];	// each sample is written twice so the newest taps are always contiguous
+	UInt32	historyIndex;
+};
+
+struct CAMeteringEngine {
+	UInt32					mChannelCount;
+	Float64					mSampleRate;
+	
+	// coefficients
+	double					mRMSCoefficient;
+	float					mPeakReleasePerFrame;
+	Biquad					mShelf;
+	Biquad					mHighPass;
+	float					mTruePeakTaps[kTruePeakOversampling][kTruePeakTapsPerPhase];
+	UInt32					mFramesPerLoudnessBlock;
+	
+	// audio thread state
+	ChannelState*			mChannels;
+	double					mBlockSum;			// K-weighted squares summed over the channels so far in this block
+	UInt32					mBlockFrames;
+	double					mBlockSums[kShortTermBlocks];
+	UInt32					mBlockCount;		// blocks completed, for as long as the short term window isn't full
+	UInt32					mBlockIndex;
+	Float64					mSampleTime;
+	std::atomic<bool>		mResetRequested;
+	
+	// the triple buffer: the writer owns mBack, the reader mFront, and they trade through mMiddle
+	CAMeterLoudness			mLoudness[3];
+	CAMeterChannelLevels*	mLevels[3];
+	UInt32					mBack;
+	UInt32					mFront;
+	std::atomic<UInt32>		mMiddle;
+};
+
+static void SetUpKWeighting(CAMeteringEngine* inEngine)
+{
+	double K = tan(M_PI * kShelfFrequency / inEngine->mSampleRate);
+	double Vh = pow(10., kShelfGainDecibels / 20.);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1. + K / kShelfQ + K * K;
+	inEngine->mShelf.b0 = (Vh + Vb * K / kShelfQ + K * K) / a0;
+	inEngine->mShelf.b1 = 2. * (K * K - Vh) / a0;
+	inEngine->mShelf.b2 = (Vh - Vb * K / kShelfQ + K * K) / a0;
+	inEngine->mShelf.a1 = 2. * (K * K - 1.) / a0;
+	inEngine->mShelf.a2 = (1. - K / kShelfQ + K * K) / a0;
+	
+	K = tan(M_PI * kHighPassFrequency / inEngine->mSampleRate);
+	a0 = 1. + K / kHighPassQ + K * K;
+	inEngine->mHighPass.b0 = 1.;
+	inEngine->mHighPass.b1 = -2.;
+	inEngine->mHighPass.b2 = 1.;
+	inEngine->mHighPass.a1 = 2. * (K * K - 1.) / a0;
+	inEngine->mHighPass.a2 = (1. - K / kHighPassQ + K * K) / a0;
+}
+
+static void SetUpTruePeakFilter(CAMeteringEngine* inEngine)
+{
+	// a Hann windowed sinc low pass at the original Nyquist frequency, split into one set of taps per phase
+	const int kNumTaps = kTruePeakOversampling * kTruePeakTapsPerPhase;
+	const double center = (kNumTaps - 1) / 2.;
+	for (int i = 0; i < kNumTaps; ++i) {
+		double t = (i - center) / kTruePeakOversampling;
+		double sinc = t == 0. ? 1. : sin(M_PI * t) / (M_PI * t);
+		double window = .5 - .5 * cos(2. * M_PI * (i + .5) / kNumTaps);
+		inEngine->mTruePeakTaps[i % kTruePeakOversampling][i / kTruePeakOversampling] = (float)(sinc * window);
+	}
+	
+	// so that each phase passes a steady level unchanged
+	for (int phase = 0; phase < kTruePeakOversampling; ++phase) {
+		float sum = 0.f;
+		for (int i = 0; i < kTruePeakTapsPerPhase; ++i) sum += inEngine->mTruePeakTaps[phase][i];
+		for (int i = 0; i < kTruePeakTapsPerPhase; ++i) inEngine->mTruePeakTaps[phase][i] /= sum;
+	}
+}
+
+static void ResetState(CAMeteringEngine* inEngine)
+{
+	memset(inEngine->mChannels, 0, sizeof(ChannelState) * inEngine->mChannelCount);
+	inEngine->mBlockSum = 0.;
+	inEngine->mBlockFrames = 0;
+	memset(inEngine->mBlockSums, 0, sizeof(inEngine->mBlockSums));
+	inEngine->mBlockCount = 0;
+	inEngine->mBlockIndex = 0;
+}
+
+CAMeteringEngine* CAMeteringEngineCreate(UInt32 inChannelCount, Float64 inSampleRate)
+{
+	if (inChannelCount == 0 || !(inSampleRate > 0.)) return NULL;
+	
+	CAMeteringEngine* engine = new (std::nothrow) CAMeteringEngine;
+	if (!engine) return NULL;
+	engine->mChannelCount = inChannelCount;
+	engine->mSampleRate = inSampleRate;
+	engine->mChannels = (ChannelState*)calloc(inChannelCount, sizeof(ChannelState));
+	CAMeterChannelLevels* levels = (CAMeterChannelLevels*)calloc(3 * inChannelCount, sizeof(CAMeterChannelLevels));
+	if (!engine->mChannels || !levels) {
+		free(engine->mChannels);
+		free(levels);
+		delete engine;
+		return NULL;
+	}
+	
+	engine->mRMSCoefficient = 1. - exp(-1. / (kCAMeter_RMSIntegrationTime * inSampleRate));
+	engine->mPeakReleasePerFrame = (float)pow(10., -kCAMeter_PeakReleaseDecibelsPerSecond / 20. / inSampleRate);
+	SetUpKWeighting(engine);
+	SetUpTruePeakFilter(engine);
+	engine->mFramesPerLoudnessBlock = (UInt32)(inSampleRate / kLoudnessBlocksPerSecond + .5);
+	
+	ResetState(engine);
+	engine->mSampleTime = 0.;
+	engine->mResetRequested.store(false, std::memory_order_relaxed);
+	for (int i = 0; i < 3; ++i) {
+		engine->mLevels[i] = levels + i * inChannelCount;
+		engine->mLoudness[i].momentary = engine->mLoudness[i].shortTerm = kCAMeter_MinLoudness;
+		engine->mLoudness[i].sampleTime = 0.;
+	}
+	engine->mBack = 0;
+	engine->mMiddle.store(1, std::memory_order_relaxed);
+	engine->mFront = 2;
+	return engine;
+}
+
+void CAMeteringEngineDispose(CAMeteringEngine* inEngine)
+{
+	if (!inEngine) return;
+	free(inEngine->mChannels);
+	free(inEngine->mLevels[0]);
+	delete inEngine;
+}
+
+UInt32 CAMeteringEngineGetChannelCount(const CAMeteringEngine* inEngine)
+{
+	return inEngine->mChannelCount;
+}
+
+void CAMeteringEngineReset(CAMeteringEngine* inEngine)
+{
+	inEngine->mResetRequested.store(true, std::memory_order_release);
+}
+
+static float LoudnessOfBlocks(const CAMeteringEngine* inEngine, UInt32 inNumBlocks)
+{
+	// the mean of the latest blocks, only counting those there have been so far
+	if (inNumBlocks > inEngine->mBlockCount) inNumBlocks = inEngine->mBlockCount;
+	if (inNumBlocks == 0) return kCAMeter_MinLoudness;
+	
+	double sum = 0.;
+	for (UInt32 i = 1; i <= inNumBlocks; ++i)
+		sum += inEngine->mBlockSums[(inEngine->mBlockIndex + kShortTermBlocks - i) % kShortTermBlocks];
+	double meanSquare = sum / ((double)inNumBlocks * inEngine->mFramesPerLoudnessBlock);
+	if (meanSquare <= 0.) return kCAMeter_MinLoudness;
+	double loudness = -0.691 + 10. * log10(meanSquare);
+	return (float)(loudness < kCAMeter_MinLoudness ? kCAMeter_MinLoudness : loudness);
+}
+
+static void ProcessChannel(CAMeteringEngine* inEngine, ChannelState& ioChannel, const Float32* inData, UInt32 inStride, UInt32 inNumberFrames)
+{
+	const double rmsCoefficient = inEngine->mRMSCoefficient;
+	const Biquad shelf = inEngine->mShelf, highPass = inEngine->mHighPass;
+	double meanSquare = ioChannel.meanSquare;
+	double shelfZ1 = ioChannel.shelfZ1, shelfZ2 = ioChannel.shelfZ2;
+	double highPassZ1 = ioChannel.highPassZ1, highPassZ2 = ioChannel.highPassZ2;
+	UInt32 historyIndex = ioChannel.historyIndex;
+	float peak = 0.f, truePeak = 0.f;
+	double weightedSum = 0.;
+	
+	for (UInt32 frame = 0; frame < inNumberFrames; ++frame) {
+		float x = inData[frame * inStride];
+		double square = (double)x * x;
+		meanSquare += rmsCoefficient * (square - meanSquare);
+		
+		float level = fabsf(x);
+		if (level > peak) peak = level;
+		
+		// oversample: each phase of the filter gives one of the points between this sample and the last
+		historyIndex = historyIndex ? historyIndex - 1 : kTruePeakTapsPerPhase - 1;
+		ioChannel.history[historyIndex] = ioChannel.history[historyIndex + kTruePeakTapsPerPhase] = x;
+		const float* recent = ioChannel.history + historyIndex;
+		for (int phase = 0; phase < kTruePeakOversampling; ++phase) {
+			const float* taps = inEngine->mTruePeakTaps[phase];
+			float y = 0.f;
+			for (int i = 0; i < kTruePeakTapsPerPhase; ++i)
+				y += taps[i] * recent[i];
+			y = fabsf(y);
+			if (y > truePeak) truePeak = y;
+		}
+		
+		double weighted = highPass.Process(shelf.Process(x, shelfZ1, shelfZ2), highPassZ1, highPassZ2);
+		weightedSum += weighted * weighted;
+	}
+	
+	// hold the highest levels, letting the held ones fall back for as long as these frames lasted
+	float release = powf(inEngine->mPeakReleasePerFrame, (float)inNumberFrames);
+	ioChannel.peak = fmaxf(peak, ioChannel.peak * release);
+	ioChannel.truePeak = fmaxf(fmaxf(truePeak, peak), ioChannel.truePeak * release);
+	
+	ioChannel.meanSquare = meanSquare;
+	ioChannel.shelfZ1 = shelfZ1;
+	ioChannel.shelfZ2 = shelfZ2;
+	ioChannel.highPassZ1 = highPassZ1;
+	ioChannel.highPassZ2 = highPassZ2;
+	ioChannel.historyIndex = historyIndex;
+	inEngine->mBlockSum += weightedSum;
+}
+
+void CAMeteringEngineProcess(CAMeteringEngine* inEngine, const AudioBufferList* inBufferList, UInt32 inNumberFrames)
+{
+	if (inEngine->mResetRequested.exchange(false, std::memory_order_acquire))
+		ResetState(inEngine);
+	
+	// go through the frames a loudness block at a time, so that the blocks end where they should
+	UInt32 startFrame = 0;
+	while (startFrame < inNumberFrames) {
+		UInt32 numFrames = inEngine->mFramesPerLoudnessBlock - inEngine->mBlockFrames;
+		if (numFrames > inNumberFrames - startFrame)
+			numFrames = inNumberFrames - startFrame;
+		
+		UInt32 channel = 0;
+		for (UInt32 i = 0; i < inBufferList->mNumberBuffers && channel < inEngine->mChannelCount; ++i) {
+			const AudioBuffer& buffer = inBufferList->mBuffers[i];
+			UInt32 stride = buffer.mNumberChannels ? buffer.mNumberChannels : 1;
+			if (!buffer.mData || buffer.mDataByteSize < inNumberFrames * stride * sizeof(Float32)) {
+				channel += stride;
+				continue;
+			}
+			const Float32* data = (const Float32*)buffer.mData + startFrame * stride;
+			for (UInt32 j = 0; j < stride && channel < inEngine->mChannelCount; ++j, ++channel)
+				ProcessChannel(inEngine, inEngine->mChannels[channel], data + j, stride, numFrames);
+		}
+		
+		inEngine->mBlockFrames += numFrames;
+		if (inEngine->mBlockFrames == inEngine->mFramesPerLoudnessBlock) {
+			inEngine->mBlockSums[inEngine->mBlockIndex] = inEngine->mBlockSum;
+			inEngine->mBlockIndex = (inEngine->mBlockIndex + 1) % kShortTermBlocks;
+			if (inEngine->mBlockCount < kShortTermBlocks) ++inEngine->mBlockCount;
+			inEngine->mBlockSum = 0.;
+			inEngine->mBlockFrames = 0;
+		}
+		startFrame += numFrames;
+	}
+	inEngine->mSampleTime += inNumberFrames;
+	
+	// publish
+	UInt32 back = inEngine->mBack;
+	CAMeterChannelLevels* levels = inEngine->mLevels[back];
+	for (UInt32 channel = 0; channel < inEngine->mChannelCount; ++channel) {
+		const ChannelState& state = inEngine->mChannels[channel];
+		levels[channel].rms = (Float32)sqrt(state.meanSquare);
+		levels[channel].peak = state.peak;
+		levels[channel].truePeak = state.truePeak;
+	}
+	CAMeterLoudness& loudness = inEngine->mLoudness[back];
+	loudness.momentary = LoudnessOfBlocks(inEngine, kMomentaryBlocks);
+	loudness.shortTerm = LoudnessOfBlocks(inEngine, kShortTermBlocks);
+	loudness.sampleTime = inEngine->mSampleTime;
+	inEngine->mBack = inEngine->mMiddle.exchange(back | kFreshSnapshot, std::memory_order_acq_rel) & ~kFreshSnapshot;
+}
+
+Boolean CAMeteringEngineGetLevels(CAMeteringEngine* inEngine, CAMeterChannelLevels* outLevels, UInt32 inMaxChannels, CAMeterLoudness* outLoudness)
+{
+	bool isFresh = (inEngine->mMiddle.load(std::memory_order_relaxed) & kFreshSnapshot) != 0;
+	if (isFresh)
+		inEngine->mFront = inEngine->mMiddle.exchange(inEngine->mFront, std::memory_order_acq_rel) & ~kFreshSnapshot;
+	
+	UInt32 front = inEngine->mFront;
+	if (outLevels) {
+		UInt32 numChannels = inMaxChannels < inEngine->mChannelCount ? inMaxChannels : inEngine->mChannelCount;
+		memcpy(outLevels, inEngine->mLevels[front], numChannels * sizeof(CAMeterChannelLevels));
+	}
+	if (outLoudness)
+		*outLoudness = inEngine->mLoudness[front];
+	return isFresh;
+}
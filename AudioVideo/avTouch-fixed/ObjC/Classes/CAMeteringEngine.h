@@ -0,0 +1,116 @@
+/*
+ 
+ File: CAMeteringEngine.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#ifndef __CAMeteringEngine_h__
+#define __CAMeteringEngine_h__
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+/*
+ CAMeteringEngine measures levels and loudness inside an audio callback and hands them to the UI
+ without either side waiting for the other.
+ 
+ CAMeteringEngineProcess is called on the audio thread with each buffer of 32 bit float samples,
+ interleaved or not. It keeps, for every channel:
+	- rms: the root mean square level, integrated over kCAMeter_RMSIntegrationTime
+	- peak: the highest sample level, falling back at kCAMeter_PeakReleaseDecibelsPerSecond
+	- truePeak: the peak level between the samples as well, found by 4x oversampling as in ITU-R BS.1770
+ all as linear amplitudes, and for the whole signal the momentary (400 ms) and short term (3 s)
+ loudness of the K-weighted channels in LUFS. Every channel is weighted equally, since the engine
+ doesn't know which are surrounds or LFE.
+ 
+ At the end of each call it publishes these through a triple buffer. CAMeteringEngineGetLevels
+ takes the latest without locking, so it can be polled from a UI timer as often as wanted while the
+ audio thread never waits or allocates. Only one thread at a time may read.
+*/
+
+#define kCAMeter_RMSIntegrationTime				0.3
+#define kCAMeter_PeakReleaseDecibelsPerSecond	12.
+#define kCAMeter_MinLoudness					-70.	/* reported for silence, the absolute gate of BS.1770 */
+
+typedef struct CAMeteringEngine CAMeteringEngine;
+
+typedef struct CAMeterChannelLevels {
+	Float32		rms;
+	Float32		peak;
+	Float32		truePeak;
+} CAMeterChannelLevels;
+
+typedef struct CAMeterLoudness {
+	Float32		momentary;	/* LUFS */
+	Float32		shortTerm;	/* LUFS */
+	Float64		sampleTime;	/* frames processed when these were published */
+} CAMeterLoudness;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+/* returns NULL if inChannelCount or inSampleRate is zero or memory runs out */
+CAMeteringEngine*	CAMeteringEngineCreate(UInt32 inChannelCount, Float64 inSampleRate);
+void				CAMeteringEngineDispose(CAMeteringEngine* inEngine);
+
+UInt32				CAMeteringEngineGetChannelCount(const CAMeteringEngine* inEngine);
+
+/* audio thread only: measures inNumberFrames frames of 32 bit float audio, channels beyond the engine's are ignored */
+void				CAMeteringEngineProcess(CAMeteringEngine* inEngine, const AudioBufferList* inBufferList, UInt32 inNumberFrames);
+
+/* starts measuring afresh, as after a seek. may be called from any thread, and takes effect when the next buffer is processed */
+void				CAMeteringEngineReset(CAMeteringEngine* inEngine);
+
+/* copies the latest levels for up to inMaxChannels channels and the loudness, either may be NULL.
+   returns true if anything was published since the last call */
+Boolean				CAMeteringEngineGetLevels(CAMeteringEngine* inEngine, CAMeterChannelLevels* outLevels, UInt32 inMaxChannels, CAMeterLoudness* outLoudness);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // __CAMeteringEngine_h__
@@ -82,12 +82,19 @@ typedef void (*CASoundDataCallback)(
 	NSUInteger* bytesSupplied, 
 	void* dataPtr);
 
-/* A struct for the meters and decibelMeters properties */
+/* A struct for the meters and amplitudeMeters properties */
 typedef struct CASoundLevels {
     float     averagePower;
     float     peakPower;
+    float     truePeakPower; /* the peak between samples as well */
 } CASoundLevels;
 
+/* A struct for the loudness property, in LUFS */
+typedef struct CASoundLoudness {
+    float     momentaryLoudness; /* over the last 400 ms */
+    float     shortTermLoudness; /* over the last 3 s */
+} CASoundLoudness;
+
 /* A protocol for delegates of CASound */
 @protocol CASoundDelegate <NSObject>
 	- (void)soundDidFinishPlaying:(CASound *)sound;
@@ -101,11 +108,13 @@ typedef struct CASoundLevels {
 
 /* all data must be in the form of an audio file understood by CoreAudio */
 + (CASound*)soundWithContentsOfURL:(NSURL *)url;
++ (CASound*)soundWithContentsOfFile:(NSString *)path;
 + (CASound*)soundWithData:(NSData *)data;
 + (CASound*)soundWithDataCallback:(CASoundDataCallback)aCallback userData:(void*) userData; /* pull mode */
 
 /* all data must be in the form of an audio file understood by CoreAudio */
-- (CASound*)initWithContentsOfURL:(NSURL *)url;
+- (CASound*)initWithContentsOfURL:(NSURL *)url; /* file URLs are memory mapped, as with initWithContentsOfFile: */
+- (CASound*)initWithContentsOfFile:(NSString *)path; /* the file is memory mapped rather than read */
 - (CASound*)initWithData:(NSData *)data;
 - (CASound*)initWithDataCallback:(CASoundDataCallback)aCallback userData:(void*) userData; /* pull mode */
 
@@ -115,6 +124,9 @@ typedef struct CASoundLevels {
 - (BOOL)play;			/* sound is played asynchronously. returns NO if already playing or can't play. */
 - (BOOL)skipForwardPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds; /* skipping style fast forward mode */
 - (BOOL)skipBackwardPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds; /* skipping style fast reverse mode */
+/* skipping covers periodSeconds of the sound for every playSeconds played, time stretched so that it is continuous and keeps its pitch,
+from .25 to 4 times normal speed. the new speed is heard within about a second, and the sound finishes if skipping reaches either end of it. 
+linear PCM only; other formats play on at normal speed. */
 - (BOOL)pause;			/* pauses playback, but remains ready to play. returns NO if sound not paused */
 - (BOOL)stop;			/* stops playback. no longer ready to play. */
 
@@ -143,6 +155,22 @@ A negative number will loop indefinitely until stopped.
 */
 @property NSInteger numberOfLoops;
 
+/* loop points */
+
+/* the sound loops between these frames, the end frame excluded. each pass after the first is sample accurate
+and gapless. playing starts at currentTime, and after the last pass carries on past the loop end to the end of the sound.
+a negative start frame means wherever playing started and a negative end frame means the end of the sound, which are the defaults.
+compressed sounds loop at the packets holding the loop points. */
+- (void)setLoopStartFrame:(int64_t)startFrame endFrame:(int64_t)endFrame;
+@property(readonly) int64_t loopStartFrame;
+@property(readonly) int64_t loopEndFrame;
+@property NSTimeInterval loopCrossfadeDuration; /* seconds the loop end is crossfaded into the loop start over. linear PCM only. default is 0, at most .5 */
+
+/* read ahead */
+
+@property NSTimeInterval readAheadDuration; /* seconds of audio read ahead of playback on a background thread. default is 2. zero reads on demand. */
+@property(readonly) NSUInteger readAheadUnderruns; /* times playback caught up with the read ahead since the sound was last prepared to play */
+
 /* metering */
 
 @property BOOL enableMetering; /* turns level metering ON or OFF. default is OFF. */
@@ -151,6 +179,19 @@ A negative number will loop indefinitely until stopped.
 The array is owned by the CASound object and its lifetime is the same as that of the CASound object. */
 @property(readonly) CASoundLevels* meters;
 
+/* the same meter values as linear amplitudes, 1 being full scale, as they are measured. Owned by the CASound object like meters,
+but a separate array. */
+@property(readonly) CASoundLevels* amplitudeMeters;
+
+/* gets the loudness of all the channels together, as in ITU-R BS.1770. Reads -70 while metering is OFF. */
+@property(readonly) CASoundLoudness loudness;
+
+/* mixing */
+
+/* the whole sound decoded to interleaved 32 bit float at its own sample rate, as CASoundMixer plays it.
+decoded the first time it is asked for and kept for the lifetime of the CASound object. nil for callback sounds. */
+@property(readonly) NSData* linearPCMData;
+
 
 @end
 
@@ -48,9 +48,14 @@
  */
 
 #import "CASound.h"
+#import "CASoundPacketCache.h"
+#import "CASoundLoopEngine.h"
+#import "CASoundTimeStretch.h"
+#import "CAMeteringEngine.h"
 #import "libkern/OSAtomic.h"
 
 #import <AudioToolbox/AudioToolbox.h>
+#import <sys/mman.h>
 
 NSString* const CASoundFormat_LPCM_8_bit_integer = @"CASoundFormat_LPCM_8_bit_integer";
 NSString* const CASoundFormat_LPCM_16_bit_integer = @"CASoundFormat_LPCM_16_bit_integer";
@@ -77,9 +82,26 @@ static OSStatus CASoundAFReadProc(
 static SInt64 CASoundAFGetSizeProc(void * 		inClientData);
 
 enum {
-	kNumberOfAudioQueueBuffers = 4
+	kNumberOfAudioQueueBuffers = 4,
+	kAudioQueueBufferByteSize = 65536,
+	kSkipBufferFrames = 4096		// buffers are only filled this far while skipping, so rate changes are heard soon after
 };
 
+// how much audio is read ahead of playback unless the readAheadDuration property says otherwise
+static const NSTimeInterval kDefaultReadAheadDuration = 2.;
+
+// how far past the play position the pages of a mapped PCM sound are asked to be paged in when there is no read ahead
+static const size_t kMappedReadAheadBytes = 262144;
+
+// the longest crossfade the loopCrossfadeDuration property can ask for
+static const NSTimeInterval kMaxLoopCrossfadeDuration = .5;
+
+// the fastest the skip modes play, either way, and the slowest is one over it
+static const float kMaxSkipRate = 4.f;
+
+// what the meters read for silence
+static const float kMinMeterDecibels = -160.f;
+
 
 
 struct CASoundImpl
@@ -112,15 +134,294 @@ struct CASoundImpl
 
 	bool _enableMetering;
 	CASoundLevels* _meters;
+	CASoundLevels* _amplitudeMeters;
+	
+	// levels measured on the queue's render thread by a siphon tap, only set up once metering is enabled and then
+	// lives as long as the queue. the queue's own level metering is used instead if the tap can't be set up.
+	AudioQueueProcessingTapRef _meteringTap;
+	CAMeteringEngine* _meteringEngine;
+	CAMeterChannelLevels* _meterLevels;
 	
 	// skip mode
 	float _playSeconds;
 	float _periodLengthSeconds; // negative for rewind
+	CASoundTimeStretch* _timeStretch; // linear PCM only, lives as long as the queue
+	bool _isStretching; // whether the queue's callback has started the time stretch since skipping began
+	SInt64 _stretchReadPos; // the frame after the last one the time stretch read
 	
 	AudioQueueBufferRef _aqbuf[kNumberOfAudioQueueBuffers];
 	AudioQueueBufferRef _lastBufferEnqueued;
+	
+	// read ahead, lives as long as the queue
+	CASoundPacketCache* _packetCache;
+	NSTimeInterval _readAheadDuration;
+	
+	// sounds made from data (including mapped files) keep a pointer to it, and for constant bit rate
+	// formats where the packets are in it, so that they can be served without going through AudioFile
+	const UInt8* _bytes;
+	SInt64 _length;
+	SInt64 _audioDataOffset; // negative unless the packets can be served straight from _bytes
+	SInt64 _packetCount;
+	
+	// loop points in frames, negative for the start position and the end of the sound
+	SInt64 _loopStartFrame;
+	SInt64 _loopEndFrame;
+	NSTimeInterval _loopCrossfadeDuration;
+	CASoundLoopEngine* _loopEngine; // linear PCM only, lives as long as the queue
+	
+	// the whole sound as interleaved 32 bit float, decoded the first time a CASoundMixer plays it
+	NSData* _linearPCMData;
+};
+
+static const void* mappedPackets(CASoundImpl* impl, SInt64 inStartingPacket, UInt32* ioNumPackets)
+{
+	// returns a pointer to up to *ioNumPackets packets starting at inStartingPacket, no copying involved
+	if (inStartingPacket >= impl->_packetCount) {
+		*ioNumPackets = 0;
+		return NULL;
+	}
+	if ((SInt64)*ioNumPackets > impl->_packetCount - inStartingPacket)
+		*ioNumPackets = (UInt32)(impl->_packetCount - inStartingPacket);
+	return impl->_bytes + impl->_audioDataOffset + inStartingPacket * impl->_asbd.mBytesPerPacket;
+}
+
+static OSStatus openReadAheadFile(CASound* myself, CASoundImpl* impl, AudioFileID* outFile)
+{
+	// the read ahead thread (or the decoder) gets its own AudioFileID on the same data, so it never shares one with the queue's callback
+	if (impl->_url)
+		return AudioFileOpenURL((CFURLRef)impl->_url, kAudioFileReadPermission, 0, outFile);
+	if (impl->_data)
+		return AudioFileOpenWithCallbacks(myself, CASoundAFReadProc, NULL, CASoundAFGetSizeProc, NULL, 0, outFile);
+	return -50/*paramErr*/;
+}
+
+static void allocPacketCache(CASound* myself, CASoundImpl* impl)
+{
+	if (impl->_packetCache || impl->_readAheadDuration <= 0.) return;
+	
+	// if the read ahead can't be set up the queue reads the file directly, as it always could
+	impl->_packetCache = new CASoundPacketCache;
+	OSStatus err;
+	if (impl->_audioDataOffset >= 0) {
+		// Mapped sounds are played by pointer from memory, but their pages are only read in from the file when
+		// first touched, and that has to happen on the read ahead thread, not in the queue's callback
+		err = impl->_packetCache->InitializeMapped(impl->_bytes + impl->_audioDataOffset, impl->_packetCount, impl->_asbd, impl->_readAheadDuration);
+	} else {
+		AudioFileID readAheadFile = NULL;
+		err = openReadAheadFile(myself, impl, &readAheadFile);
+		if (!err) err = impl->_packetCache->Initialize(readAheadFile, impl->_asbd, impl->_readAheadDuration);
+	}
+	if (err) {
+		delete impl->_packetCache;
+		impl->_packetCache = NULL;
+		return;
+	}
+	impl->_packetCache->Prefetch(impl->_readPos);
+}
+
+static OSStatus readPackets(CASoundImpl* impl, UInt32* ioNumBytes, AudioStreamPacketDescription* outPacketDescriptions, 
+							SInt64 inStartingPacket, UInt32* ioNumPackets, void* outBuffer)
+{
+	// packets in memory are served by pointer: with read ahead its thread has paged them in already, without it the
+	// pages after them are asked for
+	if (impl->_audioDataOffset >= 0 && !outPacketDescriptions) {
+		UInt32 bytesPerPacket = impl->_asbd.mBytesPerPacket;
+		if (*ioNumPackets > *ioNumBytes / bytesPerPacket)
+			*ioNumPackets = *ioNumBytes / bytesPerPacket;
+		const UInt8* packets = (const UInt8*)(impl->_packetCache ? impl->_packetCache->GetMappedPackets(inStartingPacket, ioNumPackets)
+																 : mappedPackets(impl, inStartingPacket, ioNumPackets));
+		*ioNumBytes = *ioNumPackets * bytesPerPacket;
+		if (*ioNumBytes) {
+			// an AudioQueue only plays buffers it allocated itself, so this is the one copy left
+			memcpy(outBuffer, packets, *ioNumBytes);
+			
+			// have the pages after these start coming in now so that the next buffer doesn't wait for the disk
+			if (!impl->_packetCache) {
+				uintptr_t pageMask = (uintptr_t)getpagesize() - 1;
+				uintptr_t nextPage = ((uintptr_t)(packets + *ioNumBytes) + pageMask) & ~pageMask;
+				uintptr_t end = (uintptr_t)(impl->_bytes + impl->_length);
+				if (nextPage < end)
+					madvise((void*)nextPage, MIN(kMappedReadAheadBytes, end - nextPage), MADV_WILLNEED);
+			}
+		}
+		return noErr;
+	}
+	if (impl->_packetCache)
+		return impl->_packetCache->ReadPackets(impl->_afid, ioNumBytes, outPacketDescriptions, inStartingPacket, ioNumPackets, outBuffer);
+	return AudioFileReadPackets(impl->_afid, false, ioNumBytes, outPacketDescriptions, inStartingPacket, ioNumPackets, outBuffer);
+}
+
+static bool loopsAgain(CASoundImpl* impl)
+{
+	// whether the pass being played goes round again
+	return impl->_numLoops < 0 || impl->_loopCount < impl->_numLoops;
+}
+
+static SInt64 loopStartPacket(CASoundImpl* impl)
+{
+	if (impl->_loopStartFrame < 0) return impl->_readStartPos;
+	UInt32 framesPerPacket = impl->_asbd.mFramesPerPacket ? impl->_asbd.mFramesPerPacket : 1;
+	return impl->_loopStartFrame / framesPerPacket;
+}
+
+static SInt64 loopEndPacket(CASoundImpl* impl)
+{
+	// the packet after the one holding the last frame of the loop, or as good as never
+	if (impl->_loopEndFrame < 0) return INT64_MAX;
+	UInt32 framesPerPacket = impl->_asbd.mFramesPerPacket ? impl->_asbd.mFramesPerPacket : 1;
+	return (impl->_loopEndFrame + framesPerPacket - 1) / framesPerPacket;
+}
+
+static OSStatus loopEngineReadProc(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer)
+{
+	CASoundImpl* impl = (CASoundImpl*)inRefCon;
+	UInt32 numBytes = *ioNumFrames * impl->_asbd.mBytesPerPacket;
+	return readPackets(impl, &numBytes, NULL, inFrame, ioNumFrames, outBuffer);
+}
+
+struct CASoundLoopStage
+{
+	CASoundImpl* _impl;
+	AudioFileID _afid;
 };
 
+static OSStatus loopStageReadProc(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer)
+{
+	// the loop is staged off the queue's thread, so it can't share the queue's AudioFileID or read ahead
+	CASoundLoopStage* stage = (CASoundLoopStage*)inRefCon;
+	CASoundImpl* impl = stage->_impl;
+	if (impl->_audioDataOffset >= 0) {
+		const void* packets = mappedPackets(impl, inFrame, ioNumFrames);
+		memcpy(outBuffer, packets, *ioNumFrames * impl->_asbd.mBytesPerPacket);
+		return noErr;
+	}
+	UInt32 numBytes = *ioNumFrames * impl->_asbd.mBytesPerPacket;
+	return AudioFileReadPackets(stage->_afid, false, &numBytes, NULL, inFrame, ioNumFrames, outBuffer);
+}
+
+static void allocLoopEngine(CASoundImpl* impl)
+{
+	if (impl->_loopEngine || impl->_asbd.mFormatID != kAudioFormatLinearPCM || impl->_asbd.mFramesPerPacket != 1) return;
+	
+	SInt64 frameCount = impl->_packetCount;
+	if (impl->_audioDataOffset < 0) {
+		UInt64 packetCount = 0;
+		UInt32 propSize = sizeof(packetCount);
+		if (AudioFileGetProperty(impl->_afid, kAudioFilePropertyAudioDataPacketCount, &propSize, &packetCount)) return;
+		frameCount = packetCount;
+	}
+	
+	// without it the sound loops as it always did, a packet at a time and with no crossfade
+	UInt32 maxCrossfadeFrames = (UInt32)ceil(kMaxLoopCrossfadeDuration * impl->_asbd.mSampleRate);
+	UInt32 maxHeadFrames = kAudioQueueBufferByteSize / impl->_asbd.mBytesPerFrame;
+	impl->_loopEngine = new CASoundLoopEngine;
+	if (impl->_loopEngine->Initialize(impl->_asbd, frameCount, loopEngineReadProc, impl, maxCrossfadeFrames, maxHeadFrames)) {
+		delete impl->_loopEngine;
+		impl->_loopEngine = NULL;
+	}
+}
+
+static OSStatus timeStretchReadProc(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer)
+{
+	// skipping forwards, each read carries on from the last or jumps ahead of it, so it comes from the read ahead
+	// as normal playback does. A read from before the last, as every one is going backwards, is read directly
+	// so that the read ahead isn't made to throw away what it has and start over.
+	CASoundImpl* impl = (CASoundImpl*)inRefCon;
+	bool isInOrder = inFrame >= impl->_stretchReadPos;
+	impl->_stretchReadPos = inFrame + *ioNumFrames;
+	if (isInOrder) {
+		UInt32 numBytes = *ioNumFrames * impl->_asbd.mBytesPerPacket;
+		return readPackets(impl, &numBytes, NULL, inFrame, ioNumFrames, outBuffer);
+	}
+	if (impl->_audioDataOffset >= 0) {
+		const void* packets = mappedPackets(impl, inFrame, ioNumFrames);
+		memcpy(outBuffer, packets, *ioNumFrames * impl->_asbd.mBytesPerPacket);
+		return noErr;
+	}
+	UInt32 numBytes = *ioNumFrames * impl->_asbd.mBytesPerPacket;
+	return AudioFileReadPackets(impl->_afid, false, &numBytes, NULL, inFrame, ioNumFrames, outBuffer);
+}
+
+static float skipRate(CASoundImpl* impl)
+{
+	// playing playSeconds of every periodSeconds covers the sound that many times faster
+	if (impl->_playSeconds <= 0.f) return impl->_periodLengthSeconds < 0.f ? -kMaxSkipRate : kMaxSkipRate;
+	return impl->_periodLengthSeconds / impl->_playSeconds;
+}
+
+static void allocTimeStretch(CASoundImpl* impl)
+{
+	// without it the skip modes play at normal speed
+	if (impl->_timeStretch || !impl->_loopEngine) return;
+	impl->_timeStretch = new CASoundTimeStretch;
+	if (impl->_timeStretch->Initialize(impl->_asbd, impl->_loopEngine->GetFrameCount(), timeStretchReadProc, impl, kMaxSkipRate)) {
+		delete impl->_timeStretch;
+		impl->_timeStretch = NULL;
+		return;
+	}
+	impl->_timeStretch->SetRate(skipRate(impl));
+}
+
+static void loopPacketCache(CASoundImpl* impl)
+{
+	if (!impl->_packetCache) return;
+	bool willLoop = impl->_numLoops != 0;
+	if (impl->_loopEngine) {
+		// the frames either side of the wrap are already in memory, so the read ahead can skip them
+		SInt64 sourceEndFrame, sourceResumeFrame;
+		impl->_loopEngine->GetSourceLoop(sourceEndFrame, sourceResumeFrame);
+		impl->_packetCache->SetLoop(sourceResumeFrame, sourceEndFrame, willLoop);
+	} else {
+		SInt64 endPacket = loopEndPacket(impl);
+		impl->_packetCache->SetLoop(loopStartPacket(impl), endPacket == INT64_MAX ? -1 : endPacket, willLoop);
+	}
+}
+
+static void updateLoop(CASound* myself, CASoundImpl* impl)
+{
+	if (impl->_loopEngine) {
+		SInt64 startFrame = impl->_loopStartFrame >= 0 ? impl->_loopStartFrame : impl->_readStartPos;
+		SInt64 endFrame = impl->_loopEndFrame >= 0 ? impl->_loopEndFrame : impl->_loopEngine->GetFrameCount();
+		UInt32 crossfadeFrames = (UInt32)floor(impl->_loopCrossfadeDuration * impl->_asbd.mSampleRate + .5);
+		
+		CASoundLoopStage stage = { impl, NULL };
+		if (impl->_audioDataOffset >= 0 || openReadAheadFile(myself, impl, &stage._afid) == noErr) {
+			impl->_loopEngine->SetLoop(startFrame, endFrame, crossfadeFrames, loopStageReadProc, &stage);
+			if (stage._afid) AudioFileClose(stage._afid);
+		}
+	}
+	loopPacketCache(impl);
+}
+
+static void CASoundAQTapCallback(void* inClientData, AudioQueueProcessingTapRef inAQTap, UInt32 inNumberFrames, AudioTimeStamp* ioTimeStamp, 
+								 AudioQueueProcessingTapFlags* ioFlags, UInt32* outNumberFrames, AudioBufferList* ioData)
+{
+	// a siphon tap is handed the audio as it is played and can't change it
+	CASoundImpl* impl = (CASoundImpl*)inClientData;
+	*outNumberFrames = inNumberFrames;
+	if (impl->_enableMetering)
+		CAMeteringEngineProcess(impl->_meteringEngine, ioData, inNumberFrames);
+}
+
+static void allocMeteringTap(CASoundImpl* impl)
+{
+	UInt32 maxFrames = 0;
+	AudioStreamBasicDescription tapFormat;
+	OSStatus err = AudioQueueProcessingTapNew(impl->_queue, CASoundAQTapCallback, impl, kAudioQueueProcessingTap_PostEffects | kAudioQueueProcessingTap_Siphon, 
+											  &maxFrames, &tapFormat, &impl->_meteringTap);
+	if (err) {
+		impl->_meteringTap = NULL;
+		return;
+	}
+	
+	if (tapFormat.mFormatID == kAudioFormatLinearPCM && (tapFormat.mFormatFlags & kAudioFormatFlagIsFloat) && tapFormat.mBitsPerChannel == 32)
+		impl->_meteringEngine = CAMeteringEngineCreate(tapFormat.mChannelsPerFrame, tapFormat.mSampleRate);
+	if (!impl->_meteringEngine) {
+		AudioQueueProcessingTapDispose(impl->_meteringTap);
+		impl->_meteringTap = NULL;
+	}
+}
+
 static OSStatus allocAudioQueue(CASound* myself, CASoundImpl* impl)
 {
 	if (impl->_queue) return noErr;
@@ -128,18 +429,27 @@ static OSStatus allocAudioQueue(CASound* myself, CASoundImpl* impl)
 	OSStatus err = AudioQueueNewOutput(&impl->_asbd, CASoundAQOutputCallback, myself, NULL, NULL, 0, &impl->_queue);
 	if (err) return err;
 	
+	// a queue nobody meters shouldn't pay for handing every buffer to a tap
 	if (impl->_enableMetering) {
-		UInt32 iflag = true;
-		AudioQueueSetProperty(impl->_queue, kAudioQueueProperty_EnableLevelMetering, &iflag, sizeof(iflag));
+		allocMeteringTap(impl);
+		if (!impl->_meteringEngine) {
+			UInt32 iflag = true;
+			AudioQueueSetProperty(impl->_queue, kAudioQueueProperty_EnableLevelMetering, &iflag, sizeof(iflag));
+		}
 	}
 	
 	AudioQueueAddPropertyListener(impl->_queue, kAudioQueueProperty_IsRunning, CASoundAQPropertyListenerProc, myself);
 	
 	for (UInt32 i = 0; i < kNumberOfAudioQueueBuffers; ++i) {
-		err = AudioQueueAllocateBuffer(impl->_queue, 65536, impl->_aqbuf + i);
+		err = AudioQueueAllocateBuffer(impl->_queue, kAudioQueueBufferByteSize, impl->_aqbuf + i);
 		if (err) return err;
 	}
 	
+	allocPacketCache(myself, impl);
+	allocLoopEngine(impl);
+	updateLoop(myself, impl);
+	allocTimeStretch(impl);
+	
 	return err;
 }
 
@@ -154,12 +464,16 @@ static OSStatus stopQueue(CASoundImpl* impl)
 	impl->_wasStarted = false;
 	impl->_isPlaying = false;
 	impl->_isSkipping = false;
+	impl->_isStretching = false;
 	impl->_isStopping = false;
 	impl->_queueSampleTime = 0.;
 	impl->_queueStartSampleTime = 0.;
 	impl->_mediaSampleTime = impl->_mediaStartSampleTime;
 	impl->_readPos = impl->_readStartPos;
 	OSMemoryBarrier();
+	loopPacketCache(impl); // in case it was skipping
+	if (impl->_packetCache) impl->_packetCache->Prefetch(impl->_readPos);
+	if (impl->_meteringEngine) CAMeteringEngineReset(impl->_meteringEngine);
 	return err;
 }
 
@@ -171,11 +485,22 @@ static OSStatus disposeQueue(CASound* myself, CASoundImpl* impl)
 	AudioQueueRemovePropertyListener(impl->_queue, kAudioQueueProperty_IsRunning, CASoundAQPropertyListenerProc, myself);
 	impl->_isStopping = true;
 	OSMemoryBarrier(); // make sure _isStopping is written
+	if (impl->_meteringTap) AudioQueueProcessingTapDispose(impl->_meteringTap);
+	impl->_meteringTap = NULL;
 	OSStatus err = AudioQueueDispose(impl->_queue, true);
 	impl->_queue = NULL;
+	CAMeteringEngineDispose(impl->_meteringEngine);
+	impl->_meteringEngine = NULL;
+	delete impl->_packetCache;
+	impl->_packetCache = NULL;
+	delete impl->_loopEngine;
+	impl->_loopEngine = NULL;
+	delete impl->_timeStretch;
+	impl->_timeStretch = NULL;
 	impl->_wasStarted = false;
 	impl->_isPlaying = false;
 	impl->_isSkipping = false;
+	impl->_isStretching = false;
 	impl->_isStopping = false;
 	impl->_queueSampleTime = 0.;
 	impl->_queueStartSampleTime = 0.;
@@ -230,6 +555,8 @@ static double getQueueTime(CASoundImpl* impl)
 		disposeQueue(self, impl);
 		if (impl->_afid) AudioFileClose(impl->_afid);
 		free(impl->_meters);
+		free(impl->_amplitudeMeters);
+		free(impl->_meterLevels);
 		free(_impl);
 	}
 	[super finalize];
@@ -242,6 +569,9 @@ static double getQueueTime(CASoundImpl* impl)
 		disposeQueue(self, impl);
 		if (impl->_afid) AudioFileClose(impl->_afid);
 		free(impl->_meters);
+		free(impl->_amplitudeMeters);
+		free(impl->_meterLevels);
+		[impl->_linearPCMData release];
 		[impl->_data release];
 		[impl->_url release];
 		[impl->_delegate release];
@@ -262,6 +592,10 @@ static double getQueueTime(CASoundImpl* impl)
 
 	impl->_mediaEndSampleTime = 1e100;
 	impl->_volume = 1.0;
+	impl->_readAheadDuration = kDefaultReadAheadDuration;
+	impl->_audioDataOffset = -1;
+	impl->_loopStartFrame = -1;
+	impl->_loopEndFrame = -1;
 
 	return self;
 }
@@ -289,7 +623,7 @@ static double getQueueTime(CASoundImpl* impl)
 	return copy;
 }
 
-- (CASound*)initWithContentsOfURL:(NSURL *)nsurl
+- (CASound*)initWithAudioFileURL:(NSURL *)nsurl
 {
 	[self baseInit];
 	
@@ -311,10 +645,25 @@ static double getQueueTime(CASoundImpl* impl)
 	return self;
 }
 
+- (CASound*)initWithContentsOfURL:(NSURL *)nsurl
+{
+	if ([nsurl isFileURL])
+		return [self initWithContentsOfFile: [nsurl path]];
+	return [self initWithAudioFileURL: nsurl];
+}
+
 - (CASound*)initWithContentsOfFile:(NSString *)path
 {
+	// map the file rather than read it, nothing is read until it is played and copies of the sound share the pages
+	NSData* mappedData = [[NSData alloc] initWithContentsOfFile: path options: NSDataReadingMappedAlways error: NULL];
+	if (mappedData) {
+		id result = [self initWithData: mappedData];
+		[mappedData release];
+		return result;
+	}
+	
 	NSURL* url = [[NSURL alloc] initFileURLWithPath: path];
-	id result = [self initWithContentsOfURL: url];
+	id result = [self initWithAudioFileURL: url];
 	[url release];
 	return result;
 }
@@ -324,13 +673,34 @@ static double getQueueTime(CASoundImpl* impl)
 	[self baseInit];
 
 	CASoundImpl* impl = (CASoundImpl*)_impl;
-	impl->_data = data;
-	[impl->_data retain];
+	// a copy, so that the bytes can't change or go away under us if the caller's data is mutable
+	impl->_data = [data copy];
+	impl->_bytes = (const UInt8*)[impl->_data bytes];
+	impl->_length = [impl->_data length];
 	
 	OSStatus err = AudioFileOpenWithCallbacks(self, CASoundAFReadProc, NULL, CASoundAFGetSizeProc, NULL, 0, &impl->_afid);
 	if (err) {
 		return NULL;
 	}
+
+	UInt32 propSize = sizeof(AudioStreamBasicDescription);
+	AudioFileGetProperty(impl->_afid, kAudioFilePropertyDataFormat, &propSize, &impl->_asbd);
+	
+	// constant bit rate packets lie one after another from the start of the audio data, so they can be served by pointer
+	if (impl->_asbd.mBytesPerPacket) {
+		SInt64 dataOffset = 0;
+		UInt64 packetCount = 0;
+		propSize = sizeof(dataOffset);
+		OSStatus offsetErr = AudioFileGetProperty(impl->_afid, kAudioFilePropertyDataOffset, &propSize, &dataOffset);
+		propSize = sizeof(packetCount);
+		OSStatus countErr = AudioFileGetProperty(impl->_afid, kAudioFilePropertyAudioDataPacketCount, &propSize, &packetCount);
+		if (!offsetErr && !countErr && dataOffset >= 0 && 
+				dataOffset + (SInt64)packetCount * impl->_asbd.mBytesPerPacket <= impl->_length) {
+			impl->_audioDataOffset = dataOffset;
+			impl->_packetCount = packetCount;
+		}
+	}
+
 	return self;
 }
 
@@ -392,8 +762,13 @@ static double getQueueTime(CASoundImpl* impl)
 	OSStatus err = noErr;
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
-		if (impl->_isPlaying) 
-			return NO;
+		if (impl->_isPlaying) {
+			if (!impl->_isSkipping) 
+				return NO;
+			// back to normal speed from wherever skipping has got to
+			impl->_isSkipping = false;
+			return YES;
+		}
 
 		[self prepareForPlay];
 		if (impl->_wasStarted) {
@@ -416,32 +791,31 @@ static double getQueueTime(CASoundImpl* impl)
 	return err == noErr;
 }
 
-- (BOOL)skipForwardPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds;
+- (BOOL)skipPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds
 {
-	/* skipping style fast forward mode */
-	OSStatus err = noErr;
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
-		impl->_isSkipping = true;
+		if (!impl->_isPlaying && ![self play]) 
+			return NO;
 		impl->_playSeconds = playSeconds;
 		impl->_periodLengthSeconds = periodSeconds;
-		
+		if (impl->_timeStretch) impl->_timeStretch->SetRate(skipRate(impl));
+		OSMemoryBarrier(); // make sure the rate is written before the queue's callback sees _isSkipping
+		impl->_isSkipping = true;
 	}
-	return err == noErr;
+	return YES;
+}
+
+- (BOOL)skipForwardPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds;
+{
+	/* skipping style fast forward mode */
+	return [self skipPlaying: playSeconds ofEvery: periodSeconds];
 }
 
 - (BOOL)skipBackwardPlaying:(NSTimeInterval)playSeconds ofEvery:(NSTimeInterval)periodSeconds
 {
 	/* skipping style fast reverse mode */
-	OSStatus err = noErr;
-	@synchronized(self) {
-		CASoundImpl* impl = (CASoundImpl*)_impl;
-		impl->_isSkipping = true;
-		impl->_playSeconds = playSeconds;
-		impl->_periodLengthSeconds = -periodSeconds;
-		
-	}
-	return err == noErr;
+	return [self skipPlaying: playSeconds ofEvery: -periodSeconds];
 }
 
 - (BOOL)pause
@@ -617,6 +991,8 @@ static double getQueueTime(CASoundImpl* impl)
 		impl->_readStartPos = (SInt64)floor(seconds * packetsPerSecond + .5);
 		impl->_readPos = impl->_readStartPos;
 		impl->_mediaStartSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
+		updateLoop(self, impl);
+		if (impl->_packetCache) impl->_packetCache->Prefetch(impl->_readPos);
 		if (impl->_wasStarted || impl->_wasCued) {
 			if (impl->_isPlaying) {
 				stopQueue(impl);
@@ -640,6 +1016,9 @@ static double getQueueTime(CASoundImpl* impl)
 {
 	CASoundImpl* impl = (CASoundImpl*)_impl;
 	impl->_numLoops = numLoops;		
+	@synchronized(self) {
+		updateLoop(self, impl);
+	}
 }
 
 /* Returns whether the sound will automatically restart when it is finished playing. */
@@ -650,12 +1029,142 @@ static double getQueueTime(CASoundImpl* impl)
 }
 
 
+@dynamic loopStartFrame, loopEndFrame, loopCrossfadeDuration;
+
+/* Sets the frames the sound loops between. The loop end is exclusive. A negative loop start is wherever playing starts and a negative loop end is the end of the sound. If the sound is playing, this takes effect from the next pass of the loop.
+*/
+- (void)setLoopStartFrame:(int64_t)startFrame endFrame:(int64_t)endFrame
+{
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		impl->_loopStartFrame = startFrame < 0 ? -1 : startFrame;
+		impl->_loopEndFrame = endFrame < 0 ? -1 : endFrame;
+		updateLoop(self, impl);
+	}
+}
+
+- (int64_t)loopStartFrame
+{
+	return ((CASoundImpl*)_impl)->_loopStartFrame;
+}
+
+- (int64_t)loopEndFrame
+{
+	return ((CASoundImpl*)_impl)->_loopEndFrame;
+}
+
+/* Sets how many seconds the end of the loop is crossfaded into its start over. Only linear PCM sounds crossfade.
+*/
+- (void)setLoopCrossfadeDuration:(NSTimeInterval)seconds
+{
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		impl->_loopCrossfadeDuration = seconds < 0. ? 0. : MIN(seconds, kMaxLoopCrossfadeDuration);
+		updateLoop(self, impl);
+	}
+}
+
+- (NSTimeInterval)loopCrossfadeDuration
+{
+	return ((CASoundImpl*)_impl)->_loopCrossfadeDuration;
+}
+
+
+@dynamic readAheadDuration, readAheadUnderruns;
+
+/* Sets how many seconds of the sound are read ahead of playback on a background thread. Takes effect the next time the sound is prepared to play after being stopped. Zero turns reading ahead off.
+*/
+- (void)setReadAheadDuration:(NSTimeInterval)seconds
+{
+	CASoundImpl* impl = (CASoundImpl*)_impl;
+	impl->_readAheadDuration = seconds;
+}
+
+- (NSTimeInterval)readAheadDuration
+{
+	return ((CASoundImpl*)_impl)->_readAheadDuration;
+}
+
+/* Returns how many times playback got ahead of the read ahead thread and had to read the file itself (or, for a mapped sound, page it in) since the sound was last prepared to play.
+*/
+- (NSUInteger)readAheadUnderruns
+{
+	NSUInteger underruns = 0;
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		if (impl->_packetCache) underruns = (NSUInteger)impl->_packetCache->GetUnderrunCount();
+	}
+	return underruns;
+}
+
 - (NSData*)data
 {
 	CASoundImpl* impl = (CASoundImpl*)_impl;
 	return impl->_data;
 }
 
+static NSData* decodeLinearPCM(CASound* myself, CASoundImpl* impl)
+{
+	AudioFileID fileID = NULL;
+	if (openReadAheadFile(myself, impl, &fileID)) return nil;
+	
+	ExtAudioFileRef extFile = NULL;
+	OSStatus err = ExtAudioFileWrapAudioFileID(fileID, false, &extFile);
+	if (err) {
+		AudioFileClose(fileID);
+		return nil;
+	}
+	
+	UInt32 numChannels = impl->_asbd.mChannelsPerFrame;
+	AudioStreamBasicDescription clientFormat = { 0 };
+	clientFormat.mSampleRate = impl->_asbd.mSampleRate;
+	clientFormat.mFormatID = kAudioFormatLinearPCM;
+	clientFormat.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+	clientFormat.mBitsPerChannel = 32;
+	clientFormat.mChannelsPerFrame = numChannels;
+	clientFormat.mFramesPerPacket = 1;
+	clientFormat.mBytesPerFrame = clientFormat.mBytesPerPacket = numChannels * sizeof(float);
+	err = ExtAudioFileSetProperty(extFile, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat);
+	
+	SInt64 numFrames = 0;
+	UInt32 propSize = sizeof(numFrames);
+	if (!err) err = ExtAudioFileGetProperty(extFile, kExtAudioFileProperty_FileLengthFrames, &propSize, &numFrames);
+	
+	float* samples = NULL;
+	SInt64 framesRead = 0;
+	if (!err && numFrames > 0) 
+		samples = (float*)malloc((size_t)numFrames * clientFormat.mBytesPerFrame);
+	while (samples && framesRead < numFrames) {
+		AudioBufferList bufferList;
+		bufferList.mNumberBuffers = 1;
+		bufferList.mBuffers[0].mNumberChannels = numChannels;
+		bufferList.mBuffers[0].mDataByteSize = (UInt32)MIN(numFrames - framesRead, 32768) * clientFormat.mBytesPerFrame;
+		bufferList.mBuffers[0].mData = samples + framesRead * numChannels;
+		UInt32 ioFrames = bufferList.mBuffers[0].mDataByteSize / clientFormat.mBytesPerFrame;
+		if (ExtAudioFileRead(extFile, &ioFrames, &bufferList) || ioFrames == 0) break;
+		framesRead += ioFrames;
+	}
+	ExtAudioFileDispose(extFile);
+	AudioFileClose(fileID);
+	
+	if (!framesRead) {
+		free(samples);
+		return nil;
+	}
+	return [[NSData alloc] initWithBytesNoCopy:samples length:(NSUInteger)framesRead * clientFormat.mBytesPerFrame freeWhenDone:YES];
+}
+
+- (NSData*)linearPCMData
+{
+	NSData* result = nil;
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		if (!impl->_linearPCMData) impl->_linearPCMData = decodeLinearPCM(self, impl);
+		result = [[impl->_linearPCMData retain] autorelease];
+	}
+	return result;
+}
+
 - (void)queue: (AudioQueueRef)inAQ propertyID: (AudioQueuePropertyID)inID
 {
 
@@ -679,21 +1188,82 @@ static double getQueueTime(CASoundImpl* impl)
 	if (impl->_isStopping) 
 		return;
 	
+	// the sound wraps round as the buffers are filled, so running out of data means the last pass has been heard
 	if (impl->_outOfData && impl->_lastBufferEnqueued == inBuffer) {	
 		impl->_outOfData = false;
 		impl->_lastBufferEnqueued = NULL;
-		if (impl->_numLoops < 0) {
-			impl->_readPos = impl->_readStartPos;
-		} else {
-			stopQueue(impl);
-			if (impl->_delegate) {
-				[impl->_delegate soundDidFinishPlaying: self];
-			}
-			return;
+		stopQueue(impl);
+		if (impl->_delegate) {
+			[impl->_delegate soundDidFinishPlaying: self];
 		}
+		return;
 	}
 	
-	if (impl->_asbd.mBytesPerPacket) {
+	if (impl->_timeStretch && impl->_isSkipping) {
+		if (!impl->_isStretching) {
+			impl->_timeStretch->Reset(impl->_readPos);
+			impl->_stretchReadPos = impl->_readPos;
+			impl->_isStretching = true;
+			// skipping plays on past the loop to the end of the sound, and the read ahead has to as well
+			if (impl->_packetCache) impl->_packetCache->SetLoop(0, -1, false);
+		}
+		
+		UInt32 framesToFill = MIN(inBuffer->mAudioDataBytesCapacity / impl->_asbd.mBytesPerFrame, (UInt32)kSkipBufferFrames);
+		UInt32 framesFilled = framesToFill;
+		SInt64 prevReadPos = impl->_readPos;
+		OSStatus err = impl->_timeStretch->Render(impl->_readPos, framesFilled, inBuffer->mAudioData);
+		if (err) 
+			return;
+		
+		// currentTime follows the sound, not the queue, while skipping
+		impl->_mediaStartSampleTime += (double)(impl->_readPos - prevReadPos) - framesFilled;
+		if (framesFilled < framesToFill) {
+			impl->_outOfData = true;
+			impl->_mediaEndSampleTime = impl->_readPos;
+		}
+		if (framesFilled) {
+			inBuffer->mAudioDataByteSize = framesFilled * impl->_asbd.mBytesPerFrame;
+			impl->_lastBufferEnqueued = inBuffer;
+			/*OSStatus err =*/ AudioQueueEnqueueBuffer(impl->_queue, inBuffer, 0, NULL);
+		}
+
+	} else if (impl->_loopEngine) {
+		if (impl->_isStretching) {
+			// back from skipping, the read ahead carries on from wherever the time stretch got to
+			impl->_isStretching = false;
+			loopPacketCache(impl);
+			if (impl->_packetCache) impl->_packetCache->Prefetch(impl->_readPos);
+		}
+		
+		UInt32 bytesPerFrame = impl->_asbd.mBytesPerFrame;
+		UInt32 framesToFill = inBuffer->mAudioDataBytesCapacity / bytesPerFrame;
+		UInt8* fillPtr = (UInt8*)inBuffer->mAudioData;
+		UInt32 framesFilled = 0;
+		
+		while (framesFilled < framesToFill) {
+			UInt32 numFrames = framesToFill - framesFilled;
+			bool wrapped = false;
+			OSStatus err = impl->_loopEngine->Render(impl->_readPos, loopsAgain(impl), numFrames, fillPtr + framesFilled * bytesPerFrame, wrapped);
+			if (err) 
+				return;
+			
+			framesFilled += numFrames;
+			if (wrapped) {
+				impl->_loopCount++;
+			} else if (framesFilled < framesToFill) {
+				impl->_outOfData = true;
+				impl->_mediaEndSampleTime = impl->_readPos;
+				break;
+			}
+		}
+		
+		if (framesFilled) {
+			inBuffer->mAudioDataByteSize = framesFilled * bytesPerFrame;
+			impl->_lastBufferEnqueued = inBuffer;
+			/*OSStatus err =*/ AudioQueueEnqueueBuffer(impl->_queue, inBuffer, 0, NULL);
+		}
+
+	} else if (impl->_asbd.mBytesPerPacket) {
 		UInt32 bytesToFill = inBuffer->mAudioDataBytesCapacity;
 		UInt32 packetsToFill = inBuffer->mAudioDataBytesCapacity / impl->_asbd.mBytesPerPacket;
 		UInt8* fillPtr = (UInt8*)inBuffer->mAudioData;
@@ -701,9 +1271,13 @@ static double getQueueTime(CASoundImpl* impl)
 		
 		while (true) {
 		
-			UInt32 ioNumBytes = bytesToFill;
+			SInt64 loopEnd = loopEndPacket(impl);
+			bool isLooping = loopsAgain(impl) && impl->_readPos < loopEnd;
 			UInt32 ioNumPackets = packetsToFill;
-			OSStatus err = AudioFileReadPackets(impl->_afid, false, &ioNumBytes, NULL, impl->_readPos, &ioNumPackets, fillPtr);
+			if (isLooping && ioNumPackets > loopEnd - impl->_readPos)
+				ioNumPackets = (UInt32)(loopEnd - impl->_readPos);
+			UInt32 ioNumBytes = ioNumPackets * impl->_asbd.mBytesPerPacket;
+			OSStatus err = readPackets(impl, &ioNumBytes, NULL, impl->_readPos, &ioNumPackets, fillPtr);
 			if (err) 
 				return;
 		
@@ -714,14 +1288,15 @@ static double getQueueTime(CASoundImpl* impl)
 			impl->_readPos += ioNumPackets;
 			
 			if (packetsToFill != 0) {
-				if (impl->_numLoops < 0 || impl->_loopCount+1 < impl->_numLoops) {
+				if (isLooping) {
 					impl->_loopCount++;
-					if (impl->_readPos == impl->_readStartPos) {
+					SInt64 loopStart = loopStartPacket(impl);
+					if (impl->_readPos == loopStart) {
 						// we read zero bytes even though we're at the beginning of the loop.
 						// we have to break out otherwise it is an infinite loop.
 						break;
 					}
-					impl->_readPos = impl->_readStartPos;
+					impl->_readPos = loopStart;
 				} else {
 					impl->_outOfData = true;
 					impl->_mediaEndSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
@@ -742,18 +1317,35 @@ static double getQueueTime(CASoundImpl* impl)
 	
 		const size_t kNumPacketDescs = 512;
 		AudioStreamPacketDescription descs[kNumPacketDescs];
-		UInt32 ioNumBytes = inBuffer->mAudioDataBytesCapacity;
-		UInt32 ioNumPackets = kNumPacketDescs;
-		OSStatus err = AudioFileReadPackets(impl->_afid, false, &ioNumBytes, descs, impl->_readPos, &ioNumPackets, inBuffer->mAudioData);
-		if (err) 
-			return;
+		UInt32 ioNumBytes = 0;
+		UInt32 ioNumPackets = 0;
+		
+		// at most twice round: once more from the loop start if the end of the file is where the loop ends
+		for (int attempt = 0; attempt < 2; ++attempt) {
+			SInt64 loopEnd = loopEndPacket(impl);
+			bool isLooping = loopsAgain(impl) && impl->_readPos < loopEnd;
+			ioNumBytes = inBuffer->mAudioDataBytesCapacity;
+			ioNumPackets = kNumPacketDescs;
+			if (isLooping && ioNumPackets > loopEnd - impl->_readPos)
+				ioNumPackets = (UInt32)(loopEnd - impl->_readPos);
+			OSStatus err = readPackets(impl, &ioNumBytes, descs, impl->_readPos, &ioNumPackets, inBuffer->mAudioData);
+			if (err) 
+				return;
+			
+			impl->_readPos += ioNumPackets;
+			if (isLooping && (ioNumPackets == 0 || impl->_readPos >= loopEnd)) {
+				impl->_loopCount++;
+				impl->_readPos = loopStartPacket(impl);
+			}
+			if (ioNumPackets) 
+				break;
+		}
 		
-		impl->_readPos += ioNumPackets;
 		inBuffer->mAudioDataByteSize = ioNumBytes;
 
 		if (ioNumPackets) {
 			impl->_lastBufferEnqueued = inBuffer;
-			err = AudioQueueEnqueueBuffer(impl->_queue, inBuffer, ioNumPackets, descs);
+			AudioQueueEnqueueBuffer(impl->_queue, inBuffer, ioNumPackets, descs);
 		} else {
 			impl->_outOfData = true;
 			impl->_mediaEndSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
@@ -775,34 +1367,94 @@ static double getQueueTime(CASoundImpl* impl)
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
 		impl->_enableMetering = flag;
-		if (impl->_queue) {
+		// the tap can only be put in while the queue isn't running, a running queue meters itself until it is made again
+		if (flag && !impl->_meteringEngine && impl->_queue && !impl->_wasStarted)
+			allocMeteringTap(impl);
+		if (impl->_meteringEngine) {
+			// start from silence rather than from wherever the levels were left. once in, the tap stays until the
+			// queue goes, doing nothing while metering is off
+			if (flag) CAMeteringEngineReset(impl->_meteringEngine);
+		} else if (impl->_queue) {
 			UInt32 iflag = flag;
 			AudioQueueSetProperty(impl->_queue, kAudioQueueProperty_EnableLevelMetering, &iflag, sizeof(iflag));
 		}
 	}
 }
 
-@dynamic meters;
+@dynamic meters, amplitudeMeters;
+
+static float decibels(float inAmplitude)
+{
+	return inAmplitude > 0.f ? fmaxf(20.f * log10f(inAmplitude), kMinMeterDecibels) : kMinMeterDecibels;
+}
+
+static CASoundLevels* getMeters(CASoundImpl* impl, CASoundLevels** ioMeters, bool inDecibels)
+{
+	UInt32 numChannels = impl->_asbd.mChannelsPerFrame;
+	if (!*ioMeters)
+		*ioMeters = (CASoundLevels*)calloc(numChannels, sizeof(CASoundLevels));
+	if (!impl->_meterLevels)
+		impl->_meterLevels = (CAMeterChannelLevels*)calloc(numChannels, sizeof(CAMeterChannelLevels));
+	CASoundLevels* meters = *ioMeters;
+	
+	if (impl->_meteringEngine && impl->_enableMetering) {
+		// the levels are taken from what the tap last published, without going near the render thread
+		memset(impl->_meterLevels, 0, sizeof(CAMeterChannelLevels) * numChannels);
+		CAMeteringEngineGetLevels(impl->_meteringEngine, impl->_meterLevels, numChannels, NULL);
+		for (UInt32 i = 0; i < numChannels; ++i) {
+			const CAMeterChannelLevels& levels = impl->_meterLevels[i];
+			meters[i].averagePower = inDecibels ? decibels(levels.rms) : levels.rms;
+			meters[i].peakPower = inDecibels ? decibels(levels.peak) : levels.peak;
+			meters[i].truePeakPower = inDecibels ? decibels(levels.truePeak) : levels.truePeak;
+		}
+	} else if (impl->_queue && impl->_enableMetering) {
+		AudioQueueLevelMeterState* levels = (AudioQueueLevelMeterState*)alloca(sizeof(AudioQueueLevelMeterState) * numChannels);
+		UInt32 propSize = sizeof(AudioQueueLevelMeterState) * numChannels;
+		OSStatus err = AudioQueueGetProperty(impl->_queue, inDecibels ? kAudioQueueProperty_CurrentLevelMeterDB : kAudioQueueProperty_CurrentLevelMeter, levels, &propSize);
+		for (UInt32 i = 0; i < numChannels; ++i) {
+			meters[i].averagePower = err ? 0. : levels[i].mAveragePower;
+			meters[i].peakPower = err ? 0. : levels[i].mPeakPower;
+			meters[i].truePeakPower = meters[i].peakPower;
+		}
+	} else {
+		memset(meters, 0, sizeof(CASoundLevels) * numChannels);
+	}
+	return meters;
+}
 
 - (CASoundLevels*)meters
 {
 	CASoundLevels* result = NULL;
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
-		UInt32 numChannels = impl->_asbd.mChannelsPerFrame;
-		if (!impl->_meters) {
-			impl->_meters = (CASoundLevels*)calloc(numChannels, sizeof(CASoundLevels));
-		}
-		if (impl->_queue && impl->_enableMetering) {
-			UInt32 propSize = sizeof(CASoundLevels) * numChannels;
-			OSStatus err = AudioQueueGetProperty(impl->_queue, kAudioQueueProperty_CurrentLevelMeterDB, impl->_meters, &propSize);
-			if (err) {
-				memset(impl->_meters, 0, sizeof(float) * numChannels);
-			}
-		} else {
-			memset(impl->_meters, 0, sizeof(float) * numChannels);
+		result = getMeters(impl, &impl->_meters, true);
+	}
+	return result;
+}
+
+- (CASoundLevels*)amplitudeMeters
+{
+	CASoundLevels* result = NULL;
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		result = getMeters(impl, &impl->_amplitudeMeters, false);
+	}
+	return result;
+}
+
+@dynamic loudness;
+
+- (CASoundLoudness)loudness
+{
+	CASoundLoudness result = { kCAMeter_MinLoudness, kCAMeter_MinLoudness };
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		CAMeterLoudness loudness;
+		if (impl->_meteringEngine && impl->_enableMetering) {
+			CAMeteringEngineGetLevels(impl->_meteringEngine, NULL, 0, &loudness);
+			result.momentaryLoudness = loudness.momentary;
+			result.shortTermLoudness = loudness.shortTerm;
 		}
-		result = impl->_meters;
 	}
 	return result;
 }
@@ -839,21 +1491,18 @@ static OSStatus CASoundAFReadProc(
 								UInt32 *	actualCount)
 {
 	CASound* sound = (CASound*)inClientData;
-	NSData* data = [sound data];
-	if (!data) {
+	CASoundImpl* impl = [sound impl];
+	if (!impl->_bytes || inPosition < 0) {
 		*actualCount = 0;
 		return -50/*paramErr*/;
 	}
 	
-	SInt64 length = [data length];
-	if (requestCount > length) 
-		requestCount = length;		
-
-	NSRange range;
-	range.location = inPosition;
-	range.length = requestCount;
+	if (inPosition > impl->_length)
+		inPosition = impl->_length;
+	if (requestCount > impl->_length - inPosition) 
+		requestCount = (UInt32)(impl->_length - inPosition);
 
-	[data getBytes: buffer range: range];
+	memcpy(buffer, impl->_bytes + inPosition, requestCount);
 	
 	*actualCount = requestCount;
 	
@@ -0,0 +1,308 @@
+/*
+ 
+ File: CASoundLoopEngine.cpp
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#include "CASoundLoopEngine.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+
+enum {
+	kNoBoundary = 2
+};
+
+template <typename T>
+static inline T ClampSample(double inValue, double inMin, double inMax)
+{
+	if (inValue < inMin) return (T)inMin;
+	if (inValue > inMax) return (T)inMax;
+	return (T)lrint(inValue);
+}
+
+CASoundLoopEngine::CASoundLoopEngine()
+	: mBytesPerFrame(0), mSamplesPerFrame(0), mSampleType(kSampleType_None), mFrameCount(0),
+	mReadProc(NULL), mRefCon(NULL), mMaxCrossfadeFrames(0), mMaxHeadFrames(0), mStagingMemory(NULL), mLeadInMemory(NULL),
+	mActiveBoundary(0), mRenderingBoundary(kNoBoundary)
+{
+	memset(mBoundaries, 0, sizeof(mBoundaries));
+}
+
+CASoundLoopEngine::~CASoundLoopEngine()
+{
+	Dispose();
+}
+
+OSStatus CASoundLoopEngine::Initialize(const AudioStreamBasicDescription& inFormat, SInt64 inFrameCount, ReadProc inReadProc, void* inRefCon,
+									   UInt32 inMaxCrossfadeFrames, UInt32 inMaxHeadFrames)
+{
+	Dispose();
+	if (inFormat.mFormatID != kAudioFormatLinearPCM || inFormat.mFramesPerPacket != 1 || !inFormat.mBytesPerFrame || !inReadProc)
+		return kAudioFormatUnsupportedDataFormatError;
+	
+	mBytesPerFrame = inFormat.mBytesPerFrame;
+	mSamplesPerFrame = inFormat.mChannelsPerFrame;
+	mFrameCount = inFrameCount;
+	mReadProc = inReadProc;
+	mRefCon = inRefCon;
+	mMaxHeadFrames = inMaxHeadFrames;
+	
+	// only interleaved, packed, native endian samples of the common sizes are mixed
+	UInt32 flags = inFormat.mFormatFlags;
+	bool isMixable = !(flags & kAudioFormatFlagIsNonInterleaved)
+		&& (flags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian)
+		&& mSamplesPerFrame && inFormat.mBitsPerChannel * mSamplesPerFrame == mBytesPerFrame * 8;
+	if (isMixable) {
+		if ((flags & kAudioFormatFlagIsFloat) && inFormat.mBitsPerChannel == 32)
+			mSampleType = kSampleType_Float32;
+		else if (!(flags & kAudioFormatFlagIsFloat) && (flags & kAudioFormatFlagIsSignedInteger) && inFormat.mBitsPerChannel == 16)
+			mSampleType = kSampleType_Int16;
+		else if (!(flags & kAudioFormatFlagIsFloat) && (flags & kAudioFormatFlagIsSignedInteger) && inFormat.mBitsPerChannel == 32)
+			mSampleType = kSampleType_Int32;
+	}
+	mMaxCrossfadeFrames = mSampleType != kSampleType_None ? inMaxCrossfadeFrames : 0;
+	
+	// two of each staging buffer, one for each boundary, and the lead in scratch buffer
+	size_t boundaryBytes = (size_t)(mMaxCrossfadeFrames + mMaxHeadFrames) * mBytesPerFrame;
+	mStagingMemory = (Byte*)calloc(2 * boundaryBytes + (size_t)mMaxCrossfadeFrames * mBytesPerFrame + 1, 1);
+	if (!mStagingMemory) {
+		Dispose();
+		return -108/*memFullErr*/;
+	}
+	for (int i = 0; i < 2; ++i) {
+		Boundary& boundary = mBoundaries[i];
+		boundary.mLoopStartFrame = 0;
+		boundary.mLoopEndFrame = mFrameCount;
+		boundary.mCrossfadeStartFrame = mFrameCount;
+		boundary.mResumeFrame = 0;
+		boundary.mNumHeadFrames = 0;
+		boundary.mCrossfade = mStagingMemory + i * boundaryBytes;
+		boundary.mHead = boundary.mCrossfade + (size_t)mMaxCrossfadeFrames * mBytesPerFrame;
+	}
+	mLeadInMemory = mStagingMemory + 2 * boundaryBytes;
+	mActiveBoundary.store(0, std::memory_order_release);
+	return noErr;
+}
+
+void CASoundLoopEngine::Dispose()
+{
+	free(mStagingMemory);
+	mStagingMemory = NULL;
+	mLeadInMemory = NULL;
+	memset(mBoundaries, 0, sizeof(mBoundaries));
+	mSampleType = kSampleType_None;
+	mReadProc = NULL;
+	mFrameCount = 0;
+}
+
+OSStatus CASoundLoopEngine::ReadFully(ReadProc inProc, void* inRefCon, SInt64 inFrame, UInt32 inNumFrames, void* outBuffer)
+{
+	Byte* dest = (Byte*)outBuffer;
+	while (inNumFrames) {
+		UInt32 numFrames = inNumFrames;
+		OSStatus err = inProc(inRefCon, inFrame, &numFrames, dest);
+		if (err) return err;
+		if (!numFrames) return kAudioFileEndOfFileError;
+		dest += numFrames * mBytesPerFrame;
+		inFrame += numFrames;
+		inNumFrames -= numFrames;
+	}
+	return noErr;
+}
+
+void CASoundLoopEngine::MixCrossfade(Byte* ioTail, const Byte* inLeadIn, UInt32 inNumFrames)
+{
+	// equal power, since the two sides are rarely in phase
+	const double kQuarterTurn = M_PI / 2.;
+	for (UInt32 frame = 0; frame < inNumFrames; ++frame) {
+		double angle = (frame + .5) / inNumFrames * kQuarterTurn;
+		double fadeOut = cos(angle), fadeIn = sin(angle);
+		size_t first = (size_t)frame * mSamplesPerFrame;
+		for (UInt32 i = 0; i < mSamplesPerFrame; ++i) {
+			switch (mSampleType) {
+				case kSampleType_Float32: {
+					Float32* tail = (Float32*)ioTail + first + i;
+					*tail = (Float32)(*tail * fadeOut + ((const Float32*)inLeadIn)[first + i] * fadeIn);
+					break;
+				}
+				case kSampleType_Int16: {
+					SInt16* tail = (SInt16*)ioTail + first + i;
+					*tail = ClampSample<SInt16>(*tail * fadeOut + ((const SInt16*)inLeadIn)[first + i] * fadeIn, -32768., 32767.);
+					break;
+				}
+				case kSampleType_Int32: {
+					SInt32* tail = (SInt32*)ioTail + first + i;
+					*tail = ClampSample<SInt32>(*tail * fadeOut + ((const SInt32*)inLeadIn)[first + i] * fadeIn, -2147483648., 2147483647.);
+					break;
+				}
+				default:
+					break;
+			}
+		}
+	}
+}
+
+OSStatus CASoundLoopEngine::SetLoop(SInt64 inLoopStartFrame, SInt64 inLoopEndFrame, UInt32 inCrossfadeFrames, ReadProc inStageProc, void* inStageRefCon)
+{
+	if (!mStagingMemory) return kAudioFileNotOpenError;
+	
+	SInt64 loopStart = inLoopStartFrame < 0 ? 0 : (inLoopStartFrame > mFrameCount ? mFrameCount : inLoopStartFrame);
+	SInt64 loopEnd = inLoopEndFrame > mFrameCount ? mFrameCount : inLoopEndFrame;
+	if (loopEnd <= loopStart) {
+		// nothing to loop over, so loop the whole sound
+		loopStart = 0;
+		loopEnd = mFrameCount;
+	}
+	
+	SInt64 crossfadeFrames = inCrossfadeFrames < mMaxCrossfadeFrames ? inCrossfadeFrames : mMaxCrossfadeFrames;
+	SInt64 leadInFrame;
+	if (loopStart >= crossfadeFrames && loopEnd - loopStart >= crossfadeFrames) {
+		// fade in what leads up to the loop start, so every pass is as long as the loop
+		leadInFrame = loopStart - crossfadeFrames;
+	} else {
+		// fade in the first frames of the loop, which can't then overlap the ones being faded out
+		if (crossfadeFrames > (loopEnd - loopStart) / 2)
+			crossfadeFrames = (loopEnd - loopStart) / 2;
+		leadInFrame = loopStart;
+	}
+	SInt64 resumeFrame = leadInFrame + crossfadeFrames;
+	SInt64 crossfadeStartFrame = loopEnd - crossfadeFrames;
+	SInt64 numHeadFrames = crossfadeStartFrame - resumeFrame;
+	if (numHeadFrames > mMaxHeadFrames) 
+		numHeadFrames = mMaxHeadFrames;
+	
+	// stage into the boundary that isn't active, once Render is sure not to be using it
+	UInt32 next = 1 - mActiveBoundary.load(std::memory_order_relaxed);
+	while (mRenderingBoundary.load(std::memory_order_seq_cst) == next)
+		sched_yield();
+	Boundary& boundary = mBoundaries[next];
+	
+	OSStatus err = ReadFully(inStageProc, inStageRefCon, crossfadeStartFrame, (UInt32)crossfadeFrames, boundary.mCrossfade);
+	if (err) return err;
+	err = ReadFully(inStageProc, inStageRefCon, leadInFrame, (UInt32)crossfadeFrames, mLeadInMemory);
+	if (err) return err;
+	MixCrossfade(boundary.mCrossfade, mLeadInMemory, (UInt32)crossfadeFrames);
+	err = ReadFully(inStageProc, inStageRefCon, resumeFrame, (UInt32)numHeadFrames, boundary.mHead);
+	if (err) return err;
+	
+	boundary.mLoopStartFrame = loopStart;
+	boundary.mLoopEndFrame = loopEnd;
+	boundary.mCrossfadeStartFrame = crossfadeStartFrame;
+	boundary.mResumeFrame = resumeFrame;
+	boundary.mNumHeadFrames = (UInt32)numHeadFrames;
+	mActiveBoundary.store(next, std::memory_order_seq_cst);
+	return noErr;
+}
+
+void CASoundLoopEngine::GetSourceLoop(SInt64& outEndFrame, SInt64& outResumeFrame) const
+{
+	// past the staged frames on either side of the wrap
+	const Boundary& boundary = mBoundaries[mActiveBoundary.load(std::memory_order_acquire)];
+	outEndFrame = boundary.mCrossfadeStartFrame;
+	outResumeFrame = boundary.mResumeFrame + boundary.mNumHeadFrames;
+}
+
+OSStatus CASoundLoopEngine::Render(SInt64& ioFrame, bool inWraps, UInt32& ioNumFrames, void* outBuffer, bool& outWrapped)
+{
+	outWrapped = false;
+	if (!mStagingMemory) {
+		ioNumFrames = 0;
+		return kAudioFileNotOpenError;
+	}
+	
+	// claim the active boundary, making sure it was still active once SetLoop could see the claim
+	UInt32 index;
+	do {
+		index = mActiveBoundary.load(std::memory_order_seq_cst);
+		mRenderingBoundary.store(index, std::memory_order_seq_cst);
+	} while (index != mActiveBoundary.load(std::memory_order_seq_cst));
+	const Boundary& boundary = mBoundaries[index];
+	
+	const bool isLooping = inWraps && ioFrame < boundary.mLoopEndFrame;
+	const UInt32 maxFrames = ioNumFrames;
+	Byte* dest = (Byte*)outBuffer;
+	UInt32 numFrames = 0;
+	OSStatus err = noErr;
+	
+	while (numFrames < maxFrames) {
+		SInt64 frame = ioFrame;
+		SInt64 framesToCopy = maxFrames - numFrames;
+		
+		if (isLooping && frame >= boundary.mLoopEndFrame) {
+			ioFrame = boundary.mResumeFrame;
+			outWrapped = true;
+			break;
+		}
+		
+		if (isLooping && frame >= boundary.mCrossfadeStartFrame) {
+			if (framesToCopy > boundary.mLoopEndFrame - frame)
+				framesToCopy = boundary.mLoopEndFrame - frame;
+			memcpy(dest, boundary.mCrossfade + (frame - boundary.mCrossfadeStartFrame) * mBytesPerFrame, (size_t)framesToCopy * mBytesPerFrame);
+		} else if (frame >= boundary.mResumeFrame && frame < boundary.mResumeFrame + boundary.mNumHeadFrames) {
+			if (framesToCopy > boundary.mResumeFrame + boundary.mNumHeadFrames - frame)
+				framesToCopy = boundary.mResumeFrame + boundary.mNumHeadFrames - frame;
+			memcpy(dest, boundary.mHead + (frame - boundary.mResumeFrame) * mBytesPerFrame, (size_t)framesToCopy * mBytesPerFrame);
+		} else {
+			if (isLooping && framesToCopy > boundary.mCrossfadeStartFrame - frame)
+				framesToCopy = boundary.mCrossfadeStartFrame - frame;
+			UInt32 numRead = (UInt32)framesToCopy;
+			err = mReadProc(mRefCon, frame, &numRead, dest);
+			if (err || !numRead) 
+				break; // the end of the sound
+			framesToCopy = numRead;
+		}
+		
+		dest += framesToCopy * mBytesPerFrame;
+		numFrames += (UInt32)framesToCopy;
+		ioFrame += framesToCopy;
+	}
+	
+	mRenderingBoundary.store(kNoBoundary, std::memory_order_release);
+	ioNumFrames = numFrames;
+	return err;
+}
@@ -0,0 +1,140 @@
+/*
+ 
+ File: CASoundLoopEngine.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#ifndef __CASoundLoopEngine_h__
+#define __CASoundLoopEngine_h__
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+
+/*
+ CASoundLoopEngine plays a linear PCM sound with a loop between two frames, wrapping at the loop
+ end with no gap and, if asked to, with a crossfade across the wrap.
+ 
+ SetLoop stages the loop's boundary ahead of time: the crossfade (the last frames before the loop
+ end mixed with the frames that lead into the resume point) and the first frames after the resume
+ point. At the wrap Render copies these from memory, so nothing has to be read from the sound just
+ when the queue needs it most.
+ 
+ The crossfade mixes in the frames just before the loop start if there are enough of them, so that
+ every pass of the loop is exactly as long as the loop. When the loop starts too close to the start of
+ the sound it mixes in the first frames of the loop instead and resumes after them, which makes each
+ pass after the first that much shorter. Crossfades are done for native endian float, 16 bit and 32 bit
+ integer samples; other sample formats wrap without one.
+ 
+ The staged boundary is double buffered, so SetLoop may be called from any one thread while another
+ renders.
+*/
+
+class CASoundLoopEngine
+{
+public:
+	// reads up to *ioNumFrames frames starting at inFrame, returning fewer only at the end of the sound
+	typedef OSStatus (*ReadProc)(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer);
+	
+	CASoundLoopEngine();
+	~CASoundLoopEngine();
+	
+	// inReadProc is what Render reads from. inMaxCrossfadeFrames and inMaxHeadFrames size the staging
+	// buffers, so that SetLoop never allocates.
+	OSStatus Initialize(const AudioStreamBasicDescription& inFormat, SInt64 inFrameCount, ReadProc inReadProc, void* inRefCon,
+						UInt32 inMaxCrossfadeFrames, UInt32 inMaxHeadFrames);
+	void Dispose();
+	
+	// loops from inLoopEndFrame (exclusive) back to inLoopStartFrame, reading the boundary with inStageProc, which
+	// can differ from the render ReadProc when that one may only be called on the render thread.
+	// Out of range loop points are clamped to the sound.
+	OSStatus SetLoop(SInt64 inLoopStartFrame, SInt64 inLoopEndFrame, UInt32 inCrossfadeFrames, ReadProc inStageProc, void* inStageRefCon);
+	
+	// renders up to ioNumFrames frames from ioFrame on, advancing it. If inWraps and ioFrame is inside the loop,
+	// stops at the loop end and sets ioFrame to where the next pass resumes, with outWrapped set.
+	// Otherwise plays on to the end of the sound, and returns fewer frames than asked for only there.
+	OSStatus Render(SInt64& ioFrame, bool inWraps, UInt32& ioNumFrames, void* outBuffer, bool& outWrapped);
+	
+	SInt64 GetFrameCount() const { return mFrameCount; }
+	
+	// where the read ahead should go at the end of the loop and where it should carry on from
+	void GetSourceLoop(SInt64& outEndFrame, SInt64& outResumeFrame) const;
+	
+private:
+	enum SampleType { kSampleType_None, kSampleType_Float32, kSampleType_Int16, kSampleType_Int32 };
+	
+	struct Boundary {
+		SInt64	mLoopStartFrame;
+		SInt64	mLoopEndFrame;
+		SInt64	mCrossfadeStartFrame;	// the staged crossfade replaces [mCrossfadeStartFrame, mLoopEndFrame)
+		SInt64	mResumeFrame;			// where each pass after the first starts
+		UInt32	mNumHeadFrames;			// staged frames from mResumeFrame on
+		Byte*	mCrossfade;
+		Byte*	mHead;
+	};
+	
+	OSStatus ReadFully(ReadProc inProc, void* inRefCon, SInt64 inFrame, UInt32 inNumFrames, void* outBuffer);
+	void MixCrossfade(Byte* ioTail, const Byte* inLeadIn, UInt32 inNumFrames);
+	
+	UInt32					mBytesPerFrame;
+	UInt32					mSamplesPerFrame;
+	SampleType				mSampleType;
+	SInt64					mFrameCount;
+	ReadProc				mReadProc;
+	void*					mRefCon;
+	UInt32					mMaxCrossfadeFrames;
+	UInt32					mMaxHeadFrames;
+	Byte*					mStagingMemory;
+	Byte*					mLeadInMemory;		// scratch for SetLoop
+	
+	Boundary				mBoundaries[2];
+	std::atomic<UInt32>		mActiveBoundary;
+	std::atomic<UInt32>		mRenderingBoundary;	// the one Render is using, or kNoBoundary
+	
+	CASoundLoopEngine(const CASoundLoopEngine&);
+	CASoundLoopEngine& operator=(const CASoundLoopEngine&);
+};
+
+#endif // __CASoundLoopEngine_h__
@@ -0,0 +1,115 @@
+/*
+ 
+ File: CASoundMixer.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+@class CASound;
+
+/* identifies a voice playing on a CASoundMixer. stays valid until the voice stops, after which it
+   refers to no voice, even once the voice is reused. */
+typedef uint64_t CASoundVoiceID;
+
+/* returned by playSound: when there is no voice free */
+enum {
+	kCASoundMixer_NoVoice = 0
+};
+
+
+/*  CASoundMixer plays any number of CASound objects at once through a single AudioQueue, mixing them
+in software to stereo 32 bit float. Each sound played is a voice with its own volume, pan and rate.
+The number of voices is fixed when the mixer is made, and voices are handed out and given back 
+without locking, so that all of the methods below may be called from any thread while the queue renders.
+
+Sounds are decoded in full the first time they are played (see CASound's linearPCMData), so they 
+should be short. The decoding is done on the mixer's own queue rather than the caller's thread, and the voice
+starts once it is done; a sound that can't be decoded stops its voice. A voice plays the sound once plus its numberOfLoops, from the start, and ignores 
+the sound's loop points. */
+
+@interface CASoundMixer : NSObject {
+@private
+    __strong void* _impl;
+}
+
+- (CASoundMixer*)initWithMaxVoices:(NSUInteger)maxVoices; /* mixes at 44.1 kHz */
+- (CASoundMixer*)initWithMaxVoices:(NSUInteger)maxVoices sampleRate:(double)sampleRate;
+
+/* transport control */
+
+- (BOOL)start;	/* starts the output queue. voices can be played before or after. */
+- (BOOL)stop;	/* stops the output queue. voices hold their place until it starts again. */
+
+/* voices */
+
+/* plays a sound on a free voice, returning kCASoundMixer_NoVoice if there is none.
+volume is between 0. and 1., pan between -1. (left) and 1. (right) and rate is between .0625 and 16. 
+rate 1. plays the sound at its own sample rate, whatever the mixer's. */
+- (CASoundVoiceID)playSound:(CASound*)sound;
+- (CASoundVoiceID)playSound:(CASound*)sound volume:(float)volume pan:(float)pan rate:(float)rate;
+
+/* fades the voice out over the next buffer and frees it. returns NO if the voice has already stopped. */
+- (BOOL)stopVoice:(CASoundVoiceID)voice;
+- (void)stopAllVoices;
+
+/* these take effect from the next buffer rendered, and return NO if the voice has already stopped.
+volume and pan changes are ramped across the buffer. */
+- (BOOL)setVolume:(float)volume forVoice:(CASoundVoiceID)voice;
+- (BOOL)setPan:(float)pan forVoice:(CASoundVoiceID)voice;
+- (BOOL)setRate:(float)rate forVoice:(CASoundVoiceID)voice;
+
+- (BOOL)isVoicePlaying:(CASoundVoiceID)voice;
+
+/* properties */
+
+@property(readonly) BOOL isRunning;
+@property(readonly) double sampleRate;
+@property(readonly) NSUInteger maxVoices;
+@property(readonly) NSUInteger activeVoiceCount; /* voices playing right now, or about to once their sound is decoded */
+
+@property float volume; /* the volume for the whole mix. The valid range is between 0. and 1., inclusive. */
+
+@end
+
@@ -0,0 +1,437 @@
+/*
+ 
+ File: CASoundMixer.mm
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#import "CASoundMixer.h"
+#import "CASound.h"
+#import "CASoundMixerVoice.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <math.h>
+#import <atomic>
+
+enum {
+	kNumberOfMixerBuffers = 3,
+	kMixerBufferFrames = 512,		// about 12 ms at 44.1 kHz, which is also how long volume changes and stops ramp over
+	kMixerChannels = 2
+};
+
+static const double kDefaultMixerSampleRate = 44100.;
+static const float kMinVoiceRate = .0625f;
+static const float kMaxVoiceRate = 16.f;
+
+struct CASoundMixerImpl
+{
+	AudioStreamBasicDescription _asbd;
+	AudioQueueRef _queue;
+	AudioQueueBufferRef _aqbuf[kNumberOfMixerBuffers];
+	bool _isRunning;
+	float _volume;
+	
+	CASoundMixerVoice* _voices;
+	NSData** _voiceData;			// what each voice's mSamples points into, only touched off the render thread
+	UInt32 _maxVoices;
+	
+	// sounds are decoded and finished voices given back on this queue, never on the caller's thread or the render thread.
+	// the render thread tells it a voice has finished through _reclaimSource, which doesn't block or allocate.
+	dispatch_queue_t _voiceQueue;
+	dispatch_source_t _reclaimSource;
+};
+
+static inline UInt32 voiceIndex(CASoundVoiceID inVoice) { return (UInt32)(inVoice & 0xFFFFFFFF) - 1; }
+static inline UInt32 voiceGeneration(CASoundVoiceID inVoice) { return (UInt32)(inVoice >> 32); }
+
+static inline bool isVoiceActive(UInt32 inState)
+{
+	// a voice waiting for its sound to be decoded counts as playing, so that it can be stopped or changed from the start
+	return inState == CASoundMixerVoice::kState_Starting || inState == CASoundMixerVoice::kState_Playing;
+}
+
+static bool setVoiceParameter(CASoundMixerImpl* impl, CASoundVoiceID inVoice, std::atomic<UInt64> CASoundMixerVoice::* inParameter, float inValue)
+{
+	UInt32 index = voiceIndex(inVoice);
+	if (inVoice == kCASoundMixer_NoVoice || index >= impl->_maxVoices) return false;
+	
+	// only succeeds while the parameter still belongs to the voice's generation
+	CASoundMixerVoice& voice = impl->_voices[index];
+	UInt32 generation = voiceGeneration(inVoice);
+	std::atomic<UInt64>& parameter = voice.*inParameter;
+	UInt64 oldValue = parameter.load(std::memory_order_relaxed);
+	do {
+		if ((UInt32)(oldValue >> 32) != generation) return false;
+	} while (!parameter.compare_exchange_weak(oldValue, CASoundMixerVoice::PackParameter(generation, inValue), std::memory_order_relaxed));
+	return isVoiceActive(voice.mState.load(std::memory_order_acquire));
+}
+
+static void freeVoice(CASoundMixerImpl* impl, UInt32 inIndex)
+{
+	// the voice must be claimed or starting. its data is released here, never on the render thread.
+	CASoundMixerVoice& voice = impl->_voices[inIndex];
+	[impl->_voiceData[inIndex] release];
+	impl->_voiceData[inIndex] = nil;
+	voice.mSamples = NULL;
+	voice.mState.store(CASoundMixerVoice::kState_Free, std::memory_order_release);
+}
+
+static UInt32 reclaimVoices(CASoundMixerImpl* impl)
+{
+	// gives back voices the render thread has finished with
+	UInt32 numReclaimed = 0;
+	for (UInt32 i = 0; i < impl->_maxVoices; ++i) {
+		UInt32 state = CASoundMixerVoice::kState_Done;
+		if (!impl->_voices[i].mState.compare_exchange_strong(state, CASoundMixerVoice::kState_Claimed, std::memory_order_acquire)) continue;
+		freeVoice(impl, i);
+		++numReclaimed;
+	}
+	return numReclaimed;
+}
+
+static CASoundMixerVoice* claimVoice(CASoundMixerImpl* impl, UInt32* outIndex)
+{
+	for (int pass = 0; pass < 2; ++pass) {
+		for (UInt32 i = 0; i < impl->_maxVoices; ++i) {
+			CASoundMixerVoice& voice = impl->_voices[i];
+			UInt32 state = CASoundMixerVoice::kState_Free;
+			if (voice.mState.load(std::memory_order_relaxed) == CASoundMixerVoice::kState_Free && 
+					voice.mState.compare_exchange_strong(state, CASoundMixerVoice::kState_Claimed, std::memory_order_acquire)) {
+				*outIndex = i;
+				return &voice;
+			}
+		}
+		if (!reclaimVoices(impl)) break;
+	}
+	return NULL;
+}
+
+static void startVoice(CASoundMixerImpl* impl, UInt32 inIndex, UInt32 inGeneration, CASound* inSound)
+{
+	// runs on the voice queue. decoding can take a while the first time a sound is played, the result is kept by the sound.
+	CASoundMixerVoice& voice = impl->_voices[inIndex];
+	NSData* data = [inSound linearPCMData];
+	UInt32 numChannels = (UInt32)[inSound channelCount];
+	bool isStopped = voice.mStop.load(std::memory_order_relaxed) != CASoundMixerVoice::PackParameter(inGeneration, 0.f);
+	
+	// nothing but this changes a starting voice's state, so it can be set up or freed as it is
+	if (isStopped || !numChannels || [data length] < numChannels * sizeof(float)) {
+		freeVoice(impl, inIndex);
+		return;
+	}
+	
+	impl->_voiceData[inIndex] = [data retain];
+	voice.mSamples = (const float*)[data bytes];
+	voice.mNumChannels = numChannels;
+	voice.mNumFrames = [data length] / (numChannels * sizeof(float));
+	voice.mSourceSampleRate = [inSound sampleRate];
+	voice.mState.store(CASoundMixerVoice::kState_Playing, std::memory_order_release);
+}
+
+static void renderMix(CASoundMixerImpl* impl, AudioQueueBufferRef inBuffer)
+{
+	float* mix = (float*)inBuffer->mAudioData;
+	memset(mix, 0, kMixerBufferFrames * impl->_asbd.mBytesPerFrame);
+	bool didFinish = false;
+	for (UInt32 i = 0; i < impl->_maxVoices; ++i) {
+		CASoundMixerVoice& voice = impl->_voices[i];
+		if (voice.mState.load(std::memory_order_acquire) == CASoundMixerVoice::kState_Playing)
+			didFinish |= voice.Render(impl->_asbd.mSampleRate, mix, kMixerBufferFrames);
+	}
+	inBuffer->mAudioDataByteSize = kMixerBufferFrames * impl->_asbd.mBytesPerFrame;
+	
+	// have the finished voices' data released now rather than whenever the next sound can't find a free voice
+	if (didFinish) dispatch_source_merge_data(impl->_reclaimSource, 1);
+}
+
+static void CASoundMixerAQOutputCallback(
+								void *                  inUserData,
+								AudioQueueRef           inAQ,
+								AudioQueueBufferRef     inBuffer)
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)inUserData;
+	renderMix(impl, inBuffer);
+	AudioQueueEnqueueBuffer(inAQ, inBuffer, 0, NULL);
+}
+
+static float clampFloat(float inValue, float inMin, float inMax)
+{
+	return inValue < inMin ? inMin : (inValue > inMax ? inMax : inValue);
+}
+
+
+@implementation CASoundMixer
+
+- (CASoundMixer*)initWithMaxVoices:(NSUInteger)maxVoices
+{
+	return [self initWithMaxVoices: maxVoices sampleRate: kDefaultMixerSampleRate];
+}
+
+- (CASoundMixer*)initWithMaxVoices:(NSUInteger)maxVoices sampleRate:(double)sampleRate
+{
+	self = [super init];
+	if (!self) return nil;
+	if (!maxVoices || maxVoices > 0xFFFFFFFE || sampleRate <= 0.) {
+		[self release];
+		return nil;
+	}
+	
+	CASoundMixerImpl* impl = new CASoundMixerImpl();
+	_impl = impl;
+	impl->_volume = 1.0;
+	impl->_maxVoices = (UInt32)maxVoices;
+	impl->_voices = new CASoundMixerVoice[impl->_maxVoices]();
+	impl->_voiceData = new NSData*[impl->_maxVoices]();
+	
+	impl->_voiceQueue = dispatch_queue_create("com.apple.CASoundMixer.voices", DISPATCH_QUEUE_SERIAL);
+	impl->_reclaimSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, impl->_voiceQueue);
+	dispatch_source_set_event_handler(impl->_reclaimSource, ^{ reclaimVoices(impl); });
+	dispatch_resume(impl->_reclaimSource);
+	
+	impl->_asbd.mSampleRate = sampleRate;
+	impl->_asbd.mFormatID = kAudioFormatLinearPCM;
+	impl->_asbd.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+	impl->_asbd.mBitsPerChannel = 32;
+	impl->_asbd.mChannelsPerFrame = kMixerChannels;
+	impl->_asbd.mFramesPerPacket = 1;
+	impl->_asbd.mBytesPerFrame = impl->_asbd.mBytesPerPacket = kMixerChannels * sizeof(float);
+	
+	// the queue's callback runs on the queue's own thread, which is the render thread for the voices
+	OSStatus err = AudioQueueNewOutput(&impl->_asbd, CASoundMixerAQOutputCallback, impl, NULL, NULL, 0, &impl->_queue);
+	for (UInt32 i = 0; !err && i < kNumberOfMixerBuffers; ++i)
+		err = AudioQueueAllocateBuffer(impl->_queue, kMixerBufferFrames * impl->_asbd.mBytesPerFrame, impl->_aqbuf + i);
+	if (err) {
+		[self release];
+		return nil;
+	}
+	return self;
+}
+
+- (void)disposeImpl
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	if (!impl) return;
+	if (impl->_queue) AudioQueueDispose(impl->_queue, true);
+	
+	// with the queue gone nothing renders, so once the voice queue has run what is already on it nothing else touches the voices
+	dispatch_source_cancel(impl->_reclaimSource);
+	dispatch_sync(impl->_voiceQueue, ^{});
+	dispatch_release(impl->_reclaimSource);
+	dispatch_release(impl->_voiceQueue);
+	
+	for (UInt32 i = 0; i < impl->_maxVoices; ++i)
+		[impl->_voiceData[i] release];
+	delete [] impl->_voiceData;
+	delete [] impl->_voices;
+	delete impl;
+	_impl = NULL;
+}
+
+- (void)finalize
+{
+	[self disposeImpl];
+	[super finalize];
+}
+
+- (void)dealloc
+{
+	[self disposeImpl];
+	[super dealloc];
+}
+
+// Transport control
+- (BOOL)start
+{
+	@synchronized(self) {
+		CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+		if (impl->_isRunning) return NO;
+		
+		// prime the queue with what the voices have to play so far
+		for (int i = 0; i < kNumberOfMixerBuffers; ++i) {
+			renderMix(impl, impl->_aqbuf[i]);
+			AudioQueueEnqueueBuffer(impl->_queue, impl->_aqbuf[i], 0, NULL);
+		}
+		/* err =*/ AudioQueueSetParameter(impl->_queue, kAudioQueueParam_Volume, impl->_volume);
+		OSStatus err = AudioQueueStart(impl->_queue, NULL);
+		if (err) {
+			AudioQueueStop(impl->_queue, true);
+			return NO;
+		}
+		impl->_isRunning = true;
+	}
+	return YES;
+}
+
+- (BOOL)stop
+{
+	@synchronized(self) {
+		CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+		if (!impl->_isRunning) return NO;
+		AudioQueueStop(impl->_queue, true);
+		impl->_isRunning = false;
+	}
+	return YES;
+}
+
+// Voices
+- (CASoundVoiceID)playSound:(CASound*)sound
+{
+	return [self playSound: sound volume: 1.f pan: 0.f rate: 1.f];
+}
+
+- (CASoundVoiceID)playSound:(CASound*)sound volume:(float)volume pan:(float)pan rate:(float)rate
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	if (!sound) return kCASoundMixer_NoVoice;
+	
+	UInt32 index;
+	CASoundMixerVoice* voice = claimVoice(impl, &index);
+	if (!voice) return kCASoundMixer_NoVoice;
+	
+	// a new generation first, so that any setter still holding the last voice ID fails from here on
+	UInt32 generation = voice->mGeneration.load(std::memory_order_relaxed) + 1;
+	if (!generation) generation = 1;
+	voice->mGeneration.store(generation, std::memory_order_relaxed);
+	voice->mVolume.store(CASoundMixerVoice::PackParameter(generation, clampFloat(volume, 0.f, 1.f)), std::memory_order_relaxed);
+	voice->mPan.store(CASoundMixerVoice::PackParameter(generation, clampFloat(pan, -1.f, 1.f)), std::memory_order_relaxed);
+	voice->mRate.store(CASoundMixerVoice::PackParameter(generation, clampFloat(rate, kMinVoiceRate, kMaxVoiceRate)), std::memory_order_relaxed);
+	voice->mStop.store(CASoundMixerVoice::PackParameter(generation, 0.f), std::memory_order_relaxed);
+	
+	voice->mLoopsLeft = [sound numberOfLoops];
+	voice->mPosition = 0.;
+	voice->mHasGain = false;
+	voice->mState.store(CASoundMixerVoice::kState_Starting, std::memory_order_release);
+	
+	// the sound is decoded and the voice started on the voice queue, so that the caller never waits for a decode.
+	// the block keeps the sound until then.
+	dispatch_async(impl->_voiceQueue, ^{
+		startVoice(impl, index, generation, sound);
+	});
+	
+	return ((CASoundVoiceID)generation << 32) | (index + 1);
+}
+
+- (BOOL)stopVoice:(CASoundVoiceID)voice
+{
+	return setVoiceParameter((CASoundMixerImpl*)_impl, voice, &CASoundMixerVoice::mStop, 1.f);
+}
+
+- (void)stopAllVoices
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	for (UInt32 i = 0; i < impl->_maxVoices; ++i) {
+		CASoundMixerVoice& voice = impl->_voices[i];
+		UInt32 generation = voice.mGeneration.load(std::memory_order_relaxed);
+		setVoiceParameter(impl, ((CASoundVoiceID)generation << 32) | (i + 1), &CASoundMixerVoice::mStop, 1.f);
+	}
+}
+
+- (BOOL)setVolume:(float)volume forVoice:(CASoundVoiceID)voice
+{
+	return setVoiceParameter((CASoundMixerImpl*)_impl, voice, &CASoundMixerVoice::mVolume, clampFloat(volume, 0.f, 1.f));
+}
+
+- (BOOL)setPan:(float)pan forVoice:(CASoundVoiceID)voice
+{
+	return setVoiceParameter((CASoundMixerImpl*)_impl, voice, &CASoundMixerVoice::mPan, clampFloat(pan, -1.f, 1.f));
+}
+
+- (BOOL)setRate:(float)rate forVoice:(CASoundVoiceID)voice
+{
+	return setVoiceParameter((CASoundMixerImpl*)_impl, voice, &CASoundMixerVoice::mRate, clampFloat(rate, kMinVoiceRate, kMaxVoiceRate));
+}
+
+- (BOOL)isVoicePlaying:(CASoundVoiceID)voice
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	UInt32 index = voiceIndex(voice);
+	if (voice == kCASoundMixer_NoVoice || index >= impl->_maxVoices) return NO;
+	CASoundMixerVoice& mixerVoice = impl->_voices[index];
+	return mixerVoice.mGeneration.load(std::memory_order_relaxed) == voiceGeneration(voice) && 
+		isVoiceActive(mixerVoice.mState.load(std::memory_order_acquire));
+}
+
+// Properties
+@dynamic isRunning, sampleRate, maxVoices, activeVoiceCount, volume;
+
+- (BOOL)isRunning
+{
+	return ((CASoundMixerImpl*)_impl)->_isRunning;
+}
+
+- (double)sampleRate
+{
+	return ((CASoundMixerImpl*)_impl)->_asbd.mSampleRate;
+}
+
+- (NSUInteger)maxVoices
+{
+	return ((CASoundMixerImpl*)_impl)->_maxVoices;
+}
+
+- (NSUInteger)activeVoiceCount
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	NSUInteger count = 0;
+	for (UInt32 i = 0; i < impl->_maxVoices; ++i)
+		if (isVoiceActive(impl->_voices[i].mState.load(std::memory_order_relaxed))) ++count;
+	return count;
+}
+
+- (void)setVolume:(float)volume
+{
+	CASoundMixerImpl* impl = (CASoundMixerImpl*)_impl;
+	@synchronized(self) {
+		impl->_volume = volume;
+		/*OSStatus err =*/ AudioQueueSetParameter(impl->_queue, kAudioQueueParam_Volume, impl->_volume);
+	}
+}
+
+- (float)volume
+{
+	return ((CASoundMixerImpl*)_impl)->_volume;
+}
+
+@end
@@ -0,0 +1,119 @@
+/*
+ 
+ File: CASoundMixerVoice.cpp
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#include "CASoundMixerVoice.h"
+#include <math.h>
+
+bool CASoundMixerVoice::Render(double inMixSampleRate, float* ioMix, UInt32 inNumFrames)
+{
+	float volume = UnpackParameter(mVolume.load(std::memory_order_relaxed));
+	float pan = UnpackParameter(mPan.load(std::memory_order_relaxed));
+	float rate = UnpackParameter(mRate.load(std::memory_order_relaxed));
+	bool isStopping = UnpackParameter(mStop.load(std::memory_order_relaxed)) != 0.f;
+	
+	// mono sounds are panned with equal power, stereo ones balanced
+	float targetLeft, targetRight;
+	if (mNumChannels == 1) {
+		float angle = (pan + 1.f) * (float)M_PI_4;
+		targetLeft = volume * cosf(angle);
+		targetRight = volume * sinf(angle);
+	} else {
+		targetLeft = volume * fminf(1.f, 1.f - pan);
+		targetRight = volume * fminf(1.f, 1.f + pan);
+	}
+	if (isStopping) targetLeft = targetRight = 0.f;
+	if (!mHasGain) {
+		mGainLeft = targetLeft;
+		mGainRight = targetRight;
+		mHasGain = true;
+	}
+	
+	float gainLeft = mGainLeft, gainRight = mGainRight;
+	float stepLeft = (targetLeft - gainLeft) / inNumFrames, stepRight = (targetRight - gainRight) / inNumFrames;
+	double step = rate * mSourceSampleRate / inMixSampleRate;
+	double position = mPosition;
+	const float* samples = mSamples;
+	UInt32 numChannels = mNumChannels;
+	UInt32 rightOffset = numChannels > 1 ? 1 : 0;	// any channels past the first two aren't heard
+	SInt64 numFrames = mNumFrames;
+	bool isFinished = isStopping;
+	
+	for (UInt32 i = 0; i < inNumFrames; ++i) {
+		while (position >= numFrames) {
+			if (!mLoopsLeft) break;
+			if (mLoopsLeft > 0) --mLoopsLeft;
+			position -= numFrames;
+		}
+		if (position >= numFrames) {
+			isFinished = true;
+			break;
+		}
+		
+		// linear interpolation, into the start of the sound again if it loops
+		SInt64 frame = (SInt64)position;
+		float fraction = (float)(position - frame);
+		SInt64 nextFrame = frame + 1 < numFrames ? frame + 1 : (mLoopsLeft ? 0 : frame);
+		const float* a = samples + frame * numChannels;
+		const float* b = samples + nextFrame * numChannels;
+		float left = a[0] + fraction * (b[0] - a[0]);
+		float right = a[rightOffset] + fraction * (b[rightOffset] - a[rightOffset]);
+		
+		ioMix[2 * i] += gainLeft * left;
+		ioMix[2 * i + 1] += gainRight * right;
+		gainLeft += stepLeft;
+		gainRight += stepRight;
+		position += step;
+	}
+	
+	mPosition = position;
+	mGainLeft = targetLeft;
+	mGainRight = targetRight;
+	if (isFinished) mState.store(kState_Done, std::memory_order_release);
+	return isFinished;
+}
@@ -0,0 +1,119 @@
+/*
+ 
+ File: CASoundMixerVoice.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#ifndef __CASoundMixerVoice_h__
+#define __CASoundMixerVoice_h__
+
+#include <CoreAudio/CoreAudioTypes.h>
+#include <atomic>
+
+/*
+ CASoundMixerVoice is one voice of a CASoundMixer: a decoded sound, interleaved 32 bit float, played
+ into a stereo mix with its own volume, pan and rate.
+ 
+ Control threads hand a voice out, set it up and give it back, and the render thread plays it, with
+ mState saying which of them owns it. The parameters may be set from any thread while the voice plays.
+ Each is packed with the generation of the voice it was set for, so that a stale voice ID can never change
+ the voice that has since taken its place.
+ 
+ Render is all the render thread does with a voice, and is kept apart from the mixer's AudioQueue so
+ that it can be measured on its own.
+*/
+
+struct CASoundMixerVoice
+{
+	enum {
+		kState_Free,		// anyone may claim it
+		kState_Claimed,		// a control thread is setting it up or giving it back
+		kState_Starting,	// waiting for its sound to be decoded, it plays once it is
+		kState_Playing,		// the render thread owns it
+		kState_Done			// finished, waiting for a control thread to give it back
+	};
+	
+	static UInt64 PackParameter(UInt32 inGeneration, float inValue)
+	{
+		union { float f; UInt32 u; } bits;
+		bits.f = inValue;
+		return ((UInt64)inGeneration << 32) | bits.u;
+	}
+	
+	static float UnpackParameter(UInt64 inPacked)
+	{
+		union { float f; UInt32 u; } bits;
+		bits.u = (UInt32)inPacked;
+		return bits.f;
+	}
+	
+	// mixes the next inNumFrames frames of the voice into ioMix, stereo interleaved at inMixSampleRate, ramping
+	// volume and pan changes across them. Sets mState to kState_Done and returns true once the voice has finished.
+	bool Render(double inMixSampleRate, float* ioMix, UInt32 inNumFrames);
+	
+	std::atomic<UInt32> mState;
+	std::atomic<UInt32> mGeneration;
+	
+	std::atomic<UInt64> mVolume;
+	std::atomic<UInt64> mPan;
+	std::atomic<UInt64> mRate;
+	std::atomic<UInt64> mStop;
+	
+	// written before the voice starts playing and only read after
+	const float* mSamples;
+	UInt32 mNumChannels;
+	SInt64 mNumFrames;
+	double mSourceSampleRate;
+	
+	// the render thread's own
+	SInt64 mLoopsLeft;
+	double mPosition;
+	float mGainLeft;
+	float mGainRight;
+	bool mHasGain;
+};
+
+#endif // __CASoundMixerVoice_h__
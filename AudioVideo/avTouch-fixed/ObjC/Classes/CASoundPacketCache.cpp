@@ -0,0 +1,510 @@
+/*
+ 
+ File: CASoundPacketCache.cpp
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#include "CASoundPacketCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+enum {
+	kDefaultChunkBytes = 32768,
+	kMaxChunkPackets = 512,
+	kMinNumberOfChunks = 4
+};
+
+// how long the read ahead thread sleeps when it has nothing to do before it looks again
+static const int64_t kReadAheadIdleNanoseconds = 100 * NSEC_PER_MSEC;
+
+CASoundPacketCache::CASoundPacketCache()
+	: mFileID(NULL), mBytesPerPacket(0), mPacketCount(0),
+	mChunks(NULL), mNumChunks(0), mChunkBytes(0), mChunkPackets(0), mChunkMemory(NULL), mDescriptionMemory(NULL),
+	mMappedPackets(NULL), mMappedReadAheadPackets(0), mMappedReadPacket(0), mMappedPagedFromPacket(0), mMappedPagedPacket(0),
+	mWriteIndex(0), mReadIndex(0), mReadOffsetPackets(0), mReadOffsetBytes(0),
+	mPrefetchPacket(0), mPrefetchGeneration(0), mLoopStartPacket(0), mLoopEndPacket(-1), mLoops(false), mUnderrunCount(0),
+	mThreadStarted(false), mThreadShouldExit(false), mSemaphore(NULL)
+{
+}
+
+CASoundPacketCache::~CASoundPacketCache()
+{
+	Dispose();
+}
+
+OSStatus CASoundPacketCache::Initialize(AudioFileID inFileID, const AudioStreamBasicDescription& inFormat, double inReadAheadSeconds)
+{
+	Dispose();
+	mFileID = inFileID;
+	mBytesPerPacket = inFormat.mBytesPerPacket;
+	
+	UInt64 packetCount = 0;
+	UInt32 propSize = sizeof(packetCount);
+	OSStatus err = AudioFileGetProperty(mFileID, kAudioFilePropertyAudioDataPacketCount, &propSize, &packetCount);
+	if (err) return err;
+	mPacketCount = (SInt64)packetCount;
+	
+	// a chunk must hold at least one of the largest packets
+	UInt32 maxPacketSize = mBytesPerPacket;
+	if (!maxPacketSize) {
+		propSize = sizeof(maxPacketSize);
+		err = AudioFileGetProperty(mFileID, kAudioFilePropertyPacketSizeUpperBound, &propSize, &maxPacketSize);
+		if (err) return err;
+	}
+	mChunkBytes = maxPacketSize > kDefaultChunkBytes ? maxPacketSize : (UInt32)kDefaultChunkBytes;
+	mChunkPackets = mBytesPerPacket ? mChunkBytes / mBytesPerPacket : (UInt32)kMaxChunkPackets;
+	
+	// size the ring from the (possibly average) bit rate
+	double bytesPerSecond = 0.;
+	if (mBytesPerPacket && inFormat.mFramesPerPacket) {
+		bytesPerSecond = inFormat.mSampleRate / inFormat.mFramesPerPacket * mBytesPerPacket;
+	} else {
+		UInt32 bitRate = 0;
+		propSize = sizeof(bitRate);
+		if (AudioFileGetProperty(mFileID, kAudioFilePropertyBitRate, &propSize, &bitRate) == noErr)
+			bytesPerSecond = bitRate / 8.;
+	}
+	mNumChunks = (UInt32)ceil(inReadAheadSeconds * bytesPerSecond / mChunkBytes);
+	if (mNumChunks < kMinNumberOfChunks) mNumChunks = kMinNumberOfChunks;
+	
+	mChunks = (Chunk*)calloc(mNumChunks, sizeof(Chunk));
+	mChunkMemory = (Byte*)malloc((size_t)mNumChunks * mChunkBytes);
+	if (!mBytesPerPacket)
+		mDescriptionMemory = (AudioStreamPacketDescription*)malloc((size_t)mNumChunks * mChunkPackets * sizeof(AudioStreamPacketDescription));
+	if (!mChunks || !mChunkMemory || (!mBytesPerPacket && !mDescriptionMemory)) {
+		Dispose();
+		return kAudio_MemFullError;
+	}
+	for (UInt32 i = 0; i < mNumChunks; ++i) {
+		mChunks[i].mData = mChunkMemory + (size_t)i * mChunkBytes;
+		mChunks[i].mPacketDescriptions = mDescriptionMemory ? mDescriptionMemory + (size_t)i * mChunkPackets : NULL;
+	}
+	
+	mWriteIndex.store(0, std::memory_order_relaxed);
+	mReadIndex.store(0, std::memory_order_relaxed);
+	mReadOffsetPackets = 0;
+	mReadOffsetBytes = 0;
+	return StartReadAhead();
+}
+
+OSStatus CASoundPacketCache::InitializeMapped(const void* inPackets, SInt64 inPacketCount, const AudioStreamBasicDescription& inFormat, double inReadAheadSeconds)
+{
+	Dispose();
+	if (!inPackets || !inFormat.mBytesPerPacket || !inFormat.mFramesPerPacket)
+		return kAudioFormatUnsupportedDataFormatError;
+	mMappedPackets = (const Byte*)inPackets;
+	mPacketCount = inPacketCount;
+	mBytesPerPacket = inFormat.mBytesPerPacket;
+	
+	// pages are asked for a chunk's worth at a time
+	mChunkBytes = mBytesPerPacket > kDefaultChunkBytes ? mBytesPerPacket : (UInt32)kDefaultChunkBytes;
+	mChunkPackets = mChunkBytes / mBytesPerPacket;
+	mMappedReadAheadPackets = (SInt64)ceil(inReadAheadSeconds * inFormat.mSampleRate / inFormat.mFramesPerPacket);
+	if (mMappedReadAheadPackets < mChunkPackets) mMappedReadAheadPackets = mChunkPackets;
+	mMappedReadPacket.store(0, std::memory_order_relaxed);
+	mMappedPagedFromPacket.store(0, std::memory_order_relaxed);
+	mMappedPagedPacket.store(0, std::memory_order_relaxed);
+	return StartReadAhead();
+}
+
+OSStatus CASoundPacketCache::StartReadAhead()
+{
+	mUnderrunCount.store(0, std::memory_order_relaxed);
+	mSemaphore = dispatch_semaphore_create(0);
+	mThreadShouldExit.store(false, std::memory_order_relaxed);
+	if (pthread_create(&mThread, NULL, ReadAheadThreadEntry, this)) {
+		Dispose();
+		return kAudio_MemFullError;
+	}
+	mThreadStarted = true;
+	return noErr;
+}
+
+void CASoundPacketCache::Dispose()
+{
+	if (mThreadStarted) {
+		mThreadShouldExit.store(true, std::memory_order_release);
+		dispatch_semaphore_signal(mSemaphore);
+		pthread_join(mThread, NULL);
+		mThreadStarted = false;
+	}
+	if (mSemaphore) {
+		dispatch_release(mSemaphore);
+		mSemaphore = NULL;
+	}
+	if (mFileID) {
+		AudioFileClose(mFileID);
+		mFileID = NULL;
+	}
+	free(mChunks);
+	free(mChunkMemory);
+	free(mDescriptionMemory);
+	mChunks = NULL;
+	mChunkMemory = NULL;
+	mDescriptionMemory = NULL;
+	mNumChunks = 0;
+	mMappedPackets = NULL;
+}
+
+void CASoundPacketCache::Prefetch(SInt64 inPacket)
+{
+	if (!mThreadStarted) return;
+	if (mMappedPackets) {
+		// nothing is paged in from there yet, as far as the reader is concerned
+		mMappedReadPacket.store(inPacket, std::memory_order_relaxed);
+		mMappedPagedFromPacket.store(inPacket, std::memory_order_relaxed);
+		mMappedPagedPacket.store(inPacket, std::memory_order_relaxed);
+	}
+	mPrefetchPacket.store(inPacket, std::memory_order_relaxed);
+	mPrefetchGeneration.fetch_add(1, std::memory_order_release);
+	dispatch_semaphore_signal(mSemaphore);
+}
+
+void CASoundPacketCache::SetLoop(SInt64 inLoopStartPacket, SInt64 inLoopEndPacket, bool inLoops)
+{
+	mLoopStartPacket.store(inLoopStartPacket, std::memory_order_relaxed);
+	mLoopEndPacket.store(inLoopEndPacket, std::memory_order_relaxed);
+	mLoops.store(inLoops, std::memory_order_release);
+	if (mThreadStarted) dispatch_semaphore_signal(mSemaphore);
+}
+
+void* CASoundPacketCache::ReadAheadThreadEntry(void* inRefCon)
+{
+	CASoundPacketCache* cache = static_cast<CASoundPacketCache*>(inRefCon);
+	if (cache->mMappedPackets)
+		cache->PageInAhead();
+	else
+		cache->ReadAhead();
+	return NULL;
+}
+
+SInt64 CASoundPacketCache::WrapAtLoopEnd(SInt64& ioNextPacket) const
+{
+	// wrap at the loop end, or at the end of the file when reading started past the loop, and return where
+	// reading from ioNextPacket has to stop
+	SInt64 endPacket = mPacketCount;
+	if (mLoops.load(std::memory_order_acquire)) {
+		SInt64 loopEndPacket = mLoopEndPacket.load(std::memory_order_relaxed);
+		if (loopEndPacket < 0 || loopEndPacket > mPacketCount)
+			loopEndPacket = mPacketCount;
+		if (ioNextPacket == loopEndPacket || ioNextPacket >= mPacketCount)
+			ioNextPacket = mLoopStartPacket.load(std::memory_order_relaxed);
+		if (ioNextPacket < loopEndPacket)
+			endPacket = loopEndPacket;
+	}
+	return endPacket;
+}
+
+SInt64 CASoundPacketCache::PacketsAhead(SInt64 inFromPacket, SInt64 inToPacket) const
+{
+	// how many packets playing from inFromPacket takes to get to inToPacket, going round the loop if it has to,
+	// negative if it never does
+	if (inToPacket >= inFromPacket)
+		return inToPacket - inFromPacket;
+	if (mLoops.load(std::memory_order_acquire)) {
+		SInt64 loopStartPacket = mLoopStartPacket.load(std::memory_order_relaxed);
+		SInt64 loopEndPacket = mLoopEndPacket.load(std::memory_order_relaxed);
+		if (loopEndPacket < 0 || loopEndPacket > mPacketCount)
+			loopEndPacket = mPacketCount;
+		if (inFromPacket <= loopEndPacket && inToPacket >= loopStartPacket)
+			return (loopEndPacket - inFromPacket) + (inToPacket - loopStartPacket);
+	}
+	return -1;
+}
+
+void CASoundPacketCache::ReadAhead()
+{
+	UInt32 seenGeneration = mPrefetchGeneration.load(std::memory_order_acquire);
+	SInt64 nextPacket = mPrefetchPacket.load(std::memory_order_relaxed);
+	
+	while (!mThreadShouldExit.load(std::memory_order_acquire)) {
+		UInt32 generation = mPrefetchGeneration.load(std::memory_order_acquire);
+		if (generation != seenGeneration) {
+			seenGeneration = generation;
+			nextPacket = mPrefetchPacket.load(std::memory_order_relaxed);
+		}
+		
+		SInt64 endPacket = WrapAtLoopEnd(nextPacket);
+		UInt32 writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+		bool isFull = (writeIndex - mReadIndex.load(std::memory_order_acquire)) >= mNumChunks;
+		if (isFull || nextPacket >= mPacketCount) {
+			dispatch_semaphore_wait(mSemaphore, dispatch_time(DISPATCH_TIME_NOW, kReadAheadIdleNanoseconds));
+			continue;
+		}
+		
+		Chunk& chunk = mChunks[writeIndex % mNumChunks];
+		if (!FillChunk(chunk, nextPacket, endPacket)) {
+			// don't spin on a read error, wait to be told to go somewhere else
+			nextPacket = mPacketCount;
+			continue;
+		}
+		nextPacket += chunk.mNumPackets;
+		mWriteIndex.store(writeIndex + 1, std::memory_order_release);
+	}
+}
+
+void CASoundPacketCache::PageInAhead()
+{
+	UInt32 seenGeneration = mPrefetchGeneration.load(std::memory_order_acquire);
+	SInt64 nextPacket = mPrefetchPacket.load(std::memory_order_relaxed);
+	SInt64 pagedFromPacket = nextPacket;
+	
+	while (!mThreadShouldExit.load(std::memory_order_acquire)) {
+		UInt32 generation = mPrefetchGeneration.load(std::memory_order_acquire);
+		if (generation != seenGeneration) {
+			seenGeneration = generation;
+			nextPacket = pagedFromPacket = mPrefetchPacket.load(std::memory_order_relaxed);
+		}
+		
+		// forget what the reader has played, or if it has left what we paged in, start over from it
+		SInt64 readPacket = mMappedReadPacket.load(std::memory_order_acquire);
+		SInt64 readAhead = PacketsAhead(pagedFromPacket, readPacket);
+		if (readAhead < 0 || readAhead > PacketsAhead(pagedFromPacket, nextPacket))
+			nextPacket = readPacket;
+		pagedFromPacket = readPacket;
+		mMappedPagedFromPacket.store(pagedFromPacket, std::memory_order_relaxed);
+		mMappedPagedPacket.store(nextPacket, std::memory_order_release);
+		
+		// go no further ahead of the reader than the read ahead, or once round the loop
+		SInt64 endPacket = WrapAtLoopEnd(nextPacket);
+		SInt64 maxAhead = mMappedReadAheadPackets;
+		if (mLoops.load(std::memory_order_relaxed) && endPacket - mLoopStartPacket.load(std::memory_order_relaxed) < maxAhead)
+			maxAhead = endPacket - mLoopStartPacket.load(std::memory_order_relaxed);
+		SInt64 ahead = PacketsAhead(readPacket, nextPacket);
+		if (ahead >= maxAhead || nextPacket >= mPacketCount) {
+			dispatch_semaphore_wait(mSemaphore, dispatch_time(DISPATCH_TIME_NOW, kReadAheadIdleNanoseconds));
+			continue;
+		}
+		
+		SInt64 numPackets = endPacket - nextPacket;
+		if (numPackets > mChunkPackets) numPackets = mChunkPackets;
+		if (numPackets > maxAhead - ahead) numPackets = maxAhead - ahead;
+		PageIn(nextPacket, numPackets);
+		nextPacket += numPackets;
+		mMappedPagedPacket.store(nextPacket, std::memory_order_release);
+	}
+}
+
+void CASoundPacketCache::PageIn(SInt64 inStartPacket, SInt64 inNumPackets)
+{
+	const Byte* start = mMappedPackets + inStartPacket * mBytesPerPacket;
+	const Byte* end = start + inNumPackets * mBytesPerPacket;
+	uintptr_t pageSize = (uintptr_t)getpagesize();
+	uintptr_t firstPage = (uintptr_t)start & ~(pageSize - 1);
+	madvise((void*)firstPage, (uintptr_t)end - firstPage, MADV_WILLNEED);
+	
+	// madvise only asks, reading a byte of every page has the faults taken here and not in the reader
+	volatile Byte sum = 0;
+	for (const Byte* page = start; page < end; page = (const Byte*)(((uintptr_t)page & ~(pageSize - 1)) + pageSize))
+		sum += *page;
+}
+
+const void* CASoundPacketCache::GetMappedPackets(SInt64 inStartingPacket, UInt32* ioNumPackets)
+{
+	if (inStartingPacket >= mPacketCount) {
+		*ioNumPackets = 0;
+		return NULL;
+	}
+	if ((SInt64)*ioNumPackets > mPacketCount - inStartingPacket)
+		*ioNumPackets = (UInt32)(mPacketCount - inStartingPacket);
+	
+	if (mThreadStarted) {
+		SInt64 nextPacket = inStartingPacket + *ioNumPackets;
+		SInt64 pagedPacket = mMappedPagedPacket.load(std::memory_order_acquire);
+		SInt64 pagedFromPacket = mMappedPagedFromPacket.load(std::memory_order_relaxed);
+		SInt64 startAhead = PacketsAhead(pagedFromPacket, inStartingPacket);
+		mMappedReadPacket.store(nextPacket, std::memory_order_release);
+		if (startAhead < 0 || startAhead + *ioNumPackets > PacketsAhead(pagedFromPacket, pagedPacket)) {
+			// the thread hasn't paged these in yet, so whoever reads them waits for the disk: send it on past them
+			mUnderrunCount.fetch_add(1, std::memory_order_relaxed);
+			Prefetch(nextPacket);
+		} else {
+			// there is room ahead for more now
+			dispatch_semaphore_signal(mSemaphore);
+		}
+	}
+	return mMappedPackets + inStartingPacket * mBytesPerPacket;
+}
+
+bool CASoundPacketCache::FillChunk(Chunk& ioChunk, SInt64 inStartPacket, SInt64 inEndPacket)
+{
+	UInt32 numBytes = mChunkBytes;
+	UInt32 numPackets = mChunkPackets;
+	if (inEndPacket <= inStartPacket || inEndPacket > mPacketCount)
+		inEndPacket = mPacketCount;
+	if ((SInt64)numPackets > inEndPacket - inStartPacket)
+		numPackets = (UInt32)(inEndPacket - inStartPacket);
+	
+	OSStatus err = AudioFileReadPackets(mFileID, false, &numBytes, ioChunk.mPacketDescriptions, inStartPacket, &numPackets, ioChunk.mData);
+	if (err || numPackets == 0) 
+		return false;
+	
+	ioChunk.mStartPacket = inStartPacket;
+	ioChunk.mNumPackets = numPackets;
+	ioChunk.mNumBytes = numBytes;
+	return true;
+}
+
+void CASoundPacketCache::PopChunk()
+{
+	mReadOffsetPackets = 0;
+	mReadOffsetBytes = 0;
+	mReadIndex.store(mReadIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	dispatch_semaphore_signal(mSemaphore);
+}
+
+OSStatus CASoundPacketCache::ReadPackets(AudioFileID inFileID, UInt32* ioNumBytes, AudioStreamPacketDescription* outPacketDescriptions,
+										 SInt64 inStartingPacket, UInt32* ioNumPackets, void* outBuffer)
+{
+	if (mMappedPackets) {
+		if (*ioNumPackets > *ioNumBytes / mBytesPerPacket)
+			*ioNumPackets = *ioNumBytes / mBytesPerPacket;
+		const void* packets = GetMappedPackets(inStartingPacket, ioNumPackets);
+		*ioNumBytes = *ioNumPackets * mBytesPerPacket;
+		if (*ioNumBytes) memcpy(outBuffer, packets, *ioNumBytes);
+		return noErr;
+	}
+	
+	// past the end there is nothing to cache, and the chunks waiting are likely the loop start
+	if (!mThreadStarted || inStartingPacket >= mPacketCount)
+		return AudioFileReadPackets(inFileID, false, ioNumBytes, outPacketDescriptions, inStartingPacket, ioNumPackets, outBuffer);
+	
+	const UInt32 maxBytes = *ioNumBytes;
+	const UInt32 maxPackets = *ioNumPackets;
+	Byte* dest = (Byte*)outBuffer;
+	UInt32 numBytes = 0;
+	UInt32 numPackets = 0;
+	SInt64 packet = inStartingPacket;
+	bool isOutOfSpace = false;
+	
+	while (numPackets < maxPackets && !isOutOfSpace && packet < mPacketCount) {
+		UInt32 readIndex = mReadIndex.load(std::memory_order_relaxed);
+		if (readIndex == mWriteIndex.load(std::memory_order_acquire))
+			break;
+		
+		Chunk& chunk = mChunks[readIndex % mNumChunks];
+		SInt64 chunkPacket = chunk.mStartPacket + mReadOffsetPackets;
+		SInt64 chunkEndPacket = chunk.mStartPacket + chunk.mNumPackets;
+		if (packet < chunkPacket || packet >= chunkEndPacket) {
+			// not where we're reading from, so it is of no more use
+			PopChunk();
+			continue;
+		}
+		
+		// skip ahead to the packet we want if it is further on in this chunk
+		while (chunkPacket < packet) {
+			mReadOffsetBytes += mBytesPerPacket ? mBytesPerPacket : chunk.mPacketDescriptions[mReadOffsetPackets].mDataByteSize;
+			++mReadOffsetPackets;
+			++chunkPacket;
+		}
+		
+		UInt32 packetsToCopy = chunk.mNumPackets - mReadOffsetPackets;
+		if (packetsToCopy > maxPackets - numPackets)
+			packetsToCopy = maxPackets - numPackets;
+		
+		UInt32 bytesToCopy = 0;
+		if (mBytesPerPacket) {
+			UInt32 packetsThatFit = (maxBytes - numBytes) / mBytesPerPacket;
+			if (packetsToCopy > packetsThatFit) {
+				packetsToCopy = packetsThatFit;
+				isOutOfSpace = true;
+			}
+			bytesToCopy = packetsToCopy * mBytesPerPacket;
+		} else {
+			const AudioStreamPacketDescription* desc = chunk.mPacketDescriptions + mReadOffsetPackets;
+			UInt32 i = 0;
+			for (; i < packetsToCopy; ++i) {
+				if (numBytes + bytesToCopy + desc[i].mDataByteSize > maxBytes) {
+					isOutOfSpace = true;
+					break;
+				}
+				if (outPacketDescriptions) {
+					outPacketDescriptions[numPackets + i] = desc[i];
+					outPacketDescriptions[numPackets + i].mStartOffset = numBytes + bytesToCopy;
+				}
+				bytesToCopy += desc[i].mDataByteSize;
+			}
+			packetsToCopy = i;
+		}
+		
+		memcpy(dest + numBytes, chunk.mData + mReadOffsetBytes, bytesToCopy);
+		numBytes += bytesToCopy;
+		numPackets += packetsToCopy;
+		packet += packetsToCopy;
+		mReadOffsetPackets += packetsToCopy;
+		mReadOffsetBytes += bytesToCopy;
+		if (mReadOffsetPackets == chunk.mNumPackets)
+			PopChunk();
+	}
+	
+	OSStatus err = noErr;
+	if (numPackets < maxPackets && !isOutOfSpace && packet < mPacketCount) {
+		// the read ahead thread hasn't got this far yet: read the rest ourselves and send it on past it
+		mUnderrunCount.fetch_add(1, std::memory_order_relaxed);
+		
+		UInt32 restBytes = maxBytes - numBytes;
+		UInt32 restPackets = maxPackets - numPackets;
+		AudioStreamPacketDescription* restDescriptions = outPacketDescriptions ? outPacketDescriptions + numPackets : NULL;
+		err = AudioFileReadPackets(inFileID, false, &restBytes, restDescriptions, packet, &restPackets, dest + numBytes);
+		if (err == noErr) {
+			if (restDescriptions) {
+				for (UInt32 i = 0; i < restPackets; ++i)
+					restDescriptions[i].mStartOffset += numBytes;
+			}
+			numBytes += restBytes;
+			numPackets += restPackets;
+			packet += restPackets;
+		}
+		Prefetch(packet);
+	}
+	
+	*ioNumBytes = numBytes;
+	*ioNumPackets = numPackets;
+	return err;
+}
@@ -0,0 +1,168 @@
+/*
+ 
+ File: CASoundPacketCache.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#ifndef __CASoundPacketCache_h__
+#define __CASoundPacketCache_h__
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <dispatch/dispatch.h>
+#include <pthread.h>
+#include <atomic>
+
+/*
+ CASoundPacketCache reads a sound's packets ahead of playback on a background thread, so that the
+ AudioQueue output callback only has to copy them out of memory.
+
+ The read ahead thread fills a ring of fixed size chunks, each holding a run of packets and where
+ they start in the file, with its own AudioFileID so that it never shares one with the callback.
+ When it reaches the loop end (the end of the file unless told otherwise) it carries on from the loop
+ start if the sound loops.
+ The callback takes chunks off the ring in ReadPackets, skipping any that don't continue from the
+ packet it asks for (after a seek, say). If the ring runs dry it counts an underrun, reads what is
+ missing directly as CASound always used to, and has the thread carry on from there.
+
+ Constant bit rate packets that are already in memory, mapped from a file say, aren't copied into
+ chunks at all. InitializeMapped has the thread page in the ones ahead of the reader instead, so that
+ the page faults happen there, and the reader gets them by pointer from GetMappedPackets. It counts an
+ underrun when it asks for packets the thread hasn't got to, and takes the faults itself.
+
+ The ring has one reader and one writer and never locks. Prefetch and SetLoop may be called from
+ any thread.
+*/
+
+class CASoundPacketCache
+{
+public:
+	CASoundPacketCache();
+	~CASoundPacketCache();
+	
+	// takes ownership of inFileID, which must be open on the same data as the sound's own AudioFileID.
+	// inReadAheadSeconds is how much audio the ring holds.
+	OSStatus Initialize(AudioFileID inFileID, const AudioStreamBasicDescription& inFormat, double inReadAheadSeconds);
+	// inPackets, inPacketCount constant bit rate packets of inFormat, must stay put until Dispose.
+	OSStatus InitializeMapped(const void* inPackets, SInt64 inPacketCount, const AudioStreamBasicDescription& inFormat, double inReadAheadSeconds);
+	void Dispose();
+	
+	// have the read ahead thread start over from inPacket
+	void Prefetch(SInt64 inPacket);
+	// inLoopEndPacket is exclusive, a negative one is the end of the file
+	void SetLoop(SInt64 inLoopStartPacket, SInt64 inLoopEndPacket, bool inLoops);
+	
+	// works like AudioFileReadPackets, and like it returns fewer packets than asked for only at the end of the
+	// file or when the next packet doesn't fit. inFileID is read from directly when the ring runs dry.
+	OSStatus ReadPackets(AudioFileID inFileID, UInt32* ioNumBytes, AudioStreamPacketDescription* outPacketDescriptions,
+						 SInt64 inStartingPacket, UInt32* ioNumPackets, void* outBuffer);
+	
+	// for a mapped cache, a pointer to up to *ioNumPackets packets from inStartingPacket, no copying involved.
+	// ReadPackets copies out of the same pointer.
+	const void* GetMappedPackets(SInt64 inStartingPacket, UInt32* ioNumPackets);
+	
+	UInt64 GetUnderrunCount() const { return mUnderrunCount.load(std::memory_order_relaxed); }
+	
+private:
+	struct Chunk {
+		SInt64							mStartPacket;
+		UInt32							mNumPackets;
+		UInt32							mNumBytes;
+		Byte*							mData;
+		AudioStreamPacketDescription*	mPacketDescriptions;	// NULL for constant bit rate formats
+	};
+	
+	OSStatus StartReadAhead();
+	static void* ReadAheadThreadEntry(void* inRefCon);
+	SInt64 WrapAtLoopEnd(SInt64& ioNextPacket) const;
+	SInt64 PacketsAhead(SInt64 inFromPacket, SInt64 inToPacket) const;
+	void ReadAhead();
+	void PageInAhead();
+	void PageIn(SInt64 inStartPacket, SInt64 inNumPackets);
+	bool FillChunk(Chunk& ioChunk, SInt64 inStartPacket, SInt64 inEndPacket);
+	void PopChunk();
+	
+	AudioFileID				mFileID;
+	UInt32					mBytesPerPacket;
+	SInt64					mPacketCount;
+	
+	Chunk*					mChunks;
+	UInt32					mNumChunks;
+	UInt32					mChunkBytes;
+	UInt32					mChunkPackets;
+	Byte*					mChunkMemory;
+	AudioStreamPacketDescription*	mDescriptionMemory;
+	
+	// a mapped cache's packets, how far ahead of the reader the thread pages them in, where the reader has got to,
+	// and the run of packets, going round the loop, that the thread has paged in for it
+	const Byte*				mMappedPackets;
+	SInt64					mMappedReadAheadPackets;
+	std::atomic<SInt64>		mMappedReadPacket;
+	std::atomic<SInt64>		mMappedPagedFromPacket;
+	std::atomic<SInt64>		mMappedPagedPacket;
+	
+	// chunk counters that only ever go up, the read ahead thread owns mWriteIndex and the reader mReadIndex
+	std::atomic<UInt32>		mWriteIndex;
+	std::atomic<UInt32>		mReadIndex;
+	UInt32					mReadOffsetPackets;		// how far the reader is into the chunk at mReadIndex
+	UInt32					mReadOffsetBytes;
+	
+	std::atomic<SInt64>		mPrefetchPacket;
+	std::atomic<UInt32>		mPrefetchGeneration;
+	std::atomic<SInt64>		mLoopStartPacket;
+	std::atomic<SInt64>		mLoopEndPacket;
+	std::atomic<bool>		mLoops;
+	std::atomic<UInt64>		mUnderrunCount;
+	
+	pthread_t				mThread;
+	bool					mThreadStarted;
+	std::atomic<bool>		mThreadShouldExit;
+	dispatch_semaphore_t	mSemaphore;
+	
+	CASoundPacketCache(const CASoundPacketCache&);
+	CASoundPacketCache& operator=(const CASoundPacketCache&);
+};
+
+#endif
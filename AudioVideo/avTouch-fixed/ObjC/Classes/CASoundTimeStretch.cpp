@@ -0,0 +1,364 @@
+/*
+ 
+ File: CASoundTimeStretch.cpp
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#include "CASoundTimeStretch.h"
+#include <Accelerate/Accelerate.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// half a grain, about 11.6 ms, which is 512 frames at 44.1 kHz
+static const double kHopSeconds = .0116;
+
+template <typename T>
+static inline T ClampSample(double inValue, double inMin, double inMax)
+{
+	if (inValue < inMin) return (T)inMin;
+	if (inValue > inMax) return (T)inMax;
+	return (T)lrint(inValue);
+}
+
+CASoundTimeStretch::CASoundTimeStretch()
+	: mBytesPerFrame(0), mSamplesPerFrame(0), mSampleType(kSampleType_None), mFrameCount(0), mReadProc(NULL), mRefCon(NULL),
+	mMaxRate(1.f), mRate(1.f), mGrainFrames(0), mHopFrames(0), mSearchFrames(0), mMaxSpanFrames(0),
+	mWindow(NULL), mRawSpan(NULL), mRawSpanStart(0), mRawSpanFrames(0), mSpan(NULL), mMono(NULL), mCorrelation(NULL), mAccumulator(NULL), mOutput(NULL), mMemory(NULL),
+	mAnalysisFrame(0.), mLastGrainStart(0), mHasLastGrain(false), mIsFinished(false), mIsDrained(false), mOutputOffset(0), mOutputFrames(0)
+{
+}
+
+CASoundTimeStretch::~CASoundTimeStretch()
+{
+	Dispose();
+}
+
+OSStatus CASoundTimeStretch::Initialize(const AudioStreamBasicDescription& inFormat, SInt64 inFrameCount, ReadProc inReadProc, void* inRefCon, float inMaxRate)
+{
+	Dispose();
+	if (inFormat.mFormatID != kAudioFormatLinearPCM || inFormat.mFramesPerPacket != 1 || !inFormat.mBytesPerFrame || !inReadProc || inMaxRate < 1.f)
+		return kAudioFormatUnsupportedDataFormatError;
+	
+	// only interleaved, packed, native endian samples of the common sizes are stretched
+	UInt32 flags = inFormat.mFormatFlags;
+	mSamplesPerFrame = inFormat.mChannelsPerFrame;
+	bool isStretchable = !(flags & kAudioFormatFlagIsNonInterleaved)
+		&& (flags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian)
+		&& mSamplesPerFrame && inFormat.mBitsPerChannel * mSamplesPerFrame == inFormat.mBytesPerFrame * 8;
+	if (isStretchable) {
+		if ((flags & kAudioFormatFlagIsFloat) && inFormat.mBitsPerChannel == 32)
+			mSampleType = kSampleType_Float32;
+		else if (!(flags & kAudioFormatFlagIsFloat) && (flags & kAudioFormatFlagIsSignedInteger) && inFormat.mBitsPerChannel == 16)
+			mSampleType = kSampleType_Int16;
+		else if (!(flags & kAudioFormatFlagIsFloat) && (flags & kAudioFormatFlagIsSignedInteger) && inFormat.mBitsPerChannel == 32)
+			mSampleType = kSampleType_Int32;
+	}
+	if (mSampleType == kSampleType_None) {
+		Dispose();
+		return kAudioFormatUnsupportedDataFormatError;
+	}
+	
+	mBytesPerFrame = inFormat.mBytesPerFrame;
+	mFrameCount = inFrameCount;
+	mReadProc = inReadProc;
+	mRefCon = inRefCon;
+	mMaxRate = inMaxRate;
+	mHopFrames = (UInt32)floor(kHopSeconds * inFormat.mSampleRate + .5);
+	if (mHopFrames < 16) mHopFrames = 16;
+	mGrainFrames = 2 * mHopFrames;
+	mSearchFrames = mHopFrames / 2;
+	
+	// the sound read for a grain runs from the nudged grain before it to the furthest this one can be nudged
+	mMaxSpanFrames = (UInt32)ceil((mMaxRate + 2.) * mHopFrames) + mGrainFrames + 4 * mSearchFrames;
+	
+	size_t numFloats = mGrainFrames									// window
+		+ (size_t)mMaxSpanFrames * mSamplesPerFrame					// span
+		+ mMaxSpanFrames											// mono
+		+ 2 * mSearchFrames + 1										// correlation
+		+ (size_t)mGrainFrames * mSamplesPerFrame					// accumulator
+		+ (size_t)mHopFrames * mSamplesPerFrame;					// output
+	mMemory = calloc(numFloats * sizeof(float) + (size_t)mMaxSpanFrames * mBytesPerFrame, 1);
+	if (!mMemory) {
+		Dispose();
+		return -108/*memFullErr*/;
+	}
+	mWindow = (float*)mMemory;
+	mSpan = mWindow + mGrainFrames;
+	mMono = mSpan + (size_t)mMaxSpanFrames * mSamplesPerFrame;
+	mCorrelation = mMono + mMaxSpanFrames;
+	mAccumulator = mCorrelation + 2 * mSearchFrames + 1;
+	mOutput = mAccumulator + (size_t)mGrainFrames * mSamplesPerFrame;
+	mRawSpan = (Byte*)(mOutput + (size_t)mHopFrames * mSamplesPerFrame);
+	
+	// a periodic Hann window, so that grains half a window apart add up to exactly one
+	for (UInt32 i = 0; i < mGrainFrames; ++i)
+		mWindow[i] = (float)(.5 - .5 * cos(2. * M_PI * i / mGrainFrames));
+	
+	Reset(0);
+	return noErr;
+}
+
+void CASoundTimeStretch::Dispose()
+{
+	free(mMemory);
+	mMemory = NULL;
+	mWindow = mSpan = mMono = mCorrelation = mAccumulator = mOutput = NULL;
+	mRawSpan = NULL;
+	mRawSpanFrames = 0;
+	mSampleType = kSampleType_None;
+	mReadProc = NULL;
+	mFrameCount = 0;
+	mGrainFrames = mHopFrames = mSearchFrames = mMaxSpanFrames = 0;
+}
+
+void CASoundTimeStretch::Reset(SInt64 inFrame)
+{
+	mAnalysisFrame = (double)inFrame;
+	mHasLastGrain = false;
+	mRawSpanFrames = 0;
+	mIsFinished = false;
+	mIsDrained = false;
+	mOutputOffset = mOutputFrames = 0;
+	if (mAccumulator) memset(mAccumulator, 0, (size_t)mGrainFrames * mSamplesPerFrame * sizeof(float));
+}
+
+void CASoundTimeStretch::SetRate(float inRate)
+{
+	float magnitude = fabsf(inRate);
+	if (magnitude < 1.f / mMaxRate) magnitude = 1.f / mMaxRate;
+	if (magnitude > mMaxRate) magnitude = mMaxRate;
+	mRate.store(inRate < 0.f ? -magnitude : magnitude, std::memory_order_relaxed);
+}
+
+OSStatus CASoundTimeStretch::ReadSpan(SInt64 inFrame, UInt32 inNumFrames)
+{
+	// whatever this span shares with the last one is already here, so only the rest is read
+	UInt32 keptFrames = 0;
+	SInt64 rawSpanEnd = mRawSpanStart + mRawSpanFrames;
+	if (inFrame >= mRawSpanStart && inFrame < rawSpanEnd) {
+		keptFrames = (UInt32)((inFrame + inNumFrames < rawSpanEnd ? inFrame + inNumFrames : rawSpanEnd) - inFrame);
+		memmove(mRawSpan, mRawSpan + (size_t)(inFrame - mRawSpanStart) * mBytesPerFrame, (size_t)keptFrames * mBytesPerFrame);
+	}
+	mRawSpanStart = inFrame;
+	mRawSpanFrames = 0;
+	
+	// frames either side of the sound are silence
+	memset(mRawSpan + (size_t)keptFrames * mBytesPerFrame, 0, (size_t)(inNumFrames - keptFrames) * mBytesPerFrame);
+	SInt64 frame = inFrame + keptFrames < 0 ? 0 : inFrame + keptFrames;
+	SInt64 endFrame = inFrame + inNumFrames < mFrameCount ? inFrame + inNumFrames : mFrameCount;
+	while (frame < endFrame) {
+		UInt32 numFrames = (UInt32)(endFrame - frame);
+		OSStatus err = mReadProc(mRefCon, frame, &numFrames, mRawSpan + (size_t)(frame - inFrame) * mBytesPerFrame);
+		if (err) return err;
+		if (!numFrames) break;
+		frame += numFrames;
+	}
+	mRawSpanFrames = inNumFrames;
+	
+	size_t numSamples = (size_t)inNumFrames * mSamplesPerFrame;
+	switch (mSampleType) {
+		case kSampleType_Float32:
+			memcpy(mSpan, mRawSpan, numSamples * sizeof(float));
+			break;
+		case kSampleType_Int16:
+			for (size_t i = 0; i < numSamples; ++i) mSpan[i] = ((const SInt16*)mRawSpan)[i] * (1.f / 32768.f);
+			break;
+		case kSampleType_Int32:
+			for (size_t i = 0; i < numSamples; ++i) mSpan[i] = (float)(((const SInt32*)mRawSpan)[i] * (1. / 2147483648.));
+			break;
+		default:
+			break;
+	}
+	
+	// the channels mixed down for the search
+	for (UInt32 frameIndex = 0; frameIndex < inNumFrames; ++frameIndex) {
+		const float* samples = mSpan + (size_t)frameIndex * mSamplesPerFrame;
+		float sum = 0.f;
+		for (UInt32 i = 0; i < mSamplesPerFrame; ++i) sum += samples[i];
+		mMono[frameIndex] = sum;
+	}
+	return noErr;
+}
+
+SInt64 CASoundTimeStretch::FindBestStart(SInt64 inNominalStart, SInt64 inTemplateStart, SInt64 inSpanStart)
+{
+	// where, within mSearchFrames of inNominalStart, the sound looks most like the half grain at inTemplateStart
+	const UInt32 numCandidates = 2 * mSearchFrames + 1;
+	const UInt32 length = mHopFrames;
+	const float* candidates = mMono + (inNominalStart - mSearchFrames - inSpanStart);
+	const float* pattern = mMono + (inTemplateStart - inSpanStart);
+	
+	float patternEnergy = 0.f;
+	vDSP_svesq(pattern, 1, &patternEnergy, length);
+	if (patternEnergy <= 1e-9f) return inNominalStart;
+	
+	vDSP_conv(candidates, 1, pattern, 1, mCorrelation, 1, numCandidates, length);
+	
+	float energy = 0.f;
+	vDSP_svesq(candidates, 1, &energy, length);
+	UInt32 best = mSearchFrames;
+	float bestScore = -INFINITY;
+	for (UInt32 i = 0; i < numCandidates; ++i) {
+		float score = mCorrelation[i] / sqrtf(energy > 1e-9f ? energy : 1e-9f);
+		if (score > bestScore) {
+			bestScore = score;
+			best = i;
+		}
+		if (i + 1 < numCandidates) {
+			energy += candidates[i + length] * candidates[i + length] - candidates[i] * candidates[i];
+			if (energy < 0.f) energy = 0.f;
+		}
+	}
+	return inNominalStart - mSearchFrames + best;
+}
+
+bool CASoundTimeStretch::MakeGrain(OSStatus& outErr)
+{
+	outErr = noErr;
+	const size_t hopSamples = (size_t)mHopFrames * mSamplesPerFrame;
+	
+	float rate = mRate.load(std::memory_order_relaxed);
+	SInt64 nominalStart = (SInt64)floor(mAnalysisFrame);
+	if (!mIsFinished && ((rate > 0.f && nominalStart >= mFrameCount) || (rate < 0.f && nominalStart < 0)))
+		mIsFinished = true;
+	
+	if (mIsFinished) {
+		// play out the second half of the last grain, then nothing
+		if (mIsDrained) return false;
+		memcpy(mOutput, mAccumulator, hopSamples * sizeof(float));
+		memset(mAccumulator, 0, hopSamples * sizeof(float));
+		mOutputOffset = 0;
+		mOutputFrames = mHopFrames;
+		mIsDrained = true;
+		return true;
+	}
+	
+	SInt64 templateStart = mLastGrainStart + mHopFrames;
+	// the first grain has nothing to match, but it reads as far back as the next one can be nudged, so that
+	// the next read never starts before this one at slow rates
+	SInt64 spanStart = mHasLastGrain ? nominalStart : nominalStart - mSearchFrames, spanEnd = nominalStart + mGrainFrames;
+	bool searches = mHasLastGrain;
+	if (searches) {
+		SInt64 searchStart = nominalStart - mSearchFrames;
+		SInt64 searchEnd = nominalStart + mSearchFrames + mGrainFrames;
+		spanStart = searchStart < templateStart ? searchStart : templateStart;
+		spanEnd = searchEnd > templateStart + mHopFrames ? searchEnd : templateStart + mHopFrames;
+		if (spanEnd - spanStart > mMaxSpanFrames) {
+			// too far from the last grain to be worth matching
+			searches = false;
+			spanStart = nominalStart;
+			spanEnd = nominalStart + mGrainFrames;
+		}
+	}
+	outErr = ReadSpan(spanStart, (UInt32)(spanEnd - spanStart));
+	if (outErr) return false;
+	
+	SInt64 grainStart = searches ? FindBestStart(nominalStart, templateStart, spanStart) : nominalStart;
+	
+	// overlap-add the grain, then the first half of the accumulator is finished
+	const float* grain = mSpan + (size_t)(grainStart - spanStart) * mSamplesPerFrame;
+	for (UInt32 frame = 0; frame < mGrainFrames; ++frame) {
+		float weight = mWindow[frame];
+		size_t first = (size_t)frame * mSamplesPerFrame;
+		for (UInt32 i = 0; i < mSamplesPerFrame; ++i)
+			mAccumulator[first + i] += weight * grain[first + i];
+	}
+	memcpy(mOutput, mAccumulator, hopSamples * sizeof(float));
+	memmove(mAccumulator, mAccumulator + hopSamples, hopSamples * sizeof(float));
+	memset(mAccumulator + hopSamples, 0, hopSamples * sizeof(float));
+	mOutputOffset = 0;
+	mOutputFrames = mHopFrames;
+	
+	mLastGrainStart = grainStart;
+	mHasLastGrain = true;
+	mAnalysisFrame += (double)rate * mHopFrames;
+	return true;
+}
+
+OSStatus CASoundTimeStretch::Render(SInt64& ioFrame, UInt32& ioNumFrames, void* outBuffer)
+{
+	if (mSampleType == kSampleType_None) return kAudioFormatUnsupportedDataFormatError;
+	
+	UInt32 framesFilled = 0;
+	while (framesFilled < ioNumFrames) {
+		if (mOutputOffset == mOutputFrames) {
+			OSStatus err = noErr;
+			if (!MakeGrain(err)) {
+				if (err) return err;
+				break;
+			}
+		}
+		
+		UInt32 numFrames = mOutputFrames - mOutputOffset;
+		if (numFrames > ioNumFrames - framesFilled) numFrames = ioNumFrames - framesFilled;
+		const float* source = mOutput + (size_t)mOutputOffset * mSamplesPerFrame;
+		size_t numSamples = (size_t)numFrames * mSamplesPerFrame;
+		size_t firstSample = (size_t)framesFilled * mSamplesPerFrame;
+		switch (mSampleType) {
+			case kSampleType_Float32:
+				memcpy((Float32*)outBuffer + firstSample, source, numSamples * sizeof(float));
+				break;
+			case kSampleType_Int16:
+				for (size_t i = 0; i < numSamples; ++i)
+					((SInt16*)outBuffer)[firstSample + i] = ClampSample<SInt16>(source[i] * 32768., -32768., 32767.);
+				break;
+			case kSampleType_Int32:
+				for (size_t i = 0; i < numSamples; ++i)
+					((SInt32*)outBuffer)[firstSample + i] = ClampSample<SInt32>(source[i] * 2147483648., -2147483648., 2147483647.);
+				break;
+			default:
+				break;
+		}
+		mOutputOffset += numFrames;
+		framesFilled += numFrames;
+	}
+	
+	ioNumFrames = framesFilled;
+	SInt64 frame = (SInt64)floor(mAnalysisFrame);
+	ioFrame = frame < 0 ? 0 : (frame > mFrameCount ? mFrameCount : frame);
+	return noErr;
+}
@@ -0,0 +1,146 @@
+/*
+ 
+ File: CASoundTimeStretch.h
+ Abstract: n/a
+ Version: 1.3
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2010 Apple Inc. All Rights Reserved.
+ 
+ 
+ */
+
+#ifndef __CASoundTimeStretch_h__
+#define __CASoundTimeStretch_h__
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <atomic>
+
+/*
+ CASoundTimeStretch plays a linear PCM sound faster or slower than it was recorded, forwards or
+ backwards, without changing its pitch. It is what CASound's skip modes play through.
+ 
+ It uses WSOLA (waveform similarity overlap-add): Hann windowed grains of about 23 ms are overlap-added
+ half a grain apart in the output, while the place each is taken from in the sound moves on by the rate
+ times that. Each grain is nudged by up to a quarter of a grain to where it best matches the natural
+ continuation of the grain before, found by normalized cross-correlation of the channels mixed to mono,
+ so that the grains join without phasing. Going backwards, the grains still play forwards.
+ 
+ The sound read for a grain overlaps the sound read for the one before, and the frames they share are
+ kept rather than read again, so that going forwards each read starts at or after where the last one
+ ended, and the read proc sees the sound go by in order as it would in normal playback.
+ 
+ All memory is allocated by Initialize, so Render never allocates. Output lags the sound by half a
+ grain. Native endian float, 16 bit and 32 bit integer samples are supported.
+ 
+ SetRate may be called from any thread, everything else from the thread that renders.
+*/
+
+class CASoundTimeStretch
+{
+public:
+	// reads up to *ioNumFrames frames starting at inFrame, returning fewer only at the end of the sound
+	typedef OSStatus (*ReadProc)(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer);
+	
+	CASoundTimeStretch();
+	~CASoundTimeStretch();
+	
+	// inMaxRate is the fastest rate, either way, that SetRate will be asked for
+	OSStatus Initialize(const AudioStreamBasicDescription& inFormat, SInt64 inFrameCount, ReadProc inReadProc, void* inRefCon, float inMaxRate);
+	void Dispose();
+	
+	// starts over from inFrame, with nothing carried over from before
+	void Reset(SInt64 inFrame);
+	
+	// negative rates play backwards. the magnitude is clamped to between 1 / inMaxRate and inMaxRate.
+	void SetRate(float inRate);
+	float GetRate() const { return mRate.load(std::memory_order_relaxed); }
+	
+	// renders up to ioNumFrames frames, returning fewer only once it has played past either end of the
+	// sound. ioFrame is set to where in the sound it has got to.
+	OSStatus Render(SInt64& ioFrame, UInt32& ioNumFrames, void* outBuffer);
+	
+	UInt32 GetLatencyFrames() const { return mHopFrames; }
+	
+private:
+	enum SampleType { kSampleType_None, kSampleType_Float32, kSampleType_Int16, kSampleType_Int32 };
+	
+	bool MakeGrain(OSStatus& outErr);
+	OSStatus ReadSpan(SInt64 inFrame, UInt32 inNumFrames);
+	SInt64 FindBestStart(SInt64 inNominalStart, SInt64 inTemplateStart, SInt64 inSpanStart);
+	
+	UInt32					mBytesPerFrame;
+	UInt32					mSamplesPerFrame;
+	SampleType				mSampleType;
+	SInt64					mFrameCount;
+	ReadProc				mReadProc;
+	void*					mRefCon;
+	float					mMaxRate;
+	std::atomic<float>		mRate;
+	
+	UInt32					mGrainFrames;		// a whole grain, twice mHopFrames
+	UInt32					mHopFrames;			// how far apart the grains are in the output
+	UInt32					mSearchFrames;		// how far either way a grain may be nudged
+	UInt32					mMaxSpanFrames;		// the most the sound is read at once
+	
+	float*					mWindow;
+	Byte*					mRawSpan;			// the sound as read
+	SInt64					mRawSpanStart;		// and where it is from, none of it after a Reset
+	UInt32					mRawSpanFrames;
+	float*					mSpan;				// and as float
+	float*					mMono;
+	float*					mCorrelation;
+	float*					mAccumulator;		// the overlap-add, a grain long
+	float*					mOutput;			// the finished half grain being played out
+	void*					mMemory;
+	
+	double					mAnalysisFrame;		// where the next grain is taken from before it is nudged
+	SInt64					mLastGrainStart;
+	bool					mHasLastGrain;
+	bool					mIsFinished;
+	bool					mIsDrained;
+	UInt32					mOutputOffset;
+	UInt32					mOutputFrames;
+	
+	CASoundTimeStretch(const CASoundTimeStretch&);
+	CASoundTimeStretch& operator=(const CASoundTimeStretch&);
+};
+
+#endif // __CASoundTimeStretch_h__
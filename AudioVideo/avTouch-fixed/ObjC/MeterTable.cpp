@@ -48,6 +48,7 @@ Copyright (C) 2014 Apple Inc. All Rights Reserved.
 */
 
 #include "MeterTable.h"
+#include <Accelerate/Accelerate.h>
 
 inline double DbToAmp(double inDb)
 {
@@ -57,7 +58,9 @@ inline double DbToAmp(double inDb)
 MeterTable::MeterTable(float inMinDecibels, size_t inTableSize, float inRoot)
 	: mMinDecibels(inMinDecibels),
 	mDecibelResolution(mMinDecibels / (inTableSize - 1)), 
-	mScaleFactor(1. / mDecibelResolution)
+	mScaleFactor(1. / mDecibelResolution),
+	mTableSize(inTableSize),
+	mTable(NULL)
 {
 	if (inMinDecibels >= 0.)
 	{
@@ -84,3 +87,32 @@ MeterTable::~MeterTable()
 {
 	free(mTable);
 }
+
+void MeterTable::ValuesAt(const float* inDecibels, float* outValues, size_t inCount) const
+{
+	// the index of a level in the table is its decibels times mScaleFactor. vtabi interpolates between
+	// entries and clamps anything past either end, which takes care of levels above 0 dB and below mMinDecibels
+	float scale = mScaleFactor, offset = 0.;
+	vDSP_vtabi(inDecibels, 1, &scale, &offset, mTable, mTableSize, outValues, 1, inCount);
+}
+
+void MeterTable::ValuesForAmplitudes(const float* inAmplitudes, float* outValues, size_t inCount) const
+{
+	float fullScale = 1.;
+	vDSP_vabs(inAmplitudes, 1, outValues, 1, inCount);
+	vDSP_vdbcon(outValues, 1, &fullScale, outValues, 1, inCount, 1 /* amplitude */);
+	ValuesAt(outValues, outValues, inCount);
+}
+
+void MeterTable::Decay(float* ioValues, size_t inCount, float inFalloff)
+{
+	float fall = -inFalloff, floor = 0.;
+	vDSP_vsadd(ioValues, 1, &fall, ioValues, 1, inCount);
+	vDSP_vthr(ioValues, 1, &floor, ioValues, 1, inCount);
+}
+
+void MeterTable::HoldPeaks(const float* inLevels, float* ioPeaks, size_t inCount, float inFalloff)
+{
+	Decay(ioPeaks, inCount, inFalloff);
+	vDSP_vmax(ioPeaks, 1, inLevels, 1, ioPeaks, 1, inCount);
+}
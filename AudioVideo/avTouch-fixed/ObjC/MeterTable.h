@@ -64,16 +64,31 @@ public:
 MeterTable(float inMinDecibels = -80., size_t inTableSize = 400, float inRoot = 2.0);	
 ~MeterTable();
 	
-	float ValueAt(float inDecibels)
+	float ValueAt(float inDecibels) const
 	{
 		if (inDecibels < mMinDecibels) return  0.;
 		if (inDecibels >= 0.) return 1.;
-		int index = (int)(inDecibels * mScaleFactor);
-		return mTable[index];
+		float index = inDecibels * mScaleFactor;
+		size_t i = (size_t)index;
+		if (i >= mTableSize - 1) return mTable[mTableSize - 1];
+		return mTable[i] + (index - i) * (mTable[i + 1] - mTable[i]);
 	}
+	
+// The batched versions map a whole array at once, e.g. every channel of a bus each time the meters are drawn.
+// ValuesForAmplitudes takes levels as they are measured and does the conversion to decibels on the way.
+// inDecibels and inAmplitudes may be the same array as outValues.
+	void ValuesAt(const float* inDecibels, float* outValues, size_t inCount) const;
+	void ValuesForAmplitudes(const float* inAmplitudes, float* outValues, size_t inCount) const; // linear, 1. is full scale
+	
+// Falloff for already mapped values: Decay lowers each value by inFalloff, stopping at zero.
+// HoldPeaks does the same to each peak but keeps it at least as high as the matching level.
+	static void Decay(float* ioValues, size_t inCount, float inFalloff);
+	static void HoldPeaks(const float* inLevels, float* ioPeaks, size_t inCount, float inFalloff);
+	
 private:
 	float	mMinDecibels;
 	float	mDecibelResolution;
 	float	mScaleFactor;
+	size_t	mTableSize;
 	float	*mTable;
 };
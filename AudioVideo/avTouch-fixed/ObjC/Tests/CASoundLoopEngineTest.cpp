@@ -0,0 +1,170 @@
+//	Loops a stereo tone through CASoundLoopEngine, the way the AudioQueue
+//	callback does, for several passes in blocks that don't line up with the
+//	loop, as float and as 16 bit samples, with and without the equal power
+//	crossfade. Checks every pass is the frames it should be and as long as it
+//	should be, and that nothing jumps at the wrap: a loop whose ends are in
+//	phase plays on as smoothly as the tone itself with no crossfade, and one
+//	whose ends aren't only does so with one.
+#include "CASoundLoopEngine.h"
+#include "TestSupport.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static const double kSampleRate = 44100.;
+static const double kToneHz = 441.;			// 100 frames a cycle
+static const double kAmplitude = .5;
+static const SInt64 kFrameCount = 88200;
+static const UInt32 kBlockFrames = 441;
+static const int kNumPasses = 5;
+
+template <typename T> struct Samples;
+template <> struct Samples<Float32> {
+	static const char* Name() { return "float"; }
+	static double Scale() { return 1.; }
+	static Float32 From(double value) { return (Float32)value; }
+	static double Tolerance() { return 1e-6; }
+	static void SetFlags(AudioStreamBasicDescription& format) { format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked; }
+};
+template <> struct Samples<SInt16> {
+	static const char* Name() { return "16 bit"; }
+	static double Scale() { return 32768.; }
+	static SInt16 From(double value) { return (SInt16)lrint(value < -32768. ? -32768. : value > 32767. ? 32767. : value); }
+	static double Tolerance() { return 1.; }
+	static void SetFlags(AudioStreamBasicDescription& format) { format.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked; }
+};
+
+template <typename T>
+struct Tone {
+	std::vector<T> samples;	// stereo, the right channel a quarter cycle behind the left
+
+	Tone() : samples(2 * kFrameCount)
+	{
+		for (SInt64 frame = 0; frame < kFrameCount; ++frame) {
+			double phase = 2. * M_PI * kToneHz * frame / kSampleRate;
+			samples[2 * frame] = Samples<T>::From(kAmplitude * Samples<T>::Scale() * sin(phase));
+			samples[2 * frame + 1] = Samples<T>::From(kAmplitude * Samples<T>::Scale() * sin(phase - M_PI / 2.));
+		}
+	}
+
+	static OSStatus Read(void* inRefCon, SInt64 inFrame, UInt32* ioNumFrames, void* outBuffer)
+	{
+		const Tone* tone = (const Tone*)inRefCon;
+		if (inFrame >= kFrameCount) {
+			*ioNumFrames = 0;
+			return noErr;
+		}
+		if (*ioNumFrames > kFrameCount - inFrame) *ioNumFrames = (UInt32)(kFrameCount - inFrame);
+		memcpy(outBuffer, &tone->samples[2 * inFrame], *ioNumFrames * 2 * sizeof(T));
+		return noErr;
+	}
+};
+
+// what each pass should be, worked out from the loop points the way the header describes: the last
+// crossfadeFrames frames before the loop end faded out under the ones leading up to the loop start,
+// or under the loop's first frames when there aren't enough before it
+template <typename T>
+static std::vector<double> expectedPasses(const Tone<T>& tone, SInt64 loopStart, SInt64 loopEnd, UInt32 crossfadeFrames)
+{
+	SInt64 leadIn = loopStart >= crossfadeFrames ? loopStart - crossfadeFrames : loopStart;
+	SInt64 resume = leadIn + crossfadeFrames;
+	SInt64 crossfadeStart = loopEnd - crossfadeFrames;
+	std::vector<double> expected;
+	for (int pass = 0; pass < kNumPasses; ++pass) {
+		for (SInt64 frame = pass ? resume : 0; frame < loopEnd; ++frame) {
+			for (int channel = 0; channel < 2; ++channel) {
+				double sample = tone.samples[2 * frame + channel];
+				if (frame >= crossfadeStart) {
+					double angle = (frame - crossfadeStart + .5) / crossfadeFrames * (M_PI / 2.);
+					sample = sample * cos(angle) + tone.samples[2 * (leadIn + frame - crossfadeStart) + channel] * sin(angle);
+					sample = Samples<T>::From(sample);
+				}
+				expected.push_back(sample);
+			}
+		}
+	}
+	return expected;
+}
+
+template <typename T>
+static void testLoop(const Tone<T>& tone, SInt64 loopStart, SInt64 loopEnd, UInt32 crossfadeFrames, bool shouldBeSmooth)
+{
+	char name[128];
+	snprintf(name, sizeof(name), "%s, loop %lld to %lld, %u frame crossfade", Samples<T>::Name(), (long long)loopStart, (long long)loopEnd, crossfadeFrames);
+
+	AudioStreamBasicDescription format = {};
+	format.mSampleRate = kSampleRate;
+	format.mFormatID = kAudioFormatLinearPCM;
+	Samples<T>::SetFlags(format);
+	format.mBitsPerChannel = 8 * sizeof(T);
+	format.mChannelsPerFrame = 2;
+	format.mFramesPerPacket = 1;
+	format.mBytesPerFrame = format.mBytesPerPacket = 2 * sizeof(T);
+
+	CASoundLoopEngine engine;
+	TEST_CHECK(engine.Initialize(format, kFrameCount, Tone<T>::Read, (void*)&tone, 22050, 16384) == noErr, "%s: Initialize failed", name);
+	TEST_CHECK(engine.SetLoop(loopStart, loopEnd, crossfadeFrames, Tone<T>::Read, (void*)&tone) == noErr, "%s: SetLoop failed", name);
+
+	// the queue's callback fills each buffer, carrying on from where the loop resumes when it wraps part way
+	std::vector<T> output, block(2 * kBlockFrames);
+	SInt64 frame = 0;
+	int numWraps = 0;
+	while (numWraps < kNumPasses) {
+		UInt32 filled = 0;
+		while (filled < kBlockFrames && numWraps < kNumPasses) {
+			UInt32 numFrames = kBlockFrames - filled;
+			bool wrapped = false;
+			OSStatus err = engine.Render(frame, true, numFrames, &block[2 * filled], wrapped);
+			TEST_CHECK(err == noErr, "%s: Render failed", name);
+			if (err || (!numFrames && !wrapped)) return;
+			filled += numFrames;
+			if (wrapped) ++numWraps;
+		}
+		output.insert(output.end(), block.begin(), block.begin() + 2 * filled);
+	}
+
+	std::vector<double> expected = expectedPasses(tone, loopStart, loopEnd, crossfadeFrames);
+	TEST_CHECK(output.size() == expected.size(), "%s: %zu frames in %d passes, expected %zu", name, output.size() / 2, kNumPasses, expected.size() / 2);
+	size_t numWrong = 0;
+	for (size_t i = 0; i < output.size() && i < expected.size(); ++i) {
+		if (fabs(output[i] - expected[i]) > Samples<T>::Tolerance()) ++numWrong;
+	}
+	TEST_CHECK(numWrong == 0, "%s: %zu samples aren't what the loop should play", name, numWrong);
+
+	// the biggest step between frames anywhere, against the biggest the tone takes; an equal power crossfade of two
+	// copies of the tone can be up to root two louder for a moment
+	double toneStep = 2. * M_PI * kToneHz / kSampleRate * kAmplitude * Samples<T>::Scale();
+	double maxStep = 0.;
+	for (size_t i = 2; i < output.size(); ++i) {
+		double step = fabs((double)output[i] - (double)output[i - 2]);
+		if (step > maxStep) maxStep = step;
+	}
+	double allowed = (crossfadeFrames ? M_SQRT2 * 1.05 : 1.01) * toneStep + 2. * Samples<T>::Tolerance();
+	if (shouldBeSmooth)
+		TEST_CHECK(maxStep <= allowed, "%s: a step of %.4g at the wrap, the tone's biggest is %.4g", name, maxStep, toneStep);
+	else
+		TEST_CHECK(maxStep > 3. * toneStep, "%s: the wrap was smooth, which it can't be without a crossfade", name);
+}
+
+template <typename T>
+static void testSampleType()
+{
+	Tone<T> tone;
+	// ends in phase: a whole number of cycles between them
+	testLoop(tone, 30000, 80000, 0, true);
+	testLoop(tone, 30000, 80000, 2205, true);
+	// ends out of phase, which clicks at the wrap unless crossfaded
+	testLoop(tone, 30011, 80037, 0, false);
+	testLoop(tone, 30011, 80037, 2205, true);
+	// too close to the start for a lead in, so the crossfade mixes in the loop's first frames and passes get shorter
+	testLoop(tone, 1000, 80037, 2205, true);
+}
+
+int main()
+{
+	testSampleType<Float32>();
+	testSampleType<SInt16>();
+
+	if (gTestFailures == 0) printf("CASoundLoopEngineTest: all passed\n");
+	return gTestFailures == 0 ? 0 : 1;
+}
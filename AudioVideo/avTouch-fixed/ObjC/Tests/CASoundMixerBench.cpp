@@ -0,0 +1,103 @@
+//	Measures what a CASoundMixer voice costs the render thread: the time to mix
+//	one 512 frame buffer, per voice, for mono and stereo sounds at a few rates,
+//	and what share of one core that is per voice in real time at 44.1 kHz.
+//	Also checks that a voice is panned, ends and loops as it should. Pass a
+//	buffer count to run longer than ctest does.
+#include "CASoundMixerVoice.h"
+#include "TestSupport.h"
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+static const double kMixSampleRate = 44100.;
+static const UInt32 kMixFrames = 512;
+
+static void setUpVoice(CASoundMixerVoice& voice, const std::vector<float>& samples, UInt32 numChannels, float volume, float pan, float rate, SInt64 loops)
+{
+	voice.mGeneration.store(1);
+	voice.mVolume.store(CASoundMixerVoice::PackParameter(1, volume));
+	voice.mPan.store(CASoundMixerVoice::PackParameter(1, pan));
+	voice.mRate.store(CASoundMixerVoice::PackParameter(1, rate));
+	voice.mStop.store(CASoundMixerVoice::PackParameter(1, 0.f));
+	voice.mSamples = samples.data();
+	voice.mNumChannels = numChannels;
+	voice.mNumFrames = samples.size() / numChannels;
+	voice.mSourceSampleRate = kMixSampleRate;
+	voice.mLoopsLeft = loops;
+	voice.mPosition = 0.;
+	voice.mHasGain = false;
+	voice.mState.store(CASoundMixerVoice::kState_Playing);
+}
+
+static void testVoice()
+{
+	// a constant mono sound panned to the center comes out at cos(pi/4) on both sides
+	std::vector<float> ones(1000, 1.f);
+	std::vector<float> mix(2 * kMixFrames, 0.f);
+	CASoundMixerVoice voice;
+	setUpVoice(voice, ones, 1, 1.f, 0.f, 1.f, 0);
+	TEST_CHECK(!voice.Render(kMixSampleRate, mix.data(), kMixFrames), "the voice finished early");
+	TEST_CHECK(fabsf(mix[0] - (float)M_SQRT1_2) < 1e-6f && fabsf(mix[1] - (float)M_SQRT1_2) < 1e-6f, "center pan gave %f, %f", mix[0], mix[1]);
+	
+	// 1000 frames end part way through the second buffer, and the voice is done
+	mix.assign(mix.size(), 0.f);
+	TEST_CHECK(voice.Render(kMixSampleRate, mix.data(), kMixFrames), "the voice didn't finish");
+	TEST_CHECK(voice.mState.load() == CASoundMixerVoice::kState_Done, "a finished voice isn't done");
+	TEST_CHECK(mix[2 * (1000 - kMixFrames - 1)] != 0.f && mix[2 * (1000 - kMixFrames)] == 0.f, "the voice didn't stop at the end of the sound");
+	
+	// looped once it plays twice as long
+	setUpVoice(voice, ones, 1, 1.f, -1.f, 1.f, 1);
+	UInt32 buffers = 0;
+	do {
+		mix.assign(mix.size(), 0.f);
+		++buffers;
+	} while (!voice.Render(kMixSampleRate, mix.data(), kMixFrames) && buffers < 100);
+	TEST_CHECK(buffers == 4, "a sound of 1000 frames looped once took %u buffers", (unsigned)buffers);
+	
+	// hard left pan
+	setUpVoice(voice, ones, 1, 1.f, -1.f, 1.f, 0);
+	mix.assign(mix.size(), 0.f);
+	voice.Render(kMixSampleRate, mix.data(), kMixFrames);
+	TEST_CHECK(fabsf(mix[0] - 1.f) < 1e-6f && fabsf(mix[1]) < 1e-6f, "left pan gave %f, %f", mix[0], mix[1]);
+}
+
+static void bench(UInt32 numBuffers)
+{
+	const UInt32 kNumVoices = 32;
+	const float kRates[] = { 1.f, .5f, 1.5f };
+	
+	// a couple of seconds of noise, looped forever so that no voice runs out while being timed
+	std::vector<float> sounds[2];
+	for (UInt32 numChannels = 1; numChannels <= 2; ++numChannels) {
+		sounds[numChannels - 1].resize(numChannels * 88200);
+		for (float& sample : sounds[numChannels - 1]) sample = (float)rand() / RAND_MAX * 2.f - 1.f;
+	}
+	
+	std::vector<CASoundMixerVoice> voices(kNumVoices);
+	std::vector<float> mix(2 * kMixFrames);
+	double bufferSeconds = kMixFrames / kMixSampleRate;
+	
+	printf("%-8s %-6s %12s %14s\n", "channels", "rate", "ns/voice/buf", "% core/voice");
+	for (UInt32 numChannels = 1; numChannels <= 2; ++numChannels) {
+		for (float rate : kRates) {
+			for (UInt32 i = 0; i < kNumVoices; ++i)
+				setUpVoice(voices[i], sounds[numChannels - 1], numChannels, .5f, (float)i / kNumVoices * 2.f - 1.f, rate, -1);
+			
+			double seconds = TestTime(numBuffers, [&]() {
+				mix.assign(mix.size(), 0.f);
+				for (CASoundMixerVoice& voice : voices)
+					voice.Render(kMixSampleRate, mix.data(), kMixFrames);
+			});
+			double perVoice = seconds / ((double)numBuffers * kNumVoices);
+			printf("%-8u %-6.2f %12.0f %13.3f%%\n", (unsigned)numChannels, rate, perVoice * 1e9, perVoice / bufferSeconds * 100.);
+		}
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	testVoice();
+	bench(argc > 1 ? (UInt32)atoi(argv[1]) : 200);
+	if (gTestFailures == 0) printf("CASoundMixerBench: all passed\n");
+	return gTestFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+//	Plays a constant and a variable bit rate sound through CASoundPacketCache
+//	from storage that takes a while to answer every read, the way the AudioQueue
+//	callback asks for packets, and checks that playback is gapless: every read
+//	gets exactly the packets asked for, in order and around the loop. While the
+//	storage keeps up, and through a stall shorter than the read ahead, there
+//	must be no underruns; when it can't keep up there must be some, and the
+//	packets read directly in their place must still be the right ones. Then
+//	plays the constant bit rate sound mapped from a file, where the packets
+//	must come by pointer from the mapping rather than through the ring.
+#include "CASoundPacketCache.h"
+#include "TestSupport.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// the sound both AudioFileIDs read, and how slow reading it is
+struct TestSound {
+	std::vector<Byte>							data;
+	std::vector<AudioStreamPacketDescription>	packets;	// empty for constant bit rate
+	AudioStreamBasicDescription					format;
+	UInt32										maxPacketSize;
+	SInt64										packetCount;
+	std::atomic<int>							latencyMicroseconds;
+};
+
+struct OpaqueAudioFileID {
+	TestSound*	sound;
+};
+
+static std::atomic<int> sOpenFiles(0);
+
+static AudioFileID openSound(TestSound& sound)
+{
+	++sOpenFiles;
+	return new OpaqueAudioFileID { &sound };
+}
+
+OSStatus AudioFileClose(AudioFileID inAudioFile)
+{
+	--sOpenFiles;
+	delete inAudioFile;
+	return noErr;
+}
+
+OSStatus AudioFileGetProperty(AudioFileID inAudioFile, AudioFilePropertyID inPropertyID, UInt32* ioDataSize, void* outPropertyData)
+{
+	const TestSound& sound = *inAudioFile->sound;
+	switch (inPropertyID) {
+		case kAudioFilePropertyAudioDataPacketCount:
+			*ioDataSize = sizeof(UInt64);
+			*(UInt64*)outPropertyData = sound.packetCount;
+			return noErr;
+		case kAudioFilePropertyPacketSizeUpperBound:
+			*ioDataSize = sizeof(UInt32);
+			*(UInt32*)outPropertyData = sound.maxPacketSize;
+			return noErr;
+		case kAudioFilePropertyBitRate: {
+			double seconds = (double)sound.packetCount * sound.format.mFramesPerPacket / sound.format.mSampleRate;
+			*ioDataSize = sizeof(UInt32);
+			*(UInt32*)outPropertyData = (UInt32)(8. * sound.data.size() / seconds);
+			return noErr;
+		}
+	}
+	return 'pty?';
+}
+
+// sleeps for the storage's latency, then reads as much as fits like the real one
+OSStatus AudioFileReadPackets(AudioFileID inAudioFile, Boolean, UInt32* outNumBytes, AudioStreamPacketDescription* outPacketDescriptions,
+							  SInt64 inStartingPacket, UInt32* ioNumPackets, void* outBuffer)
+{
+	const TestSound& sound = *inAudioFile->sound;
+	std::this_thread::sleep_for(std::chrono::microseconds(sound.latencyMicroseconds.load()));
+
+	UInt32 numPackets = 0, numBytes = 0;
+	SInt64 packet = inStartingPacket;
+	for (; numPackets < *ioNumPackets && packet < sound.packetCount; ++numPackets, ++packet) {
+		UInt32 packetBytes = sound.packets.empty() ? sound.format.mBytesPerPacket : sound.packets[packet].mDataByteSize;
+		if (numBytes + packetBytes > *outNumBytes) break;
+		if (outPacketDescriptions) {
+			outPacketDescriptions[numPackets].mStartOffset = numBytes;
+			outPacketDescriptions[numPackets].mVariableFramesInPacket = 0;
+			outPacketDescriptions[numPackets].mDataByteSize = packetBytes;
+		}
+		numBytes += packetBytes;
+	}
+	SInt64 offset = sound.packets.empty() ? inStartingPacket * sound.format.mBytesPerPacket
+										  : (inStartingPacket < sound.packetCount ? sound.packets[inStartingPacket].mStartOffset : 0);
+	if (numBytes) memcpy(outBuffer, &sound.data[offset], numBytes);
+	*outNumBytes = numBytes;
+	*ioNumPackets = numPackets;
+	return noErr;
+}
+
+// four seconds of 44.1 kHz 16 bit stereo
+static void makeConstantBitRate(TestSound& sound)
+{
+	sound.format = AudioStreamBasicDescription();
+	sound.format.mSampleRate = 44100.;
+	sound.format.mFormatID = kAudioFormatLinearPCM;
+	sound.format.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+	sound.format.mBytesPerPacket = sound.format.mBytesPerFrame = 4;
+	sound.format.mFramesPerPacket = 1;
+	sound.format.mChannelsPerFrame = 2;
+	sound.format.mBitsPerChannel = 16;
+	sound.maxPacketSize = 4;
+	sound.packetCount = 4 * 44100;
+	sound.packets.clear();
+	sound.data.resize(sound.packetCount * 4);
+	for (size_t i = 0; i < sound.data.size(); ++i)
+		sound.data[i] = (Byte)((i * 2654435761u) >> 13);
+}
+
+// a minute of 1024 frame packets between 50 and 449 bytes long, like AAC
+static void makeVariableBitRate(TestSound& sound)
+{
+	sound.format = AudioStreamBasicDescription();
+	sound.format.mSampleRate = 44100.;
+	sound.format.mFormatID = 'aac ';
+	sound.format.mFramesPerPacket = 1024;
+	sound.format.mChannelsPerFrame = 2;
+	sound.maxPacketSize = 449;
+	sound.packetCount = 60 * 44100 / 1024;
+	sound.packets.resize(sound.packetCount);
+	SInt64 offset = 0;
+	for (SInt64 i = 0; i < sound.packetCount; ++i) {
+		sound.packets[i].mStartOffset = offset;
+		sound.packets[i].mVariableFramesInPacket = 0;
+		sound.packets[i].mDataByteSize = 50 + (UInt32)((i * 7919) % 400);
+		offset += sound.packets[i].mDataByteSize;
+	}
+	sound.data.resize(offset);
+	for (size_t i = 0; i < sound.data.size(); ++i)
+		sound.data[i] = (Byte)((i * 2654435761u) >> 13);
+}
+
+// what the AudioQueue callback does: reads packetsPerRead packets every periodMicroseconds from packet on, going
+// back to loopStart at loopEnd, and checks each read is exactly the packets asked for. Returns the packet it got to.
+static SInt64 play(CASoundPacketCache& cache, AudioFileID callbackFile, TestSound& sound, SInt64 packet, SInt64 loopStart, SInt64 loopEnd,
+				   UInt32 numReads, UInt32 packetsPerRead, int periodMicroseconds, const char* name)
+{
+	std::vector<Byte> buffer(packetsPerRead * sound.maxPacketSize);
+	std::vector<AudioStreamPacketDescription> descriptions(packetsPerRead);
+	int numShort = 0, numWrong = 0;
+	for (UInt32 read = 0; read < numReads; ++read) {
+		UInt32 numPackets = packetsPerRead;
+		if (numPackets > loopEnd - packet) numPackets = (UInt32)(loopEnd - packet);
+		UInt32 asked = numPackets;
+		UInt32 numBytes = (UInt32)buffer.size();
+		bool isVBR = !sound.packets.empty();
+		OSStatus err = cache.ReadPackets(callbackFile, &numBytes, isVBR ? descriptions.data() : NULL, packet, &numPackets, buffer.data());
+		TEST_CHECK(err == noErr, "%s: ReadPackets failed at packet %lld", name, (long long)packet);
+		if (numPackets != asked) ++numShort;
+
+		SInt64 offset = isVBR ? sound.packets[packet].mStartOffset : packet * sound.format.mBytesPerPacket;
+		SInt64 endOffset = isVBR ? sound.packets[packet + numPackets - 1].mStartOffset + sound.packets[packet + numPackets - 1].mDataByteSize
+								 : (packet + numPackets) * sound.format.mBytesPerPacket;
+		bool isRight = numPackets && numBytes == endOffset - offset && memcmp(buffer.data(), &sound.data[offset], numBytes) == 0;
+		for (UInt32 i = 0; isVBR && isRight && i < numPackets; ++i)
+			isRight = descriptions[i].mDataByteSize == sound.packets[packet + i].mDataByteSize
+				&& descriptions[i].mStartOffset == sound.packets[packet + i].mStartOffset - offset;
+		if (!isRight) ++numWrong;
+
+		packet += numPackets;
+		if (packet >= loopEnd) packet = loopStart;
+		std::this_thread::sleep_for(std::chrono::microseconds(periodMicroseconds));
+	}
+	TEST_CHECK(numShort == 0, "%s: %d of %u reads came back short", name, numShort, numReads);
+	TEST_CHECK(numWrong == 0, "%s: %d of %u reads weren't the packets asked for", name, numWrong, numReads);
+	return packet;
+}
+
+static void testSound(TestSound& sound, UInt32 packetsPerRead, const char* name)
+{
+	// a loop inside the sound, which playback gets round more than once
+	SInt64 loopStart = sound.packetCount / 5, loopEnd = sound.packetCount - sound.packetCount / 7;
+	UInt32 numReads = (UInt32)(2 * sound.packetCount / packetsPerRead);
+
+	// storage that answers in a millisecond keeps well ahead of a callback every 4
+	{
+		sound.latencyMicroseconds.store(1000);
+		CASoundPacketCache cache;
+		AudioFileID callbackFile = openSound(sound);
+		TEST_CHECK(cache.Initialize(openSound(sound), sound.format, .5) == noErr, "%s: Initialize failed", name);
+		cache.SetLoop(loopStart, loopEnd, true);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		SInt64 packet = play(cache, callbackFile, sound, 0, loopStart, loopEnd, numReads, packetsPerRead, 4000, name);
+		TEST_CHECK(packet != 0 && packet < loopEnd, "%s: playback didn't get round the loop", name);
+		TEST_CHECK(cache.GetUnderrunCount() == 0, "%s: %llu underruns while the storage kept up", name, (unsigned long long)cache.GetUnderrunCount());
+
+		// a stall of 40 ms, well short of the read ahead, is taken up by what's already in the ring
+		sound.latencyMicroseconds.store(40000);
+		packet = play(cache, callbackFile, sound, packet, loopStart, loopEnd, 10, packetsPerRead, 4000, name);
+		sound.latencyMicroseconds.store(1000);
+		packet = play(cache, callbackFile, sound, packet, loopStart, loopEnd, 30, packetsPerRead, 4000, name);
+		TEST_CHECK(cache.GetUnderrunCount() == 0, "%s: %llu underruns through a short stall", name, (unsigned long long)cache.GetUnderrunCount());
+
+		// after a seek the ring still holds what was ahead of the old position, so the first read finds nothing
+		// it can use and reads directly; from then on the read ahead is ahead of it again
+		cache.Prefetch(loopStart + 3);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		packet = play(cache, callbackFile, sound, loopStart + 3, loopStart, loopEnd, 1, packetsPerRead, 4000, name);
+		TEST_CHECK(cache.GetUnderrunCount() <= 1, "%s: %llu underruns reading after a seek", name, (unsigned long long)cache.GetUnderrunCount());
+		UInt64 underruns = cache.GetUnderrunCount();
+		play(cache, callbackFile, sound, packet, loopStart, loopEnd, 30, packetsPerRead, 4000, name);
+		TEST_CHECK(cache.GetUnderrunCount() == underruns, "%s: %llu underruns after a seek", name, (unsigned long long)(cache.GetUnderrunCount() - underruns));
+		AudioFileClose(callbackFile);
+	}
+
+	// storage that takes 20 ms a read, started without a head start, can't keep up with a callback every 2 ms,
+	// so there are underruns, but what the callback reads in their place fills the gaps exactly
+	{
+		sound.latencyMicroseconds.store(20000);
+		CASoundPacketCache cache;
+		AudioFileID callbackFile = openSound(sound);
+		TEST_CHECK(cache.Initialize(openSound(sound), sound.format, .5) == noErr, "%s: Initialize failed", name);
+		cache.SetLoop(loopStart, loopEnd, true);
+		const UInt32 kSlowReads = 60;
+		play(cache, callbackFile, sound, loopEnd - 10 * packetsPerRead, loopStart, loopEnd, kSlowReads, packetsPerRead, 2000, name);
+		UInt64 underruns = cache.GetUnderrunCount();
+		TEST_CHECK(underruns > 0 && underruns <= kSlowReads, "%s: %llu underruns in %u reads from slow storage", name, (unsigned long long)underruns, kSlowReads);
+		printf("%s: %llu underruns in %u reads from storage taking 20 ms a read\n", name, (unsigned long long)underruns, kSlowReads);
+		AudioFileClose(callbackFile);
+	}
+	TEST_CHECK(sOpenFiles.load() == 0, "%s: %d AudioFileIDs left open", name, sOpenFiles.load());
+}
+
+// a mapped cache hands out pointers into the mapping, whose pages its thread has already touched
+static void testMapped(TestSound& sound)
+{
+	char path[] = "/tmp/CASoundPacketCacheTest.XXXXXX";
+	int fd = mkstemp(path);
+	TEST_CHECK(fd >= 0 && write(fd, sound.data.data(), sound.data.size()) == (ssize_t)sound.data.size(), "couldn't write %s", path);
+	const Byte* mapping = (const Byte*)mmap(NULL, sound.data.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	unlink(path);
+	TEST_CHECK(mapping != MAP_FAILED, "couldn't map %s", path);
+	if (fd < 0 || mapping == MAP_FAILED) return;
+	
+	const UInt32 kPacketsPerRead = 1024;
+	SInt64 loopStart = sound.packetCount / 5, loopEnd = sound.packetCount - sound.packetCount / 7;
+	CASoundPacketCache cache;
+	TEST_CHECK(cache.InitializeMapped(mapping, sound.packetCount, sound.format, .5) == noErr, "mapped: InitializeMapped failed");
+	cache.SetLoop(loopStart, loopEnd, true);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	
+	// by pointer, round the loop twice
+	SInt64 packet = 0;
+	int numWrong = 0;
+	for (UInt32 read = 0; read < 2 * sound.packetCount / kPacketsPerRead; ++read) {
+		UInt32 numPackets = kPacketsPerRead;
+		if (numPackets > loopEnd - packet) numPackets = (UInt32)(loopEnd - packet);
+		UInt32 asked = numPackets;
+		const void* packets = cache.GetMappedPackets(packet, &numPackets);
+		if (numPackets != asked || packets != mapping + packet * sound.format.mBytesPerPacket) ++numWrong;
+		packet += numPackets;
+		if (packet >= loopEnd) packet = loopStart;
+		std::this_thread::sleep_for(std::chrono::milliseconds(4));
+	}
+	TEST_CHECK(numWrong == 0, "mapped: %d reads didn't point into the mapping at the packets asked for", numWrong);
+	TEST_CHECK(cache.GetUnderrunCount() == 0, "mapped: %llu underruns while paging in kept up", (unsigned long long)cache.GetUnderrunCount());
+	
+	// ReadPackets copies out of the same place
+	packet = play(cache, NULL, sound, packet, loopStart, loopEnd, 30, kPacketsPerRead, 4000, "mapped");
+	TEST_CHECK(cache.GetUnderrunCount() == 0, "mapped: %llu underruns reading packets", (unsigned long long)cache.GetUnderrunCount());
+	
+	// after a seek it starts over from there, and jumping further on than it has got without telling it gets there first
+	cache.Prefetch(loopStart);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	packet = play(cache, NULL, sound, loopStart, loopStart, loopEnd, 2, kPacketsPerRead, 4000, "mapped");
+	TEST_CHECK(cache.GetUnderrunCount() == 0, "mapped: %llu underruns after a seek", (unsigned long long)cache.GetUnderrunCount());
+	packet = play(cache, NULL, sound, packet + 2 * 22050, loopStart, loopEnd, 1, kPacketsPerRead, 4000, "mapped");
+	TEST_CHECK(cache.GetUnderrunCount() == 1, "mapped: %llu underruns after jumping ahead of the read ahead", (unsigned long long)cache.GetUnderrunCount());
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	play(cache, NULL, sound, packet, loopStart, loopEnd, 30, kPacketsPerRead, 4000, "mapped");
+	TEST_CHECK(cache.GetUnderrunCount() == 1, "mapped: %llu underruns once the read ahead had caught up", (unsigned long long)(cache.GetUnderrunCount() - 1));
+	cache.Dispose();
+	munmap((void*)mapping, sound.data.size());
+}
+
+int main()
+{
+	TestSound sound;
+	makeConstantBitRate(sound);
+	testSound(sound, 1024, "16 bit stereo");
+	testMapped(sound);
+	makeVariableBitRate(sound);
+	testSound(sound, 16, "variable bit rate");
+
+	if (gTestFailures == 0) printf("CASoundPacketCacheTest: all passed\n");
+	return gTestFailures == 0 ? 0 : 1;
+}
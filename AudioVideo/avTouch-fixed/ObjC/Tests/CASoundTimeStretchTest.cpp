@@ -0,0 +1,144 @@
+//	Plays a 200 Hz to 4 kHz log sweep through CASoundTimeStretch at the rates
+//	CASound's skip modes use, forwards and backwards, and checks that the pitch
+//	is kept: the frequency of each block of output is that of the sweep where
+//	the stretch has got to in it. Also checks the level holds, that as much
+//	audio comes out as the rate says, and that going forwards the sound is read
+//	in order and only once, as CASound's read ahead needs.
+#include "CASoundTimeStretch.h"
+#include "TestSupport.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static const double kSampleRate = 44100.;
+static const double kSweepSeconds = 4.;
+static const double kStartHz = 200., kEndHz = 4000.;
+static const float kAmplitude = .5f;
+
+static std::vector<float> sweep;	// stereo, the same in both channels
+static SInt64 readEnd;				// the frame after the last one read
+static int numReadsBack;			// reads that started before it
+static SInt64 numFramesRead;
+
+static double sweepHz(double frame)
+{
+	double t = frame / kSampleRate;
+	return kStartHz * pow(kEndHz / kStartHz, t / kSweepSeconds);
+}
+
+static OSStatus readSweep(void*, SInt64 frame, UInt32* ioNumFrames, void* outBuffer)
+{
+	SInt64 numFrames = sweep.size() / 2;
+	if (frame < 0 || frame >= numFrames) {
+		*ioNumFrames = 0;
+		return noErr;
+	}
+	if (frame + *ioNumFrames > numFrames) *ioNumFrames = (UInt32)(numFrames - frame);
+	memcpy(outBuffer, &sweep[2 * frame], *ioNumFrames * 2 * sizeof(float));
+	if (frame < readEnd) ++numReadsBack;
+	readEnd = frame + *ioNumFrames;
+	numFramesRead += *ioNumFrames;
+	return noErr;
+}
+
+// the frequency of a block of a nearly pure tone, from its zero crossings
+static double blockHz(const float* samples, UInt32 numFrames)
+{
+	int crossings = 0;
+	double first = -1., last = -1.;
+	for (UInt32 i = 1; i < numFrames; ++i) {
+		float a = samples[2 * (i - 1)], b = samples[2 * i];
+		if (a < 0.f && b >= 0.f) {
+			double at = i - 1 + a / (a - b);
+			if (first < 0.) first = at;
+			last = at;
+			++crossings;
+		}
+	}
+	return crossings > 1 ? (crossings - 1) * kSampleRate / (last - first) : 0.;
+}
+
+static void testRate(float rate)
+{
+	AudioStreamBasicDescription format = {};
+	format.mSampleRate = kSampleRate;
+	format.mFormatID = kAudioFormatLinearPCM;
+	format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+	format.mBitsPerChannel = 32;
+	format.mChannelsPerFrame = 2;
+	format.mFramesPerPacket = 1;
+	format.mBytesPerFrame = format.mBytesPerPacket = 2 * sizeof(float);
+	
+	SInt64 numFrames = sweep.size() / 2;
+	CASoundTimeStretch stretch;
+	TEST_CHECK(stretch.Initialize(format, numFrames, readSweep, NULL, 4.f) == noErr, "Initialize failed");
+	stretch.SetRate(rate);
+	SInt64 position = rate < 0.f ? numFrames - 1 : 0;
+	stretch.Reset(position);
+	readEnd = INT64_MIN;
+	numReadsBack = 0;
+	numFramesRead = 0;
+	
+	const UInt32 kBlockFrames = 2048;
+	std::vector<float> block(2 * kBlockFrames);
+	SInt64 totalFrames = 0;
+	int numBlocks = 0, numBadBlocks = 0;
+	double worstError = 0.;
+	for (;;) {
+		SInt64 startPosition = position;
+		UInt32 n = kBlockFrames;
+		OSStatus err = stretch.Render(position, n, block.data());
+		TEST_CHECK(err == noErr, "Render failed at %.2fx", rate);
+		if (err) return;
+		totalFrames += n;
+		if (n < kBlockFrames) break;
+		
+		// leave out the ends, where the output fades in and out, and the low notes, too few cycles for a block
+		double sourceFrame = .5 * (startPosition + position);
+		double expected = sweepHz(sourceFrame);
+		if (sourceFrame < kSampleRate * .25 || sourceFrame > numFrames - kSampleRate * .25 || expected < 400.) continue;
+		++numBlocks;
+		
+		// the grains in a block come from a source span as wide as the rate, so the sweep moves on within it
+		double measured = blockHz(block.data(), n);
+		double error = fabs(measured / expected - 1.);
+		double allowed = .03 + .5 * fabs(log(sweepHz(position) / sweepHz(startPosition)));
+		if (error > allowed) ++numBadBlocks;
+		if (error > worstError) worstError = error;
+		
+		double energy = 0.;
+		for (UInt32 i = 0; i < n; ++i) energy += block[2 * i] * block[2 * i];
+		double rmsDB = 10. * log10(energy / n / (kAmplitude * kAmplitude / 2.));
+		TEST_CHECK(fabs(rmsDB) < 3., "level %.1f dB off at %.2fx near %.0f Hz", rmsDB, rate, expected);
+	}
+	
+	TEST_CHECK(numBlocks > 4, "only %d blocks measured at %.2fx", numBlocks, rate);
+	TEST_CHECK(numBadBlocks == 0, "%d of %d blocks off pitch at %.2fx, worst by %.1f%%", numBadBlocks, numBlocks, rate, worstError * 100.);
+	// give or take the latency and the last grain, and the block the end came in
+	double expectedFrames = numFrames / fabs(rate);
+	double allowedFrames = kBlockFrames + 3 * stretch.GetLatencyFrames();
+	TEST_CHECK(fabs(totalFrames - expectedFrames) < allowedFrames, "%lld frames at %.2fx, expected about %.0f", (long long)totalFrames, rate, expectedFrames);
+	if (rate > 0.f) {
+		TEST_CHECK(numReadsBack == 0, "%d reads went back at %.2fx", numReadsBack, rate);
+		TEST_CHECK(numFramesRead <= numFrames, "%lld frames read at %.2fx, the sound is %lld", (long long)numFramesRead, rate, (long long)numFrames);
+	}
+	printf("%6.2fx: %3d blocks, worst pitch error %.2f%%, %lld frames\n", rate, numBlocks, worstError * 100., (long long)totalFrames);
+}
+
+int main()
+{
+	// a log sweep, with the phase integrated so that it is continuous
+	SInt64 numFrames = (SInt64)(kSampleRate * kSweepSeconds);
+	sweep.resize(2 * numFrames);
+	double phase = 0.;
+	for (SInt64 i = 0; i < numFrames; ++i) {
+		sweep[2 * i] = sweep[2 * i + 1] = kAmplitude * (float)sin(phase);
+		phase += 2. * M_PI * sweepHz((double)i) / kSampleRate;
+	}
+	
+	const float kRates[] = { .25f, .5f, 1.f, 1.5f, 2.f, 4.f, -1.f, -4.f };
+	for (float rate : kRates) testRate(rate);
+	
+	if (gTestFailures == 0) printf("CASoundTimeStretchTest: all passed\n");
+	return gTestFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+//	Stand-in for Accelerate.h: plain loops doing what the vDSP calls the avTouch
+//	classes make do, so that their results can be checked anywhere. They are not
+//	meant to be as fast as vDSP.
+#pragma once
+
+#include <stddef.h>
+
+typedef long vDSP_Stride;
+typedef unsigned long vDSP_Length;
+
+//	the sum of the squares of inA
+inline void	vDSP_svesq(const float* inA, vDSP_Stride inStrideA, float* outC, vDSP_Length inN)
+{
+	float theSum = 0.f;
+	for(vDSP_Length theIndex = 0; theIndex < inN; ++theIndex)
+	{
+		theSum += inA[theIndex * inStrideA] * inA[theIndex * inStrideA];
+	}
+	*outC = theSum;
+}
+
+//	correlation with a positive filter stride, convolution with a negative one pointing at the filter's last element
+inline void	vDSP_conv(const float* inA, vDSP_Stride inStrideA, const float* inF, vDSP_Stride inStrideF, float* outC, vDSP_Stride inStrideC, vDSP_Length inN, vDSP_Length inP)
+{
+	for(vDSP_Length theOutput = 0; theOutput < inN; ++theOutput)
+	{
+		float theSum = 0.f;
+		for(vDSP_Length theTap = 0; theTap < inP; ++theTap)
+		{
+			theSum += inA[(theOutput + theTap) * inStrideA] * inF[(vDSP_Stride)theTap * inStrideF];
+		}
+		outC[theOutput * inStrideC] = theSum;
+	}
+}
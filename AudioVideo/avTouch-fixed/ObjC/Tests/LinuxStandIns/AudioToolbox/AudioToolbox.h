@@ -0,0 +1,32 @@
+//	Stand-in for AudioToolbox.h, only what the portable avTouch classes use.
+//	The AudioFile functions are only declared: a test that builds a class
+//	which reads files defines them over whatever data it wants read.
+#pragma once
+
+#include <CoreAudio/CoreAudioTypes.h>
+
+enum
+{
+	kAudioFormatUnsupportedDataFormatError	= 'fmt?'
+};
+
+enum
+{
+	kAudioFileNotOpenError					= -38,
+	kAudioFileEndOfFileError				= -39
+};
+
+typedef struct OpaqueAudioFileID*	AudioFileID;
+typedef UInt32						AudioFilePropertyID;
+
+enum
+{
+	kAudioFilePropertyAudioDataPacketCount	= 'pcnt',
+	kAudioFilePropertyPacketSizeUpperBound	= 'pkub',
+	kAudioFilePropertyBitRate				= 'brat'
+};
+
+OSStatus	AudioFileGetProperty(AudioFileID inAudioFile, AudioFilePropertyID inPropertyID, UInt32* ioDataSize, void* outPropertyData);
+OSStatus	AudioFileReadPackets(AudioFileID inAudioFile, Boolean inUseCache, UInt32* outNumBytes, AudioStreamPacketDescription* outPacketDescriptions,
+								 SInt64 inStartingPacket, UInt32* ioNumPackets, void* outBuffer);
+OSStatus	AudioFileClose(AudioFileID inAudioFile);
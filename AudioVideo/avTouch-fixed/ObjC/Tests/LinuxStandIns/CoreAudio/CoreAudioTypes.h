@@ -0,0 +1,67 @@
+//	Just enough of CoreAudioTypes.h to build the portable avTouch classes on a
+//	machine without the Apple SDKs. Values match the real header.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t UInt8;
+typedef int8_t SInt8;
+typedef uint16_t UInt16;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef float Float32;
+typedef double Float64;
+typedef UInt8 Byte;
+typedef int32_t OSStatus;
+typedef unsigned char Boolean;
+
+enum { noErr = 0 };
+
+enum
+{
+	kAudio_MemFullError					= -108
+};
+
+typedef UInt32 AudioFormatID;
+typedef UInt32 AudioFormatFlags;
+
+typedef struct AudioStreamBasicDescription
+{
+	Float64				mSampleRate;
+	AudioFormatID		mFormatID;
+	AudioFormatFlags	mFormatFlags;
+	UInt32				mBytesPerPacket;
+	UInt32				mFramesPerPacket;
+	UInt32				mBytesPerFrame;
+	UInt32				mChannelsPerFrame;
+	UInt32				mBitsPerChannel;
+	UInt32				mReserved;
+} AudioStreamBasicDescription;
+
+enum
+{
+	kAudioFormatLinearPCM				= 'lpcm'
+};
+
+enum
+{
+	kAudioFormatFlagIsFloat				= (1U << 0),
+	kAudioFormatFlagIsBigEndian			= (1U << 1),
+	kAudioFormatFlagIsSignedInteger		= (1U << 2),
+	kAudioFormatFlagIsPacked			= (1U << 3),
+	kAudioFormatFlagIsAlignedHigh		= (1U << 4),
+	kAudioFormatFlagIsNonInterleaved	= (1U << 5),
+	kAudioFormatFlagIsNonMixable		= (1U << 6),
+	kAudioFormatFlagsNativeEndian		= 0
+};
+
+typedef struct AudioStreamPacketDescription
+{
+	SInt64	mStartOffset;
+	UInt32	mVariableFramesInPacket;
+	UInt32	mDataByteSize;
+} AudioStreamPacketDescription;
@@ -0,0 +1,78 @@
+//	Stand-in for dispatch.h: the semaphores and times the portable avTouch
+//	classes use, on top of the C++ standard library.
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+typedef uint64_t	dispatch_time_t;
+
+#define DISPATCH_TIME_NOW		(0ull)
+#define DISPATCH_TIME_FOREVER	(~0ull)
+#define NSEC_PER_MSEC			1000000ull
+#define NSEC_PER_SEC			1000000000ull
+
+struct dispatch_semaphore_s
+{
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	long					mValue;
+};
+typedef dispatch_semaphore_s*	dispatch_semaphore_t;
+
+//	nanoseconds on the steady clock, which never comes out as either of the special values
+inline dispatch_time_t	dispatch_time(dispatch_time_t inWhen, int64_t inDelta)
+{
+	if(inWhen == DISPATCH_TIME_FOREVER)
+	{
+		return inWhen;
+	}
+	if(inWhen == DISPATCH_TIME_NOW)
+	{
+		inWhen = (dispatch_time_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() + 1;
+	}
+	return inWhen + inDelta;
+}
+
+inline dispatch_semaphore_t	dispatch_semaphore_create(long inValue)
+{
+	dispatch_semaphore_t theSemaphore = new dispatch_semaphore_s;
+	theSemaphore->mValue = inValue;
+	return theSemaphore;
+}
+
+//	only semaphores are ever released here
+inline void	dispatch_release(dispatch_semaphore_t inSemaphore)
+{
+	delete inSemaphore;
+}
+
+inline long	dispatch_semaphore_signal(dispatch_semaphore_t inSemaphore)
+{
+	std::lock_guard<std::mutex> theLock(inSemaphore->mMutex);
+	++inSemaphore->mValue;
+	inSemaphore->mCondition.notify_one();
+	return 0;
+}
+
+//	non-zero if it timed out
+inline long	dispatch_semaphore_wait(dispatch_semaphore_t inSemaphore, dispatch_time_t inTimeout)
+{
+	std::unique_lock<std::mutex> theLock(inSemaphore->mMutex);
+	if(inTimeout == DISPATCH_TIME_FOREVER)
+	{
+		inSemaphore->mCondition.wait(theLock, [inSemaphore]() { return inSemaphore->mValue > 0; });
+	}
+	else
+	{
+		std::chrono::steady_clock::time_point theDeadline(std::chrono::nanoseconds(inTimeout - 1));
+		if(!inSemaphore->mCondition.wait_until(theLock, theDeadline, [inSemaphore]() { return inSemaphore->mValue > 0; }))
+		{
+			return 1;
+		}
+	}
+	--inSemaphore->mValue;
+	return 0;
+}
@@ -285,7 +285,8 @@ using namespace simd;
                                                                  library: library];
     
     _terrainRenderer = [[AAPLTerrainRenderer alloc] initWithDevice: device
-                                                           library: library];
+                                                           library: library
+                                                         allocator: _frameAllocator];
     
 #if TARGET_OS_OSX
     _particleRenderer = [[AAPLParticleRenderer alloc] initWithDevice: device
@@ -376,8 +377,7 @@ using namespace simd;
 
     // We start the frame by doing non-render work
     // Update the terrain tesselation patches so they are more tesselated when closer to the camera
-    [_terrainRenderer computeTesselationFactors:commandBuffer
-                                 globalUniforms:_uniforms_gpu];
+    [_terrainRenderer selectPatchesWithUniforms:_uniforms_cpu];
     
 #if TARGET_OS_OSX
     // We spawn/update the particles on macOS only
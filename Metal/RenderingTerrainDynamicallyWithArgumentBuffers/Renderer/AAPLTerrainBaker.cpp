@@ -0,0 +1,477 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLTerrainBaker class.
+ The level 0 maps are baked in square tiles spread across a thread pool. Within a tile, each row gathers one sample
+ offset at a time across the whole row, so the heights a tile reads stay in cache and each gather is a run of
+ neighboring texels that vectorizes: occlusion compares eight 16 bit heights at once against a per texel threshold,
+ and variance and normals work on four texels at once.
+ Samples land on whole texels: a sample at an offset of d texels from a texel center reads the texel floor(0.5 + d)
+ away, which is what the kernels' nearest sampling does except right on a texel edge (see AAPLTerrainBaker.h).
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>      // for random()
+#include <cstring>
+
+#include "AAPLTerrainBaker.h"
+#include "AAPLThreadPool.h"
+
+using namespace simd;
+
+static const uint32_t kTileSize = 64;
+
+std::vector<float2> TerrainAOSampleDisk (int count)
+{
+    std::vector<float2> res;
+
+    srandom(12345);
+    const float sampleRadius = TERRAIN_AO_SAMPLE_RADIUS;
+
+    for (int i = 0; i < count; i++)
+    {
+        float u = (float)random() / (float)RAND_MAX;
+        float v = (float)random() / (float)RAND_MAX;
+
+        float r = sqrtf(u);
+        float theta = 2.0f * (float)M_PI * v;
+
+        res.push_back ((float2) {cosf(theta), sinf(theta)} * r * sampleRadius);
+    }
+    return res;
+}
+
+static inline uint32_t Clamp (int32_t v, uint32_t size)
+{
+    return v < 0 ? 0 : ((uint32_t)v >= size ? size - 1 : (uint32_t)v);
+}
+
+static inline float HeightValue (uint16_t h)
+{
+    return (float)h / 65535.0f;
+}
+
+// Occlusion counts a sample as visible when its height is below the center's plus 0.001. For each center height,
+//  the highest sample height that is visible, so the test can be done on the 16 bit heights.
+static const uint16_t* VisibleHeightThresholds ()
+{
+    static std::vector<uint16_t> thresholds = []
+    {
+        std::vector<uint16_t> res (65536);
+        uint32_t v = 0;
+        for (uint32_t center = 0; center < 65536; center++)
+        {
+            const float h_center = HeightValue ((uint16_t)center) + 0.001f;
+            while (v < 65535 && HeightValue ((uint16_t)(v + 1)) < h_center) v++;
+            res[center] = (uint16_t)v;
+        }
+        return res;
+    } ();
+    return thresholds.data ();
+}
+
+// Packs f as an unsigned float with a 5 bit exponent, as in MTLPixelFormatRG11B10Float, rounding to nearest even
+static uint32_t PackUnsignedFloat (float f, uint32_t mantissaBits)
+{
+    const uint32_t maxFinite = (30u << mantissaBits) | ((1u << mantissaBits) - 1);
+    if (!(f > 0.0f)) return 0;
+    if (f > 65536.0f) return maxFinite;
+
+    uint32_t bits;
+    memcpy (&bits, &f, sizeof (bits));
+    const int32_t exponent = (int32_t)(bits >> 23) - 127 + 15;
+    const uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+
+    // Line the mantissa up with the packed format's, whose numbers below 2^-14 are denormal
+    uint32_t shift = 23 - mantissaBits;
+    uint32_t biasedExponent = (uint32_t)exponent;
+    if (exponent <= 0)
+    {
+        shift += (uint32_t)(1 - exponent);
+        biasedExponent = 0;
+        if (shift >= 25) return 0;
+    }
+
+    // Adding the shifted mantissa, with its leading one, onto the exponent's bits less one carries any rounding
+    //  up into the exponent
+    uint32_t packed = ((biasedExponent == 0 ? 0 : biasedExponent - 1) << mantissaBits) + (mantissa >> shift);
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t half = 1u << (shift - 1);
+    if (remainder > half || (remainder == half && (packed & 1)))
+        packed++;
+
+    return packed > maxFinite ? maxFinite : packed;
+}
+
+static inline float UnpackUnsignedFloat (uint32_t packed, uint32_t mantissaBits)
+{
+    const uint32_t exponent = packed >> mantissaBits;
+    const uint32_t mantissa = packed & ((1u << mantissaBits) - 1);
+    if (exponent == 0)
+        return (float)mantissa * (1.0f / (float)(1u << (14 + mantissaBits)));
+
+    const uint32_t bits = ((exponent - 15 + 127) << 23) | (mantissa << (23 - mantissaBits));
+    float f;
+    memcpy (&f, &bits, sizeof (f));
+    return f;
+}
+
+static inline uint32_t PackUnorm8 (float f)
+{
+    // Adding and taking away 1.5 * 2^23 rounds to the nearest even integer without a call into the math library
+    f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+    return (uint32_t)((f * 255.0f + 12582912.0f) - 12582912.0f);
+}
+
+uint32_t AAPLTerrainBaker::PackNormal (float r, float g, float b)
+{
+    return PackUnsignedFloat (r, 6) | (PackUnsignedFloat (g, 6) << 11) | (PackUnsignedFloat (b, 5) << 22);
+}
+
+void AAPLTerrainBaker::UnpackNormal (uint32_t packed, float outRGB[3])
+{
+    outRGB[0] = UnpackUnsignedFloat (packed & 0x7ff, 6);
+    outRGB[1] = UnpackUnsignedFloat ((packed >> 11) & 0x7ff, 6);
+    outRGB[2] = UnpackUnsignedFloat (packed >> 22, 5);
+}
+
+uint32_t AAPLTerrainBaker::PackProperties (float r, float g, float b, float a)
+{
+    return PackUnorm8 (r) | (PackUnorm8 (g) << 8) | (PackUnorm8 (b) << 16) | (PackUnorm8 (a) << 24);
+}
+
+void AAPLTerrainBaker::UnpackProperties (uint32_t packed, float outRGBA[4])
+{
+    for (int i = 0; i < 4; i++)
+        outRGBA[i] = (float)((packed >> (8 * i)) & 0xff) / 255.0f;
+}
+
+AAPLTerrainBaker::AAPLTerrainBaker (const uint16_t* heights, uint32_t width, uint32_t height, int aoSampleCount)
+: _heights (heights)
+, _width (width)
+, _height (height)
+{
+    // Occlusion counts visible samples in 16 bit lanes
+    assert (heights != nullptr && width > 0 && height > 0 && aoSampleCount > 0 && aoSampleCount <= 32767);
+
+    // Sample offsets are scaled by the width along both axes, as in the kernels
+    const double aspect = (double)height / (double)width;
+
+    int32_t maxOffsetX = 0, maxOffsetY = 0;
+    auto MakeOffset = [&] (double dx, double dy)
+    {
+        Offset offset = { (int32_t)floor (0.5 + dx), (int32_t)floor (0.5 + dy * aspect) };
+        maxOffsetX = std::max (maxOffsetX, abs (offset.x));
+        maxOffsetY = std::max (maxOffsetY, abs (offset.y));
+        return offset;
+    };
+
+    for (float2 sample : TerrainAOSampleDisk (aoSampleCount))
+        _aoOffsets.push_back (MakeOffset (sample.x, sample.y));
+
+    int varianceSample = 0;
+    for (int j = -3; j <= 3; ++j)
+    {
+        for (int i = -3; i <= 3; ++i)
+        {
+            if (i == 0 && j == 0) continue;
+            _varianceOffsets[varianceSample++] = MakeOffset (3.5 * i, 3.5 * j);
+        }
+    }
+
+    // TerrainFillRebakePasses rebakes the properties of texels up to these margins from a changed height
+    assert (maxOffsetX < TERRAIN_AO_SAMPLE_RADIUS + 2);
+    assert (maxOffsetY < (int32_t)((TERRAIN_AO_SAMPLE_RADIUS * height + width - 1) / width) + 2);
+
+    // Normals read a texel either side
+    _apronX = maxOffsetX + 1;
+    _apronY = maxOffsetY + 1;
+
+    uint32_t levelWidth = width, levelHeight = height;
+    for (;;)
+    {
+        AAPLTerrainBakeLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.normals.resize ((size_t)levelWidth * levelHeight);
+        level.properties.resize ((size_t)levelWidth * levelHeight);
+        _levels.push_back (std::move (level));
+
+        if (levelWidth == 1 && levelHeight == 1) break;
+        levelWidth = std::max (levelWidth / 2, 1u);
+        levelHeight = std::max (levelHeight / 2, 1u);
+    }
+    assert (_levels.size () <= TERRAIN_MAX_MIP_LEVELS);
+}
+
+void AAPLTerrainBaker::bake (AAPLThreadPool& pool)
+{
+    TerrainRebakePass passes[TerrainRebakePassCOUNT];
+    TerrainFillRebakePasses (passes, TerrainMakeRebakePass (0, 0, (int)_width, (int)_height, 0, _width, _height),
+                             _width, _height, mipCount ());
+    bake (pool, passes);
+}
+
+// Calls fn (x0, y0, x1, y1) across the pool for each kTileSize square tile of the bounds of two passes
+template <typename F>
+static void ForEachTile (AAPLThreadPool& pool, const TerrainRebakePass& a, const TerrainRebakePass& b, F fn)
+{
+    const bool aEmpty = TerrainRebakePassIsEmpty (a), bEmpty = TerrainRebakePassIsEmpty (b);
+    if (aEmpty && bEmpty) return;
+
+    const uint32_t x0 = aEmpty ? b.origin.x : (bEmpty ? a.origin.x : std::min (a.origin.x, b.origin.x));
+    const uint32_t y0 = aEmpty ? b.origin.y : (bEmpty ? a.origin.y : std::min (a.origin.y, b.origin.y));
+    const uint32_t x1 = aEmpty ? b.end.x : (bEmpty ? a.end.x : std::max (a.end.x, b.end.x));
+    const uint32_t y1 = aEmpty ? b.end.y : (bEmpty ? a.end.y : std::max (a.end.y, b.end.y));
+
+    const uint32_t tilesX = (x1 - x0 + kTileSize - 1) / kTileSize;
+    const uint32_t tilesY = (y1 - y0 + kTileSize - 1) / kTileSize;
+
+    pool.parallelFor ((size_t)tilesX * tilesY, [&] (size_t tile)
+    {
+        const uint32_t tx = x0 + (uint32_t)(tile % tilesX) * kTileSize;
+        const uint32_t ty = y0 + (uint32_t)(tile / tilesX) * kTileSize;
+        fn (tx, ty, std::min (tx + kTileSize, x1), std::min (ty + kTileSize, y1));
+    }, 1);
+}
+
+void AAPLTerrainBaker::bake (AAPLThreadPool& pool, const TerrainRebakePass* passes)
+{
+    const TerrainRebakePass& normals = passes[TerrainRebakePassNormals];
+    const TerrainRebakePass& properties = passes[TerrainRebakePassProperties];
+
+    ForEachTile (pool, normals, properties, [&] (uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+    {
+        bakeTile (x0, y0, x1, y1, normals, properties);
+    });
+
+    // Each level filters the one above, so they go one after another
+    for (uint32_t level = 1; level < mipCount (); level++)
+    {
+        const TerrainRebakePass& normalsMip = passes[TerrainRebakePassNormalsMip1 + level - 1];
+        const TerrainRebakePass& propertiesMip = passes[TerrainRebakePassPropertiesMip1 + level - 1];
+
+        AAPLTerrainBakeLevel& dst = _levels[level];
+        const AAPLTerrainBakeLevel& src = _levels[level - 1];
+
+        auto Downsample = [&] (const TerrainRebakePass& pass, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, bool isNormals)
+        {
+            x0 = std::max (x0, pass.origin.x);  x1 = std::min (x1, pass.end.x);
+            y0 = std::max (y0, pass.origin.y);  y1 = std::min (y1, pass.end.y);
+
+            const std::vector<uint32_t>& srcTexels = isNormals ? src.normals : src.properties;
+            std::vector<uint32_t>& dstTexels = isNormals ? dst.normals : dst.properties;
+
+            for (uint32_t y = y0; y < y1; y++)
+            {
+                const uint32_t sy0 = std::min (2 * y, src.height - 1), sy1 = std::min (2 * y + 1, src.height - 1);
+                for (uint32_t x = x0; x < x1; x++)
+                {
+                    const uint32_t sx0 = std::min (2 * x, src.width - 1), sx1 = std::min (2 * x + 1, src.width - 1);
+                    const uint32_t texels[4] =
+                    {
+                        srcTexels[sy0 * src.width + sx0], srcTexels[sy0 * src.width + sx1],
+                        srcTexels[sy1 * src.width + sx0], srcTexels[sy1 * src.width + sx1]
+                    };
+
+                    float sum[4] = { 0, 0, 0, 0 };
+                    for (uint32_t t = 0; t < 4; t++)
+                    {
+                        float value[4] = { 0, 0, 0, 1 };
+                        if (isNormals) UnpackNormal (texels[t], value);
+                        else UnpackProperties (texels[t], value);
+                        for (int c = 0; c < 4; c++) sum[c] += value[c];
+                    }
+
+                    dstTexels[y * dst.width + x] = isNormals
+                        ? PackNormal (sum[0] * 0.25f, sum[1] * 0.25f, sum[2] * 0.25f)
+                        : PackProperties (sum[0] * 0.25f, sum[1] * 0.25f, sum[2] * 0.25f, sum[3] * 0.25f);
+                }
+            }
+        };
+
+        ForEachTile (pool, normalsMip, propertiesMip, [&] (uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+        {
+            if (!TerrainRebakePassIsEmpty (normalsMip)) Downsample (normalsMip, x0, y0, x1, y1, true);
+            if (!TerrainRebakePassIsEmpty (propertiesMip)) Downsample (propertiesMip, x0, y0, x1, y1, false);
+        });
+    }
+}
+
+void AAPLTerrainBaker::fillTileCache (TileCache& cache, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const
+{
+    // Rows are padded with a vector's worth of texels, so rows can be worked on in whole vectors
+    cache.originX = (int32_t)x0 - _apronX;
+    cache.originY = (int32_t)y0 - _apronY;
+    cache.stride = (x1 - x0) + 2 * _apronX + 8;
+    const uint32_t rows = (y1 - y0) + 2 * _apronY;
+
+    cache.heights.resize ((size_t)cache.stride * rows);
+    cache.values.resize ((size_t)cache.stride * rows);
+
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        const uint16_t* src = _heights + (size_t)Clamp (cache.originY + (int32_t)row, _height) * _width;
+        uint16_t* dst = cache.heights.data () + (size_t)row * cache.stride;
+        float* values = cache.values.data () + (size_t)row * cache.stride;
+
+        for (uint32_t i = 0; i < cache.stride; i++)
+        {
+            dst[i] = src[Clamp (cache.originX + (int32_t)i, _width)];
+            values[i] = HeightValue (dst[i]);
+        }
+    }
+}
+
+void AAPLTerrainBaker::bakeTile (uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                                 const TerrainRebakePass& normals, const TerrainRebakePass& properties)
+{
+    static thread_local TileCache cache;
+    fillTileCache (cache, x0, y0, x1, y1);
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        if (y >= normals.origin.y && y < normals.end.y)
+        {
+            const uint32_t nx0 = std::max (x0, normals.origin.x), nx1 = std::min (x1, normals.end.x);
+            if (nx0 < nx1) bakeNormals (cache, nx0, y, nx1);
+        }
+        if (y >= properties.origin.y && y < properties.end.y)
+        {
+            const uint32_t px0 = std::max (x0, properties.origin.x), px1 = std::min (x1, properties.end.x);
+            if (px0 < px1) bakeProperties (cache, px0, y, px1);
+        }
+    }
+}
+
+// As TerrainKnl_ComputeNormalsFromHeightmap, for texels [x0, x1) of row y
+void AAPLTerrainBaker::bakeNormals (const TileCache& cache, uint32_t x0, uint32_t y, uint32_t x1)
+{
+    const uint32_t count = x1 - x0;
+    const float xz_scale = TERRAIN_SCALE / _width;
+    const float y_scale = TERRAIN_HEIGHT;
+
+    const float* center = cache.values.data () + (size_t)((int32_t)y - cache.originY) * cache.stride + ((int32_t)x0 - cache.originX);
+    const float* up = center + cache.stride;
+    const float* down = center - cache.stride;
+
+    uint32_t* out = _levels[0].normals.data () + (size_t)y * _width + x0;
+
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        // Four texels at a time, each vector holding one component of each
+        float4 h_up, h_down, h_right, h_left, h_center;
+        memcpy (&h_up, up + i, sizeof (float4));
+        memcpy (&h_down, down + i, sizeof (float4));
+        memcpy (&h_right, center + i + 1, sizeof (float4));
+        memcpy (&h_left, center + i - 1, sizeof (float4));
+        memcpy (&h_center, center + i, sizeof (float4));
+
+        // The vectors to the four neighbors, and the sum of the cross products of each with the next around
+        const float4 zero = { 0, 0, 0, 0 };
+        const float4 s = zero + xz_scale;
+        const float4 a = (h_up    - h_center) * y_scale;
+        const float4 b = (h_down  - h_center) * y_scale;
+        const float4 c = (h_right - h_center) * y_scale;
+        const float4 d = (h_left  - h_center) * y_scale;
+
+        auto Cross = [] (float4 ax, float4 ay, float4 az, float4 bx, float4 by, float4 bz, float4 out[3])
+        {
+            out[0] = ay * bz - az * by;
+            out[1] = az * bx - ax * bz;
+            out[2] = ax * by - ay * bx;
+        };
+        float4 n0[3], n1[3], n2[3], n3[3];
+        Cross (zero, a, s,     s, c, zero,  n0);        // up x right
+        Cross (-s, d, zero,    zero, a, s,  n1);        // left x up
+        Cross (zero, b, -s,    -s, d, zero, n2);        // down x left
+        Cross (s, c, zero,     zero, b, -s, n3);        // right x down
+
+        const float4 nx = n0[0] + n1[0] + n2[0] + n3[0];
+        const float4 ny = n0[1] + n1[1] + n2[1] + n3[1];
+        const float4 nz = n0[2] + n1[2] + n2[2] + n3[2];
+        const float4 lengthSquared = nx * nx + ny * ny + nz * nz;
+
+        for (uint32_t lane = 0; lane < 4 && i + lane < count; lane++)
+        {
+            const float invLength = 1.0f / sqrtf (lengthSquared[lane]);
+            out[i + lane] = PackNormal (nx[lane] * invLength * 0.5f + 0.5f,
+                                        nz[lane] * invLength * 0.5f + 0.5f,
+                                        ny[lane] * invLength * 0.5f + 0.5f);
+        }
+    }
+}
+
+// As TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap, for texels [x0, x1) of row y
+void AAPLTerrainBaker::bakeProperties (const TileCache& cache, uint32_t x0, uint32_t y, uint32_t x1)
+{
+    const uint32_t count = x1 - x0;
+    const size_t centerIndex = (size_t)((int32_t)y - cache.originY) * cache.stride + ((int32_t)x0 - cache.originX);
+    const uint16_t* heights = cache.heights.data () + centerIndex;
+    const float* values = cache.values.data () + centerIndex;
+
+    // Occlusion, eight texels at a time. Lanes past the end of the row read the cache's padding and are ignored.
+    const uint16_t* thresholds = VisibleHeightThresholds ();
+    uint16_t visibleMax[kTileSize];
+    for (uint32_t i = 0; i < count; i++)
+        visibleMax[i] = thresholds[heights[i]];
+
+    const uint32_t visibleCount = (count + 7) / 8;
+    short8 visible[kTileSize / 8];
+    for (uint32_t i = 0; i < visibleCount; i++)
+        visible[i] = (short8){ 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    for (const Offset& offset : _aoOffsets)
+    {
+        const uint16_t* samples = heights + (ptrdiff_t)offset.y * cache.stride + offset.x;
+        for (uint32_t i = 0; i < visibleCount; i++)
+        {
+            ushort8 h, threshold;
+            memcpy (&h, samples + i * 8, sizeof (h));
+            memcpy (&threshold, visibleMax + i * 8, sizeof (threshold));
+
+            // Lanes that pass are all ones, so this counts down
+            visible[i] += (short8)(h <= threshold);
+        }
+    }
+
+    // Variance, four texels at a time, summing the samples in the kernel's order so the result rounds the same
+    const uint32_t totalCount = (count + 3) / 4;
+    float4 total[kTileSize / 4];
+    float4 center[kTileSize / 4];
+    for (uint32_t i = 0; i < totalCount; i++)
+    {
+        total[i] = (float4){ 0, 0, 0, 0 };
+        memcpy (&center[i], values + i * 4, sizeof (float4));
+    }
+
+    for (const Offset& offset : _varianceOffsets)
+    {
+        const float* samples = values + (ptrdiff_t)offset.y * cache.stride + offset.x;
+        for (uint32_t i = 0; i < totalCount; i++)
+        {
+            float4 sample;
+            memcpy (&sample, samples + i * 4, sizeof (sample));
+            total[i] += sample - center[i];
+        }
+    }
+
+    uint32_t* out = _levels[0].properties.data () + (size_t)y * _width + x0;
+    const float sampleCount = (float)_aoOffsets.size ();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const int numVisible = -(int)visible[i / 8][i % 8];
+        const float aoVal = (float)numVisible / sampleCount;
+
+        float variance = std::max (total[i / 4][i % 4], 0.f);
+        variance = variance / ((7*7)-1);
+        const float varianceVal = std::min (std::max (variance * 2, 0.f), 1.f);
+
+        // The properties map is cleared before its first bake, and the kernel keeps its b and a
+        out[i] = PackProperties (aoVal, varianceVal, 0.0f, 0.0f);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLTerrainBaker class, which bakes the terrain normal and properties maps on the CPU.
+ It computes the same normals, ambient occlusion and variance as TerrainKnl_ComputeNormalsFromHeightmap and
+ TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap, and filters mips like TerrainKnl_DownsampleMip, so terrain can
+ be baked offline or checked without a GPU. The output is in the pixel formats of the renderer's textures, ready to
+ be uploaded with replaceRegion.
+ The baker reads each sample from the whole texel it lands on, where the kernels work out a texture coordinate in
+ floating point and sample it. For power of two sizes, such as the renderer's 1024 x 1024 heightmap, the two agree
+ and so do the maps, bit for bit. For other sizes a sample right on the edge between two texels can round into the
+ other one on the GPU. Variance samples an odd number of steps across or down land on an edge, and each that rounds
+ the other way moves the variance by a 24th of the height step across the edge, so on rough terrain a texel's variance
+ can be a few 255ths away from the kernel's (up to 5/255 on the test terrain in Tests/). Occlusion samples seldom land
+ on an edge, and move the occlusion by at most 1/255 when they do.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AAPLTerrainRenderer_shared.h"
+
+class AAPLThreadPool;
+
+// The ambient occlusion sample offsets TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap reads, in texels: count
+//  points spread over a disk of TERRAIN_AO_SAMPLE_RADIUS, drawn from random() seeded with 12345
+std::vector<simd::float2> TerrainAOSampleDisk (int count);
+
+struct AAPLTerrainBakeLevel
+{
+    uint32_t                width;
+    uint32_t                height;
+    std::vector<uint32_t>   normals;        // MTLPixelFormatRG11B10Float, the normal's x, z and y mapped to [0, 1]
+    std::vector<uint32_t>   properties;     // MTLPixelFormatRGBA8Unorm, with occlusion in r and variance in g
+};
+
+class AAPLTerrainBaker
+{
+public:
+    // heights is width x height R16Unorm texels, row by row, as in the terrain renderer's height texture. The baker
+    //  reads it in place, so it must outlive the baker, and may be changed between bakes.
+    AAPLTerrainBaker (const uint16_t* heights, uint32_t width, uint32_t height, int aoSampleCount = 256);
+
+    // Bakes every texel of every level
+    void bake (AAPLThreadPool& pool);
+
+    // Rebakes only the texels of each pass, as filled in by TerrainFillRebakePasses for the heights that changed.
+    //  The result is the same as a full bake.
+    void bake (AAPLThreadPool& pool, const TerrainRebakePass* passes);
+
+    uint32_t                                    width () const      { return _width; }
+    uint32_t                                    height () const     { return _height; }
+    uint32_t                                    mipCount () const   { return (uint32_t) _levels.size (); }
+    const std::vector<AAPLTerrainBakeLevel>&    levels () const     { return _levels; }
+
+    // Conversions matching the GPU's for the output pixel formats
+    static uint32_t PackNormal (float r, float g, float b);
+    static void     UnpackNormal (uint32_t packed, float outRGB[3]);
+    static uint32_t PackProperties (float r, float g, float b, float a);
+    static void     UnpackProperties (uint32_t packed, float outRGBA[4]);
+
+private:
+    // An ambient occlusion sample, or one of the variance's, as a whole texel offset
+    struct Offset
+    {
+        int32_t x;
+        int32_t y;
+    };
+
+    // The heights a tile reads, taken out of the heightmap once with enough of an apron for every sample offset,
+    //  and clamped to its edges as the kernels' samplers do
+    struct TileCache
+    {
+        int32_t                 originX;
+        int32_t                 originY;
+        uint32_t                stride;
+        std::vector<uint16_t>   heights;
+        std::vector<float>      values;     // the same heights as floats
+    };
+
+    void fillTileCache (TileCache& cache, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+    void bakeTile (uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                   const TerrainRebakePass& normals, const TerrainRebakePass& properties);
+    void bakeNormals (const TileCache& cache, uint32_t x0, uint32_t y, uint32_t x1);
+    void bakeProperties (const TileCache& cache, uint32_t x0, uint32_t y, uint32_t x1);
+
+    const uint16_t*                     _heights;
+    uint32_t                            _width;
+    uint32_t                            _height;
+
+    std::vector<Offset>                 _aoOffsets;
+    Offset                              _varianceOffsets[7 * 7 - 1];
+    int32_t                             _apronX;
+    int32_t                             _apronY;
+
+    std::vector<AAPLTerrainBakeLevel>   _levels;
+};
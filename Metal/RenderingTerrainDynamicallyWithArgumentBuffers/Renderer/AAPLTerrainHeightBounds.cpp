@@ -0,0 +1,141 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLTerrainHeightBounds class.
+*/
+
+#include <algorithm>
+#include <cassert>
+
+#include "AAPLTerrainHeightBounds.h"
+
+AAPLTerrainHeightBounds::AAPLTerrainHeightBounds (const uint16_t* heights, uint32_t width, uint32_t height)
+: _heights (heights)
+, _width (width)
+, _height (height)
+{
+    assert (heights != nullptr && width > 0 && height > 0);
+
+    // The same levels as the heightmap's mips, down to 1 x 1
+    for (uint32_t level = 1; levelWidth (level - 1) > 1 || levelHeight (level - 1) > 1; level++)
+        _levels.emplace_back ((size_t)levelWidth (level) * levelHeight (level));
+    assert (levelCount () <= TERRAIN_MAX_MIP_LEVELS);
+}
+
+uint32_t AAPLTerrainHeightBounds::levelWidth (uint32_t level) const
+{
+    return std::max (_width >> level, 1u);
+}
+
+uint32_t AAPLTerrainHeightBounds::levelHeight (uint32_t level) const
+{
+    return std::max (_height >> level, 1u);
+}
+
+void AAPLTerrainHeightBounds::build ()
+{
+    TerrainRebakePass passes[TerrainRebakePassCOUNT];
+    TerrainFillRebakePasses (passes, TerrainMakeRebakePass (0, 0, (int)_width, (int)_height, 0, _width, _height),
+                             _width, _height, levelCount ());
+    update (passes);
+}
+
+void AAPLTerrainHeightBounds::update (const TerrainRebakePass* passes)
+{
+    // Each level is worked out from the one above
+    for (uint32_t level = 1; level < levelCount (); level++)
+    {
+        const TerrainRebakePass& pass = passes[TerrainRebakePassHeightBoundsMip1 + level - 1];
+        if (!TerrainRebakePassIsEmpty (pass)) updateLevel (level, pass);
+    }
+}
+
+inline AAPLTerrainHeightRange AAPLTerrainHeightBounds::texel (uint32_t level, uint32_t x, uint32_t y) const
+{
+    if (level == 0)
+    {
+        const uint16_t h = _heights[(size_t)y * _width + x];
+        return { h, h };
+    }
+    return _levels[level - 1][(size_t)y * levelWidth (level) + x];
+}
+
+// Works out the pass's texels of a level from the two by two texels above each
+void AAPLTerrainHeightBounds::updateLevel (uint32_t level, const TerrainRebakePass& pass)
+{
+    const uint32_t srcWidth = levelWidth (level - 1), srcHeight = levelHeight (level - 1);
+    const uint32_t lastX = levelWidth (level) - 1, lastY = levelHeight (level) - 1;
+    std::vector<AAPLTerrainHeightRange>& dst = _levels[level - 1];
+
+    for (uint32_t y = pass.origin.y; y < pass.end.y; y++)
+    {
+        // The last row and column also take in the row and column an odd sized level has left over
+        const uint32_t sy0 = std::min (2 * y, srcHeight - 1);
+        const uint32_t sy1 = (y == lastY) ? srcHeight - 1 : std::min (2 * y + 1, srcHeight - 1);
+
+        for (uint32_t x = pass.origin.x; x < pass.end.x; x++)
+        {
+            const uint32_t sx0 = std::min (2 * x, srcWidth - 1);
+            const uint32_t sx1 = (x == lastX) ? srcWidth - 1 : std::min (2 * x + 1, srcWidth - 1);
+
+            AAPLTerrainHeightRange range = { 65535, 0 };
+            for (uint32_t sy = sy0; sy <= sy1; sy++)
+            {
+                for (uint32_t sx = sx0; sx <= sx1; sx++)
+                {
+                    const AAPLTerrainHeightRange src = texel (level - 1, sx, sy);
+                    range.min = std::min (range.min, src.min);
+                    range.max = std::max (range.max, src.max);
+                }
+            }
+            dst[(size_t)y * (lastX + 1) + x] = range;
+        }
+    }
+}
+
+AAPLTerrainHeightRange AAPLTerrainHeightBounds::query (int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+{
+    x0 = std::max (x0, 0);  x1 = std::min (x1, (int32_t)_width);
+    y0 = std::max (y0, 0);  y1 = std::min (y1, (int32_t)_height);
+
+    AAPLTerrainHeightRange range = { 65535, 0 };
+    if (x1 <= x0 || y1 <= y0) return range;
+
+    // A texel of the heightmap is under texel x >> level of each level, or the last one where that is past the end
+    const uint32_t level = levelCount () > 1
+        ? TerrainHeightBoundsQueryLevel ((uint32_t)x0, (uint32_t)y0, (uint32_t)x1 - 1, (uint32_t)y1 - 1, levelCount ())
+        : 0;
+    const uint32_t lastX = levelWidth (level) - 1, lastY = levelHeight (level) - 1;
+
+    const uint32_t tx1 = std::min ((uint32_t)(x1 - 1) >> level, lastX);
+    const uint32_t ty1 = std::min ((uint32_t)(y1 - 1) >> level, lastY);
+    for (uint32_t ty = std::min ((uint32_t)y0 >> level, lastY); ty <= ty1; ty++)
+    {
+        for (uint32_t tx = std::min ((uint32_t)x0 >> level, lastX); tx <= tx1; tx++)
+        {
+            const AAPLTerrainHeightRange t = texel (level, tx, ty);
+            range.min = std::min (range.min, t.min);
+            range.max = std::max (range.max, t.max);
+        }
+    }
+    return range;
+}
+
+void AAPLTerrainHeightBounds::patchBounds (uint32_t patchX, uint32_t patchY, uint32_t patchesPerSide,
+                                          simd::float3& outMin, simd::float3& outMax) const
+{
+    const TerrainRebakePass rect = TerrainPatchHeightsRect (patchX, patchY, patchesPerSide, _width, _height);
+    const AAPLTerrainHeightRange range = query ((int32_t)rect.origin.x, (int32_t)rect.origin.y,
+                                                (int32_t)rect.end.x, (int32_t)rect.end.y);
+
+    // A step of height either way, for the sampler's rounding between two texels
+    const float heightStep = TERRAIN_HEIGHT / 65535.0f;
+
+    outMin.x = ((float)patchX / patchesPerSide - 0.5f) * TERRAIN_SCALE;
+    outMin.y = (float)range.min * heightStep - heightStep;
+    outMin.z = ((float)patchY / patchesPerSide - 0.5f) * TERRAIN_SCALE;
+    outMax.x = ((float)(patchX + 1) / patchesPerSide - 0.5f) * TERRAIN_SCALE;
+    outMax.y = (float)range.max * heightStep + heightStep;
+    outMax.z = ((float)(patchY + 1) / patchesPerSide - 0.5f) * TERRAIN_SCALE;
+}
@@ -0,0 +1,67 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLTerrainHeightBounds class, a pyramid of the lowest and highest heights of the terrain.
+ Each level halves the one above, starting from the heightmap itself, so the height range of any rectangle of the
+ heightmap can be looked up in a handful of reads.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AAPLTerrainRenderer_shared.h"
+
+// The lowest and highest of a set of heights, as R16Unorm values
+struct AAPLTerrainHeightRange
+{
+    uint16_t    min;
+    uint16_t    max;
+};
+
+class AAPLTerrainHeightBounds
+{
+public:
+    // heights is width x height R16Unorm texels, row by row. It is read in place, so it must outlive the bounds.
+    //  The bounds start out empty; call build or update to fill them in.
+    AAPLTerrainHeightBounds (const uint16_t* heights, uint32_t width, uint32_t height);
+
+    // Works out the bounds of the whole heightmap
+    void                    build ();
+
+    // Works out again only the bounds the TerrainRebakePassHeightBoundsMip1 passes list, as filled in by
+    //  TerrainFillRebakePasses for the heights that changed
+    void                    update (const TerrainRebakePass* passes);
+
+    // The range of heightmap texels [x0, x1) x [y0, y1), clamped to the heightmap. The range of no texels is
+    //  { 65535, 0 }.
+    AAPLTerrainHeightRange  query (int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+
+    // The bounds in world space of everything a patch of a patchesPerSide x patchesPerSide grid over the terrain can
+    //  draw, as AAPLTerrainQuadtree culls its nodes with
+    void                    patchBounds (uint32_t patchX, uint32_t patchY, uint32_t patchesPerSide,
+                                         simd::float3& outMin, simd::float3& outMax) const;
+
+    uint32_t                width () const      { return _width; }
+    uint32_t                height () const     { return _height; }
+
+    // Levels of the heightmap, counting level 0, which is the heightmap itself
+    uint32_t                levelCount () const { return (uint32_t) _levels.size () + 1; }
+
+    // The ranges of a level from 1 up, row by row, levelWidth (level) wide
+    const std::vector<AAPLTerrainHeightRange>& level (uint32_t level) const { return _levels[level - 1]; }
+    uint32_t                levelWidth (uint32_t level) const;
+    uint32_t                levelHeight (uint32_t level) const;
+
+private:
+    AAPLTerrainHeightRange  texel (uint32_t level, uint32_t x, uint32_t y) const;
+    void                    updateLevel (uint32_t level, const TerrainRebakePass& pass);
+
+    const uint16_t*                                     _heights;
+    uint32_t                                            _width;
+    uint32_t                                            _height;
+
+    std::vector<std::vector<AAPLTerrainHeightRange>>    _levels;
+};
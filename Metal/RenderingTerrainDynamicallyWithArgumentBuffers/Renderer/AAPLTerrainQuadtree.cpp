@@ -0,0 +1,380 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLTerrainQuadtree class.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "AAPLTerrainQuadtree.h"
+
+// A node's state byte: whether it was split, or else its tessellation factor's log2 plus one
+static const uint8_t kNodeSplit         = 0x80;
+static const uint8_t kNodeFactorMask    = 0x0F;
+
+// std::min and std::max take it by reference, so before C++17 it needs a definition
+constexpr uint32_t AAPLTerrainQuadtree::kMaxFactorLog2;
+
+AAPLTerrainQuadtree::AAPLTerrainQuadtree (const uint16_t* heights, uint32_t width, uint32_t height)
+: _heights (heights)
+, _width (width)
+, _height (height)
+, _bounds (heights, width, height)
+, _latticeLog2 (kMaxFactorLog2)
+, _stats ()
+{
+    while ((1u << _latticeLog2) < std::max (width, height)) _latticeLog2++;
+    _maxDepth = std::min<uint32_t> (TERRAIN_QUADTREE_MAX_DEPTH, _latticeLog2 - kMaxFactorLog2);
+
+    const uint32_t n = 1u << _latticeLog2;
+    _samples.resize ((size_t)(n + 1) * (n + 1));
+
+    _errors.resize (_latticeLog2 + 1);
+    for (uint32_t k = 1; k <= _latticeLog2; k++)
+    {
+        for (uint32_t m = 0; m <= std::min (kMaxFactorLog2, _latticeLog2 - k); m++)
+        {
+            const size_t side = n >> (k + m);
+            _errors[k].emplace_back (side * side, 0.0f);
+        }
+    }
+
+    for (uint32_t depth = 0; depth <= _maxDepth; depth++)
+        _nodeStates.emplace_back ((size_t)1 << (2 * depth), 0);
+    _leafCells.resize ((size_t)1 << (2 * _maxDepth));
+}
+
+void AAPLTerrainQuadtree::build ()
+{
+    _bounds.build ();
+
+    const uint32_t n = 1u << _latticeLog2;
+    updateSamples (0, 0, n, n);
+    updateErrors (0, 0, n, n);
+}
+
+void AAPLTerrainQuadtree::update (const TerrainRebakePass* passes)
+{
+    const TerrainRebakePass& heights = passes[TerrainRebakePassHeights];
+    if (TerrainRebakePassIsEmpty (heights)) return;
+
+    _bounds.update (passes);
+
+    // The lattice points that sample any changed texel: a point samples the two texels either side of it each way
+    const uint64_t n = 1u << _latticeLog2;
+    const uint32_t i0 = (uint32_t)(heights.origin.x > 0 ? (heights.origin.x - 1) * n / _width : 0);
+    const uint32_t j0 = (uint32_t)(heights.origin.y > 0 ? (heights.origin.y - 1) * n / _height : 0);
+    const uint32_t i1 = (uint32_t)std::min (n, ((heights.end.x + 1) * n + _width - 1) / _width);
+    const uint32_t j1 = (uint32_t)std::min (n, ((heights.end.y + 1) * n + _height - 1) / _height);
+    updateSamples (i0, j0, i1, j1);
+    updateErrors (i0, j0, i1, j1);
+}
+
+// As terrain_vertex samples the heightmap, linearly, at lattice point (i, j)
+float AAPLTerrainQuadtree::sampleHeight (uint32_t i, uint32_t j) const
+{
+    const float n = (float)(1u << _latticeLog2);
+    const float tx = std::min (std::max (i / n * _width - 0.5f, 0.0f), (float)(_width - 1));
+    const float ty = std::min (std::max (j / n * _height - 0.5f, 0.0f), (float)(_height - 1));
+
+    const uint32_t x0 = (uint32_t)tx, y0 = (uint32_t)ty;
+    const uint32_t x1 = std::min (x0 + 1, _width - 1), y1 = std::min (y0 + 1, _height - 1);
+    const float fx = tx - x0, fy = ty - y0;
+
+    const float h00 = _heights[(size_t)y0 * _width + x0], h10 = _heights[(size_t)y0 * _width + x1];
+    const float h01 = _heights[(size_t)y1 * _width + x0], h11 = _heights[(size_t)y1 * _width + x1];
+    const float top = h00 + (h10 - h00) * fx, bottom = h01 + (h11 - h01) * fx;
+    return (top + (bottom - top) * fy) * (1.0f / 65535.0f);
+}
+
+void AAPLTerrainQuadtree::updateSamples (uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1)
+{
+    const uint32_t stride = (1u << _latticeLog2) + 1;
+    for (uint32_t j = j0; j <= j1; j++)
+        for (uint32_t i = i0; i <= i1; i++)
+            _samples[(size_t)j * stride + i] = sampleHeight (i, j);
+}
+
+// Works out again the errors of the squares with any of lattice points [i0, i1] x [j0, j1] in them. A square's
+//  error is the furthest its edges' midpoints and middle are from where its corners would put them, or the
+//  error of any of the four squares it splits into, whichever is greater.
+void AAPLTerrainQuadtree::updateErrors (uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1)
+{
+    const uint32_t stride = (1u << _latticeLog2) + 1;
+
+    for (uint32_t k = 1; k <= _latticeLog2; k++)
+    {
+        const uint32_t side = 1u << (_latticeLog2 - k);
+        const uint32_t step = 1u << k, half = step / 2;
+
+        // A lattice point is a corner of the squares either side of it
+        const uint32_t cx0 = i0 > 0 ? (i0 - 1) >> k : 0, cx1 = std::min (i1 >> k, side - 1);
+        const uint32_t cy0 = j0 > 0 ? (j0 - 1) >> k : 0, cy1 = std::min (j1 >> k, side - 1);
+
+        std::vector<float>& errors = _errors[k][0];
+        for (uint32_t cy = cy0; cy <= cy1; cy++)
+        {
+            for (uint32_t cx = cx0; cx <= cx1; cx++)
+            {
+                const float* s = &_samples[(size_t)cy * step * stride + cx * step];
+                const float c00 = s[0], c10 = s[step], c01 = s[step * stride], c11 = s[step * stride + step];
+                const float middle = s[half * stride + half];
+
+                // The tessellator splits the square along one diagonal or the other
+                float error = std::max (std::abs (middle - (c00 + c11) * 0.5f), std::abs (middle - (c10 + c01) * 0.5f));
+                error = std::max (error, std::abs (s[half] - (c00 + c10) * 0.5f));
+                error = std::max (error, std::abs (s[step * stride + half] - (c01 + c11) * 0.5f));
+                error = std::max (error, std::abs (s[half * stride] - (c00 + c01) * 0.5f));
+                error = std::max (error, std::abs (s[half * stride + step] - (c10 + c11) * 0.5f));
+
+                if (k > 1)
+                {
+                    const std::vector<float>& finer = _errors[k - 1][0];
+                    const size_t f = (size_t)2 * cy * (2 * side) + 2 * cx;
+                    error = std::max (error, std::max (std::max (finer[f], finer[f + 1]),
+                                                       std::max (finer[f + 2 * side], finer[f + 2 * side + 1])));
+                }
+                errors[(size_t)cy * side + cx] = error;
+            }
+        }
+
+        // The same errors, over squares of up to 1 << kMaxFactorLog2 squares each way
+        for (uint32_t m = 1; m < _errors[k].size (); m++)
+        {
+            const uint32_t levelSide = side >> m;
+            const std::vector<float>& src = _errors[k][m - 1];
+            std::vector<float>& dst = _errors[k][m];
+            for (uint32_t y = cy0 >> m; y <= cy1 >> m; y++)
+            {
+                for (uint32_t x = cx0 >> m; x <= cx1 >> m; x++)
+                {
+                    const size_t f = (size_t)2 * y * (2 * levelSide) + 2 * x;
+                    dst[(size_t)y * levelSide + x] = std::max (std::max (src[f], src[f + 1]),
+                                                               std::max (src[f + 2 * levelSide], src[f + 2 * levelSide + 1]));
+                }
+            }
+        }
+    }
+}
+
+float AAPLTerrainQuadtree::nodeError (uint32_t depth, uint32_t x, uint32_t y, uint32_t factorLog2) const
+{
+    // The patch's vertices are 1 << k lattice steps apart
+    const uint32_t k = _latticeLog2 - depth - factorLog2;
+    if (k == 0) return 0.0f;
+    return _errors[k][factorLog2][(size_t)y * (1u << depth) + x];
+}
+
+// Whether any of the box from boxMin to boxMax is on the inner side of all six planes
+static bool BoxInFrustum (const simd::float4* planes, simd::float3 boxMin, simd::float3 boxMax)
+{
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        // The corner furthest along the plane's normal
+        const float x = planes[i].x > 0 ? boxMax.x : boxMin.x;
+        const float y = planes[i].y > 0 ? boxMax.y : boxMin.y;
+        const float z = planes[i].z > 0 ? boxMax.z : boxMin.z;
+        if (planes[i].x * x + planes[i].y * y + planes[i].z * z + planes[i].w < 0) return false;
+    }
+    return true;
+}
+
+static float BoxDistance (simd::float3 p, simd::float3 boxMin, simd::float3 boxMax)
+{
+    const float dx = std::max (std::max (boxMin.x - p.x, p.x - boxMax.x), 0.0f);
+    const float dy = std::max (std::max (boxMin.y - p.y, p.y - boxMax.y), 0.0f);
+    const float dz = std::max (std::max (boxMin.z - p.z, p.z - boxMax.z), 0.0f);
+    return sqrtf (dx * dx + dy * dy + dz * dz);
+}
+
+AAPLTerrainQuadtree::Leaf AAPLTerrainQuadtree::makeLeaf (uint32_t depth, uint32_t x, uint32_t y,
+                                                        const AAPLTerrainQuadtreeView& view, bool& outWantsSplit)
+{
+    _stats.visitedNodes++;
+    Leaf leaf = { depth, x, y, 0, view.frustumCount == 0 };
+    uint8_t& state = _nodeStates[depth][(size_t)y * (1u << depth) + x];
+
+    simd::float3 boxMin, boxMax;
+    _bounds.patchBounds (x, y, 1u << depth, boxMin, boxMax);
+    for (uint32_t i = 0; i < view.frustumCount && !leaf.visible; i++)
+        leaf.visible = BoxInFrustum (view.frustumPlanes + 6 * i, boxMin, boxMax);
+
+    outWantsSplit = false;
+    if (!leaf.visible)
+    {
+        state = 0;
+        return leaf;
+    }
+
+    // Pixels an R16Unorm height of 1 spans at the node's nearest point
+    const float pixelsPerHeight = TERRAIN_HEIGHT * view.pixelsPerUnit
+                                / std::max (BoxDistance (view.cameraPosition, boxMin, boxMax), 1e-3f);
+    const float maxError = view.maxScreenError / pixelsPerHeight;
+    const float comfortableError = maxError * (1.0f - view.hysteresis);
+
+    if (depth < _maxDepth && nodeError (depth, x, y, kMaxFactorLog2) > ((state & kNodeSplit) ? comfortableError : maxError))
+    {
+        state = kNodeSplit;
+        outWantsSplit = true;
+        return leaf;
+    }
+
+    // Errors only shrink as the factor grows. Take the factor from last frame if it is still fine enough and
+    //  not comfortably finer than needed, or else the nearest that is.
+    uint32_t finest = 0, coarsest = 0;
+    while (finest < kMaxFactorLog2 && nodeError (depth, x, y, finest) > maxError) finest++;
+    while (coarsest < kMaxFactorLog2 && nodeError (depth, x, y, coarsest) > comfortableError) coarsest++;
+
+    const uint32_t previous = (state & kNodeFactorMask) ? (uint32_t)(state & kNodeFactorMask) - 1 : finest;
+    leaf.factorLog2 = std::min (std::max (previous, finest), coarsest);
+    state = (uint8_t)(leaf.factorLog2 + 1);
+    return leaf;
+}
+
+void AAPLTerrainQuadtree::selectNode (uint32_t depth, uint32_t x, uint32_t y, const AAPLTerrainQuadtreeView& view)
+{
+    bool wantsSplit;
+    const Leaf leaf = makeLeaf (depth, x, y, view, wantsSplit);
+    if (!wantsSplit)
+    {
+        _leaves.push_back (leaf);
+        return;
+    }
+
+    for (uint32_t child = 0; child < 4; child++)
+        selectNode (depth + 1, 2 * x + (child & 1), 2 * y + (child >> 1), view);
+}
+
+void AAPLTerrainQuadtree::paintLeaf (uint32_t leafIndex)
+{
+    const Leaf& leaf = _leaves[leafIndex];
+    const uint32_t shift = _maxDepth - leaf.depth, cells = 1u << _maxDepth;
+    for (uint32_t y = leaf.y << shift; y < (leaf.y + 1) << shift; y++)
+        for (uint32_t x = leaf.x << shift; x < (leaf.x + 1) << shift; x++)
+            _leafCells[(size_t)y * cells + x] = leafIndex;
+}
+
+const AAPLTerrainQuadtree::Leaf* AAPLTerrainQuadtree::leafAtCell (int32_t cellX, int32_t cellY) const
+{
+    const int32_t cells = 1 << _maxDepth;
+    if (cellX < 0 || cellY < 0 || cellX >= cells || cellY >= cells) return nullptr;
+    return &_leaves[_leafCells[(size_t)cellY * cells + cellX]];
+}
+
+// Splits leaves until none has a neighbor more than one depth deeper, so the edge of every leaf meets either one
+//  leaf's edge, or half of one, or two leaves' edges
+void AAPLTerrainQuadtree::balance (const AAPLTerrainQuadtreeView& view)
+{
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (size_t i = 0; i < _leaves.size (); i++)
+        {
+            const Leaf leaf = _leaves[i];
+            if (leaf.depth + 1 >= _maxDepth) continue;
+
+            const uint32_t shift = _maxDepth - leaf.depth;
+            const int32_t size = 1 << shift;
+            const int32_t x0 = (int32_t)(leaf.x << shift), y0 = (int32_t)(leaf.y << shift);
+
+            uint32_t deepest = 0;
+            for (int32_t t = 0; t < size; t++)
+            {
+                const Leaf* neighbors[4] = { leafAtCell (x0 - 1, y0 + t), leafAtCell (x0 + t, y0 - 1),
+                                             leafAtCell (x0 + size, y0 + t), leafAtCell (x0 + t, y0 + size) };
+                for (const Leaf* neighbor : neighbors)
+                    if (neighbor) deepest = std::max (deepest, neighbor->depth);
+            }
+            if (deepest <= leaf.depth + 1) continue;
+
+            for (uint32_t child = 0; child < 4; child++)
+            {
+                bool wantsSplit;
+                const Leaf childLeaf = makeLeaf (leaf.depth + 1, 2 * leaf.x + (child & 1), 2 * leaf.y + (child >> 1),
+                                                 view, wantsSplit);
+                const size_t index = (child == 0) ? i : _leaves.size ();
+                if (child == 0) _leaves[i] = childLeaf;
+                else            _leaves.push_back (childLeaf);
+                paintLeaf ((uint32_t)index);
+            }
+            _stats.balanceSplits++;
+            changed = true;
+        }
+    }
+}
+
+// The factor of one of a leaf's edges, 0 to 3 as in AAPLTerrainPatchFactors. Leaves of the same depth use the finer
+//  of their two factors. Where a leaf meets two of the next depth, its edge takes twice the finest of theirs, and
+//  theirs half of that, so their vertices fall on its vertices.
+uint32_t AAPLTerrainQuadtree::edgeFactorLog2 (const Leaf& leaf, uint32_t edge) const
+{
+    const uint32_t shift = _maxDepth - leaf.depth;
+    const int32_t size = 1 << shift;
+    const int32_t x0 = (int32_t)(leaf.x << shift), y0 = (int32_t)(leaf.y << shift);
+    const bool alongY = (edge % 2) == 0;
+
+    // The cell just outside the start of the edge
+    const int32_t outsideX = (edge == 0) ? x0 - 1 : (edge == 2) ? x0 + size : x0;
+    const int32_t outsideY = (edge == 1) ? y0 - 1 : (edge == 3) ? y0 + size : y0;
+
+    const Leaf* neighbor = leafAtCell (outsideX, outsideY);
+    if (neighbor == nullptr) return leaf.factorLog2;
+
+    if (neighbor->depth == leaf.depth)
+        return std::max (leaf.factorLog2, neighbor->factorLog2);
+
+    if (neighbor->depth == leaf.depth + 1)
+    {
+        const Leaf* other = alongY ? leafAtCell (outsideX, outsideY + size / 2) : leafAtCell (outsideX + size / 2, outsideY);
+        return std::min (kMaxFactorLog2, std::max (leaf.factorLog2, std::max (neighbor->factorLog2, other->factorLog2) + 1));
+    }
+
+    // The neighbor is a depth above, and its edge also runs along this leaf's sibling
+    assert (neighbor->depth + 1 == leaf.depth);
+    const int32_t start = alongY ? y0 : x0;
+    const int32_t neighborStart = (int32_t)((alongY ? neighbor->y : neighbor->x) << (shift + 1));
+    const int32_t siblingStart = (start == neighborStart) ? start + size : neighborStart;
+    const Leaf* sibling = alongY ? leafAtCell (x0, siblingStart) : leafAtCell (siblingStart, y0);
+
+    const uint32_t neighborEdge = std::min (kMaxFactorLog2, std::max (neighbor->factorLog2,
+                                                                      std::max (leaf.factorLog2, sibling->factorLog2) + 1));
+    return neighborEdge - 1;
+}
+
+// A power of two tessellation factor as a half float
+static inline uint16_t HalfFromFactorLog2 (uint32_t factorLog2)
+{
+    return (uint16_t)((15 + factorLog2) << 10);
+}
+
+uint32_t AAPLTerrainQuadtree::select (const AAPLTerrainQuadtreeView& view, uint32_t* outPatchIndices,
+                                      AAPLTerrainPatchFactors* outFactors)
+{
+    _stats = AAPLTerrainQuadtreeStats ();
+    _leaves.clear ();
+
+    selectNode (0, 0, 0, view);
+    for (uint32_t i = 0; i < _leaves.size (); i++)
+        paintLeaf (i);
+    balance (view);
+
+    uint32_t count = 0;
+    for (const Leaf& leaf : _leaves)
+    {
+        if (!leaf.visible) continue;
+
+        outPatchIndices[count] = TerrainQuadtreePatchIndex (leaf.depth, leaf.x, leaf.y);
+        AAPLTerrainPatchFactors& factors = outFactors[count];
+        for (uint32_t edge = 0; edge < 4; edge++)
+            factors.edge[edge] = HalfFromFactorLog2 (edgeFactorLog2 (leaf, edge));
+        factors.inside[0] = factors.inside[1] = HalfFromFactorLog2 (leaf.factorLog2);
+        count++;
+    }
+
+    _stats.leaves = (uint32_t)_leaves.size ();
+    _stats.patches = count;
+    return count;
+}
@@ -0,0 +1,126 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLTerrainQuadtree class, which picks the patches the terrain is drawn with each frame, as the
+ leaves of a quadtree over it. A node is split wherever its heights, tessellated as finely as a patch can be, would
+ be off by more than a few pixels on screen, and otherwise gets the lowest tessellation that keeps within that.
+ Neighboring leaves are kept within a depth of each other, and their shared edges given factors that put their
+ vertices in the same places, so no cracks open between them.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AAPLTerrainHeightBounds.h"
+
+// A patch's tessellation factors as the tessellator reads them, laid out as MTLQuadTessellationFactorsHalf
+struct AAPLTerrainPatchFactors
+{
+    uint16_t        edge[4];        // half floats for the edges at x = 0, y = 0, x = 1 and y = 1 of the patch
+    uint16_t        inside[2];      // and for its inside, along x and along y
+};
+
+struct AAPLTerrainQuadtreeView
+{
+    simd::float3        cameraPosition;
+    float               pixelsPerUnit;      // pixels a world unit spans at a world unit from the camera
+    float               maxScreenError;     // pixels the drawn heights may be off by
+
+    // Once a node is split, or tessellated more finely, it stays so until its error is this fraction under
+    //  maxScreenError, so the patches don't flicker between two choices as the camera hovers around one
+    float               hysteresis;
+
+    // frustumCount sets of six planes, facing in. Patches none of them can see aren't drawn.
+    const simd::float4* frustumPlanes;
+    uint32_t            frustumCount;
+};
+
+struct AAPLTerrainQuadtreeStats
+{
+    uint32_t        visitedNodes;
+    uint32_t        leaves;
+    uint32_t        balanceSplits;      // leaves split to keep them within a depth of their neighbors
+    uint32_t        patches;
+};
+
+class AAPLTerrainQuadtree
+{
+public:
+    // heights is width x height R16Unorm texels, row by row. It is read in place, so it must outlive the quadtree.
+    //  Call build to work out the errors and bounds of the nodes before selecting any patches.
+    AAPLTerrainQuadtree (const uint16_t* heights, uint32_t width, uint32_t height);
+
+    void                    build ();
+
+    // Works out again the errors and bounds of the nodes over the heights a brush stroke has changed, as given by
+    //  the passes TerrainFillRebakePasses filled in for it
+    void                    update (const TerrainRebakePass* passes);
+
+    // Picks the patches to draw the terrain with from a view, writing up to maxPatchCount () of them, and returns
+    //  how many it wrote
+    uint32_t                select (const AAPLTerrainQuadtreeView& view, uint32_t* outPatchIndices,
+                                    AAPLTerrainPatchFactors* outFactors);
+
+    // The deepest the quadtree goes: far enough that a patch of the deepest nodes at its finest tessellation has a
+    //  vertex for each texel of the heightmap
+    uint32_t                maxDepth () const       { return _maxDepth; }
+    uint32_t                maxPatchCount () const  { return 1u << (2 * _maxDepth); }
+
+    // How far off, as an R16Unorm height, a node's heights are at a tessellation factor of 1 << factorLog2
+    float                   nodeError (uint32_t depth, uint32_t x, uint32_t y, uint32_t factorLog2) const;
+
+    const AAPLTerrainHeightBounds&  heightBounds () const   { return _bounds; }
+    const AAPLTerrainQuadtreeStats& stats () const          { return _stats; }
+
+    // The finest tessellation factor of a patch, as set on the render pipelines
+    static constexpr uint32_t kMaxFactorLog2 = 4;
+
+private:
+    struct Leaf
+    {
+        uint32_t    depth;
+        uint32_t    x;
+        uint32_t    y;
+        uint32_t    factorLog2;
+        bool        visible;
+    };
+
+    float           sampleHeight (uint32_t i, uint32_t j) const;
+    void            updateSamples (uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1);
+    void            updateErrors (uint32_t i0, uint32_t j0, uint32_t i1, uint32_t j1);
+
+    void            selectNode (uint32_t depth, uint32_t x, uint32_t y, const AAPLTerrainQuadtreeView& view);
+    Leaf            makeLeaf (uint32_t depth, uint32_t x, uint32_t y, const AAPLTerrainQuadtreeView& view,
+                              bool& outWantsSplit);
+    void            paintLeaf (uint32_t leafIndex);
+    const Leaf*     leafAtCell (int32_t cellX, int32_t cellY) const;
+    void            balance (const AAPLTerrainQuadtreeView& view);
+    uint32_t        edgeFactorLog2 (const Leaf& leaf, uint32_t edge) const;
+
+    const uint16_t*                                 _heights;
+    uint32_t                                        _width;
+    uint32_t                                        _height;
+    AAPLTerrainHeightBounds                         _bounds;
+
+    // The heights are sampled as the patches' vertices sample them, on a (1 << _latticeLog2) + 1 square lattice
+    //  over the terrain, at least as fine as the heightmap
+    uint32_t                                        _latticeLog2;
+    uint32_t                                        _maxDepth;
+    std::vector<float>                              _samples;
+
+    // _errors[k][m] holds, for each square of 1 << (k + m) lattice steps, how far off its samples are when only
+    //  every (1 << k)th is kept, and the rest linearly interpolated
+    std::vector<std::vector<std::vector<float>>>    _errors;
+
+    // What each node chose last frame: whether it was split, and its tessellation, one byte per node of each depth
+    std::vector<std::vector<uint8_t>>               _nodeStates;
+
+    // The leaves of the current selection, and which covers each cell of a grid of the deepest nodes
+    std::vector<Leaf>                               _leaves;
+    std::vector<uint32_t>                           _leafCells;
+
+    AAPLTerrainQuadtreeStats                        _stats;
+};
@@ -25,11 +25,13 @@ Declaration of the terrain renderer which is responsible for rendering tesselate
 -(simd::float3) terrainWorldBoundsMin;
 
 
+// The allocator's ring buffers hold the patches picked for each frame, and read brush strokes back from the GPU
 -(instancetype) initWithDevice:(id <MTLDevice>) device
-                       library:(id <MTLLibrary>) library;
+                       library:(id <MTLLibrary>) library
+                     allocator:(AAPLAllocator*) allocator;
 
--(void) computeTesselationFactors:(id <MTLCommandBuffer>) commandBuffer
-                   globalUniforms:(const AAPLGpuBuffer<AAPLUniforms>&)globalUniforms;
+// Picks the patches to draw the terrain with this frame, and their tessellation factors, on the CPU
+-(void) selectPatchesWithUniforms:(const AAPLUniforms&) uniforms;
 
 - (void)drawShadowsWithEncoder:(id <MTLRenderCommandEncoder>)renderEncoder
                 globalUniforms:(const AAPLGpuBuffer<AAPLUniforms>&)globalUniforms;
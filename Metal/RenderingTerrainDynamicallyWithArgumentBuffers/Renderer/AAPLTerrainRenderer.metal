@@ -48,17 +48,17 @@ float bounceStep(float i)
 vertex TerrainVertexOut terrain_vertex(uint pid [[patch_id]],
                                        float2 uv [[position_in_patch]],
                                        constant AAPLUniforms& uniforms [[buffer(1)]],
+                                       constant uint32_t* patchNodes [[buffer(2)]],
                                        texture2d<float> height [[texture(0)]],
                                        constant float4x4& depthOnlyMatrix[[buffer(6), function_constant(g_isDepthOnlyPass)]])
 {
     TerrainVertexOut out;
     
-    uint patchY = pid / TERRAIN_PATCHES;
-    uint patchX = pid % TERRAIN_PATCHES;
+    // The quadtree node the patch draws
+    TerrainQuadtreeNode node = TerrainQuadtreeNodeFromPatchIndex(patchNodes[pid]);
+    float nodeSize = 1.0f / float(1u << node.depth);
     
-    float2 patchUV = float2(patchX, patchY) / (TERRAIN_PATCHES);
-    
-    float3 position = float3(patchUV.x + uv.x / TERRAIN_PATCHES, 0, patchUV.y + uv.y / TERRAIN_PATCHES);
+    float3 position = float3((node.x + uv.x) * nodeSize, 0, (node.y + uv.y) * nodeSize);
     
     // Slowly cycle through different height offsets
     float t = GAME_TIME * 0.4;
@@ -291,65 +291,9 @@ fragment GBufferFragOut terrain_fragment (
     return output;
 }
 
-static float tessFactor(float4x4 viewProjectionMatrix, float projectionYScale, float scale, float3 p0, float3 p1) {
-    float3 center = (p0 + p1) * 0.5f;
-    float diameter = distance(p0, p1);
-    
-    float4 clip = viewProjectionMatrix * float4(center, 1.0f);
-    float projectedLength = abs(diameter * projectionYScale / clip.w);
-    
-    return max(scale * projectedLength, 1.0f);
-}
-
-kernel void TerrainKnl_FillInTesselationFactors (device MTLQuadTessellationFactorsHalf* outVisiblePatchesTessFactorBfr [[buffer(0)]],
-                                                 
-                                                 device uint32_t* outVisiblePatchIndices [[buffer(2)]],
-                                                 
-                                                 constant float& tesselationScale [[buffer(3)]],
-                                                 constant AAPLUniforms& uniforms [[buffer(4)]],
-                                                 
-                                                 texture2d<float> heightMap [[texture(0)]],
-                                                 
-                                                 uint2 tid [[thread_position_in_grid]])
-{
-    float2 u00 = float2((tid.x + 0.f) / TERRAIN_PATCHES, (tid.y + 0.f) / TERRAIN_PATCHES);
-    float2 u01 = float2((tid.x + 0.f) / TERRAIN_PATCHES, (tid.y + 1.f) / TERRAIN_PATCHES);
-    float2 u10 = float2((tid.x + 1.f) / TERRAIN_PATCHES, (tid.y + 0.f) / TERRAIN_PATCHES);
-    float2 u11 = float2((tid.x + 1.f) / TERRAIN_PATCHES, (tid.y + 1.f) / TERRAIN_PATCHES);
-    
-    float3 p00 = float3((u00.x - 0.5f) * TERRAIN_SCALE, 0, (u00.y - 0.5f) * TERRAIN_SCALE);
-    float3 p01 = float3((u01.x - 0.5f) * TERRAIN_SCALE, 0, (u01.y - 0.5f) * TERRAIN_SCALE);
-    float3 p10 = float3((u10.x - 0.5f) * TERRAIN_SCALE, 0, (u10.y - 0.5f) * TERRAIN_SCALE);
-    float3 p11 = float3((u11.x - 0.5f) * TERRAIN_SCALE, 0, (u11.y - 0.5f) * TERRAIN_SCALE);
-    
-    {
-        const uint patchID = tid.x + tid.y * TERRAIN_PATCHES;
-        outVisiblePatchIndices [patchID] = patchID;
-        
-        constexpr sampler sam(min_filter::linear, mag_filter::linear, mip_filter::none, address::clamp_to_edge);
-        
-        p00.y = heightMap.sample(sam, u00).r * TERRAIN_HEIGHT;
-        p01.y = heightMap.sample(sam, u01).r * TERRAIN_HEIGHT;
-        p10.y = heightMap.sample(sam, u10).r * TERRAIN_HEIGHT;
-        p11.y = heightMap.sample(sam, u11).r * TERRAIN_HEIGHT;
-        
-        float e0 = tessFactor(uniforms.cameraUniforms.viewProjectionMatrix, uniforms.projectionYScale, tesselationScale, p00, p01);
-        float e1 = tessFactor(uniforms.cameraUniforms.viewProjectionMatrix, uniforms.projectionYScale, tesselationScale, p00, p10);
-        float e2 = tessFactor(uniforms.cameraUniforms.viewProjectionMatrix, uniforms.projectionYScale, tesselationScale, p10, p11);
-        float e3 = tessFactor(uniforms.cameraUniforms.viewProjectionMatrix, uniforms.projectionYScale, tesselationScale, p01, p11);
-        
-        outVisiblePatchesTessFactorBfr[patchID].edgeTessellationFactor[0] = e0;
-        outVisiblePatchesTessFactorBfr[patchID].edgeTessellationFactor[1] = e1;
-        outVisiblePatchesTessFactorBfr[patchID].edgeTessellationFactor[2] = e2;
-        outVisiblePatchesTessFactorBfr[patchID].edgeTessellationFactor[3] = e3;
-        
-        outVisiblePatchesTessFactorBfr[patchID].insideTessellationFactor[0] = (e1 + e3) * 0.5f;
-        outVisiblePatchesTessFactorBfr[patchID].insideTessellationFactor[1] = (e0 + e2) * 0.5f;
-    }
-}
-
 kernel void TerrainKnl_ComputeNormalsFromHeightmap(texture2d<float> height [[texture(0)]],
                                                    texture2d<float, access::write> normal [[texture(1)]],
+                                                   device const TerrainRebakePass& pass [[buffer(0)]],
                                                    uint2 tid [[thread_position_in_grid]])
 {
     constexpr sampler sam(min_filter::nearest, mag_filter::nearest, mip_filter::none,
@@ -358,12 +302,15 @@ kernel void TerrainKnl_ComputeNormalsFromHeightmap(texture2d<float> height [[tex
     float xz_scale = TERRAIN_SCALE / height.get_width();
     float y_scale = TERRAIN_HEIGHT;
     
-    if (tid.x < height.get_width() && tid.y < height.get_height()) {
-        float h_up     = height.sample(sam, (float2)(tid + uint2(0, 1))).r;
-        float h_down   = height.sample(sam, (float2)(tid - uint2(0, 1))).r;
-        float h_right  = height.sample(sam, (float2)(tid + uint2(1, 0))).r;
-        float h_left   = height.sample(sam, (float2)(tid - uint2(1, 0))).r;
-        float h_center = height.sample(sam, (float2)(tid + uint2(0, 0))).r;
+    tid += pass.origin;
+    if (all(tid < pass.end)) {
+        // Signed, so the neighbours of the first row and column clamp to the edge rather than wrap around to the last
+        int2 coord = int2(tid);
+        float h_up     = height.sample(sam, (float2)(coord + int2(0, 1))).r;
+        float h_down   = height.sample(sam, (float2)(coord - int2(0, 1))).r;
+        float h_right  = height.sample(sam, (float2)(coord + int2(1, 0))).r;
+        float h_left   = height.sample(sam, (float2)(coord - int2(1, 0))).r;
+        float h_center = height.sample(sam, (float2)(coord + int2(0, 0))).r;
         
         float3 v_up    = float3( 0,        (h_up    - h_center) * y_scale,  xz_scale);
         float3 v_down  = float3( 0,        (h_down  - h_center) * y_scale, -xz_scale);
@@ -381,16 +328,45 @@ kernel void TerrainKnl_ComputeNormalsFromHeightmap(texture2d<float> height [[tex
     }
 }
 
+// The lowest and highest heights of heightmap texels [origin, end), looked up in the height bounds. Level n of the
+//  height bounds is mip level n - 1 of the texture, and a heightmap texel is under texel x >> n of it, or under the
+//  last one where that is past the end.
+static float2 lookUpHeightBounds(texture2d<float> heightBounds, uint2 origin, uint2 end)
+{
+    const uint levelCount = heightBounds.get_num_mip_levels() + 1;
+    const uint level = TerrainHeightBoundsQueryLevel(origin.x, origin.y, end.x - 1, end.y - 1, levelCount);
+    const uint2 last = uint2(heightBounds.get_width(level - 1), heightBounds.get_height(level - 1)) - 1;
+    
+    const uint2 from = min(origin >> level, last);
+    const uint2 to = min((end - 1) >> level, last);
+    
+    float2 bounds = float2(1, 0);
+    for (uint y = from.y; y <= to.y; y++)
+    {
+        for (uint x = from.x; x <= to.x; x++)
+        {
+            float2 texel = heightBounds.read(uint2(x, y), level - 1).rg;
+            bounds = float2(min(bounds.x, texel.x), max(bounds.y, texel.y));
+        }
+    }
+    return bounds;
+}
+
 kernel void TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap (texture2d<float> height [[texture(0)]],
                                                               texture2d<float, access::read_write> propTexture [[texture(1)]],
+                                                              texture2d<float> heightBounds [[texture(2)]],
                                                               constant float2 *aoSamples [[buffer(0)]],
                                                               constant int & aoSampleCount [[buffer(1)]],
                                                               constant float2 &invSize [[buffer(2)]],
+                                                              device const TerrainRebakePass& pass [[buffer(3)]],
                                                               uint2 tid [[thread_position_in_grid]])
 {
     constexpr sampler sam(min_filter::nearest, mag_filter::nearest, mip_filter::none,
                           address::clamp_to_edge);
     
+    tid += pass.origin;
+    if (any(tid >= pass.end)) return;
+    
     float2 uv_center = ((float2)tid + float2(0.5f, 0.5f)) * invSize;
     float aoVal;
     
@@ -400,15 +376,32 @@ kernel void TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap (texture2d<float> h
         
         int numVisible = 0;
         
-        float2 uv = uv_center;
+        // Every sample lands within the occlusion margins of the texel, so when the heights there are all below
+        //  the center's, which flat ground is, every sample is visible without reading them. The texel itself is
+        //  among them, so there is no such shortcut the other way.
+        TerrainRebakePass disk = TerrainExpandRebakePass(TerrainMakeRebakePass(tid.x, tid.y, tid.x + 1, tid.y + 1, 0,
+                                                                               height.get_width(), height.get_height()),
+                                                         TerrainOcclusionMarginX(),
+                                                         TerrainOcclusionMarginY(height.get_width(), height.get_height()),
+                                                         height.get_width(), height.get_height());
+        float2 bounds = lookUpHeightBounds(heightBounds, disk.origin, disk.end);
         
-        for (int i = 0; i < aoSampleCount; i++) {
-            float2 v = aoSamples[i];
-            
-            float h = height.sample(sam, uv + v / height.get_width()).r;
+        if (bounds.y < h_center)
+        {
+            numVisible = aoSampleCount;
+        }
+        else
+        {
+            float2 uv = uv_center;
             
-            if (h < h_center)
-                numVisible++;
+            for (int i = 0; i < aoSampleCount; i++) {
+                float2 v = aoSamples[i];
+                
+                float h = height.sample(sam, uv + v / height.get_width()).r;
+                
+                if (h < h_center)
+                    numVisible++;
+            }
         }
         
         aoVal = (float)numVisible / (float)aoSampleCount;
@@ -454,11 +447,88 @@ kernel void TerrainKnl_ClearTexture(texture2d<float, access::write> tex,
 kernel void TerrainKnl_UpdateHeightmap (    texture2d<float, access::read_write> heightMap   [[texture(0)]],
                                             uint2 tid                                        [[thread_position_in_grid]],
                                             constant float4 &mousePosition                   [[buffer(0)]],
-                                            constant AAPLUniforms& globalUniforms            [[buffer(1)]])
+                                            constant AAPLUniforms& globalUniforms            [[buffer(1)]],
+                                            device const TerrainRebakePass& pass             [[buffer(2)]])
 {
+    tid += pass.origin;
+    if (any(tid >= pass.end)) return;
+    
     float2 world_xz = (float2(tid) / float2(heightMap.get_width(), heightMap.get_width()) - .5f) * TERRAIN_SCALE;
     float displacement = evaluateModificationBrush(world_xz, mousePosition, globalUniforms.brushSize) * 0.008f;
     if (globalUniforms.mouseState.z == 2) displacement *= -1.0;
     float h = heightMap.read(tid).r;
     heightMap.write(h+displacement, tid);
 }
+
+// Works out which texels a brush stroke touches, as the passes that rebake them. Run on a single thread.
+kernel void TerrainKnl_ComputeBrushRebakePasses (device TerrainRebakePass* outPasses       [[buffer(0)]],
+                                                 constant float4 &mousePosition            [[buffer(1)]],
+                                                 constant AAPLUniforms& globalUniforms     [[buffer(2)]],
+                                                 constant uint &mipCount                   [[buffer(3)]],
+                                                 texture2d<float> heightMap                [[texture(0)]])
+{
+    uint width = heightMap.get_width();
+    uint height = heightMap.get_height();
+    
+    TerrainRebakePass heights = TerrainBrushRebakePass(mousePosition.x, mousePosition.z, globalUniforms.brushSize, width, height);
+    TerrainFillRebakePasses(outPasses, heights, width, height, mipCount);
+}
+
+// Copies the pass's texels of the heightmap into a buffer laid out as the heightmap, row by row, for the CPU to read
+//  back. The rest of the buffer keeps what it had.
+kernel void TerrainKnl_CopyHeightsToBuffer (texture2d<float> heightMap                [[texture(0)]],
+                                            device uint16_t* heights                  [[buffer(0)]],
+                                            device const TerrainRebakePass& pass      [[buffer(1)]],
+                                            uint2 tid                                 [[thread_position_in_grid]])
+{
+    tid += pass.origin;
+    if (any(tid >= pass.end)) return;
+    
+    heights[tid.y * heightMap.get_width() + tid.x] = (uint16_t)rint(heightMap.read(tid).r * 65535.0f);
+}
+
+// Works out the lowest and highest height under each of the pass's texels of a level of the height bounds, from the
+//  level above it. The first level is worked out from the heightmap, whose texels are both their lowest and highest.
+kernel void TerrainKnl_DownsampleHeightBounds (texture2d<float> src                     [[texture(0)]],
+                                               texture2d<float, access::write> dst      [[texture(1)]],
+                                               device const TerrainRebakePass& pass     [[buffer(0)]],
+                                               constant bool& srcIsHeightmap            [[buffer(1)]],
+                                               uint2 tid                                [[thread_position_in_grid]])
+{
+    tid += pass.origin;
+    if (any(tid >= pass.end)) return;
+    
+    // The last row and column also take in the row and column an odd sized level has left over
+    uint2 srcLast = uint2(src.get_width(), src.get_height()) - 1;
+    uint2 dstLast = uint2(dst.get_width(), dst.get_height()) - 1;
+    uint2 from = min(tid * 2, srcLast);
+    uint2 to = select(min(tid * 2 + 1, srcLast), srcLast, tid == dstLast);
+    
+    float2 bounds = float2(1, 0);
+    for (uint y = from.y; y <= to.y; y++)
+    {
+        for (uint x = from.x; x <= to.x; x++)
+        {
+            float4 texel = src.read(uint2(x, y));
+            float2 range = srcIsHeightmap ? texel.rr : texel.rg;
+            bounds = float2(min(bounds.x, range.x), max(bounds.y, range.y));
+        }
+    }
+    dst.write(float4(bounds, 0, 0), tid);
+}
+
+// Box filters the pass's texels of a mip level from the level above it
+kernel void TerrainKnl_DownsampleMip (texture2d<float> src                     [[texture(0)]],
+                                      texture2d<float, access::write> dst      [[texture(1)]],
+                                      device const TerrainRebakePass& pass     [[buffer(0)]],
+                                      uint2 tid                                [[thread_position_in_grid]])
+{
+    tid += pass.origin;
+    if (any(tid >= pass.end)) return;
+    
+    uint2 last = uint2(src.get_width(), src.get_height()) - 1;
+    uint2 s = tid * 2;
+    float4 sum = src.read(min(s, last)) + src.read(min(s + uint2(1, 0), last))
+               + src.read(min(s + uint2(0, 1), last)) + src.read(min(s + uint2(1, 1), last));
+    dst.write(sum * 0.25f, tid);
+}
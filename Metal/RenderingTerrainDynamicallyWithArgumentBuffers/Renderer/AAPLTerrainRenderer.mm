@@ -5,14 +5,17 @@ Abstract:
 Implementation of the terrain renderer which is responsible for rendering tesselated terrain patches.
 */
 
-#import <stdlib.h>      // for random()
-
 #import "TargetConditionals.h"
 #import <type_traits>
+#import <algorithm>
 #import <array>
+#import <memory>
+#import <vector>
 
 #import "AAPLTerrainRenderer.h"
 #import "AAPLTerrainRenderer_shared.h"
+#import "AAPLTerrainBaker.h"
+#import "AAPLTerrainQuadtree.h"
 #import "AAPLParticleRenderer.h"
 #import "AAPLBufferFormats.h"
 #import "AAPLAllocator.h"
@@ -71,10 +74,32 @@ static std::array <HabitatTextures, 4> CreateTerrainTextures (id<MTLDevice> devi
     id <MTLTexture> _terrainPropertiesMap;
     id <MTLTexture> _targetHeightmap;
     
-    // Tesselation data
-    id <MTLBuffer> _visiblePatchesTessFactorBfr;
-    id <MTLBuffer> _visiblePatchIndicesBfr;
-    float _tessellationScale;
+    // Single level views of the normal and properties maps, for filling in their mips
+    NSArray <id <MTLTexture>>* _terrainNormalMapLevels;
+    NSArray <id <MTLTexture>>* _terrainPropertiesMapLevels;
+    
+    // The lowest and highest heights under each texel of the heightmap's mip levels from 1 down, in r and g, and
+    //  single level views of it. The occlusion bake looks them up to skip its samples on flat ground.
+    id <MTLTexture> _terrainHeightBounds;
+    NSArray <id <MTLTexture>>* _terrainHeightBoundsLevels;
+    
+    // Rebake passes (see TerrainRebakePass) over the whole terrain, and over what the current brush stroke touches
+    id <MTLBuffer> _fullRebakePasses;
+    id <MTLBuffer> _brushRebakePasses;
+    
+    // The quadtree that picks the patches to draw each frame, over a CPU copy of the heightmap. Brush strokes are
+    //  read back into the frame's ring buffers, and reach the copy when those come round again, once the GPU has
+    //  finished with them.
+    std::vector <uint16_t> _heightsCpu;
+    std::unique_ptr <AAPLTerrainQuadtree> _quadtree;
+    AAPLGpuBuffer <uint16_t> _strokeHeightsReadback;
+    AAPLGpuBuffer <TerrainRebakePass> _strokePassesReadback;
+    
+    // Tesselation data, as picked by the quadtree for the frame: the node each patch draws, and its factors
+    AAPLGpuBuffer <AAPLTerrainPatchFactors> _visiblePatchesTessFactorBfr;
+    AAPLGpuBuffer <uint32_t> _visiblePatchIndicesBfr;
+    uint32_t _visiblePatchCount;
+    float _maxScreenError;
     
     // Render pipelines
     id <MTLRenderPipelineState> _pplRnd_TerrainMainView;
@@ -82,11 +107,14 @@ static std::array <HabitatTextures, 4> CreateTerrainTextures (id<MTLDevice> devi
     id <MTLRenderPipelineState> _pplRnd_TerrainShadow;
     
     // Compute pipelines
-    id <MTLComputePipelineState> _pplCmp_FillInTesselationFactors;
     id <MTLComputePipelineState> _pplCmp_BakeNormalsMips;
     id <MTLComputePipelineState> _pplCmp_BakePropertiesMips;
     id <MTLComputePipelineState> _pplCmp_ClearTexture;
-    id <MTLComputePipelineState> _pplCmp_UpdateHeightmap;;
+    id <MTLComputePipelineState> _pplCmp_UpdateHeightmap;
+    id <MTLComputePipelineState> _pplCmp_ComputeBrushRebakePasses;
+    id <MTLComputePipelineState> _pplCmp_DownsampleMip;
+    id <MTLComputePipelineState> _pplCmp_DownsampleHeightBounds;
+    id <MTLComputePipelineState> _pplCmp_CopyHeightsToBuffer;
 }
 
 -(float3) terrainWorldBoundsMax
@@ -99,40 +127,37 @@ static std::array <HabitatTextures, 4> CreateTerrainTextures (id<MTLDevice> devi
     return (float3) { TERRAIN_SCALE / 2.0f, TERRAIN_HEIGHT, TERRAIN_SCALE / 2.0f};
 }
 
+// Sets up and dispatches one of the passes in a rebake passes buffer, which only covers the texels that pass lists
+static void DispatchRebakePass (id <MTLComputeCommandEncoder> computeEncoder,
+                                id <MTLBuffer> passes,
+                                NSUInteger passIndex,
+                                NSUInteger bufferIndex)
+{
+    const NSUInteger offset = passIndex * sizeof (TerrainRebakePass);
+    [computeEncoder setBuffer:passes offset:offset atIndex:bufferIndex];
+    [computeEncoder dispatchThreadgroupsWithIndirectBuffer:passes
+                                      indirectBufferOffset:offset
+                                     threadsPerThreadgroup:MTLSizeMake(TERRAIN_REBAKE_THREADGROUP_SIZE, TERRAIN_REBAKE_THREADGROUP_SIZE, 1)];
+}
+
 -(void) GenerateTerrainNormalMap: (id <MTLCommandBuffer>) commandBuffer
+                          passes: (id <MTLBuffer>) passes
 {
     id <MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
     
-    MTLSize threadsPerThreadgroup = (MTLSize){ 16, 16, 1 };
-    assert (((_terrainHeight.width  / 16)*16) == _terrainHeight.width);
-    assert (((_terrainHeight.height / 16)*16) == _terrainHeight.height);
-    
     [computeEncoder setComputePipelineState:_pplCmp_BakeNormalsMips];
     [computeEncoder setTexture:_terrainHeight atIndex:0];
-    [computeEncoder setTexture:_terrainNormalMap atIndex:1];
-    [computeEncoder dispatchThreads:MTLSizeMake(_terrainHeight.width, _terrainHeight.height, 1) threadsPerThreadgroup:threadsPerThreadgroup];
+    [computeEncoder setTexture:_terrainNormalMapLevels[0] atIndex:1];
+    DispatchRebakePass (computeEncoder, passes, TerrainRebakePassNormals, 0);
     [computeEncoder endEncoding];
 }
 
 -(void) GenerateTerrainPropertiesMap: (id <MTLCommandBuffer>) commandBuffer
+                              passes: (id <MTLBuffer>) passes
 {
     auto GenerateSamplesBuffer = [] (id<MTLDevice> device, int numSamples)
     {
-        std::vector <float2> res;
-        
-        srandom(12345);
-        const float sampleRadius = 32.0f;
-        
-        for (int i = 0; i < numSamples; i++)
-        {
-            float u = (float)random() / (float)RAND_MAX;
-            float v = (float)random() / (float)RAND_MAX;
-            
-            float r = sqrtf(u);
-            float theta = 2.0f * (float)M_PI * v;
-            
-            res.push_back ((float2) {cosf(theta), sinf(theta)} * r * sampleRadius);
-        }
+        std::vector <float2> res = TerrainAOSampleDisk (numSamples);
         
         id<MTLBuffer> buffer = [device newBufferWithBytes:res.data()
                                                    length:res.size()*sizeof(res[0])
@@ -150,16 +175,58 @@ static std::array <HabitatTextures, 4> CreateTerrainTextures (id<MTLDevice> devi
     
     [computeEncoder setComputePipelineState:_pplCmp_BakePropertiesMips];
     [computeEncoder setTexture:_terrainHeight atIndex:0];
-    [computeEncoder setTexture:_terrainPropertiesMap atIndex:1];
+    [computeEncoder setTexture:_terrainPropertiesMapLevels[0] atIndex:1];
+    [computeEncoder setTexture:_terrainHeightBounds atIndex:2];
     [computeEncoder setBuffer:sampleBuffer offset:0 atIndex:0];
     [computeEncoder setBytes:&numSamples length:sizeof(numSamples) atIndex:1];
     
     packed_float2 invSize = {1.f / _terrainHeight.width, 1.f / _terrainHeight.height};
     [computeEncoder setBytes:&invSize length:sizeof(invSize) atIndex:2];
-    [computeEncoder dispatchThreads:{_terrainHeight.width, _terrainHeight.height, 1} threadsPerThreadgroup:{16, 16, 1}];
+    DispatchRebakePass (computeEncoder, passes, TerrainRebakePassProperties, 3);
     [computeEncoder endEncoding];
 }
 
+// Filters the passes' texels of each mip level of the normal and properties maps down from the level above.
+//  This stands in for generateMipmapsForTexture:, which can only refilter whole textures.
+-(void) GenerateTerrainMips: (id <MTLCommandBuffer>) commandBuffer
+                     passes: (id <MTLBuffer>) passes
+{
+    for (NSUInteger level = 1; level < _terrainNormalMapLevels.count; level++)
+    {
+        id <MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
+        [computeEncoder setComputePipelineState:_pplCmp_DownsampleMip];
+        
+        [computeEncoder setTexture:_terrainNormalMapLevels[level - 1] atIndex:0];
+        [computeEncoder setTexture:_terrainNormalMapLevels[level] atIndex:1];
+        DispatchRebakePass (computeEncoder, passes, TerrainRebakePassNormalsMip1 + level - 1, 0);
+        
+        [computeEncoder setTexture:_terrainPropertiesMapLevels[level - 1] atIndex:0];
+        [computeEncoder setTexture:_terrainPropertiesMapLevels[level] atIndex:1];
+        DispatchRebakePass (computeEncoder, passes, TerrainRebakePassPropertiesMip1 + level - 1, 0);
+        
+        [computeEncoder endEncoding];
+    }
+}
+
+// Works out the passes' texels of each level of the height bounds from the level above, starting from the heightmap
+-(void) GenerateTerrainHeightBounds: (id <MTLCommandBuffer>) commandBuffer
+                             passes: (id <MTLBuffer>) passes
+{
+    for (NSUInteger level = 1; level <= _terrainHeightBoundsLevels.count; level++)
+    {
+        id <MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
+        [computeEncoder setComputePipelineState:_pplCmp_DownsampleHeightBounds];
+        
+        const bool srcIsHeightmap = (level == 1);
+        [computeEncoder setTexture:srcIsHeightmap ? _terrainHeight : _terrainHeightBoundsLevels[level - 2] atIndex:0];
+        [computeEncoder setTexture:_terrainHeightBoundsLevels[level - 1] atIndex:1];
+        [computeEncoder setBytes:&srcIsHeightmap length:sizeof(srcIsHeightmap) atIndex:1];
+        DispatchRebakePass (computeEncoder, passes, TerrainRebakePassHeightBoundsMip1 + level - 1, 0);
+        
+        [computeEncoder endEncoding];
+    }
+}
+
 static int IabIndexForHabitatParam (TerrainHabitatType habType, TerrainHabitat_MemberIds memberId)
 {
     return int (TerrainHabitat_MemberIds::COUNT) * habType + int (memberId);
@@ -188,6 +255,7 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
 
 -(instancetype) initWithDevice:(id <MTLDevice>) device
                        library:(id <MTLLibrary>) library
+                     allocator:(AAPLAllocator*) allocator
 {
     self = [super init];
     if (!self) return self;
@@ -195,10 +263,6 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
     _precomputationCompleted = false;
     id <MTLCommandQueue> queue = [device newCommandQueue];
     id <MTLCommandBuffer> commandBuffer = [queue commandBuffer];
-    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> _Nonnull)
-    {
-        self->_precomputationCompleted = true;
-    }];
     
     // Loading the textures used by the terrain
     _terrainTextures = CreateTerrainTextures (device);
@@ -297,11 +361,14 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
     // Create the compute pipelines
     //  - this is needed further along in data initialization
     {
-        _pplCmp_FillInTesselationFactors =          CreateKernelPipeline (device, library, @"TerrainKnl_FillInTesselationFactors");
         _pplCmp_BakePropertiesMips =                CreateKernelPipeline (device, library, @"TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap");
         _pplCmp_BakeNormalsMips =                   CreateKernelPipeline (device, library, @"TerrainKnl_ComputeNormalsFromHeightmap");
         _pplCmp_ClearTexture =                      CreateKernelPipeline (device, library, @"TerrainKnl_ClearTexture");
         _pplCmp_UpdateHeightmap =                   CreateKernelPipeline (device, library, @"TerrainKnl_UpdateHeightmap");
+        _pplCmp_ComputeBrushRebakePasses =          CreateKernelPipeline (device, library, @"TerrainKnl_ComputeBrushRebakePasses", false);
+        _pplCmp_DownsampleMip =                     CreateKernelPipeline (device, library, @"TerrainKnl_DownsampleMip");
+        _pplCmp_DownsampleHeightBounds =            CreateKernelPipeline (device, library, @"TerrainKnl_DownsampleHeightBounds");
+        _pplCmp_CopyHeightsToBuffer =               CreateKernelPipeline (device, library, @"TerrainKnl_CopyHeightsToBuffer");
     }
     
     // Use a height map to define the initial terrain topography
@@ -342,12 +409,53 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
         texDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
         texDesc.mipmapLevelCount = std::log2(MAX(heightMapWidth, heightMapHeight)) + 1;
         texDesc.storageMode = MTLStorageModePrivate;
+        assert (texDesc.mipmapLevelCount <= TERRAIN_MAX_MIP_LEVELS);
         _terrainNormalMap = [device newTextureWithDescriptor:texDesc];
-        [self GenerateTerrainNormalMap:commandBuffer];
         
         texDesc.pixelFormat = MTLPixelFormatRGBA8Unorm;
         _terrainPropertiesMap = [device newTextureWithDescriptor:texDesc];
         
+        auto LevelViews = [] (id <MTLTexture> texture)
+        {
+            NSMutableArray <id <MTLTexture>>* levels = [NSMutableArray arrayWithCapacity:texture.mipmapLevelCount];
+            for (NSUInteger level = 0; level < texture.mipmapLevelCount; level++)
+            {
+                [levels addObject:[texture newTextureViewWithPixelFormat:texture.pixelFormat
+                                                             textureType:MTLTextureType2D
+                                                                  levels:NSMakeRange(level, 1)
+                                                                  slices:NSMakeRange(0, 1)]];
+            }
+            return levels;
+        };
+        _terrainNormalMapLevels = LevelViews (_terrainNormalMap);
+        _terrainPropertiesMapLevels = LevelViews (_terrainPropertiesMap);
+        
+        // The height bounds' levels line up with the heightmap's from level 1 down
+        assert (texDesc.mipmapLevelCount > 1);
+        texDesc.width = MAX(heightMapWidth / 2, 1);
+        texDesc.height = MAX(heightMapHeight / 2, 1);
+        texDesc.mipmapLevelCount--;
+        texDesc.pixelFormat = MTLPixelFormatRG16Unorm;
+        _terrainHeightBounds = [device newTextureWithDescriptor:texDesc];
+        _terrainHeightBoundsLevels = LevelViews (_terrainHeightBounds);
+        
+        // The full bake goes through the same passes as brush strokes, so a stroke rebakes its texels exactly as
+        //  a full bake would
+        _fullRebakePasses = [device newBufferWithLength:sizeof(TerrainRebakePass) * TerrainRebakePassCOUNT
+                                                options:terrainParamBufferStorage];
+        TerrainFillRebakePasses ((TerrainRebakePass*) _fullRebakePasses.contents,
+                                 TerrainMakeRebakePass (0, 0, (int)heightMapWidth, (int)heightMapHeight, 0,
+                                                        (uint32_t)heightMapWidth, (uint32_t)heightMapHeight),
+                                 (uint32_t)heightMapWidth, (uint32_t)heightMapHeight, (uint32_t)_terrainNormalMap.mipmapLevelCount);
+#if TARGET_OS_OSX
+        [_fullRebakePasses didModifyRange:NSMakeRange(0, [_fullRebakePasses length])];
+#endif
+        _brushRebakePasses = [device newBufferWithLength:sizeof(TerrainRebakePass) * TerrainRebakePassCOUNT
+                                                 options:MTLResourceStorageModePrivate];
+        
+        [self GenerateTerrainHeightBounds:commandBuffer passes:_fullRebakePasses];
+        [self GenerateTerrainNormalMap:commandBuffer passes:_fullRebakePasses];
+        
         // We need to clear the properties map as 'GenerateTerrainPropertiesMap' will only fill in specific color channels
         {
             id <MTLComputeCommandEncoder> encoder = [commandBuffer computeCommandEncoder];
@@ -356,14 +464,8 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
             [encoder dispatchThreads:{heightMapWidth, heightMapHeight, 1} threadsPerThreadgroup:{8, 8, 1}];
             [encoder endEncoding];
         }
-        [self GenerateTerrainPropertiesMap:commandBuffer];
-        
-        {
-            id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
-            [blit generateMipmapsForTexture:_terrainNormalMap];
-            [blit generateMipmapsForTexture:_terrainPropertiesMap];
-            [blit endEncoding];
-        }
+        [self GenerateTerrainPropertiesMap:commandBuffer passes:_fullRebakePasses];
+        [self GenerateTerrainMips:commandBuffer passes:_fullRebakePasses];
     }
     
     // Loading rendering pipelines
@@ -373,10 +475,11 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
         MTLRenderPipelineDescriptor *pipelineStateDescriptor = [[MTLRenderPipelineDescriptor alloc] init];
         pipelineStateDescriptor.sampleCount = BufferFormats::sampleCount;
         pipelineStateDescriptor.tessellationFactorFormat = MTLTessellationFactorFormatHalf;
-        pipelineStateDescriptor.tessellationPartitionMode = MTLTessellationPartitionModeFractionalOdd;
+        // The quadtree gives power of two factors, so that neighboring patches' edge vertices line up
+        pipelineStateDescriptor.tessellationPartitionMode = MTLTessellationPartitionModePow2;
         pipelineStateDescriptor.tessellationFactorStepFunction = MTLTessellationFactorStepFunctionPerPatch;
         pipelineStateDescriptor.tessellationControlPointIndexType = MTLTessellationControlPointIndexTypeNone;
-        pipelineStateDescriptor.maxTessellationFactor = 16;
+        pipelineStateDescriptor.maxTessellationFactor = 1 << AAPLTerrainQuadtree::kMaxFactorLog2;
         
         // Create the regular pipeline. This is used later on
         _iabBufferIndex_PplTerrainMainView = 1;
@@ -433,56 +536,119 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
         if (!_pplRnd_TerrainShadow) { NSLog(@"Failed to create pipeline state, error %@", error); }
     }
     
-    _tessellationScale = 25.0f;
-    _visiblePatchIndicesBfr = [device newBufferWithLength:sizeof(uint32_t) * TERRAIN_PATCHES * TERRAIN_PATCHES
-                                                  options:MTLResourceStorageModePrivate];
+    // Read the heightmap back for the quadtree, which works out its nodes' errors and bounds once it arrives
+    _heightsCpu.resize (heightMapWidth * heightMapHeight);
+    _quadtree.reset (new AAPLTerrainQuadtree (_heightsCpu.data (), (uint32_t)heightMapWidth, (uint32_t)heightMapHeight));
     
-    _visiblePatchesTessFactorBfr = [device newBufferWithLength:sizeof(MTLQuadTessellationFactorsHalf) * TERRAIN_PATCHES * TERRAIN_PATCHES
-                                                       options:MTLResourceStorageModePrivate];
+    id <MTLBuffer> heightsReadback = [device newBufferWithLength:_heightsCpu.size () * sizeof(uint16_t)
+                                                         options:MTLResourceStorageModeShared];
+    {
+        id <MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+        [blit copyFromTexture:_terrainHeight
+                  sourceSlice:0
+                  sourceLevel:0
+                 sourceOrigin:{0,0,0}
+                   sourceSize:MTLSizeMake(heightMapWidth, heightMapHeight, 1)
+                     toBuffer:heightsReadback
+            destinationOffset:0
+       destinationBytesPerRow:heightMapWidth * sizeof(uint16_t)
+     destinationBytesPerImage:heightsReadback.length];
+        [blit endEncoding];
+    }
+    
+    // The ring buffers start out zeroed, which reads as empty passes
+    _strokeHeightsReadback = allocator->allocBuffer <uint16_t> ((uint)_heightsCpu.size ());
+    _strokePassesReadback = allocator->allocBuffer <TerrainRebakePass> (TerrainRebakePassCOUNT);
+    
+    static_assert (sizeof(AAPLTerrainPatchFactors) == sizeof(MTLQuadTessellationFactorsHalf), "");
+    _maxScreenError = 2.0f;
+    _visiblePatchCount = 0;
+    _visiblePatchIndicesBfr = allocator->allocBuffer <uint32_t> (_quadtree->maxPatchCount ());
+    _visiblePatchesTessFactorBfr = allocator->allocBuffer <AAPLTerrainPatchFactors> (_quadtree->maxPatchCount ());
     
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> _Nonnull)
+    {
+        memcpy (self->_heightsCpu.data (), heightsReadback.contents, heightsReadback.length);
+        self->_quadtree->build ();
+        self->_precomputationCompleted = true;
+    }];
     [commandBuffer commit];
 
     return self;
 }
 
--(void) computeTesselationFactors:(id <MTLCommandBuffer>) commandBuffer
-                   globalUniforms:(const AAPLGpuBuffer<AAPLUniforms>&)globalUniforms;
+// Contiguous memory of a ring buffer's current slot
+template <typename T>
+static T* RingBufferContents (const AAPLGpuBuffer<T>& buffer)
 {
-    id <MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
-    
-    [computeEncoder setComputePipelineState:_pplCmp_FillInTesselationFactors];
-    
-    [computeEncoder setBuffer:_visiblePatchesTessFactorBfr offset:0 atIndex:0];
-    [computeEncoder setBuffer:_visiblePatchIndicesBfr offset:0 atIndex:2];
-    [computeEncoder setBytes:&_tessellationScale length:sizeof(float) atIndex:3];
-    [computeEncoder setBuffer:globalUniforms.getBuffer()
-                       offset:globalUniforms.getOffset()
-                      atIndex:4];
+    return (T*) ((uint8_t*) buffer.getBuffer ().contents + buffer.getOffset ());
+}
+
+-(void) selectPatchesWithUniforms:(const AAPLUniforms&) uniforms
+{
+    // The stroke, if any, that the frame that last had these ring buffers made. The GPU has finished that frame.
+    TerrainRebakePass* passes = RingBufferContents (_strokePassesReadback);
+    const TerrainRebakePass& heights = passes[TerrainRebakePassHeights];
+    if (!TerrainRebakePassIsEmpty (heights))
+    {
+        const uint32_t width = _quadtree->heightBounds ().width ();
+        const uint16_t* strokeHeights = RingBufferContents (_strokeHeightsReadback);
+        for (uint32_t y = heights.origin.y; y < heights.end.y; y++)
+        {
+            memcpy (&_heightsCpu[y * width + heights.origin.x],
+                    &strokeHeights[y * width + heights.origin.x],
+                    (heights.end.x - heights.origin.x) * sizeof(uint16_t));
+        }
+        _quadtree->update (passes);
+    }
     
-    [computeEncoder setTexture:_terrainHeight atIndex:0];
+    // Until computeUpdateHeightMap reads a stroke back into them, this frame's buffers hold no stroke
+    TerrainRebakePass noPasses[TerrainRebakePassCOUNT] = {};
+    _strokePassesReadback.fillInWith (noPasses, TerrainRebakePassCOUNT);
     
-    MTLSize threadsPerThreadgroup = { 16, 16, 1 };
-    [computeEncoder dispatchThreadgroups:MTLSizeMake(2, 2, 1) threadsPerThreadgroup:threadsPerThreadgroup];
+    // The shadow pass draws the same patches, so they are culled against the shadow cascades as well
+    float4 frustumPlanes[(NUM_CASCADES + 1) * 6];
+    std::copy (uniforms.cameraUniforms.frustumPlanes, uniforms.cameraUniforms.frustumPlanes + 6, frustumPlanes);
+    for (uint32_t c = 0; c < NUM_CASCADES; c++)
+    {
+        std::copy (uniforms.shadowCameraUniforms[c].frustumPlanes, uniforms.shadowCameraUniforms[c].frustumPlanes + 6,
+                   frustumPlanes + (c + 1) * 6);
+    }
     
-    [computeEncoder endEncoding];
+    AAPLTerrainQuadtreeView view;
+    view.cameraPosition = uniforms.cameraUniforms.invViewMatrix.columns[3].xyz;
+    view.pixelsPerUnit  = uniforms.projectionYScale * 0.5f / uniforms.invScreenSize.y;
+    view.maxScreenError = _maxScreenError;
+    view.hysteresis     = 0.2f;
+    view.frustumPlanes  = frustumPlanes;
+    view.frustumCount   = NUM_CASCADES + 1;
+    
+    _visiblePatchCount = _quadtree->select (view,
+                                            RingBufferContents (_visiblePatchIndicesBfr),
+                                            RingBufferContents (_visiblePatchesTessFactorBfr));
 }
 
 - (void)drawShadowsWithEncoder:(id <MTLRenderCommandEncoder>)renderEncoder
                 globalUniforms:(const AAPLGpuBuffer<AAPLUniforms>&)globalUniforms
 {
+    if (_visiblePatchCount == 0) return;
+    
     [renderEncoder setRenderPipelineState:_pplRnd_TerrainShadow];
     [renderEncoder setDepthBias:0.001 slopeScale:2 clamp:1];
     
-    [renderEncoder setTessellationFactorBuffer:_visiblePatchesTessFactorBfr offset:0 instanceStride:0];
+    [renderEncoder setTessellationFactorBuffer:_visiblePatchesTessFactorBfr.getBuffer ()
+                                        offset:_visiblePatchesTessFactorBfr.getOffset ()
+                                instanceStride:0];
     [renderEncoder setCullMode:MTLCullModeFront];
     
     [renderEncoder setVertexBuffer:globalUniforms.getBuffer() offset:globalUniforms.getOffset() atIndex:1];
+    [renderEncoder setVertexBuffer:_visiblePatchIndicesBfr.getBuffer () offset:_visiblePatchIndicesBfr.getOffset () atIndex:2];
     [renderEncoder setVertexTexture:_terrainHeight atIndex:0];
     
     [renderEncoder drawPatches:4
                     patchStart:0
-                    patchCount:TERRAIN_PATCHES*TERRAIN_PATCHES
-              patchIndexBuffer:_visiblePatchIndicesBfr
+                    patchCount:_visiblePatchCount
+              patchIndexBuffer:nil
         patchIndexBufferOffset:0
                  instanceCount:1
                   baseInstance:0];
@@ -492,6 +658,8 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
 - (void)drawWithEncoder:(id <MTLRenderCommandEncoder>)renderEncoder
          globalUniforms:(const AAPLGpuBuffer<AAPLUniforms>&)globalUniforms
 {
+    if (_visiblePatchCount == 0) return;
+    
     [renderEncoder setRenderPipelineState:_pplRnd_TerrainMainView];
     
     // - Note: depth stencil state is already set by the main renderer
@@ -506,8 +674,11 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
                              usage: MTLResourceUsageSample | MTLResourceUsageRead];
     }
 
-    [renderEncoder setTessellationFactorBuffer:_visiblePatchesTessFactorBfr offset:0 instanceStride:0];
+    [renderEncoder setTessellationFactorBuffer:_visiblePatchesTessFactorBfr.getBuffer ()
+                                        offset:_visiblePatchesTessFactorBfr.getOffset ()
+                                instanceStride:0];
     [renderEncoder setVertexBuffer:globalUniforms.getBuffer() offset:globalUniforms.getOffset() atIndex:1];
+    [renderEncoder setVertexBuffer:_visiblePatchIndicesBfr.getBuffer () offset:_visiblePatchIndicesBfr.getOffset () atIndex:2];
     [renderEncoder setVertexTexture:_terrainHeight atIndex:0];
 
     // Set the argument buffer
@@ -520,8 +691,8 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
     
     [renderEncoder drawPatches:4
                     patchStart:0
-                    patchCount:TERRAIN_PATCHES*TERRAIN_PATCHES
-              patchIndexBuffer:_visiblePatchIndicesBfr
+                    patchCount:_visiblePatchCount
+              patchIndexBuffer:nil
         patchIndexBufferOffset:0
                  instanceCount:1
                   baseInstance:0];
@@ -533,22 +704,49 @@ static void EncodeParam (id <MTLArgumentEncoder> paramsEncoder,
                       mouseBuffer:(id<MTLBuffer>) mouseBuffer
 ;
 {
+    // The brush position is only known on the GPU, so work out there what the stroke touches
     id <MTLComputeCommandEncoder> computeEncoder = [commandBuffer computeCommandEncoder];
     
+    const uint32_t mipCount = (uint32_t)_terrainNormalMap.mipmapLevelCount;
+    [computeEncoder setComputePipelineState:_pplCmp_ComputeBrushRebakePasses];
+    [computeEncoder setTexture:_terrainHeight atIndex:0];
+    [computeEncoder setBuffer:_brushRebakePasses offset:0 atIndex:0];
+    [computeEncoder setBuffer:mouseBuffer offset:0 atIndex:1];
+    [computeEncoder setBuffer:globalUniforms.getBuffer() offset:globalUniforms.getOffset() atIndex:2];
+    [computeEncoder setBytes:&mipCount length:sizeof(mipCount) atIndex:3];
+    [computeEncoder dispatchThreadgroups:MTLSizeMake(1, 1, 1) threadsPerThreadgroup:MTLSizeMake(1, 1, 1)];
+    [computeEncoder endEncoding];
+    
+    computeEncoder = [commandBuffer computeCommandEncoder];
     [computeEncoder setComputePipelineState:_pplCmp_UpdateHeightmap];
     [computeEncoder setTexture:_terrainHeight atIndex:0];
     [computeEncoder setBuffer:mouseBuffer offset:0 atIndex:0];
     [computeEncoder setBuffer:globalUniforms.getBuffer() offset:globalUniforms.getOffset() atIndex:1];
-    [computeEncoder dispatchThreadgroups:MTLSizeMake(_terrainHeight.width/8, _terrainHeight.height/8, 1) threadsPerThreadgroup:MTLSizeMake(8, 8, 1)];
+    DispatchRebakePass (computeEncoder, _brushRebakePasses, TerrainRebakePassHeights, 2);
     [computeEncoder endEncoding];
     
-    [self GenerateTerrainNormalMap:commandBuffer];
-    [self GenerateTerrainPropertiesMap:commandBuffer];
-    
-    id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
-    [blit generateMipmapsForTexture:_terrainNormalMap];
-    [blit generateMipmapsForTexture:_terrainPropertiesMap];
+    // Read the stroke back for the quadtree, which takes it in when this frame's ring buffers come round again.
+    //  Only the heights the stroke changed are copied, into the same place as in the heightmap, as the brush's
+    //  rectangle is only known on the GPU.
+    id <MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+    [blit copyFromBuffer:_brushRebakePasses
+            sourceOffset:0
+                toBuffer:_strokePassesReadback.getBuffer ()
+       destinationOffset:_strokePassesReadback.getOffset ()
+                    size:sizeof(TerrainRebakePass) * TerrainRebakePassCOUNT];
     [blit endEncoding];
+    
+    computeEncoder = [commandBuffer computeCommandEncoder];
+    [computeEncoder setComputePipelineState:_pplCmp_CopyHeightsToBuffer];
+    [computeEncoder setTexture:_terrainHeight atIndex:0];
+    [computeEncoder setBuffer:_strokeHeightsReadback.getBuffer () offset:_strokeHeightsReadback.getOffset () atIndex:0];
+    DispatchRebakePass (computeEncoder, _brushRebakePasses, TerrainRebakePassHeights, 1);
+    [computeEncoder endEncoding];
+    
+    [self GenerateTerrainHeightBounds:commandBuffer passes:_brushRebakePasses];
+    [self GenerateTerrainNormalMap:commandBuffer passes:_brushRebakePasses];
+    [self GenerateTerrainPropertiesMap:commandBuffer passes:_brushRebakePasses];
+    [self GenerateTerrainMips:commandBuffer passes:_brushRebakePasses];
 }
 
 @end
@@ -111,7 +111,6 @@ struct TerrainParams
     float atmosphereScale          IAB_INDEX(TerrainParams_MemberIds::atmosphereScale);
 };
 
-#define TERRAIN_PATCHES 32
 #define TERRAIN_SCALE   15000.0f
 #define TERRAIN_HEIGHT  4500.0f
 #define TERRAIN_WATER_LEVEL 50.0
@@ -129,3 +128,230 @@ struct TerrainAdjustParams
     uint32_t        component;
     bool            useTargetMap;
 };
+
+// How far, in heightmap texels, TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap looks for occluders
+#define TERRAIN_AO_SAMPLE_RADIUS 32
+
+// Enough levels for a 32k heightmap
+#define TERRAIN_MAX_MIP_LEVELS 16
+
+#define TERRAIN_REBAKE_THREADGROUP_SIZE 8
+
+// Each pass of a terrain rebake covers texels [origin, end) of one mip level. The passes are laid out one after
+//  another in a buffer, and the first member of each doubles as the indirect arguments that dispatch it.
+struct TerrainRebakePass
+{
+    uint32_t        threadgroupsPerGrid[3];   // as MTLDispatchThreadgroupsIndirectArguments
+    uint32_t        level;
+    simd::uint2     origin;
+    simd::uint2     end;
+};
+
+enum TerrainRebakePassIndex : uint32_t
+{
+    TerrainRebakePassHeights,
+    TerrainRebakePassNormals,
+    TerrainRebakePassProperties,
+
+    // One pass for each mip level from 1 up of the normal and properties maps
+    TerrainRebakePassNormalsMip1,
+    TerrainRebakePassPropertiesMip1 = TerrainRebakePassNormalsMip1 + TERRAIN_MAX_MIP_LEVELS - 1,
+
+    // And of the height bounds, whose level n holds the lowest and highest height under each of its texels at the
+    //  heightmap's mip level n
+    TerrainRebakePassHeightBoundsMip1 = TerrainRebakePassPropertiesMip1 + TERRAIN_MAX_MIP_LEVELS - 1,
+
+    TerrainRebakePassCOUNT = TerrainRebakePassHeightBoundsMip1 + TERRAIN_MAX_MIP_LEVELS - 1
+};
+
+// The rebake passes are worked out the same way on the CPU, for the full bake, and on the GPU, for brush strokes,
+//  so these stick to plain arithmetic that compiles as both C++ and Metal
+#ifdef __METAL_VERSION__
+    #define TERRAIN_DEVICE device
+#else
+    #define TERRAIN_DEVICE
+#endif
+
+// Floor of x clamped to [lo, hi], which also keeps a NaN or far off brush from overflowing the conversion
+inline int TerrainClampedFloor (float x, int lo, int hi)
+{
+    if (!(x > (float)lo)) return lo;
+    if (x >= (float)hi) return hi;
+    int i = (int)x;
+    return ((float)i > x) ? i - 1 : i;
+}
+
+// Texels [x0, x1) x [y0, y1) of a mip level of a width x height texture, clamped to the level
+inline TerrainRebakePass TerrainMakeRebakePass (int x0, int y0, int x1, int y1, uint32_t level, uint32_t width, uint32_t height)
+{
+    int levelWidth  = (width  >> level) > 0 ? (int)(width  >> level) : 1;
+    int levelHeight = (height >> level) > 0 ? (int)(height >> level) : 1;
+
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > levelWidth  ? levelWidth  : x1;
+    y1 = y1 > levelHeight ? levelHeight : y1;
+    if (x1 <= x0 || y1 <= y0) { x0 = y0 = x1 = y1 = 0; }
+
+    TerrainRebakePass pass;
+    pass.threadgroupsPerGrid[0] = (uint32_t)(x1 - x0 + TERRAIN_REBAKE_THREADGROUP_SIZE - 1) / TERRAIN_REBAKE_THREADGROUP_SIZE;
+    pass.threadgroupsPerGrid[1] = (uint32_t)(y1 - y0 + TERRAIN_REBAKE_THREADGROUP_SIZE - 1) / TERRAIN_REBAKE_THREADGROUP_SIZE;
+    pass.threadgroupsPerGrid[2] = 1;
+    pass.level = level;
+    pass.origin.x = (uint32_t)x0;
+    pass.origin.y = (uint32_t)y0;
+    pass.end.x = (uint32_t)x1;
+    pass.end.y = (uint32_t)y1;
+    return pass;
+}
+
+inline bool TerrainRebakePassIsEmpty (TerrainRebakePass pass)
+{
+    return pass.end.x <= pass.origin.x || pass.end.y <= pass.origin.y;
+}
+
+// The texels of the same level that read any of the pass's texels from up to (marginX, marginY) away
+inline TerrainRebakePass TerrainExpandRebakePass (TerrainRebakePass pass, int marginX, int marginY, uint32_t width, uint32_t height)
+{
+    if (TerrainRebakePassIsEmpty (pass)) return pass;
+    return TerrainMakeRebakePass ((int)pass.origin.x - marginX, (int)pass.origin.y - marginY,
+                                  (int)pass.end.x + marginX, (int)pass.end.y + marginY,
+                                  pass.level, width, height);
+}
+
+// The texels of the next mip level down that filter any of the pass's texels
+inline TerrainRebakePass TerrainNextMipRebakePass (TerrainRebakePass pass, uint32_t width, uint32_t height)
+{
+    if (TerrainRebakePassIsEmpty (pass))
+        return TerrainMakeRebakePass (0, 0, 0, 0, pass.level + 1, width, height);
+    return TerrainMakeRebakePass ((int)pass.origin.x / 2, (int)pass.origin.y / 2,
+                                  ((int)pass.end.x + 1) / 2, ((int)pass.end.y + 1) / 2,
+                                  pass.level + 1, width, height);
+}
+
+// The texels of the next height bounds level down that cover any of the pass's texels. A level with an odd size
+//  has no texel below its last row or column, so the last texel of the next level covers them as well.
+inline TerrainRebakePass TerrainNextHeightBoundsRebakePass (TerrainRebakePass pass, uint32_t width, uint32_t height)
+{
+    if (TerrainRebakePassIsEmpty (pass))
+        return TerrainMakeRebakePass (0, 0, 0, 0, pass.level + 1, width, height);
+
+    const uint32_t level = pass.level + 1;
+    int lastX = (width  >> level) > 0 ? (int)(width  >> level) - 1 : 0;
+    int lastY = (height >> level) > 0 ? (int)(height >> level) - 1 : 0;
+    int x0 = (int)pass.origin.x / 2, y0 = (int)pass.origin.y / 2;
+    return TerrainMakeRebakePass (x0 < lastX ? x0 : lastX, y0 < lastY ? y0 : lastY,
+                                  ((int)pass.end.x + 1) / 2, ((int)pass.end.y + 1) / 2,
+                                  level, width, height);
+}
+
+// How far from a texel, in texels, TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap can sample. Samples reach
+//  TERRAIN_AO_SAMPLE_RADIUS texels across the width, and the offsets are scaled by the width along both axes, with
+//  a texel to spare for nearest sampling on texel edges and another for rounding.
+inline int TerrainOcclusionMarginX ()
+{
+    return TERRAIN_AO_SAMPLE_RADIUS + 2;
+}
+
+inline int TerrainOcclusionMarginY (uint32_t width, uint32_t height)
+{
+    return (int)((TERRAIN_AO_SAMPLE_RADIUS * height + width - 1) / width) + 2;
+}
+
+// The heightmap texels, as a pass over level 0, that the vertices of a patch of a patchesPerSide x patchesPerSide
+//  grid over the terrain can sample. Linear sampling reads the texels either side of a vertex, and a texel more on
+//  each side leaves room for the sampler's rounding.
+inline TerrainRebakePass TerrainPatchHeightsRect (uint32_t patchX, uint32_t patchY, uint32_t patchesPerSide,
+                                                  uint32_t width, uint32_t height)
+{
+    return TerrainMakeRebakePass ((int)(patchX * width / patchesPerSide) - 1,
+                                  (int)(patchY * height / patchesPerSide) - 1,
+                                  (int)((patchX + 1) * width / patchesPerSide) + 2,
+                                  (int)((patchY + 1) * height / patchesPerSide) + 2,
+                                  0, width, height);
+}
+
+// The height bounds level to look up heightmap texels [x0, x1] x [y0, y1] in, inclusive: the first at which they
+//  span no more than three texels each way, so a lookup reads at most nine. levelCount counts the heightmap's
+//  level 0, which the height bounds start after.
+inline uint32_t TerrainHeightBoundsQueryLevel (uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t levelCount)
+{
+    uint32_t level = 1;
+    while (level + 1 < levelCount && ((x1 >> level) - (x0 >> level) > 2 || (y1 >> level) - (y0 >> level) > 2))
+        level++;
+    return level;
+}
+
+// The terrain is drawn as leaves of a quadtree over it, which AAPLTerrainQuadtree picks on the CPU each frame. A
+//  node at depth d is 1 / (1 << d) of the terrain across, and each patch drawn reads the node it draws, packed by
+//  TerrainQuadtreePatchIndex, from a buffer indexed by its patch ID.
+#define TERRAIN_QUADTREE_MAX_DEPTH 7
+
+struct TerrainQuadtreeNode
+{
+    uint32_t        depth;
+    uint32_t        x;
+    uint32_t        y;
+};
+
+inline uint32_t TerrainQuadtreePatchIndex (uint32_t depth, uint32_t x, uint32_t y)
+{
+    return (depth << 28) | (y << 14) | x;
+}
+
+inline TerrainQuadtreeNode TerrainQuadtreeNodeFromPatchIndex (uint32_t patchIndex)
+{
+    TerrainQuadtreeNode node;
+    node.depth = patchIndex >> 28;
+    node.y = (patchIndex >> 14) & 0x3FFF;
+    node.x = patchIndex & 0x3FFF;
+    return node;
+}
+
+// The heightmap texels TerrainKnl_UpdateHeightmap changes for a brush at (x, z) in world space.
+//  evaluateModificationBrush is zero from twice the brush size out, and the heightmap is mapped onto the
+//  terrain by its width along both axes.
+inline TerrainRebakePass TerrainBrushRebakePass (float x, float z, float brushSize, uint32_t width, uint32_t height)
+{
+    float cx = (x / TERRAIN_SCALE + 0.5f) * width;
+    float cy = (z / TERRAIN_SCALE + 0.5f) * width;
+    float r = 2.0f * brushSize / TERRAIN_SCALE * width;
+
+    int maxX = (int)width + 1, maxY = (int)height + 1;
+    return TerrainMakeRebakePass (TerrainClampedFloor (cx - r, -1, maxX) - 1, TerrainClampedFloor (cy - r, -1, maxY) - 1,
+                                  TerrainClampedFloor (cx + r, -1, maxX) + 2, TerrainClampedFloor (cy + r, -1, maxY) + 2,
+                                  0, width, height);
+}
+
+// Fills in all the passes that rebake the normal and properties maps, their mips, and the height bounds, after
+//  the heights in `heights` have changed
+inline void TerrainFillRebakePasses (TERRAIN_DEVICE TerrainRebakePass* passes, TerrainRebakePass heights,
+                                     uint32_t width, uint32_t height, uint32_t mipCount)
+{
+    passes[TerrainRebakePassHeights] = heights;
+
+    // Normals read the texels around them, with a texel to spare for nearest sampling on texel edges
+    passes[TerrainRebakePassNormals] = TerrainExpandRebakePass (heights, 2, 2, width, height);
+
+    // Occlusion samples reach further than the variance's 3 * 3.5 texels
+    passes[TerrainRebakePassProperties] = TerrainExpandRebakePass (heights, TerrainOcclusionMarginX (),
+                                                                   TerrainOcclusionMarginY (width, height),
+                                                                   width, height);
+
+    TerrainRebakePass normals = passes[TerrainRebakePassNormals];
+    TerrainRebakePass properties = passes[TerrainRebakePassProperties];
+    TerrainRebakePass heightBounds = heights;
+    for (uint32_t level = 1; level < TERRAIN_MAX_MIP_LEVELS; level++)
+    {
+        normals = TerrainNextMipRebakePass (normals, width, height);
+        properties = TerrainNextMipRebakePass (properties, width, height);
+        heightBounds = TerrainNextHeightBoundsRebakePass (heightBounds, width, height);
+        if (level >= mipCount)
+        {
+            normals = properties = heightBounds = TerrainMakeRebakePass (0, 0, 0, 0, level, width, height);
+        }
+        passes[TerrainRebakePassNormalsMip1 + level - 1] = normals;
+        passes[TerrainRebakePassPropertiesMip1 + level - 1] = properties;
+        passes[TerrainRebakePassHeightBoundsMip1 + level - 1] = heightBounds;
+    }
+}
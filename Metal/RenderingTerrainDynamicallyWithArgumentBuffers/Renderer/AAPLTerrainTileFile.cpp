@@ -0,0 +1,223 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLTerrainTileFile class.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "AAPLTerrainTileFile.h"
+
+static const char       kTileFileMagic[4]   = { 'A', 'T', 'H', 'M' };
+static const uint32_t   kTileFileVersion    = 1;
+
+uint32_t AAPLTerrainTileFile::LevelCount (uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    uint32_t level = 0;
+    while (std::max (width >> level, 1u) > tileSize || std::max (height >> level, 1u) > tileSize) level++;
+    return level + 1;
+}
+
+static bool IsValidHeader (const AAPLTerrainTileFileHeader& header)
+{
+    return memcmp (header.magic, kTileFileMagic, sizeof (kTileFileMagic)) == 0
+        && header.version == kTileFileVersion
+        && header.width > 0 && header.height > 0 && header.tileSize > 0
+        && header.levelCount == AAPLTerrainTileFile::LevelCount (header.width, header.height, header.tileSize);
+}
+
+std::unique_ptr<AAPLTerrainTileFile> AAPLTerrainTileFile::Open (const char* path)
+{
+    const int fd = open (path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    AAPLTerrainTileFileHeader header;
+    if (pread (fd, &header, sizeof (header), 0) != (ssize_t)sizeof (header) || !IsValidHeader (header))
+    {
+        close (fd);
+        return nullptr;
+    }
+    return std::unique_ptr<AAPLTerrainTileFile> (new AAPLTerrainTileFile (fd, header));
+}
+
+AAPLTerrainTileFile::AAPLTerrainTileFile (int fd, const AAPLTerrainTileFileHeader& header)
+: _fd (fd)
+, _header (header)
+{
+    assert (header.levelCount <= sizeof (_levelFirstTile) / sizeof (_levelFirstTile[0]));
+
+    uint64_t firstTile = 0;
+    for (uint32_t level = 0; level < levelCount (); level++)
+    {
+        _levelFirstTile[level] = firstTile;
+        firstTile += (uint64_t)tilesX (level) * tilesY (level);
+    }
+}
+
+AAPLTerrainTileFile::~AAPLTerrainTileFile ()
+{
+    close (_fd);
+}
+
+uint32_t AAPLTerrainTileFile::levelWidth (uint32_t level) const
+{
+    return std::max (_header.width >> level, 1u);
+}
+
+uint32_t AAPLTerrainTileFile::levelHeight (uint32_t level) const
+{
+    return std::max (_header.height >> level, 1u);
+}
+
+uint32_t AAPLTerrainTileFile::tilesX (uint32_t level) const
+{
+    return (levelWidth (level) + _header.tileSize - 1) / _header.tileSize;
+}
+
+uint32_t AAPLTerrainTileFile::tilesY (uint32_t level) const
+{
+    return (levelHeight (level) + _header.tileSize - 1) / _header.tileSize;
+}
+
+bool AAPLTerrainTileFile::readTile (uint32_t level, uint32_t tileX, uint32_t tileY, uint16_t* out) const
+{
+    assert (level < levelCount () && tileX < tilesX (level) && tileY < tilesY (level));
+
+    const size_t tileBytes = tileTexelCount () * sizeof (uint16_t);
+    const uint64_t tileIndex = _levelFirstTile[level] + (uint64_t)tileY * tilesX (level) + tileX;
+    off_t offset = (off_t)(sizeof (AAPLTerrainTileFileHeader) + tileIndex * tileBytes);
+
+    // pread may return less than asked for, such as when interrupted
+    uint8_t* dst = (uint8_t*)out;
+    size_t remaining = tileBytes;
+    while (remaining > 0)
+    {
+        const ssize_t bytesRead = pread (_fd, dst, remaining, offset);
+        if (bytesRead <= 0) return false;
+        dst += bytesRead;
+        offset += bytesRead;
+        remaining -= (size_t)bytesRead;
+    }
+    return true;
+}
+
+bool AAPLTerrainTileFile::Write (const char* path, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t border,
+                                 const std::function<uint16_t (uint32_t level, uint32_t x, uint32_t y)>& heightAt)
+{
+    assert (width > 0 && height > 0 && tileSize > 0 && border < tileSize);
+
+    AAPLTerrainTileFileHeader header = {};
+    memcpy (header.magic, kTileFileMagic, sizeof (kTileFileMagic));
+    header.version      = kTileFileVersion;
+    header.width        = width;
+    header.height       = height;
+    header.tileSize     = tileSize;
+    header.border       = border;
+    header.levelCount   = LevelCount (width, height, tileSize);
+
+    FILE* file = fopen (path, "wb");
+    if (file == nullptr) return false;
+    bool ok = fwrite (&header, sizeof (header), 1, file) == 1;
+
+    // One tile in memory at a time, so heightmaps too large for memory can be written
+    const uint32_t stride = tileSize + 2 * border;
+    std::vector<uint16_t> tile ((size_t)stride * stride);
+
+    for (uint32_t level = 0; ok && level < header.levelCount; level++)
+    {
+        const int32_t lastX = (int32_t)std::max (width >> level, 1u) - 1;
+        const int32_t lastY = (int32_t)std::max (height >> level, 1u) - 1;
+        const uint32_t tilesX = (uint32_t)(lastX + tileSize) / tileSize;
+        const uint32_t tilesY = (uint32_t)(lastY + tileSize) / tileSize;
+
+        for (uint32_t tileY = 0; ok && tileY < tilesY; tileY++)
+        {
+            for (uint32_t tileX = 0; ok && tileX < tilesX; tileX++)
+            {
+                const int32_t originX = (int32_t)(tileX * tileSize) - (int32_t)border;
+                const int32_t originY = (int32_t)(tileY * tileSize) - (int32_t)border;
+                for (uint32_t y = 0; y < stride; y++)
+                {
+                    const uint32_t sy = (uint32_t)std::min (std::max (originY + (int32_t)y, 0), lastY);
+                    for (uint32_t x = 0; x < stride; x++)
+                    {
+                        const uint32_t sx = (uint32_t)std::min (std::max (originX + (int32_t)x, 0), lastX);
+                        tile[(size_t)y * stride + x] = heightAt (level, sx, sy);
+                    }
+                }
+                ok = fwrite (tile.data (), sizeof (uint16_t), tile.size (), file) == tile.size ();
+            }
+        }
+    }
+
+    ok = (fclose (file) == 0) && ok;
+    if (!ok) remove (path);
+    return ok;
+}
+
+// Hashes a lattice point of an octave to [0, 1]
+static inline float LatticeValue (uint32_t seed, uint32_t octave, int32_t x, int32_t y)
+{
+    uint32_t h = seed ^ (octave * 0x9E3779B9u);
+    h ^= (uint32_t)x * 0x85EBCA6Bu;
+    h = (h ^ (h >> 15)) * 0x2C1B3C6Du;
+    h ^= (uint32_t)y * 0xC2B2AE35u;
+    h = (h ^ (h >> 13)) * 0x297A2D39u;
+    h ^= h >> 16;
+    return (float)(h >> 8) * (1.0f / 16777215.0f);
+}
+
+static inline float SmoothValueNoise (uint32_t seed, uint32_t octave, float x, float y)
+{
+    const float fx = floorf (x), fy = floorf (y);
+    const int32_t ix = (int32_t)fx, iy = (int32_t)fy;
+    float tx = x - fx, ty = y - fy;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    ty = ty * ty * (3.0f - 2.0f * ty);
+
+    const float v00 = LatticeValue (seed, octave, ix, iy),     v10 = LatticeValue (seed, octave, ix + 1, iy);
+    const float v01 = LatticeValue (seed, octave, ix, iy + 1), v11 = LatticeValue (seed, octave, ix + 1, iy + 1);
+    const float top = v00 + (v10 - v00) * tx, bottom = v01 + (v11 - v01) * tx;
+    return top + (bottom - top) * ty;
+}
+
+uint16_t TerrainSyntheticHeight (uint32_t seed, uint32_t level, uint32_t x, uint32_t y)
+{
+    // Features from 4096 texels of level 0 down to 4, each octave half the size and a little under half the height
+    //  of the one before. Octaves narrower than two texels of the level would only alias, so their average stands
+    //  in for them.
+    const int   kOctaves        = 11;
+    const float kBaseWavelength = 4096.0f;
+    const float kPersistence    = 0.47f;
+
+    // The middle of the texel, in level 0 texels
+    const float scale = (float)(1u << level);
+    const float px = ((float)x + 0.5f) * scale;
+    const float py = ((float)y + 0.5f) * scale;
+
+    float sum = 0.0f, amplitude = 1.0f, totalAmplitude = 0.0f, wavelength = kBaseWavelength;
+    for (int octave = 0; octave < kOctaves; octave++)
+    {
+        const float noise = (wavelength >= 2.0f * scale)
+            ? SmoothValueNoise (seed, (uint32_t)octave, px / wavelength, py / wavelength)
+            : 0.5f;
+        sum += amplitude * noise;
+        totalAmplitude += amplitude;
+        amplitude *= kPersistence;
+        wavelength *= 0.5f;
+    }
+
+    // Flatter valleys and sharper peaks than the noise on its own
+    const float h = sum / totalAmplitude;
+    const float shaped = std::min (std::max (h * h * 1.4f - 0.02f, 0.0f), 1.0f);
+    return (uint16_t)lrintf (shaped * 65535.0f);
+}
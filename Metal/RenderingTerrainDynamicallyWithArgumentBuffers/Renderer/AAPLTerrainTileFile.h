@@ -0,0 +1,77 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLTerrainTileFile class, which reads and writes heightmaps stored as square tiles, so terrain
+ larger than a texture can be paged in a tile at a time, and of a synthetic heightmap to try it out with.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// A tiled heightmap file is this header, then every tile of every level: level 0 first, and the tiles of each level
+//  row by row. A tile holds tileStride x tileStride R16Unorm heights, row by row: its tileSize x tileSize texels with
+//  `border` texels of its neighbors around them, clamped to the level's edges, so a tile can be filtered on its own.
+//  Level n has the dimensions of the heightmap's mip level n, and the levels stop at the first that fits in one tile.
+struct AAPLTerrainTileFileHeader
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    width;          // of level 0, in texels
+    uint32_t    height;
+    uint32_t    tileSize;
+    uint32_t    border;
+    uint32_t    levelCount;
+    uint32_t    reserved;
+};
+
+class AAPLTerrainTileFile
+{
+public:
+    // Returns nullptr when the file can't be opened, or isn't a tiled heightmap
+    static std::unique_ptr<AAPLTerrainTileFile> Open (const char* path);
+
+    // Writes a tiled heightmap of which texel (x, y) of level n is heightAt (n, x, y). Levels from 1 on are
+    //  expected to be box filtered versions of level 0, as mips are. Returns false if the file can't be written.
+    static bool Write (const char* path, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t border,
+                       const std::function<uint16_t (uint32_t level, uint32_t x, uint32_t y)>& heightAt);
+
+    ~AAPLTerrainTileFile ();
+
+    AAPLTerrainTileFile (const AAPLTerrainTileFile&) = delete;
+    AAPLTerrainTileFile& operator= (const AAPLTerrainTileFile&) = delete;
+
+    // Reads a tile, border included, into tileTexelCount () heights at out. Safe to call from several threads at once.
+    bool        readTile (uint32_t level, uint32_t tileX, uint32_t tileY, uint16_t* out) const;
+
+    uint32_t    width () const          { return _header.width; }
+    uint32_t    height () const         { return _header.height; }
+    uint32_t    tileSize () const       { return _header.tileSize; }
+    uint32_t    border () const         { return _header.border; }
+    uint32_t    levelCount () const     { return _header.levelCount; }
+    uint32_t    tileStride () const     { return _header.tileSize + 2 * _header.border; }
+    size_t      tileTexelCount () const { return (size_t)tileStride () * tileStride (); }
+
+    uint32_t    levelWidth (uint32_t level) const;
+    uint32_t    levelHeight (uint32_t level) const;
+    uint32_t    tilesX (uint32_t level) const;
+    uint32_t    tilesY (uint32_t level) const;
+
+    // The number of levels a heightmap is split into
+    static uint32_t LevelCount (uint32_t width, uint32_t height, uint32_t tileSize);
+
+private:
+    AAPLTerrainTileFile (int fd, const AAPLTerrainTileFileHeader& header);
+
+    int                         _fd;
+    AAPLTerrainTileFileHeader   _header;
+    uint64_t                    _levelFirstTile[32];
+};
+
+// Height (x, y) of level n of a synthetic heightmap of fractal value noise, the same for a given seed on every run.
+//  Rather than box filtering, coarser levels flatten the octaves too fine for their texels, which keeps them
+//  close to the filtered heights while each texel is worked out on its own.
+uint16_t TerrainSyntheticHeight (uint32_t seed, uint32_t level, uint32_t x, uint32_t y);
@@ -0,0 +1,370 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLTerrainTileStreamer class.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "AAPLTerrainTileStreamer.h"
+
+static inline uint32_t MakeEntry (uint32_t slot, uint32_t level)
+{
+    return (slot << 8) | level;
+}
+
+static const uint32_t kFreeSlot = ~0u;
+
+AAPLTerrainTileStreamer::AAPLTerrainTileStreamer (const AAPLTerrainTileFile& file,
+                                                  const AAPLTerrainStreamerParams& params)
+: _file (file)
+, _params (params)
+, _pageTablesChanged (true)
+, _updateIndex (0)
+, _stats ()
+, _stopping (false)
+{
+    const uint32_t topLevel = file.levelCount () - 1;
+    assert (params.atlasSlots > file.tilesX (topLevel) * file.tilesY (topLevel) && params.atlasSlots < (1u << 24)
+            && params.loadsPerUpdate > 0);
+
+    for (uint32_t level = 0; level < file.levelCount (); level++)
+    {
+        const size_t tileCount = (size_t)file.tilesX (level) * file.tilesY (level);
+        _tiles.emplace_back (tileCount, Tile { kNoSlot, false, false, 0, 0.0f });
+        _pageTables.emplace_back (tileCount, 0);
+    }
+
+    _atlas.resize ((size_t)params.atlasSlots * file.tileTexelCount ());
+    _slotTiles.resize (params.atlasSlots, Load { kFreeSlot, 0, 0, 0, false });
+    for (uint32_t slot = params.atlasSlots; slot > 0; slot--)
+        _freeSlots.push_back (slot - 1);
+
+    // The coarsest level is always resident, so every page table entry has a tile to fall back on
+    for (uint32_t tileY = 0; tileY < file.tilesY (topLevel); tileY++)
+    {
+        for (uint32_t tileX = 0; tileX < file.tilesX (topLevel); tileX++)
+        {
+            const uint32_t slot = _freeSlots.back ();
+            _freeSlots.pop_back ();
+
+            Tile& t = tile (topLevel, tileX, tileY);
+            t.pinned = true;
+            _slotTiles[slot] = Load { topLevel, tileX, tileY, slot, true };
+            if (!file.readTile (topLevel, tileX, tileY, mutableSlotTexels (slot)))
+                _stats.failedLoads++;
+
+            t.slot = (int32_t)slot;
+            _changedSlots.push_back (slot);
+            updatePageTable (topLevel, tileX, tileY, MakeEntry (slot, topLevel));
+        }
+    }
+
+    for (unsigned i = 0; i < params.loaderThreads; i++)
+        _loaders.emplace_back (&AAPLTerrainTileStreamer::loaderMain, this);
+}
+
+AAPLTerrainTileStreamer::~AAPLTerrainTileStreamer ()
+{
+    {
+        std::lock_guard<std::mutex> lock (_loadMutex);
+        _stopping = true;
+    }
+    _loadQueued.notify_all ();
+
+    for (std::thread& loader : _loaders)
+        loader.join ();
+}
+
+inline AAPLTerrainTileStreamer::Tile& AAPLTerrainTileStreamer::tile (uint32_t level, uint32_t tileX, uint32_t tileY)
+{
+    return _tiles[level][(size_t)tileY * _file.tilesX (level) + tileX];
+}
+
+inline const AAPLTerrainTileStreamer::Tile& AAPLTerrainTileStreamer::tile (uint32_t level, uint32_t tileX,
+                                                                           uint32_t tileY) const
+{
+    return _tiles[level][(size_t)tileY * _file.tilesX (level) + tileX];
+}
+
+uint16_t* AAPLTerrainTileStreamer::mutableSlotTexels (uint32_t slot)
+{
+    return _atlas.data () + (size_t)slot * _file.tileTexelCount ();
+}
+
+const uint16_t* AAPLTerrainTileStreamer::slotTexels (uint32_t slot) const
+{
+    return _atlas.data () + (size_t)slot * _file.tileTexelCount ();
+}
+
+bool AAPLTerrainTileStreamer::isResident (uint32_t level, uint32_t tileX, uint32_t tileY) const
+{
+    return tile (level, tileX, tileY).slot != kNoSlot;
+}
+
+AAPLTerrainStreamerStats AAPLTerrainTileStreamer::stats () const
+{
+    AAPLTerrainStreamerStats stats = _stats;
+    stats.residentTiles = _params.atlasSlots - (uint32_t)_freeSlots.size () - stats.pendingLoads;
+    return stats;
+}
+
+// The tiles of the next finer level a tile covers. The last tile of an odd sized level also covers what the finer
+//  level has left over past it.
+static inline void ChildRange (uint32_t tile, uint32_t tileCount, uint32_t childTileCount,
+                               uint32_t& outBegin, uint32_t& outEnd)
+{
+    outBegin = std::min (2 * tile, childTileCount);
+    outEnd = (tile == tileCount - 1) ? childTileCount : std::min (2 * tile + 2, childTileCount);
+}
+
+float AAPLTerrainTileStreamer::tileDistance (uint32_t level, uint32_t tileX, uint32_t tileY,
+                                             simd::float3 position) const
+{
+    // The level 0 texels under the tile, up to the edge of the heightmap
+    const float tileTexels = (float)((uint64_t)_file.tileSize () << level);
+    const float x0 = tileX * tileTexels, x1 = std::min ((tileX + 1) * tileTexels, (float)_file.width ());
+    const float z0 = tileY * tileTexels, z1 = std::min ((tileY + 1) * tileTexels, (float)_file.height ());
+
+    // Without the heights, the box runs from the lowest height to the highest
+    const float minX = _params.worldOrigin.x + x0 * _params.texelSpacing;
+    const float maxX = _params.worldOrigin.x + x1 * _params.texelSpacing;
+    const float minZ = _params.worldOrigin.y + z0 * _params.texelSpacing;
+    const float maxZ = _params.worldOrigin.y + z1 * _params.texelSpacing;
+
+    const float dx = std::max (std::max (minX - position.x, position.x - maxX), 0.0f);
+    const float dy = std::max (std::max (-position.y, position.y - _params.heightScale), 0.0f);
+    const float dz = std::max (std::max (minZ - position.z, position.z - maxZ), 0.0f);
+    return sqrtf (dx * dx + dy * dy + dz * dz);
+}
+
+void AAPLTerrainTileStreamer::selectTiles (uint32_t level, uint32_t tileX, uint32_t tileY,
+                                           const AAPLTerrainStreamingView& view, std::vector<Request>& outRequests)
+{
+    // A texel of the level, seen from the nearest point of the tile
+    const float distance = tileDistance (level, tileX, tileY, view.cameraPosition);
+    const float texelSize = _params.texelSpacing * (float)(1u << level);
+    const float screenError = texelSize * view.projectionScale / std::max (distance, 1e-6f);
+
+    Tile& t = tile (level, tileX, tileY);
+    t.lastWanted = _updateIndex;
+    t.priority = screenError;
+    _stats.wantedTiles++;
+
+    if (t.slot == kNoSlot && !t.loading)
+        outRequests.push_back (Request { level, tileX, tileY, screenError, distance });
+
+    if (level == 0 || screenError <= view.maxScreenError) return;
+
+    uint32_t x0, x1, y0, y1;
+    ChildRange (tileX, _file.tilesX (level), _file.tilesX (level - 1), x0, x1);
+    ChildRange (tileY, _file.tilesY (level), _file.tilesY (level - 1), y0, y1);
+    for (uint32_t y = y0; y < y1; y++)
+        for (uint32_t x = x0; x < x1; x++)
+            selectTiles (level - 1, x, y, view, outRequests);
+}
+
+void AAPLTerrainTileStreamer::update (const AAPLTerrainStreamingView& view)
+{
+    _updateIndex++;
+    takeCompletedLoads ();
+
+    std::vector<Request> requests;
+    _stats.wantedTiles = 0;
+
+    const uint32_t topLevel = _file.levelCount () - 1;
+    for (uint32_t tileY = 0; tileY < _file.tilesY (topLevel); tileY++)
+        for (uint32_t tileX = 0; tileX < _file.tilesX (topLevel); tileX++)
+            selectTiles (topLevel, tileX, tileY, view, requests);
+
+    // A tile has at most half the screen error of the tile above it, so tiles always load after their parents
+    std::sort (requests.begin (), requests.end (), [] (const Request& a, const Request& b)
+    {
+        return a.priority != b.priority ? a.priority > b.priority : a.distance < b.distance;
+    });
+
+    uint32_t started = 0;
+    for (const Request& request : requests)
+    {
+        if (started == _params.loadsPerUpdate || _stats.pendingLoads == _params.loadsPerUpdate) break;
+
+        uint32_t slot;
+        if (!allocateSlot (request, slot)) break;
+        startLoad (request, slot);
+        started++;
+    }
+}
+
+bool AAPLTerrainTileStreamer::allocateSlot (const Request& request, uint32_t& outSlot)
+{
+    if (!_freeSlots.empty ())
+    {
+        outSlot = _freeSlots.back ();
+        _freeSlots.pop_back ();
+        return true;
+    }
+
+    // The tile needed least recently, and of those the one with the least screen error
+    const Tile* victim = nullptr;
+    uint32_t victimSlot = 0;
+    for (uint32_t slot = 0; slot < _params.atlasSlots; slot++)
+    {
+        const Load& key = _slotTiles[slot];
+        const Tile& t = tile (key.level, key.tileX, key.tileY);
+        if (t.pinned || t.loading) continue;
+
+        if (victim == nullptr || t.lastWanted < victim->lastWanted
+            || (t.lastWanted == victim->lastWanted && t.priority < victim->priority))
+        {
+            victim = &t;
+            victimSlot = slot;
+        }
+    }
+
+    // Don't give up a tile this view needs for one it needs less
+    if (victim == nullptr || (victim->lastWanted == _updateIndex && victim->priority >= request.priority))
+        return false;
+
+    evict (victimSlot);
+    outSlot = victimSlot;
+    return true;
+}
+
+void AAPLTerrainTileStreamer::evict (uint32_t slot)
+{
+    const Load key = _slotTiles[slot];
+    tile (key.level, key.tileX, key.tileY).slot = kNoSlot;
+    _slotTiles[slot].level = kFreeSlot;
+
+    updatePageTable (key.level, key.tileX, key.tileY, inheritedEntry (key.level, key.tileX, key.tileY));
+    _stats.evictions++;
+}
+
+void AAPLTerrainTileStreamer::startLoad (const Request& request, uint32_t slot)
+{
+    const Load load = { request.level, request.tileX, request.tileY, slot, false };
+    tile (load.level, load.tileX, load.tileY).loading = true;
+    _slotTiles[slot] = load;
+    _stats.loadsStarted++;
+    _stats.pendingLoads++;
+
+    if (_loaders.empty ())
+    {
+        Load completed = load;
+        completed.succeeded = _file.readTile (load.level, load.tileX, load.tileY, mutableSlotTexels (slot));
+        completeLoad (completed);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (_loadMutex);
+        _queuedLoads.push_back (load);
+    }
+    _loadQueued.notify_one ();
+}
+
+void AAPLTerrainTileStreamer::completeLoad (const Load& load)
+{
+    Tile& t = tile (load.level, load.tileX, load.tileY);
+    t.loading = false;
+    _stats.pendingLoads--;
+
+    if (!load.succeeded)
+    {
+        _slotTiles[load.slot].level = kFreeSlot;
+        _freeSlots.push_back (load.slot);
+        _stats.failedLoads++;
+        return;
+    }
+
+    t.slot = (int32_t)load.slot;
+    _changedSlots.push_back (load.slot);
+    updatePageTable (load.level, load.tileX, load.tileY, MakeEntry (load.slot, load.level));
+}
+
+void AAPLTerrainTileStreamer::takeCompletedLoads ()
+{
+    std::vector<Load> completed;
+    {
+        std::lock_guard<std::mutex> lock (_loadMutex);
+        completed.swap (_completedLoads);
+    }
+    for (const Load& load : completed)
+        completeLoad (load);
+}
+
+void AAPLTerrainTileStreamer::finishLoads ()
+{
+    {
+        std::unique_lock<std::mutex> lock (_loadMutex);
+        _loadCompleted.wait (lock, [this] { return _completedLoads.size () == _stats.pendingLoads; });
+    }
+    takeCompletedLoads ();
+}
+
+void AAPLTerrainTileStreamer::loaderMain ()
+{
+    std::unique_lock<std::mutex> lock (_loadMutex);
+    for (;;)
+    {
+        _loadQueued.wait (lock, [this] { return _stopping || !_queuedLoads.empty (); });
+        if (_stopping) return;
+
+        Load load = _queuedLoads.front ();
+        _queuedLoads.pop_front ();
+
+        // The slot is the load's alone until it completes: it isn't in any page table, and can't be evicted
+        lock.unlock ();
+        load.succeeded = _file.readTile (load.level, load.tileX, load.tileY, mutableSlotTexels (load.slot));
+        lock.lock ();
+
+        _completedLoads.push_back (load);
+        _loadCompleted.notify_all ();
+    }
+}
+
+// The entry of a tile's parent, which is what the tile shows while it isn't resident
+uint32_t AAPLTerrainTileStreamer::inheritedEntry (uint32_t level, uint32_t tileX, uint32_t tileY) const
+{
+    const uint32_t parentX = std::min (tileX / 2, _file.tilesX (level + 1) - 1);
+    const uint32_t parentY = std::min (tileY / 2, _file.tilesY (level + 1) - 1);
+    return _pageTables[level + 1][(size_t)parentY * _file.tilesX (level + 1) + parentX];
+}
+
+void AAPLTerrainTileStreamer::updatePageTable (uint32_t level, uint32_t tileX, uint32_t tileY, uint32_t entry)
+{
+    const Tile& t = tile (level, tileX, tileY);
+    if (t.slot != kNoSlot) entry = MakeEntry ((uint32_t)t.slot, level);
+    _pageTables[level][(size_t)tileY * _file.tilesX (level) + tileX] = entry;
+    _pageTablesChanged = true;
+
+    if (level == 0) return;
+
+    // Resident tiles below are their own entries, and so are what is below them
+    uint32_t x0, x1, y0, y1;
+    ChildRange (tileX, _file.tilesX (level), _file.tilesX (level - 1), x0, x1);
+    ChildRange (tileY, _file.tilesY (level), _file.tilesY (level - 1), y0, y1);
+    for (uint32_t y = y0; y < y1; y++)
+        for (uint32_t x = x0; x < x1; x++)
+            if (tile (level - 1, x, y).slot == kNoSlot)
+                updatePageTable (level - 1, x, y, entry);
+}
+
+std::vector<uint32_t> AAPLTerrainTileStreamer::takeChangedSlots ()
+{
+    std::vector<uint32_t> slots;
+    slots.swap (_changedSlots);
+    std::sort (slots.begin (), slots.end ());
+    slots.erase (std::unique (slots.begin (), slots.end ()), slots.end ());
+    return slots;
+}
+
+bool AAPLTerrainTileStreamer::takePageTablesChanged ()
+{
+    const bool changed = _pageTablesChanged;
+    _pageTablesChanged = false;
+    return changed;
+}
@@ -0,0 +1,159 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLTerrainTileStreamer class, which keeps the tiles of a tiled heightmap that the camera needs
+ in a fixed number of atlas slots. Every update, it walks the tiles as a quadtree from the coarsest level, going
+ down wherever a tile's texel spacing would show as more than a few pixels on screen, and loads the tiles it
+ reaches from disk, most visible error first, in place of the tiles least recently needed.
+ A page table per level tells, for every tile, the slot of the finest resident tile covering it, so terrain can
+ always be drawn from whatever has arrived so far.
+ The app doesn't build it, or AAPLTerrainTileFile, until the terrain shaders sample through the page tables; the
+ tests in Tests/ build both on their own.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <simd/simd.h>
+
+#include "AAPLTerrainTileFile.h"
+
+struct AAPLTerrainStreamerParams
+{
+    uint32_t        atlasSlots;         // tiles the atlas holds; the coarsest level takes some of them for good
+    uint32_t        loadsPerUpdate;     // the most tile loads an update starts, and the most in flight at once
+    unsigned        loaderThreads;      // threads reading tiles; with none, update reads them itself
+    float           texelSpacing;       // world units between two texels of level 0
+    float           heightScale;        // world units of a height of 1
+    simd::float2    worldOrigin;        // world x and z of the corner of the heightmap at texel (0, 0)
+};
+
+struct AAPLTerrainStreamingView
+{
+    simd::float3    cameraPosition;
+    float           projectionScale;    // pixels a world unit spans at a world unit from the camera, that is
+                                        //  viewport height / (2 tan (vertical field of view / 2))
+    float           maxScreenError;     // pixels a texel of a drawn level may span
+};
+
+struct AAPLTerrainStreamerStats
+{
+    uint32_t        wantedTiles;        // tiles the last update reached
+    uint32_t        residentTiles;
+    uint32_t        pendingLoads;
+    uint64_t        loadsStarted;
+    uint64_t        evictions;
+    uint64_t        failedLoads;
+};
+
+class AAPLTerrainTileStreamer
+{
+public:
+    // Reads the tiles of the coarsest level in before returning. The file must outlive the streamer.
+    AAPLTerrainTileStreamer (const AAPLTerrainTileFile& file, const AAPLTerrainStreamerParams& params);
+    ~AAPLTerrainTileStreamer ();
+
+    AAPLTerrainTileStreamer (const AAPLTerrainTileStreamer&) = delete;
+    AAPLTerrainTileStreamer& operator= (const AAPLTerrainTileStreamer&) = delete;
+
+    // Takes in the loads that have finished, works out the tiles the view needs and starts loading the most
+    //  needed of those that aren't resident, evicting tiles to make room
+    void                            update (const AAPLTerrainStreamingView& view);
+
+    // Waits for the loads in flight and takes them in, as for a loading screen
+    void                            finishLoads ();
+
+    // The page table of a level: an entry for each tile, row by row, file.tilesX (level) wide
+    const std::vector<uint32_t>&    pageTable (uint32_t level) const    { return _pageTables[level]; }
+    static uint32_t                 EntrySlot (uint32_t entry)          { return entry >> 8; }
+    static uint32_t                 EntryLevel (uint32_t entry)         { return entry & 0xFF; }
+
+    // The heights in a slot, file.tileTexelCount () of them, as read from the file
+    const uint16_t*                 slotTexels (uint32_t slot) const;
+
+    // The slots whose heights have changed since the last call, and whether any page table entry has, for
+    //  uploading to the GPU's copies
+    std::vector<uint32_t>           takeChangedSlots ();
+    bool                            takePageTablesChanged ();
+
+    bool                            isResident (uint32_t level, uint32_t tileX, uint32_t tileY) const;
+    AAPLTerrainStreamerStats        stats () const;
+
+private:
+    static const int32_t kNoSlot = -1;
+
+    struct Tile
+    {
+        int32_t     slot;
+        bool        loading;
+        bool        pinned;
+        uint64_t    lastWanted;         // the update that last reached the tile
+        float       priority;           // its screen error when last reached
+    };
+
+    struct Load
+    {
+        uint32_t    level;
+        uint32_t    tileX;
+        uint32_t    tileY;
+        uint32_t    slot;
+        bool        succeeded;
+    };
+
+    struct Request
+    {
+        uint32_t    level;
+        uint32_t    tileX;
+        uint32_t    tileY;
+        float       priority;
+        float       distance;
+    };
+
+    Tile&           tile (uint32_t level, uint32_t tileX, uint32_t tileY);
+    const Tile&     tile (uint32_t level, uint32_t tileX, uint32_t tileY) const;
+    uint16_t*       mutableSlotTexels (uint32_t slot);
+
+    float           tileDistance (uint32_t level, uint32_t tileX, uint32_t tileY, simd::float3 position) const;
+    void            selectTiles (uint32_t level, uint32_t tileX, uint32_t tileY, const AAPLTerrainStreamingView& view,
+                                 std::vector<Request>& outRequests);
+    bool            allocateSlot (const Request& request, uint32_t& outSlot);
+    void            evict (uint32_t slot);
+    void            startLoad (const Request& request, uint32_t slot);
+    void            completeLoad (const Load& load);
+    void            takeCompletedLoads ();
+    void            updatePageTable (uint32_t level, uint32_t tileX, uint32_t tileY, uint32_t entry);
+    uint32_t        inheritedEntry (uint32_t level, uint32_t tileX, uint32_t tileY) const;
+    void            loaderMain ();
+
+    const AAPLTerrainTileFile&          _file;
+    AAPLTerrainStreamerParams           _params;
+
+    std::vector<std::vector<Tile>>      _tiles;
+    std::vector<std::vector<uint32_t>>  _pageTables;
+    std::vector<uint16_t>               _atlas;
+
+    // The tile in each slot, as level, x and y, or level ~0 while the slot is free
+    std::vector<Load>                   _slotTiles;
+    std::vector<uint32_t>               _freeSlots;
+    std::vector<uint32_t>               _changedSlots;
+    bool                                _pageTablesChanged;
+
+    uint64_t                            _updateIndex;
+    AAPLTerrainStreamerStats            _stats;
+
+    // Loads waiting for a loader, and loads that loaders have finished
+    std::mutex                          _loadMutex;
+    std::condition_variable             _loadQueued;
+    std::condition_variable             _loadCompleted;
+    std::deque<Load>                    _queuedLoads;
+    std::vector<Load>                   _completedLoads;
+    std::vector<std::thread>            _loaders;
+    bool                                _stopping;
+};
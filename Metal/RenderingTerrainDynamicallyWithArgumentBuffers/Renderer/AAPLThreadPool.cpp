@@ -0,0 +1,156 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of the AAPLThreadPool class.
+*/
+
+#include "AAPLThreadPool.h"
+
+// The pool and queue of the worker running on this thread, so that parallelFor calls made from inside a task
+//  queue their batches on that worker first
+static thread_local const AAPLThreadPool* t_currentPool = nullptr;
+static thread_local size_t t_currentQueue = 0;
+
+unsigned AAPLThreadPool::DefaultWorkerCount ()
+{
+    const unsigned cores = std::thread::hardware_concurrency ();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+AAPLThreadPool::AAPLThreadPool (unsigned workerCount)
+: _queuedTaskCount (0)
+, _nextQueue (0)
+, _stopping (false)
+{
+    for (unsigned i = 0; i <= workerCount; i++)
+        _queues.emplace_back (new Queue);
+
+    for (unsigned i = 0; i < workerCount; i++)
+        _threads.emplace_back (&AAPLThreadPool::workerMain, this, (size_t) i);
+}
+
+AAPLThreadPool::~AAPLThreadPool ()
+{
+    {
+        std::lock_guard<std::mutex> lock (_sleepMutex);
+        _stopping = true;
+    }
+    _workAvailable.notify_all ();
+
+    for (std::thread& thread : _threads)
+        thread.join ();
+}
+
+void AAPLThreadPool::parallelFor (size_t count, const std::function<void (size_t)>& fn, size_t batchSize)
+{
+    if (count == 0) return;
+
+    const size_t threadCount = _threads.size () + 1;
+    if (batchSize == 0)
+        batchSize = std::max<size_t> (1, count / (threadCount * 8));
+
+    if (threadCount == 1 || count <= batchSize)
+    {
+        for (size_t i = 0; i < count; i++) fn (i);
+        return;
+    }
+
+    std::atomic<size_t> remaining (count);
+
+    // Deal the batches out across the queues, starting with the caller's own when it is one of the workers
+    const bool isWorker = (t_currentPool == this);
+    size_t queueIndex = isWorker ? t_currentQueue : _nextQueue.fetch_add (1) % _queues.size ();
+
+    for (size_t begin = 0; begin < count; begin += batchSize)
+    {
+        Task task = { &fn, begin, std::min (begin + batchSize, count), &remaining };
+        {
+            std::lock_guard<std::mutex> lock (_queues[queueIndex]->mutex);
+            _queues[queueIndex]->tasks.push_back (task);
+        }
+        _queuedTaskCount++;
+        queueIndex = (queueIndex + 1) % _queues.size ();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (_sleepMutex);
+    }
+    _workAvailable.notify_all ();
+
+    // Help out until every batch has been taken, then wait for the ones still running elsewhere
+    const size_t ownQueue = isWorker ? t_currentQueue : _queues.size () - 1;
+    while (remaining.load () != 0)
+    {
+        Task task;
+        if (popTask (ownQueue, task) || stealTask (ownQueue, task))
+        {
+            runTask (task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock (_sleepMutex);
+        _workCompleted.wait (lock, [&] { return remaining.load () == 0 || _queuedTaskCount.load () != 0; });
+    }
+}
+
+void AAPLThreadPool::workerMain (size_t queueIndex)
+{
+    t_currentPool = this;
+    t_currentQueue = queueIndex;
+
+    for (;;)
+    {
+        Task task;
+        if (popTask (queueIndex, task) || stealTask (queueIndex, task))
+        {
+            runTask (task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock (_sleepMutex);
+        _workAvailable.wait (lock, [&] { return _stopping || _queuedTaskCount.load () != 0; });
+        if (_stopping && _queuedTaskCount.load () == 0) return;
+    }
+}
+
+bool AAPLThreadPool::popTask (size_t queueIndex, Task& outTask)
+{
+    Queue& queue = *_queues[queueIndex];
+    std::lock_guard<std::mutex> lock (queue.mutex);
+    if (queue.tasks.empty ()) return false;
+
+    outTask = queue.tasks.back ();
+    queue.tasks.pop_back ();
+    _queuedTaskCount--;
+    return true;
+}
+
+bool AAPLThreadPool::stealTask (size_t thiefIndex, Task& outTask)
+{
+    for (size_t i = 1; i < _queues.size (); i++)
+    {
+        Queue& queue = *_queues[(thiefIndex + i) % _queues.size ()];
+        std::lock_guard<std::mutex> lock (queue.mutex);
+        if (queue.tasks.empty ()) continue;
+
+        outTask = queue.tasks.front ();
+        queue.tasks.pop_front ();
+        _queuedTaskCount--;
+        return true;
+    }
+    return false;
+}
+
+void AAPLThreadPool::runTask (const Task& task)
+{
+    for (size_t i = task.begin; i < task.end; i++)
+        (*task.fn) (i);
+
+    const size_t count = task.end - task.begin;
+    if (task.remaining->fetch_sub (count) == count)
+    {
+        std::lock_guard<std::mutex> lock (_sleepMutex);
+        _workCompleted.notify_all ();
+    }
+}
@@ -0,0 +1,73 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Declaration of the AAPLThreadPool class, a small work-stealing pool for running CPU side loops in parallel.
+ Each worker has its own queue of tasks and takes the newest from it first, and once that runs dry steals the
+ oldest task from the other queues, so uneven work evens itself out without a shared queue to contend on.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class AAPLThreadPool
+{
+public:
+    // The pool starts workerCount threads. Threads calling parallelFor work alongside them, so a pool with no
+    //  workers runs everything on the caller.
+    explicit AAPLThreadPool (unsigned workerCount = DefaultWorkerCount ());
+    ~AAPLThreadPool ();
+
+    AAPLThreadPool (const AAPLThreadPool&) = delete;
+    AAPLThreadPool& operator= (const AAPLThreadPool&) = delete;
+
+    // Runs fn(i) for every i in [0, count) and returns once they have all run. Iterations are handed out in
+    //  batches of up to batchSize; 0 picks a size that gives each thread several batches. Safe to call from
+    //  inside fn.
+    void            parallelFor (size_t count, const std::function<void (size_t)>& fn, size_t batchSize = 0);
+
+    unsigned        workerCount () const { return (unsigned) _threads.size (); }
+
+    // One worker for each core besides the calling thread's
+    static unsigned DefaultWorkerCount ();
+
+private:
+    struct Task
+    {
+        const std::function<void (size_t)>* fn;
+        size_t                              begin;
+        size_t                              end;
+        std::atomic<size_t>*                remaining;
+    };
+
+    struct Queue
+    {
+        std::mutex          mutex;
+        std::deque<Task>    tasks;
+    };
+
+    void            workerMain (size_t queueIndex);
+    bool            popTask (size_t queueIndex, Task& outTask);
+    bool            stealTask (size_t thiefIndex, Task& outTask);
+    void            runTask (const Task& task);
+
+    // One queue per worker, then a last one for tasks queued by threads outside the pool
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread>            _threads;
+    std::atomic<size_t>                 _queuedTaskCount;
+    std::atomic<size_t>                 _nextQueue;
+
+    std::mutex                          _sleepMutex;
+    std::condition_variable             _workAvailable;
+    std::condition_variable             _workCompleted;
+    bool                                _stopping;
+};
@@ -0,0 +1,224 @@
+// Checks AAPLTerrainBaker against a texel by texel model of TerrainKnl_ComputeNormalsFromHeightmap and
+//  TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap that samples through floating point texture coordinates as they
+//  do, to the tolerance AAPLTerrainBaker.h gives, and that its pixel formats round as the GPU's do. Then times full
+//  bakes of square heightmaps across the thread pool. The arguments are the sizes to time, 1024 by default; from
+//  1024 to 16384 shows how the bake scales.
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "AAPLTerrainBaker.h"
+#include "AAPLThreadPool.h"
+#include "TestSupport.h"
+
+using namespace simd;
+
+// The kernels, one texel at a time
+class KernelModel
+{
+public:
+    KernelModel (const uint16_t* heights, int width, int height)
+    : _heights (heights), _width (width), _height (height), _aoSamples (TerrainAOSampleDisk (256))
+    {
+    }
+
+    uint32_t normal (int x, int y) const
+    {
+        const float xz_scale = TERRAIN_SCALE / _width;
+        const float y_scale = TERRAIN_HEIGHT;
+        const float h_center = texel (x, y);
+
+        const float up[3]       = { 0, (texel (x, y + 1) - h_center) * y_scale, xz_scale };
+        const float down[3]     = { 0, (texel (x, y - 1) - h_center) * y_scale, -xz_scale };
+        const float right[3]    = { xz_scale, (texel (x + 1, y) - h_center) * y_scale, 0 };
+        const float left[3]     = { -xz_scale, (texel (x - 1, y) - h_center) * y_scale, 0 };
+
+        float crosses[4][3];
+        Cross (up, right, crosses[0]);
+        Cross (left, up, crosses[1]);
+        Cross (down, left, crosses[2]);
+        Cross (right, down, crosses[3]);
+
+        float n[3];
+        for (int c = 0; c < 3; c++)
+            n[c] = crosses[0][c] + crosses[1][c] + crosses[2][c] + crosses[3][c];
+        const float invLength = 1.0f / sqrtf (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        return AAPLTerrainBaker::PackNormal (n[0] * invLength * 0.5f + 0.5f, n[2] * invLength * 0.5f + 0.5f,
+                                             n[1] * invLength * 0.5f + 0.5f);
+    }
+
+    uint32_t properties (int x, int y) const
+    {
+        const float invWidth = 1.0f / _width, invHeight = 1.0f / _height;
+        const float u = (x + 0.5f) * invWidth, v = (y + 0.5f) * invHeight;
+
+        const float h_center = sample (u, v) + 0.001f;
+        int numVisible = 0;
+        for (float2 offset : _aoSamples)
+        {
+            if (sample (u + offset.x / _width, v + offset.y / _width) < h_center)
+                numVisible++;
+        }
+        const float aoVal = (float)numVisible / (float)_aoSamples.size ();
+
+        const float offset = 3.5f * invWidth;
+        const float center = sample (u, v);
+        float total = 0;
+        for (int j = -3; j <= 3; ++j)
+        {
+            for (int i = -3; i <= 3; ++i)
+            {
+                if (i == 0 && j == 0) continue;
+                total += sample (u + offset * i, v + offset * j) - center;
+            }
+        }
+        const float variance = std::max (total, 0.0f) / ((7*7)-1);
+
+        return AAPLTerrainBaker::PackProperties (aoVal, std::min (std::max (variance * 2, 0.0f), 1.0f), 0, 0);
+    }
+
+private:
+    static void Cross (const float a[3], const float b[3], float out[3])
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    float texel (int x, int y) const
+    {
+        x = std::min (std::max (x, 0), _width - 1);
+        y = std::min (std::max (y, 0), _height - 1);
+        return (float)_heights[(size_t)y * _width + x] / 65535.0f;
+    }
+
+    // Nearest sampling, clamped to the edges
+    float sample (float u, float v) const
+    {
+        return texel ((int)floorf (u * _width), (int)floorf (v * _height));
+    }
+
+    const uint16_t*             _heights;
+    int                         _width;
+    int                         _height;
+    std::vector<float2>         _aoSamples;
+};
+
+// Every RG11B10Float code unpacks and packs back to itself, and packing picks the nearest code
+static void TestPixelFormats ()
+{
+    for (uint32_t code = 0; code < 0x7c0; code++)
+    {
+        const uint32_t packed = code | (code << 11) | ((code >> 1) << 22);
+        float rgb[3];
+        AAPLTerrainBaker::UnpackNormal (packed, rgb);
+        TEST_CHECK (AAPLTerrainBaker::PackNormal (rgb[0], rgb[1], rgb[2]) == packed, "RG11B10Float %08x doesn't round trip", packed);
+    }
+
+    uint32_t seed = 1;
+    int misrounded = 0;
+    for (int i = 0; i < 1000000; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        const float f = ldexpf ((float)(seed >> 8) / (float)(1u << 24), -(int)(seed % 20));
+
+        const uint32_t code = AAPLTerrainBaker::PackNormal (f, 0, 0) & 0x7ff;
+        float nearest[3], below[3], above[3];
+        AAPLTerrainBaker::UnpackNormal (code, nearest);
+        AAPLTerrainBaker::UnpackNormal (code ? code - 1 : 0, below);
+        AAPLTerrainBaker::UnpackNormal (code + 1, above);
+        if (fabsf (nearest[0] - f) > fabsf (below[0] - f) || fabsf (nearest[0] - f) > fabsf (above[0] - f))
+            misrounded++;
+    }
+    TEST_CHECK (misrounded == 0, "%d floats packed to a code other than the nearest", misrounded);
+
+    for (uint32_t value = 0; value < 256; value++)
+    {
+        float rgba[4];
+        AAPLTerrainBaker::UnpackProperties (AAPLTerrainBaker::PackProperties (value / 255.0f, 0, 0, 0), rgba);
+        TEST_CHECK (rgba[0] == value / 255.0f, "RGBA8Unorm %u doesn't round trip", value);
+    }
+}
+
+static void TestAgainstKernels (AAPLThreadPool& pool, uint32_t width, uint32_t height)
+{
+    const std::vector<uint16_t> heights = TestHeightmap (width, height, width * height);
+    AAPLTerrainBaker baker (heights.data (), width, height);
+    baker.bake (pool);
+
+    const KernelModel model (heights.data (), (int)width, (int)height);
+    const bool powerOfTwo = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+
+    uint32_t normalsDiffering = 0, propertiesDiffering = 0, worstOcclusion = 0, worstVariance = 0;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const size_t i = (size_t)y * width + x;
+            if (baker.levels ()[0].normals[i] != model.normal ((int)x, (int)y))
+                normalsDiffering++;
+
+            const uint32_t a = baker.levels ()[0].properties[i], b = model.properties ((int)x, (int)y);
+            if (a != b)
+            {
+                propertiesDiffering++;
+                worstOcclusion = std::max (worstOcclusion, (uint32_t)abs ((int)(a & 0xff) - (int)(b & 0xff)));
+                worstVariance = std::max (worstVariance, (uint32_t)abs ((int)((a >> 8) & 0xff) - (int)((b >> 8) & 0xff)));
+                TEST_CHECK ((a >> 16) == (b >> 16), "%ux%u texel (%u, %u) has properties b and a of %04x", width, height, x, y, a >> 16);
+            }
+        }
+    }
+
+    TEST_CHECK (normalsDiffering == 0, "%u of the %ux%u normals differ from the kernel's", normalsDiffering, width, height);
+    if (powerOfTwo)
+        TEST_CHECK (propertiesDiffering == 0, "%u of the %ux%u properties differ from the kernel's", propertiesDiffering, width, height);
+    TEST_CHECK (worstOcclusion <= 1 && worstVariance <= 5, "%ux%u occlusion is up to %u/255 and variance up to %u/255 from the kernel's",
+                width, height, worstOcclusion, worstVariance);
+
+    // The same maps however many threads bake them
+    AAPLThreadPool serial (0);
+    AAPLTerrainBaker serialBaker (heights.data (), width, height);
+    serialBaker.bake (serial);
+    for (uint32_t level = 0; level < baker.mipCount (); level++)
+    {
+        TEST_CHECK (baker.levels ()[level].normals == serialBaker.levels ()[level].normals &&
+                    baker.levels ()[level].properties == serialBaker.levels ()[level].properties,
+                    "%ux%u level %u differs baked on one thread", width, height, level);
+    }
+}
+
+static void Bench (AAPLThreadPool& pool, uint32_t size)
+{
+    const std::vector<uint16_t> heights = TestHeightmap (size, size, 1);
+    AAPLTerrainBaker baker (heights.data (), size, size);
+
+    const double seconds = TestTime (1, [&] { baker.bake (pool); });
+    printf ("%6u^2: %8.3f s, %7.1f Mtexels/s, %2u mips\n", size, seconds, (double)size * size / seconds / 1e6, baker.mipCount ());
+    fflush (stdout);
+}
+
+int main (int argc, const char* argv[])
+{
+    AAPLThreadPool pool;
+
+    TestPixelFormats ();
+
+    const uint32_t sizes[][2] = { { 256, 256 }, { 128, 64 }, { 192, 128 }, { 200, 136 }, { 96, 160 }, { 37, 5 }, { 1, 1 } };
+    for (const auto& size : sizes)
+        TestAgainstKernels (pool, size[0], size[1]);
+
+    printf ("Full bakes with %u workers and the calling thread:\n", pool.workerCount ());
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            Bench (pool, (uint32_t)atoi (argv[i]));
+    }
+    else
+    {
+        Bench (pool, 1024);
+    }
+
+    if (gTestFailures == 0) printf ("AAPLTerrainBakerBench: all passed\n");
+    return gTestFailures != 0;
+}
@@ -0,0 +1,255 @@
+// Checks AAPLTerrainHeightBounds against ranges worked out by brute force: every texel of every level, after a full
+//  build and after updates for random edits and brush strokes, rectangle queries and patch boxes. It then checks the
+//  occlusion bake's early-out: wherever the bounds over a texel's occlusion margins say every sample is visible,
+//  AAPLTerrainBaker, which reads every sample, must find them all visible too.
+
+#include <math.h>
+
+#include "AAPLTerrainBaker.h"
+#include "AAPLTerrainHeightBounds.h"
+#include "AAPLThreadPool.h"
+#include "TestSupport.h"
+
+static uint32_t gSeed = 7;
+
+static uint32_t Random ()
+{
+    gSeed = gSeed * 1664525u + 1013904223u;
+    return gSeed >> 8;
+}
+
+static const AAPLTerrainHeightRange kEmptyRange = { 65535, 0 };
+
+static void Include (AAPLTerrainHeightRange& range, uint16_t h)
+{
+    range.min = std::min (range.min, h);
+    range.max = std::max (range.max, h);
+}
+
+// The range of heightmap texels [x0, x1) x [y0, y1), clamped to the heightmap
+static AAPLTerrainHeightRange ExactRange (const std::vector<uint16_t>& heights, uint32_t width, uint32_t height,
+                                          int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    AAPLTerrainHeightRange range = kEmptyRange;
+    for (int32_t y = std::max (y0, 0); y < std::min (y1, (int32_t)height); y++)
+    {
+        for (int32_t x = std::max (x0, 0); x < std::min (x1, (int32_t)width); x++)
+            Include (range, heights[(size_t)y * width + x]);
+    }
+    return range;
+}
+
+// Every texel of every level holds the range of the heightmap texels under it, with the last row and column of a
+//  level also covering what an odd sized level above leaves over
+static void CheckLevels (const AAPLTerrainHeightBounds& bounds, const std::vector<uint16_t>& heights, const char* when)
+{
+    const uint32_t width = bounds.width ();
+    const uint32_t height = bounds.height ();
+    for (uint32_t level = 1; level < bounds.levelCount (); level++)
+    {
+        const uint32_t levelWidth = bounds.levelWidth (level);
+        const uint32_t levelHeight = bounds.levelHeight (level);
+
+        std::vector<AAPLTerrainHeightRange> expected ((size_t)levelWidth * levelHeight, kEmptyRange);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const uint32_t tx = std::min (x >> level, levelWidth - 1);
+                const uint32_t ty = std::min (y >> level, levelHeight - 1);
+                Include (expected[(size_t)ty * levelWidth + tx], heights[(size_t)y * width + x]);
+            }
+        }
+
+        uint32_t wrong = 0;
+        for (size_t i = 0; i < expected.size (); i++)
+        {
+            if (expected[i].min != bounds.level (level)[i].min || expected[i].max != bounds.level (level)[i].max)
+                wrong++;
+        }
+        TEST_CHECK (wrong == 0, "%u x %u %s: %u of level %u's texels are wrong", width, height, when, wrong, level);
+    }
+}
+
+static void TestPyramid (uint32_t width, uint32_t height)
+{
+    std::vector<uint16_t> heights ((size_t)width * height);
+    for (uint16_t& h : heights)
+        h = (uint16_t)Random ();
+
+    AAPLTerrainHeightBounds bounds (heights.data (), width, height);
+    bounds.build ();
+    CheckLevels (bounds, heights, "after a build");
+
+    // Queries over rectangles of every size, some hanging off the heightmap or off it altogether
+    uint32_t loose = 0;
+    for (int q = 0; q < 2000; q++)
+    {
+        const int32_t x0 = (int32_t)(Random () % (width + 20)) - 10;
+        const int32_t y0 = (int32_t)(Random () % (height + 20)) - 10;
+        const int32_t x1 = x0 + (int32_t)(Random () % (width + 5));
+        const int32_t y1 = y0 + (int32_t)(Random () % (height + 5));
+
+        const AAPLTerrainHeightRange range = bounds.query (x0, y0, x1, y1);
+        const AAPLTerrainHeightRange exact = ExactRange (heights, width, height, x0, y0, x1, y1);
+        if (range.min > exact.min || range.max < exact.max)
+            loose++;
+    }
+    TEST_CHECK (loose == 0, "%u x %u: %u queries miss some of the range", width, height, loose);
+
+    // Random edits and brush strokes, each followed by an update of just the bounds they touch
+    for (int edit = 0; edit < 40; edit++)
+    {
+        const int32_t x0 = (int32_t)(Random () % width);
+        const int32_t y0 = (int32_t)(Random () % height);
+        TerrainRebakePass changed = TerrainMakeRebakePass (x0, y0, x0 + 1 + (int32_t)(Random () % std::max (width / 4, 1u)),
+                                                           y0 + 1 + (int32_t)(Random () % std::max (height / 4, 1u)),
+                                                           0, width, height);
+        if (edit % 3 == 0)
+        {
+            const float brushX = ((float)(Random () % 1000) / 1000.0f - 0.5f) * TERRAIN_SCALE * 1.1f;
+            const float brushZ = ((float)(Random () % 1000) / 1000.0f - 0.5f) * TERRAIN_SCALE * 1.1f;
+            changed = TerrainBrushRebakePass (brushX, brushZ, (float)(Random () % 400 + 1), width, height);
+        }
+
+        // Raising only some heights and replacing others, so ranges both grow and shrink
+        for (uint32_t y = changed.origin.y; y < changed.end.y; y++)
+        {
+            for (uint32_t x = changed.origin.x; x < changed.end.x; x++)
+            {
+                uint16_t& h = heights[(size_t)y * width + x];
+                h = (edit & 1) ? (uint16_t)Random () : (uint16_t)std::min (65535u, h + Random () % 3000);
+            }
+        }
+
+        TerrainRebakePass passes[TerrainRebakePassCOUNT];
+        TerrainFillRebakePasses (passes, changed, width, height, bounds.levelCount ());
+        bounds.update (passes);
+    }
+    CheckLevels (bounds, heights, "after updates");
+}
+
+// A patch's box holds everything it can draw: the vertices sample the heightmap linearly, with mirrored repeat
+static void TestPatchBounds (uint32_t width, uint32_t height)
+{
+    const std::vector<uint16_t> heights = TestHeightmap (width, height, 3);
+    AAPLTerrainHeightBounds bounds (heights.data (), width, height);
+    bounds.build ();
+
+    auto Mirror = [] (int32_t i, int32_t n)
+    {
+        if (i < 0) i = -1 - i;
+        if (i >= n) i = 2 * n - 1 - i;
+        return std::min (std::max (i, 0), n - 1);
+    };
+    auto Height = [&] (int32_t x, int32_t y)
+    {
+        return heights[(size_t)Mirror (y, (int32_t)height) * width + Mirror (x, (int32_t)width)] / 65535.0f;
+    };
+
+    uint32_t outside = 0;
+    for (uint32_t patchesPerSide : { 1u, 4u, 32u })
+    {
+        for (uint32_t patchY = 0; patchY < patchesPerSide; patchY++)
+        {
+            for (uint32_t patchX = 0; patchX < patchesPerSide; patchX++)
+            {
+                simd::float3 boxMin, boxMax;
+                bounds.patchBounds (patchX, patchY, patchesPerSide, boxMin, boxMax);
+
+                // The patch's corners, and points across it
+                for (int s = 0; s < 36; s++)
+                {
+                    const float fu = (s < 4) ? (float)(s & 1) : (float)(Random () % 10001) / 10000.0f;
+                    const float fv = (s < 4) ? (float)(s >> 1) : (float)(Random () % 10001) / 10000.0f;
+                    const float u = (patchX + fu) / patchesPerSide;
+                    const float v = (patchY + fv) / patchesPerSide;
+
+                    const float tx = u * width - 0.5f, ty = v * height - 0.5f;
+                    const int32_t ix = (int32_t)floorf (tx), iy = (int32_t)floorf (ty);
+                    const float ax = tx - ix, ay = ty - iy;
+                    const float h = (Height (ix, iy) * (1 - ax) + Height (ix + 1, iy) * ax) * (1 - ay) +
+                                    (Height (ix, iy + 1) * (1 - ax) + Height (ix + 1, iy + 1) * ax) * ay;
+
+                    const float px = (u - 0.5f) * TERRAIN_SCALE, py = h * TERRAIN_HEIGHT, pz = (v - 0.5f) * TERRAIN_SCALE;
+                    if (py < boxMin.y || py > boxMax.y ||
+                        px < boxMin.x - 1e-2f || px > boxMax.x + 1e-2f || pz < boxMin.z - 1e-2f || pz > boxMax.z + 1e-2f)
+                        outside++;
+                }
+            }
+        }
+    }
+    TEST_CHECK (outside == 0, "%u x %u: %u points of patches are outside their boxes", width, height, outside);
+}
+
+// As TerrainKnl_ComputeOcclusionAndSlopeFromHeightmap's early-out: the bounds over the texel's occlusion margins are
+//  all below the center's height, so every sample counts as visible
+static void TestOcclusionEarlyOut (AAPLThreadPool& pool, const std::vector<uint16_t>& heights, uint32_t width,
+                                   uint32_t height, const char* name)
+{
+    AAPLTerrainHeightBounds bounds (heights.data (), width, height);
+    bounds.build ();
+    AAPLTerrainBaker baker (heights.data (), width, height);
+    baker.bake (pool);
+
+    uint32_t settled = 0, wrong = 0;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const TerrainRebakePass disk = TerrainExpandRebakePass (TerrainMakeRebakePass ((int)x, (int)y, (int)x + 1, (int)y + 1,
+                                                                                           0, width, height),
+                                                                    TerrainOcclusionMarginX (),
+                                                                    TerrainOcclusionMarginY (width, height),
+                                                                    width, height);
+            const AAPLTerrainHeightRange range = bounds.query ((int32_t)disk.origin.x, (int32_t)disk.origin.y,
+                                                              (int32_t)disk.end.x, (int32_t)disk.end.y);
+
+            const float center = heights[(size_t)y * width + x] / 65535.0f + 0.001f;
+            if (range.max / 65535.0f < center)
+            {
+                settled++;
+                float properties[4];
+                AAPLTerrainBaker::UnpackProperties (baker.levels ()[0].properties[(size_t)y * width + x], properties);
+                if (properties[0] != 1.0f)
+                    wrong++;
+            }
+        }
+    }
+    TEST_CHECK (wrong == 0, "%s: %u of the %u texels the early-out settles are occluded", name, wrong, settled);
+    TEST_CHECK (settled > 0, "%s: the early-out settles no texels", name);
+    printf ("%s %u x %u: the early-out settles %.1f%% of texels\n", name, width, height,
+            100.0 * settled / ((double)width * height));
+}
+
+int main ()
+{
+    const uint32_t sizes[][2] = { { 1, 1 }, { 1, 9 }, { 13, 1 }, { 5, 5 }, { 37, 5 }, { 96, 160 },
+                                  { 129, 67 }, { 256, 256 }, { 333, 777 } };
+    for (const auto& size : sizes)
+        TestPyramid (size[0], size[1]);
+
+    TestPatchBounds (256, 256);
+    TestPatchBounds (200, 136);
+
+    AAPLThreadPool pool;
+
+    // The test terrain, and terraces of it, whose flat tops the early-out settles
+    for (uint32_t size : { 256u, 300u })
+    {
+        std::vector<uint16_t> heights = TestHeightmap (size, size, 11);
+        TestOcclusionEarlyOut (pool, heights, size, size, "hills");
+        for (uint16_t& h : heights)
+            h = (uint16_t)(h / 8192 * 8192);
+        TestOcclusionEarlyOut (pool, heights, size, size, "terraces");
+
+        // And flat ground with lone spikes, which a sample from near the edge of the margins can just reach
+        for (uint16_t& h : heights)
+            h = (Random () % 8000 == 0) ? 65535 : 20000;
+        TestOcclusionEarlyOut (pool, heights, size, size, "spikes");
+    }
+
+    if (gTestFailures == 0)
+        printf ("AAPLTerrainHeightBoundsTest: all passed\n");
+    return gTestFailures != 0;
+}
@@ -0,0 +1,368 @@
+// Checks the patches AAPLTerrainQuadtree picks along camera paths over the test terrain: they cover each spot of the
+//  terrain at most once, neighbors are within a depth of each other, the vertices of every shared edge are in the
+//  same places on both sides, so no cracks open, and factors are powers of two the pipelines allow. Also checks that
+//  node errors shrink with finer factors and deeper nodes, and that updating the quadtree for brush strokes gives
+//  the same errors as building it again, and times select along the paths. Pass a number of frames to time longer
+//  paths.
+
+#include <map>
+#include <math.h>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AAPLTerrainQuadtree.h"
+#include "TestSupport.h"
+
+using simd::float3;
+using simd::float4;
+
+static float3 Add (float3 a, float3 b)          { return float3 { a.x + b.x, a.y + b.y, a.z + b.z }; }
+static float3 Scale (float3 a, float s)         { return float3 { a.x * s, a.y * s, a.z * s }; }
+static float  Dot (float3 a, float3 b)          { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static float3 Normalize (float3 a)              { return Scale (a, 1.0f / sqrtf (Dot (a, a))); }
+static float3 Cross (float3 a, float3 b)        { return float3 { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+// A 60 degree, 16:9 camera drawing 1080 rows
+static const float kProjectionYScale = 1.73205066f;
+static const float kAspect = 16.0f / 9.0f;
+static const float kPixelsPerUnit = kProjectionYScale * 0.5f * 1080.0f;
+
+struct Camera
+{
+    float3  position;
+    float3  forward;
+};
+
+// The six planes of the camera's frustum, facing in
+static void FrustumPlanes (const Camera& camera, float4 outPlanes[6])
+{
+    const float3 f = Normalize (camera.forward);
+    const float3 r = Normalize (Cross (float3 { 0, 1, 0 }, f));
+    const float3 u = Cross (f, r);
+    const float tanY = 1.0f / kProjectionYScale, tanX = tanY * kAspect;
+    const float cosX = 1 / sqrtf (1 + tanX * tanX), sinX = tanX * cosX;
+    const float cosY = 1 / sqrtf (1 + tanY * tanY), sinY = tanY * cosY;
+
+    const float3 normals[4] = { Add (Scale (r, cosX), Scale (f, sinX)), Add (Scale (r, -cosX), Scale (f, sinX)),
+                                Add (Scale (u, cosY), Scale (f, sinY)), Add (Scale (u, -cosY), Scale (f, sinY)) };
+    for (int i = 0; i < 4; i++)
+        outPlanes[i] = float4 { normals[i].x, normals[i].y, normals[i].z, -Dot (normals[i], camera.position) };
+    outPlanes[4] = float4 { f.x, f.y, f.z, -(Dot (f, camera.position) + 1.0f) };
+    outPlanes[5] = float4 { -f.x, -f.y, -f.z, Dot (f, camera.position) + 60000.0f };
+}
+
+// The log2 of a power of two half float
+static uint32_t FactorLog2 (uint16_t factor)
+{
+    return (uint32_t)(factor >> 10) - 15;
+}
+
+struct Patches
+{
+    std::vector<uint32_t>                   indices;
+    std::vector<AAPLTerrainPatchFactors>    factors;
+    uint32_t                                count;
+};
+
+// The places, in 16ths of a deepest node, of the vertices along edge `edge` of patch i, and the span of the edge
+static void EdgeVertices (const Patches& patches, uint32_t i, int edge, uint32_t maxDepth,
+                          std::set<int>& outVertices, int& outBegin, int& outEnd)
+{
+    const TerrainQuadtreeNode node = TerrainQuadtreeNodeFromPatchIndex (patches.indices[i]);
+    const int size = (1 << (maxDepth - node.depth)) * (1 << AAPLTerrainQuadtree::kMaxFactorLog2);
+    const int begin = (int)((edge % 2 == 0) ? node.y : node.x) * size;
+    const int factor = 1 << FactorLog2 (patches.factors[i].edge[edge]);
+    for (int t = 0; t <= factor; t++)
+        outVertices.insert (begin + t * size / factor);
+    outBegin = begin;
+    outEnd = begin + size;
+}
+
+// Returns the number of problems with the patches, printing the first few
+static uint32_t CheckPatches (const Patches& patches, uint32_t maxDepth)
+{
+    uint32_t problems = 0;
+    auto Problem = [&problems] (const char* what, uint32_t i)
+    {
+        if (problems++ < 5) fprintf (stderr, "patch %u: %s\n", i, what);
+    };
+
+    // Which patch covers each deepest node
+    const int cells = 1 << maxDepth;
+    std::vector<int> covering ((size_t)cells * cells, -1);
+    for (uint32_t i = 0; i < patches.count; i++)
+    {
+        const TerrainQuadtreeNode node = TerrainQuadtreeNodeFromPatchIndex (patches.indices[i]);
+        if (node.depth > maxDepth || node.x >= (1u << node.depth) || node.y >= (1u << node.depth))
+        {
+            Problem ("isn't a node of the quadtree", i);
+            continue;
+        }
+
+        const uint32_t shift = maxDepth - node.depth;
+        for (uint32_t y = node.y << shift; y < (node.y + 1) << shift; y++)
+        {
+            for (uint32_t x = node.x << shift; x < (node.x + 1) << shift; x++)
+            {
+                if (covering[(size_t)y * cells + x] != -1) Problem ("overlaps another", i);
+                covering[(size_t)y * cells + x] = (int)i;
+            }
+        }
+
+        for (int edge = 0; edge < 4; edge++)
+        {
+            if (patches.factors[i].edge[edge] < 0x3C00 || FactorLog2 (patches.factors[i].edge[edge]) > AAPLTerrainQuadtree::kMaxFactorLog2)
+                Problem ("has an edge factor out of range", i);
+        }
+        if (FactorLog2 (patches.factors[i].inside[0]) > AAPLTerrainQuadtree::kMaxFactorLog2 ||
+            patches.factors[i].inside[0] != patches.factors[i].inside[1])
+            Problem ("has inside factors out of range", i);
+    }
+    if (problems > 0) return problems;
+
+    for (uint32_t i = 0; i < patches.count; i++)
+    {
+        const TerrainQuadtreeNode node = TerrainQuadtreeNodeFromPatchIndex (patches.indices[i]);
+        const int shift = (int)(maxDepth - node.depth), size = 1 << shift;
+        const int x0 = (int)node.x << shift, y0 = (int)node.y << shift;
+
+        for (int edge = 0; edge < 4; edge++)
+        {
+            // The patches across the edge, at x = 0, y = 0, x = 1 and y = 1
+            std::set<int> neighbors;
+            for (int t = 0; t < size; t++)
+            {
+                const int x = (edge == 0) ? x0 - 1 : (edge == 2) ? x0 + size : x0 + t;
+                const int y = (edge == 1) ? y0 - 1 : (edge == 3) ? y0 + size : y0 + t;
+                if (x >= 0 && y >= 0 && x < cells && y < cells && covering[(size_t)y * cells + x] >= 0)
+                    neighbors.insert (covering[(size_t)y * cells + x]);
+            }
+
+            std::set<int> mine;
+            int begin, end;
+            EdgeVertices (patches, i, edge, maxDepth, mine, begin, end);
+            for (int neighbor : neighbors)
+            {
+                const TerrainQuadtreeNode other = TerrainQuadtreeNodeFromPatchIndex (patches.indices[neighbor]);
+                if (abs ((int)other.depth - (int)node.depth) > 1)
+                    Problem ("is more than a depth from a neighbor", i);
+
+                std::set<int> theirs;
+                int otherBegin, otherEnd;
+                EdgeVertices (patches, (uint32_t)neighbor, edge ^ 2, maxDepth, theirs, otherBegin, otherEnd);
+
+                // Along the part of the edge they share, both put their vertices in the same places
+                const int sharedBegin = std::max (begin, otherBegin), sharedEnd = std::min (end, otherEnd);
+                std::set<int> mineShared, theirsShared;
+                for (int v : mine)   if (v >= sharedBegin && v <= sharedEnd) mineShared.insert (v);
+                for (int v : theirs) if (v >= sharedBegin && v <= sharedEnd) theirsShared.insert (v);
+                if (mineShared != theirsShared)
+                    Problem ("has a crack with a neighbor", i);
+            }
+        }
+    }
+    return problems;
+}
+
+static void TestErrors (const AAPLTerrainQuadtree& quadtree)
+{
+    uint32_t wrong = 0;
+    for (uint32_t depth = 0; depth <= quadtree.maxDepth (); depth++)
+    {
+        for (uint32_t y = 0; y < (1u << depth); y++)
+        {
+            for (uint32_t x = 0; x < (1u << depth); x++)
+            {
+                for (uint32_t j = 0; j < AAPLTerrainQuadtree::kMaxFactorLog2; j++)
+                {
+                    if (quadtree.nodeError (depth, x, y, j + 1) > quadtree.nodeError (depth, x, y, j))
+                        wrong++;
+                }
+                if (depth == quadtree.maxDepth ()) continue;
+                for (uint32_t child = 0; child < 4; child++)
+                {
+                    for (uint32_t j = 0; j <= AAPLTerrainQuadtree::kMaxFactorLog2; j++)
+                    {
+                        if (quadtree.nodeError (depth + 1, 2 * x + (child & 1), 2 * y + (child >> 1), j) > quadtree.nodeError (depth, x, y, j))
+                            wrong++;
+                    }
+                }
+            }
+        }
+    }
+    TEST_CHECK (wrong == 0, "%u node errors grow with a finer factor or a deeper node", wrong);
+}
+
+static std::vector<Camera> CameraPath (const char* name, uint32_t frames, const std::vector<uint16_t>& heights, uint32_t width)
+{
+    auto Ground = [&] (float x, float z)
+    {
+        const int tx = std::min (std::max ((int)((x / TERRAIN_SCALE + 0.5f) * width), 0), (int)width - 1);
+        const int ty = std::min (std::max ((int)((z / TERRAIN_SCALE + 0.5f) * width), 0), (int)width - 1);
+        return heights[(size_t)ty * width + tx] / 65535.0f * TERRAIN_HEIGHT;
+    };
+
+    std::vector<Camera> cameras;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        const float t = (float)i / frames;
+        Camera camera;
+        if (strcmp (name, "flyover") == 0)
+        {
+            const float x = -6500 + 13000 * t, z = -3000 + 2000 * sinf (t * 6.28f);
+            camera = Camera { { x, Ground (x, z) + 60, z }, { 1, -0.15f, 0.3f * cosf (t * 6.28f) } };
+        }
+        else if (strcmp (name, "orbit") == 0)
+        {
+            const float a = t * 6.28f;
+            camera = Camera { { 5000 * cosf (a), 3000, 5000 * sinf (a) }, { -5000 * cosf (a), -2000, -5000 * sinf (a) } };
+        }
+        else
+        {
+            // Swaying a little about a point, as a hand held camera would
+            const float sway = 40.0f * sinf (i * 0.9f);
+            camera = Camera { { 1200 + sway, Ground (1200, 800) + 120 + 0.4f * cosf (i * 1.3f), 800 + 0.6f * sway }, { -1, -0.2f, -0.6f } };
+        }
+        cameras.push_back (camera);
+    }
+    return cameras;
+}
+
+static void TestCameraPaths (const std::vector<uint16_t>& heights, uint32_t width, uint32_t frames)
+{
+    for (const char* name : { "flyover", "orbit", "sway" })
+    {
+        for (float hysteresis : { 0.0f, 0.2f })
+        {
+            AAPLTerrainQuadtree quadtree (heights.data (), width, width);
+            quadtree.build ();
+
+            Patches patches;
+            patches.indices.resize (quadtree.maxPatchCount ());
+            patches.factors.resize (quadtree.maxPatchCount ());
+
+            double seconds = 0;
+            uint64_t patchCount = 0, changes = 0;
+            uint32_t problems = 0;
+            std::map<uint32_t, uint64_t> previous;
+            for (const Camera& camera : CameraPath (name, frames, heights, width))
+            {
+                float4 planes[6];
+                FrustumPlanes (camera, planes);
+                const AAPLTerrainQuadtreeView view = { camera.position, kPixelsPerUnit, 2.0f, hysteresis, planes, 1 };
+                seconds += TestTime (1, [&] { patches.count = quadtree.select (view, patches.indices.data (), patches.factors.data ()); });
+                problems += CheckPatches (patches, quadtree.maxDepth ());
+                patchCount += patches.count;
+
+                // Patches that are new, or have new factors, since the last frame
+                std::map<uint32_t, uint64_t> current;
+                for (uint32_t i = 0; i < patches.count; i++)
+                {
+                    uint64_t factors = 0;
+                    memcpy (&factors, &patches.factors[i], sizeof (factors));
+                    current[patches.indices[i]] = factors;
+                }
+                for (const auto& patch : current)
+                {
+                    auto found = previous.find (patch.first);
+                    if (found == previous.end () || found->second != patch.second) changes++;
+                }
+                previous.swap (current);
+            }
+            TEST_CHECK (problems == 0, "%s, hysteresis %.1f: %u problems with the patches", name, hysteresis, problems);
+
+            printf ("%-8s hysteresis %.1f: %.3f ms a select, %.0f patches, %.1f changed a frame\n", name, hysteresis,
+                    seconds * 1000 / frames, (double)patchCount / frames, (double)changes / frames);
+        }
+    }
+}
+
+static void TestUpdate (std::vector<uint16_t> heights, uint32_t width, uint32_t height)
+{
+    AAPLTerrainQuadtree updated (heights.data (), width, height);
+    updated.build ();
+
+    uint32_t seed = 7;
+    auto Random = [&seed] () { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+    double seconds = 0;
+    const int strokes = 100;
+    for (int stroke = 0; stroke < strokes; stroke++)
+    {
+        const float brushX = ((float)(Random () % 10000) / 10000.0f - 0.5f) * TERRAIN_SCALE;
+        const float brushZ = ((float)(Random () % 10000) / 10000.0f - 0.5f) * TERRAIN_SCALE;
+        const TerrainRebakePass changed = TerrainBrushRebakePass (brushX, brushZ, 50.0f + Random () % 550, width, height);
+        for (uint32_t y = changed.origin.y; y < changed.end.y; y++)
+        {
+            for (uint32_t x = changed.origin.x; x < changed.end.x; x++)
+            {
+                uint16_t& h = heights[(size_t)y * width + x];
+                h = (uint16_t)std::min (std::max ((int)h + (int)(Random () % 4001) - 1500, 0), 65535);
+            }
+        }
+
+        TerrainRebakePass passes[TerrainRebakePassCOUNT];
+        TerrainFillRebakePasses (passes, changed, width, height, updated.heightBounds ().levelCount ());
+        seconds += TestTime (1, [&] { updated.update (passes); });
+    }
+
+    AAPLTerrainQuadtree built (heights.data (), width, height);
+    built.build ();
+    uint32_t different = 0;
+    for (uint32_t depth = 0; depth <= built.maxDepth (); depth++)
+    {
+        for (uint32_t y = 0; y < (1u << depth); y++)
+        {
+            for (uint32_t x = 0; x < (1u << depth); x++)
+            {
+                for (uint32_t j = 0; j <= AAPLTerrainQuadtree::kMaxFactorLog2; j++)
+                {
+                    if (updated.nodeError (depth, x, y, j) != built.nodeError (depth, x, y, j))
+                        different++;
+                }
+            }
+        }
+    }
+    TEST_CHECK (different == 0, "%u x %u: %u node errors differ from a fresh build after %d strokes", width, height,
+                different, strokes);
+    printf ("%u x %u: %.3f ms to update a stroke\n", width, height, seconds * 1000 / strokes);
+}
+
+int main (int argc, const char* argv[])
+{
+    const uint32_t frames = (argc > 1) ? (uint32_t)atoi (argv[1]) : 150;
+    const uint32_t width = 1024;
+    // The test terrain's noise flattened, so it is the hills that decide how deep the quadtree goes
+    std::vector<uint16_t> heights = TestHeightmap (width, width, 5);
+    for (uint16_t& h : heights)
+        h = (uint16_t)(h / 8 + 16384);
+
+    AAPLTerrainQuadtree quadtree (heights.data (), width, width);
+    const double buildSeconds = TestTime (1, [&] { quadtree.build (); });
+    printf ("%u x %u: depth %u, built in %.2f ms\n", width, width, quadtree.maxDepth (), buildSeconds * 1000);
+    TestErrors (quadtree);
+
+    TestCameraPaths (heights, width, frames);
+    TestUpdate (heights, width, width);
+
+    // An odd size, seen from above with no frustum to cull against
+    {
+        const std::vector<uint16_t> odd = TestHeightmap (1000, 700, 9);
+        AAPLTerrainQuadtree oddQuadtree (odd.data (), 1000, 700);
+        oddQuadtree.build ();
+        TestErrors (oddQuadtree);
+
+        Patches patches;
+        patches.indices.resize (oddQuadtree.maxPatchCount ());
+        patches.factors.resize (oddQuadtree.maxPatchCount ());
+        const AAPLTerrainQuadtreeView view = { { 0, 500, 0 }, kPixelsPerUnit, 1.0f, 0.2f, nullptr, 0 };
+        patches.count = oddQuadtree.select (view, patches.indices.data (), patches.factors.data ());
+        TEST_CHECK (CheckPatches (patches, oddQuadtree.maxDepth ()) == 0, "1000 x 700: problems with the patches");
+        TestUpdate (odd, 1000, 700);
+    }
+
+    if (gTestFailures == 0)
+        printf ("AAPLTerrainQuadtreeTest: all passed\n");
+    return gTestFailures != 0;
+}
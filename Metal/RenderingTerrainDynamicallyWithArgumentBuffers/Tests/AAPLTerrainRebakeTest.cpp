@@ -0,0 +1,145 @@
+// Checks that rebaking only what a brush stroke touches gives the same maps, bit for bit, as baking the whole
+//  terrain again. Each stroke is applied as TerrainKnl_UpdateHeightmap applies it: once to every texel, followed by a
+//  full bake, and once to just the texels of the passes TerrainFillRebakePasses works out from
+//  TerrainBrushRebakePass, followed by a bake of those passes. AAPLTerrainBaker stands in for the GPU kernels.
+
+#include <math.h>
+#include <string.h>
+
+#include "AAPLTerrainBaker.h"
+#include "AAPLThreadPool.h"
+#include "TestSupport.h"
+
+// As evaluateModificationBrush
+static float BrushStrength (float x, float z, float brushX, float brushZ, float brushSize)
+{
+    const float dist = sqrtf ((x - brushX) * (x - brushX) + (z - brushZ) * (z - brushZ)) / brushSize;
+    const float strength = std::min (2 - dist, 1.0f / (1.0f + powf (dist * 2.0f, 4)));
+    return std::min (std::max (strength, 0.0f), 1.0f);
+}
+
+// As TerrainKnl_UpdateHeightmap over the texels of pass, writing back to R16Unorm
+static void ApplyBrush (std::vector<uint16_t>& heights, uint32_t width, const TerrainRebakePass& pass,
+                        float brushX, float brushZ, float brushSize, bool lower)
+{
+    for (uint32_t y = pass.origin.y; y < pass.end.y; y++)
+    {
+        for (uint32_t x = pass.origin.x; x < pass.end.x; x++)
+        {
+            const float worldX = ((float)x / width - 0.5f) * TERRAIN_SCALE;
+            const float worldZ = ((float)y / width - 0.5f) * TERRAIN_SCALE;
+            float displacement = BrushStrength (worldX, worldZ, brushX, brushZ, brushSize) * 0.008f;
+            if (lower) displacement = -displacement;
+
+            uint16_t& h = heights[(size_t)y * width + x];
+            const float value = std::min (std::max ((float)h / 65535.0f + displacement, 0.0f), 1.0f);
+            h = (uint16_t)lrintf (value * 65535.0f);
+        }
+    }
+}
+
+static bool SameMaps (const AAPLTerrainBaker& a, const AAPLTerrainBaker& b, uint32_t& outLevel)
+{
+    for (outLevel = 0; outLevel < a.mipCount (); outLevel++)
+    {
+        if (a.levels ()[outLevel].normals != b.levels ()[outLevel].normals ||
+            a.levels ()[outLevel].properties != b.levels ()[outLevel].properties)
+            return false;
+    }
+    return true;
+}
+
+static void TestStrokes (AAPLThreadPool& pool, uint32_t width, uint32_t height, uint64_t& ioTouched, uint64_t& ioTotal)
+{
+    std::vector<uint16_t> fullHeights = TestHeightmap (width, height, width * height);
+    std::vector<uint16_t> heights = fullHeights;
+
+    AAPLTerrainBaker incremental (heights.data (), width, height);
+    incremental.bake (pool);
+
+    const TerrainRebakePass everything = TerrainMakeRebakePass (0, 0, (int)width, (int)height, 0, width, height);
+
+    uint32_t seed = 7;
+    auto Random = [&seed] () { seed = seed * 1664525u + 1013904223u; return (float)(seed >> 8) / (float)(1u << 24); };
+
+    for (int stroke = 0; stroke < 48; stroke++)
+    {
+        // Strokes inside the terrain, on its corners and edges, off it altogether, and at the far end of a float
+        float brushX = (Random () - 0.5f) * TERRAIN_SCALE * 1.1f;
+        float brushZ = (Random () - 0.5f) * TERRAIN_SCALE * 1.1f;
+        switch (stroke % 8)
+        {
+            case 0: brushX = brushZ = -TERRAIN_SCALE / 2;           break;
+            case 1: brushX = TERRAIN_SCALE / 2;                     break;
+            case 2: brushX = TERRAIN_SCALE * 3; brushZ = 0;         break;
+            case 3: brushX = 1e30f; brushZ = -1e30f;                break;
+            default:                                                break;
+        }
+        const float brushSize = (stroke % 3 == 0) ? 1000.0f : ((stroke % 3 == 1) ? 7000.0f : 150.0f);
+        const bool lower = stroke % 4 == 3;
+
+        ApplyBrush (fullHeights, width, everything, brushX, brushZ, brushSize, lower);
+        AAPLTerrainBaker full (fullHeights.data (), width, height);
+        full.bake (pool);
+
+        TerrainRebakePass passes[TerrainRebakePassCOUNT];
+        TerrainFillRebakePasses (passes, TerrainBrushRebakePass (brushX, brushZ, brushSize, width, height),
+                                 width, height, incremental.mipCount ());
+        ApplyBrush (heights, width, passes[TerrainRebakePassHeights], brushX, brushZ, brushSize, lower);
+        incremental.bake (pool, passes);
+
+        uint32_t level;
+        TEST_CHECK (heights == fullHeights, "%ux%u stroke %d at (%g, %g) changed heights outside its pass",
+                    width, height, stroke, brushX, brushZ);
+        TEST_CHECK (SameMaps (incremental, full, level), "%ux%u stroke %d at (%g, %g), size %g: level %u differs from a full bake",
+                    width, height, stroke, brushX, brushZ, brushSize, level);
+
+        // Carry on from the full bake's heights either way, so one failure doesn't show up in every stroke after
+        heights = fullHeights;
+        incremental.bake (pool);
+
+        const TerrainRebakePass& properties = passes[TerrainRebakePassProperties];
+        ioTouched += (uint64_t)(properties.end.x - properties.origin.x) * (properties.end.y - properties.origin.y);
+        ioTotal += (uint64_t)width * height;
+    }
+}
+
+// The passes TerrainFillRebakePasses works out for the whole terrain cover every texel of every level
+static void TestFullPasses (uint32_t width, uint32_t height, uint32_t mipCount)
+{
+    TerrainRebakePass passes[TerrainRebakePassCOUNT];
+    TerrainFillRebakePasses (passes, TerrainMakeRebakePass (0, 0, (int)width, (int)height, 0, width, height),
+                             width, height, mipCount);
+
+    for (uint32_t level = 0; level < TERRAIN_MAX_MIP_LEVELS; level++)
+    {
+        const uint32_t levelWidth = std::max (width >> level, 1u), levelHeight = std::max (height >> level, 1u);
+        const TerrainRebakePass pass = level == 0 ? passes[TerrainRebakePassProperties]
+                                                  : passes[TerrainRebakePassPropertiesMip1 + level - 1];
+        if (level < mipCount)
+            TEST_CHECK (pass.origin.x == 0 && pass.origin.y == 0 && pass.end.x == levelWidth && pass.end.y == levelHeight &&
+                        pass.threadgroupsPerGrid[0] * TERRAIN_REBAKE_THREADGROUP_SIZE >= levelWidth &&
+                        pass.threadgroupsPerGrid[1] * TERRAIN_REBAKE_THREADGROUP_SIZE >= levelHeight,
+                        "%ux%u level %u pass covers [%u, %u) x [%u, %u)", width, height, level,
+                        pass.origin.x, pass.end.x, pass.origin.y, pass.end.y);
+        else
+            TEST_CHECK (TerrainRebakePassIsEmpty (pass), "%ux%u level %u is past the last mip but has a pass", width, height, level);
+    }
+}
+
+int main (int, const char*[])
+{
+    AAPLThreadPool pool;
+
+    const uint32_t sizes[][2] = { { 256, 256 }, { 192, 128 }, { 200, 136 }, { 128, 256 }, { 37, 5 } };
+    uint64_t touched = 0, total = 0;
+    for (const auto& size : sizes)
+    {
+        TestFullPasses (size[0], size[1], (uint32_t)log2 (std::max (size[0], size[1])) + 1);
+        TestStrokes (pool, size[0], size[1], touched, total);
+    }
+    printf ("The properties passes covered %.1f%% of the texels a full rebake does\n", 100.0 * touched / total);
+
+    if (gTestFailures == 0) printf ("AAPLTerrainRebakeTest: all passed\n");
+    return gTestFailures != 0;
+}
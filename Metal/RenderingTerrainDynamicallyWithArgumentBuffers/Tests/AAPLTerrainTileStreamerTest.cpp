@@ -0,0 +1,319 @@
+// Checks AAPLTerrainTileFile and AAPLTerrainTileStreamer: that tiles read back as written, borders and odd sizes
+//  included, and that as a camera moves over a synthetic world the streamer's page tables always point every tile
+//  at the finest resident tile covering it, slots hold the tiles they claim to, tiles are evicted least recently
+//  needed first, and a view it can hold settles without loading or evicting any more. Pass the synthetic world's
+//  width, and a number of frames, to time updates over a bigger one.
+
+#include <set>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "AAPLTerrainTileStreamer.h"
+#include "TestSupport.h"
+
+struct TileKey
+{
+    uint32_t    level;
+    uint32_t    tileX;
+    uint32_t    tileY;
+
+    bool operator< (const TileKey& other) const
+    {
+        if (level != other.level) return level < other.level;
+        return tileY != other.tileY ? tileY < other.tileY : tileX < other.tileX;
+    }
+
+    bool operator== (const TileKey& other) const
+    {
+        return level == other.level && tileX == other.tileX && tileY == other.tileY;
+    }
+};
+
+static std::set<TileKey> ResidentTiles (const AAPLTerrainTileFile& file, const AAPLTerrainTileStreamer& streamer)
+{
+    std::set<TileKey> resident;
+    for (uint32_t level = 0; level < file.levelCount (); level++)
+    {
+        for (uint32_t tileY = 0; tileY < file.tilesY (level); tileY++)
+        {
+            for (uint32_t tileX = 0; tileX < file.tilesX (level); tileX++)
+            {
+                if (streamer.isResident (level, tileX, tileY))
+                    resident.insert (TileKey { level, tileX, tileY });
+            }
+        }
+    }
+    return resident;
+}
+
+// Every page table entry names the finest resident tile covering its tile, no two resident tiles share a slot, and
+//  with checkTexels, every slot holds the heights of its tile
+static void CheckPageTables (const AAPLTerrainTileFile& file, const AAPLTerrainTileStreamer& streamer,
+                             uint32_t atlasSlots, bool checkTexels, const char* when)
+{
+    const uint32_t topLevel = file.levelCount () - 1;
+    std::set<uint32_t> usedSlots;
+    std::vector<uint16_t> texels (file.tileTexelCount ());
+    uint32_t wrongEntries = 0, sharedSlots = 0, wrongTexels = 0;
+
+    for (uint32_t level = 0; level < file.levelCount (); level++)
+    {
+        const std::vector<uint32_t>& pageTable = streamer.pageTable (level);
+        TEST_CHECK (pageTable.size () == (size_t)file.tilesX (level) * file.tilesY (level),
+                    "%s: level %u's page table has %zu entries", when, level, pageTable.size ());
+        if (pageTable.size () != (size_t)file.tilesX (level) * file.tilesY (level)) continue;
+
+        for (uint32_t tileY = 0; tileY < file.tilesY (level); tileY++)
+        {
+            for (uint32_t tileX = 0; tileX < file.tilesX (level); tileX++)
+            {
+                uint32_t residentLevel = level, residentX = tileX, residentY = tileY;
+                while (residentLevel < topLevel && !streamer.isResident (residentLevel, residentX, residentY))
+                {
+                    residentLevel++;
+                    residentX = std::min (residentX / 2, file.tilesX (residentLevel) - 1);
+                    residentY = std::min (residentY / 2, file.tilesY (residentLevel) - 1);
+                }
+
+                const uint32_t entry = pageTable[(size_t)tileY * file.tilesX (level) + tileX];
+                const uint32_t slot = AAPLTerrainTileStreamer::EntrySlot (entry);
+                if (AAPLTerrainTileStreamer::EntryLevel (entry) != residentLevel || slot >= atlasSlots)
+                {
+                    wrongEntries++;
+                    continue;
+                }
+                if (residentLevel != level) continue;
+
+                if (!usedSlots.insert (slot).second)
+                    sharedSlots++;
+                if (checkTexels && (!file.readTile (level, tileX, tileY, texels.data ()) ||
+                                    !std::equal (texels.begin (), texels.end (), streamer.slotTexels (slot))))
+                    wrongTexels++;
+            }
+        }
+    }
+
+    TEST_CHECK (wrongEntries == 0, "%s: %u page table entries are wrong", when, wrongEntries);
+    TEST_CHECK (sharedSlots == 0, "%s: %u slots hold more than one tile", when, sharedSlots);
+    TEST_CHECK (wrongTexels == 0, "%s: %u slots hold the wrong heights", when, wrongTexels);
+    TEST_CHECK (usedSlots.size () == streamer.stats ().residentTiles, "%s: %zu tiles are resident, stats say %u",
+                when, usedSlots.size (), streamer.stats ().residentTiles);
+}
+
+// Tiles of a file of odd size come back with their borders clamped to the edges of their level
+static void TestFileRoundTrip (const char* path)
+{
+    auto HeightAt = [] (uint32_t level, uint32_t x, uint32_t y) { return (uint16_t)(level * 10007 + x * 31 + y * 17); };
+    TEST_CHECK (AAPLTerrainTileFile::Write (path, 1000, 700, 64, 2, HeightAt), "can't write %s", path);
+
+    std::unique_ptr<AAPLTerrainTileFile> file = AAPLTerrainTileFile::Open (path);
+    TEST_CHECK (file != nullptr, "can't open %s", path);
+    if (file == nullptr) return;
+
+    const uint32_t levelCount = file->levelCount ();
+    TEST_CHECK (levelCount == AAPLTerrainTileFile::LevelCount (1000, 700, 64), "%u levels", levelCount);
+    TEST_CHECK (file->levelWidth (levelCount - 1) <= 64 && file->levelWidth (levelCount - 2) > 64,
+                "the levels don't stop at the first that fits in a tile");
+
+    const int32_t stride = (int32_t)file->tileStride ();
+    std::vector<uint16_t> texels (file->tileTexelCount ());
+    uint32_t wrongTiles = 0;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        for (uint32_t tileY = 0; tileY < file->tilesY (level); tileY++)
+        {
+            for (uint32_t tileX = 0; tileX < file->tilesX (level); tileX++)
+            {
+                bool same = file->readTile (level, tileX, tileY, texels.data ());
+                for (int32_t y = 0; y < stride && same; y++)
+                {
+                    for (int32_t x = 0; x < stride && same; x++)
+                    {
+                        const int32_t levelX = std::min (std::max ((int32_t)tileX * 64 + x - 2, 0), (int32_t)file->levelWidth (level) - 1);
+                        const int32_t levelY = std::min (std::max ((int32_t)tileY * 64 + y - 2, 0), (int32_t)file->levelHeight (level) - 1);
+                        same = texels[(size_t)y * stride + x] == HeightAt (level, (uint32_t)levelX, (uint32_t)levelY);
+                    }
+                }
+                if (!same) wrongTiles++;
+            }
+        }
+    }
+    TEST_CHECK (wrongTiles == 0, "%u tiles read back wrong", wrongTiles);
+
+    TEST_CHECK (!AAPLTerrainTileFile::Write ("/nonexistent/AAPLTerrainTileStreamerTest.th", 10, 10, 4, 1, HeightAt),
+                "wrote to a directory that doesn't exist");
+    TEST_CHECK (!AAPLTerrainTileFile::Open ("/nonexistent/AAPLTerrainTileStreamerTest.th"), "opened a missing file");
+
+    // The odd sized levels' last tiles cover the leftover tiles of the level below, which random views visit
+    const uint32_t atlasSlots = 40;
+    AAPLTerrainTileStreamer streamer (*file, AAPLTerrainStreamerParams { atlasSlots, 4, 0, 1.0f, 100.0f, { 0, 0 } });
+    CheckPageTables (*file, streamer, atlasSlots, true, "odd size, at first");
+
+    uint32_t seed = 1;
+    for (int i = 0; i < 300; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        const float x = (float)((seed >> 8) % 1100) - 50, z = (float)((seed >> 12) % 800) - 50;
+        streamer.update (AAPLTerrainStreamingView { { x, (float)(i % 200), z }, 500.0f, 2.0f });
+        CheckPageTables (*file, streamer, atlasSlots, true, "odd size, after an update");
+    }
+    TEST_CHECK (streamer.stats ().evictions > 0, "odd size: the views needed no evictions");
+}
+
+// A view over the synthetic world, from a point that goes round the middle of it as step goes up
+static AAPLTerrainStreamingView PathView (uint32_t width, float texelSpacing, float step)
+{
+    const float radius = width * texelSpacing * 0.35f, center = width * texelSpacing * 0.5f;
+    const float t = step * 0.004f;
+    return AAPLTerrainStreamingView { { center + radius * cosf (t), 300.0f + 200.0f * sinf (3 * t), center + radius * sinf (t) },
+                                      1080.0f / (2.0f * tanf (0.5f)), 2.0f };
+}
+
+static void TestCameraPath (const AAPLTerrainTileFile& file, unsigned loaderThreads, uint32_t frames)
+{
+    // Room for what any one view along the path needs, but not for everything it passes over
+    const uint32_t atlasSlots = 320;
+    const float texelSpacing = 2.0f;
+    AAPLTerrainTileStreamer streamer (file, AAPLTerrainStreamerParams { atlasSlots, 16, loaderThreads, texelSpacing,
+                                                                        1500.0f, { 0, 0 } });
+
+    uint32_t maxWanted = 0;
+    double seconds = 0;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        const AAPLTerrainStreamingView view = PathView (file.width (), texelSpacing, (float)frame);
+        seconds += TestTime (1, [&] { streamer.update (view); });
+        maxWanted = std::max (maxWanted, streamer.stats ().wantedTiles);
+        streamer.takeChangedSlots ();
+        streamer.takePageTablesChanged ();
+
+        if (frame % 50 == 0)
+        {
+            streamer.finishLoads ();
+            CheckPageTables (file, streamer, atlasSlots, frame % 250 == 0, "along the camera path");
+        }
+    }
+
+    // Once the view stops, its tiles all come in, and then nothing more loads
+    const AAPLTerrainStreamingView view = PathView (file.width (), texelSpacing, (float)frames);
+    for (int i = 0; i < 100; i++)
+    {
+        streamer.update (view);
+        streamer.finishLoads ();
+    }
+    const AAPLTerrainStreamerStats settled = streamer.stats ();
+    streamer.update (view);
+    streamer.finishLoads ();
+    TEST_CHECK (streamer.stats ().loadsStarted == settled.loadsStarted && streamer.stats ().evictions == settled.evictions,
+                "%u loader threads: a still view keeps loading", loaderThreads);
+    TEST_CHECK (settled.failedLoads == 0, "%u loader threads: %llu loads failed", loaderThreads,
+                (unsigned long long)settled.failedLoads);
+    CheckPageTables (file, streamer, atlasSlots, true, "at the end of the camera path");
+
+    printf ("%u loader threads: %.3f ms an update, up to %u tiles wanted, %llu loads (%.2f a frame), %llu evictions\n",
+            loaderThreads, seconds * 1000 / frames, maxWanted, (unsigned long long)settled.loadsStarted,
+            settled.loadsStarted / (double)frames, (unsigned long long)settled.evictions);
+}
+
+// Going from view A to B to C with just enough room for B's tiles and C's together, C evicts all of A's that it
+//  doesn't need itself, and none of B's
+static void TestLeastRecentlyNeeded (const AAPLTerrainTileFile& file)
+{
+    const float texelSpacing = 2.0f;
+    const float size = file.width () * texelSpacing;
+    const AAPLTerrainStreamingView views[3] = {
+        { { size * 0.2f, 100.0f, size * 0.2f }, 935.0f, 2.0f },
+        { { size * 0.8f, 100.0f, size * 0.2f }, 935.0f, 2.0f },
+        { { size * 0.5f, 100.0f, size * 0.8f }, 935.0f, 2.0f },
+    };
+    auto Settle = [] (AAPLTerrainTileStreamer& streamer, const AAPLTerrainStreamingView& view)
+    {
+        for (int i = 0; i < 100; i++)
+            streamer.update (view);
+    };
+
+    // The tiles each view needs, as a streamer with room for them all loads for it from scratch
+    std::set<TileKey> wanted[3];
+    for (int v = 0; v < 3; v++)
+    {
+        AAPLTerrainTileStreamer streamer (file, AAPLTerrainStreamerParams { 4096, 64, 0, texelSpacing, 1500.0f, { 0, 0 } });
+        Settle (streamer, views[v]);
+        wanted[v] = ResidentTiles (file, streamer);
+    }
+    std::set<TileKey> wantedBC = wanted[1];
+    wantedBC.insert (wanted[2].begin (), wanted[2].end ());
+
+    const uint32_t atlasSlots = (uint32_t)wantedBC.size ();
+    AAPLTerrainTileStreamer streamer (file, AAPLTerrainStreamerParams { atlasSlots, 64, 0, texelSpacing, 1500.0f, { 0, 0 } });
+    Settle (streamer, views[0]);
+    Settle (streamer, views[1]);
+    const std::set<TileKey> residentB = ResidentTiles (file, streamer);
+    TEST_CHECK (std::includes (residentB.begin (), residentB.end (), wanted[1].begin (), wanted[1].end ()),
+                "view B's tiles didn't all load");
+
+    const uint64_t evictionsBeforeC = streamer.stats ().evictions;
+    Settle (streamer, views[2]);
+    TEST_CHECK (streamer.stats ().evictions > evictionsBeforeC, "view C evicted nothing, so this checks nothing");
+    TEST_CHECK (ResidentTiles (file, streamer) == wantedBC, "after view C, other tiles than B's and C's are resident");
+    CheckPageTables (file, streamer, atlasSlots, true, "after views A, B and C");
+
+    printf ("views A, B and C want %zu, %zu and %zu tiles, B and C %zu together\n", wanted[0].size (), wanted[1].size (),
+            wanted[2].size (), wantedBC.size ());
+}
+
+// An atlas too small for what the view wants fills up with the tiles it wants most, and then stops
+static void TestSmallAtlas (const AAPLTerrainTileFile& file)
+{
+    const uint32_t atlasSlots = 24;
+    AAPLTerrainTileStreamer streamer (file, AAPLTerrainStreamerParams { atlasSlots, 16, 0, 2.0f, 1500.0f, { 0, 0 } });
+    const AAPLTerrainStreamingView view = PathView (file.width (), 2.0f, 0);
+    for (int i = 0; i < 50; i++)
+        streamer.update (view);
+
+    const uint64_t evictions = streamer.stats ().evictions;
+    for (int i = 0; i < 50; i++)
+        streamer.update (view);
+    TEST_CHECK (streamer.stats ().wantedTiles > atlasSlots, "the view wants only %u tiles", streamer.stats ().wantedTiles);
+    TEST_CHECK (streamer.stats ().evictions == evictions, "a still view keeps evicting with a small atlas");
+    CheckPageTables (file, streamer, atlasSlots, true, "with a small atlas");
+}
+
+int main (int argc, const char* argv[])
+{
+    const uint32_t width = (argc > 1) ? (uint32_t)atoi (argv[1]) : 2048;
+    const uint32_t frames = (argc > 2) ? (uint32_t)atoi (argv[2]) : 1600;
+
+    // Scratch files go in the working directory, which ctest makes the build directory
+    const char* oddPath = "AAPLTerrainTileStreamerTest_odd.th";
+    const char* worldPath = "AAPLTerrainTileStreamerTest_world.th";
+
+    TestFileRoundTrip (oddPath);
+    unlink (oddPath);
+
+    TEST_CHECK (TerrainSyntheticHeight (7, 0, 123, 456) == TerrainSyntheticHeight (7, 0, 123, 456),
+                "the synthetic heightmap changes between calls");
+    TEST_CHECK (TerrainSyntheticHeight (7, 0, 123, 456) != TerrainSyntheticHeight (8, 0, 123, 456),
+                "the synthetic heightmap ignores its seed");
+
+    const double writeSeconds = TestTime (1, [&] {
+        TEST_CHECK (AAPLTerrainTileFile::Write (worldPath, width, width, 128, 1,
+                                                [] (uint32_t level, uint32_t x, uint32_t y) { return TerrainSyntheticHeight (7, level, x, y); }),
+                    "can't write %s", worldPath);
+    });
+    std::unique_ptr<AAPLTerrainTileFile> world = AAPLTerrainTileFile::Open (worldPath);
+    TEST_CHECK (world != nullptr, "can't open %s", worldPath);
+    if (world != nullptr)
+    {
+        printf ("%u x %u world in %u levels, written in %.2f s\n", width, width, world->levelCount (), writeSeconds);
+
+        TestCameraPath (*world, 0, frames);
+        TestCameraPath (*world, 2, frames);
+        TestLeastRecentlyNeeded (*world);
+        TestSmallAtlas (*world);
+    }
+    unlink (worldPath);
+
+    if (gTestFailures == 0)
+        printf ("AAPLTerrainTileStreamerTest: all passed\n");
+    return gTestFailures != 0;
+}
@@ -0,0 +1,69 @@
+// Stand-in for simd/simd.h: just the vector types the terrain's C++ sources use, so they build with GCC as well as
+//  clang. The 8 lane integer vectors are GCC vector extensions, which subscript, compare and convert like clang's
+//  extended vectors. The float vectors are plain structs, because the sources also name their lanes x, y, z and w.
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+namespace simd
+{
+    typedef short           short8  __attribute__((vector_size(16)));
+    typedef unsigned short  ushort8 __attribute__((vector_size(16)));
+
+    struct uint2
+    {
+        uint32_t x, y;
+    };
+
+    // Adds the lane by lane arithmetic of clang's extended vectors to a struct of `Count` float lanes
+    #define SIMD_STAND_IN_FLOAT_OPERATORS(Type, Count)                                                              \
+        inline float& lane (Type& v, int i)                 { return (&v.x)[i]; }                                   \
+        inline float lane (const Type& v, int i)            { return (&v.x)[i]; }                                   \
+        inline Type operator+ (Type a, Type b)              { for (int i = 0; i < Count; i++) lane (a, i) += lane (b, i); return a; } \
+        inline Type operator- (Type a, Type b)              { for (int i = 0; i < Count; i++) lane (a, i) -= lane (b, i); return a; } \
+        inline Type operator* (Type a, Type b)              { for (int i = 0; i < Count; i++) lane (a, i) *= lane (b, i); return a; } \
+        inline Type operator/ (Type a, Type b)              { for (int i = 0; i < Count; i++) lane (a, i) /= lane (b, i); return a; } \
+        inline Type operator+ (Type a, float b)             { for (int i = 0; i < Count; i++) lane (a, i) += b; return a; } \
+        inline Type operator- (Type a, float b)             { for (int i = 0; i < Count; i++) lane (a, i) -= b; return a; } \
+        inline Type operator* (Type a, float b)             { for (int i = 0; i < Count; i++) lane (a, i) *= b; return a; } \
+        inline Type operator/ (Type a, float b)             { for (int i = 0; i < Count; i++) lane (a, i) /= b; return a; } \
+        inline Type operator* (float a, Type b)             { return b * a; }                                       \
+        inline Type operator- (Type a)                      { for (int i = 0; i < Count; i++) lane (a, i) = -lane (a, i); return a; } \
+        inline Type& operator+= (Type& a, Type b)           { return a = a + b; }                                   \
+        inline Type& operator-= (Type& a, Type b)           { return a = a - b; }                                   \
+        inline Type& operator*= (Type& a, float b)          { return a = a * b; }
+
+    struct float2
+    {
+        float x, y;
+        float& operator[] (int i)           { return (&x)[i]; }
+        float operator[] (int i) const      { return (&x)[i]; }
+    };
+
+    // float3 is the size of a float4, as on Apple platforms, and { x, y, z } fills it in as it does there
+    struct alignas(16) float3
+    {
+        float x, y, z, unused = 0;
+        float& operator[] (int i)           { return (&x)[i]; }
+        float operator[] (int i) const      { return (&x)[i]; }
+    };
+
+    struct alignas(16) float4
+    {
+        float x, y, z, w;
+        float& operator[] (int i)           { return (&x)[i]; }
+        float operator[] (int i) const      { return (&x)[i]; }
+    };
+
+    SIMD_STAND_IN_FLOAT_OPERATORS(float2, 2)
+    SIMD_STAND_IN_FLOAT_OPERATORS(float3, 3)
+    SIMD_STAND_IN_FLOAT_OPERATORS(float4, 4)
+
+    #undef SIMD_STAND_IN_FLOAT_OPERATORS
+
+    struct float4x4
+    {
+        float4 columns[4];
+    };
+}
@@ -0,0 +1,53 @@
+// Small helpers shared by the terrain tests and benchmarks. Each test is its own executable that prints what failed
+//  and returns non-zero, so ctest needs nothing more.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define TEST_CHECK(condition, ...)                              \
+    do                                                          \
+    {                                                           \
+        if (!(condition))                                       \
+        {                                                       \
+            fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);    \
+            fprintf (stderr, __VA_ARGS__);                      \
+            fprintf (stderr, "\n");                             \
+            ++gTestFailures;                                    \
+        }                                                       \
+    }                                                           \
+    while (0)
+
+static int gTestFailures = 0;
+
+// Seconds taken by iterations calls of block
+template <typename F>
+double TestTime (uint32_t iterations, F block)
+{
+    auto start = std::chrono::steady_clock::now ();
+    for (uint32_t i = 0; i < iterations; i++)
+        block ();
+    return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+// A 16 bit heightmap of rolling hills with some noise on top, the same for the same seed
+inline std::vector<uint16_t> TestHeightmap (uint32_t width, uint32_t height, uint32_t seed)
+{
+    std::vector<uint16_t> heights ((size_t)width * height);
+    uint32_t state = seed * 2654435761u + 1;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            state = state * 1664525u + 1013904223u;
+            const float noise = (float)(state >> 22) / 1024.0f;
+            const float h = 0.4f + 0.25f * sinf (x * 0.031f) * cosf (y * 0.027f) + 0.1f * sinf ((x + y) * 0.11f) + 0.02f * noise;
+            heights[(size_t)y * width + x] = (uint16_t)lrintf (std::min (std::max (h, 0.0f), 1.0f) * 65535.0f);
+        }
+    }
+    return heights;
+}